@@ -0,0 +1,194 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+/*
+bench_cmd.c
+
+Host side benchmark of the command parser.
+
+A script of the given number of lines (default 10000) is generated
+and stored with cmdParseScript, as gpioStoreScript and pigs PARSE do.
+The same lines are then parsed one command at a time with cmdParse,
+as the FIFO and pigs do.
+
+The time per pass, per line, and the lines per second are reported.
+
+bench_cmd [lines]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "pigpio.h"
+#include "command.h"
+
+#define PASSES 20
+
+/* a block using a spread of command types, tags are filled in */
+
+static char *body[]=
+{
+   "tag %d",
+   "ld v%d 100",
+   "w 4 1",
+   "mics 100",
+   "w 4 0",
+   "r 17",
+   "sta v2",
+   "pwm 18 128",
+   "dcr v1",
+   "jnz %d",
+   "m 4 w",
+   "pud 17 u",
+   "wvag 16 0 100 0 16 100",
+   "i2cwd 0 0x12 0x34 0x56",
+   "add 0x10",
+   "cmp p1",
+   "jp %d",
+   "servo 25 1500",
+   "call %d",
+   "tick",
+};
+
+#define BODY (sizeof(body)/sizeof(body[0]))
+
+/* ----------------------------------------------------------------------- */
+
+static char *makeScript(int lines)
+{
+   char *script, *pos;
+   int i, block;
+
+   script = malloc(lines * 32);
+
+   pos = script;
+
+   for (i=0; i<lines; i++)
+   {
+      /* only the first blocks define a tag, later blocks reuse them */
+
+      block = i / BODY;
+
+      if (((i % BODY) == 0) && (block >= PI_MAX_SCRIPT_TAGS))
+         pos += sprintf(pos, "nop");
+      else
+         pos += sprintf(pos, body[i % BODY], block % PI_MAX_SCRIPT_TAGS);
+
+      *pos++ = '\n';
+   }
+
+   *pos = 0;
+
+   return script;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static double secs(struct timespec *t0, struct timespec *t1)
+{
+   return (t1->tv_sec - t0->tv_sec) + ((t1->tv_nsec - t0->tv_nsec) / 1e9);
+}
+
+/* ----------------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+   static char ext[CMD_MAX_EXTENSION];
+   struct timespec t0, t1;
+   cmdScript_t s;
+   cmdCtlParse_t ctl;
+   uint32_t p[10];
+   char *script;
+   int lines, len, pass, status, cmds, idx;
+   double t;
+
+   if (argc > 1) lines = atoi(argv[1]); else lines = 10000;
+
+   script = makeScript(lines);
+
+   len = strlen(script);
+
+   printf("lines=%d bytes=%d passes=%d\n", lines, len, PASSES);
+   printf("            pass(ms)  line(us)  lines/s\n");
+
+   status = 0;
+
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+
+   for (pass=0; pass<PASSES; pass++)
+   {
+      status = cmdParseScript(script, &s, 1);
+
+      free(s.par);
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+
+   t = secs(&t0, &t1) / PASSES;
+
+   printf("script      %8.3f  %8.3f  %.0f%s\n",
+      t * 1000.0, (t * 1e6) / lines, lines / t,
+      status ? " PARSE FAILED" : "");
+
+   cmds = 0;
+
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+
+   for (pass=0; pass<PASSES; pass++)
+   {
+      ctl.eaten = 0;
+
+      while (ctl.eaten < len)
+      {
+         idx = cmdParse(script, p, sizeof(ext), ext, &ctl);
+
+         if (idx < 0)
+         {
+            printf("%s: bad command\n", cmdStr());
+            return 1;
+         }
+
+         cmds++;
+      }
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+
+   t = secs(&t0, &t1) / PASSES;
+
+   printf("commands    %8.3f  %8.3f  %.0f%s\n",
+      t * 1000.0, (t * 1e6) / lines, lines / t,
+      (cmds == (lines * PASSES)) ? "" : " MISCOUNT");
+
+   free(script);
+
+   return status ? 1 : 0;
+}
+
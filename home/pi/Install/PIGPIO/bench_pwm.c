@@ -0,0 +1,436 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+/*
+bench_pwm.c
+
+Host side benchmark of the DMA table writes made by PWM updates.
+
+The gpio on/off words are laid out in the same page/slot arrangement
+as the DMA input pages.  One update sets a new random dutycycle on
+each of the given number of gpios, it is applied three ways.
+
+old     each gpio read-modify-writes its off words in the DMA pages
+        (as up to pigpio V38), new levels set then old levels cleared.
+
+each    each gpio is staged and its changed words written at once
+        (gpioPWM outside gpioPWMBegin/gpioPWMCommit).
+
+commit  all gpios are staged and the changed words written in one
+        sweep (gpioPWMBegin, gpioPWM ..., gpioPWMCommit).
+
+The uncached DMA page reads and writes per update and the time per
+update are reported for several PWM frequencies (at the default 5
+microsecond sample rate).  The final tables are checked to be the
+same for all three.
+
+bench_pwm [gpios [updates]]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/* layout as pigpio.c */
+
+#define PULSE_PER_CYCLE  25
+#define CBS_PER_IPAGE   117
+#define LVS_PER_IPAGE    38
+#define OFF_PER_IPAGE    38
+#define TCK_PER_IPAGE     2
+#define ON_PER_IPAGE      2
+#define PAD_PER_IPAGE     7
+
+#define SUPERCYCLE 800
+#define SUPERLEVEL 20000
+
+#define PWM_PASS_ALL  0
+#define PWM_PASS_ADD  1
+#define PWM_PASS_HOLD 2
+
+#define PAGES ((SUPERLEVEL / OFF_PER_IPAGE) + 1)
+
+#define RANGE 255
+
+typedef struct
+{
+   uint32_t cb[CBS_PER_IPAGE*8];
+   uint32_t level[LVS_PER_IPAGE];
+   uint32_t gpioOff[OFF_PER_IPAGE];
+   uint32_t tick[TCK_PER_IPAGE];
+   uint32_t gpioOn[ON_PER_IPAGE];
+   uint32_t periphData;
+   uint32_t pad[PAD_PER_IPAGE];
+} dmaIPage_t;
+
+static dmaIPage_t *dmaIVirt[PAGES];
+
+static unsigned dmaReads, dmaWrites;
+
+static uint32_t pwmOnCur [SUPERCYCLE];
+static uint32_t pwmOnNew [SUPERCYCLE];
+static uint32_t pwmOffCur[SUPERLEVEL+1];
+static uint32_t pwmOffNew[SUPERLEVEL+1];
+static uint32_t pwmDirty [SUPERLEVEL/32];
+
+/* ----------------------------------------------------------------------- */
+
+static uint32_t *offWord(int pos)
+{
+   return &dmaIVirt[pos/OFF_PER_IPAGE]->gpioOff[pos%OFF_PER_IPAGE];
+}
+
+/* ----------------------------------------------------------------------- */
+
+static uint32_t *onWord(int pos)
+{
+   return &dmaIVirt[pos/ON_PER_IPAGE]->gpioOn[pos%ON_PER_IPAGE];
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* as mySetGpioOff etc. up to pigpio V38 */
+
+static void rmw(uint32_t *word, unsigned gpio, int on)
+{
+   uint32_t v;
+
+   v = *word;
+   dmaReads++;
+
+   if (on) v |= (1<<gpio); else v &= ~(1<<gpio);
+
+   *word = v;
+   dmaWrites++;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void oldSetPwm(
+   unsigned gpio, int realRange, int cycles, int oldVal, int newVal)
+{
+   int newOff, oldOff, i;
+
+   newOff = (newVal * realRange)/RANGE;
+   oldOff = (oldVal * realRange)/RANGE;
+
+   if (newOff == oldOff) return;
+
+   if (newOff && oldOff)
+   {
+      for (i=0; i<SUPERLEVEL; i+=realRange) rmw(offWord(i+newOff), gpio, 1);
+      for (i=0; i<SUPERLEVEL; i+=realRange) rmw(offWord(i+oldOff), gpio, 0);
+   }
+   else if (newOff)
+   {
+      for (i=0; i<SUPERLEVEL; i+=realRange) rmw(offWord(i+newOff), gpio, 1);
+      for (i=0; i<SUPERCYCLE; i+=cycles)    rmw(onWord(i), gpio, 1);
+   }
+   else
+   {
+      for (i=0; i<SUPERCYCLE; i+=cycles)    rmw(onWord(i), gpio, 0);
+      for (i=0; i<SUPERLEVEL; i+=realRange) rmw(offWord(i+oldOff), gpio, 0);
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* must be kept in step with pwmStage, pwmWriteKey and pwmSweep */
+
+static void stage(uint32_t *tab, unsigned pos, unsigned key,
+   unsigned gpio, int on)
+{
+   if (on) tab[pos] |= (1<<gpio); else tab[pos] &= ~(1<<gpio);
+
+   pwmDirty[key>>5] |= (1<<(key&31));
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void stageOff(unsigned gpio, int pos, int on)
+{
+   stage(pwmOffNew, pos, pos-1, gpio, on);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void stageOn(unsigned gpio, int pos, int on)
+{
+   stage(pwmOnNew, pos, pos*PULSE_PER_CYCLE, gpio, on);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void writeKey(unsigned key, int pass)
+{
+   uint32_t v;
+   int on, off;
+
+   on = -1;
+
+   if (!(key % PULSE_PER_CYCLE))
+   {
+      on = key / PULSE_PER_CYCLE;
+
+      v = pwmOnNew[on];
+
+      if (pass == PWM_PASS_ADD) v |= pwmOnCur[on];
+
+      if (v != pwmOnCur[on])
+      {
+         *onWord(on) = v;
+         pwmOnCur[on] = v;
+         dmaWrites++;
+      }
+   }
+
+   off = key + 1;
+
+   v = pwmOffNew[off];
+
+   if (pass == PWM_PASS_ADD) v |= pwmOffCur[off];
+
+   if (v != pwmOffCur[off])
+   {
+      *offWord(off) = v;
+      pwmOffCur[off] = v;
+      dmaWrites++;
+   }
+
+   if ((pwmOffCur[off] == pwmOffNew[off]) &&
+       ((on < 0) || (pwmOnCur[on] == pwmOnNew[on])))
+      pwmDirty[key>>5] &= ~(1<<(key&31));
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void sweep(unsigned start, unsigned count, int pass)
+{
+   unsigned n, key, span;
+   uint32_t bits;
+
+   n = 0;
+
+   while (n < count)
+   {
+      key  = (start + n) % SUPERLEVEL;
+      span = 32 - (key & 31);
+
+      if (span > (count - n)) span = count - n;
+
+      bits = pwmDirty[key>>5] >> (key & 31);
+
+      if (span < 32) bits &= (1U<<span) - 1;
+
+      while (bits)
+      {
+         writeKey(key + __builtin_ctz(bits), pass);
+
+         bits &= bits - 1;
+      }
+
+      n += span;
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void newSetPwm(
+   unsigned gpio, int realRange, int cycles, int oldVal, int newVal)
+{
+   int newOff, oldOff, i;
+
+   newOff = (newVal * realRange)/RANGE;
+   oldOff = (oldVal * realRange)/RANGE;
+
+   if (newOff == oldOff) return;
+
+   if (newOff && oldOff)
+   {
+      for (i=0; i<SUPERLEVEL; i+=realRange) stageOff(gpio, i+newOff, 1);
+      for (i=0; i<SUPERLEVEL; i+=realRange) stageOff(gpio, i+oldOff, 0);
+   }
+   else if (newOff)
+   {
+      for (i=0; i<SUPERLEVEL; i+=realRange) stageOff(gpio, i+newOff, 1);
+      for (i=0; i<SUPERCYCLE; i+=cycles)    stageOn(gpio, i, 1);
+   }
+   else
+   {
+      for (i=0; i<SUPERCYCLE; i+=cycles)    stageOn(gpio, i, 0);
+      for (i=0; i<SUPERLEVEL; i+=realRange) stageOff(gpio, i+oldOff, 0);
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void clearTables(void)
+{
+   int p;
+
+   for (p=0; p<PAGES; p++) memset(dmaIVirt[p], 0, sizeof(dmaIPage_t));
+
+   memset(pwmOnCur,  0, sizeof(pwmOnCur));
+   memset(pwmOnNew,  0, sizeof(pwmOnNew));
+   memset(pwmOffCur, 0, sizeof(pwmOffCur));
+   memset(pwmOffNew, 0, sizeof(pwmOffNew));
+   memset(pwmDirty,  0, sizeof(pwmDirty));
+}
+
+/* ----------------------------------------------------------------------- */
+
+static uint32_t tableSum(void)
+{
+   uint32_t sum;
+   int i;
+
+   sum = 0;
+
+   for (i=0; i<SUPERCYCLE; i++) sum = (sum * 31) + *onWord(i);
+   for (i=0; i<=SUPERLEVEL; i++) sum = (sum * 31) + *offWord(i);
+
+   return sum;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* mode 0 old, 1 each, 2 commit */
+
+static double run(int mode, int gpios, int updates,
+   int realRange, int cycles, uint32_t *sum)
+{
+   struct timespec t0, t1;
+   int val[32];
+   int u, g, v;
+
+   clearTables();
+
+   memset(val, 0, sizeof(val));
+
+   dmaReads  = 0;
+   dmaWrites = 0;
+
+   srandom(1);
+
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+
+   for (u=0; u<updates; u++)
+   {
+      for (g=0; g<gpios; g++)
+      {
+         v = random() % (RANGE + 1);
+
+         if (mode == 0)
+            oldSetPwm(g, realRange, cycles, val[g], v);
+         else
+         {
+            newSetPwm(g, realRange, cycles, val[g], v);
+
+            if (mode == 1)
+            {
+               sweep(0, SUPERLEVEL, PWM_PASS_ADD);
+               sweep(0, SUPERLEVEL, PWM_PASS_HOLD);
+            }
+         }
+
+         val[g] = v;
+      }
+
+      if (mode == 2) sweep(0, SUPERLEVEL, PWM_PASS_ALL);
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+
+   *sum = tableSum();
+
+   return (t1.tv_sec - t0.tv_sec) + ((t1.tv_nsec - t0.tv_nsec) / 1e9);
+}
+
+/* ----------------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+   static const int freqIdx[] = {0, 5, 9, 13, 17};
+
+   static const uint16_t pwmCycles[] =
+      {  1,    2,    4,    5,    8,   10,   16,    20,    25,
+        32,   40,   50,   80,  100,  160,  200,   400,   800};
+
+   static const uint16_t pwmRealRange[] =
+      { 25,   50,  100,  125,  200,  250,  400,   500,   625,
+       800, 1000, 1250, 2000, 2500, 4000, 5000, 10000, 20000};
+
+   static const char *name[] = {"old", "each", "commit"};
+
+   int gpios, updates, i, m, p, realRange, cycles;
+   unsigned reads[3], writes[3];
+   uint32_t sum[3];
+   double secs[3];
+
+   if (argc > 1) gpios   = atoi(argv[1]); else gpios   = 16;
+   if (argc > 2) updates = atoi(argv[2]); else updates = 200;
+
+   if ((gpios < 1) || (gpios > 32) || (updates < 1))
+   {
+      fprintf(stderr, "gpios must be 1-32, updates 1 or more\n");
+      return 1;
+   }
+
+   for (p=0; p<PAGES; p++) dmaIVirt[p] = malloc(sizeof(dmaIPage_t));
+
+   printf("%d gpios, %d updates, per update figures\n", gpios, updates);
+   printf("   Hz  range  mode     reads   writes      us\n");
+
+   for (i=0; i<(sizeof(freqIdx)/sizeof(freqIdx[0])); i++)
+   {
+      realRange = pwmRealRange[freqIdx[i]];
+      cycles    = pwmCycles   [freqIdx[i]];
+
+      for (m=0; m<3; m++)
+      {
+         secs[m] = run(m, gpios, updates, realRange, cycles, &sum[m]);
+
+         reads[m]  = dmaReads;
+         writes[m] = dmaWrites;
+      }
+
+      for (m=0; m<3; m++)
+      {
+         printf("%5d  %5d  %-6s  %6u  %7u  %7.1f%s\n",
+            8000 / cycles, realRange, name[m],
+            reads[m] / updates, writes[m] / updates,
+            secs[m] * 1e6 / updates,
+            (sum[m] == sum[0]) ? "" : " MISMATCH");
+      }
+   }
+
+   for (p=0; p<PAGES; p++) free(dmaIVirt[p]);
+
+   return 0;
+}
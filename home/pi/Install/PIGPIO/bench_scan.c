@@ -0,0 +1,369 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+/*
+bench_scan.c
+
+Host side benchmark of the pthAlertThread sample scan.
+
+Synthetic level words are laid out in the same page/slot arrangement
+as the DMA input pages and fed through the slot at a time scanner
+(as used up to pigpio V38) and the run at a time scanner.
+
+The time to process one second of samples is reported for each of
+the 1, 2, 4, and 5 microsecond sample rates, together with the
+percentage of one core that represents.
+
+bench_scan [edges per second]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+/* layout as pigpio.c */
+
+#define PULSE_PER_CYCLE  25
+#define CBS_PER_IPAGE   117
+#define LVS_PER_IPAGE    38
+#define OFF_PER_IPAGE    38
+#define TCK_PER_IPAGE     2
+#define ON_PER_IPAGE      2
+#define PAD_PER_IPAGE     7
+#define DATUMS         2000
+
+#define BUFFER_MILLIS   120
+#define SCAN_BATCH      100
+
+typedef struct
+{
+   uint32_t cb[CBS_PER_IPAGE*8];
+   uint32_t level[LVS_PER_IPAGE];
+   uint32_t gpioOff[OFF_PER_IPAGE];
+   uint32_t tick[TCK_PER_IPAGE];
+   uint32_t gpioOn[ON_PER_IPAGE];
+   uint32_t periphData;
+   uint32_t pad[PAD_PER_IPAGE];
+} dmaIPage_t;
+
+typedef struct
+{
+   uint32_t tick;
+   uint32_t level;
+} gpioSample_t;
+
+typedef struct
+{
+   int slot;
+   int cycle;
+   int pulse;
+   uint32_t tick;
+   uint32_t level;
+} scanState_t;
+
+static dmaIPage_t **dmaIVirt;
+static int bufferCycles;
+static int clockMicros;
+static gpioSample_t gpioSample[DATUMS];
+
+/* ----------------------------------------------------------------------- */
+
+static uint32_t myGetLevel(int pos)
+{
+   return dmaIVirt[pos/LVS_PER_IPAGE]->level[pos%LVS_PER_IPAGE];
+}
+
+/* ----------------------------------------------------------------------- */
+
+static uint32_t myGetTick(int pos)
+{
+   return dmaIVirt[pos/TCK_PER_IPAGE]->tick[pos%TCK_PER_IPAGE];
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* must be kept in step with myScanLevels in pigpio.c */
+
+static int myScanLevels(
+   const uint32_t *level, int count, uint32_t mask, uint32_t oldLevel)
+{
+   int i = 0;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+   uint32x4_t vMask, vOld, vDiff;
+   uint64x2_t vAny;
+
+   vMask = vdupq_n_u32(mask);
+   vOld  = vdupq_n_u32(oldLevel);
+
+   while ((i+4) <= count)
+   {
+      vDiff = veorq_u32(vandq_u32(vld1q_u32(level+i), vMask), vOld);
+      vAny  = vreinterpretq_u64_u32(vDiff);
+
+      if (vgetq_lane_u64(vAny, 0) | vgetq_lane_u64(vAny, 1)) break;
+
+      i += 4;
+   }
+#else
+   while ((i+4) <= count)
+   {
+      if (((level[i  ] ^ oldLevel) |
+           (level[i+1] ^ oldLevel) |
+           (level[i+2] ^ oldLevel) |
+           (level[i+3] ^ oldLevel)) & mask) break;
+
+      i += 4;
+   }
+#endif
+
+   while ((i < count) && !((level[i] ^ oldLevel) & mask)) i++;
+
+   return i;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void nextCycle(scanState_t *s)
+{
+   s->pulse = 0;
+
+   if (++s->cycle >= bufferCycles)
+   {
+      s->cycle = 0;
+      s->slot = 0;
+   }
+
+   s->tick = myGetTick(s->cycle);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int scanSlots(scanState_t *s, int newSlot, uint32_t mask)
+{
+   uint32_t level, newLevel, oldLevel;
+   int numSamples = 0;
+
+   oldLevel = s->level & mask;
+
+   while ((s->slot != newSlot) && (numSamples < DATUMS))
+   {
+      level = myGetLevel(s->slot++);
+
+      newLevel = (level & mask);
+
+      if (newLevel != oldLevel)
+      {
+         gpioSample[numSamples].tick  = s->tick;
+         gpioSample[numSamples].level = level;
+
+         oldLevel = newLevel;
+
+         numSamples++;
+      }
+
+      s->tick += clockMicros;
+
+      if (++s->pulse >= PULSE_PER_CYCLE) nextCycle(s);
+   }
+
+   s->level = oldLevel;
+
+   return numSamples;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int scanRuns(scanState_t *s, int newSlot, uint32_t mask)
+{
+   uint32_t level, oldLevel;
+   const uint32_t *levels;
+   int numSamples = 0;
+   int run, n;
+
+   oldLevel = s->level & mask;
+
+   while ((s->slot != newSlot) && (numSamples < DATUMS))
+   {
+      run = LVS_PER_IPAGE - (s->slot % LVS_PER_IPAGE);
+
+      if (run > (PULSE_PER_CYCLE - s->pulse)) run = PULSE_PER_CYCLE - s->pulse;
+
+      if ((newSlot > s->slot) && (run > (newSlot - s->slot)))
+         run = newSlot - s->slot;
+
+      levels = dmaIVirt[s->slot / LVS_PER_IPAGE]->level +
+         (s->slot % LVS_PER_IPAGE);
+
+      n = 0;
+
+      while (n < run)
+      {
+         n += myScanLevels(levels+n, run-n, mask, oldLevel);
+
+         if (n < run)
+         {
+            level = levels[n];
+
+            gpioSample[numSamples].tick  = s->tick + (n * clockMicros);
+            gpioSample[numSamples].level = level;
+
+            oldLevel = level & mask;
+
+            n++;
+
+            if (++numSamples >= DATUMS) break;
+         }
+      }
+
+      s->slot  += n;
+      s->pulse += n;
+      s->tick  += (n * clockMicros);
+
+      if (s->pulse >= PULSE_PER_CYCLE) nextCycle(s);
+   }
+
+   s->level = oldLevel;
+
+   return numSamples;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void fillPages(int edgesPerSec)
+{
+   int slots, pos, cycle, gap;
+   uint32_t level = 0;
+
+   slots = bufferCycles * PULSE_PER_CYCLE;
+
+   /* average gap between edges in slots */
+
+   gap = (1000000 / clockMicros) / (edgesPerSec ? edgesPerSec : 1);
+
+   if (gap < 1) gap = 1;
+
+   srandom(1);
+
+   for (pos=0; pos<slots; pos++)
+   {
+      if ((random() % gap) == 0) level ^= (1 << (random() % 28));
+
+      dmaIVirt[pos/LVS_PER_IPAGE]->level[pos%LVS_PER_IPAGE] = level;
+   }
+
+   for (cycle=0; cycle<bufferCycles; cycle++)
+   {
+      dmaIVirt[cycle/TCK_PER_IPAGE]->tick[cycle%TCK_PER_IPAGE] =
+         cycle * PULSE_PER_CYCLE * clockMicros;
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+static double runScan(
+   int (*scan)(scanState_t *, int, uint32_t), int slots, long *samples)
+{
+   struct timespec t0, t1;
+   scanState_t s;
+   int total, done, newSlot;
+
+   memset(&s, 0, sizeof(s));
+
+   total = bufferCycles * PULSE_PER_CYCLE;
+
+   *samples = 0;
+
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+
+   for (done=0; done<slots; done+=SCAN_BATCH)
+   {
+      newSlot = (s.slot + SCAN_BATCH) % total;
+
+      while (s.slot != newSlot) *samples += scan(&s, newSlot, 0x0FFFFFFF);
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+
+   return (t1.tv_sec - t0.tv_sec) + ((t1.tv_nsec - t0.tv_nsec) / 1e9);
+}
+
+/* ----------------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+   static const int micros[] = {1, 2, 4, 5};
+   int edgesPerSec, i, p, pages, slots;
+   long oldSamples, newSamples;
+   double oldSecs, newSecs;
+
+   if (argc > 1) edgesPerSec = atoi(argv[1]); else edgesPerSec = 10000;
+
+   printf("edges/s=%d\n", edgesPerSec);
+   printf("us  slots/s    old(ms)  new(ms)  old%%   new%%   samples\n");
+
+   for (i=0; i<(sizeof(micros)/sizeof(micros[0])); i++)
+   {
+      clockMicros = micros[i];
+
+      bufferCycles = (BUFFER_MILLIS * 1000) / (PULSE_PER_CYCLE * clockMicros);
+
+      pages = ((bufferCycles * PULSE_PER_CYCLE) / LVS_PER_IPAGE) + 1;
+
+      if (((bufferCycles / TCK_PER_IPAGE) + 1) > pages)
+         pages = (bufferCycles / TCK_PER_IPAGE) + 1;
+
+      dmaIVirt = malloc(pages * sizeof(dmaIPage_t *));
+
+      for (p=0; p<pages; p++) dmaIVirt[p] = calloc(1, sizeof(dmaIPage_t));
+
+      fillPages(edgesPerSec);
+
+      slots = 1000000 / clockMicros;
+
+      oldSecs = runScan(scanSlots, slots, &oldSamples);
+      newSecs = runScan(scanRuns,  slots, &newSamples);
+
+      printf("%d  %-9d  %7.3f  %7.3f  %5.2f  %5.2f  %ld%s\n",
+         clockMicros, slots, oldSecs * 1000.0, newSecs * 1000.0,
+         oldSecs * 100.0, newSecs * 100.0, newSamples,
+         (oldSamples == newSamples) ? "" : " MISMATCH");
+
+      for (p=0; p<pages; p++) free(dmaIVirt[p]);
+
+      free(dmaIVirt);
+   }
+
+   return 0;
+}
+
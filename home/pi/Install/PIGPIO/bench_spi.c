@@ -0,0 +1,149 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+/*
+bench_spi.c
+
+Pi side benchmark of the main SPI device, polled against DMA.
+
+Transfers of the given size are repeated for the given number of
+seconds at 1, 8, and 32 MHz, first with the polling loop (spiOpen
+flag D set) and then with DMA.  The throughput and the CPU time used
+by the calling thread, as a percentage of one core, are reported.
+
+If MOSI is linked to MISO the received data is checked against what
+was sent.  The simulated library (make SIM=1) loops the DMA transfers
+back, the polled transfers are not modelled.
+
+Needs root.  The SPI gpios of the chosen channel are driven.
+
+sudo ./bench_spi [channel [bytes [seconds]]]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pigpio.h"
+
+#define MAX_BYTES 65535
+
+static char txBuf[MAX_BYTES];
+static char rxBuf[MAX_BYTES];
+
+/* ----------------------------------------------------------------------- */
+
+static double secs(clockid_t clk)
+{
+   struct timespec ts;
+
+   clock_gettime(clk, &ts);
+
+   return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int run(
+   unsigned channel, unsigned baud, unsigned flags,
+   unsigned bytes, double seconds)
+{
+   double w0, c0, wall, cpu;
+   unsigned xfers, good;
+   int h, i;
+
+   h = spiOpen(channel, baud, flags);
+
+   if (h < 0) return h;
+
+   xfers = 0;
+   wall  = 0;
+   good  = 0;
+
+   w0 = secs(CLOCK_MONOTONIC);
+   c0 = secs(CLOCK_THREAD_CPUTIME_ID);
+
+   do
+   {
+      for (i=0; i<bytes; i++) txBuf[i] = xfers + i;
+
+      if (spiXfer(h, txBuf, rxBuf, bytes) != bytes) break;
+
+      if (!memcmp(txBuf, rxBuf, bytes)) good++;
+
+      xfers++;
+
+      wall = secs(CLOCK_MONOTONIC) - w0;
+   }
+   while (wall < seconds);
+
+   cpu = secs(CLOCK_THREAD_CPUTIME_ID) - c0;
+
+   spiClose(h);
+
+   printf("%4u MHz %-6s %10.0f  %5.1f%%  %5u/%u\n",
+      baud / 1000000, (flags & PI_SPI_FLAGS_NO_DMA(1)) ? "poll" : "dma",
+      (double)xfers * bytes / wall, 100.0 * cpu / wall, good, xfers);
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+   static const unsigned mhz[] = {1, 8, 32};
+
+   unsigned channel, bytes, i;
+   double seconds;
+
+   if (argc > 1) channel = atoi(argv[1]); else channel = 0;
+   if (argc > 2) bytes   = atoi(argv[2]); else bytes   = 4096;
+   if (argc > 3) seconds = atof(argv[3]); else seconds = 2.0;
+
+   if ((bytes < 1) || (bytes > MAX_BYTES))
+   {
+      fprintf(stderr, "bytes must be 1-%d\n", MAX_BYTES);
+      return 1;
+   }
+
+   if (gpioInitialise() < 0) return 1;
+
+   printf("%u byte transfers on channel %u\n", bytes, channel);
+   printf("   speed mode      bytes/s    cpu    looped\n");
+
+   for (i=0; i<(sizeof(mhz)/sizeof(mhz[0])); i++)
+   {
+      run(channel, mhz[i] * 1000000, PI_SPI_FLAGS_NO_DMA(1), bytes, seconds);
+      run(channel, mhz[i] * 1000000, 0, bytes, seconds);
+   }
+
+   gpioTerminate();
+
+   return 0;
+}
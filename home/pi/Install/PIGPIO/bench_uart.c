@@ -0,0 +1,827 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+/*
+bench_uart.c
+
+Host side benchmark of the bit bang serial receive decoder.
+
+A recorded waveform is replayed as level words at each of the 1, 2,
+4, and 5 microsecond sample rates through the edge at a time decoder
+(as used up to pigpio V38, one alert callback per gpio per edge plus
+watchdog timeouts) and the shared decoder which looks only at the words
+where a serial gpio changes level.
+
+The recording is a stream of gpioReport_t notification records, as
+written to /dev/pigpioN or captured with pigs NB.  Without a recording
+one is synthesised with the given number of channels (gpios 0 up)
+each sending random 8 bit frames at the given baud.  The synthesised
+recording may be saved with -w.
+
+The best time of several passes to decode one second of samples is
+reported for each decoder together with the percentage of one core
+that represents, and the bytes decoded.  Synthesised data is checked
+against what was sent, recorded data is checked for agreement between
+the decoders.
+
+bench_uart [-w file] [channels [baud]]
+bench_uart -r file [baud]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "pigpio.h"
+
+#define MILLION 1000000
+
+#define PULSE_PER_CYCLE  25
+#define SCAN_BATCH      100
+#define DATUMS         2000
+
+#define PASSES 5
+
+#define DATA_BITS  8
+#define SEND_MICROS MILLION
+#define OUT_SIZE   (64*1024)
+#define PAD_MICROS 50000
+
+#define SRX_FRAC    8
+
+typedef struct
+{
+   uint32_t fullBit; /* nanoseconds */
+   uint32_t halfBit; /* nanoseconds */
+   int      timeout; /* milliseconds, old decoder */
+   uint32_t startBitTick; /* microseconds */
+   uint32_t nextBitDiff; /* nanoseconds */
+   uint32_t lastEdge; /* old decoder watchdog */
+   uint32_t fullPos; /* samples << SRX_FRAC */
+   uint32_t halfPos; /* samples << SRX_FRAC */
+   uint32_t nextBit; /* samples << SRX_FRAC since the start bit */
+   uint32_t startPos; /* sample of the start bit */
+   uint32_t endPos;   /* sample of the last data bit */
+   int      bit;
+   uint32_t data;
+   int      level;
+   uint8_t *out;
+   int      outPos;
+} chan_t;
+
+static chan_t chan[32];
+static uint32_t chanBits;
+
+static int clockMicros;
+
+static gpioSample_t gpioSample[DATUMS];
+static int numSamples;
+
+static void (*alertFunc[32])(int gpio, int level, uint32_t tick);
+
+static uint32_t srxActive, srxPrev, srxPos, srxEnd;
+
+/* ----------------------------------------------------------------------- */
+
+static void putByte(chan_t *c)
+{
+   if (c->outPos < OUT_SIZE) c->out[c->outPos++] = c->data;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* must be kept in step with myScanLevels in pigpio.c */
+
+static int myScanLevels(
+   const uint32_t *level, int count, uint32_t mask, uint32_t oldLevel)
+{
+   int i = 0;
+
+   while ((i+4) <= count)
+   {
+      if (((level[i  ] ^ oldLevel) |
+           (level[i+1] ^ oldLevel) |
+           (level[i+2] ^ oldLevel) |
+           (level[i+3] ^ oldLevel)) & mask) break;
+
+      i += 4;
+   }
+
+   while ((i < count) && !((level[i] ^ oldLevel) & mask)) i++;
+
+   return i;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* the pigpio V38 waveRxSerial, called per gpio per edge */
+
+static void oldRxSerial(chan_t *c, int level, uint32_t tick)
+{
+   int diffTicks, lastLevel;
+
+   if (c->bit >= 0)
+   {
+      diffTicks = tick - c->startBitTick;
+
+      if (level != PI_TIMEOUT)
+      {
+         c->level = level;
+         lastLevel = !level;
+      }
+      else lastLevel = c->level;
+
+      while ((c->bit <= DATA_BITS) && (diffTicks > (c->nextBitDiff/1000)))
+      {
+         if (c->bit)
+         {
+            if (lastLevel) c->data |= (1<<(c->bit-1));
+         }
+         else c->data = 0;
+
+         ++(c->bit);
+
+         c->nextBitDiff += c->fullBit;
+      }
+
+      if (c->bit > DATA_BITS)
+      {
+         putByte(c);
+
+         if (level == 0)
+         {
+            c->bit          = 0;
+            c->startBitTick = tick;
+            c->nextBitDiff  = c->halfBit;
+         }
+         else c->bit = -1;
+      }
+   }
+   else
+   {
+      if (level == 0)
+      {
+         c->level        = 0;
+         c->bit          = 0;
+         c->startBitTick = tick;
+         c->nextBitDiff  = c->halfBit;
+      }
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void oldRxBit(int gpio, int level, uint32_t tick)
+{
+   oldRxSerial(&chan[gpio], level, tick);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void oldScan(
+   const uint32_t *levels, int count, uint32_t tick, uint32_t *oldLevel)
+{
+   int i = 0;
+
+   /* as the alert thread, keep the words where a monitored bit changes */
+
+   while ((i < count) && (numSamples < DATUMS))
+   {
+      i += myScanLevels(levels+i, count-i, chanBits, *oldLevel);
+
+      if (i >= count) break;
+
+      gpioSample[numSamples].tick  = tick + (i * clockMicros);
+      gpioSample[numSamples].level = levels[i];
+
+      numSamples++;
+
+      *oldLevel = levels[i] & chanBits;
+
+      i++;
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void oldAlerts(uint32_t tick, uint32_t *reportedLevel)
+{
+   uint32_t oldLevel, newLevel, changes, todo;
+   int d, b;
+
+   /* as the alert thread, one callback per gpio per edge */
+
+   oldLevel = *reportedLevel;
+
+   for (d=0; d<numSamples; d++)
+   {
+      newLevel = gpioSample[d].level & chanBits;
+
+      changes = newLevel ^ oldLevel;
+
+      for (todo=changes; todo; todo&=(todo-1))
+      {
+         b = __builtin_ctz(todo);
+
+         chan[b].lastEdge = gpioSample[d].tick;
+
+         (alertFunc[b])(b, (newLevel>>b) & 1, gpioSample[d].tick);
+      }
+
+      oldLevel = newLevel;
+   }
+
+   *reportedLevel = oldLevel;
+
+   numSamples = 0;
+
+   /* then the armed watchdogs */
+
+   for (todo=chanBits; todo; todo&=(todo-1))
+   {
+      b = __builtin_ctz(todo);
+
+      if (chan[b].bit < 0) continue;
+
+      if ((int32_t)(tick - chan[b].lastEdge) > (chan[b].timeout*1000))
+      {
+         chan[b].lastEdge += (chan[b].timeout*1000);
+
+         (alertFunc[b])(b, PI_TIMEOUT, tick);
+      }
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* must be kept in step with the srx functions in pigpio.c */
+
+static void srxSettle(chan_t *c, uint32_t samples, uint32_t level)
+{
+   uint32_t limit = samples << SRX_FRAC;
+
+   /* the data bits sampled before samples since the start bit */
+
+   while ((c->bit <= DATA_BITS) && (c->nextBit < limit))
+   {
+      c->data |= (level<<(c->bit-1));
+
+      ++(c->bit);
+
+      c->nextBit += c->fullPos;
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void srxStart(int gpio, uint32_t pos)
+{
+   chan_t *c = &chan[gpio];
+   uint32_t last;
+
+   /* the start bit itself is not sampled */
+
+   c->bit      = 1;
+   c->data     = 0;
+   c->nextBit  = c->halfPos + c->fullPos;
+   c->startPos = pos;
+
+   /* the frame ends at the sample of its last data bit */
+
+   last = (c->halfPos + (DATA_BITS * c->fullPos)) >> SRX_FRAC;
+
+   if (last < 1) last = 1;
+
+   c->endPos = pos + last;
+
+   if (!srxActive || ((int32_t)(c->endPos - srxEnd) < 0)) srxEnd = c->endPos;
+
+   srxActive |= (1<<gpio);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void srxDecode(const uint32_t *levels, int count)
+{
+   uint32_t bits, level, prev, changed, idle, todo, pos, next;
+   chan_t *c;
+   int i, g;
+
+   bits = chanBits;
+   prev = srxPrev;
+
+   i = 0;
+
+   while (i < count)
+   {
+      i += myScanLevels(levels+i, count-i, bits, prev);
+
+      if (i >= count) break;
+
+      pos   = srxPos + i;
+      level = levels[i] & bits;
+
+      changed = level ^ prev;
+
+      idle = ~srxActive;
+
+      /* an edge settles the bits of a frame sampled before it */
+
+      for (todo=changed & srxActive; todo; todo&=(todo-1))
+      {
+         g = __builtin_ctz(todo);
+         c = &chan[g];
+
+         srxSettle(c, pos - c->startPos, (prev>>g) & 1);
+
+         if ((int32_t)(pos - c->endPos) >= 0)
+         {
+            srxSettle(c, (pos - c->startPos) + 1, (level>>g) & 1);
+
+            srxActive &= ~(1<<g);
+
+            putByte(c);
+
+            /* an edge on the last data bit is not a start bit */
+
+            if (pos != c->endPos) idle |= (1<<g);
+         }
+      }
+
+      /* start bits, high to low on an idle gpio */
+
+      for (todo=changed & prev & idle; todo; todo&=(todo-1))
+      {
+         srxStart(__builtin_ctz(todo), pos);
+      }
+
+      prev = level;
+
+      i++;
+   }
+
+   srxPos += count;
+   srxPrev = prev;
+
+   /* frames which ended without a later edge */
+
+   if (srxActive && ((int32_t)(srxPos - srxEnd) > 0))
+   {
+      next = srxPos + 0x7FFFFFFF;
+
+      for (todo=srxActive; todo; todo&=(todo-1))
+      {
+         g = __builtin_ctz(todo);
+         c = &chan[g];
+
+         if ((int32_t)(srxPos - c->endPos) > 0)
+         {
+            srxSettle(c, (c->endPos - c->startPos) + 1, (prev>>g) & 1);
+
+            srxActive &= ~(1<<g);
+
+            putByte(c);
+         }
+         else if ((int32_t)(c->endPos - next) < 0) next = c->endPos;
+      }
+
+      srxEnd = next;
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void resetChannels(int baud)
+{
+   uint32_t todo;
+   int b, bitTime, timeout;
+
+   bitTime = (1000 * MILLION) / baud;
+
+   timeout = ((DATA_BITS+2) * bitTime) / MILLION;
+
+   if (timeout < 1) timeout = 1;
+
+   for (todo=chanBits; todo; todo&=(todo-1))
+   {
+      b = __builtin_ctz(todo);
+
+      chan[b].fullBit = bitTime;
+      chan[b].halfBit = (bitTime/2)+500;
+      chan[b].fullPos = ((uint64_t)bitTime << SRX_FRAC) / (clockMicros * 1000);
+      chan[b].halfPos =
+         ((uint64_t)((bitTime/2)+500) << SRX_FRAC) / (clockMicros * 1000);
+      chan[b].timeout = timeout;
+      chan[b].bit     = -1;
+      chan[b].outPos  = 0;
+   }
+
+   numSamples = 0;
+
+   srxActive = 0;
+   srxPos    = 0;
+   srxPrev   = chanBits;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static gpioReport_t *synthesise(
+   int channels, int baud, uint8_t **sent, int *sentCount, int *numReports)
+{
+   gpioReport_t *rep;
+   int max, n, b, f, bit;
+   uint32_t level, *next, *frame, t, first;
+   int *pos, bitMicros;
+
+   bitMicros = MILLION / baud;
+
+   if (bitMicros < 1) bitMicros = 1;
+
+   max = (channels * (SEND_MICROS / bitMicros) * 2) + 16;
+
+   rep   = malloc(max * sizeof(gpioReport_t));
+   next  = calloc(channels, sizeof(uint32_t));
+   frame = calloc(channels, sizeof(uint32_t));
+   pos   = calloc(channels, sizeof(int));
+
+   srandom(1);
+
+   /*
+   Each channel sends random bytes, with a random start time and
+   random idle gaps, one bit time per frame position.  pos -1 is idle.
+   */
+
+   for (b=0; b<channels; b++)
+   {
+      next[b] = random() % (bitMicros * 16);
+      pos[b]  = -1;
+   }
+
+   level = (1<<channels) - 1;
+
+   n = 0;
+
+   first = 1;
+
+   while (1)
+   {
+      t = SEND_MICROS;
+
+      for (b=0; b<channels; b++) if (next[b] < t) t = next[b];
+
+      if (t >= SEND_MICROS) break;
+
+      for (b=0; b<channels; b++)
+      {
+         if (next[b] != t) continue;
+
+         if (pos[b] < 0)
+         {
+            frame[b] = random() & 0xFF;
+            pos[b]   = 0;
+
+            if (sentCount[b] < OUT_SIZE) sent[b][sentCount[b]++] = frame[b];
+         }
+
+         /* frame positions: start, data bits, stop */
+
+         f = pos[b];
+
+         if      (f == 0)         bit = 0;
+         else if (f <= DATA_BITS) bit = (frame[b] >> (f-1)) & 1;
+         else                     bit = 1;
+
+         if (bit) level |= (1<<b); else level &= ~(1<<b);
+
+         if (f > DATA_BITS)
+         {
+            pos[b]  = -1;
+            next[b] = t + (bitMicros * (1 + (random() % 4)));
+
+            /* don't start a frame which can't finish */
+
+            if ((next[b] + ((DATA_BITS+2) * bitMicros)) >= SEND_MICROS)
+               next[b] = SEND_MICROS;
+         }
+         else
+         {
+            pos[b]++;
+            next[b] = t + ((((f+1) * MILLION) / baud) - ((f * MILLION) / baud));
+         }
+      }
+
+      if (first || (level != rep[n-1].level))
+      {
+         rep[n].seqno = n;
+         rep[n].flags = 0;
+         rep[n].tick  = t;
+         rep[n].level = level;
+         n++;
+         first = 0;
+      }
+   }
+
+   free(next);
+   free(frame);
+   free(pos);
+
+   *numReports = n;
+
+   return rep;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static uint32_t *expand(gpioReport_t *rep, int numReports, int *numSlots)
+{
+   uint32_t *levels, level, t0, micros;
+   int slots, s, r;
+
+   t0 = rep[0].tick;
+
+   /* time after the last edge for the old decoder timeouts */
+
+   micros = rep[numReports-1].tick - t0 + PAD_MICROS;
+
+   if (micros < SEND_MICROS) micros = SEND_MICROS;
+
+   slots = micros / clockMicros;
+
+   slots -= (slots % SCAN_BATCH);
+
+   levels = malloc(slots * sizeof(uint32_t));
+
+   level = rep[0].level;
+
+   r = 0;
+
+   for (s=0; s<slots; s++)
+   {
+      while ((r < numReports) &&
+             ((rep[r].tick - t0) <= (uint32_t)(s * clockMicros)))
+      {
+         if (!(rep[r].flags & ~PI_NTFY_FLAGS_WDOG)) level = rep[r].level;
+         r++;
+      }
+
+      levels[s] = level;
+   }
+
+   *numSlots = slots;
+
+   return levels;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static double runPass(int newDecoder, const uint32_t *levels, int slots)
+{
+   struct timespec t0, t1;
+   uint32_t tick = 0, oldLevel = chanBits, reportedLevel = chanBits;
+   int done, run;
+
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+
+   for (done=0; done<slots; done+=SCAN_BATCH)
+   {
+      /* in cycle sized runs as the alert thread scan */
+
+      for (run=0; run<SCAN_BATCH; run+=PULSE_PER_CYCLE)
+      {
+         if (newDecoder)
+            srxDecode(levels+done+run, PULSE_PER_CYCLE);
+         else
+            oldScan(levels+done+run, PULSE_PER_CYCLE, tick, &oldLevel);
+
+         tick += (PULSE_PER_CYCLE * clockMicros);
+      }
+
+      if (!newDecoder) oldAlerts(tick, &reportedLevel);
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+
+   return (t1.tv_sec - t0.tv_sec) + ((t1.tv_nsec - t0.tv_nsec) / 1e9);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static double runDecode(
+   int newDecoder, const uint32_t *levels, int slots, int baud)
+{
+   double secs, best = 0.0;
+   int p;
+
+   /* best of several passes, each from a clean start */
+
+   for (p=0; p<PASSES; p++)
+   {
+      resetChannels(baud);
+
+      secs = runPass(newDecoder, levels, slots);
+
+      if ((p == 0) || (secs < best)) best = secs;
+   }
+
+   return best;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static long checkOutput(uint8_t **ref, int *refCount, int *bad)
+{
+   uint32_t todo;
+   long bytes = 0;
+   int b;
+
+   /* counts the channels which differ from the reference */
+
+   *bad = 0;
+
+   for (todo=chanBits; todo; todo&=(todo-1))
+   {
+      b = __builtin_ctz(todo);
+
+      bytes += chan[b].outPos;
+
+      if ((chan[b].outPos != refCount[b]) ||
+          memcmp(chan[b].out, ref[b], refCount[b])) (*bad)++;
+   }
+
+   return bytes;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void usage(void)
+{
+   fprintf(stderr, "bench_uart [-w file] [channels [baud]]\n");
+   fprintf(stderr, "bench_uart -r file [baud]\n");
+   exit(1);
+}
+
+/* ----------------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+   static const int micros[] = {1, 2, 4, 5};
+   char *rdFile = NULL, *wrFile = NULL;
+   int channels = 16, baud = 19200;
+   int numReports, slots, i, b, opt, oldBad, newBad;
+   long bytes;
+   double oldSecs, newSecs, scale;
+   gpioReport_t *rep;
+   uint32_t *levels;
+   uint8_t *sent[32], *oldOut[32];
+   int sentCount[32], oldCount[32];
+   FILE *fp;
+   long size;
+
+   for (b=0; b<32; b++)
+   {
+      alertFunc[b] = oldRxBit;
+
+      chan[b].out  = malloc(OUT_SIZE);
+      oldOut[b]    = malloc(OUT_SIZE);
+      sent[b]      = malloc(OUT_SIZE);
+      sentCount[b] = 0;
+   }
+
+   opt = 1;
+
+   while ((opt+1 < argc) && (argv[opt][0] == '-'))
+   {
+      if      (strcmp(argv[opt], "-r") == 0) rdFile = argv[opt+1];
+      else if (strcmp(argv[opt], "-w") == 0) wrFile = argv[opt+1];
+      else usage();
+
+      opt += 2;
+   }
+
+   if (rdFile)
+   {
+      if (opt < argc) baud = atoi(argv[opt++]);
+
+      fp = fopen(rdFile, "rb");
+
+      if (fp == NULL) { perror(rdFile); return 1; }
+
+      fseek(fp, 0, SEEK_END);
+      size = ftell(fp);
+      fseek(fp, 0, SEEK_SET);
+
+      numReports = size / sizeof(gpioReport_t);
+
+      if (numReports < 1) { fprintf(stderr, "%s: empty\n", rdFile); return 1; }
+
+      rep = malloc(numReports * sizeof(gpioReport_t));
+
+      if (fread(rep, sizeof(gpioReport_t), numReports, fp) != numReports)
+      {
+         perror(rdFile);
+         return 1;
+      }
+
+      fclose(fp);
+
+      /* decode every gpio which changes */
+
+      chanBits = 0;
+
+      for (i=1; i<numReports; i++)
+         chanBits |= (rep[i].level ^ rep[i-1].level);
+   }
+   else
+   {
+      if (opt < argc) channels = atoi(argv[opt++]);
+      if (opt < argc) baud = atoi(argv[opt++]);
+
+      if ((channels < 1) || (channels > 31)) usage();
+
+      chanBits = (1<<channels) - 1;
+
+      rep = synthesise(channels, baud, sent, sentCount, &numReports);
+
+      if (wrFile)
+      {
+         fp = fopen(wrFile, "wb");
+
+         if (fp == NULL) { perror(wrFile); return 1; }
+
+         fwrite(rep, sizeof(gpioReport_t), numReports, fp);
+
+         fclose(fp);
+      }
+   }
+
+   if ((baud < PI_BB_SER_MIN_BAUD) || (baud > PI_BB_SER_MAX_BAUD)) usage();
+
+   printf("channels=%d gpios=%08X baud=%d reports=%d\n",
+      __builtin_popcount(chanBits), chanBits, baud, numReports);
+   /* channels decoded differently from what was sent (or to old) */
+
+   printf("us  slots/s    old(ms)  new(ms)  old%%   new%%   bytes  "
+          "old-bad  new-bad\n");
+
+   for (i=0; i<(sizeof(micros)/sizeof(micros[0])); i++)
+   {
+      clockMicros = micros[i];
+
+      levels = expand(rep, numReports, &slots);
+
+      /* scale to one second of samples */
+
+      scale = (double)SEND_MICROS / (slots * clockMicros);
+
+      oldSecs = runDecode(0, levels, slots, baud) * scale;
+
+      if (rdFile) oldBad = 0;
+      else        checkOutput(sent, sentCount, &oldBad);
+
+      for (b=0; b<32; b++)
+      {
+         memcpy(oldOut[b], chan[b].out, chan[b].outPos);
+         oldCount[b] = chan[b].outPos;
+      }
+
+      newSecs = runDecode(1, levels, slots, baud) * scale;
+
+      if (rdFile) bytes = checkOutput(oldOut, oldCount, &newBad);
+      else        bytes = checkOutput(sent, sentCount, &newBad);
+
+      printf("%d  %-9d  %7.3f  %7.3f  %5.2f  %5.2f  %-5ld  %-7d  %d\n",
+         clockMicros, MILLION / clockMicros, oldSecs * 1000.0,
+         newSecs * 1000.0, oldSecs * 100.0, newSecs * 100.0,
+         bytes, oldBad, newBad);
+
+      free(levels);
+   }
+
+   return 0;
+}
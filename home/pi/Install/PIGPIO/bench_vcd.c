@@ -0,0 +1,269 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+/*
+bench_vcd.c
+
+Host side benchmark of pig2vcd.
+
+A synthetic recording of the given number of edges (default 100
+million) on 8 gpios is generated and piped as gpioReport_t
+notification records into a converter whose output is discarded.
+The 32 bit ticks start just before they wrap.
+
+The converter is pig2vcd (-b 0xFF so it converts as the reports
+arrive), then pig2vcd -z, then the one report per read() and printf
+per gpio converter used up to pigpio V38 (built in, on a tenth of the
+edges as it is so much slower).  Another converter command may be
+given, it is run with the reports on stdin.
+
+The elapsed time and edges per second are reported for each.
+
+bench_vcd [edges [command]]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "pigpio.h"
+
+#define BLOCK_REPORTS 65536
+
+#define BITS 0xFF
+
+/* ----------------------------------------------------------------------- */
+
+static double secs(struct timespec *t0, struct timespec *t1)
+{
+   return (t1->tv_sec - t0->tv_sec) + ((t1->tv_nsec - t0->tv_nsec) / 1e9);
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* the converter as used up to pigpio V38 */
+
+static int legacyGetReport(gpioReport_t *r)
+{
+   char *p = (char *)r;
+   int got, n;
+
+   /* /dev/pigpioN never splits a report but a pipe from here may */
+
+   for (got=0; got<sizeof(*r); got+=n)
+   {
+      n = read(STDIN_FILENO, p+got, sizeof(*r)-got);
+      if (n <= 0) return 0;
+   }
+
+   return 1;
+}
+
+static int legacySymbol(int bit)
+{
+   if (bit < 26) return ('A' + bit);
+   else          return ('a' + bit - 26);
+}
+
+static void legacy(void)
+{
+   gpioReport_t r;
+   int b, v;
+   uint32_t t0, lastLevel, changed;
+
+   if (!legacyGetReport(&r)) exit(-1);
+
+   printf("$timescale 1 us $end\n");
+   printf("$scope module top $end\n");
+
+   for (b=0; b<32; b++)
+      printf("$var wire 1 %c %d $end\n", legacySymbol(b), b);
+
+   printf("$upscope $end\n");
+   printf("$enddefinitions $end\n");
+
+   t0 = r.tick;
+   lastLevel = 0;
+
+   while (legacyGetReport(&r))
+   {
+      if (r.level != lastLevel)
+      {
+         printf("#%u\n", r.tick - t0);
+
+         changed = r.level ^ lastLevel;
+
+         lastLevel = r.level;
+
+         for (b=0; b<32; b++)
+         {
+            if (changed & (1<<b))
+            {
+               if (r.level & (1<<b)) v='1'; else v='0';
+
+               printf("%c%c\n", v, legacySymbol(b));
+            }
+         }
+      }
+   }
+
+   fflush(stdout);
+}
+
+/* ----------------------------------------------------------------------- */
+
+/*
+Pipes edges synthetic reports into command (or the legacy converter
+if NULL) and returns the seconds until it exits.
+*/
+
+static double run(char *command, uint64_t edges)
+{
+   static gpioReport_t block[BLOCK_REPORTS];
+   struct timespec t0, t1;
+   uint64_t sent;
+   uint32_t tick, level, x;
+   int fd[2], i, n, status, nul;
+   pid_t pid;
+   char *p;
+
+   if (pipe(fd)) return -1;
+
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+
+   pid = fork();
+
+   if (pid == 0)
+   {
+      close(fd[1]);
+      dup2(fd[0], STDIN_FILENO);
+      nul = open("/dev/null", O_WRONLY);
+      dup2(nul, STDOUT_FILENO);
+
+      if (command) execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+      else legacy();
+
+      _exit(0);
+   }
+
+   close(fd[0]);
+
+   tick  = 0xFFFFFFFF - 1000000;
+   level = 0;
+   x     = 1;
+
+   for (sent=0; sent<edges; sent+=n)
+   {
+      if ((edges - sent) < BLOCK_REPORTS) n = edges - sent;
+      else                                n = BLOCK_REPORTS;
+
+      for (i=0; i<n; i++)
+      {
+         /* xorshift, one or (1 in 8) two of the gpios per report */
+
+         x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+
+         tick  += 1 + (x & 15);
+         level ^= (1 << ((x >> 4) & 7));
+
+         if (((x >> 7) & 7) == 0) level ^= (1 << ((x >> 10) & 7));
+
+         block[i].seqno = sent + i;
+         block[i].flags = 0;
+         block[i].tick  = tick;
+         block[i].level = level;
+      }
+
+      p = (char *)block;
+
+      for (i=n*sizeof(gpioReport_t); i>0; )
+      {
+         status = write(fd[1], p, i);
+
+         if (status <= 0) break;
+
+         p += status;
+         i -= status;
+      }
+
+      if (i) break;
+   }
+
+   close(fd[1]);
+
+   waitpid(pid, &status, 0);
+
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+
+   return secs(&t0, &t1);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void report(char *name, uint64_t edges, double t)
+{
+   printf("%-22s %10llu  %8.2f  %12.0f\n",
+      name, (unsigned long long)edges, t, edges / t);
+}
+
+/* ----------------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+   char command[64];
+   uint64_t edges;
+
+   if (argc > 1) edges = strtoull(argv[1], NULL, 0); else edges = 100000000;
+
+   /* a converter which stops early must not stop the benchmark */
+
+   signal(SIGPIPE, SIG_IGN);
+
+   printf("converter                   edges      secs       edges/s\n");
+
+   if (argc > 2)
+   {
+      report(argv[2], edges, run(argv[2], edges));
+      return 0;
+   }
+
+   sprintf(command, "./pig2vcd -b %d", BITS);
+   report("pig2vcd", edges, run(command, edges));
+
+   sprintf(command, "./pig2vcd -z -b %d", BITS);
+   report("pig2vcd -z", edges, run(command, edges));
+
+   report("V38 pig2vcd", edges/10, run(NULL, edges/10));
+
+   return 0;
+}
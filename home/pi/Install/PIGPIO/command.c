@@ -55,6 +55,10 @@ cmdInfo_t cmdInfo[]=
    {PI_CMD_BS1,   "BS1",   111, 1}, // gpioWrite_Bits_0_31_Set
    {PI_CMD_BS2,   "BS2",   111, 1}, // gpioWrite_Bits_32_53_Set
 
+   {PI_CMD_CAPOFF,"CAPOFF",101, 0}, // gpioCaptureStop
+   {PI_CMD_CAPON, "CAPON", 133, 0}, // gpioCaptureStart
+   {PI_CMD_CAPST, "CAPST", 101, 9}, // gpioCaptureStatus
+
    {PI_CMD_CF1,   "CF1",   195, 2}, // gpioCustom1
    {PI_CMD_CF2,   "CF2",   195, 6}, // gpioCustom2
 
@@ -64,6 +68,10 @@ cmdInfo_t cmdInfo[]=
    {PI_CMD_GDC,   "GDC",   112, 2}, // gpioGetPWMdutycycle
    {PI_CMD_GPW,   "GPW",   112, 2}, // gpioGetServoPulsewidth
 
+   {PI_CMD_GRPC,  "GRPC",  112, 0}, // gpioGroupClose
+   {PI_CMD_GRPO,  "GRPO",  197, 2}, // gpioGroupOpen
+   {PI_CMD_GRPW,  "GRPW",  122, 0}, // gpioGroupWrite
+
    {PI_CMD_HELP,  "H",     101, 5}, // cmdUsage
    {PI_CMD_HELP,  "HELP",  101, 5}, // cmdUsage
 
@@ -106,6 +114,7 @@ cmdInfo_t cmdInfo[]=
 
    {PI_CMD_NB,    "NB",    122, 0}, // gpioNotifyBegin
    {PI_CMD_NC,    "NC",    112, 0}, // gpioNotifyClose
+   {PI_CMD_NF,    "NF",    122, 0}, // gpioNotifyFormat
    {PI_CMD_NO,    "NO",    101, 2}, // gpioNotifyOpen
    {PI_CMD_NP,    "NP",    112, 0}, // gpioNotifyPause
 
@@ -116,6 +125,9 @@ cmdInfo_t cmdInfo[]=
 
    {PI_CMD_PIGPV, "PIGPV", 101, 4}, // gpioVersion
 
+   {PI_CMD_POLLOFF,"POLLOFF",112,0}, // gpioPollStop
+   {PI_CMD_POLLON,"POLLON",134, 2}, // gpioPollStart
+
    {PI_CMD_PRG,   "PRG",   112, 2}, // gpioGetPWMrange
 
    {PI_CMD_PROC,  "PROC",  115, 2}, // gpioStoreScript
@@ -129,6 +141,9 @@ cmdInfo_t cmdInfo[]=
 
    {PI_CMD_PUD,   "PUD",   126, 0}, // gpioSetPullUpDown
 
+   {PI_CMD_PWMB,  "PWMB",  101, 0}, // gpioPWMBegin
+   {PI_CMD_PWMC,  "PWMC",  101, 2}, // gpioPWMCommit
+
    {PI_CMD_PWM,   "P",     121, 0}, // gpioPWM
    {PI_CMD_PWM,   "PWM",   121, 0}, // gpioPWM
 
@@ -139,6 +154,8 @@ cmdInfo_t cmdInfo[]=
    {PI_CMD_SERWB, "SERWB", 121, 0}, // serWriteByte
    {PI_CMD_SERC,  "SERC",  112, 0}, // serClose
    {PI_CMD_SERDA, "SERDA", 112, 2}, // serDataAvailable
+   {PI_CMD_SERNOFF,"SERNOFF",112,0}, // serNotifyStop
+   {PI_CMD_SERNON,"SERNON",135, 0}, // serNotifyStart
    {PI_CMD_SERO,  "SERO",  132, 2}, // serOpen
    {PI_CMD_SERR,  "SERR",  121, 6}, // serRead
    {PI_CMD_SERW,  "SERW",  193, 0}, // serWrite
@@ -154,11 +171,13 @@ cmdInfo_t cmdInfo[]=
    {PI_CMD_SPIC,  "SPIC",  112, 0}, // spiClose
    {PI_CMD_SPIO,  "SPIO",  131, 2}, // spiOpen
    {PI_CMD_SPIR,  "SPIR",  121, 6}, // spiRead
+   {PI_CMD_SPISG, "SPISG", 193, 6}, // spiSegments
    {PI_CMD_SPIW,  "SPIW",  193, 0}, // spiWrite
    {PI_CMD_SPIX,  "SPIX",  193, 6}, // spiXfer
 
    {PI_CMD_TICK,  "T",     101, 4}, // gpioTick
    {PI_CMD_TICK,  "TICK",  101, 4}, // gpioTick
+   {PI_CMD_T64,   "T64",   101, 8}, // gpioTick64
 
    {PI_CMD_TRIG,  "TRIG",  131, 0}, // gpioTrigger
 
@@ -241,6 +260,10 @@ BR2              Read bank 2 gpios\n\
 BS1 bits         Set gpios in bank 2\n\
 BS2 bits         Set gpios in bank 2\n\
 \n\
+CAPOFF           Stop capture\n\
+CAPON bits kb tbits tlevels pre file | Capture to /opt/pigpio/capture/file\n\
+CAPST            Get capture state, samples, and bytes\n\
+\n\
 CF1 ...          Custom function 1\n\
 CF2 ...          Custom function 2\n\
 \n\
@@ -250,6 +273,10 @@ CSI v            Configuration set internals\n\
 GDC g            Get PWM dutycycle for gpio\n\
 GPW g            Get servo pulsewidth for gpio\n\
 \n\
+GRPC h           Close gpio group handle\n\
+GRPO g ...       Open gpio group, first gpio is value bit 0\n\
+GRPW h v         Write value to gpio group\n\
+\n\
 H/HELP           Display command help\n\
 HC g f           Set hardware clock frequency\n\
 HP g f dc        Set hardware PWM frequency and dutycycle\n\
@@ -281,6 +308,7 @@ MILS n           Delay for milliseconds\n\
 \n\
 NB h bits        Start notification\n\
 NC h             Close notification\n\
+NF h format      Set notification format (1 for 64 bit ticks)\n\
 NO               Request a notification\n\
 NP h             Pause notification\n\
 \n\
@@ -289,6 +317,8 @@ PARSE text       Validate script\n\
 PFG g            Get gpio PWM frequency\n\
 PFS g v          Set gpio PWM frequency\n\
 PIGPV            Get pigpio library version\n\
+POLLOFF job      Stop poll job\n\
+POLLON h dev flags micros rxlen ... | Poll device onto notification\n\
 PRG g            Get gpio PWM range\n\
 PROC text        Store script\n\
 PROCD sid        Delete script\n\
@@ -298,12 +328,16 @@ PROCS sid        Stop script\n\
 PRRG g           Get gpio PWM real range\n\
 PRS g v          Set gpio PWM range\n\
 PUD g pud        Set gpio pull up/down\n\
+PWMB             Hold PWM and servo changes\n\
+PWMC             Apply held PWM and servo changes\n\
 \n\
 R/READ g         Read gpio level\n\
 \n\
 S/SERVO g v      Set gpio servo pulsewidth\n\
 SERC h           Close serial handle\n\
 SERDA h          Check for serial data ready to read\n\
+SERNOFF h        Stop serial notification\n\
+SERNON h ser delim count | Send serial bytes to notification\n\
 SERO text baud flags | Open serial device at baud with flags\n\
 SERR h n         Read bytes from serial handle\n\
 SERRB h          Read byte from serial handle\n\
@@ -316,10 +350,12 @@ SLRI g invert    Invert serial logic (1 invert, 0 normal)\n\
 SPIC h           SPI close handle\n\
 SPIO channel baud flags | SPI open channel at baud with flags\n\
 SPIR h v         SPI read bytes from handle\n\
+SPISG h ...      SPI transfer segments with handle\n\
 SPIW h ...       SPI write bytes to handle\n\
 SPIX h ...       SPI transfer bytes to handle\n\
 \n\
 T/TICK           Get current tick\n\
+T64              Get current 64 bit tick\n\
 TRIG g micros l  Trigger level for micros on gpio\n\
 \n\
 W/WRITE g l      Write level to gpio\n\
@@ -479,74 +515,238 @@ static errInfo_t errInfo[]=
    {PI_BAD_EDGE         , "bad ISR edge, not 1, 1, or 2"},
    {PI_BAD_ISR_INIT     , "bad ISR initialisation"},
    {PI_BAD_FOREVER      , "loop forever must be last chain command"},
+   {PI_BAD_SOCK_CLIENTS , "socket clients not 1-1024"},
+   {PI_BAD_BATCH        , "bad batch command"},
+   {PI_BAD_NOTIFY_FMT   , "bad notify format or notify running"},
+   {PI_BAD_TIMER_MICS   , "timer micros not 100-3600000000"},
+   {PI_WAVE_STREAMING   , "wave stream open, or not open"},
+   {PI_BAD_CAPTURE      , "bad capture parameter or file"},
+   {PI_CAPTURE_BUSY     , "capture already started"},
+   {PI_I2C_PENDING      , "queued I2C transaction not complete"},
+   {PI_BAD_POLL         , "bad poll job flags or lengths"},
+   {PI_BAD_SPI_SEG      , "bad SPI segment count, delay, or flags"},
+   {PI_BAD_GROUP        , "bad group gpio count, or bad or repeated gpio"},
+   {PI_NOT_CAPTURING    , "no capture started"},
 
 };
 
 static char * fmtMdeStr="RW540123";
 static char * fmtPudStr="ODU";
 
-static int cmdMatch(char *str)
+/*
+Command names are looked up through a perfect hash of the name.
+
+CMD_HASH_SEED is chosen so that no two names in cmdInfo share a slot.
+The table is filled before main runs.  Should an edit to cmdInfo
+introduce a collision the seed is advanced until there is none, so
+lookups stay correct, but CMD_HASH_SEED should then be updated to
+save the search at start up.
+*/
+
+#define CMD_HASH_SIZE 2048
+#define CMD_HASH_SEED 0x811CA2DA
+
+#define CMD_INFOS (sizeof(cmdInfo)/sizeof(cmdInfo_t))
+
+/* table entries are cmdInfo index + 1, 0 is empty */
+
+static uint8_t cmdHashTab[CMD_HASH_SIZE];
+
+static uint32_t cmdHashSeed = CMD_HASH_SEED;
+
+/* compile time check that a cmdInfo index fits a table entry */
+
+typedef char cmdHashFits_t[(CMD_INFOS < 255) ? 1 : -1];
+
+static char *cmdTok    = "";
+static int   cmdTokLen = 0;
+
+static char intCmdStr[32];
+
+static unsigned cmdHash(char *str, int len, uint32_t seed)
 {
+   uint32_t h;
    int i;
 
-   for (i=0; i<(sizeof(cmdInfo)/sizeof(cmdInfo_t)); i++)
+   /* names are letters and digits, | 0x20 folds the case of letters */
+
+   h = seed;
+
+   for (i=0; i<len; i++) h = (h ^ (uint8_t)(str[i] | 0x20)) * 0x01000193;
+
+   return (h ^ (h >> 16)) & (CMD_HASH_SIZE - 1);
+}
+
+static void __attribute__((constructor)) cmdHashInit(void)
+{
+   int i, slot;
+   char *name;
+
+   while (1)
    {
-      if (strcasecmp(str, cmdInfo[i].name) == 0) return i;
+      memset(cmdHashTab, 0, sizeof(cmdHashTab));
+
+      for (i=0; i<CMD_INFOS; i++)
+      {
+         name = cmdInfo[i].name;
+
+         slot = cmdHash(name, strlen(name), cmdHashSeed);
+
+         if (cmdHashTab[slot])
+         {
+            /* a repeated name keeps its first entry */
+
+            if (strcasecmp(cmdInfo[cmdHashTab[slot]-1].name, name)) break;
+         }
+         else cmdHashTab[slot] = i + 1;
+      }
+
+      if (i == CMD_INFOS) return;
+
+      cmdHashSeed++;
    }
+}
+
+static int cmdMatch(char *str, int len)
+{
+   int idx;
+
+   idx = cmdHashTab[cmdHash(str, len, cmdHashSeed)] - 1;
+
+   if ((idx >= 0) &&
+       (strncasecmp(str, cmdInfo[idx].name, len) == 0) &&
+       (cmdInfo[idx].name[len] == 0)) return idx;
+
    return CMD_UNKNOWN_CMD;
 }
 
-static int getNum(char *str, unsigned *val, int8_t *opt)
+static char *skipSpace(char *str)
 {
-   int f, n;
-   unsigned v;
+   while (isspace((unsigned char)*str)) str++;
 
-   *opt = 0;
+   return str;
+}
+
+static char *skipToken(char *str)
+{
+   while (*str && !isspace((unsigned char)*str)) str++;
+
+   return str;
+}
+
+static char *getInt(char *str, unsigned *val)
+{
+   /* as scanf %i: optional sign, then hex (0x), octal (0) or decimal */
+
+   unsigned v, base, d;
+   int neg;
+   char *start;
+
+   str = skipSpace(str);
 
-   f = sscanf(str, " %i %n", &v, &n);
+   neg = 0;
 
-   if (f == 1)
+   if (*str == '-') {neg = 1; str++;}
+   else if (*str == '+') str++;
+
+   base = 10;
+
+   start = str;
+
+   if (*str == '0')
    {
-      *val = v;
-      *opt = CMD_NUMERIC;
-      return n;
+      if ((str[1] | 0x20) == 'x')
+      {
+         base = 16;
+         str += 2; /* a bare 0x is taken as 0 */
+      }
+      else base = 8;
    }
 
-   f = sscanf(str, " v%i %n", &v, &n);
+   v = 0;
 
-   if (f == 1)
+   while (1)
    {
-      *val = v;
-      if (v < PI_MAX_SCRIPT_VARS) *opt = CMD_VAR;
-      else *opt = -CMD_VAR;
-      return n;
+      if ((*str >= '0') && (*str <= '9')) d = *str - '0';
+      else if (((*str | 0x20) >= 'a') && ((*str | 0x20) <= 'f'))
+         d = (*str | 0x20) - 'a' + 10;
+      else break;
+
+      if (d >= base) break;
+
+      v = (v * base) + d;
+
+      str++;
    }
 
-   f = sscanf(str, " p%i %n", &v, &n);
+   if (str == start) return NULL;
+
+   if (neg) *val = -v; else *val = v;
+
+   return str;
+}
 
-   if (f == 1)
+static int getNum(char *str, unsigned *val, int8_t *opt)
+{
+   char *s;
+   unsigned v;
+   int type, max;
+
+   *opt = 0;
+
+   s = skipSpace(str);
+
+   if (*s == 'v')
+   {
+      type = CMD_VAR;
+      max = PI_MAX_SCRIPT_VARS;
+      s++;
+   }
+   else if (*s == 'p')
+   {
+      type = CMD_PAR;
+      max = PI_MAX_SCRIPT_PARAMS;
+      s++;
+   }
+   else
    {
-      *val = v;
-      if (v < PI_MAX_SCRIPT_PARAMS) *opt = CMD_PAR;
-      else *opt = -CMD_PAR;
-      return n;
+      type = CMD_NUMERIC;
+      max = 0;
    }
 
-   return 0;
-}
+   s = getInt(s, &v);
 
-static char intCmdStr[32];
+   if (s == NULL) return 0;
+
+   *val = v;
+
+   if ((type == CMD_NUMERIC) || (v < max)) *opt = type; else *opt = -type;
+
+   return skipSpace(s) - str;
+}
 
 char *cmdStr(void)
 {
+   int len;
+
+   /* the name is only copied out when asked for */
+
+   len = cmdTokLen;
+
+   if (len >= sizeof(intCmdStr)) len = sizeof(intCmdStr) - 1;
+
+   memcpy(intCmdStr, cmdTok, len);
+
+   intCmdStr[len] = 0;
+
    return intCmdStr;
 }
 
 int cmdParse(
    char *buf, uint32_t *p, unsigned ext_len, char *ext, cmdCtlParse_t *ctl)
 {
-   int f, valid, idx, val, pp, pars, n, n2, i;
-   char *p8;
+   int valid, idx, val, pars, n, i;
+   char *p8, *tok, *end;
    int32_t *p32;
    char c;
    uint32_t tp1, tp2, tp3;
@@ -558,13 +758,19 @@ int cmdParse(
 
    bzero(&ctl->opt, sizeof(ctl->opt));
 
-   sscanf(buf+ctl->eaten, " %31s %n", intCmdStr, &pp);
+   /* the name is matched in place */
+
+   tok = skipSpace(buf+ctl->eaten);
+   end = skipToken(tok);
 
-   ctl->eaten += pp;
+   cmdTok    = tok;
+   cmdTokLen = end - tok;
+
+   ctl->eaten = skipSpace(end) - buf;
 
    p[0] = -1;
 
-   idx = cmdMatch(intCmdStr);
+   idx = cmdMatch(tok, end - tok);
 
    if (idx < 0) return idx;
 
@@ -577,9 +783,9 @@ int cmdParse(
 
    switch (cmdInfo[idx].vt)
    {
-      case 101: /* BR1  BR2  CGI  H  HELP  HWVER
+      case 101: /* BR1  BR2  CAPOFF  CAPST  CGI  H  HELP  HWVER
                    DCRA  HALT  INRA  NO
-                   PIGPV  POPA  PUSHA  RET  T  TICK  WVBSY  WVCLR
+                   PIGPV  POPA  PUSHA  PWMB  PWMC  RET  T  T64  TICK  WVBSY  WVCLR
                    WVCRE  WVGO  WVGOR  WVHLT  WVNEW
 
                    No parameters, always valid.
@@ -600,10 +806,10 @@ int cmdParse(
 
          break;
 
-      case 112: /* BI2CC GDC  GPW  I2CC
-                   I2CRB MG  MICS  MILS  MODEG  NC  NP  PFG  PRG
-                   PROCD  PROCP  PROCS  PRRG  R  READ  SLRC  SPIC
-                   WVDEL  WVSC  WVSM  WVSP  WVTX  WVTXR
+      case 112: /* BI2CC GDC  GPW  GRPC  I2CC
+                   I2CRB MG  MICS  MILS  MODEG  NC  NP  PFG  POLLOFF
+                   PRG  PROCD  PROCP  PROCS  PRRG  R  READ  SERNOFF  SLRC
+                   SPIC  WVDEL  WVSC  WVSM  WVSP  WVTX  WVTXR
 
                    One positive parameter.
                 */
@@ -647,14 +853,16 @@ int cmdParse(
 
                    One parameter, a string of letters, digits, '-' and '_'.
                 */
-         f = sscanf(buf+ctl->eaten, " %*s%n %n", &n, &n2);
-         if ((f >= 0) && n)
+         tok = skipSpace(buf+ctl->eaten);
+         end = skipToken(tok);
+         n = end - tok;
+         if (n)
          {
             valid = 1;
 
             for (i=0; i<n; i++)
             {
-               c = buf[ctl->eaten+i];
+               c = tok[i];
 
                if ((!isalnum(c)) && (c != '_') && (c != '-'))
                {
@@ -667,8 +875,8 @@ int cmdParse(
             {
                p[3] = n;
                ctl->opt[3] = CMD_NUMERIC;
-               memcpy(ext, buf+ctl->eaten, n);
-               ctl->eaten += n2;
+               memcpy(ext, tok, n);
+               ctl->eaten = skipSpace(end) - buf;
             }
          }
 
@@ -687,7 +895,7 @@ int cmdParse(
 
          break;
 
-      case 122: /* NB
+      case 122: /* GRPW  NB  NF
 
                    Two parameters, first positive, second any value.
                 */
@@ -730,11 +938,12 @@ int cmdParse(
                 */
          ctl->eaten += getNum(buf+ctl->eaten, &p[1], &ctl->opt[1]);
 
-         f = sscanf(buf+ctl->eaten, " %c %n", &c, &n);
+         tok = skipSpace(buf+ctl->eaten);
+         c = *tok;
 
-         if ((ctl->opt[1] > 0) && ((int)p[1] >= 0) && (f >= 1))
+         if ((ctl->opt[1] > 0) && ((int)p[1] >= 0) && c)
          {
-            ctl->eaten += n;
+            ctl->eaten = skipSpace(tok+1) - buf;
             val = toupper(c);
             p8 = strchr(fmtMdeStr, val);
 
@@ -754,11 +963,12 @@ int cmdParse(
                 */
          ctl->eaten += getNum(buf+ctl->eaten, &p[1], &ctl->opt[1]);
 
-         f = sscanf(buf+ctl->eaten, " %c %n", &c, &n);
+         tok = skipSpace(buf+ctl->eaten);
+         c = *tok;
 
-         if ((ctl->opt[1] > 0) && ((int)p[1] >= 0)  && (f >= 1))
+         if ((ctl->opt[1] > 0) && ((int)p[1] >= 0) && c)
          {
-            ctl->eaten += n;
+            ctl->eaten = skipSpace(tok+1) - buf;
             val = toupper(c);
             p8 = strchr(fmtPudStr, val);
             if (p8 != NULL)
@@ -795,13 +1005,15 @@ int cmdParse(
 
                    Three parameters, first a string, rest >=0
                 */
-         f = sscanf(buf+ctl->eaten, " %*s%n %n", &n, &n2);
-         if ((f >= 0) && n)
+         tok = skipSpace(buf+ctl->eaten);
+         end = skipToken(tok);
+         n = end - tok;
+         if (n)
          {
             p[3] = n;
             ctl->opt[2] = CMD_NUMERIC;
-            memcpy(ext, buf+ctl->eaten, n);
-            ctl->eaten += n2;
+            memcpy(ext, tok, n);
+            ctl->eaten = skipSpace(end) - buf;
 
             ctl->eaten += getNum(buf+ctl->eaten, &p[1], &ctl->opt[1]);
             ctl->eaten += getNum(buf+ctl->eaten, &p[2], &ctl->opt[2]);
@@ -813,6 +1025,119 @@ int cmdParse(
 
          break;
 
+      case 133: /* CAPON
+
+                   Five parameters, first two positive, the last
+                   positive, then a string.
+                */
+         ctl->eaten += getNum(buf+ctl->eaten, &p[1], &ctl->opt[1]);
+         ctl->eaten += getNum(buf+ctl->eaten, &p[2], &ctl->opt[2]);
+         ctl->eaten += getNum(buf+ctl->eaten, &tp1, &to1);
+         ctl->eaten += getNum(buf+ctl->eaten, &tp2, &to2);
+         ctl->eaten += getNum(buf+ctl->eaten, &tp3, &to3);
+
+         tok = skipSpace(buf+ctl->eaten);
+         end = skipToken(tok);
+         n = end - tok;
+
+         if ((ctl->opt[1] > 0) && ((int)p[1] >= 0) &&
+             (ctl->opt[2] > 0) && ((int)p[2] >= 0) &&
+             (to1 > 0) && (to2 > 0) && (to3 > 0) && ((int)tp3 >= 0) &&
+             n && ((n + 12) < CMD_MAX_EXTENSION))
+         {
+            p[3] = 12 + n;
+            memcpy(ext,   &tp1, 4);
+            memcpy(ext+4, &tp2, 4);
+            memcpy(ext+8, &tp3, 4);
+            memcpy(ext+12, tok, n);
+            ctl->eaten = skipSpace(end) - buf;
+            valid = 1;
+         }
+
+         break;
+
+      case 134: /* POLLON
+
+                   handle dev flags micros rxlen byte...
+
+                   p1 handle
+                   p2 dev
+                   p3 txlen + 12
+                   ---------
+                   uint32_t flags
+                   uint32_t micros
+                   uint32_t rxlen
+                   uint8_t[txlen]
+                */
+         ctl->eaten += getNum(buf+ctl->eaten, &p[1], &ctl->opt[1]);
+         ctl->eaten += getNum(buf+ctl->eaten, &p[2], &ctl->opt[2]);
+         ctl->eaten += getNum(buf+ctl->eaten, &tp1, &to1);
+         ctl->eaten += getNum(buf+ctl->eaten, &tp2, &to2);
+         ctl->eaten += getNum(buf+ctl->eaten, &tp3, &to3);
+
+         if ((ctl->opt[1] == CMD_NUMERIC) && ((int)p[1] >= 0) &&
+             (ctl->opt[2] == CMD_NUMERIC) && ((int)p[2] >= 0) &&
+             (to1 == CMD_NUMERIC) && (to2 == CMD_NUMERIC) &&
+             (to3 == CMD_NUMERIC) && ((int)tp3 >= 0))
+         {
+            pars = 0;
+
+            memcpy(ext, &tp1, 4);
+            memcpy(ext+4, &tp2, 4);
+            memcpy(ext+8, &tp3, 4);
+            p8 = ext + 12;
+            while (pars < PI_POLL_MAX_BYTES)
+            {
+               eaten = getNum(buf+ctl->eaten, &tp1, &to1);
+               if (to1 == CMD_NUMERIC)
+               {
+                  if (((int)tp1>=0) && ((int)tp1<=255))
+                  {
+                     *p8++ = tp1;
+                     pars++;
+                     ctl->eaten += eaten;
+                  }
+                  else break; /* invalid number, end of command */
+               }
+               else break;
+            }
+
+            p[3] = pars + 12;
+
+            valid = 1;
+         }
+
+         break;
+
+      case 135: /* SERNON
+
+                   Four positive parameters.
+
+                   p1 handle
+                   p2 ser
+                   p3 8
+                   ---------
+                   uint32_t delim
+                   uint32_t count
+                */
+         ctl->eaten += getNum(buf+ctl->eaten, &p[1], &ctl->opt[1]);
+         ctl->eaten += getNum(buf+ctl->eaten, &p[2], &ctl->opt[2]);
+         ctl->eaten += getNum(buf+ctl->eaten, &tp1, &to1);
+         ctl->eaten += getNum(buf+ctl->eaten, &tp2, &to2);
+
+         if ((ctl->opt[1] == CMD_NUMERIC) && ((int)p[1] >= 0) &&
+             (ctl->opt[2] == CMD_NUMERIC) && ((int)p[2] >= 0) &&
+             (to1 == CMD_NUMERIC) && ((int)tp1 >= 0) &&
+             (to2 == CMD_NUMERIC) && ((int)tp2 >= 0))
+         {
+            p[3] = 8;
+            memcpy(ext, &tp1, 4);
+            memcpy(ext+4, &tp2, 4);
+            valid = 1;
+         }
+
+         break;
+
       case 191: /* PROCR
 
                    One to 11 parameters, first positive,
@@ -869,7 +1194,7 @@ int cmdParse(
 
          break;
 
-      case 193: /* BI2CZ  I2CWD  I2CZ  SERW  SPIW  SPIX
+      case 193: /* BI2CZ  I2CWD  I2CZ  SERW  SPISG  SPIW  SPIX
 
                    Two or more parameters, first >=0, rest 0-255.
                 */
@@ -1042,7 +1367,7 @@ int cmdParse(
 
          break;
 
-      case 197: /* WVCHA
+      case 197: /* GRPO  WVCHA
 
                    One or more parameters, all 0-255.
                 */
@@ -1077,6 +1402,34 @@ int cmdParse(
    if (valid) return idx; else return CMD_BAD_PARAMETER;
 }
 
+int cmdReplyExt(unsigned cmd)
+{
+   /* commands whose positive result is followed by that many bytes */
+
+   switch (cmd)
+   {
+      case PI_CMD_BI2CZ:
+      case PI_CMD_CAPST:
+      case PI_CMD_CF2:
+      case PI_CMD_I2CPK:
+      case PI_CMD_I2CRD:
+      case PI_CMD_I2CRI:
+      case PI_CMD_I2CRK:
+      case PI_CMD_I2CZ:
+      case PI_CMD_PROCP:
+      case PI_CMD_SERR:
+      case PI_CMD_SLR:
+      case PI_CMD_SPISG:
+      case PI_CMD_SPIX:
+      case PI_CMD_SPIR:
+      case PI_CMD_T64:
+         return 1;
+
+      default:
+         return 0;
+   }
+}
+
 char * cmdErrStr(int error)
 {
    int i;
@@ -1139,7 +1492,7 @@ int cmdParseScript(char *script, cmdScript_t *s, int diags)
          {
             memcpy(s->str_area + s->str_area_pos, v, p[3]);
             s->str_area[s->str_area_pos + p[3]] = 0;
-            p[4] = (intptr_t) s->str_area + s->str_area_pos;
+            p[4] = s->str_area_pos; /* offset, pointers may not fit */
             s->str_area_pos += (p[3] + 1);
          }
 
@@ -116,6 +116,8 @@ int cmdParseScript(char *script, cmdScript_t *s, int diags);
 
 char *cmdErrStr(int error);
 
+int cmdReplyExt(unsigned cmd);
+
 char *cmdStr(void);
 
 #endif
@@ -32,21 +32,423 @@ This version is for pigpio version 3+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 #include <fcntl.h>
+#include <zlib.h>
 
 #include "pigpio.h"
 
 /*
-This software converts pigpio notification reports
-into a VCD format understood by GTKWave.
+This software converts pigpio notification reports, or a capture
+file written by gpioCaptureStart, into a VCD format understood by
+GTKWave.
+
+pig2vcd [-64] [-z] [-b bits] [file]
+
+Reports are read from file, or stdin if no file is given.  A capture
+file is recognised by its header.
+
+-64 reads the 16 byte reports selected by PI_NOTIFY_TICK64 (pigs nf h 1).
+32 bit ticks are extended across their wrap at 1h12m, which is right
+as long as no two reports are more than 1h12m apart.
+
+-z writes the VCD gzip compressed, GTKWave reads it as is.
+
+Only the gpios which change are declared, which needs a first pass
+over the input.  Reports from a pipe are spooled to a temporary file
+for that.  -b gives the gpios to declare instead, e.g. -b 0x30 for
+gpios 4 and 5, and the reports are converted as they arrive.
+
+Reading from a pipe or device (pig2vcd </dev/pigpio0) stops at the
+first SIGINT, SIGTERM, or SIGHUP as if at the end of the input, and the
+reports read so far are converted.  A further signal while the spooled
+reports are being converted cuts the conversion short.  Either way the
+VCD written is complete.
+*/
+
+#define USAGE "usage: pig2vcd [-64] [-z] [-b bits] [file]"
+
+#define RS   (sizeof(gpioReport_t))
+#define RS64 (sizeof(gpioReport64_t))
+
+#define IN_SIZE  (1024*1024)
+#define SAMPLES  8192
+#define OUT_SIZE (256*1024)
+#define OUT_MAX  (32 * 4) /* most bytes one sample adds after its tick */
+
+typedef struct
+{
+   uint64_t tick;
+   uint32_t level;
+} sample_t;
+
+static int tick64;
+
+static int inFd = STDIN_FILENO;
+static int spoolFd = -1;
+
+static volatile sig_atomic_t stopped;
+
+static char     inBuf[IN_SIZE];
+static unsigned inPos, inLen;
+static int      inEOF;
+
+static int      haveTick;
+static uint32_t lastTick;
+static uint64_t extTick;
+
+static uint8_t *capMap;
+static size_t   capSize;
+static uint8_t *capPos, *capEnd;
+static int      capFirst;
+static uint64_t capTick;
+static uint32_t capLevel;
+
+static gzFile   gz;
+static char     outBuf[OUT_SIZE];
+static unsigned outLen;
+
+static char symbol[32];
+
+static void fatal(char *msg)
+{
+   fprintf(stderr, "pig2vcd: %s\n", msg);
+   exit(-1);
+}
+
+static void stop(int signum)
+{
+   stopped = 1;
+}
+
+static void catchStop(void)
+{
+   struct sigaction sa;
+
+   /* no SA_RESTART, a blocked read returns EINTR */
+
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = stop;
+   sigemptyset(&sa.sa_mask);
+
+   sigaction(SIGINT,  &sa, NULL);
+   sigaction(SIGTERM, &sa, NULL);
+   sigaction(SIGHUP,  &sa, NULL);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void holdStops(sigset_t *old)
+{
+   sigset_t stops;
+
+   /* a stop signal waits, an interrupted write would be an error */
+
+   sigemptyset(&stops);
+   sigaddset(&stops, SIGINT);
+   sigaddset(&stops, SIGTERM);
+   sigaddset(&stops, SIGHUP);
+
+   sigprocmask(SIG_BLOCK, &stops, old);
+}
+
+static void outFlush(void)
+{
+   sigset_t old;
+   unsigned done;
+   int n;
+
+   holdStops(&old);
+
+   if (gz)
+   {
+      if (outLen && (gzwrite(gz, outBuf, outLen) != outLen))
+         fatal("write failed");
+   }
+   else
+   {
+      for (done=0; done<outLen; done+=n)
+      {
+         n = write(STDOUT_FILENO, outBuf+done, outLen-done);
+         if (n <= 0) fatal("write failed");
+      }
+   }
+
+   sigprocmask(SIG_SETMASK, &old, NULL);
+
+   outLen = 0;
+}
+
+static void outStr(char *str)
+{
+   int len = strlen(str);
+
+   if ((outLen + len) > OUT_SIZE) outFlush();
+
+   memcpy(outBuf+outLen, str, len);
+   outLen += len;
+}
+
+static void outTick(uint64_t tick)
+{
+   char digits[24];
+   int n;
+
+   if ((outLen + OUT_MAX + sizeof(digits)) > OUT_SIZE) outFlush();
+
+   n = sizeof(digits);
+
+   do
+   {
+      digits[--n] = '0' + (tick % 10);
+      tick /= 10;
+   }
+   while (tick);
+
+   outBuf[outLen++] = '#';
+   memcpy(outBuf+outLen, digits+n, sizeof(digits)-n);
+   outLen += sizeof(digits)-n;
+   outBuf[outLen++] = '\n';
+}
+
+static void outLevels(uint32_t changed, uint32_t level)
+{
+   int b;
+
+   /* room for these was made by outTick */
+
+   for (; changed; changed&=(changed-1))
+   {
+      b = __builtin_ctz(changed);
+
+      outBuf[outLen++] = '0' + ((level >> b) & 1);
+      outBuf[outLen++] = symbol[b];
+      outBuf[outLen++] = '\n';
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+/*
+Returns the number of bytes of whole reports in inBuf from inPos,
+reading more when fewer than one block is left.
 */
 
-#define RS (sizeof(gpioReport_t))
+static unsigned inFill(unsigned size)
+{
+   int n;
+
+   if (((inLen - inPos) < size) && !inEOF)
+   {
+      memmove(inBuf, inBuf+inPos, inLen-inPos);
+      inLen -= inPos;
+      inPos = 0;
+
+      while ((inLen < (IN_SIZE/2)) && !inEOF)
+      {
+         /* a stop signal ends the input */
+
+         if (stopped) n = 0;
+         else n = read(inFd, inBuf+inLen, IN_SIZE-inLen);
+
+         if (n <= 0) inEOF = 1;
+         else
+         {
+            if ((spoolFd >= 0) && (write(spoolFd, inBuf+inLen, n) != n))
+               fatal("can't spool input");
+
+            inLen += n;
+         }
+      }
+   }
+
+   return (inLen - inPos) - ((inLen - inPos) % size);
+}
+
+static int getReports(sample_t *s, int max)
+{
+   gpioReport_t *r;
+   gpioReport64_t *r64;
+   unsigned bytes;
+   int i, n;
+
+   if (tick64)
+   {
+      bytes = inFill(RS64);
+      n = bytes / RS64;
+      if (n > max) n = max;
+
+      r64 = (gpioReport64_t *)(inBuf + inPos);
+
+      for (i=0; i<n; i++)
+      {
+         s[i].tick  = r64[i].tick;
+         s[i].level = r64[i].level;
+      }
+
+      inPos += n * RS64;
+   }
+   else
+   {
+      bytes = inFill(RS);
+      n = bytes / RS;
+      if (n > max) n = max;
+
+      r = (gpioReport_t *)(inBuf + inPos);
+
+      for (i=0; i<n; i++)
+      {
+         /* 32 bit ticks only give the right time for 1h12m, extend them */
+
+         if (haveTick) extTick += (uint32_t)(r[i].tick - lastTick);
+         else          extTick = r[i].tick;
+
+         haveTick = 1;
+         lastTick = r[i].tick;
+
+         s[i].tick  = extTick;
+         s[i].level = r[i].level;
+      }
+
+      inPos += n * RS;
+   }
+
+   return n;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static uint64_t capVarint(void)
+{
+   uint64_t v = 0;
+   int shift = 0;
+
+   while ((capPos < capEnd) && (*capPos & 0x80))
+   {
+      v |= (uint64_t)(*capPos++ & 0x7F) << shift;
+      shift += 7;
+   }
+
+   if (capPos < capEnd) v |= (uint64_t)(*capPos++) << shift;
+
+   return v;
+}
+
+static void capRewind(void)
+{
+   gpioCaptureHeader_t *h = (gpioCaptureHeader_t *)capMap;
+
+   capPos   = capMap + h->dataOffset;
+   capEnd   = capPos + h->dataUsed;
+   capTick  = h->startTick;
+   capLevel = h->startLevel;
+   capFirst = 1;
+}
+
+static int getCapture(sample_t *s, int max)
+{
+   uint64_t v;
+   int n = 0;
+
+   if (capFirst && max)
+   {
+      s[n].tick  = capTick;
+      s[n].level = capLevel;
+      n++;
+      capFirst = 0;
+   }
+
+   while ((n < max) && (capPos < capEnd))
+   {
+      v = capVarint();
+
+      capTick += v >> PI_CAPTURE_CODE_BITS;
+
+      if ((v & ((1<<PI_CAPTURE_CODE_BITS)-1)) == PI_CAPTURE_MULTI)
+         capLevel ^= capVarint();
+      else
+         capLevel ^= (1 << (v & ((1<<PI_CAPTURE_CODE_BITS)-1)));
+
+      s[n].tick  = capTick;
+      s[n].level = capLevel;
+      n++;
+   }
+
+   return n;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int getSamples(sample_t *s, int max)
+{
+   if (capMap) return getCapture(s, max);
+   else        return getReports(s, max);
+}
+
+static void rewindInput(void)
+{
+   if (capMap)
+   {
+      capRewind();
+      return;
+   }
+
+   if (spoolFd >= 0)
+   {
+      if (inFd != STDIN_FILENO) close(inFd);
+      inFd = spoolFd;
+      spoolFd = -1;
+
+      /* the signal which ended the first pass, the spool is complete */
+
+      stopped = 0;
+   }
+
+   if (lseek(inFd, 0, SEEK_SET) < 0) fatal("can't rewind input");
+
+   inPos = 0;
+   inLen = 0;
+   inEOF = 0;
+   haveTick = 0;
+}
+
+static int openCapture(int fd)
+{
+   gpioCaptureHeader_t h;
+   struct stat st;
+
+   if (fstat(fd, &st) || !S_ISREG(st.st_mode)) return 0;
+
+   if (st.st_size < sizeof(h)) return 0;
+
+   if (pread(fd, &h, sizeof(h), 0) != sizeof(h)) return 0;
+
+   if (h.magic != PI_CAPTURE_MAGIC) return 0;
+
+   if ((h.version != PI_CAPTURE_VERSION) ||
+       ((h.dataOffset + h.dataUsed) > st.st_size))
+      fatal("bad capture file");
+
+   capSize = st.st_size;
+   capMap = mmap(NULL, capSize, PROT_READ, MAP_SHARED, fd, 0);
+
+   if (capMap == MAP_FAILED) fatal("can't map capture file");
+
+   madvise(capMap, capSize, MADV_SEQUENTIAL);
+
+   capRewind();
+
+   return 1;
+}
+
+/* ----------------------------------------------------------------------- */
 
 static char * timeStamp()
 {
@@ -63,59 +465,165 @@ static char * timeStamp()
    return buf;
 }
 
-int symbol(int bit)
-{
-   if (bit < 26) return ('A' + bit);
-   else          return ('a' + bit - 26);
-}
-
 int main(int argc, char * argv[])
 {
-   int b, r, v;
-   uint32_t t0;
-   uint32_t lastLevel, changed;
+   static sample_t s[SAMPLES];
+   char line[64];
+   int b, i, n, opt, haveBits, z, live;
+   uint64_t t0, tick, lastTick;
+   uint32_t bits, first, level, lastLevel, changed;
+   struct stat st;
+
+   haveBits = 0;
+   bits = 0;
+   z = 0;
+
+   while ((opt = getopt(argc, argv, "6:zb:")) != -1)
+   {
+      switch (opt)
+      {
+         case '6':
+            if (strcmp(optarg, "4")) fatal(USAGE);
+            tick64 = 1;
+            break;
+
+         case 'z':
+            z = 1;
+            break;
 
-   gpioReport_t report;
+         case 'b':
+            bits = strtoul(optarg, NULL, 0);
+            haveBits = 1;
+            break;
+
+         default:
+            fatal(USAGE);
+      }
+   }
+
+   if (optind < argc)
+   {
+      inFd = open(argv[optind], O_RDONLY);
+      if (inFd < 0) fatal("can't open input");
+      openCapture(inFd);
+   }
 
-   r=read(STDIN_FILENO, &report, RS);
+   /* a live stream only ends when stopped */
 
-   if (r != RS) exit(-1);
+   live = (fstat(inFd, &st) || !S_ISREG(st.st_mode));
 
-   printf("$date %s $end\n", timeStamp());
-   printf("$version pig2vcd V1 $end\n");
-   printf("$timescale 1 us $end\n");
-   printf("$scope module top $end\n");
+   if (live) catchStop();
 
    for (b=0; b<32; b++)
-      printf("$var wire 1 %c %d $end\n", symbol(b), b);
-        
-   printf("$upscope $end\n");
-   printf("$enddefinitions $end\n");
-         
-   t0 = report.tick;
-   lastLevel =0;
+   {
+      if (b < 26) symbol[b] = 'A' + b;
+      else        symbol[b] = 'a' + b - 26;
+   }
+
+   if (!haveBits)
+   {
+      /* a first pass to find the gpios which change */
+
+      if (!capMap && live)
+      {
+         FILE *tmp = tmpfile();
+
+         if (tmp == NULL) fatal("can't create spool file");
+
+         spoolFd = dup(fileno(tmp));
+         fclose(tmp);
+      }
+
+      n = getSamples(s, SAMPLES);
+
+      if (!n) exit(-1);
+
+      first = s[0].level;
+
+      while (n)
+      {
+         for (i=0; i<n; i++) bits |= s[i].level ^ first;
+
+         n = getSamples(s, SAMPLES);
+      }
+
+      rewindInput();
+   }
+
+   n = getSamples(s, SAMPLES);
+
+   if (!n) exit(-1);
 
-   while ((r=read(STDIN_FILENO, &report, RS)) == RS)
+   if (z)
    {
-      if (report.level != lastLevel)
+      gz = gzdopen(STDOUT_FILENO, "wb1");
+      if (gz == NULL) fatal("can't compress output");
+      gzbuffer(gz, OUT_SIZE);
+   }
+
+   sprintf(line, "$date %s $end\n", timeStamp());
+   outStr(line);
+   outStr("$version pig2vcd V2 $end\n");
+   outStr("$timescale 1 us $end\n");
+   outStr("$scope module top $end\n");
+
+   for (b=0; b<32; b++)
+   {
+      if (bits & (1<<b))
       {
-         printf("#%u\n", report.tick - t0);
+         sprintf(line, "$var wire 1 %c %d $end\n", symbol[b], b);
+         outStr(line);
+      }
+   }
 
-         changed = report.level ^ lastLevel;
+   outStr("$upscope $end\n");
+   outStr("$enddefinitions $end\n");
 
-         lastLevel = report.level;
+   /* the levels of the first report are the start values */
 
-         for (b=0; b<32; b++)
+   t0 = s[0].tick;
+
+   outTick(0);
+   outStr("$dumpvars\n");
+   outLevels(bits, s[0].level);
+   outStr("$end\n");
+
+   lastTick  = t0;
+   lastLevel = s[0].level;
+   i = 1;
+
+   while (n)
+   {
+      for (; i<n; i++)
+      {
+         level = s[i].level;
+
+         changed = (level ^ lastLevel) & bits;
+
+         if (changed)
          {
-            if (changed & (1<<b))
-            {
-               if (report.level & (1<<b)) v='1'; else v='0';
+            tick = s[i].tick;
 
-               printf("%c%c\n", v, symbol(b));
-            }
+            if (tick != lastTick) outTick(tick - t0);
+            else if ((outLen + OUT_MAX) > OUT_SIZE) outFlush();
+
+            outLevels(changed, level);
+
+            lastTick  = tick;
+            lastLevel = level;
          }
       }
+
+      n = getSamples(s, SAMPLES);
+      i = 0;
    }
+
+   outFlush();
+
+   holdStops(NULL);
+
+   if (gz && (gzclose(gz) != Z_OK)) fatal("write failed");
+
    return 0;
 }
 
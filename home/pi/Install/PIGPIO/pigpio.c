@@ -56,6 +56,14 @@ For more information, please refer to <http://unlicense.org/>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <sys/select.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 
 #include "pigpio.h"
 
@@ -190,6 +198,24 @@ bit 0 READ_LAST_NOT_SET_ERROR
 
 #define BIT  (1<<(gpio&0x1F))
 
+/* make SIM=1 replaces the peripherals by the simulation in pigpio.c */
+
+#ifdef PIGPIO_SIM
+#define PI_SIM 1
+#else
+#define PI_SIM 0
+#endif
+
+/* set or clear the levels of output gpios in a bank */
+
+#if PI_SIM
+#define GPIO_SET(bank, bits) simGpioWrite(GPSET0 + (bank), (bits))
+#define GPIO_CLR(bank, bits) simGpioWrite(GPCLR0 + (bank), (bits))
+#else
+#define GPIO_SET(bank, bits) (*(gpioReg + GPSET0 + (bank)) = (bits))
+#define GPIO_CLR(bank, bits) (*(gpioReg + GPCLR0 + (bank)) = (bits))
+#endif
+
 #ifndef EMBEDDED_IN_VM
 #define DBG(level, format, arg...) DO_DBG(level, format, ## arg)
 #else
@@ -536,6 +562,9 @@ bit 0 READ_LAST_NOT_SET_ERROR
 #define SPI_MODE2 2
 #define SPI_MODE3 3
 
+#define SPI_HOLD_CONT 1 /* chip select already asserted */
+#define SPI_HOLD_KEEP 2 /* leave chip select asserted   */
+
 #define SPI_CS0     0
 #define SPI_CS1     1
 #define SPI_CS2     2
@@ -701,6 +730,14 @@ Assumes two counters per block.  Each counter 4 * 16 (16^4=65536)
 #define SUPERCYCLE 800
 #define SUPERLEVEL 20000
 
+/* PWM table writes start this many levels ahead of the DMA */
+
+#define PWM_FLUSH_AHEAD (2 * PULSE_PER_CYCLE)
+
+#define PWM_PASS_ALL  0
+#define PWM_PASS_ADD  1
+#define PWM_PASS_HOLD 2
+
 #define BLOCK_SIZE (PAGES_PER_BLOCK*PAGE_SIZE)
 
 #define DMAI_PAGES (PAGES_PER_BLOCK * bufferBlocks)
@@ -710,17 +747,58 @@ Assumes two counters per block.  Each counter 4 * 16 (16^4=65536)
 #define NUM_WAVE_OOL (DMAO_PAGES * OOL_PER_OPAGE)
 #define NUM_WAVE_CBS (DMAO_PAGES * CBS_PER_OPAGE)
 
+/*
+SPI DMA Block
+
+One block after the wave blocks.  The data is transferred in place,
+the received bytes overwrite the transmitted bytes.
+   0 data   [16] 16 pages  65536 bytes
+  16 CB   [4097] 33 pages  1 header CB, 2048 tx CBs, 2048 rx CBs
+  49 header  [1]  1 page   DLEN/CS word written to the FIFO first
+*/
+
+#define SPI_DMA_BLOCKS      1
+#define SPI_DMA_CHUNK      32 /* bytes per CB */
+#define SPI_DMA_CHUNKS   2048
+#define SPI_DMA_DATA_PAGES 16
+#define SPI_DMA_HDR_PAGE   49
+#define SPI_DMA_CBS_PER_PAGE 128
+#define SPI_DMA_CHUNKS_PER_PAGE (PAGE_SIZE / SPI_DMA_CHUNK)
+
+#define SPI_DMA_CB_HDR    0
+#define SPI_DMA_CB_TX(i)  (1 + (i))
+#define SPI_DMA_CB_RX(i)  (1 + SPI_DMA_CHUNKS + (i))
+
+#define SPI_DMA_MIN_BYTES  64    /* smaller transfers are polled */
+#define SPI_DMA_MAX_BYTES  65535 /* DLEN is 16 bits */
+#define SPI_DMA_POLL_MICROS 20
+#define SPI_DMA_TIMEOUT    100000
+
+#define DMA_BLOCKS (bufferBlocks + PI_WAVE_BLOCKS + SPI_DMA_BLOCKS)
+
 #define TICKSLOTS 50
 
 #define PI_I2C_CLOSED 0
 #define PI_I2C_OPENED 1
 
+#define PI_I2CQ_FREE   0
+#define PI_I2CQ_QUEUED 1
+#define PI_I2CQ_ACTIVE 2
+#define PI_I2CQ_DONE   3
+
+#define PI_POLL_FREE     0
+#define PI_POLL_RUNNING  1
+#define PI_POLL_STOPPING 2
+
 #define PI_SPI_CLOSED 0
 #define PI_SPI_OPENED 1
 
 #define PI_SER_CLOSED 0
 #define PI_SER_OPENED 1
 
+#define PI_GROUP_CLOSED 0
+#define PI_GROUP_OPENED 1
+
 #define PI_NOTIFY_CLOSED  0
 #define PI_NOTIFY_CLOSING 1
 #define PI_NOTIFY_OPENED  2
@@ -740,7 +818,104 @@ Assumes two counters per block.  Each counter 4 * 16 (16^4=65536)
 
 #define MAX_EMITS (PIPE_BUF / sizeof(gpioReport_t))
 
-#define SRX_BUF_SIZE 8192
+/* shared notification ring, must be a power of 2 */
+
+#define NOTIFY_RING_SIZE 16384
+#define NOTIFY_RING_MASK (NOTIFY_RING_SIZE - 1)
+
+/* most reports the alert thread may add to the ring before publishing */
+
+#define NOTIFY_BATCH_MAX (DATUMS + PI_MAX_USER_GPIO + 1)
+
+#define NOTIFY_OUT_CHUNKS 4
+#define NOTIFY_WAIT_MS  100
+
+/* most bytes one report may add to the output, a compact key plus record */
+
+#define NOTIFY_OUT_MAX   48
+
+/* compact records between keys */
+
+#define NOTIFY_KEY_INTERVAL 256
+
+/* poll job reports waiting for a handle's writer, must be a power of 2 */
+
+#define NOTIFY_POLL_SIZE 256
+#define NOTIFY_POLL_MASK (NOTIFY_POLL_SIZE - 1)
+
+/* bytes read ahead per serial handle, must be a power of 2 */
+
+#define SER_BUF_SIZE 4096
+#define SER_BUF_MASK (SER_BUF_SIZE - 1)
+
+/* retry interval for bytes waiting on a full or paused notification */
+
+#define SER_WAIT_MS 20
+
+#define SOCK_WORKERS   4 /* at start, more while they are all busy */
+#define SOCK_WRITE_MS  5000
+
+/* timer wheel, TW_LEVELS levels of TW_SLOTS lists of TW_TICK_MICROS */
+
+#define TW_TICK_MICROS 100
+#define TW_BITS   8
+#define TW_SLOTS  (1<<TW_BITS)
+#define TW_MASK   (TW_SLOTS-1)
+#define TW_LEVELS 4
+#define TW_DUE    (TW_LEVELS*TW_SLOTS) /* timers being called */
+#define TW_LISTS  (TW_DUE+1)
+#define TW_NONE   -1
+
+#define SRX_BUF_SIZE 8192 /* must be a power of 2 */
+
+/* fraction bits of the bit centre positions */
+
+#define SRX_FRAC 8
+
+/* pulses per chunk of the wave being built, all but the last half full */
+
+#define WF_CHUNK_SIZE 128
+#define WF_CHUNKS     (((2*PI_WAVE_MAX_PULSES)/WF_CHUNK_SIZE)+2)
+
+/*
+Streamed wave layout, cbs and OOLs relative to the first of each.
+
+START  delay, then to IDLE
+IDLE   sets FLAG, then a WS_IDLE_MICROS delay, then DISPATCH
+DISPATCH  a dummy copy whose next is the next segment, or IDLE
+
+A segment clears FLAG, resets the DISPATCH next to IDLE, then has
+WS_SEG_PULSES set/clear/delay cb triples and returns to DISPATCH.
+*/
+
+#define WS_SEGS         4
+#define WS_SEG_PULSES 250
+#define WS_SEG_CBS    (2 + (3 * WS_SEG_PULSES))
+
+#define WS_CB_START     0
+#define WS_CB_IDLE      1
+#define WS_CB_DISPATCH  3
+#define WS_CB_SEG       4
+#define WS_CBS        (WS_CB_SEG + (WS_SEGS * WS_SEG_CBS))
+
+#define WS_OOL_ONE      0
+#define WS_OOL_ZERO     1
+#define WS_OOL_IDLE     2
+#define WS_OOL_FLAG     3
+#define WS_OOL_DUMMY    4
+#define WS_OOL_SEG      5
+#define WS_OOLS       (WS_OOL_SEG + (WS_SEGS * 2 * WS_SEG_PULSES))
+
+#define WS_IDLE_MICROS  10
+#define WS_MIN_WAIT     50
+#define WS_MAX_WAIT   5000
+
+/* capture, changes kept while armed must be a power of 2 */
+
+#define CAP_PRE_SAMPLES    65536
+#define CAP_PRE_MASK       (CAP_PRE_SAMPLES - 1)
+#define CAP_INDEX_INTERVAL 4096
+#define CAP_MAX_RECORD     15 /* 10 byte delta and code, 5 byte mask */
 
 #define PI_I2C_RETRIES 0x0701
 #define PI_I2C_TIMEOUT 0x0702
@@ -810,9 +985,24 @@ Assumes two counters per block.  Each counter 4 * 16 (16^4=65536)
 
 #define PI_SCRIPT_STACK_SIZE 256
 
+/* compiled script operations */
+
+#define SCR_OP_CMD    0 /* any command < PI_CMD_SCRIPT via myDoCommand */
+#define SCR_OP_W      1
+#define SCR_OP_R      2
+#define SCR_OP_MICS   3
+#define SCR_OP_MILS   4
+#define SCR_OP_NOP    5
+#define SCR_OP_SCRIPT 6 /* PI_CMD_ADD onwards */
+
+#define SCR_OP(cmd) (SCR_OP_SCRIPT + (cmd) - PI_CMD_SCRIPT)
+
+#define SCR_OPS SCR_OP(PI_CMD_XOR+1)
+
 #define PI_SPI_FLAGS_CHANNEL(x)    ((x&7)<<29)
 
 #define PI_SPI_FLAGS_GET_CHANNEL(x) (((x)>>29)&7)
+#define PI_SPI_FLAGS_GET_NO_DMA(x)  (((x)>>22)&1)
 #define PI_SPI_FLAGS_GET_BITLEN(x)  (((x)>>16)&63)
 #define PI_SPI_FLAGS_GET_RX_LSB(x)  (((x)>>15)&1)
 #define PI_SPI_FLAGS_GET_TX_LSB(x)  (((x)>>14)&1)
@@ -875,15 +1065,26 @@ typedef struct
 typedef struct
 {
    unsigned gpio;
-   pthread_t *pth;
+   int fd;        /* /sys/class/gpio/gpioN/value while func is set */
    callbk_t func;
    unsigned edge;
    int timeout;
    unsigned ex;
    void *userdata;
    int inited;
+   int heapPos;   /* position in isrHeap, -1 if no timeout pending */
+   uint64_t deadline;
 } gpioISR_t;
 
+typedef struct
+{
+   callbk_t func;
+   unsigned gpio;
+   int level;
+   unsigned ex;
+   void *userdata;
+} isrCall_t;
+
 typedef struct
 {
    callbk_t func;
@@ -906,11 +1107,28 @@ typedef struct
    void *userdata;
    unsigned id;
    unsigned running;
-   unsigned millis;
-   struct timespec nextTick;
-   pthread_t pthId;
+   unsigned oneshot;
+   uint32_t micros;
+   uint64_t due;       /* CLOCK_MONOTONIC micros of the next call */
+   int      list;      /* wheel list holding the timer, TW_NONE if none */
+   int      next;
+   int      prev;
+   uint32_t runs;
+   uint32_t overruns;
+   uint32_t lateMax;
+   uint64_t lateTotal;
 } gpioTimer_t;
 
+typedef struct
+{
+   void *label;       /* handler, bound by scrExecute */
+   int op;            /* SCR_OP_x */
+   int *p1;           /* operands, point at a var, a par, or imm */
+   int *p2;
+   int imm[3];
+   cmdInstr_t *instr; /* source instruction */
+} scrOp_t;
+
 typedef struct
 {
    unsigned id;
@@ -923,6 +1141,7 @@ typedef struct
    pthread_mutex_t pthMutex;
    pthread_cond_t pthCond;
    cmdScript_t script;
+   scrOp_t *code;     /* NULL if the script is interpreted */
 } gpioScript_t;
 
 
@@ -941,8 +1160,38 @@ typedef struct
    int      fd;
    int      pipe;
    int      max_emits;
+   uint32_t tail;
+   uint32_t lastLevel;
+   int      writer;
+   int      tick64; /* send gpioReport64_t rather than gpioReport_t */
+   int      compact; /* send PI_NOTIFY_COMPACT records */
+   int      encCount; /* compact records until a key is due */
+   uint64_t encTick;  /* compact tick and level as known to the reader */
+   uint32_t encLevel;
+   uint32_t pollHead; /* poll job reports, added under pollMutex */
+   uint32_t pollTail; /* and taken by the writer */
+   gpioReport64_t pollRep[NOTIFY_POLL_SIZE];
+   pthread_t pthId;
 } gpioNotify_t;
 
+typedef struct
+{
+   volatile uint32_t head;  /* reports ever published */
+   volatile uint32_t level; /* level at last publish */
+   pthread_mutex_t   mutex;
+   pthread_cond_t    cond;
+   gpioReport64_t    report[NOTIFY_RING_SIZE];
+} notifyRing_t;
+
+typedef struct
+{
+   int      fd;
+   int      handle; /* in-band notification handle, -1 if none */
+   unsigned got;    /* bytes of the current command received */
+   uint32_t p[CMD_P_ARR];
+   char     buf[CMD_MAX_EXTENSION];
+} sockClient_t;
+
 typedef struct
 {
    uint16_t state;
@@ -950,13 +1199,72 @@ typedef struct
    uint32_t addr;
    uint32_t flags;
    uint32_t funcs;
+   uint32_t bus;
 } i2cInfo_t;
 
+typedef struct
+{
+   int            state;
+   int            next; /* in the bus queue, -1 if last */
+   int            status;
+   unsigned       bus;
+   unsigned       handle;
+   unsigned       numSegs;
+   pi_i2c_msg_t   segs[PI_I2C_RDRW_IOCTL_MAX_MSGS];
+   i2cQueueFunc_t func;
+   void          *userdata;
+   uint64_t       submitted;
+} i2cQueued_t;
+
+typedef struct
+{
+   int       running;
+   int       stop;
+   int       fd;
+   int       head;
+   int       tail;
+   pthread_t pthId;
+   uint32_t  queued;
+   uint32_t  transactions;
+   uint32_t  failed;
+   uint32_t  ioctls;
+   uint32_t  latencyMax;
+   uint64_t  latencyTotal;
+   uint64_t  bytes;
+   uint64_t  busyMicros;
+} i2cQueue_t;
+
+typedef struct
+{
+   int          state;
+   unsigned     handle; /* notification */
+   unsigned     pollFlags;
+   unsigned     dev;
+   int          timer;
+   int          busy; /* transfer queued */
+   int          due;  /* SPI transfer waiting for the worker */
+   unsigned     txLen;
+   unsigned     rxLen;
+   char         buf[2 * PI_POLL_MAX_BYTES];
+   pi_i2c_msg_t segs[2];
+   uint64_t     tick; /* of the transfer in progress */
+} gpioPoll_t;
+
 typedef struct
 {
    uint16_t state;
    int16_t  fd;
    uint32_t flags;
+   uint32_t head;   /* advanced only by the serial reader thread */
+   uint32_t tail;   /* advanced by readers under serReadMutex */
+   uint32_t scan;   /* delimiter search position */
+   uint32_t owed;   /* bytes due to the notification handle */
+   int      parked; /* buffer full, fd out of the epoll set */
+   int      failed; /* device read failed */
+   int      notify; /* notification handle or -1 */
+   unsigned delim;
+   unsigned count;
+   char     buf[SER_BUF_SIZE];
 } serInfo_t;
 
 typedef struct
@@ -966,6 +1274,14 @@ typedef struct
    uint32_t flags;
 } spiInfo_t;
 
+typedef struct
+{
+   uint16_t state;
+   uint16_t bytes;           /* value bytes which select gpios */
+   uint32_t mask;            /* all the gpios of the group */
+   uint32_t scatter[4][256]; /* gpios set by each value of each byte */
+} groupInfo_t;
+
 typedef struct
 {
    uint32_t alertTicks;
@@ -983,6 +1299,18 @@ typedef struct
    uint32_t goodPipeWrite;
    uint32_t shortPipeWrite;
    uint32_t wouldBlockPipeWrite;
+   uint32_t alertSamples;
+   uint32_t alertCalls;
+   uint32_t wdogChecks;
+   uint32_t notifyGaps;
+   uint32_t notifyLost;
+   uint32_t isrWakeups;
+   uint32_t isrEvents;
+   uint32_t isrTimeouts;
+   uint32_t timerWakeups;
+   uint32_t timerRuns;
+   uint32_t timerOverruns;
+   uint32_t timerLateMax;
 } gpioStats_t;
 
 typedef struct
@@ -993,6 +1321,7 @@ typedef struct
    unsigned DMAprimaryChannel;
    unsigned DMAsecondaryChannel;
    unsigned socketPort;
+   unsigned socketClients;
    unsigned ifFlags;
    unsigned memAllocMode;
    unsigned dbgLevel;
@@ -1020,18 +1349,17 @@ typedef struct
 typedef struct
 {
    char    *buf;
-   uint32_t bufSize;
-   int      readPos;
-   int      writePos;
-   uint32_t fullBit; /* nanoseconds */
-   uint32_t halfBit; /* nanoseconds */
-   int      timeout; /* millisconds */
-   uint32_t startBitTick; /* microseconds */
-   uint32_t nextBitDiff; /* nanoseconds */
+   uint32_t bufSize; /* power of 2 */
+   uint32_t readPos;  /* free running, only written by the reader */
+   uint32_t writePos; /* free running, only written by the decoder */
+   uint32_t fullBit; /* samples << SRX_FRAC */
+   uint32_t halfBit; /* samples << SRX_FRAC */
+   uint32_t nextBit; /* samples << SRX_FRAC since the start bit */
+   uint32_t startPos; /* sample of the start bit */
+   uint32_t endPos;   /* sample of the last data bit */
    int      bit;
    uint32_t data;
    int      bytes; /* 1, 2, 4 */
-   int      level;
    int      dataBits; /* 1-32 */
    int      invert; /* 0, 1 */
 } wfRxSerial_t;
@@ -1058,6 +1386,14 @@ typedef struct
    };
 } wfRx_t;
 
+typedef struct
+{
+   uint32_t tick; /* micros from the start of the wave */
+   uint32_t gpioOn;
+   uint32_t gpioOff;
+   uint32_t flags;
+} wfPulse_t;
+
 union my_smbus_data
 {
    uint8_t  byte;
@@ -1086,6 +1422,12 @@ typedef struct
    unsigned clock;
 } clkInf_t;
 
+typedef struct
+{
+   uint64_t tick;
+   uint32_t level;
+} capSample_t;
+
 typedef struct
 {
    unsigned  handle;        /* mbAllocateMemory() */
@@ -1118,11 +1460,30 @@ static int gpioMaskSet = 0;
 
 static uint64_t gpioMask;
 
-static rawWave_t wf[3][PI_WAVE_MAX_PULSES];
+/* wf[0] the flattened wave being built, wf[1] the pulses being added */
+
+static rawWave_t wf[2][PI_WAVE_MAX_PULSES];
 
-static int wfc[3]={0, 0, 0};
+/*
+The wave being built is kept as pulses with absolute start ticks in
+time order, in chunks listed by wfChunkList, so that merging added
+pulses costs a search and a short move per pulse rather than a copy
+of the whole wave.  It is flattened into wf[0] when needed.
+*/
 
-static int wfcur=0;
+static wfPulse_t wfChunk[WF_CHUNKS][WF_CHUNK_SIZE];
+static int       wfChunkLen[WF_CHUNKS];
+static int       wfChunkList[WF_CHUNKS];
+static int       wfNumChunks = 0;
+
+static int       wfPulses    = 0;
+static int       wfCbs       = 0;
+static int       wfOOLs      = 0; /* read and tick flags */
+static uint32_t  wfLastTick  = 0;
+static int       wfLastGroup = 0; /* pulses starting at wfLastTick */
+static uint32_t  wfEnd       = 0;
+static int       wfFlat      = 0; /* pulses in wf[0], -1 if out of date */
+static uint64_t  wfHash      = 0;
 
 static wfStats_t wfStats=
 {
@@ -1133,28 +1494,153 @@ static wfStats_t wfStats=
 
 static rawWaveInfo_t waveInfo[PI_MAX_WAVES];
 
+/*
+content hash and number of creates of each wave, and its flattened
+pulses to confirm a hash match
+*/
+
+static uint64_t   waveHash[PI_MAX_WAVES];
+static int        waveRefs[PI_MAX_WAVES];
+static rawWave_t *waveFlat[PI_MAX_WAVES];
+static int        waveFlatLen[PI_MAX_WAVES];
+
 static wfRx_t wfRx[PI_MAX_USER_GPIO+1];
 
+/*
+Serial receive state, bit n of each word belongs to gpio n.  Sample
+positions count the level words decoded since initialisation.
+*/
+
+static uint32_t srxBits   = 0; /* gpios opened for serial reads */
+static uint32_t srxActive = 0; /* gpios part way through a frame */
+static uint32_t srxInvert = 0;
+static uint32_t srxPrev   = 0; /* last (inverted) levels */
+static uint32_t srxPos    = 0; /* sample of the next word */
+static uint32_t srxEnd    = 0; /* no frame ends before this sample */
+
+static pthread_mutex_t srxMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* keeps gpioSerialRead off a buffer being freed, taken before srxMutex */
+static pthread_mutex_t srxReadMutex = PTHREAD_MUTEX_INITIALIZER;
+
 static int waveOutBotCB  = PI_WAVE_COUNT_PAGES*CBS_PER_OPAGE;
 static int waveOutBotOOL = PI_WAVE_COUNT_PAGES*OOL_PER_OPAGE;
 static int waveOutTopOOL = NUM_WAVE_OOL;
 static int waveOutCount = 0;
 
+/*
+Streamed wave, held in the resources of wave id wsWid.
+
+Segments are filled, linked and played in ring order.  Only the
+refill thread sets the DISPATCH next, and only while it points to
+IDLE, the DMA engine resets it when it enters the linked segment.
+*/
+
+static int       wsWid       = -1;
+static int       wsRun       = 0;
+static pthread_t pthWaveStream;
+
+static gpioPulse_t wsFifo[PI_WAVE_STREAM_PULSES];
+static unsigned  wsFifoPos   = 0;
+static unsigned  wsFifoCount = 0;
+
+static int       wsSegLen[WS_SEGS];
+static uint32_t  wsSegMicros[WS_SEGS];
+static int       wsFillSeg   = 0;  /* next segment to fill */
+static int       wsFilled    = 0;  /* filled, not yet linked */
+static int       wsLinked    = -1; /* linked, perhaps not started */
+static int       wsPlaying   = -1; /* started */
+static int       wsStarved   = 0;
+static uint32_t  wsUnderruns = 0;
+
+static pthread_mutex_t wsMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  wsCond  = PTHREAD_COND_INITIALIZER;
+
+static int                  capState      = PI_CAPTURE_IDLE;
+static int                  capFd         = -1;
+static void                *capMap        = MAP_FAILED;
+static size_t               capMapSize    = 0;
+static gpioCaptureHeader_t *capHdr        = NULL;
+static gpioCaptureIndex_t  *capIndex      = NULL;
+static uint8_t             *capData       = NULL;
+static uint32_t             capBits       = 0;
+static uint32_t             capTrigBits   = 0;
+static uint32_t             capTrigLevels = 0;
+static uint32_t             capTrigLast   = 0;
+static uint32_t             capPreMicros  = 0;
+static uint64_t             capTick       = 0; /* of the last record */
+static uint32_t             capLevel      = 0; /* after the last record */
+static uint64_t             capUsed       = 0;
+static uint64_t             capCount      = 0;
+static uint64_t             capNextIndex  = 0;
+
+/* changes while armed, and the levels before the oldest kept */
+
+static capSample_t         *capPre        = NULL;
+static unsigned             capPreTail    = 0;
+static unsigned             capPreCount   = 0;
+static uint64_t             capBaseTick   = 0;
+static uint32_t             capBaseLevel  = 0;
+
+static pthread_mutex_t capMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+I2C queue, one worker per bus.  Transactions without a callback
+keep their slot until collected by i2cQueueWait.
+*/
+
+static i2cQueued_t i2cQueued[PI_I2C_QUEUE_SLOTS];
+static i2cQueue_t  i2cQueueBus[PI_NUM_I2C_BUS];
+static uint8_t     i2cQueueAlone[PI_I2C_SLOTS]; /* last transfer failed */
+
+static pthread_mutex_t i2cQMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  i2cQWork  = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  i2cQDone  = PTHREAD_COND_INITIALIZER;
+
+static gpioPoll_t gpioPoll[PI_POLL_SLOTS];
+
+static pthread_mutex_t pollMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  pollWork  = PTHREAD_COND_INITIALIZER;
+
+/* SPI poll transfers are made by one worker, off the timer thread */
+
+static pthread_t pthPollSPI;
+static int       pollSPIRunning  = 0;
+static int       pollSPIStopping = 0;
+
 static volatile uint32_t alertBits   = 0;
+static volatile uint32_t capMonitorBits = 0;
 static volatile uint32_t monitorBits = 0;
 static volatile uint32_t notifyBits  = 0;
 static volatile uint32_t scriptBits  = 0;
+static volatile uint32_t wdogBits    = 0;
 
 static volatile int runState = PI_STARTING;
 
 static int pthAlertRunning  = 0;
 static int pthFifoRunning   = 0;
 static int pthSocketRunning = 0;
+static int pthISRRunning    = 0;
+static int pthSerRunning    = 0;
+static int pthTimerRunning  = 0;
 
 static gpioAlert_t      gpioAlert  [PI_MAX_USER_GPIO+1];
 
 static gpioISR_t        gpioISR    [PI_MAX_USER_GPIO+1];
 
+static int              isrHeap    [PI_MAX_USER_GPIO+1];
+static int              isrHeapSize = 0;
+static int              isrEpfd     = -1;
+static int              isrWakeFd   = -1;
+static pthread_mutex_t  isrMutex    = PTHREAD_MUTEX_INITIALIZER;
+
+static int              serEpfd     = -1;
+static int              serWakeFd   = -1;
+static pthread_mutex_t  serMutex    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t  serReadMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t  groupMutex  = PTHREAD_MUTEX_INITIALIZER;
+
 static gpioGetSamples_t gpioGetSamples;
 
 static gpioInfo_t       gpioInfo   [PI_MAX_GPIO+1];
@@ -1164,12 +1650,40 @@ static gpioNotify_t     gpioNotify [PI_NOTIFY_SLOTS];
 static i2cInfo_t        i2cInfo    [PI_I2C_SLOTS];
 static serInfo_t        serInfo    [PI_SER_SLOTS];
 static spiInfo_t        spiInfo    [PI_SPI_SLOTS];
+static groupInfo_t      groupInfo  [PI_GROUP_SLOTS];
+
+static unsigned         spiDmaPage = 0; /* first page of SPI DMA block */
+
+/* the gpio on/off words as in the DMA tables and as staged */
+
+static uint32_t         pwmOnCur  [SUPERCYCLE];
+static uint32_t         pwmOnNew  [SUPERCYCLE];
+static uint32_t         pwmOffCur [SUPERLEVEL+1];
+static uint32_t         pwmOffNew [SUPERLEVEL+1];
+static uint32_t         pwmDirty  [SUPERLEVEL/32]; /* keys to write */
+
+static int              pwmStaging  = 0; /* gpioPWMBegin called */
+static void            *pwmOwner    = NULL; /* socket client staging */
+static unsigned         pwmPeriod   = 1; /* common period of the staged */
+static uint32_t         pwmStopBits = 0; /* PWM stopped, clear once done */
+static uint32_t         pwmHoldBits = 0; /* servo stopped, let pulse end */
+static pthread_mutex_t  pwmMutex    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t  spiDmaMutex = PTHREAD_MUTEX_INITIALIZER;
 
 static gpioScript_t     gpioScript [PI_MAX_SCRIPTS];
 
 static gpioSignal_t     gpioSignal [PI_MAX_SIGNUM+1];
 
-static gpioTimer_t      gpioTimer  [PI_MAX_TIMER+1];
+static gpioTimer_t      gpioTimer  [PI_TIMER_SLOTS];
+
+static int              twHead     [TW_LISTS];
+static uint32_t         twBits     [TW_LEVELS][TW_SLOTS/32];
+static uint64_t         twNext      = 0; /* next tick to process */
+static int              twActive    = 0;
+static int              twFd        = -1;
+static int              twCalling   = TW_NONE;
+static pthread_mutex_t  twMutex     = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   twCond      = PTHREAD_COND_INITIALIZER;
 
 static int pwmFreq[PWM_FREQS];
 
@@ -1183,6 +1697,7 @@ static FILE * outFifo = NULL;
 static int fdLock = -1;
 static int fdMem  = -1;
 static int fdSock = -1;
+static int fdEpoll = -1;
 static int fdPmap = -1;
 static int fdMbox = -1;
 
@@ -1222,6 +1737,7 @@ static volatile gpioCfg_t gpioCfg =
    PI_DEFAULT_DMA_PRIMARY_CHANNEL,
    PI_DEFAULT_DMA_SECONDARY_CHANNEL,
    PI_DEFAULT_SOCKET_PORT,
+   PI_DEFAULT_SOCKET_CLIENTS,
    PI_DEFAULT_IF_FLAGS,
    PI_DEFAULT_MEM_ALLOC_MODE,
    0, /* dbgLevel */
@@ -1237,9 +1753,21 @@ static unsigned bufferCycles; /* number of cycles */
 static pthread_t pthAlert;
 static pthread_t pthFifo;
 static pthread_t pthSocket;
+static pthread_t pthSocketWorkers[PI_MAX_SOCKET_CLIENTS];
+static int sockWorkers = 0; /* besides pthSocket */
+static volatile int sockBusy = 0; /* workers serving an event */
+static int sockStopping = 0;
+static pthread_mutex_t sockWorkerMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t pthISR;
+static pthread_t pthSer;
+static pthread_t pthTimer;
+static volatile int sockClients = 0;
 
 static gpioSample_t gpioSample[DATUMS];
-static gpioReport_t gpioReport[DATUMS];
+static notifyRing_t notifyRing =
+{
+   0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER
+};
 
 static uint32_t spi_dummy;
 
@@ -1363,6 +1891,42 @@ static void initHWClk
 
 static void initDMAgo(volatile uint32_t  *dmaAddr, uint32_t cbAddr);
 
+static void simGpioWrite(int reg, uint32_t bits);
+
+static void isrStop(void);
+
+static void twStop(void);
+
+static void wsStop(void);
+
+static void capStop(void);
+
+static int capCommandFile(char *name, char *path, unsigned size);
+
+static void i2cQueueStop(void);
+
+static void pollStopAll(int handle);
+
+static void pollSPIStop(void);
+
+static void serStop(void);
+
+static void serNotifyStopAll(int handle);
+
+static int pwmBegin(void *owner);
+
+static void pwmRelease(void *owner);
+
+static uint64_t twMicros(void);
+
+static uint64_t systTick64(void);
+
+static unsigned dmaNowAtICB(void);
+
+static unsigned dmaCurrentSlot(unsigned pos);
+
+static int mySpiSegments(unsigned handle, char *buf, unsigned bufLen);
+
 int gpioWaveTxStart(unsigned wave_mode); /* deprecated */
 
 
@@ -1438,21 +2002,12 @@ static void myGpioSetMode(unsigned gpio, unsigned mode)
 }
 
 
-/* ----------------------------------------------------------------------- */
-
-static int myGpioRead(unsigned gpio)
-{
-   if ((*(gpioReg + GPLEV0 + BANK) & BIT) != 0) return PI_ON;
-   else                                         return PI_OFF;
-}
-
-
 /* ----------------------------------------------------------------------- */
 
 static void myGpioWrite(unsigned gpio, unsigned level)
 {
-   if (level == PI_OFF) *(gpioReg + GPCLR0 + BANK) = BIT;
-   else                 *(gpioReg + GPSET0 + BANK) = BIT;
+   if (level == PI_OFF) GPIO_CLR(BANK, BIT);
+   else                 GPIO_SET(BANK, BIT);
 }
 
 /* ----------------------------------------------------------------------- */
@@ -1532,16 +2087,50 @@ static void myTckPageSlot(int pos, int * page, int * slot)
 
 /* ----------------------------------------------------------------------- */
 
-static uint32_t myGetLevel(int pos)
+/*
+Returns the index of the first of count level words which differs
+from oldLevel in the bits selected by mask, or count if none differ.
+
+Four words are compared per step so that runs with no change are
+skipped without a branch per sample.  oldLevel must already be masked.
+*/
+
+static int myScanLevels(
+   const uint32_t *level, int count, uint32_t mask, uint32_t oldLevel)
 {
-   uint32_t level;
-   int page, slot;
+   int i = 0;
 
-   myLvsPageSlot(pos, &page, &slot);
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+   uint32x4_t vMask, vOld, vDiff;
+   uint64x2_t vAny;
+
+   vMask = vdupq_n_u32(mask);
+   vOld  = vdupq_n_u32(oldLevel);
+
+   while ((i+4) <= count)
+   {
+      vDiff = veorq_u32(vandq_u32(vld1q_u32(level+i), vMask), vOld);
+      vAny  = vreinterpretq_u64_u32(vDiff);
+
+      if (vgetq_lane_u64(vAny, 0) | vgetq_lane_u64(vAny, 1)) break;
+
+      i += 4;
+   }
+#else
+   while ((i+4) <= count)
+   {
+      if (((level[i  ] ^ oldLevel) |
+           (level[i+1] ^ oldLevel) |
+           (level[i+2] ^ oldLevel) |
+           (level[i+3] ^ oldLevel)) & mask) break;
+
+      i += 4;
+   }
+#endif
 
-   level = dmaIVirt[page]->level[slot];
+   while ((i < count) && !((level[i] ^ oldLevel) & mask)) i++;
 
-   return level;
+   return i;
 }
 
 /* ----------------------------------------------------------------------- */
@@ -1635,8 +2224,11 @@ static int myDoCommand(uint32_t *p, unsigned bufSize, char *buf)
    int res, i, j;
    uint32_t mask;
    uint32_t tmp1, tmp2, tmp3;
+   uint64_t tick64;
    gpioPulse_t *pulse;
    int masked;
+   unsigned group[PI_MAX_GROUP_GPIOS];
+   char capFile[256];
 
    res = 0;
 
@@ -1719,6 +2311,32 @@ static int myDoCommand(uint32_t *p, unsigned bufSize, char *buf)
          }
          break;
 
+      case PI_CMD_CAPOFF: res = gpioCaptureStop(); break;
+
+      case PI_CMD_CAPON:
+         if (p[3] > 12)
+            res = capCommandFile(buf+12, capFile, sizeof(capFile));
+         else
+            res = PI_BAD_CAPTURE;
+
+         if (!res)
+         {
+            memcpy(&tmp1, buf,   4);
+            memcpy(&tmp2, buf+4, 4);
+            memcpy(&tmp3, buf+8, 4);
+            res = gpioCaptureStart(capFile, p[1], p[2], tmp1, tmp2, tmp3);
+         }
+         break;
+
+      case PI_CMD_CAPST:
+         res = gpioCaptureStatus((uint32_t *)buf+1, (uint32_t *)buf+2);
+         if (res >= 0)
+         {
+            memcpy(buf, &res, 4);
+            res = 12;
+         }
+         break;
+
       case PI_CMD_CF1:
          res = gpioCustom1(p[1], p[2], buf, p[3]);
          break;
@@ -1738,6 +2356,38 @@ static int myDoCommand(uint32_t *p, unsigned bufSize, char *buf)
 
       case PI_CMD_GPW: res = gpioGetServoPulsewidth(p[1]); break;
 
+      case PI_CMD_GRPC: res = gpioGroupClose(p[1]); break;
+
+      case PI_CMD_GRPO:
+         /* the gpios are sent one per byte */
+
+         if ((p[3] < 1) || (p[3] > PI_MAX_GROUP_GPIOS))
+         {
+            res = PI_BAD_GROUP;
+            break;
+         }
+
+         mask = 0;
+
+         for (i=0; i<p[3]; i++)
+         {
+            group[i] = (uint8_t)buf[i];
+
+            if (group[i] <= PI_MAX_USER_GPIO) mask |= (1<<group[i]);
+         }
+
+         if ((mask & gpioMask) != mask)
+         {
+            DBG(DBG_USER,
+               "gpioGroupOpen: bad gpios %08X (permissions %08X)",
+               mask, (uint32_t)gpioMask);
+            res = PI_NOT_PERMITTED;
+         }
+         else res = gpioGroupOpen(p[3], group);
+         break;
+
+      case PI_CMD_GRPW: res = gpioGroupWrite(p[1], p[2]); break;
+
       case PI_CMD_HC:
          /* special case to allow password in upper byte */
          if (myPermit(p[1]&0xFFFFFF)) res = gpioHardwareClock(p[1], p[2]);
@@ -1870,6 +2520,8 @@ static int myDoCommand(uint32_t *p, unsigned bufSize, char *buf)
 
       case PI_CMD_NC: res = gpioNotifyClose(p[1]); break;
 
+      case PI_CMD_NF: res = gpioNotifyFormat(p[1], p[2]); break;
+
       case PI_CMD_NO: res = gpioNotifyOpen();  break;
 
       case PI_CMD_NP: res = gpioNotifyPause(p[1]); break;
@@ -1888,6 +2540,19 @@ static int myDoCommand(uint32_t *p, unsigned bufSize, char *buf)
 
       case PI_CMD_PIGPV: res = gpioVersion(); break;
 
+      case PI_CMD_POLLOFF: res = gpioPollStop(p[1]); break;
+
+      case PI_CMD_POLLON:
+         if (p[3] >= 12)
+         {
+            memcpy(&tmp1, buf, 4);   /* flags */
+            memcpy(&tmp2, buf+4, 4); /* micros */
+            memcpy(&tmp3, buf+8, 4); /* rxLen */
+            res = gpioPollStart(p[1], tmp1, p[2], tmp2, buf+12, p[3]-12, tmp3);
+         }
+         else res = PI_BAD_POLL;
+         break;
+
       case PI_CMD_PRG: res = gpioGetPWMrange(p[1]); break;
 
       case PI_CMD_PROC:
@@ -1937,6 +2602,10 @@ static int myDoCommand(uint32_t *p, unsigned bufSize, char *buf)
          }
          break;
 
+      case PI_CMD_PWMB: res = gpioPWMBegin(); break;
+
+      case PI_CMD_PWMC: res = gpioPWMCommit(); break;
+
       case PI_CMD_READ: res = gpioRead(p[1]); break;
 
       case PI_CMD_SERVO:
@@ -1968,6 +2637,18 @@ static int myDoCommand(uint32_t *p, unsigned bufSize, char *buf)
 
       case PI_CMD_SERW: res = serWrite(p[1], buf, p[3]); break;
 
+      case PI_CMD_SERNOFF: res = serNotifyStop(p[1]); break;
+
+      case PI_CMD_SERNON:
+         if (p[3] == 8)
+         {
+            memcpy(&tmp1, buf, 4);   /* delim */
+            memcpy(&tmp2, buf+4, 4); /* count */
+            res = serNotifyStart(p[1], p[2], tmp1, tmp2);
+         }
+         else res = PI_BAD_PARAM;
+         break;
+
 
 
       case PI_CMD_SLR:
@@ -2001,11 +2682,22 @@ static int myDoCommand(uint32_t *p, unsigned bufSize, char *buf)
          res = spiWrite(p[1], buf, p[3]);
          break;
 
+      case PI_CMD_SPISG:
+         if (p[3] > bufSize) p[3] = bufSize;
+         res = mySpiSegments(p[1], buf, p[3]);
+         break;
+
       case PI_CMD_SPIX:
          if (p[3] > bufSize) p[3] = bufSize;
          res = spiXfer(p[1], buf, buf, p[3]);
          break;
 
+      case PI_CMD_T64:
+         tick64 = gpioTick64();
+         memcpy(buf, &tick64, 8);
+         res = 8;
+         break;
+
       case PI_CMD_TICK: res = gpioTick(); break;
 
       case PI_CMD_TRIG:
@@ -2156,62 +2848,271 @@ static int myDoCommand(uint32_t *p, unsigned bufSize, char *buf)
 
 /* ----------------------------------------------------------------------- */
 
-static void mySetGpioOff(unsigned gpio, int pos)
-{
-   int page, slot;
+/*
+The gpio on/off words of the DMA tables are staged in ordinary
+(cached) copies and only the words which change are written to the
+uncached DMA pages, so a change never reads the DMA pages and each
+changed word is written once however many gpios share it.
+
+A table word is keyed by the level at which the DMA reads it, the
+on word of cycle c at level c*PULSE_PER_CYCLE and off word p at
+level p-1.  Words are written in key order starting just ahead of
+the DMA, so the DMA sees the old words up to one level and the new
+words from there on.
+
+Outside gpioPWMBegin/gpioPWMCommit each change is written at once,
+new off levels being added before old ones are removed, as before.
+A commit waits for a period boundary common to every gpio changed
+and switches all of them there together.
+*/
 
-   myOffPageSlot(pos, &page, &slot);
+static void pwmStage(uint32_t *tab, unsigned pos, unsigned key,
+   unsigned gpio, int on)
+{
+   if (on) tab[pos] |= (1<<gpio); else tab[pos] &= ~(1<<gpio);
 
-   dmaIVirt[page]->gpioOff[slot] |= (1<<gpio);
+   pwmDirty[key>>5] |= (1<<(key&31));
 }
 
 /* ----------------------------------------------------------------------- */
 
-static void myClearGpioOff(unsigned gpio, int pos)
+static void mySetGpioOff(unsigned gpio, int pos)
 {
-   int page, slot;
+   pwmStage(pwmOffNew, pos, pos-1, gpio, 1);
+}
 
-   myOffPageSlot(pos, &page, &slot);
+/* ----------------------------------------------------------------------- */
 
-   dmaIVirt[page]->gpioOff[slot] &= ~(1<<gpio);
+static void myClearGpioOff(unsigned gpio, int pos)
+{
+   pwmStage(pwmOffNew, pos, pos-1, gpio, 0);
 }
 
 /* ----------------------------------------------------------------------- */
 
 static void mySetGpioOn(unsigned gpio, int pos)
 {
-   int page, slot;
-
-   page = pos/ON_PER_IPAGE;
-   slot = pos%ON_PER_IPAGE;
-
-   dmaIVirt[page]->gpioOn[slot] |= (1<<gpio);
+   pwmStage(pwmOnNew, pos, pos*PULSE_PER_CYCLE, gpio, 1);
 }
 
 /* ----------------------------------------------------------------------- */
 
 static void myClearGpioOn(unsigned gpio, int pos)
 {
-   int page, slot;
+   pwmStage(pwmOnNew, pos, pos*PULSE_PER_CYCLE, gpio, 0);
+}
 
-   page = pos/ON_PER_IPAGE;
-   slot = pos%ON_PER_IPAGE;
+/* ----------------------------------------------------------------------- */
+
+/* the period of every gpio staged so far, all periods divide SUPERLEVEL */
+
+static void pwmAddPeriod(unsigned realRange)
+{
+   unsigned a, b, t;
+
+   a = pwmPeriod;
+   b = realRange;
+
+   while (b)
+   {
+      t = a % b;
+      a = b;
+      b = t;
+   }
+
+   pwmPeriod = (pwmPeriod / a) * realRange;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/*
+Writes the staged words for one key, returns the number of DMA words
+written.  PWM_PASS_ADD only adds gpios, PWM_PASS_HOLD removes all but
+the held gpios from the off word.  The key stays dirty until both
+words are as staged.
+*/
+
+static int pwmWriteKey(unsigned key, int pass)
+{
+   uint32_t v;
+   int page, slot, on, off, writes;
+
+   writes = 0;
+
+   on = -1;
+
+   if (!(key % PULSE_PER_CYCLE))
+   {
+      on = key / PULSE_PER_CYCLE;
+
+      v = pwmOnNew[on];
+
+      if (pass == PWM_PASS_ADD) v |= pwmOnCur[on];
+
+      if (v != pwmOnCur[on])
+      {
+         dmaIVirt[on/ON_PER_IPAGE]->gpioOn[on%ON_PER_IPAGE] = v;
+         pwmOnCur[on] = v;
+         writes++;
+      }
+   }
+
+   off = key + 1;
+
+   v = pwmOffNew[off];
+
+   if      (pass == PWM_PASS_ADD)  v |= pwmOffCur[off];
+   else if (pass == PWM_PASS_HOLD) v |= (pwmOffCur[off] & pwmHoldBits);
+
+   if (v != pwmOffCur[off])
+   {
+      myOffPageSlot(off, &page, &slot);
+      dmaIVirt[page]->gpioOff[slot] = v;
+      pwmOffCur[off] = v;
+      writes++;
+   }
+
+   if ((pwmOffCur[off] == pwmOffNew[off]) &&
+       ((on < 0) || (pwmOnCur[on] == pwmOnNew[on])))
+      pwmDirty[key>>5] &= ~(1<<(key&31));
+
+   return writes;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* writes the dirty keys from start for count levels */
+
+static int pwmSweep(unsigned start, unsigned count, int pass)
+{
+   unsigned n, key, span;
+   uint32_t bits;
+   int writes;
+
+   writes = 0;
+
+   n = 0;
+
+   /* a bitmap word at a time, SUPERLEVEL is a multiple of 32 */
+
+   while (n < count)
+   {
+      key  = (start + n) % SUPERLEVEL;
+      span = 32 - (key & 31);
+
+      if (span > (count - n)) span = count - n;
+
+      bits = pwmDirty[key>>5] >> (key & 31);
+
+      if (span < 32) bits &= (1U<<span) - 1;
+
+      while (bits)
+      {
+         writes += pwmWriteKey(key + __builtin_ctz(bits), pass);
+
+         bits &= bits - 1;
+      }
+
+      n += span;
+   }
+
+   return writes;
+}
+
+/* ----------------------------------------------------------------------- */
 
-   dmaIVirt[page]->gpioOn[slot] &= ~(1<<gpio);
+static unsigned pwmDmaLevel(void)
+{
+   return dmaCurrentSlot(dmaNowAtICB()) % SUPERLEVEL;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/*
+Writes every staged change, called with pwmMutex held.  Returns the
+number of DMA words written.
+*/
+
+static int pwmFlush(int atBoundary)
+{
+   unsigned level, ahead, done;
+   uint32_t tick, limit;
+   int writes;
+
+   level = pwmDmaLevel();
+
+   if (atBoundary)
+   {
+      /* the first common period boundary PWM_FLUSH_AHEAD or more
+         levels ahead of the DMA */
+
+      ahead = PWM_FLUSH_AHEAD + pwmPeriod - 1;
+      ahead -= (level + ahead) % pwmPeriod;
+
+      if (ahead >= SUPERLEVEL) ahead -= pwmPeriod;
+
+      /* the words from the boundary on are written first, those
+         before it once the DMA has read them */
+
+      writes = pwmSweep(level + ahead, SUPERLEVEL - ahead, PWM_PASS_ALL);
+
+      tick  = systReg[SYST_CLO];
+      limit = 2 * SUPERLEVEL * gpioCfg.clockMicros;
+
+      while ((systReg[SYST_CLO] - tick) < limit)
+      {
+         done = (pwmDmaLevel() + SUPERLEVEL - level) % SUPERLEVEL;
+
+         if (done >= ahead) break;
+
+         myGpioDelay((ahead - done) * gpioCfg.clockMicros);
+      }
+
+      writes += pwmSweep(level, ahead, PWM_PASS_ALL);
+   }
+   else
+   {
+      level += PWM_FLUSH_AHEAD;
+
+      /* add new off levels before removing old ones */
+
+      writes = pwmSweep(level, SUPERLEVEL, PWM_PASS_ADD);
+
+      writes += pwmSweep(level, SUPERLEVEL, PWM_PASS_HOLD);
+
+      if (pwmHoldBits)
+      {
+         /* if in pulse then delay for the last cycle to complete */
+
+         if (*(gpioReg + GPLEV0) & pwmHoldBits)
+            myGpioDelay(PI_MAX_SERVO_PULSEWIDTH);
+
+         writes += pwmSweep(level, SUPERLEVEL, PWM_PASS_ALL);
+      }
+   }
+
+   if (pwmStopBits)
+   {
+      GPIO_CLR(0, pwmStopBits);
+      GPIO_CLR(0, pwmStopBits);
+   }
+
+   pwmStopBits = 0;
+   pwmHoldBits = 0;
+   pwmPeriod   = 1;
+
+   return writes;
 }
 
 /* ----------------------------------------------------------------------- */
 
 static void myGpioSetPwm(unsigned gpio, int oldVal, int newVal)
 {
-   int switchGpioOff;
    int newOff, oldOff, realRange, cycles, i;
 
    DBG(DBG_INTERNAL,
       "myGpioSetPwm %d from %d to %d", gpio, oldVal, newVal);
 
-   switchGpioOff = 0;
-
    realRange = pwmRealRange[gpioInfo[gpio].freqIdx];
 
    cycles    = pwmCycles   [gpioInfo[gpio].freqIdx];
@@ -2221,6 +3122,8 @@ static void myGpioSetPwm(unsigned gpio, int oldVal, int newVal)
 
    if (newOff != oldOff)
    {
+      pthread_mutex_lock(&pwmMutex);
+
       if (newOff && oldOff)                      /* PWM CHANGE */
       {
          for (i=0; i<SUPERLEVEL; i+=realRange)
@@ -2237,6 +3140,8 @@ static void myGpioSetPwm(unsigned gpio, int oldVal, int newVal)
          /* schedule new gpio on */
 
          for (i=0; i<SUPERCYCLE; i+=cycles) mySetGpioOn(gpio, i);
+
+         pwmStopBits &= ~(1<<gpio);
       }
       else                                       /* PWM STOP */
       {
@@ -2248,14 +3153,14 @@ static void myGpioSetPwm(unsigned gpio, int oldVal, int newVal)
          for (i=0; i<SUPERLEVEL; i+=realRange)
             myClearGpioOff(gpio, i+oldOff);
 
-         switchGpioOff = 1;
+         pwmStopBits |= (1<<gpio);
       }
 
-      if (switchGpioOff)
-      {
-         *(gpioReg + GPCLR0) = (1<<gpio);
-         *(gpioReg + GPCLR0) = (1<<gpio);
-      }
+      pwmAddPeriod(realRange);
+
+      if (!pwmStaging) pwmFlush(0);
+
+      pthread_mutex_unlock(&pwmMutex);
    }
 }
 
@@ -2276,6 +3181,8 @@ static void myGpioSetServo(unsigned gpio, int oldVal, int newVal)
 
    if (newOff != oldOff)
    {
+      pthread_mutex_lock(&pwmMutex);
+
       if (newOff && oldOff)                       /* SERVO CHANGE */
       {
          for (i=0; i<SUPERLEVEL; i+=realRange)
@@ -2293,6 +3200,8 @@ static void myGpioSetServo(unsigned gpio, int oldVal, int newVal)
 
          for (i=0; i<SUPERCYCLE; i+=cycles)
             mySetGpioOn(gpio, i);
+
+         pwmHoldBits &= ~(1<<gpio);
       }
       else                                        /* SERVO STOP */
       {
@@ -2301,15 +3210,19 @@ static void myGpioSetServo(unsigned gpio, int oldVal, int newVal)
          for (i=0; i<SUPERCYCLE; i+=cycles)
             myClearGpioOn(gpio, i);
 
-         /* if in pulse then delay for the last cycle to complete */
-
-         if (myGpioRead(gpio)) myGpioDelay(PI_MAX_SERVO_PULSEWIDTH);
-
-         /* deschedule gpio off */
+         /* deschedule gpio off once a pulse in progress completes */
 
          for (i=0; i<SUPERLEVEL; i+=realRange)
             myClearGpioOff(gpio, i+oldOff);
+
+         pwmHoldBits |= (1<<gpio);
       }
+
+      pwmAddPeriod(realRange);
+
+      if (!pwmStaging) pwmFlush(0);
+
+      pthread_mutex_unlock(&pwmMutex);
    }
 }
 
@@ -2522,6 +3435,17 @@ static void waveSetOOL(int pos, uint32_t OOL)
 
 /* ----------------------------------------------------------------------- */
 
+static uint32_t waveGetOOL(int pos)
+{
+   int page, slot;
+
+   waveOOLPageSlot(pos, &page, &slot);
+
+   return ((volatile uint32_t *)dmaOVirt[page]->OOL)[slot];
+}
+
+/* ----------------------------------------------------------------------- */
+
 static uint32_t waveOOLPOadr(int pos)
 {
    int page, slot;
@@ -2559,431 +3483,785 @@ static void waveBitDelay
 
 /* ----------------------------------------------------------------------- */
 
-static void waveCBsOOLs(int *numCBs, int *numBOOLs, int *numTOOLs)
+static void waveReset(void)
 {
-   int numCB=0, numBOOL=0, numTOOL=0;
+   wfNumChunks = 0;
+   wfPulses    = 0;
+   wfCbs       = 0;
+   wfOOLs      = 0;
+   wfLastTick  = 0;
+   wfLastGroup = 0;
+   wfEnd       = 0;
+   wfFlat      = 0;
+}
 
-   unsigned i;
+/* ----------------------------------------------------------------------- */
 
-   unsigned numWaves;
+static int waveCost(uint32_t gpioOn, uint32_t gpioOff, uint32_t flags)
+{
+   int cbs = 1; /* one cb for delay */
 
-   rawWave_t *waves;
+   if (gpioOn)                  cbs++;
+   if (gpioOff)                 cbs++;
+   if (flags & WAVE_FLAG_READ)  cbs++;
+   if (flags & WAVE_FLAG_TICK)  cbs++;
 
-   numWaves = wfc[wfcur];
-   waves    = wf [wfcur];
+   return cbs;
+}
 
-   /* delay cb at start of DMA */
+/* ----------------------------------------------------------------------- */
 
-   numCB++;
+static int waveOOLs(uint32_t flags)
+{
+   int ools = 0;
 
-   for (i=0; i<numWaves; i++)
-   {
-      if (waves[i].gpioOn)                 {numCB++; numBOOL++;}
-      if (waves[i].gpioOff)                {numCB++; numBOOL++;}
-      if (waves[i].flags & WAVE_FLAG_READ) {numCB++; numTOOL++;}
-      if (waves[i].flags & WAVE_FLAG_TICK) {numCB++; numTOOL++;}
-      if (waves[i].usDelay)                {numCB++;           }
-   }
+   if (flags & WAVE_FLAG_READ) ools++;
+   if (flags & WAVE_FLAG_TICK) ools++;
 
-   *numCBs   = numCB;
-   *numBOOLs = numBOOL;
-   *numTOOLs = numTOOL;
+   return ools;
 }
 
 /* ----------------------------------------------------------------------- */
 
-static int wave2Cbs(unsigned wave_mode, int *CB, int *BOOL, int *TOOL)
+static wfPulse_t *waveAt(int chunk, int pos)
 {
-   int botCB=*CB, botOOL=*BOOL, topOOL=*TOOL;
+   if (chunk >= wfNumChunks) return NULL;
 
-   int status;
+   if (pos >= wfChunkLen[wfChunkList[chunk]]) return NULL;
 
-   rawCbs_t *p=NULL;
+   return &wfChunk[wfChunkList[chunk]][pos];
+}
 
-   unsigned i, half, repeatCB;
+/* ----------------------------------------------------------------------- */
 
-   unsigned numWaves;
+static void waveNext(int *chunk, int *pos)
+{
+   if (++(*pos) >= wfChunkLen[wfChunkList[*chunk]])
+   {
+      ++(*chunk);
+      *pos = 0;
+   }
+}
 
-   rawWave_t * waves;
+/* ----------------------------------------------------------------------- */
 
-   numWaves = wfc[wfcur];
-   waves    = wf [wfcur];
+static void waveFind(uint32_t tick, int *chunk, int *pos)
+{
+   int lo, hi, mid, c;
 
-   half = PI_WF_MICROS/2;
+   /* the first pulse starting at or after tick */
 
-   /* add delay cb at start of DMA */
+   lo = 0;
+   hi = wfNumChunks;
 
-   p = rawWaveCBAdr(botCB++);
+   while (lo < hi)
+   {
+      mid = (lo + hi) / 2;
+      c = wfChunkList[mid];
 
-   /* use the secondary clock */
+      if (wfChunk[c][wfChunkLen[c]-1].tick < tick) lo = mid + 1; else hi = mid;
+   }
 
-   if (gpioCfg.clockPeriph != PI_CLOCK_PCM)
+   *chunk = lo;
+   *pos = 0;
+
+   if (lo >= wfNumChunks) return;
+
+   c = wfChunkList[lo];
+
+   lo = 0;
+   hi = wfChunkLen[c];
+
+   while (lo < hi)
    {
-      p->info = NORMAL_DMA | TIMED_DMA(2);
-      p->dst  = PCM_TIMER;
+      mid = (lo + hi) / 2;
+
+      if (wfChunk[c][mid].tick < tick) lo = mid + 1; else hi = mid;
    }
-   else
+
+   *pos = lo;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void waveInsert(int *chunk, int *pos, wfPulse_t *pulse)
+{
+   int c, d, half;
+
+   /* prefer the room at the end of the previous chunk */
+
+   if ((*pos == 0) && (*chunk > 0) &&
+       (wfChunkLen[wfChunkList[*chunk-1]] < WF_CHUNK_SIZE))
    {
-      p->info = NORMAL_DMA | TIMED_DMA(5);
-      p->dst  = PWM_TIMER;
+      --(*chunk);
+      *pos = wfChunkLen[wfChunkList[*chunk]];
    }
 
-   p->src    = (uint32_t) (&dmaOBus[0]->periphData);
-   p->length = 4 * 20 / PI_WF_MICROS; /* 20 micros delay */
-   p->next   = waveCbPOadr(botCB);
+   if (*chunk >= wfNumChunks)
+   {
+      /* start a new last chunk */
 
-   repeatCB = botCB;
+      c = wfNumChunks;
+      wfChunkList[wfNumChunks++] = c;
+      wfChunkLen[c] = 0;
+      *chunk = wfNumChunks - 1;
+      *pos = 0;
+   }
 
-   for (i=0; i<numWaves; i++)
+   c = wfChunkList[*chunk];
+
+   if (wfChunkLen[c] >= WF_CHUNK_SIZE)
    {
-      if (waves[i].gpioOn)
-      {
-         waveSetOOL(botOOL, waves[i].gpioOn);
+      /* split a full chunk */
 
-         p = rawWaveCBAdr(botCB++);
+      half = WF_CHUNK_SIZE / 2;
 
-         p->info   = NORMAL_DMA;
-         p->src    = waveOOLPOadr(botOOL++);
-         p->dst    = ((GPIO_BASE + (GPSET0*4)) & 0x00ffffff) | PI_PERI_BUS;
-         p->length = 4;
-         p->next   = waveCbPOadr(botCB);
-      }
+      d = wfNumChunks;
 
-      if (waves[i].gpioOff)
-      {
-         waveSetOOL(botOOL, waves[i].gpioOff);
+      memcpy(wfChunk[d], wfChunk[c]+half, half * sizeof(wfPulse_t));
 
-         p = rawWaveCBAdr(botCB++);
+      wfChunkLen[c] = half;
+      wfChunkLen[d] = WF_CHUNK_SIZE - half;
 
-         p->info   = NORMAL_DMA;
-         p->src    = waveOOLPOadr(botOOL++);
-         p->dst    = ((GPIO_BASE + (GPCLR0*4)) & 0x00ffffff) | PI_PERI_BUS;
-         p->length = 4;
-         p->next   = waveCbPOadr(botCB);
-      }
+      memmove(wfChunkList+*chunk+2, wfChunkList+*chunk+1,
+         (wfNumChunks - (*chunk+1)) * sizeof(int));
 
-      if (waves[i].flags & WAVE_FLAG_READ)
-      {
-         p = rawWaveCBAdr(botCB++);
+      wfChunkList[*chunk+1] = d;
 
-         p->info   = NORMAL_DMA;
-         p->src    = ((GPIO_BASE + (GPLEV0*4)) & 0x00ffffff) | PI_PERI_BUS;
-         p->dst    = waveOOLPOadr(--topOOL);
-         p->length = 4;
-         p->next   = waveCbPOadr(botCB);
-      }
+      wfNumChunks++;
 
-      if (waves[i].flags & WAVE_FLAG_TICK)
+      if (*pos > half)
       {
-         p = rawWaveCBAdr(botCB++);
-
-         p->info   = NORMAL_DMA;
-         p->src    = ((SYST_BASE + (SYST_CLO*4)) & 0x00ffffff) | PI_PERI_BUS;
-         p->dst    = waveOOLPOadr(--topOOL);
-         p->length = 4;
-         p->next   = waveCbPOadr(botCB);
+         ++(*chunk);
+         *pos -= half;
+         c = d;
       }
+   }
 
-      if (waves[i].usDelay)
-      {
-         p = rawWaveCBAdr(botCB++);
+   memmove(wfChunk[c]+*pos+1, wfChunk[c]+*pos,
+      (wfChunkLen[c] - *pos) * sizeof(wfPulse_t));
 
-         /* use the secondary clock */
+   wfChunk[c][*pos] = *pulse;
 
-         if (gpioCfg.clockPeriph != PI_CLOCK_PCM)
-         {
-            p->info = NORMAL_DMA | TIMED_DMA(2);
-            p->dst  = PCM_TIMER;
-         }
-         else
-         {
-            p->info = NORMAL_DMA | TIMED_DMA(5);
-            p->dst  = PWM_TIMER;
-         }
+   wfChunkLen[c]++;
 
-         p->src    = (uint32_t) (&dmaOBus[0]->periphData);
-         p->length = 4 * ((waves[i].usDelay+half)/PI_WF_MICROS);
-         p->next   = waveCbPOadr(botCB);
-      }
-   }
-
-   if (p != NULL)
-   {
-      if (wave_mode == PI_WAVE_MODE_ONE_SHOT)
-           p->next = 0;
-      else p->next = waveCbPOadr(repeatCB);
-   }
+   ++(*pos);
+}
 
-   status = botCB - *CB;
+/* ----------------------------------------------------------------------- */
 
-   *CB   = botCB;
-   *BOOL = botOOL;
-   *TOOL = topOOL;
+/*
+Merges numIn pulses, starting at tick 0, into the wave being built.
 
-   return status;
-}
+Pulses starting at the same tick are paired in order, the nth added
+with the nth already there, and any left over follow.  This gives the
+same wave as merging the whole of both pulse lists.
 
-/* ----------------------------------------------------------------------- */
+If check is set nothing is changed and PI_TOO_MANY_PULSES is returned
+if the merged wave would be too big.
+*/
 
-static void waveRxSerial(wfRx_t *w, int level, uint32_t tick)
+static int waveMerge(unsigned numIn, rawWave_t *in, int check)
 {
-   int diffTicks, lastLevel;
-   int newWritePos;
+   int pulses, cbs, ools, chunk, pos, group, i, j;
+   uint32_t tick, on, off, flags;
+   wfPulse_t *w, pulse;
+
+   pulses = wfPulses;
+   cbs    = wfCbs;
+   ools   = wfOOLs;
 
-   level = level ^ w->s.invert;
+   tick  = 0;
+   group = 0;
 
-   if (w->s.bit >= 0)
+   for (i=0; i<numIn; i+=group)
    {
-      diffTicks = tick - w->s.startBitTick;
+      /* the group of pulses starting at tick */
 
-      if (level != PI_TIMEOUT)
-      {
-         w->s.level = level;
-         lastLevel = !level;
-      }
-      else lastLevel = w->s.level;
+      for (group=1; ((i+group) < numIn) && !in[i+group-1].usDelay; group++);
 
-      while ((w->s.bit <= w->s.dataBits) &&
-             (diffTicks > (w->s.nextBitDiff/1000)))
+      waveFind(tick, &chunk, &pos);
+
+      for (j=0; j<group; j++)
       {
-         if (w->s.bit)
+         w = waveAt(chunk, pos);
+
+         if (w && (w->tick == tick))
          {
-            if (lastLevel) w->s.data |= (1<<(w->s.bit-1));
+            on    = w->gpioOn  | in[i+j].gpioOn;
+            off   = w->gpioOff | in[i+j].gpioOff;
+            flags = w->flags   | in[i+j].flags;
+
+            cbs  += waveCost(on, off, flags) -
+                    waveCost(w->gpioOn, w->gpioOff, w->flags);
+            ools += waveOOLs(flags) - waveOOLs(w->flags);
+
+            if (!check)
+            {
+               w->gpioOn  = on;
+               w->gpioOff = off;
+               w->flags   = flags;
+            }
+
+            waveNext(&chunk, &pos);
          }
-         else w->s.data = 0;
+         else
+         {
+            pulses++;
+            cbs  += waveCost(in[i+j].gpioOn, in[i+j].gpioOff, in[i+j].flags);
+            ools += waveOOLs(in[i+j].flags);
 
-         ++(w->s.bit);
+            if (!check)
+            {
+               pulse.tick    = tick;
+               pulse.gpioOn  = in[i+j].gpioOn;
+               pulse.gpioOff = in[i+j].gpioOff;
+               pulse.flags   = in[i+j].flags;
 
-         w->s.nextBitDiff += w->s.fullBit;
+               waveInsert(&chunk, &pos, &pulse);
+            }
+         }
       }
 
-      if (w->s.bit > w->s.dataBits)
-      {
-         memcpy(w->s.buf + w->s.writePos, &w->s.data, w->s.bytes);
+      if (check && ((pulses >= PI_WAVE_MAX_PULSES) ||
+                    (pulses >= (NUM_WAVE_OOL - ools))))
+         return PI_TOO_MANY_PULSES;
+
+      tick += in[i+group-1].usDelay;
+   }
 
-         /* don't let writePos catch readPos */
+   if (check) return 0;
 
-         newWritePos = (w->s.writePos + w->s.bytes) % (w->s.bufSize);
+   /*
+   The wave ends at the end of the list with the last pulse to start,
+   the earlier end if both lists end with the same pulse.
+   */
 
-         if (newWritePos != w->s.readPos) w->s.writePos = newWritePos;
+   if (numIn)
+   {
+      tick -= in[numIn-1].usDelay;
+      i = numIn - group; /* first pulse of the last group */
 
-         if (level == 0)
+      if ((wfPulses == 0) || (tick > wfLastTick))
+      {
+         wfLastTick  = tick;
+         wfLastGroup = group;
+         wfEnd       = tick + in[numIn-1].usDelay;
+      }
+      else if (tick == wfLastTick)
+      {
+         if (group > wfLastGroup)
          {
-            gpioSetWatchdog(w->gpio, w->s.timeout);
-            w->s.bit          = 0;
-            w->s.startBitTick = tick;
-            w->s.nextBitDiff  = w->s.halfBit;
+            wfLastGroup = group;
+            wfEnd       = tick + in[numIn-1].usDelay;
          }
-         else
+         else if (group == wfLastGroup)
          {
-            w->s.bit = -1;
-            gpioSetWatchdog(w->gpio, 0);
+            if ((tick + in[numIn-1].usDelay) < wfEnd)
+               wfEnd = tick + in[numIn-1].usDelay;
          }
       }
    }
-   else
-   {
-      /* start bit if high->low */
 
-      if (level == 0)
+   wfPulses = pulses;
+   wfCbs    = cbs;
+   wfOOLs   = ools;
+
+   wfFlat = -1;
+
+   return pulses;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int waveFlatten(void)
+{
+   int chunk, pos, n;
+   wfPulse_t *w;
+   uint64_t hash;
+   uint32_t *word;
+
+   if (wfFlat >= 0) return wfFlat;
+
+   n = 0;
+
+   for (chunk=0; chunk<wfNumChunks; chunk++)
+   {
+      for (pos=0; pos<wfChunkLen[wfChunkList[chunk]]; pos++)
       {
-         gpioSetWatchdog(w->gpio, w->s.timeout);
-         w->s.level        = 0;
-         w->s.bit          = 0;
-         w->s.startBitTick = tick;
-         w->s.nextBitDiff  = w->s.halfBit;
+         w = &wfChunk[wfChunkList[chunk]][pos];
+
+         if (n) wf[0][n-1].usDelay = w->tick - wf[0][n-1].usDelay;
+
+         wf[0][n].gpioOn  = w->gpioOn;
+         wf[0][n].gpioOff = w->gpioOff;
+         wf[0][n].flags   = w->flags;
+         wf[0][n].usDelay = w->tick; /* until the next pulse is seen */
+
+         n++;
       }
    }
-}
 
+   if (n) wf[0][n-1].usDelay = wfEnd - wf[0][n-1].usDelay;
+
+   /* FNV-1a, used to find an identical wave already created */
+
+   hash = 0xCBF29CE484222325ULL;
+
+   word = (uint32_t *)wf[0];
+
+   for (pos=0; pos<(n * (sizeof(rawWave_t)/4)); pos++)
+   {
+      hash = (hash ^ word[pos]) * 0x100000001B3ULL;
+   }
+
+   wfHash = hash;
+
+   wfFlat = n;
+
+   return n;
+}
 
 /* ----------------------------------------------------------------------- */
 
-static void waveRxBit(int gpio, int level, uint32_t tick)
+static void waveKeep(int wid, int keep)
 {
-   switch (wfRx[gpio].mode)
+   /* replaces the pulses kept for wid by those in wf[0] (or none) */
+
+   free(waveFlat[wid]);
+
+   waveFlat[wid]    = NULL;
+   waveFlatLen[wid] = 0;
+
+   if (keep && (wfFlat > 0))
    {
-      case PI_WFRX_SERIAL:
-         waveRxSerial(&wfRx[gpio], level, tick);
+      waveFlat[wid] = malloc(wfFlat * sizeof(rawWave_t));
+
+      if (waveFlat[wid])
+      {
+         memcpy(waveFlat[wid], wf[0], wfFlat * sizeof(rawWave_t));
+         waveFlatLen[wid] = wfFlat;
+      }
    }
 }
 
-
 /* ----------------------------------------------------------------------- */
 
-int rawWaveAddGeneric(unsigned numIn1, rawWave_t *in1)
+static int waveSame(int wid)
 {
-   unsigned inPos1=0, inPos2=0, outPos=0, level = NUM_WAVE_OOL;
+   /* a wave without kept pulses never matches */
+
+   return (waveFlat[wid] != NULL)      &&
+          (waveFlatLen[wid] == wfFlat) &&
+          !memcmp(waveFlat[wid], wf[0], wfFlat * sizeof(rawWave_t));
+}
 
-   unsigned cbs=0;
+/* ----------------------------------------------------------------------- */
 
-   unsigned numIn2, numOut;
+static void waveCBsOOLs(int *numCBs, int *numBOOLs, int *numTOOLs)
+{
+   int numCB=0, numBOOL=0, numTOOL=0;
 
-   uint32_t tNow, tNext1, tNext2, tDelay;
+   unsigned i;
 
-   rawWave_t *in2, *out;
+   unsigned numWaves;
 
-   numIn2 = wfc[wfcur];
-   in2    = wf[wfcur];
+   rawWave_t *waves;
 
-   numOut = PI_WAVE_MAX_PULSES;
-   out   = wf[1-wfcur];
+   numWaves = waveFlatten();
+   waves    = wf[0];
 
-   tNow = 0;
+   /* delay cb at start of DMA */
 
-   if (!numIn1) tNext1 = -1; else tNext1 = 0;
-   if (!numIn2) tNext2 = -1; else tNext2 = 0;
+   numCB++;
 
-   while (((inPos1<numIn1) || (inPos2<numIn2)) && (outPos<numOut))
+   for (i=0; i<numWaves; i++)
    {
-      if (tNext1 < tNext2)
-      {
-         /* pulse 1 due */
+      if (waves[i].gpioOn)                 {numCB++; numBOOL++;}
+      if (waves[i].gpioOff)                {numCB++; numBOOL++;}
+      if (waves[i].flags & WAVE_FLAG_READ) {numCB++; numTOOL++;}
+      if (waves[i].flags & WAVE_FLAG_TICK) {numCB++; numTOOL++;}
+      if (waves[i].usDelay)                {numCB++;           }
+   }
 
-         if (tNow < tNext1)
-         {
-            /* extend previous delay */
-            out[outPos-1].usDelay += (tNext1 - tNow);
-            tNow = tNext1;
-         }
+   *numCBs   = numCB;
+   *numBOOLs = numBOOL;
+   *numTOOLs = numTOOL;
+}
 
-         out[outPos].gpioOn  = in1[inPos1].gpioOn;
-         out[outPos].gpioOff = in1[inPos1].gpioOff;
-         out[outPos].flags   = in1[inPos1].flags;
+/* ----------------------------------------------------------------------- */
 
-         tNext1 = tNow + in1[inPos1].usDelay; ++inPos1;
-      }
-      else if (tNext2 < tNext1)
-      {
-         /* pulse 2 due */
+static int wave2Cbs(unsigned wave_mode, int *CB, int *BOOL, int *TOOL)
+{
+   int botCB=*CB, botOOL=*BOOL, topOOL=*TOOL;
 
-         if (tNow < tNext2)
-         {
-            /* extend previous delay */
-            out[outPos-1].usDelay += (tNext2 - tNow);
-            tNow = tNext2;
-         }
+   int status;
 
-         out[outPos].gpioOn  = in2[inPos2].gpioOn;
-         out[outPos].gpioOff = in2[inPos2].gpioOff;
-         out[outPos].flags   = in2[inPos2].flags;
+   rawCbs_t *p=NULL;
 
-         tNext2 = tNow + in2[inPos2].usDelay; ++inPos2;
-      }
-      else
-      {
-         /* pulse 1 and 2 both due */
+   unsigned i, half, repeatCB;
 
-         if (tNow < tNext1)
-         {
-            /* extend previous delay */
-            out[outPos-1].usDelay += (tNext1 - tNow);
-            tNow = tNext1;
-         }
+   unsigned numWaves;
 
-         out[outPos].gpioOn  = in1[inPos1].gpioOn  | in2[inPos2].gpioOn;
-         out[outPos].gpioOff = in1[inPos1].gpioOff | in2[inPos2].gpioOff;
-         out[outPos].flags   = in1[inPos1].flags   | in2[inPos2].flags;
+   rawWave_t * waves;
 
-         tNext1 = tNow + in1[inPos1].usDelay; ++inPos1;
-         tNext2 = tNow + in2[inPos2].usDelay; ++inPos2;
-      }
+   numWaves = waveFlatten();
+   waves    = wf[0];
+
+   half = PI_WF_MICROS/2;
 
-      if (tNext1 <= tNext2) { tDelay = tNext1 - tNow; tNow = tNext1; }
-      else                  { tDelay = tNext2 - tNow; tNow = tNext2; }
+   /* add delay cb at start of DMA */
+
+   p = rawWaveCBAdr(botCB++);
+
+   /* use the secondary clock */
+
+   if (gpioCfg.clockPeriph != PI_CLOCK_PCM)
+   {
+      p->info = NORMAL_DMA | TIMED_DMA(2);
+      p->dst  = PCM_TIMER;
+   }
+   else
+   {
+      p->info = NORMAL_DMA | TIMED_DMA(5);
+      p->dst  = PWM_TIMER;
+   }
 
-      out[outPos].usDelay = tDelay;
+   p->src    = (uint32_t) (&dmaOBus[0]->periphData);
+   p->length = 4 * 20 / PI_WF_MICROS; /* 20 micros delay */
+   p->next   = waveCbPOadr(botCB);
+
+   repeatCB = botCB;
+
+   for (i=0; i<numWaves; i++)
+   {
+      if (waves[i].gpioOn)
+      {
+         waveSetOOL(botOOL, waves[i].gpioOn);
+
+         p = rawWaveCBAdr(botCB++);
+
+         p->info   = NORMAL_DMA;
+         p->src    = waveOOLPOadr(botOOL++);
+         p->dst    = ((GPIO_BASE + (GPSET0*4)) & 0x00ffffff) | PI_PERI_BUS;
+         p->length = 4;
+         p->next   = waveCbPOadr(botCB);
+      }
 
-      cbs++; /* one cb for delay */
+      if (waves[i].gpioOff)
+      {
+         waveSetOOL(botOOL, waves[i].gpioOff);
 
-      if (out[outPos].gpioOn) cbs++; /* one cb if gpio on */
+         p = rawWaveCBAdr(botCB++);
 
-      if (out[outPos].gpioOff) cbs++; /* one cb if gpio off */
+         p->info   = NORMAL_DMA;
+         p->src    = waveOOLPOadr(botOOL++);
+         p->dst    = ((GPIO_BASE + (GPCLR0*4)) & 0x00ffffff) | PI_PERI_BUS;
+         p->length = 4;
+         p->next   = waveCbPOadr(botCB);
+      }
 
-      if (out[outPos].flags & WAVE_FLAG_READ)
+      if (waves[i].flags & WAVE_FLAG_READ)
       {
-         cbs++; /* one cb if read */
-         --level;
+         p = rawWaveCBAdr(botCB++);
+
+         p->info   = NORMAL_DMA;
+         p->src    = ((GPIO_BASE + (GPLEV0*4)) & 0x00ffffff) | PI_PERI_BUS;
+         p->dst    = waveOOLPOadr(--topOOL);
+         p->length = 4;
+         p->next   = waveCbPOadr(botCB);
       }
 
-      if (out[outPos].flags & WAVE_FLAG_TICK)
+      if (waves[i].flags & WAVE_FLAG_TICK)
       {
-         cbs++; /* one cb if tick */
-         --level;
+         p = rawWaveCBAdr(botCB++);
+
+         p->info   = NORMAL_DMA;
+         p->src    = ((SYST_BASE + (SYST_CLO*4)) & 0x00ffffff) | PI_PERI_BUS;
+         p->dst    = waveOOLPOadr(--topOOL);
+         p->length = 4;
+         p->next   = waveCbPOadr(botCB);
       }
 
-      outPos++;
+      if (waves[i].usDelay)
+      {
+         p = rawWaveCBAdr(botCB++);
+
+         /* use the secondary clock */
 
-      if (inPos1 >= numIn1) tNext1 = -1;
-      if (inPos2 >= numIn2) tNext2 = -1;
+         if (gpioCfg.clockPeriph != PI_CLOCK_PCM)
+         {
+            p->info = NORMAL_DMA | TIMED_DMA(2);
+            p->dst  = PCM_TIMER;
+         }
+         else
+         {
+            p->info = NORMAL_DMA | TIMED_DMA(5);
+            p->dst  = PWM_TIMER;
+         }
 
+         p->src    = (uint32_t) (&dmaOBus[0]->periphData);
+         p->length = 4 * ((waves[i].usDelay+half)/PI_WF_MICROS);
+         p->next   = waveCbPOadr(botCB);
+      }
    }
 
-   if ((outPos < numOut) && (outPos < level))
+   if (p != NULL)
    {
-      wfStats.micros = tNow;
+      if (wave_mode == PI_WAVE_MODE_ONE_SHOT)
+           p->next = 0;
+      else p->next = waveCbPOadr(repeatCB);
+   }
+
+   status = botCB - *CB;
 
-      if (tNow > wfStats.highMicros) wfStats.highMicros = tNow;
+   *CB   = botCB;
+   *BOOL = botOOL;
+   *TOOL = topOOL;
+
+   return status;
+}
 
-      wfStats.pulses = outPos;
+/* ----------------------------------------------------------------------- */
 
-      if (outPos > wfStats.highPulses) wfStats.highPulses = outPos;
+static void srxSettle(wfRx_t *w, uint32_t samples, uint32_t level)
+{
+   uint32_t limit = samples << SRX_FRAC;
 
-      wfStats.cbs    = cbs;
+   /*
+   The data bits whose centre is before samples since the start bit.
+   A bit is taken at the last sample at or before its centre, rounded
+   to the nearest microsecond (halfBit carries the rounding).
+   */
 
-      if (cbs > wfStats.highCbs) wfStats.highCbs = cbs;
+   while ((w->s.bit <= w->s.dataBits) && (w->s.nextBit < limit))
+   {
+      w->s.data |= (level<<(w->s.bit-1));
 
-      wfc[1-wfcur] = outPos;
-      wfcur = 1 - wfcur;
+      ++(w->s.bit);
 
-      return outPos;
+      w->s.nextBit += w->s.fullBit;
    }
-   else return PI_TOO_MANY_PULSES;
 }
 
-/* ======================================================================= */
+/* ----------------------------------------------------------------------- */
 
-int i2cWriteQuick(unsigned handle, unsigned bit)
+static void srxStart(int gpio, uint32_t pos)
 {
-   int err;
-
-   DBG(DBG_USER, "handle=%d bit=%d", handle, bit);
+   wfRx_t *w = &wfRx[gpio];
+   uint32_t last;
 
-   CHECK_INITED;
+   /* the start bit itself is not sampled */
 
-   if (handle >= PI_I2C_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   w->s.bit      = 1;
+   w->s.data     = 0;
+   w->s.nextBit  = w->s.halfBit + w->s.fullBit;
+   w->s.startPos = pos;
 
-   if (i2cInfo[handle].state == PI_I2C_CLOSED)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   /* the frame ends at the sample of its last data bit */
 
-   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_QUICK) == 0)
-      SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
+   last = (w->s.halfBit + (w->s.dataBits * w->s.fullBit)) >> SRX_FRAC;
 
-   if (bit > 1)
-      SOFT_ERROR(PI_BAD_PARAM, "bad bit (%d)", bit);
+   if (last < 1) last = 1;
 
-   err = my_smbus_access(
-      i2cInfo[handle].fd, bit, 0, PI_I2C_SMBUS_QUICK, NULL);
+   w->s.endPos = pos + last;
 
-   if (err < 0) return PI_I2C_WRITE_FAILED;
+   if (!srxActive || ((int32_t)(w->s.endPos - srxEnd) < 0))
+      srxEnd = w->s.endPos;
 
-   return err;
+   srxActive |= (1<<gpio);
 }
 
-int i2cReadByte(unsigned handle)
+/* ----------------------------------------------------------------------- */
+
+static void srxFrame(int gpio)
 {
-   union my_smbus_data data;
+   wfRx_t *w = &wfRx[gpio];
+   uint32_t wpos;
 
-   DBG(DBG_USER, "handle=%d", handle);
+   srxActive &= ~(1<<gpio);
 
-   CHECK_INITED;
+   /* single producer ring, drop the data rather than overtake the reader */
 
-   if (handle >= PI_I2C_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   wpos = w->s.writePos;
 
-   if (i2cInfo[handle].state == PI_I2C_CLOSED)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   if ((wpos - __atomic_load_n(&w->s.readPos, __ATOMIC_ACQUIRE)) <=
+       (w->s.bufSize - w->s.bytes))
+   {
+      memcpy(w->s.buf + (wpos & (w->s.bufSize-1)), &w->s.data, w->s.bytes);
+
+      __atomic_store_n(&w->s.writePos, wpos + w->s.bytes, __ATOMIC_RELEASE);
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+/*
+Decodes count consecutive level words for every gpio opened for
+serial reads.  Must be called with srxMutex held.
+
+Only the words where a serial gpio changes level are looked at.  An
+edge settles the bits of that gpio's frame sampled before it (the
+level has not changed since the previous edge), and a falling edge on
+an idle gpio starts a frame.  A frame whose last data bit passes
+without a later edge is finished at the end of the call from the
+current level, found by checking the active gpios once srxEnd has gone.
+*/
+
+static void srxDecode(const uint32_t *levels, int count)
+{
+   uint32_t bits, level, prev, changed, idle, todo, pos, next;
+   wfRx_t *w;
+   int i, g;
+
+   bits = srxBits;
+   prev = srxPrev;
+
+   i = 0;
+
+   while (i < count)
+   {
+      i += myScanLevels(levels+i, count-i, bits, (prev ^ srxInvert) & bits);
+
+      if (i >= count) break;
+
+      pos   = srxPos + i;
+      level = levels[i] ^ srxInvert;
+
+      changed = (level ^ prev) & bits;
+
+      idle = ~srxActive;
+
+      for (todo=changed & srxActive; todo; todo&=(todo-1))
+      {
+         g = __builtin_ctz(todo);
+         w = &wfRx[g];
+
+         srxSettle(w, pos - w->s.startPos, (prev>>g) & 1);
+
+         if ((int32_t)(pos - w->s.endPos) >= 0)
+         {
+            srxSettle(w, (pos - w->s.startPos) + 1, (level>>g) & 1);
+
+            srxFrame(g);
+
+            /* an edge on the last data bit is not a start bit */
+
+            if (pos != w->s.endPos) idle |= (1<<g);
+         }
+      }
+
+      /* start bits, high to low on an idle gpio */
+
+      for (todo=changed & prev & idle; todo; todo&=(todo-1))
+      {
+         srxStart(__builtin_ctz(todo), pos);
+      }
+
+      prev = level;
+
+      i++;
+   }
+
+   srxPos += count;
+   srxPrev = prev;
+
+   /* frames which ended without a later edge */
+
+   if (srxActive && ((int32_t)(srxPos - srxEnd) > 0))
+   {
+      next = srxPos + 0x7FFFFFFF;
+
+      for (todo=srxActive; todo; todo&=(todo-1))
+      {
+         g = __builtin_ctz(todo);
+         w = &wfRx[g];
+
+         if ((int32_t)(srxPos - w->s.endPos) > 0)
+         {
+            srxSettle(w, (w->s.endPos - w->s.startPos) + 1, (prev>>g) & 1);
+
+            srxFrame(g);
+         }
+         else if ((int32_t)(w->s.endPos - next) < 0) next = w->s.endPos;
+      }
+
+      srxEnd = next;
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+int rawWaveAddGeneric(unsigned numIn1, rawWave_t *in1)
+{
+   int status;
+
+   /* check first so a failed add leaves the wave unchanged */
+
+   status = waveMerge(numIn1, in1, 1);
+
+   if (status < 0) return status;
+
+   waveMerge(numIn1, in1, 0);
+
+   wfStats.micros = wfEnd;
+
+   if (wfEnd > wfStats.highMicros) wfStats.highMicros = wfEnd;
+
+   wfStats.pulses = wfPulses;
+
+   if (wfPulses > wfStats.highPulses) wfStats.highPulses = wfPulses;
+
+   wfStats.cbs    = wfCbs;
+
+   if (wfCbs > wfStats.highCbs) wfStats.highCbs = wfCbs;
+
+   return wfPulses;
+}
+
+/* ======================================================================= */
+
+int i2cWriteQuick(unsigned handle, unsigned bit)
+{
+   int err;
+
+   DBG(DBG_USER, "handle=%d bit=%d", handle, bit);
+
+   CHECK_INITED;
+
+   if (handle >= PI_I2C_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (i2cInfo[handle].state == PI_I2C_CLOSED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_QUICK) == 0)
+      SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
+
+   if (bit > 1)
+      SOFT_ERROR(PI_BAD_PARAM, "bad bit (%d)", bit);
+
+   err = my_smbus_access(
+      i2cInfo[handle].fd, bit, 0, PI_I2C_SMBUS_QUICK, NULL);
+
+   if (err < 0) return PI_I2C_WRITE_FAILED;
+
+   return err;
+}
+
+int i2cReadByte(unsigned handle)
+{
+   union my_smbus_data data;
+
+   DBG(DBG_USER, "handle=%d", handle);
+
+   CHECK_INITED;
+
+   if (handle >= PI_I2C_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (i2cInfo[handle].state == PI_I2C_CLOSED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
    if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_READ_BYTE) == 0)
       SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
@@ -3547,6 +4825,7 @@ int i2cOpen(unsigned i2cBus, unsigned i2cAddr, unsigned i2cFlags)
    i2cInfo[slot].addr = i2cAddr;
    i2cInfo[slot].flags = i2cFlags;
    i2cInfo[slot].funcs = funcs;
+   i2cInfo[slot].bus = i2cBus;
 
    return slot;
 }
@@ -3773,3457 +5052,8580 @@ int i2cZip(
    return status;
 }
 
-/* ======================================================================= */
-
-/*SPI */
+/* ----------------------------------------------------------------------- */
 
-static uint32_t _spiTXBits(char *buf, int pos, int bitlen, int msbf)
+static int i2cQueueRdwr(int fd, pi_i2c_msg_t *segs, unsigned numSegs)
 {
-   uint32_t bits=0;
+   my_i2c_rdwr_ioctl_data_t rdwr;
 
-   if (buf)
-   {
-      if      (bitlen <=  8) bits = *((( uint8_t*)buf)+pos);
-      else if (bitlen <= 16) bits = *(((uint16_t*)buf)+pos);
-      else                   bits = *(((uint32_t*)buf)+pos);
+   rdwr.msgs = segs;
+   rdwr.nmsgs = numSegs;
 
-      if (msbf) bits <<= (32-bitlen);
-   }
+   if (ioctl(fd, PI_I2C_RDWR, &rdwr) < 0) return PI_BAD_I2C_SEG;
 
-   return bits;
+   return numSegs;
 }
 
-static void _spiRXBits(
-   char *buf, int pos, int bitlen, int msbf, uint32_t bits)
-{
-   if (buf)
-   {
-      if (!msbf) bits >>= (32-bitlen);
-
-      if      (bitlen <=  8) *((( uint8_t*)buf)+pos) = bits;
-      else if (bitlen <= 16) *(((uint16_t*)buf)+pos) = bits;
-      else                   *(((uint32_t*)buf)+pos) = bits;
-   }
-}
+/* ----------------------------------------------------------------------- */
 
-static void spiACS(int channel, int on)
+static void *pthI2CQueueThread(void *x)
 {
-   int gpio;
+   i2cQueue_t *q = x;
+   i2cQueued_t *t;
+   pi_i2c_msg_t segs[PI_I2C_RDRW_IOCTL_MAX_MSGS];
+   int batch[PI_I2C_RDRW_IOCTL_MAX_MSGS];
+   int status[PI_I2C_RDRW_IOCTL_MAX_MSGS];
+   i2cQueueFunc_t func[PI_I2C_RDRW_IOCTL_MAX_MSGS];
+   void *userdata[PI_I2C_RDRW_IOCTL_MAX_MSGS];
+   int i, j, n, numSegs, err, prev, slot, handle;
+   uint32_t latency;
+   uint64_t start, now;
 
-   switch (channel)
+   pthread_mutex_lock(&i2cQMutex);
+
+   while (!q->stop)
    {
-       case  0: gpio = PI_ASPI_CE0; break;
-       case  1: gpio = PI_ASPI_CE1; break;
-       default: gpio = PI_ASPI_CE2; break;
-   }
-   myGpioWrite(gpio, on);
-}
+      if (q->head < 0)
+      {
+         pthread_cond_wait(&i2cQWork, &i2cQMutex);
+         continue;
+      }
 
-static void spiGoA(
-   unsigned speed,    /* bits per second */
-   uint32_t flags,    /* flags           */
-   char     *txBuf,   /* tx buffer       */
-   char     *rxBuf,   /* rx buffer       */
-   unsigned count)    /* number of bytes */
-{
-   int cs;
-   char bit_ir[4] = {1, 0, 0, 1}; /* read on rising edge */
-   char bit_or[4] = {0, 1, 1, 0}; /* write on rising edge */
-   char bit_ic[4] = {0, 0, 1, 1}; /* invert clock */
+      /*
+      Take the queued transactions of the first one's handle which fit
+      one I2C_RDWR, in order.  Those of other handles keep their
+      places, so a failing device can't fail another's transactions.
+      A handle whose last transfer failed sends one at a time until
+      one succeeds, so the error goes to the transaction which failed.
+      */
 
-   int mode, bitlen, txmsbf, rxmsbf, channel;
-   unsigned txCnt=0;
-   unsigned rxCnt=0;
-   uint32_t spiDefaults;
-   uint32_t statusReg;
-   int txFull, rxEmpty;
+      handle  = i2cQueued[q->head].handle;
+      n       = 0;
+      numSegs = 0;
+      prev    = -1;
+      slot    = q->head;
 
-   channel = PI_SPI_FLAGS_GET_CHANNEL(flags);
-   mode   =  PI_SPI_FLAGS_GET_MODE   (flags);
+      while ((slot >= 0) && !(n && i2cQueueAlone[handle]))
+      {
+         t = &i2cQueued[slot];
 
-   bitlen =  PI_SPI_FLAGS_GET_BITLEN (flags);
+         if ((t->handle != handle) ||
+             ((numSegs + t->numSegs) > PI_I2C_RDRW_IOCTL_MAX_MSGS))
+         {
+            prev = slot;
+            slot = t->next;
+            continue;
+         }
 
-   if (!bitlen) bitlen = 8;
+         memcpy(segs+numSegs, t->segs, t->numSegs * sizeof(pi_i2c_msg_t));
+         numSegs += t->numSegs;
 
-   /* correct count for word size */
+         t->state = PI_I2CQ_ACTIVE;
+         batch[n++] = slot;
 
-   if (bitlen >  8) count /= 2;
-   if (bitlen > 16) count /= 2;
+         if (prev >= 0) i2cQueued[prev].next = t->next;
+         else           q->head = t->next;
 
-   txmsbf = !PI_SPI_FLAGS_GET_TX_LSB (flags);
-   rxmsbf = !PI_SPI_FLAGS_GET_RX_LSB (flags);
+         if (q->tail == slot) q->tail = prev;
 
-   cs = PI_SPI_FLAGS_GET_CSPOLS(flags) & (1<<channel);
+         slot = t->next;
+      }
 
-   spiDefaults = AUXSPI_CNTL0_SPEED(125000000/speed)   |
-                 AUXSPI_CNTL0_IN_RISING(bit_ir[mode])  |
-                 AUXSPI_CNTL0_OUT_RISING(bit_or[mode]) |
-                 AUXSPI_CNTL0_INVERT_CLK(bit_ic[mode]) |
-                 AUXSPI_CNTL0_MSB_FIRST(txmsbf)        |
-                 AUXSPI_CNTL0_SHIFT_LEN(bitlen);
+      q->queued -= n;
 
-   if (!count)
-   {
-      auxReg[AUX_SPI0_CNTL0_REG] =
-         AUXSPI_CNTL0_ENABLE | AUXSPI_CNTL0_CLR_FIFOS;
+      pthread_mutex_unlock(&i2cQMutex);
 
-      myGpioDelay(10);
+      start = twMicros();
 
-      auxReg[AUX_SPI0_CNTL0_REG] = AUXSPI_CNTL0_ENABLE  | spiDefaults;
+      err = i2cQueueRdwr(q->fd, segs, numSegs);
 
-      auxReg[AUX_SPI0_CNTL1_REG] = AUXSPI_CNTL1_MSB_FIRST(rxmsbf);
+      /*
+      The ioctl doesn't say which segment failed, and those before it
+      have been done.  Running the transactions again on their own
+      could repeat a write or a FIFO read, so the joined transactions
+      of the device all fail.
+      */
 
-      return;
-   }
+      for (i=0; i<n; i++)
+      {
+         if (err >= 0) status[i] = i2cQueued[batch[i]].numSegs;
+         else          status[i] = err;
+      }
 
-   auxReg[AUX_SPI0_CNTL0_REG] = AUXSPI_CNTL0_ENABLE  | spiDefaults;
+      now = twMicros();
 
-   auxReg[AUX_SPI0_CNTL1_REG] = AUXSPI_CNTL1_MSB_FIRST(rxmsbf);
+      pthread_mutex_lock(&i2cQMutex);
 
-   spiACS(channel, cs);
+      i2cQueueAlone[handle] = (err < 0);
 
-   while ((txCnt < count) || (rxCnt < count))
-   {
-      statusReg = auxReg[AUX_SPI0_STAT_REG];
+      q->ioctls++;
+      q->busyMicros += (now - start);
 
-      rxEmpty = statusReg & AUXSPI_STAT_RX_EMPTY;
+      for (i=0; i<n; i++)
+      {
+         t = &i2cQueued[batch[i]];
 
-      txFull = (((statusReg>>28)&15) > 2);
+         t->status = status[i];
 
-      if (rxCnt < count)
-      {
-         if (!rxEmpty)
+         latency = now - t->submitted;
+
+         q->transactions++;
+         q->latencyTotal += latency;
+         if (latency > q->latencyMax) q->latencyMax = latency;
+
+         if (status[i] < 0) q->failed++;
+         else
          {
-            _spiRXBits(
-               rxBuf, rxCnt++, bitlen, rxmsbf, auxReg[AUX_SPI0_IO_REG]);
+            for (j=0; j<t->numSegs; j++) q->bytes += t->segs[j].len;
          }
+
+         func[i]     = t->func;
+         userdata[i] = t->userdata;
+
+         /* a transaction without callback waits to be collected */
+
+         if (t->func) t->state = PI_I2CQ_FREE;
+         else         t->state = PI_I2CQ_DONE;
       }
 
-      if (txCnt < count)
+      pthread_cond_broadcast(&i2cQDone);
+
+      pthread_mutex_unlock(&i2cQMutex);
+
+      for (i=0; i<n; i++)
       {
-         if (!txFull)
-         {
-            if (txCnt != (count-1))
-            {
-               auxReg[AUX_SPI0_TX_HOLD] =
-                  _spiTXBits(txBuf, txCnt++, bitlen, txmsbf);
-            }
-            else
-            {
-               auxReg[AUX_SPI0_IO_REG] =
-                  _spiTXBits(txBuf, txCnt++, bitlen, txmsbf);
-            }
-         }
+         if (func[i]) (func[i])(batch[i], status[i], userdata[i]);
       }
+
+      pthread_mutex_lock(&i2cQMutex);
    }
 
-   while ((auxReg[AUX_SPI0_STAT_REG] & AUXSPI_STAT_BUSY)) ;
+   pthread_mutex_unlock(&i2cQMutex);
 
-   spiACS(channel, !cs);
+   return NULL;
 }
 
-static void spiGoS(
-   unsigned speed,
-   uint32_t flags,
-   char     *txBuf,
-   char     *rxBuf,
-   unsigned count)
+/* ----------------------------------------------------------------------- */
+
+static int i2cQueueStart(unsigned bus, int fd)
 {
-   unsigned txCnt=0;
-   unsigned rxCnt=0;
-   unsigned cnt, cnt4w, cnt3w;
-   uint32_t spiDefaults;
-   unsigned mode, channel, cspol, cspols, flag3w, ren3w;
+   /* called with i2cQMutex held */
 
-   channel = PI_SPI_FLAGS_GET_CHANNEL(flags);
-   mode   =  PI_SPI_FLAGS_GET_MODE   (flags);
-   cspols =  PI_SPI_FLAGS_GET_CSPOLS(flags);
-   cspol  =  (cspols>>channel) & 1;
-   flag3w =  PI_SPI_FLAGS_GET_3WIRE(flags);
-   ren3w =   PI_SPI_FLAGS_GET_3WREN(flags);
+   i2cQueue_t *q = &i2cQueueBus[bus];
+   pthread_attr_t pthAttr;
 
-   spiDefaults = SPI_CS_MODE(mode)     |
-                 SPI_CS_CSPOLS(cspols) |
-                 SPI_CS_CS(channel)    |
-                 SPI_CS_CSPOL(cspol)   |
-                 SPI_CS_CLEAR(3);
+   /* the worker's own descriptor outlives the opening handle */
 
-   spiReg[SPI_CS] = spiDefaults; /* stop */
+   q->fd = dup(fd);
 
-   if (!count) return;
+   if (q->fd < 0) return PI_I2C_OPEN_FAILED;
 
-   if (flag3w)
-   {
-      if (ren3w < count)
-      {
-         cnt4w = ren3w;
-         cnt3w = count - ren3w;
-      }
-      else
-      {
-         cnt4w = count;
-         cnt3w = 0;
-      }
-   }
-   else
+   q->stop = 0;
+   q->head = -1;
+   q->tail = -1;
+
+   if (pthread_attr_init(&pthAttr) ||
+       pthread_attr_setstacksize(&pthAttr, STACK_SIZE) ||
+       pthread_create(&q->pthId, &pthAttr, pthI2CQueueThread, q))
    {
-      cnt4w = count;
-      cnt3w = 0;
+      close(q->fd);
+      q->fd = -1;
+      return PI_INIT_FAILED;
    }
 
-   spiReg[SPI_CLK] = 250000000/speed;
+   q->running = 1;
 
-   spiReg[SPI_CS] = spiDefaults | SPI_CS_TA; /* start */
+   return 0;
+}
 
-   cnt = cnt4w;
+/* ----------------------------------------------------------------------- */
 
-   while((txCnt < cnt) || (rxCnt < cnt))
+static void i2cQueueStop(void)
+{
+   int i;
+
+   for (i=0; i<PI_NUM_I2C_BUS; i++)
    {
-      while((rxCnt < cnt) && ((spiReg[SPI_CS] & SPI_CS_RXD)))
+      if (i2cQueueBus[i].running)
       {
-         if (rxBuf) rxBuf[rxCnt] = spiReg[SPI_FIFO];
-         else       spi_dummy    = spiReg[SPI_FIFO];
-         rxCnt++;
-      }
+         pthread_mutex_lock(&i2cQMutex);
+         i2cQueueBus[i].stop = 1;
+         pthread_cond_broadcast(&i2cQWork);
+         pthread_mutex_unlock(&i2cQMutex);
 
-      while((txCnt < cnt) && ((spiReg[SPI_CS] & SPI_CS_TXD)))
-      {
-         if (txBuf) spiReg[SPI_FIFO] = txBuf[txCnt];
-         else       spiReg[SPI_FIFO] = 0;
-         txCnt++;
+         pthread_join(i2cQueueBus[i].pthId, NULL);
+
+         close(i2cQueueBus[i].fd);
       }
    }
 
-   while (!(spiReg[SPI_CS] & SPI_CS_DONE)) ;
+   /* anything still queued is dropped */
 
-   /* now switch to 3-wire bus */
+   memset(i2cQueueBus, 0, sizeof(i2cQueueBus));
 
-   cnt += cnt3w;
+   for (i=0; i<PI_I2C_QUEUE_SLOTS; i++) i2cQueued[i].state = PI_I2CQ_FREE;
+}
 
-   spiReg[SPI_CS] |= SPI_CS_REN;
+/* ----------------------------------------------------------------------- */
 
-   while((txCnt < cnt) || (rxCnt < cnt))
+int i2cQueue(
+   unsigned handle,
+   pi_i2c_msg_t *segs,
+   unsigned numSegs,
+   i2cQueueFunc_t f,
+   void *userdata)
+{
+   int i, slot, err;
+   unsigned bus;
+   i2cQueue_t *q;
+   i2cQueued_t *t;
+
+   DBG(DBG_USER, "handle=%d numSegs=%d function=%08X, userdata=%08X",
+      handle, numSegs, (uint32_t)f, (uint32_t)userdata);
+
+   CHECK_INITED;
+
+   if (handle >= PI_I2C_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (i2cInfo[handle].state != PI_I2C_OPENED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if ((segs == NULL) || (numSegs == 0))
+      SOFT_ERROR(PI_BAD_POINTER, "no segments");
+
+   if (numSegs > PI_I2C_RDRW_IOCTL_MAX_MSGS)
+      SOFT_ERROR(PI_TOO_MANY_SEGS, "too many segments (%d)", numSegs);
+
+   bus = i2cInfo[handle].bus;
+   q = &i2cQueueBus[bus];
+
+   pthread_mutex_lock(&i2cQMutex);
+
+   if (!q->running)
    {
-      while((rxCnt < cnt) && ((spiReg[SPI_CS] & SPI_CS_RXD)))
-      {
-         if (rxBuf) rxBuf[rxCnt] = spiReg[SPI_FIFO];
-         else       spi_dummy    = spiReg[SPI_FIFO];
-         rxCnt++;
-      }
+      err = i2cQueueStart(bus, i2cInfo[handle].fd);
 
-      while((txCnt < cnt) && ((spiReg[SPI_CS] & SPI_CS_TXD)))
+      if (err)
       {
-         if (txBuf) spiReg[SPI_FIFO] = txBuf[txCnt];
-         else       spiReg[SPI_FIFO] = 0;
-         txCnt++;
+         pthread_mutex_unlock(&i2cQMutex);
+         SOFT_ERROR(err, "I2C queue for bus %d failed (%m)", bus);
       }
    }
 
-   while (!(spiReg[SPI_CS] & SPI_CS_DONE)) ;
-
-   spiReg[SPI_CS] = spiDefaults; /* stop */
-}
+   slot = -1;
 
-static void spiGo(
-   unsigned speed,
-   uint32_t flags,
-   char     *txBuf,
-   char     *rxBuf,
-   unsigned count)
-{
-   if (PI_SPI_FLAGS_GET_AUX_SPI(flags))
+   for (i=0; i<PI_I2C_QUEUE_SLOTS; i++)
    {
-      spiGoA(speed, flags, txBuf, rxBuf, count);
+      if (i2cQueued[i].state == PI_I2CQ_FREE)
+      {
+         slot = i;
+         break;
+      }
    }
-   else
+
+   if (slot < 0)
    {
-      spiGoS(speed, flags, txBuf, rxBuf, count);
+      pthread_mutex_unlock(&i2cQMutex);
+      SOFT_ERROR(PI_NO_HANDLE, "I2C queue full");
    }
-}
 
-static int spiAnyOpen(uint32_t flags)
-{
-   int i, aux;
+   t = &i2cQueued[slot];
 
-   aux = PI_SPI_FLAGS_GET_AUX_SPI(flags);
+   memcpy(t->segs, segs, numSegs * sizeof(pi_i2c_msg_t));
 
-   for (i=0; i<PI_SPI_SLOTS; i++)
-   {
-      if ((spiInfo[i].state == PI_SPI_OPENED) &&
-         (PI_SPI_FLAGS_GET_AUX_SPI(spiInfo[i].flags) == aux))
-            return 1;
-   }
-   return 0;
-}
+   t->state     = PI_I2CQ_QUEUED;
+   t->next      = -1;
+   t->status    = 0;
+   t->bus       = bus;
+   t->handle    = handle;
+   t->numSegs   = numSegs;
+   t->func      = f;
+   t->userdata  = userdata;
+   t->submitted = twMicros();
 
-static void spiInit(uint32_t flags)
-{
-   uint32_t resvd, cspols;
+   if (q->tail >= 0) i2cQueued[q->tail].next = slot;
+   else              q->head = slot;
 
-   resvd  = PI_SPI_FLAGS_GET_RESVD(flags);
-   cspols = PI_SPI_FLAGS_GET_CSPOLS(flags);
+   q->tail = slot;
+   q->queued++;
 
-   if (PI_SPI_FLAGS_GET_AUX_SPI(flags))
-   {
-      /* enable module and access to registers */
+   pthread_cond_broadcast(&i2cQWork);
 
-      auxReg[AUX_ENABLES] |= AUXENB_SPI1;
+   pthread_mutex_unlock(&i2cQMutex);
 
-      /* save original state */
+   return slot;
+}
 
-      old_mode_ace0  = gpioGetMode(PI_ASPI_CE0);
-      old_mode_ace1  = gpioGetMode(PI_ASPI_CE1);
-      old_mode_ace2  = gpioGetMode(PI_ASPI_CE2);
-      old_mode_asclk = gpioGetMode(PI_ASPI_SCLK);
-      old_mode_amiso = gpioGetMode(PI_ASPI_MISO);
-      old_mode_amosi = gpioGetMode(PI_ASPI_MOSI);
+/* ----------------------------------------------------------------------- */
 
-      old_spi_cntl0 = auxReg[AUX_SPI0_CNTL0_REG];
-      old_spi_cntl1 = auxReg[AUX_SPI0_CNTL1_REG];
+int i2cQueueWait(unsigned id, unsigned millis)
+{
+   int status;
+   i2cQueued_t *t;
+   struct timespec ts;
 
-      /* manually control auxiliary SPI chip selects */
+   DBG(DBG_USER, "id=%d millis=%d", id, millis);
 
-      if (!(resvd&1))
-      {
-         gpioSetMode(PI_ASPI_CE0,  PI_OUTPUT);
-         myGpioWrite(PI_ASPI_CE0, !(cspols&1));
-      }
+   CHECK_INITED;
 
-      if (!(resvd&2))
-      {
-         gpioSetMode(PI_ASPI_CE1,  PI_OUTPUT);
-         myGpioWrite(PI_ASPI_CE1, !(cspols&2));
-      }
+   if (id >= PI_I2C_QUEUE_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad id (%d)", id);
 
-      if (!(resvd&4))
-      {
-         gpioSetMode(PI_ASPI_CE2,  PI_OUTPUT);
-         myGpioWrite(PI_ASPI_CE2, !(cspols&4));
-      }
+   t = &i2cQueued[id];
 
-      /* set gpios to SPI mode */
+   pthread_mutex_lock(&i2cQMutex);
 
-      gpioSetMode(PI_ASPI_SCLK, PI_ALT4);
-      gpioSetMode(PI_ASPI_MISO, PI_ALT4);
-      gpioSetMode(PI_ASPI_MOSI, PI_ALT4);
-   }
-   else
+   if ((t->state == PI_I2CQ_FREE) || t->func)
    {
-      /* save original state */
+      pthread_mutex_unlock(&i2cQMutex);
+      SOFT_ERROR(PI_BAD_HANDLE, "bad id (%d)", id);
+   }
 
-      old_mode_ce0  = gpioGetMode(PI_SPI_CE0);
-      old_mode_ce1  = gpioGetMode(PI_SPI_CE1);
-      old_mode_sclk = gpioGetMode(PI_SPI_SCLK);
-      old_mode_miso = gpioGetMode(PI_SPI_MISO);
-      old_mode_mosi = gpioGetMode(PI_SPI_MOSI);
+   clock_gettime(CLOCK_REALTIME, &ts);
 
-      old_spi_cs  = spiReg[SPI_CS];
-      old_spi_clk = spiReg[SPI_CLK];
+   ts.tv_sec  += millis / THOUSAND;
+   ts.tv_nsec += (millis % THOUSAND) * MILLION;
 
-      /* set gpios to SPI mode */
+   if (ts.tv_nsec >= BILLION)
+   {
+      ts.tv_sec++;
+      ts.tv_nsec -= BILLION;
+   }
 
-      if (!(resvd&1)) gpioSetMode(PI_SPI_CE0,  PI_ALT0);
-      if (!(resvd&2)) gpioSetMode(PI_SPI_CE1,  PI_ALT0);
+   while (t->state != PI_I2CQ_DONE)
+   {
+      if (pthread_cond_timedwait(&i2cQDone, &i2cQMutex, &ts)) break;
+   }
 
-      gpioSetMode(PI_SPI_SCLK, PI_ALT0);
-      gpioSetMode(PI_SPI_MISO, PI_ALT0);
-      gpioSetMode(PI_SPI_MOSI, PI_ALT0);
+   if (t->state == PI_I2CQ_DONE)
+   {
+      status = t->status;
+      t->state = PI_I2CQ_FREE;
    }
+   else status = PI_I2C_PENDING;
+
+   pthread_mutex_unlock(&i2cQMutex);
+
+   return status;
 }
 
-static void spiTerm(uint32_t flags)
+/* ----------------------------------------------------------------------- */
+
+int i2cQueueStats(unsigned i2cBus, i2cQueueStats_t *stats)
 {
-   int resvd;
+   i2cQueue_t *q;
 
-   resvd = PI_SPI_FLAGS_GET_RESVD(flags);
+   DBG(DBG_USER, "i2cBus=%d stats=%08X", i2cBus, (uint32_t)stats);
 
-   if (PI_SPI_FLAGS_GET_AUX_SPI(flags))
-   {
-      /* disable module and access to registers */
+   CHECK_INITED;
 
-      auxReg[AUX_ENABLES] &= (~AUXENB_SPI1);
+   if (i2cBus >= PI_NUM_I2C_BUS)
+      SOFT_ERROR(PI_BAD_I2C_BUS, "bad I2C bus (%d)", i2cBus);
 
-      /* restore original state */
+   if (stats == NULL)
+      SOFT_ERROR(PI_BAD_POINTER, "null stats");
 
-      if (!(resvd&1)) gpioSetMode(PI_ASPI_CE0,  old_mode_ace0);
-      if (!(resvd&2)) gpioSetMode(PI_ASPI_CE1,  old_mode_ace1);
-      if (!(resvd&4)) gpioSetMode(PI_ASPI_CE2,  old_mode_ace2);
+   q = &i2cQueueBus[i2cBus];
 
-      gpioSetMode(PI_ASPI_SCLK, old_mode_asclk);
-      gpioSetMode(PI_ASPI_MISO, old_mode_amiso);
-      gpioSetMode(PI_ASPI_MOSI, old_mode_amosi);
+   pthread_mutex_lock(&i2cQMutex);
 
-      auxReg[AUX_SPI0_CNTL0_REG] = old_spi_cntl0;
-      auxReg[AUX_SPI0_CNTL1_REG] = old_spi_cntl1;
-   }
+   stats->transactions = q->transactions;
+   stats->failed       = q->failed;
+   stats->ioctls       = q->ioctls;
+   stats->queued       = q->queued;
+   stats->latencyMax   = q->latencyMax;
+   stats->bytes        = q->bytes;
+
+   if (q->transactions)
+      stats->latencyAvg = q->latencyTotal / q->transactions;
    else
-   {
-      /* restore original state */
+      stats->latencyAvg = 0;
 
-      if (!(resvd&1)) gpioSetMode(PI_SPI_CE0,  old_mode_ce0);
-      if (!(resvd&2)) gpioSetMode(PI_SPI_CE1,  old_mode_ce1);
+   if (q->busyMicros)
+      stats->bytesPerSec = (q->bytes * MILLION) / q->busyMicros;
+   else
+      stats->bytesPerSec = 0;
 
-      gpioSetMode(PI_SPI_SCLK, old_mode_sclk);
-      gpioSetMode(PI_SPI_MISO, old_mode_miso);
-      gpioSetMode(PI_SPI_MOSI, old_mode_mosi);
+   pthread_mutex_unlock(&i2cQMutex);
 
-      spiReg[SPI_CS]  = old_spi_cs;
-      spiReg[SPI_CLK] = old_spi_clk;
-   }
+   return 0;
 }
 
-int spiOpen(unsigned spiChan, unsigned baud, unsigned spiFlags)
-{
-   int i, slot;
+/* ======================================================================= */
 
-   DBG(DBG_USER, "spiChan=%d baud=%d spiFlags=0x%X",
-      spiChan, baud, spiFlags);
+/*SPI */
 
-   CHECK_INITED;
+static uint32_t _spiTXBits(char *buf, int pos, int bitlen, int msbf)
+{
+   uint32_t bits=0;
 
-   if (PI_SPI_FLAGS_GET_AUX_SPI(spiFlags))
+   if (buf)
    {
-      if (gpioHardwareRevision() < 16)
-         SOFT_ERROR(PI_NO_AUX_SPI, "no auxiliary SPI, need a A+/B+");
+      if      (bitlen <=  8) bits = *((( uint8_t*)buf)+pos);
+      else if (bitlen <= 16) bits = *(((uint16_t*)buf)+pos);
+      else                   bits = *(((uint32_t*)buf)+pos);
 
-      i = PI_NUM_AUX_SPI_CHANNEL;
+      if (msbf) bits <<= (32-bitlen);
    }
-   else
-      i = PI_NUM_STD_SPI_CHANNEL;
 
-   if (spiChan >= i)
-      SOFT_ERROR(PI_BAD_SPI_CHANNEL, "bad spiChan (%d)", spiChan);
+   return bits;
+}
 
-   if ((baud < PI_SPI_MIN_BAUD) || (baud > PI_SPI_MAX_BAUD))
-      SOFT_ERROR(PI_BAD_SPI_SPEED, "bad baud (%d)", baud);
+static void _spiRXBits(
+   char *buf, int pos, int bitlen, int msbf, uint32_t bits)
+{
+   if (buf)
+   {
+      if (!msbf) bits >>= (32-bitlen);
+
+      if      (bitlen <=  8) *((( uint8_t*)buf)+pos) = bits;
+      else if (bitlen <= 16) *(((uint16_t*)buf)+pos) = bits;
+      else                   *(((uint32_t*)buf)+pos) = bits;
+   }
+}
+
+static void spiACS(int channel, int on)
+{
+   int gpio;
+
+   switch (channel)
+   {
+       case  0: gpio = PI_ASPI_CE0; break;
+       case  1: gpio = PI_ASPI_CE1; break;
+       default: gpio = PI_ASPI_CE2; break;
+   }
+   myGpioWrite(gpio, on);
+}
+
+static void spiGoA(
+   unsigned speed,    /* bits per second */
+   uint32_t flags,    /* flags           */
+   char     *txBuf,   /* tx buffer       */
+   char     *rxBuf,   /* rx buffer       */
+   unsigned count,    /* number of bytes */
+   unsigned hold)     /* SPI_HOLD_x      */
+{
+   int cs;
+   char bit_ir[4] = {1, 0, 0, 1}; /* read on rising edge */
+   char bit_or[4] = {0, 1, 1, 0}; /* write on rising edge */
+   char bit_ic[4] = {0, 0, 1, 1}; /* invert clock */
+
+   int mode, bitlen, txmsbf, rxmsbf, channel;
+   unsigned txCnt=0;
+   unsigned rxCnt=0;
+   uint32_t spiDefaults;
+   uint32_t statusReg;
+   int txFull, rxEmpty;
+
+   channel = PI_SPI_FLAGS_GET_CHANNEL(flags);
+   mode   =  PI_SPI_FLAGS_GET_MODE   (flags);
+
+   bitlen =  PI_SPI_FLAGS_GET_BITLEN (flags);
+
+   if (!bitlen) bitlen = 8;
+
+   /* correct count for word size */
+
+   if (bitlen >  8) count /= 2;
+   if (bitlen > 16) count /= 2;
+
+   txmsbf = !PI_SPI_FLAGS_GET_TX_LSB (flags);
+   rxmsbf = !PI_SPI_FLAGS_GET_RX_LSB (flags);
+
+   cs = PI_SPI_FLAGS_GET_CSPOLS(flags) & (1<<channel);
+
+   spiDefaults = AUXSPI_CNTL0_SPEED(125000000/speed)   |
+                 AUXSPI_CNTL0_IN_RISING(bit_ir[mode])  |
+                 AUXSPI_CNTL0_OUT_RISING(bit_or[mode]) |
+                 AUXSPI_CNTL0_INVERT_CLK(bit_ic[mode]) |
+                 AUXSPI_CNTL0_MSB_FIRST(txmsbf)        |
+                 AUXSPI_CNTL0_SHIFT_LEN(bitlen);
+
+   if (!count && (hold & SPI_HOLD_CONT))
+   {
+      if (!(hold & SPI_HOLD_KEEP)) spiACS(channel, !cs);
+
+      return;
+   }
+
+   if (!count)
+   {
+      auxReg[AUX_SPI0_CNTL0_REG] =
+         AUXSPI_CNTL0_ENABLE | AUXSPI_CNTL0_CLR_FIFOS;
+
+      myGpioDelay(10);
+
+      auxReg[AUX_SPI0_CNTL0_REG] = AUXSPI_CNTL0_ENABLE  | spiDefaults;
+
+      auxReg[AUX_SPI0_CNTL1_REG] = AUXSPI_CNTL1_MSB_FIRST(rxmsbf);
+
+      return;
+   }
+
+   auxReg[AUX_SPI0_CNTL0_REG] = AUXSPI_CNTL0_ENABLE  | spiDefaults;
+
+   auxReg[AUX_SPI0_CNTL1_REG] = AUXSPI_CNTL1_MSB_FIRST(rxmsbf);
+
+   spiACS(channel, cs);
+
+   while ((txCnt < count) || (rxCnt < count))
+   {
+      statusReg = auxReg[AUX_SPI0_STAT_REG];
+
+      rxEmpty = statusReg & AUXSPI_STAT_RX_EMPTY;
+
+      txFull = (((statusReg>>28)&15) > 2);
+
+      if (rxCnt < count)
+      {
+         if (!rxEmpty)
+         {
+            _spiRXBits(
+               rxBuf, rxCnt++, bitlen, rxmsbf, auxReg[AUX_SPI0_IO_REG]);
+         }
+      }
+
+      if (txCnt < count)
+      {
+         if (!txFull)
+         {
+            if (txCnt != (count-1))
+            {
+               auxReg[AUX_SPI0_TX_HOLD] =
+                  _spiTXBits(txBuf, txCnt++, bitlen, txmsbf);
+            }
+            else
+            {
+               auxReg[AUX_SPI0_IO_REG] =
+                  _spiTXBits(txBuf, txCnt++, bitlen, txmsbf);
+            }
+         }
+      }
+   }
+
+   while ((auxReg[AUX_SPI0_STAT_REG] & AUXSPI_STAT_BUSY)) ;
+
+   if (!(hold & SPI_HOLD_KEEP)) spiACS(channel, !cs);
+}
+
+static void spiGoS(
+   unsigned speed,
+   uint32_t flags,
+   char     *txBuf,
+   char     *rxBuf,
+   unsigned count,
+   unsigned hold)
+{
+   unsigned txCnt=0;
+   unsigned rxCnt=0;
+   unsigned cnt, cnt4w, cnt3w;
+   uint32_t spiDefaults;
+   unsigned mode, channel, cspol, cspols, flag3w, ren3w;
+
+   channel = PI_SPI_FLAGS_GET_CHANNEL(flags);
+   mode   =  PI_SPI_FLAGS_GET_MODE   (flags);
+   cspols =  PI_SPI_FLAGS_GET_CSPOLS(flags);
+   cspol  =  (cspols>>channel) & 1;
+   flag3w =  PI_SPI_FLAGS_GET_3WIRE(flags);
+   ren3w =   PI_SPI_FLAGS_GET_3WREN(flags);
+
+   spiDefaults = SPI_CS_MODE(mode)     |
+                 SPI_CS_CSPOLS(cspols) |
+                 SPI_CS_CS(channel)    |
+                 SPI_CS_CSPOL(cspol)   |
+                 SPI_CS_CLEAR(3);
+
+   if (!count)
+   {
+      if (!(hold & SPI_HOLD_KEEP)) spiReg[SPI_CS] = spiDefaults; /* stop */
+
+      return;
+   }
+
+   if (!(hold & SPI_HOLD_CONT)) spiReg[SPI_CS] = spiDefaults; /* stop */
+
+   if (flag3w)
+   {
+      if (ren3w < count)
+      {
+         cnt4w = ren3w;
+         cnt3w = count - ren3w;
+      }
+      else
+      {
+         cnt4w = count;
+         cnt3w = 0;
+      }
+   }
+   else
+   {
+      cnt4w = count;
+      cnt3w = 0;
+   }
+
+   spiReg[SPI_CLK] = 250000000/speed;
+
+   spiReg[SPI_CS] = spiDefaults | SPI_CS_TA; /* start */
+
+   cnt = cnt4w;
+
+   while((txCnt < cnt) || (rxCnt < cnt))
+   {
+      while((rxCnt < cnt) && ((spiReg[SPI_CS] & SPI_CS_RXD)))
+      {
+         if (rxBuf) rxBuf[rxCnt] = spiReg[SPI_FIFO];
+         else       spi_dummy    = spiReg[SPI_FIFO];
+         rxCnt++;
+      }
+
+      while((txCnt < cnt) && ((spiReg[SPI_CS] & SPI_CS_TXD)))
+      {
+         if (txBuf) spiReg[SPI_FIFO] = txBuf[txCnt];
+         else       spiReg[SPI_FIFO] = 0;
+         txCnt++;
+      }
+   }
+
+   while (!(spiReg[SPI_CS] & SPI_CS_DONE)) ;
+
+   /* now switch to 3-wire bus */
+
+   cnt += cnt3w;
+
+   spiReg[SPI_CS] |= SPI_CS_REN;
+
+   while((txCnt < cnt) || (rxCnt < cnt))
+   {
+      while((rxCnt < cnt) && ((spiReg[SPI_CS] & SPI_CS_RXD)))
+      {
+         if (rxBuf) rxBuf[rxCnt] = spiReg[SPI_FIFO];
+         else       spi_dummy    = spiReg[SPI_FIFO];
+         rxCnt++;
+      }
+
+      while((txCnt < cnt) && ((spiReg[SPI_CS] & SPI_CS_TXD)))
+      {
+         if (txBuf) spiReg[SPI_FIFO] = txBuf[txCnt];
+         else       spiReg[SPI_FIFO] = 0;
+         txCnt++;
+      }
+   }
+
+   while (!(spiReg[SPI_CS] & SPI_CS_DONE)) ;
+
+   if (!(hold & SPI_HOLD_KEEP)) spiReg[SPI_CS] = spiDefaults; /* stop */
+}
+
+static rawCbs_t *spiDmaCbV(int pos)
+{
+   int page, slot;
+
+   page = spiDmaPage + SPI_DMA_DATA_PAGES + (pos / SPI_DMA_CBS_PER_PAGE);
+   slot = pos % SPI_DMA_CBS_PER_PAGE;
+
+   return &dmaVirt[page]->cb[slot];
+}
+
+static uint32_t spiDmaCbP(int pos)
+{
+   int page, slot;
+
+   page = spiDmaPage + SPI_DMA_DATA_PAGES + (pos / SPI_DMA_CBS_PER_PAGE);
+   slot = pos % SPI_DMA_CBS_PER_PAGE;
+
+   return (uint32_t)(uintptr_t) &dmaBus[page]->cb[slot];
+}
+
+static uint32_t spiDmaDataP(int chunk)
+{
+   int page, offset;
+
+   page   = spiDmaPage + (chunk / SPI_DMA_CHUNKS_PER_PAGE);
+   offset = (chunk % SPI_DMA_CHUNKS_PER_PAGE) * SPI_DMA_CHUNK;
+
+   return (uint32_t)(uintptr_t)dmaBus[page] + offset;
+}
+
+static uint32_t spiDmaRxNext(int chunk)
+{
+   /* tx runs two chunks ahead of rx so neither fifo can block the other
+
+      TX0 TX1 RX0 TX2 RX1 ... TXn-1 RXn-2 RXn-1
+   */
+
+   if (chunk < (SPI_DMA_CHUNKS-2)) return spiDmaCbP(SPI_DMA_CB_TX(chunk+2));
+   if (chunk < (SPI_DMA_CHUNKS-1)) return spiDmaCbP(SPI_DMA_CB_RX(chunk+1));
+   return 0;
+}
+
+static void spiDmaInitCbs(void)
+{
+   rawCbs_t *p;
+   uint32_t fifo;
+   int i;
+
+   spiDmaPage = PAGES_PER_BLOCK * (bufferBlocks + PI_WAVE_BLOCKS);
+
+   fifo = ((SPI_BASE + (SPI_FIFO*4)) & 0x00ffffff) | PI_PERI_BUS;
+
+   p = spiDmaCbV(SPI_DMA_CB_HDR);
+
+   p->info   = DMA_NO_WIDE_BURSTS | DMA_WAIT_RESP | DMA_DEST_DREQ |
+               DMA_PERIPHERAL_MAPPING(6);
+   p->src    = (uint32_t)(uintptr_t)dmaBus[spiDmaPage + SPI_DMA_HDR_PAGE];
+   p->dst    = fifo;
+   p->length = 4;
+   p->next   = spiDmaCbP(SPI_DMA_CB_TX(0));
+
+   for (i=0; i<SPI_DMA_CHUNKS; i++)
+   {
+      p = spiDmaCbV(SPI_DMA_CB_TX(i));
+
+      p->info   = DMA_NO_WIDE_BURSTS | DMA_WAIT_RESP | DMA_DEST_DREQ |
+                  DMA_PERIPHERAL_MAPPING(6) | DMA_SRC_INC;
+      p->src    = spiDmaDataP(i);
+      p->dst    = fifo;
+      p->length = SPI_DMA_CHUNK;
+
+      if (i) p->next = spiDmaCbP(SPI_DMA_CB_RX(i-1));
+      else   p->next = spiDmaCbP(SPI_DMA_CB_TX(1));
+
+      p = spiDmaCbV(SPI_DMA_CB_RX(i));
+
+      p->info   = DMA_NO_WIDE_BURSTS | DMA_WAIT_RESP | DMA_SRC_DREQ |
+                  DMA_PERIPHERAL_MAPPING(7) | DMA_DEST_INC;
+      p->src    = fifo;
+      p->dst    = spiDmaDataP(i);
+      p->length = SPI_DMA_CHUNK;
+      p->next   = spiDmaRxNext(i);
+   }
+}
+
+static void spiDmaCopy(char *buf, unsigned count, int toDma)
+{
+   unsigned page, len;
+   char *virt;
+
+   for (page=0; (page*PAGE_SIZE)<count; page++)
+   {
+      virt = (char *)dmaVirt[spiDmaPage + page];
+
+      len = count - (page*PAGE_SIZE);
+      if (len > PAGE_SIZE) len = PAGE_SIZE;
+
+      if (!toDma)      memcpy(buf + (page*PAGE_SIZE), virt, len);
+      else if (buf)    memcpy(virt, buf + (page*PAGE_SIZE), len);
+      else             memset(virt, 0, len);
+   }
+}
+
+static int spiGoDma(
+   unsigned speed,
+   uint32_t flags,
+   char     *txBuf,
+   char     *rxBuf,
+   unsigned count)
+{
+   unsigned chunks, last, words;
+   uint32_t spiDefaults, start, micros, pause, cdiv;
+   unsigned mode, channel, cspol, cspols;
+   rawCbs_t *tx, *rx, *prev;
+   int status = 0;
+
+   channel = PI_SPI_FLAGS_GET_CHANNEL(flags);
+   mode   =  PI_SPI_FLAGS_GET_MODE   (flags);
+   cspols =  PI_SPI_FLAGS_GET_CSPOLS(flags);
+   cspol  =  (cspols>>channel) & 1;
+
+   spiDefaults = SPI_CS_MODE(mode)     |
+                 SPI_CS_CSPOLS(cspols) |
+                 SPI_CS_CS(channel)    |
+                 SPI_CS_CSPOL(cspol)   |
+                 SPI_CS_CLEAR(3);
+
+   spiDmaCopy(txBuf, count, 1);
+
+   /* the first fifo word sets DLEN and the low byte of CS */
+
+   *(uint32_t *)dmaVirt[spiDmaPage + SPI_DMA_HDR_PAGE] =
+      (count << 16) | SPI_CS_TA | (spiDefaults & 0x4F);
+
+   /* end the chain after the last chunk, at least two chunks */
+
+   words  = (count + 3) / 4;
+   chunks = (words + 7) / 8;
+   last   = (words - ((chunks - 1) * 8)) * 4;
+
+   tx   = spiDmaCbV(SPI_DMA_CB_TX(chunks-1));
+   rx   = spiDmaCbV(SPI_DMA_CB_RX(chunks-1));
+   prev = spiDmaCbV(SPI_DMA_CB_RX(chunks-2));
+
+   tx->length = last;
+   rx->length = last;
+   rx->next   = 0;
+   prev->next = spiDmaCbP(SPI_DMA_CB_RX(chunks-1));
+
+   cdiv = 250000000/speed;
+
+   spiReg[SPI_CS]  = spiDefaults; /* stop */
+   spiReg[SPI_CLK] = cdiv;
+
+   cdiv &= 0xFFFF; /* as seen by the SPI clock, 0 is 65536 */
+   if (!cdiv) cdiv = 65536;
+   spiReg[SPI_DC]  = SPI_DC_RPANIC(0x30) | SPI_DC_RDREQ(0x20) |
+                     SPI_DC_TPANIC(0x10) | SPI_DC_TDREQ(0x20);
+   spiReg[SPI_CS]  = spiDefaults | SPI_CS_DMAEN | SPI_CS_ADCS;
+
+   start = systReg[SYST_CLO];
+
+   initDMAgo((uint32_t *)dmaOut, spiDmaCbP(SPI_DMA_CB_HDR));
+
+   /* sleep through most of the transfer then poll for the chain end */
+
+   micros = ((uint64_t)count * 8 * cdiv * 4) / 1000;
+
+   if (micros > (2 * SPI_DMA_POLL_MICROS))
+   {
+      pause = micros - SPI_DMA_POLL_MICROS;
+      myGpioSleep(pause / MILLION, pause % MILLION);
+   }
+
+   while (dmaOut[DMA_CONBLK_AD])
+   {
+      if ((systReg[SYST_CLO] - start) > (micros + SPI_DMA_TIMEOUT))
+      {
+         DBG(DBG_ALWAYS, "SPI DMA timed out, count=%d", count);
+
+         dmaOut[DMA_CS] = DMA_CHANNEL_RESET;
+
+         dmaOut[DMA_CONBLK_AD] = 0;
+
+         status = PI_SPI_XFER_FAILED;
+
+         break;
+      }
+
+      myGpioSleep(0, SPI_DMA_POLL_MICROS);
+   }
+
+   spiReg[SPI_CS] = spiDefaults; /* stop */
+
+   /* restore the chain */
+
+   tx->length = SPI_DMA_CHUNK;
+   rx->length = SPI_DMA_CHUNK;
+   rx->next   = spiDmaRxNext(chunks-1);
+   prev->next = spiDmaRxNext(chunks-2);
+
+   if ((status == 0) && rxBuf) spiDmaCopy(rxBuf, count, 0);
+
+   return status;
+}
+
+static int spiGo(
+   unsigned speed,
+   uint32_t flags,
+   char     *txBuf,
+   char     *rxBuf,
+   unsigned count)
+{
+   int status;
+
+   if (PI_SPI_FLAGS_GET_AUX_SPI(flags))
+   {
+      spiGoA(speed, flags, txBuf, rxBuf, count, 0);
+      return 0;
+   }
+
+   /* DMA on the secondary channel unless a wave is using it */
+
+   if ((count >= SPI_DMA_MIN_BYTES) && (count <= SPI_DMA_MAX_BYTES) &&
+       !PI_SPI_FLAGS_GET_3WIRE(flags) && !PI_SPI_FLAGS_GET_NO_DMA(flags))
+   {
+      pthread_mutex_lock(&spiDmaMutex);
+
+      if ((wsWid < 0) && !dmaOut[DMA_CONBLK_AD])
+      {
+         status = spiGoDma(speed, flags, txBuf, rxBuf, count);
+
+         pthread_mutex_unlock(&spiDmaMutex);
+
+         return status;
+      }
+
+      pthread_mutex_unlock(&spiDmaMutex);
+   }
+
+   spiGoS(speed, flags, txBuf, rxBuf, count, 0);
+
+   return 0;
+}
+
+static int spiAnyOpen(uint32_t flags)
+{
+   int i, aux;
+
+   aux = PI_SPI_FLAGS_GET_AUX_SPI(flags);
+
+   for (i=0; i<PI_SPI_SLOTS; i++)
+   {
+      if ((spiInfo[i].state == PI_SPI_OPENED) &&
+         (PI_SPI_FLAGS_GET_AUX_SPI(spiInfo[i].flags) == aux))
+            return 1;
+   }
+   return 0;
+}
+
+static void spiInit(uint32_t flags)
+{
+   uint32_t resvd, cspols;
+
+   resvd  = PI_SPI_FLAGS_GET_RESVD(flags);
+   cspols = PI_SPI_FLAGS_GET_CSPOLS(flags);
+
+   if (PI_SPI_FLAGS_GET_AUX_SPI(flags))
+   {
+      /* enable module and access to registers */
+
+      auxReg[AUX_ENABLES] |= AUXENB_SPI1;
+
+      /* save original state */
+
+      old_mode_ace0  = gpioGetMode(PI_ASPI_CE0);
+      old_mode_ace1  = gpioGetMode(PI_ASPI_CE1);
+      old_mode_ace2  = gpioGetMode(PI_ASPI_CE2);
+      old_mode_asclk = gpioGetMode(PI_ASPI_SCLK);
+      old_mode_amiso = gpioGetMode(PI_ASPI_MISO);
+      old_mode_amosi = gpioGetMode(PI_ASPI_MOSI);
+
+      old_spi_cntl0 = auxReg[AUX_SPI0_CNTL0_REG];
+      old_spi_cntl1 = auxReg[AUX_SPI0_CNTL1_REG];
+
+      /* manually control auxiliary SPI chip selects */
+
+      if (!(resvd&1))
+      {
+         gpioSetMode(PI_ASPI_CE0,  PI_OUTPUT);
+         myGpioWrite(PI_ASPI_CE0, !(cspols&1));
+      }
+
+      if (!(resvd&2))
+      {
+         gpioSetMode(PI_ASPI_CE1,  PI_OUTPUT);
+         myGpioWrite(PI_ASPI_CE1, !(cspols&2));
+      }
+
+      if (!(resvd&4))
+      {
+         gpioSetMode(PI_ASPI_CE2,  PI_OUTPUT);
+         myGpioWrite(PI_ASPI_CE2, !(cspols&4));
+      }
+
+      /* set gpios to SPI mode */
+
+      gpioSetMode(PI_ASPI_SCLK, PI_ALT4);
+      gpioSetMode(PI_ASPI_MISO, PI_ALT4);
+      gpioSetMode(PI_ASPI_MOSI, PI_ALT4);
+   }
+   else
+   {
+      /* save original state */
+
+      old_mode_ce0  = gpioGetMode(PI_SPI_CE0);
+      old_mode_ce1  = gpioGetMode(PI_SPI_CE1);
+      old_mode_sclk = gpioGetMode(PI_SPI_SCLK);
+      old_mode_miso = gpioGetMode(PI_SPI_MISO);
+      old_mode_mosi = gpioGetMode(PI_SPI_MOSI);
+
+      old_spi_cs  = spiReg[SPI_CS];
+      old_spi_clk = spiReg[SPI_CLK];
+
+      /* set gpios to SPI mode */
+
+      if (!(resvd&1)) gpioSetMode(PI_SPI_CE0,  PI_ALT0);
+      if (!(resvd&2)) gpioSetMode(PI_SPI_CE1,  PI_ALT0);
+
+      gpioSetMode(PI_SPI_SCLK, PI_ALT0);
+      gpioSetMode(PI_SPI_MISO, PI_ALT0);
+      gpioSetMode(PI_SPI_MOSI, PI_ALT0);
+   }
+}
+
+static void spiTerm(uint32_t flags)
+{
+   int resvd;
+
+   resvd = PI_SPI_FLAGS_GET_RESVD(flags);
+
+   if (PI_SPI_FLAGS_GET_AUX_SPI(flags))
+   {
+      /* disable module and access to registers */
+
+      auxReg[AUX_ENABLES] &= (~AUXENB_SPI1);
+
+      /* restore original state */
+
+      if (!(resvd&1)) gpioSetMode(PI_ASPI_CE0,  old_mode_ace0);
+      if (!(resvd&2)) gpioSetMode(PI_ASPI_CE1,  old_mode_ace1);
+      if (!(resvd&4)) gpioSetMode(PI_ASPI_CE2,  old_mode_ace2);
+
+      gpioSetMode(PI_ASPI_SCLK, old_mode_asclk);
+      gpioSetMode(PI_ASPI_MISO, old_mode_amiso);
+      gpioSetMode(PI_ASPI_MOSI, old_mode_amosi);
+
+      auxReg[AUX_SPI0_CNTL0_REG] = old_spi_cntl0;
+      auxReg[AUX_SPI0_CNTL1_REG] = old_spi_cntl1;
+   }
+   else
+   {
+      /* restore original state */
+
+      if (!(resvd&1)) gpioSetMode(PI_SPI_CE0,  old_mode_ce0);
+      if (!(resvd&2)) gpioSetMode(PI_SPI_CE1,  old_mode_ce1);
+
+      gpioSetMode(PI_SPI_SCLK, old_mode_sclk);
+      gpioSetMode(PI_SPI_MISO, old_mode_miso);
+      gpioSetMode(PI_SPI_MOSI, old_mode_mosi);
+
+      spiReg[SPI_CS]  = old_spi_cs;
+      spiReg[SPI_CLK] = old_spi_clk;
+   }
+}
+
+int spiOpen(unsigned spiChan, unsigned baud, unsigned spiFlags)
+{
+   int i, slot;
+
+   DBG(DBG_USER, "spiChan=%d baud=%d spiFlags=0x%X",
+      spiChan, baud, spiFlags);
+
+   CHECK_INITED;
+
+   if (PI_SPI_FLAGS_GET_AUX_SPI(spiFlags))
+   {
+      if (gpioHardwareRevision() < 16)
+         SOFT_ERROR(PI_NO_AUX_SPI, "no auxiliary SPI, need a A+/B+");
+
+      i = PI_NUM_AUX_SPI_CHANNEL;
+   }
+   else
+      i = PI_NUM_STD_SPI_CHANNEL;
+
+   if (spiChan >= i)
+      SOFT_ERROR(PI_BAD_SPI_CHANNEL, "bad spiChan (%d)", spiChan);
+
+   if ((baud < PI_SPI_MIN_BAUD) || (baud > PI_SPI_MAX_BAUD))
+      SOFT_ERROR(PI_BAD_SPI_SPEED, "bad baud (%d)", baud);
+
+   if (spiFlags >= (1<<23))
+      SOFT_ERROR(PI_BAD_FLAGS, "bad spiFlags (0x%X)", spiFlags);
+
+   if (!spiAnyOpen(spiFlags)) /* initialise on first open */
+   {
+      spiInit(spiFlags);
+      spiGo(baud, spiFlags, NULL, NULL, 0);
+   }
+
+   slot = -1;
+
+   for (i=0; i<PI_SPI_SLOTS; i++)
+   {
+      if (spiInfo[i].state == PI_SPI_CLOSED)
+      {
+         spiInfo[i].state = PI_SPI_OPENED;
+         slot = i;
+         break;
+      }
+   }
+
+   if (slot < 0)
+      SOFT_ERROR(PI_NO_HANDLE, "no SPI handles");
+
+   spiInfo[slot].speed = baud;
+   spiInfo[slot].flags = spiFlags | PI_SPI_FLAGS_CHANNEL(spiChan);
+
+   return slot;
+}
+
+int spiClose(unsigned handle)
+{
+   DBG(DBG_USER, "handle=%d", handle);
+
+   CHECK_INITED;
+
+   if (handle >= PI_SPI_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (spiInfo[handle].state != PI_SPI_OPENED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   spiInfo[handle].state = PI_I2C_CLOSED;
+
+   if (!spiAnyOpen(spiInfo[handle].flags))
+      spiTerm(spiInfo[handle].flags); /* terminate on last close */
+
+   return 0;
+}
+
+int spiRead(unsigned handle, char *buf, unsigned count)
+{
+   DBG(DBG_USER, "handle=%d count=%d [%s]",
+      handle, count, myBuf2Str(count, buf));
+
+   CHECK_INITED;
+
+   if (handle >= PI_SPI_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (spiInfo[handle].state != PI_SPI_OPENED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (count > PI_MAX_SPI_DEVICE_COUNT)
+      SOFT_ERROR(PI_BAD_SPI_COUNT, "bad count (%d)", count);
+
+   if (spiGo(spiInfo[handle].speed, spiInfo[handle].flags, NULL, buf, count))
+      SOFT_ERROR(PI_SPI_XFER_FAILED, "SPI transfer failed");
+
+   return count;
+}
+
+int spiWrite(unsigned handle, char *buf, unsigned count)
+{
+   DBG(DBG_USER, "handle=%d count=%d [%s]",
+      handle, count, myBuf2Str(count, buf));
+
+   CHECK_INITED;
+
+   if (handle >= PI_SPI_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (spiInfo[handle].state != PI_SPI_OPENED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (count > PI_MAX_SPI_DEVICE_COUNT)
+      SOFT_ERROR(PI_BAD_SPI_COUNT, "bad count (%d)", count);
+
+   if (spiGo(spiInfo[handle].speed, spiInfo[handle].flags, buf, NULL, count))
+      SOFT_ERROR(PI_SPI_XFER_FAILED, "SPI transfer failed");
+
+   return count;
+}
+
+int spiXfer(unsigned handle, char *txBuf, char *rxBuf, unsigned count)
+{
+   DBG(DBG_USER, "handle=%d count=%d [%s]",
+      handle, count, myBuf2Str(count, txBuf));
+
+   CHECK_INITED;
+
+   if (handle >= PI_SPI_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (spiInfo[handle].state != PI_SPI_OPENED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (count > PI_MAX_SPI_DEVICE_COUNT)
+      SOFT_ERROR(PI_BAD_SPI_COUNT, "bad count (%d)", count);
+
+   if (spiGo(spiInfo[handle].speed, spiInfo[handle].flags, txBuf, rxBuf, count))
+      SOFT_ERROR(PI_SPI_XFER_FAILED, "SPI transfer failed");
+
+   return count;
+}
+
+int spiSegments(unsigned handle, pi_spi_seg_t *segs, unsigned numSegs)
+{
+   unsigned speed, hold, held;
+   uint32_t flags;
+   int i, total;
+
+   DBG(DBG_USER, "handle=%d segs=%08X numSegs=%d",
+      handle, (uint32_t)segs, numSegs);
+
+   CHECK_INITED;
+
+   if (handle >= PI_SPI_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (spiInfo[handle].state != PI_SPI_OPENED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (!segs || !numSegs || (numSegs > PI_SPI_MAX_SEGS))
+      SOFT_ERROR(PI_BAD_SPI_SEG, "bad numSegs (%d)", numSegs);
+
+   /* check every segment before transferring any */
+
+   for (i=0; i<numSegs; i++)
+   {
+      if (segs[i].len > PI_MAX_SPI_DEVICE_COUNT)
+         SOFT_ERROR(PI_BAD_SPI_COUNT, "bad count (%d)", segs[i].len);
+
+      if (segs[i].baud && ((segs[i].baud < PI_SPI_MIN_BAUD) ||
+                           (segs[i].baud > PI_SPI_MAX_BAUD)))
+         SOFT_ERROR(PI_BAD_SPI_SPEED, "bad baud (%d)", segs[i].baud);
+
+      if ((segs[i].delay > PI_MAX_MICS_DELAY) ||
+          (segs[i].flags > PI_SPI_SEG_CS_HOLD))
+         SOFT_ERROR(PI_BAD_SPI_SEG, "bad segment %d delay=%d flags=%d",
+            i, segs[i].delay, segs[i].flags);
+   }
+
+   flags = spiInfo[handle].flags;
+
+   held  = 0;
+   total = 0;
+
+   for (i=0; i<numSegs; i++)
+   {
+      if (segs[i].baud) speed = segs[i].baud;
+      else              speed = spiInfo[handle].speed;
+
+      /* the chip select is always released by the last segment */
+
+      hold = held;
+
+      if ((segs[i].flags & PI_SPI_SEG_CS_HOLD) && (i < (numSegs-1)))
+         hold |= SPI_HOLD_KEEP;
+
+      if (!hold)
+      {
+         /* a segment on its own may use DMA */
+
+         if (segs[i].len &&
+            spiGo(speed, flags, segs[i].txBuf, segs[i].rxBuf, segs[i].len))
+            SOFT_ERROR(PI_SPI_XFER_FAILED, "SPI transfer failed");
+      }
+      else if (PI_SPI_FLAGS_GET_AUX_SPI(flags))
+         spiGoA(speed, flags, segs[i].txBuf, segs[i].rxBuf, segs[i].len, hold);
+      else
+         spiGoS(speed, flags, segs[i].txBuf, segs[i].rxBuf, segs[i].len, hold);
+
+      if (hold & SPI_HOLD_KEEP) held = SPI_HOLD_CONT; else held = 0;
+
+      total += segs[i].len;
+
+      if (segs[i].delay) myGpioDelay(segs[i].delay);
+   }
+
+   return total;
+}
+
+static int mySpiSegments(unsigned handle, char *buf, unsigned bufLen)
+{
+   pi_spi_seg_t segs[PI_SPI_MAX_SEGS];
+   uint16_t len, flags;
+   uint32_t baud, delay;
+   unsigned pos, out, numSegs;
+   int i, status;
+
+   /* 12 byte headers, each followed by its data, transferred in place */
+
+   pos = 0;
+   numSegs = 0;
+
+   while (pos < bufLen)
+   {
+      if ((numSegs >= PI_SPI_MAX_SEGS) || ((pos + 12) > bufLen))
+         return PI_BAD_SPI_SEG;
+
+      memcpy(&len,   buf+pos,   2);
+      memcpy(&flags, buf+pos+2, 2);
+      memcpy(&baud,  buf+pos+4, 4);
+      memcpy(&delay, buf+pos+8, 4);
+
+      pos += 12;
+
+      if ((pos + len) > bufLen) return PI_BAD_SPI_SEG;
+
+      segs[numSegs].txBuf = buf + pos;
+      segs[numSegs].rxBuf = buf + pos;
+      segs[numSegs].len   = len;
+      segs[numSegs].baud  = baud;
+      segs[numSegs].delay = delay;
+      segs[numSegs].flags = flags;
+
+      pos += len;
+      numSegs++;
+   }
+
+   status = spiSegments(handle, segs, numSegs);
+
+   if (status < 0) return status;
+
+   /* close up the data read over the headers */
+
+   out = 0;
+
+   for (i=0; i<numSegs; i++)
+   {
+      memmove(buf + out, segs[i].rxBuf, segs[i].len);
+      out += segs[i].len;
+   }
+
+   return out;
+}
+
+/* ======================================================================= */
+
+
+/*
+Every open serial device is read by one thread as data arrives.  It
+epolls the device fds together with an eventfd which is written when
+a device is given a notification handle.  The bytes go into a ring
+buffer per device.  Only the thread advances head and only readers,
+holding serReadMutex, advance tail, so the thread never waits for a
+reader.  A device whose buffer is full is taken out of the epoll set
+until it is read, leaving further bytes with the driver.
+*/
+
+/* call with serReadMutex held */
+
+static void serUnpark(unsigned handle)
+{
+   serInfo_t *s = &serInfo[handle];
+   struct epoll_event ev;
+
+   if (s->parked && ((s->head - s->tail) < SER_BUF_SIZE))
+   {
+      ev.events   = EPOLLIN;
+      ev.data.u32 = handle;
+
+      if (epoll_ctl(serEpfd, EPOLL_CTL_ADD, s->fd, &ev) < 0)
+         DBG(DBG_ALWAYS, "serial %d epoll add failed (%m)", handle);
+
+      s->parked = 0;
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* call with serReadMutex held, returns the number of bytes copied */
+
+static unsigned serTake(unsigned handle, char *buf, unsigned count)
+{
+   serInfo_t *s = &serInfo[handle];
+   uint32_t avail, pos, part;
+
+   avail = s->head - s->tail;
+
+   /* head must be read before the bytes it covers */
+
+   __sync_synchronize();
+
+   if (count > avail) count = avail;
+
+   pos  = s->tail & SER_BUF_MASK;
+   part = SER_BUF_SIZE - pos;
+
+   if (part > count) part = count;
+
+   memcpy(buf, s->buf + pos, part);
+   memcpy(buf + part, s->buf, count - part);
+
+   /* the bytes must be copied before their space is released */
+
+   __sync_synchronize();
+
+   s->tail += count;
+
+   serUnpark(handle);
+
+   return count;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* call with serMutex held */
+
+static void serFill(unsigned handle)
+{
+   serInfo_t *s = &serInfo[handle];
+   uint32_t head, space, pos;
+   int n;
+
+   if (s->parked || s->failed) return; /* stale event */
+
+   head  = s->head;
+   pos   = head & SER_BUF_MASK;
+   space = SER_BUF_SIZE - (head - s->tail);
+
+   /* the rest of a wrapped read is picked up on the next event */
+
+   if (space > (SER_BUF_SIZE - pos)) space = SER_BUF_SIZE - pos;
+
+   if (space)
+   {
+      n = read(s->fd, s->buf + pos, space);
+
+      if (n > 0)
+      {
+         /* the bytes must be visible before the new head */
+
+         __sync_synchronize();
+
+         s->head = head + n;
+      }
+      else if ((n == 0) || (errno != EAGAIN))
+      {
+         /* hung up or failed, readers get PI_SER_READ_FAILED */
+
+         DBG(DBG_ALWAYS, "serial %d read failed (%m)", handle);
+
+         epoll_ctl(serEpfd, EPOLL_CTL_DEL, s->fd, NULL);
+
+         s->failed = 1;
+
+         return;
+      }
+   }
+
+   if ((s->head - s->tail) == SER_BUF_SIZE)
+   {
+      pthread_mutex_lock(&serReadMutex);
+
+      if ((s->head - s->tail) == SER_BUF_SIZE)
+      {
+         epoll_ctl(serEpfd, EPOLL_CTL_DEL, s->fd, NULL);
+         s->parked = 1;
+      }
+
+      pthread_mutex_unlock(&serReadMutex);
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+/*
+Sends the bytes of a serial device which are due to its notification
+handle, called with serMutex held.  Returns the number still due.
+*/
+
+static unsigned serPush(unsigned handle)
+{
+   serInfo_t *s = &serInfo[handle];
+   gpioNotify_t *h = &gpioNotify[s->notify];
+   gpioReport64_t *r;
+   uint32_t head, tail, avail, level;
+   unsigned i, j, k, n, reps, space;
+   uint64_t tick;
+
+   pthread_mutex_lock(&serReadMutex);
+
+   head = s->head;
+   tail = s->tail;
+
+   avail = head - tail;
+
+   /* a reader may have taken bytes since the last push */
+
+   if ((s->scan - tail) > avail) s->scan = tail;
+   if (s->owed > avail) s->owed = avail;
+
+   __sync_synchronize();
+
+   if ((s->delim == PI_SER_NO_DELIM) && (s->count == 0)) s->owed = avail;
+
+   if (s->count && (avail >= s->count)) s->owed = avail;
+
+   if (s->delim != PI_SER_NO_DELIM)
+   {
+      /* everything up to and including the last delimiter */
+
+      while (s->scan != head)
+      {
+         if ((uint8_t)s->buf[s->scan & SER_BUF_MASK] == s->delim)
+         {
+            if ((s->scan - tail) >= s->owed) s->owed = s->scan - tail + 1;
+         }
+
+         s->scan++;
+      }
+   }
+
+   if ((s->owed == 0) || (h->state != PI_NOTIFY_RUNNING))
+   {
+      pthread_mutex_unlock(&serReadMutex);
+      return s->owed;
+   }
+
+   pthread_mutex_lock(&pollMutex);
+
+   space = (NOTIFY_POLL_SIZE - (h->pollHead - h->pollTail)) * 4;
+
+   n = s->owed;
+
+   if (n > space) n = space;
+
+   reps = (n + 3) / 4;
+
+   tick = systTick64();
+
+   for (i=0; i<reps; i++)
+   {
+      k = n - (i * 4);
+
+      if (k > 4) k = 4;
+
+      /* up to four bytes, first in the least significant */
+
+      level = 0;
+
+      for (j=0; j<k; j++)
+         level |= (uint8_t)s->buf[(tail + (i * 4) + j) & SER_BUF_MASK]
+                     << (j * 8);
+
+      r = &h->pollRep[(h->pollHead + i) & NOTIFY_POLL_MASK];
+
+      r->seqno = 0;
+      r->flags = PI_NTFY_FLAGS_SER | PI_NTFY_FLAGS_BIT(handle) |
+                 PI_NTFY_FLAGS_PART(k);
+      r->tick  = tick;
+      r->level = level;
+   }
+
+   /* reports must be visible before the new head */
+
+   __sync_synchronize();
+
+   h->pollHead += reps;
+
+   pthread_mutex_unlock(&pollMutex);
+
+   if (reps)
+   {
+      pthread_mutex_lock(&notifyRing.mutex);
+      pthread_cond_broadcast(&notifyRing.cond);
+      pthread_mutex_unlock(&notifyRing.mutex);
+   }
+
+   s->tail = tail + n;
+   s->owed -= n;
+
+   serUnpark(handle);
+
+   pthread_mutex_unlock(&serReadMutex);
+
+   return s->owed;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void *pthSerThread(void *x)
+{
+   struct epoll_event ev[PI_SER_SLOTS+1];
+   uint64_t count;
+   int i, n, state, timeout, waiting;
+
+   timeout = -1;
+
+   while (1)
+   {
+      n = epoll_wait(serEpfd, ev, PI_SER_SLOTS+1, timeout);
+
+      if (n < 0) n = 0; /* interrupted, just retry the notifications */
+
+      /* don't allow cancellation while holding the mutex */
+
+      pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+
+      pthread_mutex_lock(&serMutex);
+
+      for (i=0; i<n; i++)
+      {
+         if (ev[i].data.u32 >= PI_SER_SLOTS)
+         {
+            read(serWakeFd, &count, sizeof(count));
+            continue;
+         }
+
+         if (serInfo[ev[i].data.u32].state == PI_SER_OPENED)
+            serFill(ev[i].data.u32);
+      }
+
+      /* bytes held back by a full or paused notification are retried */
+
+      waiting = 0;
+
+      for (i=0; i<PI_SER_SLOTS; i++)
+      {
+         if ((serInfo[i].state == PI_SER_OPENED) && (serInfo[i].notify >= 0))
+         {
+            if (serPush(i)) waiting = 1;
+         }
+      }
+
+      pthread_mutex_unlock(&serMutex);
+
+      pthread_setcancelstate(state, NULL);
+
+      if (waiting) timeout = SER_WAIT_MS; else timeout = -1;
+   }
+
+   return NULL;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* call with serMutex held */
+
+static int serStart(void)
+{
+   struct epoll_event ev;
+   pthread_attr_t pthAttr;
+
+   serEpfd = epoll_create(PI_SER_SLOTS+1);
+
+   if (serEpfd < 0)
+      SOFT_ERROR(PI_SER_OPEN_FAILED, "epoll_create failed (%m)");
+
+   serWakeFd = eventfd(0, EFD_NONBLOCK);
+
+   ev.events   = EPOLLIN;
+   ev.data.u32 = PI_SER_SLOTS;
+
+   if ((serWakeFd < 0) ||
+       (epoll_ctl(serEpfd, EPOLL_CTL_ADD, serWakeFd, &ev) < 0) ||
+       pthread_attr_init(&pthAttr) ||
+       pthread_attr_setstacksize(&pthAttr, STACK_SIZE) ||
+       pthread_create(&pthSer, &pthAttr, pthSerThread, NULL))
+   {
+      if (serWakeFd >= 0) close(serWakeFd);
+      close(serEpfd);
+
+      serWakeFd = -1;
+      serEpfd   = -1;
+
+      SOFT_ERROR(PI_SER_OPEN_FAILED, "serial thread failed (%m)");
+   }
+
+   pthSerRunning = 1;
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void serWake(void)
+{
+   uint64_t one = 1;
+
+   if (write(serWakeFd, &one, sizeof(one)) != sizeof(one))
+      DBG(DBG_INTERNAL, "serial wake failed (%m)");
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void serStop(void)
+{
+   int i;
+
+   if (pthSerRunning)
+   {
+      pthread_cancel(pthSer);
+      pthread_join(pthSer, NULL);
+      pthSerRunning = 0;
+
+      close(serWakeFd);
+      close(serEpfd);
+
+      serWakeFd = -1;
+      serEpfd   = -1;
+   }
+
+   for (i=0; i<PI_SER_SLOTS; i++)
+   {
+      if (serInfo[i].state == PI_SER_OPENED)
+      {
+         close(serInfo[i].fd);
+         serInfo[i].fd     = -1;
+         serInfo[i].notify = -1;
+         serInfo[i].state  = PI_SER_CLOSED;
+      }
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void serNotifyStopAll(int handle)
+{
+   int i;
+
+   pthread_mutex_lock(&serMutex);
+
+   for (i=0; i<PI_SER_SLOTS; i++)
+   {
+      if (serInfo[i].notify == handle) serInfo[i].notify = -1;
+   }
+
+   pthread_mutex_unlock(&serMutex);
+}
+
+/* ----------------------------------------------------------------------- */
+
+int serOpen(char *tty, unsigned serBaud, unsigned serFlags)
+{
+   struct termios new;
+   struct epoll_event ev;
+   serInfo_t *s;
+   int speed;
+   int fd;
+   int i, slot;
+
+   DBG(DBG_USER, "tty=%s serBaud=%d serFlags=0x%X", tty, serBaud, serFlags);
+
+   CHECK_INITED;
+
+   if (strncmp("/dev/tty", tty, 8))
+      SOFT_ERROR(PI_BAD_SER_DEVICE, "bad device (%s)", tty);
+
+   switch (serBaud)
+   {
+      case     50: speed =     B50; break;
+      case     75: speed =     B75; break;
+      case    110: speed =    B110; break;
+      case    134: speed =    B134; break;
+      case    150: speed =    B150; break;
+      case    200: speed =    B200; break;
+      case    300: speed =    B300; break;
+      case    600: speed =    B600; break;
+      case   1200: speed =   B1200; break;
+      case   1800: speed =   B1800; break;
+      case   2400: speed =   B2400; break;
+      case   4800: speed =   B4800; break;
+      case   9600: speed =   B9600; break;
+      case  19200: speed =  B19200; break;
+      case  38400: speed =  B38400; break;
+      case  57600: speed =  B57600; break;
+      case 115200: speed = B115200; break;
+      case 230400: speed = B230400; break;
+
+      default:
+         SOFT_ERROR(PI_BAD_SER_SPEED, "bad speed (%d)", serBaud);
+   }
+
+   if (serFlags)
+      SOFT_ERROR(PI_BAD_FLAGS, "bad flags (0x%X)", serFlags);
+
+   /* the slot is reserved by holding serMutex until it is opened */
+
+   pthread_mutex_lock(&serMutex);
+
+   if (!pthSerRunning && serStart())
+   {
+      pthread_mutex_unlock(&serMutex);
+      return PI_SER_OPEN_FAILED;
+   }
+
+   slot = -1;
+
+   for (i=0; i<PI_SER_SLOTS; i++)
+   {
+      if (serInfo[i].state == PI_SER_CLOSED)
+      {
+         slot = i;
+         break;
+      }
+   }
+
+   if (slot < 0)
+   {
+      pthread_mutex_unlock(&serMutex);
+      SOFT_ERROR(PI_NO_HANDLE, "no serial handles");
+   }
+
+   if ((fd = open(tty, O_RDWR | O_NOCTTY | O_NDELAY | O_NONBLOCK)) == -1)
+   {
+      pthread_mutex_unlock(&serMutex);
+      return PI_SER_OPEN_FAILED;
+   }
+
+   tcgetattr(fd, &new);
+
+   cfmakeraw(&new);
+
+   cfsetispeed(&new, speed);
+   cfsetospeed(&new, speed);
+
+   new.c_cc [VMIN]  = 0;
+   new.c_cc [VTIME] = 0;
+
+   tcflush(fd, TCIFLUSH);
+   tcsetattr(fd, TCSANOW, &new);
+
+   //fcntl(fd, F_SETFL, O_RDWR);
+
+   s = &serInfo[slot];
+
+   s->fd     = fd;
+   s->flags  = serFlags;
+   s->head   = 0;
+   s->tail   = 0;
+   s->scan   = 0;
+   s->owed   = 0;
+   s->parked = 0;
+   s->failed = 0;
+   s->notify = -1;
+
+   ev.events   = EPOLLIN;
+   ev.data.u32 = slot;
+
+   if (epoll_ctl(serEpfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+   {
+      close(fd);
+      s->fd = -1;
+      pthread_mutex_unlock(&serMutex);
+      SOFT_ERROR(PI_SER_OPEN_FAILED, "epoll_ctl failed (%m)");
+   }
+
+   pthread_mutex_lock(&serReadMutex);
+   s->state = PI_SER_OPENED;
+   pthread_mutex_unlock(&serReadMutex);
+
+   pthread_mutex_unlock(&serMutex);
+
+   return slot;
+}
+
+int serClose(unsigned handle)
+{
+   DBG(DBG_USER, "handle=%d", handle);
+
+   CHECK_INITED;
+
+   if (handle >= PI_SER_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   pthread_mutex_lock(&serMutex);
+   pthread_mutex_lock(&serReadMutex);
+
+   if (serInfo[handle].state != PI_SER_OPENED)
+   {
+      pthread_mutex_unlock(&serReadMutex);
+      pthread_mutex_unlock(&serMutex);
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   }
+
+   /* closing the fd also takes it out of the epoll set */
+
+   if (serInfo[handle].fd >= 0) close(serInfo[handle].fd);
+
+   serInfo[handle].fd = -1;
+   serInfo[handle].notify = -1;
+   serInfo[handle].state = PI_SER_CLOSED;
+
+   pthread_mutex_unlock(&serReadMutex);
+   pthread_mutex_unlock(&serMutex);
+
+   return 0;
+}
+
+int serWriteByte(unsigned handle, unsigned bVal)
+{
+   char c;
+
+   DBG(DBG_USER, "handle=%d bVal=%d", handle, bVal);
+
+   CHECK_INITED;
+
+   if (handle >= PI_SER_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (serInfo[handle].state != PI_SER_OPENED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (bVal > 0xFF)
+      SOFT_ERROR(PI_BAD_PARAM, "bad parameter (%d)", bVal);
+
+   c = bVal;
+
+   if (write(serInfo[handle].fd, &c, 1) != 1)
+      return PI_SER_WRITE_FAILED;
+   else
+      return 0;
+}
+
+int serReadByte(unsigned handle)
+{
+   char x;
+   int r;
+
+   DBG(DBG_USER, "handle=%d", handle);
+
+   CHECK_INITED;
+
+   if (handle >= PI_SER_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   pthread_mutex_lock(&serReadMutex);
+
+   if (serInfo[handle].state != PI_SER_OPENED)
+   {
+      pthread_mutex_unlock(&serReadMutex);
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   }
+
+   if (serTake(handle, &x, 1)) r = ((int)x) & 0xFF;
+   else if (serInfo[handle].failed) r = PI_SER_READ_FAILED;
+   else r = PI_SER_READ_NO_DATA;
+
+   pthread_mutex_unlock(&serReadMutex);
+
+   return r;
+}
+
+int serWrite(unsigned handle, char *buf, unsigned count)
+{
+   DBG(DBG_USER, "handle=%d count=%d [%s]",
+      handle, count, myBuf2Str(count, buf));
+
+   CHECK_INITED;
+
+   if (handle >= PI_SER_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (serInfo[handle].state != PI_SER_OPENED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (!count)
+      SOFT_ERROR(PI_BAD_PARAM, "bad count (%d)", count);
+
+   if (write(serInfo[handle].fd, buf, count) != count)
+      return PI_SER_WRITE_FAILED;
+   else
+      return 0;
+}
+
+int serRead(unsigned handle, char *buf, unsigned count)
+{
+   int r;
+
+   DBG(DBG_USER, "handle=%d count=%d buf=0x%X", handle, count, (unsigned)buf);
+
+   CHECK_INITED;
+
+   if (handle >= PI_SER_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (!count)
+      SOFT_ERROR(PI_BAD_PARAM, "bad count (%d)", count);
+
+   pthread_mutex_lock(&serReadMutex);
+
+   if (serInfo[handle].state != PI_SER_OPENED)
+   {
+      pthread_mutex_unlock(&serReadMutex);
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   }
+
+   r = serTake(handle, buf, count);
+
+   if (r) buf[r] = 0;
+   else if (serInfo[handle].failed) r = PI_SER_READ_FAILED;
+   else r = PI_SER_READ_NO_DATA;
+
+   pthread_mutex_unlock(&serReadMutex);
+
+   return r;
+}
+
+int serDataAvailable(unsigned handle)
+{
+   DBG(DBG_USER, "handle=%d", handle);
+
+   CHECK_INITED;
+
+   if (handle >= PI_SER_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (serInfo[handle].state != PI_SER_OPENED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   return serInfo[handle].head - serInfo[handle].tail;
+}
+
+int serNotifyStart(
+   unsigned handle, unsigned serHandle, unsigned delim, unsigned count)
+{
+   serInfo_t *s;
+
+   DBG(DBG_USER, "handle=%d serHandle=%d delim=%d count=%d",
+      handle, serHandle, delim, count);
+
+   CHECK_INITED;
+
+   if (handle >= PI_NOTIFY_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (gpioNotify[handle].state <= PI_NOTIFY_CLOSING)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (serHandle >= PI_SER_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad serial handle (%d)", serHandle);
+
+   if (delim > PI_SER_NO_DELIM)
+      SOFT_ERROR(PI_BAD_PARAM, "bad delim (%d)", delim);
+
+   if (count > PI_SER_MAX_COUNT)
+      SOFT_ERROR(PI_BAD_PARAM, "bad count (%d)", count);
+
+   pthread_mutex_lock(&serMutex);
+
+   s = &serInfo[serHandle];
+
+   if (s->state != PI_SER_OPENED)
+   {
+      pthread_mutex_unlock(&serMutex);
+      SOFT_ERROR(PI_BAD_HANDLE, "bad serial handle (%d)", serHandle);
+   }
+
+   /* bytes already buffered are subject to the new triggers */
+
+   s->delim  = delim;
+   s->count  = count;
+   s->owed   = 0;
+   s->scan   = s->tail;
+   s->notify = handle;
+
+   pthread_mutex_unlock(&serMutex);
+
+   serWake();
+
+   return 0;
+}
+
+int serNotifyStop(unsigned serHandle)
+{
+   DBG(DBG_USER, "serHandle=%d", serHandle);
+
+   CHECK_INITED;
+
+   if (serHandle >= PI_SER_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad serial handle (%d)", serHandle);
+
+   pthread_mutex_lock(&serMutex);
+
+   if (serInfo[serHandle].state != PI_SER_OPENED)
+   {
+      pthread_mutex_unlock(&serMutex);
+      SOFT_ERROR(PI_BAD_HANDLE, "bad serial handle (%d)", serHandle);
+   }
+
+   serInfo[serHandle].notify = -1;
+   serInfo[serHandle].owed   = 0;
+
+   pthread_mutex_unlock(&serMutex);
+
+   return 0;
+}
+
+/* ======================================================================= */
+
+static int chooseBestClock
+   (clkInf_t *clkInf, unsigned f, unsigned numc, unsigned *cf)
+{
+   int c, valid, offby, offby2, best_offby;
+   uint32_t div;
+   uint64_t frac;
+
+   valid = 0;
+   best_offby = 0;
+
+   for (c=0; c<numc; c++)
+   {
+      div = cf[c] / f;
+
+      if ((div > 1) && (div < 4096))
+      {
+         if (f < PI_MASH_MAX_FREQ)
+         {
+            frac = cf[c] - (div * f);
+            frac = (frac * 4096) / f;
+            offby = cf[c] - (div * f) - ((frac * f) / 4096);
+            if (frac < 4095)
+            {
+               offby2 = cf[c] - (div * f) - (((frac+1) * f) / 4096);
+               if (offby2 < 0) offby2 = -offby2;
+               if (offby2 < offby)
+               {
+                  offby = offby2;
+                  frac++;
+               }
+            }
+         }
+         else
+         {
+            frac = 0;
+            offby = cf[c] - (div * f);
+            if (div < 4095)
+            {
+               offby2 = cf[c] - ((div+1) * f);
+               if (offby2 < 0) offby2 = -offby2;
+               if (offby2 < offby)
+               {
+                  offby = offby2;
+                  div++;
+               }
+            }
+         }
+
+         if ((!valid) || (offby <= best_offby))
+         {
+            valid = 1;
+            clkInf->div = div;
+            clkInf->frac = frac;
+            clkInf->clock = c;
+            best_offby = offby;
+         }
+      }
+   }
+   return valid;
+}
+
+/* ======================================================================= */
+
+static rawCbs_t * dmaCB2adr(int pos)
+{
+   int page, slot;
+
+   page = pos/CBS_PER_IPAGE;
+   slot = pos%CBS_PER_IPAGE;
+
+   return &dmaIVirt[page]->cb[slot];
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void dmaCbPrint(int pos)
+{
+   rawCbs_t * p;
+
+   p = dmaCB2adr(pos);
+
+   fprintf(stderr, "i=%x s=%x d=%x len=%x s=%x nxt=%x\n",
+      p->info, p->src, p->dst, p->length, p->stride, p->next);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static unsigned dmaNowAtICB(void)
+{
+   unsigned cb;
+   static unsigned lastPage=0;
+   unsigned page;
+   uint32_t cbAddr;
+   uint32_t startTick, endTick;
+
+   startTick = systReg[SYST_CLO];
+
+   cbAddr = dmaIn[DMA_CONBLK_AD];
+
+   page = lastPage;
+
+   /* which page are we dma'ing? */
+
+   while (1)
+   {
+      cb = (cbAddr - ((int)dmaIBus[page])) / 32;
+
+      if (cb < CBS_PER_IPAGE)
+      {
+         endTick = systReg[SYST_CLO];
+
+         if (endTick != startTick)
+            gpioStats.cbTicks += (endTick - startTick);
+
+         gpioStats.cbCalls++;
+
+         lastPage = page;
+
+         return (page*CBS_PER_IPAGE) + cb;
+      }
+
+      if (page++ >= DMAI_PAGES) page=0;
+
+      if (page == lastPage) break;
+   }
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+unsigned rawWaveCB(void)
+{
+   unsigned cb;
+   static unsigned lastPage=0;
+   unsigned page;
+   uint32_t cbAddr;
+
+   cbAddr = dmaOut[DMA_CONBLK_AD];
+
+   if (!cbAddr) return -1;
+
+   page = lastPage;
+
+   /* which page are we dma'ing? */
+
+   while (1)
+   {
+      cb = (cbAddr - ((int)dmaOBus[page])) / 32;
+
+      if (cb < CBS_PER_OPAGE)
+      {
+         lastPage = page;
+
+         return (page*CBS_PER_OPAGE) + cb;
+      }
+
+      if (page++ >= DMAO_PAGES) page=0;
+
+      if (page == lastPage) break;
+   }
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static unsigned dmaCurrentSlot(unsigned pos)
+{
+   unsigned cycle=0, slot=0, tmp;
+
+   cycle = (pos/CBS_PER_CYCLE);
+   tmp   = (pos%CBS_PER_CYCLE);
+
+   if (tmp > 2) slot = ((tmp-2)/3);
+
+   return (cycle*PULSE_PER_CYCLE)+slot;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static uint32_t dmaPwmDataAdr(int pos)
+{
+   return (uint32_t) &dmaIBus[pos]->periphData;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static uint32_t dmaGpioOnAdr(int pos)
+{
+   int page, slot;
+
+   page = pos/ON_PER_IPAGE;
+   slot = pos%ON_PER_IPAGE;
+
+   return (uint32_t) &dmaIBus[page]->gpioOn[slot];
+}
+
+/* ----------------------------------------------------------------------- */
+
+static uint32_t dmaGpioOffAdr(int pos)
+{
+   int page, slot;
+
+   myOffPageSlot(pos, &page, &slot);
+
+   return (uint32_t) &dmaIBus[page]->gpioOff[slot];
+}
+
+/* ----------------------------------------------------------------------- */
+
+static uint32_t dmaTickAdr(int pos)
+{
+   int page, slot;
+
+   myTckPageSlot(pos, &page, &slot);
+
+   return (uint32_t) &dmaIBus[page]->tick[slot];
+}
+
+/* ----------------------------------------------------------------------- */
+
+static uint32_t dmaReadLevelsAdr(int pos)
+{
+   int page, slot;
+
+   myLvsPageSlot(pos, &page, &slot);
+
+   return (uint32_t) &dmaIBus[page]->level[slot];
+}
+
+/* ----------------------------------------------------------------------- */
+
+static uint32_t dmaCbAdr(int pos)
+{
+   int page, slot;
+
+   page = (pos/CBS_PER_IPAGE);
+   slot = (pos%CBS_PER_IPAGE);
+
+   return (uint32_t) &dmaIBus[page]->cb[slot];
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void dmaGpioOnCb(int b, int pos)
+{
+   rawCbs_t * p;
+
+   p = dmaCB2adr(b);
+
+   p->info   = NORMAL_DMA;
+   p->src    = dmaGpioOnAdr(pos);
+   p->dst    = ((GPIO_BASE + (GPSET0*4)) & 0x00ffffff) | PI_PERI_BUS;
+   p->length = 4;
+   p->next   = dmaCbAdr(b+1);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void dmaTickCb(int b, int pos)
+{
+   rawCbs_t * p;
+
+   p = dmaCB2adr(b);
+
+   p->info   = NORMAL_DMA;
+   p->src    = ((SYST_BASE + (SYST_CLO*4)) & 0x00ffffff) | PI_PERI_BUS;
+   p->dst    = dmaTickAdr(pos);
+   p->length = 4;
+   p->next   = dmaCbAdr(b+1);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void dmaGpioOffCb(int b, int pos)
+{
+   rawCbs_t * p;
+
+   p = dmaCB2adr(b);
+
+   p->info   = NORMAL_DMA;
+   p->src    = dmaGpioOffAdr(pos);
+   p->dst    = ((GPIO_BASE + (GPCLR0*4)) & 0x00ffffff) | PI_PERI_BUS;
+   p->length = 4;
+   p->next   = dmaCbAdr(b+1);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void dmaReadLevelsCb(int b, int pos)
+{
+   rawCbs_t * p;
+
+   p = dmaCB2adr(b);
+
+   p->info   = NORMAL_DMA;
+   p->src    = ((GPIO_BASE + (GPLEV0*4)) & 0x00ffffff) | PI_PERI_BUS;
+   p->dst    = dmaReadLevelsAdr(pos);
+   p->length = 4;
+   p->next   = dmaCbAdr(b+1);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void dmaDelayCb(int b)
+{
+   rawCbs_t * p;
+
+   p = dmaCB2adr(b);
+
+   if (gpioCfg.clockPeriph == PI_CLOCK_PCM)
+   {
+      p->info = NORMAL_DMA | TIMED_DMA(2);
+      p->dst  = PCM_TIMER;
+   }
+   else
+   {
+      p->info = NORMAL_DMA | TIMED_DMA(5);
+      p->dst  = PWM_TIMER;
+   }
+
+   p->src    = dmaPwmDataAdr(b%DMAI_PAGES);
+   p->length = 4;
+   p->next   = dmaCbAdr(b+1);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void dmaInitCbs(void)
+{
+   int b, pulse, level, cycle;
+
+   rawCbs_t * p;
+
+   /* set up the DMA control blocks */
+
+   DBG(DBG_STARTUP, "");
+
+   gpioStats.dmaInitCbsCount++;
+
+   b = -1;
+   level = 0;
+
+   for (cycle=0; cycle<bufferCycles; cycle++)
+   {
+      b++; dmaGpioOnCb(b, cycle%SUPERCYCLE); /* gpio on slot */
+
+      b++; dmaTickCb(b, cycle);              /* tick slot */
+
+      for (pulse=0; pulse<PULSE_PER_CYCLE; pulse++)
+      {
+         b++; dmaReadLevelsCb(b, level);               /* read levels slot */
+
+         b++; dmaDelayCb(b);                           /* delay slot */
+
+         b++; dmaGpioOffCb(b, (level%SUPERLEVEL)+1);   /* gpio off slot */
+
+         ++level;
+      }
+   }
+
+   /* point last cb back to first for continuous loop */
+
+   p = dmaCB2adr(b);
+
+   p->next = dmaCbAdr(0);
+
+   DBG(DBG_STARTUP, "DMA page type count = %d", sizeof(dmaIPage_t));
+
+   DBG(DBG_STARTUP, "%d control blocks (exp=%d)", b+1, NUM_CBS);
+}
+
+/* ======================================================================= */
+
+
+static void sigHandler(int signum)
+{
+   if ((signum >= PI_MIN_SIGNUM) && (signum <= PI_MAX_SIGNUM))
+   {
+      if (gpioSignal[signum].func)
+      {
+         if (gpioSignal[signum].ex)
+         {
+            (gpioSignal[signum].func)(signum, gpioSignal[signum].userdata);
+         }
+         else
+         {
+            (gpioSignal[signum].func)(signum);
+         }
+      }
+      else
+      {
+         switch(signum)
+         {
+            case SIGUSR1:
+
+               if (gpioCfg.dbgLevel > DBG_MIN_LEVEL) --gpioCfg.dbgLevel;
+               else gpioCfg.dbgLevel = DBG_MIN_LEVEL;
+               DBG(DBG_USER, "Debug level %d\n", gpioCfg.dbgLevel);
+               break;
+
+            case SIGUSR2:
+               if (gpioCfg.dbgLevel < DBG_MAX_LEVEL) ++gpioCfg.dbgLevel;
+               else gpioCfg.dbgLevel = DBG_MAX_LEVEL;
+               DBG(DBG_USER, "Debug level %d\n", gpioCfg.dbgLevel);
+               break;
+
+            case SIGPIPE:
+            case SIGWINCH:
+               DBG(DBG_USER, "signal %d ignored", signum);
+               break;
+
+            case SIGCHLD:
+               /* Used to notify threads of events */
+               break;
+
+            default:
+               DBG(DBG_ALWAYS, "Unhandled signal %d, terminating\n", signum);
+               gpioTerminate();
+               exit(-1);
+         }
+      }
+   }
+   else
+   {
+      /* exit */
+
+      DBG(DBG_ALWAYS, "Unhandled signal %d, terminating\n", signum);
+      gpioTerminate();
+      exit(-1);
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void sigSetHandler(void)
+{
+   int i;
+   struct sigaction new;
+
+   for (i=PI_MIN_SIGNUM; i<=PI_MAX_SIGNUM; i++)
+   {
+
+      memset(&new, 0, sizeof(new));
+      new.sa_handler = sigHandler;
+
+      sigaction(i, &new, NULL);
+   }
+}
+
+/* ======================================================================= */
+
+static uint64_t systTick64(void)
+{
+   uint32_t hi, lo;
+
+   /* CHI may step between the reads of CLO, read until it doesn't */
+
+   do
+   {
+      hi = systReg[SYST_CHI];
+      lo = systReg[SYST_CLO];
+   }
+   while (hi != systReg[SYST_CHI]);
+
+   return ((uint64_t)hi << 32) | lo;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static uint64_t tickExtend(uint64_t now, uint32_t tick)
+{
+   /* tick must be within 35 minutes of now */
+
+   return now + (int32_t)(tick - (uint32_t)now);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void notifyPut(uint32_t pos, unsigned flags, uint64_t tick, uint32_t level)
+{
+   gpioReport64_t *r;
+
+   r = &notifyRing.report[pos & NOTIFY_RING_MASK];
+
+   r->seqno = 0; /* assigned per handle by the writer */
+   r->flags = flags;
+   r->tick  = tick;
+   r->level = level;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void notifyPublish(uint32_t head, uint32_t level)
+{
+   notifyRing.level = level;
+
+   if (head != notifyRing.head)
+   {
+      /* reports must be visible before the new head */
+
+      __sync_synchronize();
+
+      notifyRing.head = head;
+
+      pthread_mutex_lock(&notifyRing.mutex);
+      pthread_cond_broadcast(&notifyRing.cond);
+      pthread_mutex_unlock(&notifyRing.mutex);
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+/*
+Returns 0 once the len bytes of count reports have been written,
+otherwise < 0.  Only the writer thread for the handle ever blocks here.
+*/
+
+static int notifyWrite(gpioNotify_t *h, void *rep, int count, int len)
+{
+   struct iovec iov[NOTIFY_OUT_CHUNKS];
+   struct msghdr msg;
+   struct pollfd pfd;
+   int i, iovcnt, size, chunk, left, err;
+   char *ptr;
+
+   if (count > gpioStats.maxEmit) gpioStats.maxEmit = count;
+
+   if      (h->compact) size = 1;
+   else if (h->tick64)  size = sizeof(gpioReport64_t);
+   else                 size = sizeof(gpioReport_t);
+
+   ptr  = (char *)rep;
+   left = len;
+
+   chunk = h->max_emits * size;
+
+   while (left > 0)
+   {
+      /* one gather write of up to NOTIFY_OUT_CHUNKS atomic sized chunks */
+
+      iovcnt = 0;
+
+      for (i=0; (i<left) && (iovcnt<NOTIFY_OUT_CHUNKS); i+=chunk)
+      {
+         iov[iovcnt].iov_base = ptr + i;
+
+         if ((left - i) > chunk) iov[iovcnt].iov_len = chunk;
+         else                    iov[iovcnt].iov_len = left - i;
+
+         iovcnt++;
+      }
+
+      if (iovcnt > 1) gpioStats.emitFrags += (iovcnt - 1);
+
+      if (h->pipe)
+      {
+         err = writev(h->fd, iov, iovcnt);
+      }
+      else
+      {
+         memset(&msg, 0, sizeof(msg));
+         msg.msg_iov    = iov;
+         msg.msg_iovlen = iovcnt;
+
+         err = sendmsg(h->fd, &msg, MSG_DONTWAIT|MSG_NOSIGNAL);
+      }
+
+      if (err < 0)
+      {
+         if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+         {
+            /* serious error, no point continuing */
+
+            DBG(DBG_ALWAYS, "fd=%d err=%d errno=%d", h->fd, err, errno);
+
+            DBG(DBG_ALWAYS, "%s", strerror(errno));
+
+            return -1;
+         }
+
+         gpioStats.wouldBlockPipeWrite++;
+
+         /* wait for the consumer, the ring takes up the slack */
+
+         pfd.fd     = h->fd;
+         pfd.events = POLLOUT;
+
+         poll(&pfd, 1, NOTIFY_WAIT_MS);
+
+         if (h->state == PI_NOTIFY_CLOSING) return -1;
+      }
+      else
+      {
+         if (err < left) gpioStats.shortPipeWrite++;
+         else            gpioStats.goodPipeWrite++;
+
+         ptr  += err;
+         left -= err;
+      }
+   }
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int notifyVarint(uint8_t *p, uint64_t v)
+{
+   int n = 0;
+
+   while (v >= 0x80)
+   {
+      p[n++] = (v & 0x7F) | 0x80;
+      v >>= 7;
+   }
+
+   p[n++] = v;
+
+   return n;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/*
+Appends a PI_NOTIFY_COMPACT record to out, preceded by a key if one is
+due, returns the new length.
+*/
+
+static int notifyOutCompact(
+   gpioNotify_t *h, uint8_t *out, int len,
+   unsigned flags, uint64_t tick, uint32_t level)
+{
+   uint8_t *p = out + len;
+   uint32_t changed;
+   uint64_t delta;
+
+   if ((h->encCount <= 0) || (tick < h->encTick))
+   {
+      p += notifyVarint(p, PI_NOTIFY_CODE_KEY);
+      p += notifyVarint(p, tick);
+      p += notifyVarint(p, h->encLevel);
+
+      h->encTick  = tick;
+      h->encCount = NOTIFY_KEY_INTERVAL;
+   }
+
+   delta   = (tick - h->encTick) << PI_NOTIFY_CODE_BITS;
+   changed = level ^ h->encLevel;
+
+   if (flags & (PI_NTFY_FLAGS_POLL | PI_NTFY_FLAGS_SER))
+   {
+      /* the level is data, the gpio levels are unchanged */
+
+      p += notifyVarint(p, delta | PI_NOTIFY_CODE_FLAGS);
+      p += notifyVarint(p, flags);
+      p += notifyVarint(p, level);
+
+      level = h->encLevel;
+   }
+   else if (flags)
+   {
+      p += notifyVarint(p, delta | PI_NOTIFY_CODE_FLAGS);
+      p += notifyVarint(p, flags);
+      p += notifyVarint(p, changed);
+   }
+   else if (changed && !(changed & (changed - 1)))
+   {
+      p += notifyVarint(p, delta | __builtin_ctz(changed));
+   }
+   else
+   {
+      p += notifyVarint(p, delta | PI_NOTIFY_CODE_MULTI);
+      p += notifyVarint(p, changed);
+   }
+
+   h->encTick  = tick;
+   h->encLevel = level;
+   h->encCount--;
+
+   return p - out;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* Appends a report in the handle's format to out, returns the new length. */
+
+static int notifyOut(
+   gpioNotify_t *h, void *out, int len,
+   unsigned flags, uint64_t tick, uint32_t level)
+{
+   gpioReport_t *r;
+   gpioReport64_t *r64;
+
+   if (h->compact)
+   {
+      h->seqno++;
+
+      return notifyOutCompact(h, out, len, flags, tick, level);
+   }
+   else if (h->tick64)
+   {
+      r64 = (gpioReport64_t *)((char *)out + len);
+
+      r64->seqno = h->seqno++;
+      r64->flags = flags;
+      r64->tick  = tick;
+      r64->level = level;
+
+      return len + sizeof(gpioReport64_t);
+   }
+   else
+   {
+      r = (gpioReport_t *)((char *)out + len);
+
+      r->seqno = h->seqno++;
+      r->flags = flags;
+      r->tick  = tick;
+      r->level = level;
+
+      return len + sizeof(gpioReport_t);
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void * pthNotifyWriter(void *x)
+{
+   gpioNotify_t *h = x;
+   gpioReport64_t out[NOTIFY_OUT_CHUNKS * MAX_EMITS];
+   gpioReport64_t *r;
+   struct timespec ts;
+   uint32_t head, start, lost, bits, tick, encLevel, pos, gapLevel;
+   uint64_t encTick, gapTick;
+   int n, len, running, gap, err, encCount;
+   char fifo[32];
+
+   running = 0;
+
+   err = 0;
+
+   while (!err && (h->state != PI_NOTIFY_CLOSING))
+   {
+      pthread_mutex_lock(&notifyRing.mutex);
+
+      if ((notifyRing.head == h->tail) && (h->pollHead == h->pollTail) &&
+          (h->state != PI_NOTIFY_CLOSING))
+      {
+         clock_gettime(CLOCK_REALTIME, &ts);
+
+         ts.tv_nsec += (NOTIFY_WAIT_MS * MILLION);
+
+         if (ts.tv_nsec >= BILLION)
+         {
+            ts.tv_sec++;
+            ts.tv_nsec -= BILLION;
+         }
+
+         pthread_cond_timedwait(&notifyRing.cond, &notifyRing.mutex, &ts);
+      }
+
+      pthread_mutex_unlock(&notifyRing.mutex);
+
+      if (h->state != PI_NOTIFY_RUNNING)
+      {
+         /* opened or paused, reports are not wanted */
+
+         running = 0;
+         h->tail = notifyRing.head;
+         h->pollTail = h->pollHead;
+         continue;
+      }
+
+      if (!running)
+      {
+         running = 1;
+         h->tail = notifyRing.head;
+         h->lastLevel = notifyRing.level;
+         h->encCount = 0;
+      }
+
+      bits = h->bits;
+
+      head = notifyRing.head;
+
+      __sync_synchronize();
+
+      gap = 0;
+
+      lost = 0;
+
+      start = h->tail;
+
+      /* the alert thread may be writing up to NOTIFY_BATCH_MAX
+         unpublished reports beyond head */
+
+      if ((head - start) > (NOTIFY_RING_SIZE - NOTIFY_BATCH_MAX))
+      {
+         gap = 1;
+      }
+      else
+      {
+         n = 0;
+         len = 0;
+
+         encTick  = h->encTick;
+         encLevel = h->encLevel;
+         encCount = h->encCount;
+
+         while ((h->tail != head) &&
+                (len <= (sizeof(out) - NOTIFY_OUT_MAX)))
+         {
+            r = &notifyRing.report[h->tail & NOTIFY_RING_MASK];
+
+            if (r->flags == 0)
+            {
+               if ((r->level ^ h->lastLevel) & bits)
+               {
+                  len = notifyOut(h, out, len, 0, r->tick, r->level);
+                  n++;
+               }
+
+               h->lastLevel = r->level;
+            }
+            else if (bits & (1<<(r->flags & 31)))
+            {
+               len = notifyOut(h, out, len, r->flags, r->tick, r->level);
+               n++;
+            }
+
+            h->tail++;
+         }
+
+         __sync_synchronize();
+
+         /* discard the copy if the alert thread lapped us meanwhile */
+
+         if ((notifyRing.head - start) > (NOTIFY_RING_SIZE - NOTIFY_BATCH_MAX))
+         {
+            h->seqno -= n;
+            h->encTick  = encTick;
+            h->encLevel = encLevel;
+            h->encCount = encCount;
+            gap = 1;
+         }
+         else if (n)
+         {
+            h->lastReportTick = gpioTick();
+            err = notifyWrite(h, out, n, len);
+         }
+      }
+
+      if (!err && !gap && (h->pollTail != h->pollHead))
+      {
+         /* poll job readings */
+
+         head = h->pollHead;
+
+         __sync_synchronize();
+
+         n = 0;
+         len = 0;
+
+         while ((h->pollTail != head) &&
+                (len <= (sizeof(out) - NOTIFY_OUT_MAX)))
+         {
+            r = &h->pollRep[h->pollTail & NOTIFY_POLL_MASK];
+
+            len = notifyOut(h, out, len, r->flags, r->tick, r->level);
+            n++;
+
+            h->pollTail++;
+         }
+
+         h->lastReportTick = gpioTick();
+         err = notifyWrite(h, out, n, len);
+      }
+
+      if (gap)
+      {
+         /* tell the client reports were lost and resynchronise at the
+            first level report half a ring behind the alert thread, so
+            the reports still in the ring are sent and the copy is not
+            lapped again at once */
+
+         head = notifyRing.head;
+
+         __sync_synchronize();
+
+         pos = head - (NOTIFY_RING_SIZE / 2);
+
+         while ((pos != head) &&
+                (notifyRing.report[pos & NOTIFY_RING_MASK].flags != 0)) pos++;
+
+         gapTick  = notifyRing.report[pos & NOTIFY_RING_MASK].tick;
+         gapLevel = notifyRing.report[pos & NOTIFY_RING_MASK].level;
+
+         __sync_synchronize();
+
+         if ((pos == head) ||
+             ((notifyRing.head - pos) > (NOTIFY_RING_SIZE - NOTIFY_BATCH_MAX)))
+         {
+            /* no level report left, carry on from now */
+
+            pos = notifyRing.head;
+            gapTick  = systTick64();
+            gapLevel = notifyRing.level;
+         }
+
+         /* the reports from the last one consumed to the resume point */
+
+         lost = pos - start;
+
+         gpioStats.notifyGaps++;
+         gpioStats.notifyLost += lost;
+
+         DBG(DBG_INTERNAL, "handle %d lost %u reports",
+            (int)(h - gpioNotify), lost);
+
+         /* the level report resumed from matches the gap and is not sent */
+
+         h->tail = pos;
+         h->lastLevel = gapLevel;
+
+         h->lastReportTick = gpioTick();
+
+         /* a compact reader gets a key with the gap */
+
+         h->encCount = 0;
+
+         len = notifyOut(h, out, 0, PI_NTFY_FLAGS_GAP, gapTick, gapLevel);
+
+         err = notifyWrite(h, out, 1, len);
+      }
+
+      tick = gpioTick();
+
+      if (!err && ((tick - h->lastReportTick) > 60000000))
+      {
+         h->lastReportTick = tick;
+
+         len = notifyOut(h, out, 0,
+            PI_NTFY_FLAGS_ALIVE, systTick64(), notifyRing.level);
+
+         err = notifyWrite(h, out, 1, len);
+      }
+   }
+
+   h->bits = 0;
+
+   if (err)
+   {
+      h->state = PI_NOTIFY_CLOSING;
+      intNotifyBits();
+   }
+
+   pollStopAll(h - gpioNotify);
+
+   serNotifyStopAll(h - gpioNotify);
+
+   if (h->pipe)
+   {
+      close(h->fd);
+
+      sprintf(fifo, "/dev/pigpio%d", (int)(h - gpioNotify));
+
+      unlink(fifo);
+   }
+
+   h->state = PI_NOTIFY_CLOSED;
+
+   return NULL;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int notifyStartWriter(int slot)
+{
+   gpioNotify_t *h = &gpioNotify[slot];
+
+   h->tail = notifyRing.head;
+   h->lastLevel = notifyRing.level;
+
+   if (pthread_create(&h->pthId, NULL, pthNotifyWriter, h))
+   {
+      h->writer = 0;
+      return -1;
+   }
+
+   h->writer = 1;
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void notifyJoinWriter(int slot)
+{
+   if (gpioNotify[slot].writer)
+   {
+      pthread_join(gpioNotify[slot].pthId, NULL);
+      gpioNotify[slot].writer = 0;
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void notifyCloseInBand(int slot, int fd)
+{
+   int i;
+
+   /* closed by the client, wait for the writer to let go of fd */
+
+   if ((gpioNotify[slot].fd == fd) && (!gpioNotify[slot].pipe))
+   {
+      if (gpioNotify[slot].state > PI_NOTIFY_CLOSING)
+         gpioNotifyClose(slot);
+
+      for (i=0; i<(10*NOTIFY_WAIT_MS); i++)
+      {
+         if ((gpioNotify[slot].state == PI_NOTIFY_CLOSED) ||
+             (gpioNotify[slot].fd != fd)) break;
+
+         myGpioDelay(1000);
+      }
+   }
+}
+
+/* ======================================================================= */
+
+static int capVarint(uint8_t *p, uint64_t v)
+{
+   int n = 0;
+
+   while (v >= 0x80)
+   {
+      p[n++] = (v & 0x7F) | 0x80;
+      v >>= 7;
+   }
+
+   p[n++] = v;
+
+   return n;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void capSync(void)
+{
+   /* records must be visible before the sizes which cover them */
+
+   __sync_synchronize();
+
+   capHdr->samples  = capCount;
+   capHdr->dataUsed = capUsed;
+   capHdr->state    = capState;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/*
+Writes the record for a change to level at tick.
+Must be called with capMutex held while running.
+*/
+
+static void capPut(uint64_t tick, uint32_t level)
+{
+   uint32_t changed;
+   uint64_t delta;
+   gpioCaptureIndex_t *ix;
+   uint8_t *p;
+
+   level &= capBits;
+
+   changed = level ^ capLevel;
+
+   if (!changed) return;
+
+   if ((capUsed + CAP_MAX_RECORD) > capHdr->dataSize)
+   {
+      capState = PI_CAPTURE_FULL;
+      return;
+   }
+
+   if ((capUsed >= capNextIndex) && (capHdr->indexUsed < capHdr->indexSize))
+   {
+      ix = &capIndex[capHdr->indexUsed];
+
+      ix->tick   = capTick;
+      ix->offset = capUsed;
+      ix->level  = capLevel;
+
+      capHdr->indexUsed++;
+
+      capNextIndex = capUsed + CAP_INDEX_INTERVAL;
+   }
+
+   /* a sample read before the capture started may be late */
+
+   if (tick > capTick) delta = tick - capTick; else delta = 0;
+
+   p = capData + capUsed;
+
+   if (changed & (changed - 1))
+   {
+      p += capVarint(p, (delta << PI_CAPTURE_CODE_BITS) | PI_CAPTURE_MULTI);
+      p += capVarint(p, changed);
+   }
+   else
+   {
+      p += capVarint(p,
+         (delta << PI_CAPTURE_CODE_BITS) | __builtin_ctz(changed));
+   }
+
+   capUsed  = p - capData;
+   capTick  = tick;
+   capLevel = level;
+   capCount++;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void capPreDrop(void)
+{
+   capBaseTick  = capPre[capPreTail].tick;
+   capBaseLevel = capPre[capPreTail].level;
+
+   capPreTail = (capPreTail + 1) & CAP_PRE_MASK;
+   capPreCount--;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/*
+Keeps the change to level at tick while armed and starts the
+capture if it meets the trigger.  Must be called with capMutex held.
+*/
+
+static void capArmed(uint64_t tick, uint32_t level)
+{
+   uint32_t last, met;
+   uint64_t start;
+   unsigned i;
+
+   if (capPreCount)
+      last = capPre[(capPreTail + capPreCount - 1) & CAP_PRE_MASK].level;
+   else
+      last = capBaseLevel;
+
+   if ((level ^ last) & capBits)
+   {
+      if (capPreCount == CAP_PRE_SAMPLES) capPreDrop();
+
+      i = (capPreTail + capPreCount) & CAP_PRE_MASK;
+
+      capPre[i].tick  = tick;
+      capPre[i].level = level;
+
+      capPreCount++;
+   }
+
+   if (tick > capPreMicros) start = tick - capPreMicros; else start = 0;
+
+   /* the base level holds from the base tick to the oldest kept */
+
+   while (capPreCount && (capPre[capPreTail].tick < start)) capPreDrop();
+
+   met = ((level & capTrigBits) == capTrigLevels);
+
+   if (met && !capTrigLast)
+   {
+      if (start < capBaseTick) start = capBaseTick;
+
+      capHdr->startTick  = start;
+      capHdr->startLevel = capBaseLevel & capBits;
+      capHdr->trigTick   = tick;
+
+      capTick  = start;
+      capLevel = capBaseLevel & capBits;
+
+      capState = PI_CAPTURE_RUNNING;
+
+      while (capPreCount && (capState == PI_CAPTURE_RUNNING))
+      {
+         capPut(capPre[capPreTail].tick, capPre[capPreTail].level);
+
+         capPreTail = (capPreTail + 1) & CAP_PRE_MASK;
+         capPreCount--;
+      }
+   }
+
+   capTrigLast = met;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* called by the alert thread for each batch of samples */
+
+static void capSamples(int numSamples)
+{
+   uint64_t tick64;
+   int d;
+
+   pthread_mutex_lock(&capMutex);
+
+   if ((capState == PI_CAPTURE_ARMED) || (capState == PI_CAPTURE_RUNNING))
+   {
+      tick64 = systTick64();
+
+      for (d=0; d<numSamples; d++)
+      {
+         if (capState == PI_CAPTURE_ARMED)
+         {
+            capArmed(tickExtend(tick64, gpioSample[d].tick),
+               gpioSample[d].level);
+         }
+         else if (capState == PI_CAPTURE_RUNNING)
+         {
+            capPut(tickExtend(tick64, gpioSample[d].tick),
+               gpioSample[d].level);
+         }
+         else break;
+      }
+
+      capSync();
+   }
+
+   pthread_mutex_unlock(&capMutex);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void capStop(void)
+{
+   void *map;
+   size_t size;
+   int fd;
+
+   pthread_mutex_lock(&capMutex);
+
+   if (capState == PI_CAPTURE_IDLE)
+   {
+      pthread_mutex_unlock(&capMutex);
+      return;
+   }
+
+   if (capState != PI_CAPTURE_FULL) capState = PI_CAPTURE_STOPPED;
+
+   capSync();
+
+   map  = capMap;
+   size = capMapSize;
+   fd   = capFd;
+
+   capMap   = MAP_FAILED;
+   capFd    = -1;
+   capHdr   = NULL;
+   capIndex = NULL;
+   capData  = NULL;
+
+   if (capPre) free(capPre);
+
+   capPre      = NULL;
+   capPreCount = 0;
+
+   capBits        = 0;
+   capMonitorBits = 0;
+
+   capState = PI_CAPTURE_IDLE;
+
+   pthread_mutex_unlock(&capMutex);
+
+   /* the alert thread no longer touches the map */
+
+   msync(map, size, MS_SYNC);
+   munmap(map, size);
+   close(fd);
+}
+
+/* ======================================================================= */
+
+unsigned alert_delays[]={
+   1000, 1068, 1145, 1235,
+   1339, 1463, 1613, 1796,
+   2027, 2326, 2727, 3297,
+   4167, 5660, 8823, 20000};
+
+/* ======================================================================= */
+
+static void * pthAlertThread(void *x)
+{
+   struct timespec req, rem;
+   uint32_t oldLevel, newLevel, level, reportedLevel;
+   uint32_t oldSlot,  newSlot;
+   uint32_t tick, expected, nowTick;
+   int32_t diff;
+   int cycle, pulse;
+   uint32_t changes, bits, changedBits, timeoutBits;
+   int numSamples, d;
+   int b, n, v;
+   int page, slot, run;
+   uint32_t mask, todo;
+   const uint32_t *levels;
+   int wdogList[PI_MAX_USER_GPIO+1];
+   int wdogCount, w;
+   uint32_t wdogListBits;
+   int stopped;
+   int delayTicks;
+   uint32_t nextWakeTick;
+   int moreToDo;
+   uint32_t head;
+   uint64_t tick64;
+   int srxLocked;
+
+   req.tv_sec = 0;
+
+   /* don't start until DMA started */
+
+   spinWhileStarting();
+
+   reportedLevel = gpioReg[GPLEV0];
+
+   oldSlot = dmaCurrentSlot(dmaNowAtICB());
+
+   cycle = (oldSlot/PULSE_PER_CYCLE);
+   pulse = (oldSlot%PULSE_PER_CYCLE);
+
+   stopped = 0;
+
+   moreToDo = 0;
+
+   wdogCount = 0;
+
+   wdogListBits = 0;
+
+   tick = systReg[SYST_CLO];
+
+   nextWakeTick =
+      tick + alert_delays[(gpioCfg.internals>>PI_CFG_ALERT_FREQ)&15];
+
+   while (1)
+   {
+      newSlot = dmaCurrentSlot(dmaNowAtICB());
+
+      numSamples = 0;
+
+      changedBits = 0;
+
+      mask = monitorBits;
+
+      oldLevel = reportedLevel & mask;
+
+      /* serial reads are decoded from the same level words */
+
+      srxLocked = 0;
+
+      if (srxBits)
+      {
+         pthread_mutex_lock(&srxMutex);
+         srxLocked = 1;
+      }
+
+      while ((oldSlot != newSlot) && (numSamples < DATUMS))
+      {
+         /*
+         Scan the longest run of level words which are contiguous
+         in one DMA page and do not cross a cycle boundary (where
+         the tick is resynchronised) or the current DMA position.
+         */
+
+         myLvsPageSlot(oldSlot, &page, &slot);
+
+         run = LVS_PER_IPAGE - slot;
+
+         if (run > (PULSE_PER_CYCLE - pulse)) run = PULSE_PER_CYCLE - pulse;
+
+         if ((newSlot > oldSlot) && (run > (newSlot - oldSlot)))
+            run = newSlot - oldSlot;
+
+         levels = dmaIVirt[page]->level + slot;
+
+         n = 0;
+
+         while (n < run)
+         {
+            n += myScanLevels(levels+n, run-n, mask, oldLevel);
+
+            if (n < run)
+            {
+               level = levels[n];
+
+               newLevel = (level & mask);
+
+               gpioSample[numSamples].tick  = tick + (n * gpioCfg.clockMicros);
+               gpioSample[numSamples].level = level;
+
+               changedBits |= (newLevel ^ oldLevel);
+
+               oldLevel = newLevel;
+
+               n++;
+
+               if (++numSamples >= DATUMS) break;
+            }
+         }
+
+         if (srxLocked) srxDecode(levels, n);
+
+         oldSlot += n;
+         pulse   += n;
+         tick    += (n * gpioCfg.clockMicros);
+
+         if (pulse >= PULSE_PER_CYCLE)
+         {
+            pulse = 0;
+
+            if (++cycle >= bufferCycles)
+            {
+               cycle = 0;
+               oldSlot = 0;
+            }
+
+            expected = tick;
+
+            tick = myGetTick(cycle);
+
+            diff = tick - expected;
+
+            diff += (TICKSLOTS/2);
+
+            if (diff < 0)
+            {
+               gpioStats.diffTick[0]++;
+            }
+
+            else if (diff >= TICKSLOTS)
+            {
+               gpioStats.diffTick[TICKSLOTS-1]++;
+            }
+
+            else gpioStats.diffTick[diff]++;
+         }
+      }
+
+      if (srxLocked) pthread_mutex_unlock(&srxMutex);
+
+      if (oldSlot == newSlot) moreToDo = 0; else moreToDo = 1;
+
+      /* should gpioGetSamples be called */
+
+      if (changedBits)
+      {
+         if (gpioGetSamples.func)
+         {
+            if (gpioGetSamples.ex)
+            {
+               (gpioGetSamples.func)
+                  (gpioSample, numSamples, gpioGetSamples.userdata);
+            }
+            else
+            {
+               (gpioGetSamples.func)
+                  (gpioSample, numSamples);
+            }
+         }
+      }
+
+      /* reset timeouts for any changed bits */
+
+      for (todo=changedBits; todo; todo&=(todo-1))
+      {
+         gpioAlert[__builtin_ctz(todo)].tick = tick;
+      }
+
+      /* call alert callbacks for each bit transition */
+
+      mask = alertBits;
+
+      if (changedBits & mask)
+      {
+         oldLevel = reportedLevel & mask;
+
+         gpioStats.alertSamples += numSamples;
+
+         for (d=0; d<numSamples; d++)
+         {
+            newLevel = gpioSample[d].level & mask;
+
+            if (newLevel != oldLevel)
+            {
+               changes = newLevel ^ oldLevel;
+
+               /* only visit the gpios which changed */
+
+               for (todo=changes; todo; todo&=(todo-1))
+               {
+                  b = __builtin_ctz(todo);
+
+                  if (newLevel & (1<<b)) v = 1; else v = 0;
+
+                  if (gpioAlert[b].func)
+                  {
+                     gpioStats.alertCalls++;
+
+                     if (gpioAlert[b].ex)
+                     {
+                        (gpioAlert[b].func)
+                           (b, v, gpioSample[d].tick,
+                            gpioAlert[b].userdata);
+                     }
+                     else
+                     {
+                        (gpioAlert[b].func)
+                           (b, v, gpioSample[d].tick);
+                     }
+                  }
+               }
+               oldLevel = newLevel;
+            }
+         }
+      }
+
+      /* rebuild the list of armed watchdogs if it has changed */
+
+      if (wdogBits != wdogListBits)
+      {
+         wdogListBits = wdogBits;
+
+         wdogCount = 0;
+
+         for (todo=wdogListBits; todo; todo&=(todo-1))
+         {
+            wdogList[wdogCount++] = __builtin_ctz(todo);
+         }
+      }
+
+      /* check for timeout watchdogs */
+
+      timeoutBits = 0;
+
+      for (w=0; w<wdogCount; w++)
+      {
+         b = wdogList[w];
+
+         gpioStats.wdogChecks++;
+
+         if (gpioAlert[b].timeout)
+         {
+            diff = tick - gpioAlert[b].tick;
+
+            if (diff > (gpioAlert[b].timeout*1000))
+            {
+               timeoutBits |= (1<<b);
+
+               gpioAlert[b].tick += (gpioAlert[b].timeout*1000);
+
+               if (gpioAlert[b].func)
+               {
+                  if (gpioAlert[b].ex)
+                  {
+                     (gpioAlert[b].func)
+                        (b, PI_TIMEOUT, tick, gpioAlert[b].userdata);
+                  }
+                  else
+                  {
+                     (gpioAlert[b].func)
+                        (b, PI_TIMEOUT, tick);
+                  }
+               }
+            }
+         }
+      }
+
+      /* publish notification reports once, the writers filter them */
+
+      bits = notifyBits;
+
+      head = notifyRing.head;
+
+      if (numSamples) newLevel = gpioSample[numSamples-1].level;
+      else            newLevel = reportedLevel;
+
+      if (bits)
+      {
+         /* reports carry the full tick, samples only the low half */
+
+         tick64 = systTick64();
+
+         if (changedBits & bits)
+         {
+            oldLevel = reportedLevel & bits;
+
+            for (d=0; d<numSamples; d++)
+            {
+               if ((gpioSample[d].level & bits) != oldLevel)
+               {
+                  notifyPut(head++, 0, tickExtend(tick64, gpioSample[d].tick),
+                     gpioSample[d].level);
+
+                  oldLevel = gpioSample[d].level & bits;
+               }
+            }
+         }
+
+         for (todo=(timeoutBits & bits); todo; todo&=(todo-1))
+         {
+            notifyPut(head++,
+               PI_NTFY_FLAGS_WDOG | PI_NTFY_FLAGS_BIT(__builtin_ctz(todo)),
+               tickExtend(tick64, tick), newLevel);
+         }
+      }
+
+      notifyPublish(head, newLevel);
+
+      if (capMonitorBits && numSamples) capSamples(numSamples);
+
+      if (changedBits & scriptBits)
+      {
+         for (n=0; n<PI_MAX_SCRIPTS; n++)
+         {
+            if ((gpioScript[n].state     == PI_SCRIPT_IN_USE)  &&
+                (gpioScript[n].run_state == PI_SCRIPT_WAITING) &&
+                (gpioScript[n].waitBits & changedBits))
+            {
+               pthread_mutex_lock(&gpioScript[n].pthMutex);
+
+               if (gpioScript[n].run_state == PI_SCRIPT_WAITING)
+               {
+                  gpioScript[n].changedBits =
+                     gpioScript[n].waitBits & changedBits;
+                  pthread_cond_signal(&gpioScript[n].pthCond);
+               }
+
+               pthread_mutex_unlock(&gpioScript[n].pthMutex);
+            }
+         }
+      }
+
+      /* once all outputs have been emitted set reported level */
+
+      if (numSamples) reportedLevel = gpioSample[numSamples-1].level;
+
+      if (numSamples > gpioStats.maxSamples)
+         gpioStats.maxSamples = numSamples;
+
+      gpioStats.numSamples += numSamples;
+
+      /* Check that DMA is running okay */
+
+      if (dmaIn[DMA_CONBLK_AD])
+      {
+         if (stopped)
+         {
+            DBG(DBG_STARTUP, "****** GOING ******");
+            stopped = 0;
+         }
+      }
+      else
+      {
+         stopped = 1;
+
+         myGpioDelay(5000);
+
+         if (runState == PI_RUNNING)
+         {
+            /* should never be executed, leave code just in case */
+
+            gpioCfg.internals |= PI_CFG_STATS;
+
+            dmaInitCbs();
+            flushMemory();
+            initDMAgo((uint32_t *)dmaIn, (uint32_t)dmaIBus[0]);
+            myGpioDelay(5000); /* let DMA run for a while */
+            oldSlot = dmaCurrentSlot(dmaNowAtICB());
+            gpioStats.DMARestarts++;
+         }
+      }
+
+      nowTick = systReg[SYST_CLO];
+
+      if (moreToDo)
+      {
+         gpioStats.moreToDo++;
+
+         /* rebase wake up time */
+
+         nextWakeTick = nowTick +
+            alert_delays[(gpioCfg.internals>>PI_CFG_ALERT_FREQ)&15];
+
+         req.tv_nsec = 0;
+      }
+      else
+      {
+         delayTicks = nextWakeTick - nowTick;
+
+         if (delayTicks < 0)
+         {
+            gpioStats.lateTicks++;
+
+            /* rebase wake up time */
+
+            nextWakeTick = nowTick +
+               alert_delays[(gpioCfg.internals>>PI_CFG_ALERT_FREQ)&15];
+
+            req.tv_nsec = 0;
+         }
+         else
+         {
+            gpioStats.alertTicks++;
+
+            nextWakeTick +=
+               alert_delays[(gpioCfg.internals>>PI_CFG_ALERT_FREQ)&15];
+
+            req.tv_nsec = (delayTicks * 1000);
+         }
+      }
+
+      if (req.tv_nsec)
+      {
+         req.tv_sec = 0;
+
+         while (nanosleep(&req, &rem))
+         {
+            req.tv_sec  = rem.tv_sec;
+            req.tv_nsec = rem.tv_nsec;
+         }
+      }
+
+      nextWakeTick +=
+         alert_delays[(gpioCfg.internals>>PI_CFG_ALERT_FREQ)&15];
+
+   }
+
+   return 0;
+}
+
+/* ======================================================================= */
+
+static int scrPop(gpioScript_t *s, int *SP, int *S)
+{
+   if ((*SP) > 0)
+   {
+      return S[--(*SP)];
+   }
+   else
+   {
+      s->run_state = PI_SCRIPT_FAILED;
+      DBG(DBG_ALWAYS, "script %d too many pops", s->id);
+      return 0;
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void scrPush(gpioScript_t *s, int *SP, int *S, int val)
+{
+   if ((*SP) < PI_SCRIPT_STACK_SIZE)
+   {
+      S[(*SP)++] = val;
+   }
+   else
+   {
+      s->run_state = PI_SCRIPT_FAILED;
+      DBG(DBG_ALWAYS, "script %d too many pushes", s->id);
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void scrSwap(int *v1, int *v2)
+{
+   int t;
+
+   t=*v1; *v1=*v2; *v2= t;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int scrWait(gpioScript_t *s, uint32_t bits)
+{
+   pthread_mutex_lock(&s->pthMutex);
+
+   if (s->request == PI_SCRIPT_RUN)
+   {
+      s->run_state = PI_SCRIPT_WAITING;
+      s->waitBits = bits;
+      intScriptBits();
+
+      pthread_cond_wait(&s->pthCond, &s->pthMutex);
+
+      s->waitBits = 0;
+      intScriptBits();
+      s->run_state = PI_SCRIPT_RUNNING;
+   }
+
+   pthread_mutex_unlock(&s->pthMutex);
+
+   return s->changedBits;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int scrSys(char *cmd, uint32_t p1, uint32_t p2)
+{
+   char buf[256];
+   char pars[40];
+
+   sprintf(pars, " %u %u", p1, p2);
+   strcpy(buf, "/opt/pigpio/cgi/");
+   strncat(buf, cmd, 200);
+   strcat(buf, pars);
+
+   DBG(DBG_USER, "sys %s", buf);
+
+   return system(buf);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int *scrBind(gpioScript_t *s, scrOp_t *op, int n, int reg)
+{
+   int v;
+
+   /*
+      Return where operand n is to be read from.  A register operand
+      always names a var or par.  Any other operand may be a constant.
+   */
+
+   v = op->instr->p[n];
+
+   op->imm[n] = v;
+
+   if      (op->instr->opt[n] == CMD_PAR) return &s->script.par[v];
+   else if (op->instr->opt[n] == CMD_VAR) return &s->script.var[v];
+   else if (reg)                          return &s->script.var[v];
+   else                                   return &op->imm[n];
+}
+
+/* ----------------------------------------------------------------------- */
+
+static scrOp_t *scrCompile(gpioScript_t *s)
+{
+   scrOp_t *code, *op;
+   int i, cmd, reg1, reg2;
+
+   code = calloc(s->script.instrs + 1, sizeof(scrOp_t));
+
+   if (code == NULL) return NULL;
+
+   for (i=0; i<s->script.instrs; i++)
+   {
+      op = &code[i];
+
+      op->instr = &s->script.instr[i];
+
+      cmd = op->instr->p[0];
+
+      reg1 = 0;
+      reg2 = 0;
+
+      switch (cmd)
+      {
+         case PI_CMD_WRITE: op->op = SCR_OP_W;    break;
+         case PI_CMD_READ:  op->op = SCR_OP_R;    break;
+         case PI_CMD_MICS:  op->op = SCR_OP_MICS; break;
+         case PI_CMD_MILS:  op->op = SCR_OP_MILS; break;
+
+         case PI_CMD_CMDR:
+         case PI_CMD_CMDW:
+         case PI_CMD_NOP:   op->op = SCR_OP_NOP;  break;
+
+         case PI_CMD_DCR:
+         case PI_CMD_INR:
+         case PI_CMD_LD:
+         case PI_CMD_POP:
+         case PI_CMD_PUSH:
+         case PI_CMD_RL:
+         case PI_CMD_RR:
+         case PI_CMD_STA:
+         case PI_CMD_XA:
+            reg1 = 1;
+            op->op = SCR_OP(cmd);
+            break;
+
+         case PI_CMD_X:
+            reg1 = 1;
+            reg2 = 1;
+            op->op = SCR_OP(cmd);
+            break;
+
+         default:
+            if (cmd < PI_CMD_SCRIPT) op->op = SCR_OP_CMD;
+            else if (cmd < (PI_CMD_XOR+1)) op->op = SCR_OP(cmd);
+            else
+            {
+               free(code);
+               return NULL;
+            }
+      }
+
+      op->p1 = scrBind(s, op, 1, reg1);
+      op->p2 = scrBind(s, op, 2, reg2);
+   }
+
+   return code;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void scrExecute(gpioScript_t *s, int *S, char *buf)
+{
+   static void *handler[SCR_OPS] =
+   {
+      [SCR_OP_CMD]            = &&doCMD,
+      [SCR_OP_W]              = &&doW,
+      [SCR_OP_R]              = &&doR,
+      [SCR_OP_MICS]           = &&doMICS,
+      [SCR_OP_MILS]           = &&doMILS,
+      [SCR_OP_NOP]            = &&doNOP,
+      [SCR_OP(PI_CMD_ADD)]    = &&doADD,
+      [SCR_OP(PI_CMD_AND)]    = &&doAND,
+      [SCR_OP(PI_CMD_CALL)]   = &&doCALL,
+      [SCR_OP(PI_CMD_CMDR)]   = &&doNOP,
+      [SCR_OP(PI_CMD_CMDW)]   = &&doNOP,
+      [SCR_OP(PI_CMD_CMP)]    = &&doCMP,
+      [SCR_OP(PI_CMD_DCR)]    = &&doDCR,
+      [SCR_OP(PI_CMD_DCRA)]   = &&doDCRA,
+      [SCR_OP(PI_CMD_DIV)]    = &&doDIV,
+      [SCR_OP(PI_CMD_HALT)]   = &&doHALT,
+      [SCR_OP(PI_CMD_INR)]    = &&doINR,
+      [SCR_OP(PI_CMD_INRA)]   = &&doINRA,
+      [SCR_OP(PI_CMD_JM)]     = &&doJM,
+      [SCR_OP(PI_CMD_JMP)]    = &&doJMP,
+      [SCR_OP(PI_CMD_JNZ)]    = &&doJNZ,
+      [SCR_OP(PI_CMD_JP)]     = &&doJP,
+      [SCR_OP(PI_CMD_JZ)]     = &&doJZ,
+      [SCR_OP(PI_CMD_TAG)]    = &&doNOP,
+      [SCR_OP(PI_CMD_LD)]     = &&doLD,
+      [SCR_OP(PI_CMD_LDA)]    = &&doLDA,
+      [SCR_OP(PI_CMD_LDAB)]   = &&doLDAB,
+      [SCR_OP(PI_CMD_MLT)]    = &&doMLT,
+      [SCR_OP(PI_CMD_MOD)]    = &&doMOD,
+      [SCR_OP(PI_CMD_NOP)]    = &&doNOP,
+      [SCR_OP(PI_CMD_OR)]     = &&doOR,
+      [SCR_OP(PI_CMD_POP)]    = &&doPOP,
+      [SCR_OP(PI_CMD_POPA)]   = &&doPOPA,
+      [SCR_OP(PI_CMD_PUSH)]   = &&doPUSH,
+      [SCR_OP(PI_CMD_PUSHA)]  = &&doPUSHA,
+      [SCR_OP(PI_CMD_RET)]    = &&doRET,
+      [SCR_OP(PI_CMD_RL)]     = &&doRL,
+      [SCR_OP(PI_CMD_RLA)]    = &&doRLA,
+      [SCR_OP(PI_CMD_RR)]     = &&doRR,
+      [SCR_OP(PI_CMD_RRA)]    = &&doRRA,
+      [SCR_OP(PI_CMD_STA)]    = &&doSTA,
+      [SCR_OP(PI_CMD_STAB)]   = &&doSTAB,
+      [SCR_OP(PI_CMD_SUB)]    = &&doSUB,
+      [SCR_OP(PI_CMD_SYS)]    = &&doSYS,
+      [SCR_OP(PI_CMD_WAIT)]   = &&doWAIT,
+      [SCR_OP(PI_CMD_X)]      = &&doX,
+      [SCR_OP(PI_CMD_XA)]     = &&doXA,
+      [SCR_OP(PI_CMD_XOR)]    = &&doXOR,
+   };
+
+   scrOp_t *code, *op;
+   uint32_t p[CMD_P_ARR];
+   int A, F, SP, i, v;
+   unsigned PC, instrs;
+
+   code   = s->code;
+   instrs = s->script.instrs;
+
+   for (i=0; i<instrs; i++) code[i].label = handler[code[i].op];
+
+   A  = 0;
+   F  = 0;
+   SP = 0;
+   PC = 0;
+
+   /*
+      Each handler ends by jumping straight to the handler of the
+      next operation.  The stop request is still seen every step.
+   */
+
+#define SCR_GOTO(pc)                                               \
+   do {                                                            \
+      PC = (pc);                                                   \
+      if (PC >= instrs) {s->run_state = PI_SCRIPT_HALTED; return;} \
+      if (((volatile int)s->request != PI_SCRIPT_RUN) ||           \
+          (s->run_state != PI_SCRIPT_RUNNING)) return;             \
+      op = &code[PC];                                              \
+      goto *op->label;                                             \
+   } while (0)
+
+#define SCR_NEXT SCR_GOTO(PC+1)
+
+   SCR_GOTO(0);
+
+doCMD:
+   memcpy(p, op->instr->p, sizeof(op->instr->p));
+   p[1] = *op->p1;
+   p[2] = *op->p2;
+   if (p[3]) memcpy(buf, s->script.str_area + p[4], p[3]);
+   A = myDoCommand(p, CMD_MAX_EXTENSION-1, buf); F = A;
+   SCR_NEXT;
+
+doW:
+   v = *op->p1;
+   if (myPermit(v)) A = gpioWrite(v, *op->p2);
+   else
+   {
+      DBG(DBG_USER, "gpioWrite: gpio %d, no permission to update", v);
+      A = PI_NOT_PERMITTED;
+   }
+   F = A;
+   SCR_NEXT;
+
+doR:     A = gpioRead(*op->p1); F = A;                            SCR_NEXT;
+
+doMICS:
+   v = *op->p1;
+   if ((uint32_t)v <= PI_MAX_MICS_DELAY) {myGpioDelay(v); A = 0;}
+   else A = PI_BAD_MICS_DELAY;
+   F = A;
+   SCR_NEXT;
+
+doMILS:
+   v = *op->p1;
+   if ((uint32_t)v <= PI_MAX_MILS_DELAY) {myGpioDelay(v * 1000); A = 0;}
+   else A = PI_BAD_MILS_DELAY;
+   F = A;
+   SCR_NEXT;
+
+doNOP:                                                            SCR_NEXT;
+
+doADD:   A += *op->p1; F = A;                                     SCR_NEXT;
+doAND:   A &= *op->p1; F = A;                                     SCR_NEXT;
+doCALL:  scrPush(s, &SP, S, PC+1);                       SCR_GOTO(*op->p1);
+doCMP:   F = A - *op->p1;                                         SCR_NEXT;
+doDCR:   F = --(*op->p1);                                         SCR_NEXT;
+doDCRA:  F = --A;                                                 SCR_NEXT;
+doDIV:   A /= *op->p1; F = A;                                     SCR_NEXT;
+doHALT:  s->run_state = PI_SCRIPT_HALTED;                           return;
+doINR:   F = ++(*op->p1);                                         SCR_NEXT;
+doINRA:  F = ++A;                                                 SCR_NEXT;
+doJM:    if (F < 0)  SCR_GOTO(*op->p1);                           SCR_NEXT;
+doJMP:   SCR_GOTO(*op->p1);
+doJNZ:   if (F)      SCR_GOTO(*op->p1);                           SCR_NEXT;
+doJP:    if (F >= 0) SCR_GOTO(*op->p1);                           SCR_NEXT;
+doJZ:    if (!F)     SCR_GOTO(*op->p1);                           SCR_NEXT;
+doLD:    *op->p1 = *op->p2;                                       SCR_NEXT;
+doLDA:   A = *op->p1;                                             SCR_NEXT;
+
+doLDAB:
+   v = *op->p1;
+   if ((v >= 0) && (v < CMD_MAX_EXTENSION)) A = buf[v];
+   SCR_NEXT;
+
+doMLT:   A *= *op->p1; F = A;                                     SCR_NEXT;
+doMOD:   A %= *op->p1; F = A;                                     SCR_NEXT;
+doOR:    A |= *op->p1; F = A;                                     SCR_NEXT;
+doPOP:   *op->p1 = scrPop(s, &SP, S);                             SCR_NEXT;
+doPOPA:  A = scrPop(s, &SP, S);                                   SCR_NEXT;
+doPUSH:  scrPush(s, &SP, S, *op->p1);                             SCR_NEXT;
+doPUSHA: scrPush(s, &SP, S, A);                                   SCR_NEXT;
+doRET:   SCR_GOTO(scrPop(s, &SP, S));
+doRL:    *op->p1 <<= *op->p2; F = *op->p1;                        SCR_NEXT;
+doRLA:   A <<= *op->p1; F = A;                                    SCR_NEXT;
+doRR:    *op->p1 >>= *op->p2; F = *op->p1;                        SCR_NEXT;
+doRRA:   A >>= *op->p1; F = A;                                    SCR_NEXT;
+doSTA:   *op->p1 = A;                                             SCR_NEXT;
+
+doSTAB:
+   v = *op->p1;
+   if ((v >= 0) && (v < CMD_MAX_EXTENSION)) buf[v] = A;
+   SCR_NEXT;
+
+doSUB:   A -= *op->p1; F = A;                                     SCR_NEXT;
+
+doSYS:
+   A = scrSys(s->script.str_area + op->instr->p[4], A, *(gpioReg + GPLEV0));
+   F = A;
+   SCR_NEXT;
+
+doWAIT:  A = scrWait(s, *op->p1); F = A;                          SCR_NEXT;
+doX:     scrSwap(op->p1, op->p2);                                 SCR_NEXT;
+doXA:    scrSwap(op->p1, &A);                                     SCR_NEXT;
+doXOR:   A ^= *op->p1; F = A;                                     SCR_NEXT;
+
+#undef SCR_NEXT
+#undef SCR_GOTO
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void *pthScript(void *x)
+{
+   gpioScript_t *s;
+   cmdInstr_t instr;
+   int p1, p2, p1o, p2o, *t1, *t2;
+   int PC, A, F, SP;
+   int S[PI_SCRIPT_STACK_SIZE];
+   char buf[CMD_MAX_EXTENSION];
+
+
+   S[0] = 0; /* to prevent compiler warning */
+
+   s = x;
+
+   while ((volatile int)s->request != PI_SCRIPT_DELETE)
+   {
+      pthread_mutex_lock(&s->pthMutex);
+      s->run_state = PI_SCRIPT_HALTED;
+      pthread_cond_wait(&s->pthCond, &s->pthMutex);
+      pthread_mutex_unlock(&s->pthMutex);
+
+      s->run_state = PI_SCRIPT_RUNNING;
+
+      /* a compiled script has finished before the loop below */
+
+      if (s->code) scrExecute(s, S, buf);
+
+      A  = 0;
+      F  = 0;
+      PC = 0;
+      SP = 0;
+
+      while (((volatile int)s->request   == PI_SCRIPT_RUN    ) &&
+                           (s->run_state == PI_SCRIPT_RUNNING))
+      {
+         instr = s->script.instr[PC];
+
+         p1o = instr.p[1];
+         p2o = instr.p[2];
+
+         if      (instr.opt[1] == CMD_VAR) instr.p[1] = s->script.var[p1o];
+         else if (instr.opt[1] == CMD_PAR) instr.p[1] = s->script.par[p1o];
+
+         if      (instr.opt[2] == CMD_VAR) instr.p[2] = s->script.var[p2o];
+         else if (instr.opt[2] == CMD_PAR) instr.p[2] = s->script.par[p2o];
+/*
+         fprintf(stderr, "PC=%d cmd=%d p1o=%d p1=%d p2o=%d p2=%d\n",
+            PC, instr.p[0], p1o, instr.p[1], p2o, instr.p[2]);
+         fflush(stderr);
+*/
+         if (instr.p[0] < PI_CMD_SCRIPT)
+         {
+            if (instr.p[3])
+            {
+               memcpy(buf, s->script.str_area + instr.p[4], instr.p[3]);
+            }
+
+            A = myDoCommand(instr.p, sizeof(buf)-1, buf);
+
+            F = A;
+
+            PC++;
+         }
+         else
+         {
+            p1 = instr.p[1];
+            p2 = instr.p[2];
+
+            switch (instr.p[0])
+            {
+               case PI_CMD_ADD:   A+=p1; F=A;                     PC++; break;
+
+               case PI_CMD_AND:   A&=p1; F=A;                     PC++; break;
+
+               case PI_CMD_CALL:  scrPush(s, &SP, S, PC+1);    PC = p1; break;
+
+               case PI_CMD_CMP:   F=A-p1;                         PC++; break;
+
+               case PI_CMD_DCR:
+                  if (instr.opt[1] == CMD_PAR)
+                     {--s->script.par[p1o]; F=s->script.par[p1o];}
+                  else
+                     {--s->script.var[p1o]; F=s->script.var[p1o];}
+                  PC++;
+                  break;
+
+               case PI_CMD_DCRA:  --A; F=A;                       PC++; break;
+
+               case PI_CMD_DIV:   A/=p1; F=A;                     PC++; break;
+
+               case PI_CMD_HALT: s->run_state = PI_SCRIPT_HALTED;       break;
+
+               case PI_CMD_INR:
+                  if (instr.opt[1] == CMD_PAR)
+                     {++s->script.par[p1o]; F=s->script.par[p1o];}
+                  else
+                     {++s->script.var[p1o]; F=s->script.var[p1o];}
+                  PC++;
+                  break;
+
+               case PI_CMD_INRA:  ++A; F=A;                       PC++; break;
+
+               case PI_CMD_JM:    if (F<0)  PC=p1; else PC++;           break;
+
+               case PI_CMD_JMP:   PC=p1;                                break;
+
+               case PI_CMD_JNZ:   if (F)    PC=p1; else PC++;           break;
+
+               case PI_CMD_JP:    if (F>=0) PC=p1; else PC++;           break;
+
+               case PI_CMD_JZ:    if (!F)   PC=p1; else PC++;           break;
+
+               case PI_CMD_LD:
+                  if (instr.opt[1] == CMD_PAR) s->script.par[p1o]=p2;
+                  else                         s->script.var[p1o]=p2;
+                  PC++;
+                  break;
+
+               case PI_CMD_LDA:   A=p1;                           PC++; break;
+
+               case PI_CMD_LDAB:
+                  if ((p1 >= 0) && (p1 < sizeof(buf))) A = buf[p1];
+                  PC++;
+                  break;
+
+               case PI_CMD_MLT:   A*=p1; F=A;                     PC++; break;
+
+               case PI_CMD_MOD:   A%=p1; F=A;                     PC++; break;
+
+               case PI_CMD_OR:    A|=p1; F=A;                     PC++; break;
+
+               case PI_CMD_POP:
+                  if (instr.opt[1] == CMD_PAR)
+                     s->script.par[p1o]=scrPop(s, &SP, S);
+                  else
+                     s->script.var[p1o]=scrPop(s, &SP, S);
+                  PC++;
+                  break;
+
+               case PI_CMD_POPA:  A=scrPop(s, &SP, S);            PC++; break;
+
+               case PI_CMD_PUSH:
+                  if (instr.opt[1] == CMD_PAR)
+                     scrPush(s, &SP, S, s->script.par[p1o]);
+                  else
+                     scrPush(s, &SP, S, s->script.var[p1o]);
+                  PC++;
+                  break;
+
+               case PI_CMD_PUSHA: scrPush(s, &SP, S, A);          PC++; break;
+
+               case PI_CMD_RET:   PC=scrPop(s, &SP, S);                 break;
+
+               case PI_CMD_RL:
+                  if (instr.opt[1] == CMD_PAR)
+                     {s->script.par[p1o]<<=p2; F=s->script.par[p1o];}
+                  else
+                     {s->script.var[p1o]<<=p2; F=s->script.var[p1o];}
+                  PC++;
+                  break;
+
+               case PI_CMD_RLA:   A<<=p1; F=A;                    PC++; break;
+
+               case PI_CMD_RR:
+                  if (instr.opt[1] == CMD_PAR)
+                     {s->script.par[p1o]>>=p2; F=s->script.par[p1o];}
+                  else
+                     {s->script.var[p1o]>>=p2; F=s->script.var[p1o];}
+                  PC++;
+                  break;
+
+               case PI_CMD_RRA:   A>>=p1; F=A;                    PC++; break;
+
+               case PI_CMD_STA:
+                  if (instr.opt[1] == CMD_PAR) s->script.par[p1o]=A;
+                  else                         s->script.var[p1o]=A;
+                  PC++;
+                  break;
+
+               case PI_CMD_STAB:
+                  if ((p1 >= 0) && (p1 < sizeof(buf))) buf[p1] = A;
+                  PC++;
+                  break;
+
+               case PI_CMD_SUB:   A-=p1; F=A;                     PC++; break;
+
+               case PI_CMD_SYS:
+                  A=scrSys(s->script.str_area + instr.p[4], A,
+                     *(gpioReg + GPLEV0));
+                  F=A;
+                  PC++;
+                  break;
+
+               case PI_CMD_WAIT:  A=scrWait(s, p1); F=A;          PC++; break;
+
+               case PI_CMD_X:
+                  if (instr.opt[1] == CMD_PAR) t1 = &s->script.par[p1o];
+                  else                         t1 = &s->script.var[p1o];
+
+                  if (instr.opt[2] == CMD_PAR) t2 = &s->script.par[p2o];
+                  else                         t2 = &s->script.var[p2o];
+
+                  scrSwap(t1, t2);
+                  PC++;
+                  break;
+
+               case PI_CMD_XA:
+                  if (instr.opt[1] == CMD_PAR)
+                     scrSwap(&s->script.par[p1o], &A);
+                  else
+                     scrSwap(&s->script.var[p1o], &A);
+                  PC++;
+                  break;
+
+               case PI_CMD_XOR:   A^=p1; F=A;                     PC++; break;
+
+            }
+         }
+
+         if (PC >= s->script.instrs) s->run_state = PI_SCRIPT_HALTED;
+
+      }
+
+      if ((volatile int)s->request == PI_SCRIPT_HALT)
+         s->run_state = PI_SCRIPT_HALTED;
+
+   }
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/*
+Timers share one hierarchical timer wheel.  Level 0 has a list for each
+TW_TICK_MICROS tick, each higher level a list for every TW_SLOTS ticks
+of the level below.  Timers cascade down a level as they come due.
+One thread sleeps on a CLOCK_MONOTONIC timerfd until the next tick
+with work, so wall clock steps have no effect.
+
+The lists are linked through gpioTimer[].  Call with twMutex held.
+*/
+
+static uint64_t twMicros(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ((uint64_t)ts.tv_sec * MILLION) + (ts.tv_nsec / THOUSAND);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void twUnlink(int t)
+{
+   gpioTimer_t *tp = &gpioTimer[t];
+   int list;
+
+   list = tp->list;
+
+   if (list == TW_NONE) return;
+
+   if (tp->prev != TW_NONE) gpioTimer[tp->prev].next = tp->next;
+   else                     twHead[list] = tp->next;
+
+   if (tp->next != TW_NONE) gpioTimer[tp->next].prev = tp->prev;
+
+   if ((twHead[list] == TW_NONE) && (list < TW_DUE))
+      twBits[list/TW_SLOTS][(list%TW_SLOTS)/32] &= ~(1U<<(list%32));
+
+   tp->list = TW_NONE;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void twLink(int t, int list)
+{
+   gpioTimer_t *tp = &gpioTimer[t];
+
+   tp->list = list;
+   tp->prev = TW_NONE;
+   tp->next = twHead[list];
+
+   if (tp->next != TW_NONE) gpioTimer[tp->next].prev = t;
+
+   twHead[list] = t;
+
+   if (list < TW_DUE)
+      twBits[list/TW_SLOTS][(list%TW_SLOTS)/32] |= (1U<<(list%32));
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void twAdd(int t)
+{
+   uint64_t expires, delta;
+   int level;
+
+   expires = (gpioTimer[t].due + TW_TICK_MICROS - 1) / TW_TICK_MICROS;
+
+   if (expires < twNext) expires = twNext;
+
+   delta = expires - twNext;
+
+   for (level=0; level<(TW_LEVELS-1); level++)
+   {
+      if (delta < (1ULL << (TW_BITS * (level+1)))) break;
+   }
+
+   twLink(t, (level * TW_SLOTS) + ((expires >> (TW_BITS * level)) & TW_MASK));
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int twLevelEmpty(int level)
+{
+   int i;
+
+   for (i=0; i<(TW_SLOTS/32); i++) if (twBits[level][i]) return 0;
+
+   return 1;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* moves the timers due by tick to the TW_DUE list */
+
+static void twAdvance(uint64_t tick)
+{
+   int level, list, t;
+
+   while (twNext <= tick)
+   {
+      if ((twNext & TW_MASK) == 0)
+      {
+         for (level=1; level<TW_LEVELS; level++)
+         {
+            list = (level * TW_SLOTS) +
+               ((twNext >> (TW_BITS * level)) & TW_MASK);
+
+            while ((t = twHead[list]) != TW_NONE)
+            {
+               twUnlink(t);
+               twAdd(t);
+            }
+
+            if ((twNext >> (TW_BITS * level)) & TW_MASK) break;
+         }
+      }
+      else if (twLevelEmpty(0))
+      {
+         /* nothing due before the next cascade */
+
+         if ((twNext | TW_MASK) < tick) twNext = (twNext | TW_MASK) + 1;
+         else                           twNext = tick + 1;
+
+         continue;
+      }
+
+      list = twNext & TW_MASK;
+
+      while ((t = twHead[list]) != TW_NONE)
+      {
+         twUnlink(t);
+         twLink(t, TW_DUE);
+      }
+
+      twNext++;
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* sets the timerfd for the next tick with work */
+
+static void twArm(void)
+{
+   struct itimerspec its;
+   uint64_t tick, wake;
+   int idx, i, b;
+
+   memset(&its, 0, sizeof(its));
+
+   if (twActive)
+   {
+      idx = twNext & TW_MASK;
+
+      /* next cascade, twNext itself if its cascade is still to be done */
+
+      tick = (twNext + TW_MASK) & ~(uint64_t)TW_MASK;
+
+      /*
+      The earliest busy level 0 slot before the cascade.  Slots past
+      the end of the wheel are a turn later, after the cascade.
+      */
+
+      if (!twLevelEmpty(0))
+      {
+         for (i=0; (twNext + i) < tick; i++)
+         {
+            b = idx + i;
+
+            if (twBits[0][b/32] & (1U<<(b%32)))
+            {
+               tick = twNext + i;
+               break;
+            }
+         }
+      }
+
+      wake = tick * TW_TICK_MICROS;
+
+      its.it_value.tv_sec  = wake / MILLION;
+      its.it_value.tv_nsec = (wake % MILLION) * THOUSAND;
+   }
+
+   timerfd_settime(twFd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void * pthTimerThread(void *x)
+{
+   gpioTimer_t *tp;
+   uint64_t expirations, now, late, missed;
+   callbk_t func;
+   unsigned ex;
+   void *userdata;
+   int t, state;
+
+   while (1)
+   {
+      read(twFd, &expirations, sizeof(expirations));
+
+      /* don't allow cancellation while holding the mutex */
+
+      pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+
+      pthread_mutex_lock(&twMutex);
+
+      gpioStats.timerWakeups++;
+
+      twAdvance(twMicros() / TW_TICK_MICROS);
+
+      while ((t = twHead[TW_DUE]) != TW_NONE)
+      {
+         tp = &gpioTimer[t];
+
+         twUnlink(t);
+
+         now = twMicros();
+
+         if (now > tp->due) late = now - tp->due; else late = 0;
+
+         tp->runs++;
+         tp->lateTotal += late;
+         if (late > tp->lateMax) tp->lateMax = late;
+
+         gpioStats.timerRuns++;
+         if (late > gpioStats.timerLateMax) gpioStats.timerLateMax = late;
+
+         if (!tp->oneshot)
+         {
+            /* keep to the original schedule, skipping missed periods */
+
+            tp->due += tp->micros;
+
+            if (tp->due <= now)
+            {
+               missed = ((now - tp->due) / tp->micros) + 1;
+
+               tp->due += (missed * tp->micros);
+               tp->overruns += missed;
+               gpioStats.timerOverruns += missed;
+            }
+
+            twAdd(t);
+         }
+
+         func     = tp->func;
+         ex       = tp->ex;
+         userdata = tp->userdata;
+
+         twCalling = t;
+
+         pthread_mutex_unlock(&twMutex);
+
+         pthread_setcancelstate(state, NULL);
+
+         if (gpioCfg.dbgLevel >= DBG_SLOW_TICK)
+         {
+            if ((tp->micros > 50000) || (gpioCfg.dbgLevel >= DBG_FAST_TICK))
+            {
+               fprintf(stderr, "pigpio: TIMER=%d @ %llu late %llu\n",
+                  t, (unsigned long long)now, (unsigned long long)late);
+            }
+         }
+
+         if (ex) (func)(userdata);
+         else    (func)();
+
+         pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+
+         pthread_mutex_lock(&twMutex);
+
+         twCalling = TW_NONE;
+
+         /* a one-shot timer is released once called */
+
+         if (tp->oneshot && tp->running && (tp->list == TW_NONE))
+         {
+            tp->running = 0;
+            tp->func    = NULL;
+            twActive--;
+         }
+
+         pthread_cond_broadcast(&twCond);
+      }
+
+      twArm();
+
+      pthread_mutex_unlock(&twMutex);
+
+      pthread_setcancelstate(state, NULL);
+   }
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int twStart(void)
+{
+   pthread_attr_t pthAttr;
+
+   twFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+
+   if (twFd < 0)
+      SOFT_ERROR(PI_TIMER_FAILED, "timerfd_create failed (%m)");
+
+   twNext = twMicros() / TW_TICK_MICROS;
+
+   if (pthread_attr_init(&pthAttr) ||
+       pthread_attr_setstacksize(&pthAttr, STACK_SIZE) ||
+       pthread_create(&pthTimer, &pthAttr, pthTimerThread, NULL))
+   {
+      close(twFd);
+      twFd = -1;
+      SOFT_ERROR(PI_TIMER_FAILED, "timer thread failed (%m)");
+   }
+
+   pthTimerRunning = 1;
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void twStop(void)
+{
+   int i;
+
+   if (pthTimerRunning)
+   {
+      pthread_cancel(pthTimer);
+      pthread_join(pthTimer, NULL);
+      pthTimerRunning = 0;
+
+      close(twFd);
+      twFd = -1;
+   }
+
+   for (i=0; i<PI_TIMER_SLOTS; i++)
+   {
+      gpioTimer[i].running = 0;
+      gpioTimer[i].func    = NULL;
+      gpioTimer[i].list    = TW_NONE;
+   }
+
+   for (i=0; i<TW_LISTS; i++) twHead[i] = TW_NONE;
+
+   memset(twBits, 0, sizeof(twBits));
+
+   twActive  = 0;
+   twCalling = TW_NONE;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* call with twMutex held */
+
+static int twSet(
+   int t, uint32_t micros, int oneshot, void *f, int user, void *userdata)
+{
+   gpioTimer_t *tp = &gpioTimer[t];
+
+   if (!pthTimerRunning && twStart()) return PI_TIMER_FAILED;
+
+   if (!twActive) twNext = twMicros() / TW_TICK_MICROS;
+
+   if (tp->running)
+   {
+      twUnlink(t);
+   }
+   else
+   {
+      tp->running   = 1;
+      tp->runs      = 0;
+      tp->overruns  = 0;
+      tp->lateMax   = 0;
+      tp->lateTotal = 0;
+
+      twActive++;
+   }
+
+   tp->id       = t;
+   tp->func     = f;
+   tp->ex       = user;
+   tp->userdata = userdata;
+   tp->oneshot  = oneshot;
+   tp->micros   = micros;
+   tp->due      = twMicros() + micros;
+
+   twAdd(t);
+
+   twArm();
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* call with twMutex held */
+
+static void twCancel(int t)
+{
+   gpioTimer_t *tp = &gpioTimer[t];
+
+   if (tp->running)
+   {
+      twUnlink(t);
+
+      tp->running = 0;
+      tp->func    = NULL;
+
+      twActive--;
+   }
+
+   /* unless called from the callback itself wait for it to finish */
+
+   if (pthTimerRunning && !pthread_equal(pthread_self(), pthTimer))
+   {
+      while (twCalling == t) pthread_cond_wait(&twCond, &twMutex);
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+
+static void * pthFifoThread(void *x)
+{
+   char buf[CMD_MAX_EXTENSION];
+   int idx, flags, len, res, i;
+   uint32_t p[CMD_P_ARR];
+   cmdCtlParse_t ctl;
+   uint32_t *param;
+   char v[CMD_MAX_EXTENSION];
+
+   myCreatePipe(PI_INPFIFO, 0662);
+
+   if ((inpFifo = fopen(PI_INPFIFO, "r+")) == NULL)
+      SOFT_ERROR((void*)PI_INIT_FAILED, "fopen %s failed(%m)", PI_INPFIFO);
+
+   myCreatePipe(PI_OUTFIFO, 0664);
+
+   if ((outFifo = fopen(PI_OUTFIFO, "w+")) == NULL)
+      SOFT_ERROR((void*)PI_INIT_FAILED, "fopen %s failed (%m)", PI_OUTFIFO);
+
+   /* set outFifo non-blocking */
+
+   flags = fcntl(fileno(outFifo), F_GETFL, 0);
+   fcntl(fileno(outFifo), F_SETFL, flags | O_NONBLOCK);
+
+   /* don't start until DMA started */
+
+   spinWhileStarting();
+
+   while (1)
+   {
+      if (fgets(buf, sizeof(buf), inpFifo) == NULL)
+         SOFT_ERROR((void*)PI_INIT_FAILED, "fifo fgets failed (%m)");
+
+      len = strlen(buf);
+
+      if (len)
+      {
+        --len;
+        buf[len] = 0; /* replace terminating */
+      }
+
+      ctl.eaten = 0;
+      idx = 0;
+
+      while (((ctl.eaten)<len) && (idx >= 0))
+      {
+         if ((idx=cmdParse(buf, p, CMD_MAX_EXTENSION, v, &ctl)) >= 0)
+         {
+            /* make sure extensions are null terminated */
+
+            v[p[3]] = 0;
+
+            res = myDoCommand(p, sizeof(v)-1, v);
+
+            switch (cmdInfo[idx].rv)
+            {
+               case 0:
+                  fprintf(outFifo, "%d\n", res);
+                  break;
+
+               case 1:
+                  fprintf(outFifo, "%d\n", res);
+                  break;
+
+               case 2:
+                  fprintf(outFifo, "%d\n", res);
+                  break;
+
+               case 3:
+                  fprintf(outFifo, "%08X\n", res);
+                  break;
+
+               case 4:
+                  fprintf(outFifo, "%u\n", res);
+                  break;
+
+               case 5:
+                  fprintf(outFifo, cmdUsage);
+                  break;
+
+               case 6:
+                  fprintf(outFifo, "%d", res);
+                  if (res > 0)
+                  {
+                     for (i=0; i<res; i++)
+                     {
+                        fprintf(outFifo, " %d", v[i]);
+                     }
+                  }
+                  fprintf(outFifo, "\n");
+                  break;
+
+               case 7:
+                  if (res < 0) fprintf(outFifo, "%d\n", res);
+                  else
+                  {
+                     fprintf(outFifo, "%d", res);
+                     param = (uint32_t *)v;
+                     for (i=0; i<PI_MAX_SCRIPT_PARAMS; i++)
+                     {
+                        fprintf(outFifo, " %d", param[i]);
+                     }
+                     fprintf(outFifo, "\n");
+                  }
+                  break;
+            }
+         }
+         else fprintf(outFifo, "%d\n", PI_BAD_FIFO_COMMAND);
+      }
+
+      fflush(outFifo);
+   }
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int sockWrite(int sock, void *data, unsigned count)
+{
+   struct pollfd pfd;
+   char *ptr = data;
+   int err;
+
+   while (count)
+   {
+      err = send(sock, ptr, count, MSG_NOSIGNAL);
+
+      if (err < 0)
+      {
+         if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+            return -1;
+
+         /* client not reading, wait for room */
+
+         pfd.fd     = sock;
+         pfd.events = POLLOUT;
+
+         if (poll(&pfd, 1, SOCK_WRITE_MS) == 0)
+         {
+            DBG(DBG_ALWAYS, "socket %d write timed out", sock);
+            return -1;
+         }
+      }
+      else
+      {
+         ptr   += err;
+         count -= err;
+      }
+   }
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void sockDoCommand(sockClient_t *c, uint32_t *p, char *buf)
+{
+   if (p[0] == PI_CMD_PWMB)
+   {
+      /* the held changes are applied if the client goes first */
+
+      p[3] = pwmBegin(c);
+   }
+   else if (p[0] == PI_CMD_PROCP)
+   {
+      p[3] = myDoCommand(p, CMD_MAX_EXTENSION-1, buf+sizeof(int));
+      if (((int)p[3]) >= 0)
+      {
+         memcpy(buf, &p[3], 4);
+         p[3] = 4 + (4*PI_MAX_SCRIPT_PARAMS);
+      }
+   }
+   else p[3] = myDoCommand(p, CMD_MAX_EXTENSION-1, buf);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int sockBatch(sockClient_t *c)
+{
+   uint32_t *p = c->p;
+   uint32_t sp[CMD_P_ARR];
+   char *cmdBuf, *rep, *tmp;
+   unsigned pos, len, size, extLen;
+   int i, count, err;
+
+   count = 0;
+   len   = 0;
+   size  = 4096;
+   err   = 0;
+
+   cmdBuf = malloc(CMD_MAX_EXTENSION);
+   rep    = malloc(size);
+
+   if ((cmdBuf == NULL) || (rep == NULL)) err = PI_NO_MEMORY;
+
+   pos = 0;
+
+   for (i=0; (i<p[1]) && !err; i++)
+   {
+      if ((pos + 16) > p[3]) {err = PI_BAD_BATCH; break;}
+
+      memset(sp, 0, sizeof(sp));
+      memcpy(sp, c->buf + pos, 16);
+      pos += 16;
+
+      extLen = sp[3];
+
+      if ((extLen > (p[3] - pos)) ||
+          (sp[0] == PI_CMD_NOIB)  ||
+          (sp[0] == PI_CMD_BATCH)) {err = PI_BAD_BATCH; break;}
+
+      memcpy(cmdBuf, c->buf + pos, extLen);
+      cmdBuf[extLen] = 0;
+      pos += extLen;
+
+      sockDoCommand(c, sp, cmdBuf);
+
+      if (cmdReplyExt(sp[0]) && (((int)sp[3]) > 0)) extLen = sp[3];
+      else                                          extLen = 0;
+
+      while ((len + 16 + extLen) > size)
+      {
+         size *= 2;
+         tmp = realloc(rep, size);
+         if (tmp == NULL) {err = PI_NO_MEMORY; break;}
+         rep = tmp;
+      }
+
+      if (err) break;
+
+      memcpy(rep + len, sp, 16);
+      memcpy(rep + len + 16, cmdBuf, extLen);
+      len += (16 + extLen);
+
+      count++;
+   }
+
+   p[1] = count;
+
+   if (err) p[3] = err; else p[3] = len;
+
+   err = sockWrite(c->fd, p, 16);
+
+   if (!err && (((int)p[3]) > 0)) err = sockWrite(c->fd, rep, len);
+
+   free(cmdBuf);
+   free(rep);
+
+   return err;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int sockExecute(sockClient_t *c)
+{
+   uint32_t *p = c->p;
+   char *buf = c->buf;
+   int opt;
+
+   /* add null terminator in case it's a string */
+
+   buf[p[3]] = 0;
+
+   switch (p[0])
+   {
+      case PI_CMD_BATCH:
+
+         return sockBatch(c);
+
+      case PI_CMD_NOIB:
+
+         p[3] = gpioNotifyOpenInBand(c->fd);
+
+         if (((int)p[3]) >= 0) c->handle = p[3];
+
+         /*
+         p1 is the format wanted, p2 in the reply is the format given.
+         Earlier daemons echo p2, which clients send as 0.
+         */
+
+         p[2] = 0;
+
+         if ((((int)p[3]) >= 0) && p[1] &&
+             (gpioNotifyFormat(p[3], p[1] & PI_NOTIFY_FORMATS) == 0))
+            p[2] = p[1] & PI_NOTIFY_FORMATS;
+
+        /* Enable the Nagle algorithm. */
+         opt = 0;
+         setsockopt(
+            c->fd, IPPROTO_TCP, TCP_NODELAY, (char*)&opt, sizeof(int));
+
+         break;
+
+      default:
+         sockDoCommand(c, p, buf);
+   }
+
+   if (sockWrite(c->fd, p, 16)) return -1;
+
+   /* extensions */
+
+   if (cmdReplyExt(p[0]) && (((int)p[3]) > 0))
+   {
+      if (sockWrite(c->fd, buf, p[3])) return -1;
+   }
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/*
+Reads whatever the client has sent and executes each command as soon
+as its 16 byte header and any extension are complete.  Returns 0 if
+the client should be rearmed, < 0 if it should be closed.
+*/
+
+static int sockRead(sockClient_t *c)
+{
+   char *ptr;
+   int want, got;
+
+   while (1)
+   {
+      if (c->got < 16)
+      {
+         ptr  = (char *)c->p + c->got;
+         want = 16 - c->got;
+      }
+      else
+      {
+         if (c->p[3] >= CMD_MAX_EXTENSION)
+         {
+            /* Serious error.  No point continuing. */
+            DBG(DBG_ALWAYS, "ext too large %d(%d)",
+               c->p[3], CMD_MAX_EXTENSION);
+
+            return -1;
+         }
+
+         ptr  = c->buf + (c->got - 16);
+         want = (16 + c->p[3]) - c->got;
+      }
+
+      if (want)
+      {
+         got = recv(c->fd, ptr, want, 0);
+
+         if (got == 0) return -1; /* client closed */
+
+         if (got < 0)
+         {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) return 0;
+            if (errno == EINTR) continue;
+            return -1;
+         }
+
+         c->got += got;
+      }
+
+      if ((c->got >= 16) && (c->got == (16 + c->p[3])))
+      {
+         c->got = 0;
+
+         if (sockExecute(c)) return -1;
+      }
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void sockClose(sockClient_t *c)
+{
+   epoll_ctl(fdEpoll, EPOLL_CTL_DEL, c->fd, NULL);
+
+   /* the notification writer must be done with the socket first */
+
+   if (c->handle >= 0) notifyCloseInBand(c->handle, c->fd);
+
+   pwmRelease(c);
+
+   close(c->fd);
+
+   free(c);
+
+   __sync_fetch_and_sub(&sockClients, 1);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void sockAccept(void)
+{
+   struct epoll_event ev;
+   sockClient_t *c;
+   int fdC, opt;
+
+   while ((fdC = accept(fdSock, NULL, NULL)) >= 0)
+   {
+      if (sockClients >= gpioCfg.socketClients)
+      {
+         DBG(DBG_ALWAYS, "too many socket clients (%d)", sockClients);
+         close(fdC);
+         continue;
+      }
+
+      c = malloc(sizeof(sockClient_t));
+
+      if (c == NULL)
+      {
+         DBG(DBG_ALWAYS, "no memory for socket client");
+         close(fdC);
+         continue;
+      }
+
+      c->fd     = fdC;
+      c->handle = -1;
+      c->got    = 0;
+
+      fcntl(fdC, F_SETFL, fcntl(fdC, F_GETFL, 0) | O_NONBLOCK);
+
+      /* Disable the Nagle algorithm. */
+      opt = 1;
+      setsockopt(fdC, IPPROTO_TCP, TCP_NODELAY, (char*)&opt, sizeof(int));
+
+      __sync_fetch_and_add(&sockClients, 1);
+
+      ev.events   = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+      ev.data.ptr = c;
+
+      if (epoll_ctl(fdEpoll, EPOLL_CTL_ADD, fdC, &ev) < 0)
+      {
+         DBG(DBG_ALWAYS, "epoll add failed (%m)");
+         close(fdC);
+         free(c);
+         __sync_fetch_and_sub(&sockClients, 1);
+      }
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void * pthSocketWorker(void *x);
+
+static void sockGrow(void)
+{
+   pthread_attr_t attr;
+
+   /*
+   A client is served by one worker at a time.  With a worker for each
+   client and one for accepting, a client blocked in a slow command
+   (MICS, bit bang serial, a full socket) can't hold up the others.
+   */
+
+   pthread_mutex_lock(&sockWorkerMutex);
+
+   if (!sockStopping                                  &&
+       (sockBusy > sockWorkers)                       &&
+       (sockWorkers < gpioCfg.socketClients)          &&
+       !pthread_attr_init(&attr))
+   {
+      if (pthread_attr_setstacksize(&attr, STACK_SIZE) ||
+          pthread_create(
+             &pthSocketWorkers[sockWorkers], &attr, pthSocketWorker, NULL))
+      {
+         DBG(DBG_ALWAYS, "socket pthread_create failed (%m)");
+      }
+      else sockWorkers++;
+
+      pthread_attr_destroy(&attr);
+   }
+
+   pthread_mutex_unlock(&sockWorkerMutex);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void * pthSocketWorker(void *x)
+{
+   struct epoll_event ev;
+   sockClient_t *c;
+   int err, state;
+
+   while (1)
+   {
+      err = epoll_wait(fdEpoll, &ev, 1, -1);
+
+      if (err < 1)
+      {
+         if ((err < 0) && (errno != EINTR))
+         {
+            DBG(DBG_ALWAYS, "epoll_wait failed (%m)");
+            break;
+         }
+         continue;
+      }
+
+      /* don't allow cancellation part way through a command */
+
+      pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+
+      /* keep a worker free for the next event */
+
+      if (__sync_add_and_fetch(&sockBusy, 1) > sockWorkers) sockGrow();
+
+      c = ev.data.ptr;
+
+      if (c == NULL)
+      {
+         sockAccept();
+
+         ev.events   = EPOLLIN | EPOLLONESHOT;
+         ev.data.ptr = NULL;
+         epoll_ctl(fdEpoll, EPOLL_CTL_MOD, fdSock, &ev);
+      }
+      else if (sockRead(c) < 0)
+      {
+         sockClose(c);
+      }
+      else
+      {
+         ev.events   = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+         ev.data.ptr = c;
+         epoll_ctl(fdEpoll, EPOLL_CTL_MOD, c->fd, &ev);
+      }
+
+      __sync_sub_and_fetch(&sockBusy, 1);
+
+      pthread_setcancelstate(state, NULL);
+   }
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void * pthSocketThread(void *x)
+{
+   struct epoll_event ev;
+   pthread_attr_t attr;
+   int i;
+
+   /* fdSock opened in gpioInitialise so that we can treat
+      failure to bind as fatal. */
+
+   fcntl(fdSock, F_SETFL, fcntl(fdSock, F_GETFL, 0) | O_NONBLOCK);
+
+   listen(fdSock, 100);
+
+   fdEpoll = epoll_create(PI_MAX_SOCKET_CLIENTS);
+
+   if (fdEpoll < 0)
+      SOFT_ERROR((void*)PI_INIT_FAILED, "epoll_create failed (%m)");
+
+   /* the listening socket is identified by a NULL client */
+
+   ev.events   = EPOLLIN | EPOLLONESHOT;
+   ev.data.ptr = NULL;
+
+   if (epoll_ctl(fdEpoll, EPOLL_CTL_ADD, fdSock, &ev) < 0)
+      SOFT_ERROR((void*)PI_INIT_FAILED, "epoll_ctl failed (%m)");
+
+   /* don't start until DMA started */
+
+   spinWhileStarting();
+
+   if (pthread_attr_init(&attr))
+      SOFT_ERROR((void*)PI_INIT_FAILED,
+         "pthread_attr_init failed (%m)");
+
+   if (pthread_attr_setstacksize(&attr, STACK_SIZE))
+   {
+      pthread_attr_destroy(&attr);
+      SOFT_ERROR((void*)PI_INIT_FAILED,
+         "pthread_attr_setstacksize failed (%m)");
+   }
+
+   /* this thread is the first worker of the pool */
+
+   pthread_mutex_lock(&sockWorkerMutex);
+
+   sockStopping = 0;
+
+   for (i=0; i<(SOCK_WORKERS-1); i++)
+   {
+      if (pthread_create
+         (&pthSocketWorkers[i], &attr, pthSocketWorker, NULL))
+      {
+         pthread_mutex_unlock(&sockWorkerMutex);
+         pthread_attr_destroy(&attr);
+         SOFT_ERROR((void*)PI_INIT_FAILED,
+            "socket pthread_create failed (%m)");
+      }
+
+      sockWorkers++;
+   }
+
+   pthread_mutex_unlock(&sockWorkerMutex);
+
+   pthread_attr_destroy(&attr);
+
+   return pthSocketWorker(x);
+}
+
+/* ======================================================================= */
+
+/*
+Simulated peripherals (make SIM=1).
+
+The peripheral registers and DMA pages are ordinary memory.  A
+simulation thread stands in for the hardware.  Every PI_SIM_MICROS it
+sets the system timer from CLOCK_MONOTONIC and runs the input and
+output DMA control block chains up to the current time.  Paced
+(DREQ) transfers take the time set by the PWM/PCM clock registers, so
+the sample slots and ticks advance as they would on a Pi.
+
+Output gpios read back the level last written.  Input gpios read the
+square waves listed in the file named by PIGPIO_SIM_INPUT, one per
+line as "gpio period_micros high_micros [phase_micros]", otherwise 0.
+
+The SPI status bits are held set so polled transfers complete, there
+is no model of their data.  DMA transfers through the SPI FIFO are
+paced by the SPI clock divider and loop MOSI back to MISO.
+*/
+
+#define PI_ENVSIMINPUT "PIGPIO_SIM_INPUT"
+
+#define PI_SIM_MICROS   50         /* simulation thread period      */
+#define PI_SIM_BUS      0x40000000 /* bus address of first DMA page */
+#define PI_SIM_MAX_CBS  100000     /* cbs run per period at most    */
+#define PI_SIM_SPI_FIFO 64         /* loopback words                */
+
+typedef struct
+{
+   unsigned gpio;
+   uint32_t period;
+   uint32_t high;
+   uint32_t phase;
+} simWave_t;
+
+typedef struct
+{
+   volatile uint32_t *reg;
+   uint32_t cbAddr;
+   uint64_t nanos;
+   int      active;
+} simDma_t;
+
+static simWave_t simWave[PI_MAX_GPIO+1];
+static int       simWaves = 0;
+
+static uint32_t simLatch[2];
+static uint32_t simOutput[2];
+
+static simDma_t simDma[2];
+
+static unsigned simPages;
+
+static uint32_t simSpiFifo[PI_SIM_SPI_FIFO];
+static unsigned simSpiHead = 0;
+static unsigned simSpiTail = 0;
+static unsigned simSpiLeft = 0; /* bytes left of the DMA transfer */
+
+static pthread_mutex_t simMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t pthSim;
+static int pthSimRunning = 0;
+
+/* ----------------------------------------------------------------------- */
+
+static uint64_t simNanos(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ((uint64_t)ts.tv_sec * BILLION) + ts.tv_nsec;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static uint32_t simInput(int bank, uint64_t nanos)
+{
+   uint32_t micros, levels;
+   int i;
+
+   micros = nanos / THOUSAND;
+
+   levels = 0;
+
+   for (i=0; i<simWaves; i++)
+   {
+      if ((simWave[i].gpio >> 5) == bank)
+      {
+         if (((micros + simWave[i].phase) % simWave[i].period) <
+            simWave[i].high) levels |= (1<<(simWave[i].gpio&0x1F));
+      }
+   }
+
+   return levels;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static uint32_t simLevel(int bank, uint64_t nanos)
+{
+   return (simLatch[bank] & simOutput[bank]) |
+          (simInput(bank, nanos) & ~simOutput[bank]);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void simSetOutputs(void)
+{
+   uint32_t outputs[2];
+   unsigned gpio;
+
+   outputs[0] = 0;
+   outputs[1] = 0;
+
+   for (gpio=0; gpio<=PI_MAX_GPIO; gpio++)
+   {
+      if (((gpioReg[GPFSEL0 + (gpio/10)] >> ((gpio%10)*3)) & 7) == PI_OUTPUT)
+         outputs[BANK] |= BIT;
+   }
+
+   simOutput[0] = outputs[0];
+   simOutput[1] = outputs[1];
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void simGpioWrite(int reg, uint32_t bits)
+{
+   int bank;
+
+   pthread_mutex_lock(&simMutex);
+
+   if ((reg == GPSET0) || (reg == GPSET1))
+   {
+      bank = reg - GPSET0;
+      simLatch[bank] |= bits;
+   }
+   else
+   {
+      bank = reg - GPCLR0;
+      simLatch[bank] &= ~bits;
+   }
+
+   simSetOutputs(); /* the mode may have just been set */
+
+   gpioReg[GPLEV0 + bank] = simLevel(bank, simNanos());
+
+   pthread_mutex_unlock(&simMutex);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static volatile uint32_t *simPeriph(uint32_t busAdr)
+{
+   static const struct {volatile uint32_t **reg; int len;} block[]=
+   {
+      {&auxReg,  AUX_LEN},
+      {&clkReg,  CLK_LEN},
+      {&dmaReg,  DMA_LEN},
+      {&gpioReg, GPIO_LEN},
+      {&pcmReg,  PCM_LEN},
+      {&pwmReg,  PWM_LEN},
+      {&spiReg,  SPI_LEN},
+      {&systReg, SYST_LEN},
+   };
+
+   uint32_t base[8];
+   uint32_t offset;
+   int i;
+
+   base[0] = AUX_BASE;
+   base[1] = CLK_BASE;
+   base[2] = DMA_BASE;
+   base[3] = GPIO_BASE;
+   base[4] = PCM_BASE;
+   base[5] = PWM_BASE;
+   base[6] = SPI_BASE;
+   base[7] = SYST_BASE;
+
+   offset = busAdr & 0x00FFFFFF;
+
+   for (i=0; i<8; i++)
+   {
+      base[i] &= 0x00FFFFFF;
+
+      if ((offset >= base[i]) && (offset < (base[i] + block[i].len)))
+         return *block[i].reg + ((offset - base[i]) / 4);
+   }
+
+   return NULL;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static uint32_t *simMemory(uint32_t busAdr)
+{
+   unsigned page;
+
+   page = (busAdr - PI_SIM_BUS) / PAGE_SIZE;
+
+   if ((busAdr < PI_SIM_BUS) || (page >= simPages)) return NULL;
+
+   return (uint32_t *)((char *)dmaVirt[page] + (busAdr % PAGE_SIZE));
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int simRead(uint32_t busAdr, uint64_t nanos, uint32_t *value)
+{
+   volatile uint32_t *reg;
+   uint32_t *mem;
+
+   if ((busAdr & 0xFF000000) == PI_PERI_BUS)
+   {
+      reg = simPeriph(busAdr);
+
+      if (reg == NULL) return -1;
+
+      if ((reg == (gpioReg + GPLEV0)) || (reg == (gpioReg + GPLEV1)))
+      {
+         pthread_mutex_lock(&simMutex);
+         *value = simLevel(reg - (gpioReg + GPLEV0), nanos);
+         pthread_mutex_unlock(&simMutex);
+      }
+      else if (reg == (systReg + SYST_CLO)) *value = nanos / THOUSAND;
+      else if (reg == (systReg + SYST_CHI)) *value = (nanos/THOUSAND) >> 32;
+      else *value = *reg;
+
+      return 0;
+   }
+
+   mem = simMemory(busAdr);
+
+   if (mem == NULL) return -1;
+
+   *value = *mem;
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int simWrite(uint32_t busAdr, uint32_t value)
+{
+   volatile uint32_t *reg;
+   uint32_t *mem;
+   int r;
+
+   if ((busAdr & 0xFF000000) == PI_PERI_BUS)
+   {
+      reg = simPeriph(busAdr);
+
+      if (reg == NULL) return -1;
+
+      r = reg - gpioReg;
+
+      if ((reg >= gpioReg) && (reg < (gpioReg + (GPIO_LEN/4))) &&
+          ((r == GPSET0) || (r == GPSET1) || (r == GPCLR0) || (r == GPCLR1)))
+         simGpioWrite(r, value);
+      else *reg = value;
+
+      return 0;
+   }
+
+   mem = simMemory(busAdr);
+
+   if (mem == NULL) return -1;
+
+   *mem = value;
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static uint64_t simDreqNanos(int permap)
+{
+   unsigned divi, bits;
+
+   /* the time to empty one fifo word, 0 if the clock isn't set up */
+
+   if (permap == 5)
+   {
+      divi = (clkReg[CLK_PWMDIV] >> 12) & 0xFFF;
+      bits = pwmReg[PWM_RNG1];
+   }
+   else if (permap == 2)
+   {
+      divi = (clkReg[CLK_PCMDIV] >> 12) & 0xFFF;
+      bits = ((pcmReg[PCM_MODE] >> 10) & 0x3FF) + 1;
+   }
+   else if (permap == 6)
+   {
+      /* core clock is 250 MHz, 4 ns per cycle, CDIV 0 is 65536 */
+
+      divi = spiReg[SPI_CLK] & 0xFFFF;
+      if (!divi) divi = 65536;
+
+      return (uint64_t)divi * 32 * 4;
+   }
+   else return 0;
+
+   /* PLLD is 500 MHz, 2 ns per cycle */
+
+   return (uint64_t)divi * bits * 2;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int simDmaCb(simDma_t *d)
+{
+   rawCbs_t *cb;
+   uint32_t src, dst, value;
+   uint64_t nanos;
+   int i;
+
+   cb = (rawCbs_t *)simMemory(d->cbAddr);
+
+   if (cb == NULL) return -1;
+
+   if ((cb->info & DMA_DEST_DREQ) && (((cb->info >> 16) & 31) == 6))
+   {
+      /* SPI TX, the first word of a transfer sets DLEN */
+
+      nanos = simDreqNanos(6);
+      src = cb->src;
+
+      for (i=0; i<cb->length; i+=4)
+      {
+         if (simRead(src, d->nanos, &value)) return -1;
+
+         if (!simSpiLeft)
+         {
+            simSpiLeft = value >> 16;
+            simSpiHead = simSpiTail = 0;
+         }
+         else
+         {
+            simSpiFifo[simSpiHead++ % PI_SIM_SPI_FIFO] = value;
+            simSpiLeft = (simSpiLeft > 4) ? (simSpiLeft - 4) : 0;
+            d->nanos += nanos;
+         }
+
+         if (cb->info & DMA_SRC_INC) src += 4;
+      }
+   }
+   else if ((cb->info & DMA_SRC_DREQ) && (((cb->info >> 16) & 31) == 7))
+   {
+      /* SPI RX, stalls until TX has shifted the words */
+
+      if ((simSpiHead - simSpiTail) < (cb->length / 4)) return 1;
+
+      dst = cb->dst;
 
-   if (spiFlags > (1<<22))
-      SOFT_ERROR(PI_BAD_FLAGS, "bad spiFlags (0x%X)", spiFlags);
+      for (i=0; i<cb->length; i+=4)
+      {
+         if (simWrite(dst, simSpiFifo[simSpiTail++ % PI_SIM_SPI_FIFO]))
+            return -1;
 
-   if (!spiAnyOpen(spiFlags)) /* initialise on first open */
-   {
-      spiInit(spiFlags);
-      spiGo(baud, spiFlags, NULL, NULL, 0);
+         if (cb->info & DMA_DEST_INC) dst += 4;
+      }
    }
+   else if (cb->info & DMA_DEST_DREQ)
+   {
+      nanos = simDreqNanos((cb->info >> 16) & 31);
 
-   slot = -1;
+      if (!nanos) return 1; /* stalled until the clock runs */
 
-   for (i=0; i<PI_SPI_SLOTS; i++)
+      d->nanos += nanos * (cb->length / 4);
+   }
+   else
    {
-      if (spiInfo[i].state == PI_SPI_CLOSED)
+      src = cb->src;
+      dst = cb->dst;
+
+      for (i=0; i<cb->length; i+=4)
       {
-         spiInfo[i].state = PI_SPI_OPENED;
-         slot = i;
-         break;
+         if (cb->info & DMA_SRC_IGNORE) value = 0;
+         else if (simRead(src, d->nanos, &value)) return -1;
+
+         if (!(cb->info & DMA_DEST_IGNORE))
+         {
+            if (simWrite(dst, value)) return -1;
+         }
+
+         if (cb->info & DMA_SRC_INC)  src += 4;
+         if (cb->info & DMA_DEST_INC) dst += 4;
       }
    }
 
-   if (slot < 0)
-      SOFT_ERROR(PI_NO_HANDLE, "no SPI handles");
-
-   spiInfo[slot].speed = baud;
-   spiInfo[slot].flags = spiFlags | PI_SPI_FLAGS_CHANNEL(spiChan);
+   d->cbAddr = cb->next;
 
-   return slot;
+   return 0;
 }
 
-int spiClose(unsigned handle)
+/* ----------------------------------------------------------------------- */
+
+static void simDmaRun(uint64_t now)
 {
-   DBG(DBG_USER, "handle=%d", handle);
+   uint32_t start[2];
+   uint32_t cs;
+   int run[2];
+   int c, ch, cbs, status;
+   simDma_t *d;
 
-   CHECK_INITED;
+   for (c=0; c<2; c++)
+   {
+      d = &simDma[c];
 
-   if (handle >= PI_SPI_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+      start[c] = d->reg[DMA_CONBLK_AD];
 
-   if (spiInfo[handle].state != PI_SPI_OPENED)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+      run[c] = (d->reg[DMA_CS] & DMA_ACTIVATE) && start[c];
 
-   spiInfo[handle].state = PI_I2C_CLOSED;
+      /* a chain started or moved by the library runs from now */
 
-   if (!spiAnyOpen(spiInfo[handle].flags))
-      spiTerm(spiInfo[handle].flags); /* terminate on last close */
+      if (run[c] && (!d->active || (start[c] != d->cbAddr)))
+      {
+         d->cbAddr = start[c];
+         d->nanos  = now;
+      }
 
-   return 0;
-}
+      d->active = run[c];
+   }
 
-int spiRead(unsigned handle, char *buf, unsigned count)
-{
-   DBG(DBG_USER, "handle=%d count=%d [%s]",
-      handle, count, myBuf2Str(count, buf));
+   /* run the channels in time order so outputs and samples interleave */
 
-   CHECK_INITED;
+   for (cbs=0; cbs<PI_SIM_MAX_CBS; cbs++)
+   {
+      ch = -1;
 
-   if (handle >= PI_SPI_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+      for (c=0; c<2; c++)
+      {
+         if (run[c] && (simDma[c].nanos <= now))
+         {
+            if ((ch < 0) || (simDma[c].nanos < simDma[ch].nanos)) ch = c;
+         }
+      }
 
-   if (spiInfo[handle].state != PI_SPI_OPENED)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+      if (ch < 0) break;
 
-   if (count > PI_MAX_SPI_DEVICE_COUNT)
-      SOFT_ERROR(PI_BAD_SPI_COUNT, "bad count (%d)", count);
+      d = &simDma[ch];
 
-   spiGo(spiInfo[handle].speed, spiInfo[handle].flags, NULL, buf, count);
+      status = simDmaCb(d);
 
-   return count;
+      if (status > 0)
+      {
+         d->nanos = now;
+         run[ch] = 0;
+      }
+      else if (status < 0)
+      {
+         DBG(DBG_ALWAYS, "DMA error cb=%08X", d->cbAddr);
+         d->cbAddr = 0;
+      }
+
+      if (!d->cbAddr) run[ch] = 0;
+   }
+
+   for (c=0; c<2; c++)
+   {
+      d = &simDma[c];
+
+      if (!d->active) continue;
+
+      /* leave alone if the library has changed the channel meanwhile */
+
+      if (__sync_bool_compare_and_swap(
+         &d->reg[DMA_CONBLK_AD], start[c], d->cbAddr))
+      {
+         if (!d->cbAddr)
+         {
+            do cs = d->reg[DMA_CS];
+            while (!__sync_bool_compare_and_swap(
+               &d->reg[DMA_CS], cs, (cs & ~DMA_ACTIVATE) | DMA_END_FLAG));
+
+            d->active = 0;
+         }
+      }
+      else d->active = 0;
+   }
 }
 
-int spiWrite(unsigned handle, char *buf, unsigned count)
+/* ----------------------------------------------------------------------- */
+
+static void *pthSimThread(void *x)
 {
-   DBG(DBG_USER, "handle=%d count=%d [%s]",
-      handle, count, myBuf2Str(count, buf));
+   struct timespec req;
+   uint64_t now, next;
+   int bank;
 
-   CHECK_INITED;
+   simDma[0].reg = dmaIn;
+   simDma[1].reg = dmaOut;
 
-   if (handle >= PI_SPI_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   next = simNanos();
 
-   if (spiInfo[handle].state != PI_SPI_OPENED)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   while (1)
+   {
+      now = simNanos();
 
-   if (count > PI_MAX_SPI_DEVICE_COUNT)
-      SOFT_ERROR(PI_BAD_SPI_COUNT, "bad count (%d)", count);
+      systReg[SYST_CLO] = now / THOUSAND;
+      systReg[SYST_CHI] = (now / THOUSAND) >> 32;
 
-   spiGo(spiInfo[handle].speed, spiInfo[handle].flags, buf, NULL, count);
+      if (simPages) simDmaRun(now);
 
-   return count;
-}
+      pthread_mutex_lock(&simMutex);
 
-int spiXfer(unsigned handle, char *txBuf, char *rxBuf, unsigned count)
-{
-   DBG(DBG_USER, "handle=%d count=%d [%s]",
-      handle, count, myBuf2Str(count, txBuf));
+      simSetOutputs();
 
-   CHECK_INITED;
+      for (bank=0; bank<2; bank++)
+         gpioReg[GPLEV0 + bank] = simLevel(bank, now);
 
-   if (handle >= PI_SPI_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+      pthread_mutex_unlock(&simMutex);
 
-   if (spiInfo[handle].state != PI_SPI_OPENED)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+      spiReg[SPI_CS] |= (SPI_CS_DONE | SPI_CS_RXD | SPI_CS_TXD);
+      auxReg[AUX_SPI0_STAT_REG] &= ~AUXSPI_STAT_BUSY;
 
-   if (count > PI_MAX_SPI_DEVICE_COUNT)
-      SOFT_ERROR(PI_BAD_SPI_COUNT, "bad count (%d)", count);
+      next += PI_SIM_MICROS * THOUSAND;
 
-   spiGo(spiInfo[handle].speed, spiInfo[handle].flags, txBuf, rxBuf, count);
+      if (next < now) next = now;
 
-   return count;
-}
+      req.tv_sec  = next / BILLION;
+      req.tv_nsec = next % BILLION;
 
-/* ======================================================================= */
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &req, NULL);
+   }
+
+   return 0;
+}
 
+/* ----------------------------------------------------------------------- */
 
-int serOpen(char *tty, unsigned serBaud, unsigned serFlags)
+static void simLoadInput(void)
 {
-   struct termios new;
-   int speed;
-   int fd;
-   int i, slot;
+   FILE *fp;
+   char *name;
+   char buf[128];
+   unsigned gpio, period, high, phase;
+   int f;
 
-   DBG(DBG_USER, "tty=%s serBaud=%d serFlags=0x%X", tty, serBaud, serFlags);
+   simWaves = 0;
 
-   CHECK_INITED;
+   name = getenv(PI_ENVSIMINPUT);
 
-   if (strncmp("/dev/tty", tty, 8))
-      SOFT_ERROR(PI_BAD_SER_DEVICE, "bad device (%s)", tty);
+   if (name == NULL) return;
 
-   switch (serBaud)
-   {
-      case     50: speed =     B50; break;
-      case     75: speed =     B75; break;
-      case    110: speed =    B110; break;
-      case    134: speed =    B134; break;
-      case    150: speed =    B150; break;
-      case    200: speed =    B200; break;
-      case    300: speed =    B300; break;
-      case    600: speed =    B600; break;
-      case   1200: speed =   B1200; break;
-      case   1800: speed =   B1800; break;
-      case   2400: speed =   B2400; break;
-      case   4800: speed =   B4800; break;
-      case   9600: speed =   B9600; break;
-      case  19200: speed =  B19200; break;
-      case  38400: speed =  B38400; break;
-      case  57600: speed =  B57600; break;
-      case 115200: speed = B115200; break;
-      case 230400: speed = B230400; break;
+   fp = fopen(name, "r");
 
-      default:
-         SOFT_ERROR(PI_BAD_SER_SPEED, "bad speed (%d)", serBaud);
+   if (fp == NULL)
+   {
+      DBG(DBG_ALWAYS, "can't open %s (%m)", name);
+      return;
    }
 
-   if (serFlags)
-      SOFT_ERROR(PI_BAD_FLAGS, "bad flags (0x%X)", serFlags);
+   while (fgets(buf, sizeof(buf), fp) != NULL)
+   {
+      if (buf[0] == '#') continue;
 
-   slot = -1;
+      phase = 0;
 
-   for (i=0; i<PI_SER_SLOTS; i++)
-   {
-      if (serInfo[i].state == PI_SER_CLOSED)
+      f = sscanf(buf, "%u %u %u %u", &gpio, &period, &high, &phase);
+
+      if (f < 0) continue;
+
+      if ((f < 3) || (gpio > PI_MAX_GPIO) || !period ||
+          (simWaves > PI_MAX_GPIO))
       {
-         serInfo[i].state = PI_SER_OPENED;
-         slot = i;
-         break;
+         DBG(DBG_ALWAYS, "bad %s line: %s", name, buf);
+         continue;
       }
-   }
 
-   if (slot < 0)
-      SOFT_ERROR(PI_NO_HANDLE, "no serial handles");
+      simWave[simWaves].gpio   = gpio;
+      simWave[simWaves].period = period;
+      simWave[simWaves].high   = high;
+      simWave[simWaves].phase  = phase;
 
-   if ((fd = open(tty, O_RDWR | O_NOCTTY | O_NDELAY | O_NONBLOCK)) == -1)
-   {
-      serInfo[slot].state = PI_SER_CLOSED;
-      return PI_SER_OPEN_FAILED;
+      simWaves++;
    }
 
-   tcgetattr(fd, &new);
+   fclose(fp);
 
-   cfmakeraw(&new);
+   DBG(DBG_STARTUP, "%d input waves from %s", simWaves, name);
+}
 
-   cfsetispeed(&new, speed);
-   cfsetospeed(&new, speed);
+/* ----------------------------------------------------------------------- */
 
-   new.c_cc [VMIN]  = 0;
-   new.c_cc [VTIME] = 0;
+static volatile uint32_t * initSimReg(uint32_t len)
+{
+   return (uint32_t *) mmap(0, len,
+      PROT_READ|PROT_WRITE,
+      MAP_PRIVATE|MAP_ANONYMOUS,
+      -1, 0);
+}
 
-   tcflush(fd, TCIFLUSH);
-   tcsetattr(fd, TCSANOW, &new);
+/* ----------------------------------------------------------------------- */
 
-   //fcntl(fd, F_SETFL, O_RDWR);
+static int initSimPeripherals(void)
+{
+   DBG(DBG_STARTUP, "");
 
-   serInfo[slot].fd = fd;
-   serInfo[slot].flags = serFlags;
+   gpioReg = initSimReg(GPIO_LEN);
+   dmaReg  = initSimReg(DMA_LEN);
+   clkReg  = initSimReg(CLK_LEN);
+   systReg = initSimReg(SYST_LEN);
+   spiReg  = initSimReg(SPI_LEN);
+   pwmReg  = initSimReg(PWM_LEN);
+   pcmReg  = initSimReg(PCM_LEN);
+   auxReg  = initSimReg(AUX_LEN);
 
-   return slot;
+   if ((gpioReg == MAP_FAILED) || (dmaReg == MAP_FAILED) ||
+       (clkReg  == MAP_FAILED) || (systReg == MAP_FAILED) ||
+       (spiReg  == MAP_FAILED) || (pwmReg  == MAP_FAILED) ||
+       (pcmReg  == MAP_FAILED) || (auxReg  == MAP_FAILED))
+      SOFT_ERROR(PI_INIT_FAILED, "mmap simulated peripherals failed (%m)");
+
+   dmaIn  = dmaReg + (gpioCfg.DMAprimaryChannel   * 0x40);
+   dmaOut = dmaReg + (gpioCfg.DMAsecondaryChannel * 0x40);
+
+   simLatch[0] = 0;
+   simLatch[1] = 0;
+
+   memset(simDma, 0, sizeof(simDma));
+
+   simPages = 0;
+
+   simLoadInput();
+
+   if (pthread_create(&pthSim, NULL, pthSimThread, NULL))
+      SOFT_ERROR(PI_INIT_FAILED, "pthread_create sim failed (%m)");
+
+   pthSimRunning = 1;
+
+   return 0;
 }
 
-int serClose(unsigned handle)
+/* ----------------------------------------------------------------------- */
+
+static int initSimBlock(int block)
 {
-   DBG(DBG_USER, "handle=%d", handle);
+   char *virtualAdr;
+   unsigned page;
+   int n;
 
-   CHECK_INITED;
+   DBG(DBG_STARTUP, "block=%d", block);
 
-   if (handle >= PI_SER_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   virtualAdr = mmap(
+       0, (PAGES_PER_BLOCK*PAGE_SIZE),
+       PROT_READ|PROT_WRITE,
+       MAP_PRIVATE|MAP_ANONYMOUS,
+       -1, 0);
 
-   if (serInfo[handle].state != PI_SER_OPENED)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   if (virtualAdr == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap sim block %d failed (%m)", block);
 
-   if (serInfo[handle].fd >= 0) close(serInfo[handle].fd);
+   page = block * PAGES_PER_BLOCK;
 
-   serInfo[handle].fd = -1;
-   serInfo[handle].state = PI_SER_CLOSED;
+   for (n=0; n<PAGES_PER_BLOCK; n++)
+   {
+      dmaVirt[page+n] = (dmaPage_t *) virtualAdr;
+      dmaBus[page+n] = (dmaPage_t *) (uintptr_t)
+         (PI_SIM_BUS + ((page+n) * PAGE_SIZE));
+      virtualAdr += PAGE_SIZE;
+   }
 
    return 0;
 }
 
-int serWriteByte(unsigned handle, unsigned bVal)
+/* ----------------------------------------------------------------------- */
+
+static void simStop(void)
 {
-   char c;
+   if (pthSimRunning)
+   {
+      pthread_cancel(pthSim);
+      pthread_join(pthSim, NULL);
+      pthSimRunning = 0;
+   }
+}
 
-   DBG(DBG_USER, "handle=%d bVal=%d", handle, bVal);
+/* ======================================================================= */
 
-   CHECK_INITED;
+static void initCheckLockFile(void)
+{
+   int fd;
+   int count;
+   int pid;
+   int err;
+   int delete;
+   char str[20];
 
-   if (handle >= PI_SER_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   fd = open(PI_LOCKFILE, O_RDONLY);
 
-   if (serInfo[handle].state != PI_SER_OPENED)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   if (fd != -1)
+   {
+      DBG(DBG_STARTUP, "lock file exists");
+      delete = 1;
 
-   if (bVal > 0xFF)
-      SOFT_ERROR(PI_BAD_PARAM, "bad parameter (%d)", bVal);
+      count = read(fd, str, sizeof(str)-1);
 
-   c = bVal;
+      if (count)
+      {
+         pid = atoi(str);
+         err = kill(pid, 0);
+         if (!err) delete = 0; /* process still exists */
+         DBG(DBG_STARTUP, "lock file pid=%d err=%d", pid, err);
+      }
+
+      close(fd);
+      DBG(DBG_STARTUP, "lock file delete=%d", delete);
 
-   if (write(serInfo[handle].fd, &c, 1) != 1)
-      return PI_SER_WRITE_FAILED;
-   else
-      return 0;
+      if (delete) unlink(PI_LOCKFILE);
+   }
 }
 
-int serReadByte(unsigned handle)
+static int initGrabLockFile(void)
 {
-   char x;
-
-   DBG(DBG_USER, "handle=%d", handle);
+   int fd;
+   int lockResult;
+   char pidStr[20];
 
-   CHECK_INITED;
+   initCheckLockFile();
 
-   if (handle >= PI_SER_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   /* try to grab the lock file */
 
-   if (serInfo[handle].state != PI_SER_OPENED)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   fd = open(PI_LOCKFILE, O_WRONLY|O_CREAT|O_EXCL|O_TRUNC, 0644);
 
-   if (read(serInfo[handle].fd, &x, 1) != 1)
+   if (fd != -1)
    {
-      if (errno == EAGAIN)
-         return PI_SER_READ_NO_DATA;
+      lockResult = flock(fd, LOCK_EX|LOCK_NB);
+
+      if(lockResult == 0)
+      {
+         sprintf(pidStr, "%d\n", (int)getpid());
+
+         write(fd, pidStr, strlen(pidStr));
+      }
       else
-         return PI_SER_READ_FAILED;
+      {
+         close(fd);
+         return -1;
+      }
    }
 
-   return ((int)x) & 0xFF;
+   return fd;
 }
 
-int serWrite(unsigned handle, char *buf, unsigned count)
-{
-   DBG(DBG_USER, "handle=%d count=%d [%s]",
-      handle, count, myBuf2Str(count, buf));
-
-   CHECK_INITED;
+/* ----------------------------------------------------------------------- */
 
-   if (handle >= PI_SER_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+static uint32_t * initMapMem(int fd, uint32_t addr, uint32_t len)
+{
+    return (uint32_t *) mmap(0, len,
+       PROT_READ|PROT_WRITE|PROT_EXEC,
+       MAP_SHARED|MAP_LOCKED,
+       fd, addr);
+}
 
-   if (serInfo[handle].state != PI_SER_OPENED)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+/* ----------------------------------------------------------------------- */
 
-   if (!count)
-      SOFT_ERROR(PI_BAD_PARAM, "bad count (%d)", count);
+static int initCheckPermitted(void)
+{
+   DBG(DBG_STARTUP, "");
 
-   if (write(serInfo[handle].fd, buf, count) != count)
-      return PI_SER_WRITE_FAILED;
-   else
-      return 0;
+   if ((fdMem = open("/dev/mem", O_RDWR | O_SYNC) ) < 0)
+   {
+      DBG(DBG_ALWAYS,
+         "\n" \
+         "+---------------------------------------------------------+\n" \
+         "|Sorry, you don't have permission to run this program.    |\n" \
+         "|Try running as root, e.g. precede the command with sudo. |\n" \
+         "+---------------------------------------------------------+\n\n");
+      return -1;
+   }
+   return 0;
 }
 
-int serRead(unsigned handle, char *buf, unsigned count)
-{
-   int r;
+/* ----------------------------------------------------------------------- */
 
-   DBG(DBG_USER, "handle=%d count=%d buf=0x%X", handle, count, (unsigned)buf);
+static int initPeripherals(void)
+{
+   uint32_t dmaBase;
 
-   CHECK_INITED;
+   if (PI_SIM) return initSimPeripherals();
 
-   if (handle >= PI_SER_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   DBG(DBG_STARTUP, "");
 
-   if (serInfo[handle].state != PI_SER_OPENED)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   gpioReg = initMapMem(fdMem, GPIO_BASE, GPIO_LEN);
 
-   if (!count)
-      SOFT_ERROR(PI_BAD_PARAM, "bad count (%d)", count);
+   if (gpioReg == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap gpio failed (%m)");
 
-   r = read(serInfo[handle].fd, buf, count);
+   /* dma channels 0-14 share one page, 15 has another */
 
-   if (r == -1)
-   {
-      if (errno == EAGAIN)
-         return PI_SER_READ_NO_DATA;
-      else
-         return PI_SER_READ_FAILED;
-   }
-   else
+   if (gpioCfg.DMAprimaryChannel < 15)
    {
-      buf[r] = 0;
-      return r;
+      dmaBase = DMA_BASE;
    }
-}
+   else dmaBase = DMA15_BASE;
 
-int serDataAvailable(unsigned handle)
-{
-   int result;
+   dmaReg = initMapMem(fdMem, dmaBase,  DMA_LEN);
 
-   DBG(DBG_USER, "handle=%d", handle);
+   if (dmaReg == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap dma failed (%m)");
 
-   CHECK_INITED;
+   if (gpioCfg.DMAprimaryChannel < 15)
+   {
+      dmaIn =  dmaReg + (gpioCfg.DMAprimaryChannel   * 0x40);
+      dmaOut = dmaReg + (gpioCfg.DMAsecondaryChannel * 0x40);
+   }
 
-   if (handle >= PI_SER_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   DBG(DBG_STARTUP, "DMA #%d @ %08X @ %08X",
+      gpioCfg.DMAprimaryChannel, dmaBase, (uint32_t)dmaIn);
 
-   if (serInfo[handle].state != PI_SER_OPENED)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   DBG(DBG_STARTUP, "debug reg is %08X", dmaIn[DMA_DEBUG]);
 
-   if (ioctl(serInfo[handle].fd, FIONREAD, &result) == -1) return 0;
+   clkReg  = initMapMem(fdMem, CLK_BASE,  CLK_LEN);
 
-   return result;
-}
+   if (clkReg == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap clk failed (%m)");
 
-/* ======================================================================= */
+   systReg  = initMapMem(fdMem, SYST_BASE,  SYST_LEN);
 
-static int chooseBestClock
-   (clkInf_t *clkInf, unsigned f, unsigned numc, unsigned *cf)
-{
-   int c, valid, offby, offby2, best_offby;
-   uint32_t div;
-   uint64_t frac;
+   if (systReg == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap syst failed (%m)");
 
-   valid = 0;
-   best_offby = 0;
+   spiReg  = initMapMem(fdMem, SPI_BASE,  SPI_LEN);
 
-   for (c=0; c<numc; c++)
-   {
-      div = cf[c] / f;
+   if (spiReg == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap spi failed (%m)");
 
-      if ((div > 1) && (div < 4096))
-      {
-         if (f < PI_MASH_MAX_FREQ)
-         {
-            frac = cf[c] - (div * f);
-            frac = (frac * 4096) / f;
-            offby = cf[c] - (div * f) - ((frac * f) / 4096);
-            if (frac < 4095)
-            {
-               offby2 = cf[c] - (div * f) - (((frac+1) * f) / 4096);
-               if (offby2 < 0) offby2 = -offby2;
-               if (offby2 < offby)
-               {
-                  offby = offby2;
-                  frac++;
-               }
-            }
-         }
-         else
-         {
-            frac = 0;
-            offby = cf[c] - (div * f);
-            if (div < 4095)
-            {
-               offby2 = cf[c] - ((div+1) * f);
-               if (offby2 < 0) offby2 = -offby2;
-               if (offby2 < offby)
-               {
-                  offby = offby2;
-                  div++;
-               }
-            }
-         }
+   pwmReg  = initMapMem(fdMem, PWM_BASE,  PWM_LEN);
 
-         if ((!valid) || (offby <= best_offby))
-         {
-            valid = 1;
-            clkInf->div = div;
-            clkInf->frac = frac;
-            clkInf->clock = c;
-            best_offby = offby;
-         }
-      }
-   }
-   return valid;
-}
+   if (pwmReg == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap pwm failed (%m)");
 
-/* ======================================================================= */
+   pcmReg  = initMapMem(fdMem, PCM_BASE,  PCM_LEN);
 
-static rawCbs_t * dmaCB2adr(int pos)
-{
-   int page, slot;
+   if (pcmReg == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap pcm failed (%m)");
 
-   page = pos/CBS_PER_IPAGE;
-   slot = pos%CBS_PER_IPAGE;
+   auxReg  = initMapMem(fdMem, AUX_BASE,  AUX_LEN);
 
-   return &dmaIVirt[page]->cb[slot];
+   if (auxReg == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap aux failed (%m)");
+
+   return 0;
 }
 
 /* ----------------------------------------------------------------------- */
 
-static void dmaCbPrint(int pos)
+static int initZaps
+   (int  pmapFd, void *virtualBase, int  basePage, int  pages)
 {
-   rawCbs_t * p;
-
-   p = dmaCB2adr(pos);
-
-   fprintf(stderr, "i=%x s=%x d=%x len=%x s=%x nxt=%x\n",
-      p->info, p->src, p->dst, p->length, p->stride, p->next);
-}
+   int n;
+   long index;
+   off_t offset;
+   ssize_t t;
+   uint32_t physical;
+   int status;
+   uint32_t pageAdr;
+   unsigned long long pa;
 
-/* ----------------------------------------------------------------------- */
+   DBG(DBG_STARTUP, "");
 
-static unsigned dmaNowAtICB(void)
-{
-   unsigned cb;
-   static unsigned lastPage=0;
-   unsigned page;
-   uint32_t cbAddr;
-   uint32_t startTick, endTick;
+   status = 0;
 
-   startTick = systReg[SYST_CLO];
+   pageAdr = (uint32_t) dmaVirt[basePage];
 
-   cbAddr = dmaIn[DMA_CONBLK_AD];
+   index  = ((uint32_t)virtualBase / PAGE_SIZE) * 8;
 
-   page = lastPage;
+   offset = lseek(pmapFd, index, SEEK_SET);
 
-   /* which page are we dma'ing? */
+   if (offset != index)
+      SOFT_ERROR(PI_INIT_FAILED, "lseek pagemap failed (%m)");
 
-   while (1)
+   for (n=0; n<pages; n++)
    {
-      cb = (cbAddr - ((int)dmaIBus[page])) / 32;
+      t = read(pmapFd, &pa, sizeof(pa));
 
-      if (cb < CBS_PER_IPAGE)
-      {
-         endTick = systReg[SYST_CLO];
+      if (t != sizeof(pa))
+         SOFT_ERROR(PI_INIT_FAILED, "read pagemap failed (%m)");
 
-         if (endTick != startTick)
-            gpioStats.cbTicks += (endTick - startTick);
+      DBG(DBG_STARTUP, "pf%d=%016llX", n, pa);
 
-         gpioStats.cbCalls++;
+      physical = 0x3FFFFFFF & (PAGE_SIZE * (pa & 0xFFFFFFFF));
 
-         lastPage = page;
+      if (physical)
+      {
+         dmaBus[basePage+n] = (dmaPage_t *) (physical | pi_dram_bus);
 
-         return (page*CBS_PER_IPAGE) + cb;
+         dmaVirt[basePage+n] = mmap
+         (
+            (void *)pageAdr,
+            PAGE_SIZE,
+            PROT_READ|PROT_WRITE,
+            MAP_SHARED|MAP_FIXED|MAP_LOCKED|MAP_NORESERVE,
+            fdMem,
+            physical
+         );
       }
+      else status = 1;
 
-      if (page++ >= DMAI_PAGES) page=0;
-
-      if (page == lastPage) break;
+      pageAdr += PAGE_SIZE;
    }
 
-   return 0;
+   return status;
 }
 
 /* ----------------------------------------------------------------------- */
 
-unsigned rawWaveCB(void)
+static int initPagemapBlock(int block)
 {
-   unsigned cb;
-   static unsigned lastPage=0;
-   unsigned page;
-   uint32_t cbAddr;
-
-   cbAddr = dmaOut[DMA_CONBLK_AD];
+   int trys, ok;
+   unsigned pageNum;
 
-   if (!cbAddr) return -1;
+   DBG(DBG_STARTUP, "block=%d", block);
 
-   page = lastPage;
+   dmaPMapBlk[block] = mmap(
+       0, (PAGES_PER_BLOCK*PAGE_SIZE),
+       PROT_READ|PROT_WRITE,
+       MAP_SHARED|MAP_ANONYMOUS|MAP_NORESERVE|MAP_LOCKED,
+       -1, 0);
 
-   /* which page are we dma'ing? */
+   if (dmaPMapBlk[block] == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap dma block %d failed (%m)", block);
 
-   while (1)
-   {
-      cb = (cbAddr - ((int)dmaOBus[page])) / 32;
+   /* force allocation of physical memory */
 
-      if (cb < CBS_PER_OPAGE)
-      {
-         lastPage = page;
+   memset((void *)dmaPMapBlk[block], 0xAA, (PAGES_PER_BLOCK*PAGE_SIZE));
 
-         return (page*CBS_PER_OPAGE) + cb;
-      }
+   memset((void *)dmaPMapBlk[block], 0xFF, (PAGES_PER_BLOCK*PAGE_SIZE));
 
-      if (page++ >= DMAO_PAGES) page=0;
+   memset((void *)dmaPMapBlk[block], 0, (PAGES_PER_BLOCK*PAGE_SIZE));
 
-      if (page == lastPage) break;
-   }
+   pageNum = block * PAGES_PER_BLOCK;
 
-   return 0;
-}
+   dmaVirt[pageNum] = mmap(
+       0, (PAGES_PER_BLOCK*PAGE_SIZE),
+       PROT_READ|PROT_WRITE,
+       MAP_SHARED|MAP_ANONYMOUS|MAP_NORESERVE|MAP_LOCKED,
+       -1, 0);
 
-/* ----------------------------------------------------------------------- */
+   if (dmaVirt[pageNum] == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap dma block %d failed (%m)", block);
 
-static unsigned dmaCurrentSlot(unsigned pos)
-{
-   unsigned cycle=0, slot=0, tmp;
+   munmap(dmaVirt[pageNum], PAGES_PER_BLOCK*PAGE_SIZE);
 
-   cycle = (pos/CBS_PER_CYCLE);
-   tmp   = (pos%CBS_PER_CYCLE);
+   trys = 0;
+   ok = 0;
 
-   if (tmp > 2) slot = ((tmp-2)/3);
+   while ((trys < 10) && !ok)
+   {
+      if (initZaps(fdPmap,
+                    dmaPMapBlk[block],
+                    pageNum,
+                    PAGES_PER_BLOCK) == 0) ok = 1;
+      else myGpioDelay(50000);
 
-   return (cycle*PULSE_PER_CYCLE)+slot;
-}
+      ++trys;
+   }
 
-/* ----------------------------------------------------------------------- */
+   if (!ok) SOFT_ERROR(PI_INIT_FAILED, "initZaps failed");
 
-static uint32_t dmaPwmDataAdr(int pos)
-{
-   return (uint32_t) &dmaIBus[pos]->periphData;
+   return 0;
 }
 
-/* ----------------------------------------------------------------------- */
-
-static uint32_t dmaGpioOnAdr(int pos)
+static int initMboxBlock(int block)
 {
-   int page, slot;
-
-   page = pos/ON_PER_IPAGE;
-   slot = pos%ON_PER_IPAGE;
-
-   return (uint32_t) &dmaIBus[page]->gpioOn[slot];
-}
-
-/* ----------------------------------------------------------------------- */
+   int n, ok;
+   unsigned page;
+   uintptr_t virtualAdr;
+   uintptr_t busAdr;
 
-static uint32_t dmaGpioOffAdr(int pos)
-{
-   int page, slot;
+   DBG(DBG_STARTUP, "block=%d", block);
 
-   myOffPageSlot(pos, &page, &slot);
+   ok = mbDMAAlloc
+      (&dmaMboxBlk[block], PAGES_PER_BLOCK * PAGE_SIZE, pi_mem_flag);
 
-   return (uint32_t) &dmaIBus[page]->gpioOff[slot];
-}
+   if (!ok) SOFT_ERROR(PI_INIT_FAILED, "init mbox zaps failed");
 
-/* ----------------------------------------------------------------------- */
+   page = block * PAGES_PER_BLOCK;
 
-static uint32_t dmaTickAdr(int pos)
-{
-   int page, slot;
+   virtualAdr = (uintptr_t) dmaMboxBlk[block].virtual_addr;
+   busAdr = dmaMboxBlk[block].bus_addr;
 
-   myTckPageSlot(pos, &page, &slot);
+   for (n=0; n<PAGES_PER_BLOCK; n++)
+   {
+      dmaVirt[page+n] = (dmaPage_t *) virtualAdr;
+      dmaBus[page+n] = (dmaPage_t *) busAdr;
+      virtualAdr += PAGE_SIZE;
+      busAdr += PAGE_SIZE;
+   }
 
-   return (uint32_t) &dmaIBus[page]->tick[slot];
+   return 0;
 }
 
 /* ----------------------------------------------------------------------- */
 
-static uint32_t dmaReadLevelsAdr(int pos)
+static int initAllocDMAMem(void)
 {
-   int page, slot;
-
-   myLvsPageSlot(pos, &page, &slot);
+   int i, servoCycles, superCycles;
+   int status;
 
-   return (uint32_t) &dmaIBus[page]->level[slot];
-}
+   DBG(DBG_STARTUP, "");
 
-/* ----------------------------------------------------------------------- */
+   /* Calculate the number of blocks needed for buffers.  The number
+      of blocks must be a multiple of the 20ms servo cycle.
+   */
 
-static uint32_t dmaCbAdr(int pos)
-{
-   int page, slot;
+   servoCycles = gpioCfg.bufferMilliseconds / 20;
+   if           (gpioCfg.bufferMilliseconds % 20) servoCycles++;
 
-   page = (pos/CBS_PER_IPAGE);
-   slot = (pos%CBS_PER_IPAGE);
+   bufferCycles = (SUPERCYCLE * servoCycles) / gpioCfg.clockMicros;
 
-   return (uint32_t) &dmaIBus[page]->cb[slot];
-}
+   superCycles = bufferCycles / SUPERCYCLE;
+   if           (bufferCycles % SUPERCYCLE) superCycles++;
 
-/* ----------------------------------------------------------------------- */
+   bufferCycles = SUPERCYCLE * superCycles;
 
-static void dmaGpioOnCb(int b, int pos)
-{
-   rawCbs_t * p;
+   bufferBlocks = bufferCycles / CYCLES_PER_BLOCK;
 
-   p = dmaCB2adr(b);
+   DBG(DBG_STARTUP, "bmillis=%d mics=%d bblk=%d bcyc=%d",
+      gpioCfg.bufferMilliseconds, gpioCfg.clockMicros,
+      bufferBlocks, bufferCycles);
 
-   p->info   = NORMAL_DMA;
-   p->src    = dmaGpioOnAdr(pos);
-   p->dst    = ((GPIO_BASE + (GPSET0*4)) & 0x00ffffff) | PI_PERI_BUS;
-   p->length = 4;
-   p->next   = dmaCbAdr(b+1);
-}
+   /* allocate memory for pointers to virtual and bus memory pages */
 
-/* ----------------------------------------------------------------------- */
+   dmaVirt = mmap(
+       0, PAGES_PER_BLOCK*DMA_BLOCKS*sizeof(dmaPage_t *),
+       PROT_READ|PROT_WRITE,
+       MAP_PRIVATE|MAP_ANONYMOUS|MAP_LOCKED,
+       -1, 0);
 
-static void dmaTickCb(int b, int pos)
-{
-   rawCbs_t * p;
+   if (dmaVirt == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap dma virtual failed (%m)");
 
-   p = dmaCB2adr(b);
+   dmaBus = mmap(
+       0, PAGES_PER_BLOCK*DMA_BLOCKS*sizeof(dmaPage_t *),
+       PROT_READ|PROT_WRITE,
+       MAP_PRIVATE|MAP_ANONYMOUS|MAP_LOCKED,
+       -1, 0);
 
-   p->info   = NORMAL_DMA;
-   p->src    = ((SYST_BASE + (SYST_CLO*4)) & 0x00ffffff) | PI_PERI_BUS;
-   p->dst    = dmaTickAdr(pos);
-   p->length = 4;
-   p->next   = dmaCbAdr(b+1);
-}
+   if (dmaBus == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap dma bus failed (%m)");
 
-/* ----------------------------------------------------------------------- */
+   dmaIVirt = (dmaIPage_t **) dmaVirt;
+   dmaIBus  = (dmaIPage_t **) dmaBus;
 
-static void dmaGpioOffCb(int b, int pos)
-{
-   rawCbs_t * p;
+   dmaOVirt = (dmaOPage_t **)(dmaVirt + (PAGES_PER_BLOCK*bufferBlocks));
+   dmaOBus  = (dmaOPage_t **)(dmaBus  + (PAGES_PER_BLOCK*bufferBlocks));
 
-   p = dmaCB2adr(b);
+   if (PI_SIM)
+   {
+      /* ordinary memory, the bus addresses are seen by simDmaRun only */
 
-   p->info   = NORMAL_DMA;
-   p->src    = dmaGpioOffAdr(pos);
-   p->dst    = ((GPIO_BASE + (GPCLR0*4)) & 0x00ffffff) | PI_PERI_BUS;
-   p->length = 4;
-   p->next   = dmaCbAdr(b+1);
-}
+      for (i=0; i<DMA_BLOCKS; i++)
+      {
+         status = initSimBlock(i);
+         if (status < 0) return status;
+      }
 
-/* ----------------------------------------------------------------------- */
+      simPages = PAGES_PER_BLOCK*DMA_BLOCKS;
+   }
+   else if ((gpioCfg.memAllocMode == PI_MEM_ALLOC_PAGEMAP) ||
+       ((gpioCfg.memAllocMode == PI_MEM_ALLOC_AUTO) &&
+        (gpioCfg.bufferMilliseconds > PI_DEFAULT_BUFFER_MILLIS)))
+   {
+      /* pagemap allocation of DMA memory */
 
-static void dmaReadLevelsCb(int b, int pos)
-{
-   rawCbs_t * p;
+      dmaPMapBlk = mmap(
+          0, DMA_BLOCKS*sizeof(dmaPage_t *),
+          PROT_READ|PROT_WRITE,
+          MAP_PRIVATE|MAP_ANONYMOUS|MAP_LOCKED,
+          -1, 0);
 
-   p = dmaCB2adr(b);
+      if (dmaPMapBlk == MAP_FAILED)
+         SOFT_ERROR(PI_INIT_FAILED, "pagemap mmap block failed (%m)");
 
-   p->info   = NORMAL_DMA;
-   p->src    = ((GPIO_BASE + (GPLEV0*4)) & 0x00ffffff) | PI_PERI_BUS;
-   p->dst    = dmaReadLevelsAdr(pos);
-   p->length = 4;
-   p->next   = dmaCbAdr(b+1);
-}
+      fdPmap = open("/proc/self/pagemap", O_RDONLY);
 
-/* ----------------------------------------------------------------------- */
+      if (fdPmap < 0)
+         SOFT_ERROR(PI_INIT_FAILED, "pagemap open failed(%m)");
 
-static void dmaDelayCb(int b)
-{
-   rawCbs_t * p;
+      for (i=0; i<DMA_BLOCKS; i++)
+      {
+         status = initPagemapBlock(i);
+         if (status < 0)
+         {
+            close(fdPmap);
+            return status;
+         }
+      }
 
-   p = dmaCB2adr(b);
+      close(fdPmap);
 
-   if (gpioCfg.clockPeriph == PI_CLOCK_PCM)
-   {
-      p->info = NORMAL_DMA | TIMED_DMA(2);
-      p->dst  = PCM_TIMER;
+      DBG(DBG_STARTUP, "dmaPMapBlk=%08X dmaIn=%08X",
+         (uint32_t)dmaPMapBlk, (uint32_t)dmaIn);
    }
    else
    {
-      p->info = NORMAL_DMA | TIMED_DMA(5);
-      p->dst  = PWM_TIMER;
-   }
+      /* mailbox allocation of DMA memory */
 
-   p->src    = dmaPwmDataAdr(b%DMAI_PAGES);
-   p->length = 4;
-   p->next   = dmaCbAdr(b+1);
-}
+      dmaMboxBlk = mmap(
+          0, DMA_BLOCKS*sizeof(DMAMem_t),
+          PROT_READ|PROT_WRITE,
+          MAP_PRIVATE|MAP_ANONYMOUS|MAP_LOCKED,
+          -1, 0);
 
-/* ----------------------------------------------------------------------- */
+      if (dmaMboxBlk == MAP_FAILED)
+         SOFT_ERROR(PI_INIT_FAILED, "mmap mbox block failed (%m)");
 
-static void dmaInitCbs(void)
-{
-   int b, pulse, level, cycle;
+      fdMbox = mbOpen();
 
-   rawCbs_t * p;
+      if (fdMbox < 0)
+         SOFT_ERROR(PI_INIT_FAILED, "mbox open failed(%m)");
 
-   /* set up the DMA control blocks */
+      for (i=0; i<DMA_BLOCKS; i++)
+      {
+         status = initMboxBlock(i);
+         if (status < 0)
+         {
+            mbClose(fdMbox);
+            return status;
+         }
+      }
 
-   DBG(DBG_STARTUP, "");
+      mbClose(fdMbox);
 
-   gpioStats.dmaInitCbsCount++;
+      DBG(DBG_STARTUP, "dmaMboxBlk=%08X dmaIn=%08X",
+         (uint32_t)dmaMboxBlk, (uint32_t)dmaIn);
+   }
 
-   b = -1;
-   level = 0;
+   DBG(DBG_STARTUP,
+      "gpioReg=%08X pwmReg=%08X pcmReg=%08X clkReg=%08X auxReg=%08X",
+      (uint32_t)gpioReg, (uint32_t)pwmReg,
+      (uint32_t)pcmReg,  (uint32_t)clkReg, (uint32_t)auxReg);
 
-   for (cycle=0; cycle<bufferCycles; cycle++)
+   for (i=0; i<DMAI_PAGES; i++)
+      DBG(DBG_STARTUP, "dmaIBus[%d]=%08X", i, (uint32_t)dmaIBus[i]);
+
+   if (gpioCfg.dbgLevel >= DBG_DMACBS)
    {
-      b++; dmaGpioOnCb(b, cycle%SUPERCYCLE); /* gpio on slot */
+      fprintf(stderr, "*** INPUT DMA CONTROL BLOCKS ***\n");
+      for (i=0; i<NUM_CBS; i++) dmaCbPrint(i);
+   }
 
-      b++; dmaTickCb(b, cycle);              /* tick slot */
+   return 0;
+}
 
-      for (pulse=0; pulse<PULSE_PER_CYCLE; pulse++)
-      {
-         b++; dmaReadLevelsCb(b, level);               /* read levels slot */
+/* ----------------------------------------------------------------------- */
 
-         b++; dmaDelayCb(b);                           /* delay slot */
+static void initPWM(unsigned bits)
+{
+   DBG(DBG_STARTUP, "bits=%d", bits);
 
-         b++; dmaGpioOffCb(b, (level%SUPERLEVEL)+1);   /* gpio off slot */
+   /* reset PWM */
 
-         ++level;
-      }
-   }
+   pwmReg[PWM_CTL] = 0;
 
-   /* point last cb back to first for continuous loop */
+   myGpioDelay(10);
 
-   p = dmaCB2adr(b);
+   pwmReg[PWM_STA] = -1;
 
-   p->next = dmaCbAdr(0);
+   myGpioDelay(10);
 
-   DBG(DBG_STARTUP, "DMA page type count = %d", sizeof(dmaIPage_t));
+   /* set number of bits to transmit */
 
-   DBG(DBG_STARTUP, "%d control blocks (exp=%d)", b+1, NUM_CBS);
-}
+   pwmReg[PWM_RNG1] = bits;
 
-/* ======================================================================= */
+   myGpioDelay(10);
 
+   dmaIVirt[0]->periphData = 1;
 
-static void sigHandler(int signum)
-{
-   if ((signum >= PI_MIN_SIGNUM) && (signum <= PI_MAX_SIGNUM))
-   {
-      if (gpioSignal[signum].func)
-      {
-         if (gpioSignal[signum].ex)
-         {
-            (gpioSignal[signum].func)(signum, gpioSignal[signum].userdata);
-         }
-         else
-         {
-            (gpioSignal[signum].func)(signum);
-         }
-      }
-      else
-      {
-         switch(signum)
-         {
-            case SIGUSR1:
+   /* enable PWM DMA, raise panic and dreq thresholds to 15 */
 
-               if (gpioCfg.dbgLevel > DBG_MIN_LEVEL) --gpioCfg.dbgLevel;
-               else gpioCfg.dbgLevel = DBG_MIN_LEVEL;
-               DBG(DBG_USER, "Debug level %d\n", gpioCfg.dbgLevel);
-               break;
+   pwmReg[PWM_DMAC] = PWM_DMAC_ENAB      |
+                      PWM_DMAC_PANIC(15) |
+                      PWM_DMAC_DREQ(15);
 
-            case SIGUSR2:
-               if (gpioCfg.dbgLevel < DBG_MAX_LEVEL) ++gpioCfg.dbgLevel;
-               else gpioCfg.dbgLevel = DBG_MAX_LEVEL;
-               DBG(DBG_USER, "Debug level %d\n", gpioCfg.dbgLevel);
-               break;
+   myGpioDelay(10);
 
-            case SIGPIPE:
-            case SIGWINCH:
-               DBG(DBG_USER, "signal %d ignored", signum);
-               break;
+   /* clear PWM fifo */
 
-            case SIGCHLD:
-               /* Used to notify threads of events */
-               break;
+   pwmReg[PWM_CTL] = PWM_CTL_CLRF1;
 
-            default:
-               DBG(DBG_ALWAYS, "Unhandled signal %d, terminating\n", signum);
-               gpioTerminate();
-               exit(-1);
-         }
-      }
-   }
-   else
-   {
-      /* exit */
+   myGpioDelay(10);
 
-      DBG(DBG_ALWAYS, "Unhandled signal %d, terminating\n", signum);
-      gpioTerminate();
-      exit(-1);
-   }
+   /* enable PWM channel 1 and use fifo */
+
+   pwmReg[PWM_CTL] = PWM_CTL_USEF1 | PWM_CTL_MODE1 | PWM_CTL_PWEN1;
 }
 
 /* ----------------------------------------------------------------------- */
 
-static void sigSetHandler(void)
+static void initPCM(unsigned bits)
 {
-   int i;
-   struct sigaction new;
+   DBG(DBG_STARTUP, "bits=%d", bits);
 
-   for (i=PI_MIN_SIGNUM; i<=PI_MAX_SIGNUM; i++)
-   {
+   /* disable PCM so we can modify the regs */
 
-      memset(&new, 0, sizeof(new));
-      new.sa_handler = sigHandler;
+   pcmReg[PCM_CS] = 0;
 
-      sigaction(i, &new, NULL);
-   }
-}
+   myGpioDelay(1000);
 
-unsigned alert_delays[]={
-   1000, 1068, 1145, 1235,
-   1339, 1463, 1613, 1796,
-   2027, 2326, 2727, 3297,
-   4167, 5660, 8823, 20000};
+   pcmReg[PCM_FIFO]   = 0;
+   pcmReg[PCM_MODE]   = 0;
+   pcmReg[PCM_RXC]    = 0;
+   pcmReg[PCM_TXC]    = 0;
+   pcmReg[PCM_DREQ]   = 0;
+   pcmReg[PCM_INTEN]  = 0;
+   pcmReg[PCM_INTSTC] = 0;
+   pcmReg[PCM_GRAY]   = 0;
 
-/* ======================================================================= */
+   myGpioDelay(1000);
 
-static void * pthAlertThread(void *x)
-{
-   struct timespec req, rem;
-   uint32_t oldLevel, newLevel, level, reportedLevel;
-   uint32_t oldSlot,  newSlot;
-   uint32_t tick, expected, nowTick;
-   int32_t diff;
-   int cycle, pulse;
-   int emit, seqno, emitted;
-   uint32_t changes, bits, changedBits, timeoutBits;
-   int numSamples, d;
-   int b, n, v;
-   int err;
-   int stopped;
-   int delayTicks;
-   uint32_t nextWakeTick;
-   int moreToDo;
-   int max_emits;
-   char fifo[32];
+   pcmReg[PCM_MODE] = PCM_MODE_FLEN(bits-1); /* # bits in frame */
 
-   req.tv_sec = 0;
+   /* enable channel 1 with # bits width */
 
-   /* don't start until DMA started */
+   pcmReg[PCM_TXC] = PCM_TXC_CH1EN | PCM_TXC_CH1WID(bits-8);
 
-   spinWhileStarting();
+   pcmReg[PCM_CS] |= PCM_CS_STBY; /* clear standby */
 
-   reportedLevel = gpioReg[GPLEV0];
+   myGpioDelay(1000);
 
-   oldSlot = dmaCurrentSlot(dmaNowAtICB());
+   pcmReg[PCM_CS] |= PCM_CS_TXCLR; /* clear TX FIFO */
 
-   cycle = (oldSlot/PULSE_PER_CYCLE);
-   pulse = (oldSlot%PULSE_PER_CYCLE);
+   pcmReg[PCM_CS] |= PCM_CS_DMAEN; /* enable DREQ */
 
-   stopped = 0;
+   pcmReg[PCM_DREQ] = PCM_DREQ_TX_PANIC(16) | PCM_DREQ_TX_REQ_L(30);
 
-   moreToDo = 0;
+   pcmReg[PCM_INTSTC] = 0b1111; /* clear status bits */
 
-   tick = systReg[SYST_CLO];
+   /* enable PCM */
 
-   nextWakeTick =
-      tick + alert_delays[(gpioCfg.internals>>PI_CFG_ALERT_FREQ)&15];
+   pcmReg[PCM_CS] |= PCM_CS_EN;
 
-   while (1)
-   {
-      newSlot = dmaCurrentSlot(dmaNowAtICB());
+   /* enable tx */
 
-      numSamples = 0;
+   pcmReg[PCM_CS] |= PCM_CS_TXON;
 
-      changedBits = 0;
+   dmaIVirt[0]->periphData = 0x0F;
+}
 
-      oldLevel = reportedLevel & monitorBits;
+/* ----------------------------------------------------------------------- */
 
-      while ((oldSlot != newSlot) && (numSamples < DATUMS))
+static void initHWClk
+   (int clkCtl, int clkDiv, int clkSrc, int divI, int divF, int MASH)
+{
+   DBG(DBG_INTERNAL, "ctl=%d div=%d src=%d /I=%d /f=%d M=%d",
+      clkCtl, clkDiv, clkSrc, divI, divF, MASH);
+
+   /* kill the clock if busy, anything else isn't reliable */
+
+   if (clkReg[clkCtl] & CLK_CTL_BUSY)
+   {
+      do
       {
-         level = myGetLevel(oldSlot++);
+         clkReg[clkCtl] = CLK_PASSWD | CLK_CTL_KILL;
+      }
+      while (clkReg[clkCtl] & CLK_CTL_BUSY);
+   }
+
+   clkReg[clkDiv] = (CLK_PASSWD | CLK_DIV_DIVI(divI) | CLK_DIV_DIVF(divF));
 
-         newLevel = (level & monitorBits);
+   usleep(10);
 
-         if (newLevel != oldLevel)
-         {
-            gpioSample[numSamples].tick  = tick;
-            gpioSample[numSamples].level = level;
+   clkReg[clkCtl] = (CLK_PASSWD | CLK_CTL_MASH(MASH) | CLK_CTL_SRC(clkSrc));
 
-            changedBits |= (newLevel ^ oldLevel);
+   usleep(10);
 
-            oldLevel = newLevel;
+   clkReg[clkCtl] |= (CLK_PASSWD | CLK_CTL_ENAB);
+}
 
-            numSamples++;
-         }
+static void initClock(int mainClock)
+{
+   const unsigned BITS=10;
+   int clockPWM;
+   unsigned clkCtl, clkDiv, clkSrc, clkDivI, clkDivF, clkMash, clkBits;
+   char *per;
+   unsigned micros;
 
-         tick += gpioCfg.clockMicros;
+   DBG(DBG_STARTUP, "mainClock=%d", mainClock);
 
-         if (++pulse >= PULSE_PER_CYCLE)
-         {
-            pulse = 0;
+   if (mainClock) micros = gpioCfg.clockMicros;
+   else           micros = PI_WF_MICROS;
 
-            if (++cycle >= bufferCycles)
-            {
-               cycle = 0;
-               oldSlot = 0;
-            }
+   clockPWM = mainClock ^ (gpioCfg.clockPeriph == PI_CLOCK_PCM);
 
-            expected = tick;
+   if (clockPWM)
+   {
+      clkCtl = CLK_PWMCTL;
+      clkDiv = CLK_PWMDIV;
+      per = "PWM";
+   }
+   else
+   {
+      clkCtl = CLK_PCMCTL;
+      clkDiv = CLK_PCMDIV;
+      per = "PCM";
+   }
 
-            tick = myGetTick(cycle);
+   clkSrc  = CLK_CTL_SRC_PLLD;
+   clkDivI = 50 * micros; /* 10      MHz - 1      MHz */
+   clkBits = BITS;        /* 10/BITS MHz - 1/BITS MHz */
+   clkDivF = 0;
+   clkMash = 0;
 
-            diff = tick - expected;
+   DBG(DBG_STARTUP, "%s PLLD divi=%d divf=%d mash=%d bits=%d",
+      per, clkDivI, clkDivF, clkMash, clkBits);
 
-            diff += (TICKSLOTS/2);
+   initHWClk(clkCtl, clkDiv, clkSrc, clkDivI, clkDivF, clkMash);
 
-            if (diff < 0)
-            {
-               gpioStats.diffTick[0]++;
-            }
+   if (clockPWM) initPWM(BITS);
+   else          initPCM(BITS);
 
-            else if (diff >= TICKSLOTS)
-            {
-               gpioStats.diffTick[TICKSLOTS-1]++;
-            }
+   myGpioDelay(2000);
+}
 
-            else gpioStats.diffTick[diff]++;
-         }
-      }
+/* ----------------------------------------------------------------------- */
 
-      if (oldSlot == newSlot) moreToDo = 0; else moreToDo = 1;
+static void initDMAgo(volatile uint32_t  *dmaAddr, uint32_t cbAddr)
+{
+   DBG(DBG_STARTUP, "");
 
-      /* should gpioGetSamples be called */
+   dmaAddr[DMA_CS] = DMA_CHANNEL_RESET;
 
-      if (changedBits)
-      {
-         if (gpioGetSamples.func)
-         {
-            if (gpioGetSamples.ex)
-            {
-               (gpioGetSamples.func)
-                  (gpioSample, numSamples, gpioGetSamples.userdata);
-            }
-            else
-            {
-               (gpioGetSamples.func)
-                  (gpioSample, numSamples);
-            }
-         }
-      }
+   dmaAddr[DMA_CS] = DMA_INTERRUPT_STATUS | DMA_END_FLAG;
 
-      /* reset timeouts for any changed bits */
+   dmaAddr[DMA_CONBLK_AD] = cbAddr;
 
-      if (changedBits)
-      {
-         for (b=0; b<=PI_MAX_USER_GPIO; b++)
-         {
-            if (changedBits & (1<<b)) gpioAlert[b].tick = tick;
-         }
-      }
+   /* clear READ/FIFO/READ_LAST_NOT_SET error bits */
 
-      /* call alert callbacks for each bit transition */
+   dmaAddr[DMA_DEBUG] = DMA_DEBUG_READ_ERR            |
+                        DMA_DEBUG_FIFO_ERR            |
+                        DMA_DEBUG_RD_LST_NOT_SET_ERR;
 
-      if (changedBits & alertBits)
-      {
-         oldLevel = reportedLevel & alertBits;
 
-         for (d=0; d<numSamples; d++)
-         {
-            newLevel = gpioSample[d].level & alertBits;
+   dmaAddr[DMA_CS] = DMA_WAIT_ON_WRITES    |
+                     DMA_PANIC_PRIORITY(8) |
+                     DMA_PRIORITY(8)       |
+                     DMA_ACTIVATE;
+}
 
-            if (newLevel != oldLevel)
-            {
-               changes = newLevel ^ oldLevel;
+/* ----------------------------------------------------------------------- */
 
-               for (b=0; b<=PI_MAX_USER_GPIO; b++)
-               {
-                  if (changes & (1<<b))
-                  {
-                     if (newLevel & (1<<b)) v = 1; else v = 0;
+static void initClearGlobals(void)
+{
+   int i;
 
-                     if (gpioAlert[b].func)
-                     {
-                        if (gpioAlert[b].ex)
-                        {
-                           (gpioAlert[b].func)
-                              (b, v, gpioSample[d].tick,
-                               gpioAlert[b].userdata);
-                        }
-                        else
-                        {
-                           (gpioAlert[b].func)
-                              (b, v, gpioSample[d].tick);
-                        }
-                     }
-                  }
-               }
-               oldLevel = newLevel;
-            }
-         }
-      }
+   DBG(DBG_STARTUP, "");
 
-      /* check for timeout watchdogs */
+   alertBits   = 0;
+   monitorBits = 0;
 
-      timeoutBits = 0;
+   srxBits   = 0;
+   srxActive = 0;
+   srxInvert = 0;
+   srxPos    = 0;
+   notifyBits  = 0;
+   scriptBits  = 0;
+   wdogBits    = 0;
 
-      for (b=0; b<=PI_MAX_USER_GPIO; b++)
-      {
-         if (gpioAlert[b].timeout)
-         {
-            diff = tick - gpioAlert[b].tick;
+   pthAlertRunning  = 0;
+   pthFifoRunning   = 0;
+   pthSocketRunning = 0;
 
-            if (diff > (gpioAlert[b].timeout*1000))
-            {
-               timeoutBits |= (1<<b);
+   waveReset();
 
-               gpioAlert[b].tick += (gpioAlert[b].timeout*1000);
+   wfStats.micros     = 0;
+   wfStats.highMicros = 0;
+   wfStats.maxMicros  = PI_WAVE_MAX_MICROS;
 
-               if (gpioAlert[b].func)
-               {
-                  if (gpioAlert[b].ex)
-                  {
-                     (gpioAlert[b].func)
-                        (b, PI_TIMEOUT, tick, gpioAlert[b].userdata);
-                  }
-                  else
-                  {
-                     (gpioAlert[b].func)
-                        (b, PI_TIMEOUT, tick);
-                  }
-               }
-            }
-         }
-      }
+   wfStats.pulses     = 0;
+   wfStats.highPulses = 0;
+   wfStats.maxPulses  = PI_WAVE_MAX_PULSES;
 
-      for (n=0; n<PI_NOTIFY_SLOTS; n++)
-      {
-         if (gpioNotify[n].state == PI_NOTIFY_CLOSING)
-         {
-            if (gpioNotify[n].pipe)
-            {
-               close(gpioNotify[n].fd);
+   wfStats.cbs        = 0;
+   wfStats.highCbs    = 0;
+   wfStats.maxCbs     = (PI_WAVE_BLOCKS * PAGES_PER_BLOCK * CBS_PER_OPAGE);
 
-               sprintf(fifo, "/dev/pigpio%d", n);
+   gpioGetSamples.func     = NULL;
+   gpioGetSamples.ex       = 0;
+   gpioGetSamples.userdata = NULL;
+   gpioGetSamples.bits     = 0;
 
-               unlink(fifo);
-            }
+   for (i=0; i<=PI_MAX_USER_GPIO; i++)
+   {
+      wfRx[i].mode         = PI_WFRX_NONE;
 
-            gpioNotify[n].state = PI_NOTIFY_CLOSED;
-         }
-         else if (gpioNotify[n].state == PI_NOTIFY_RUNNING)
-         {
-            bits = gpioNotify[n].bits;
+      gpioAlert[i].func    = NULL;
+   }
 
-            emit = 0;
+   for (i=0; i<=PI_MAX_GPIO; i++)
+   {
+      gpioInfo [i].is      = GPIO_UNDEFINED;
+      gpioInfo [i].width   = 0;
+      gpioInfo [i].range   = PI_DEFAULT_DUTYCYCLE_RANGE;
+      gpioInfo [i].freqIdx = DEFAULT_PWM_IDX;
+   }
 
-            seqno = gpioNotify[n].seqno;
+   for (i=0; i<PI_NOTIFY_SLOTS; i++)
+   {
+      gpioNotify[i].seqno  = 0;
+      gpioNotify[i].state  = PI_NOTIFY_CLOSED;
+      gpioNotify[i].writer = 0;
+   }
 
-            /* check to see if any bits have changed for this
-               notification.
+   for (i=0; i<=PI_MAX_SIGNUM; i++)
+   {
+      gpioSignal[i].func     = NULL;
+      gpioSignal[i].ex       = 0;
+      gpioSignal[i].userdata = NULL;
+   }
 
-               bits        is the set of notification bits
-               changedBits is the set of changed bits
-            */
+   for (i=0; i<PI_TIMER_SLOTS; i++)
+   {
+      gpioTimer[i].running = 0;
+      gpioTimer[i].func    = NULL;
+      gpioTimer[i].list    = TW_NONE;
+   }
 
-            if (changedBits & bits)
-            {
-               oldLevel = reportedLevel & bits;
+   for (i=0; i<TW_LISTS; i++) twHead[i] = TW_NONE;
 
-               for (d=0; d<numSamples; d++)
-               {
-                  newLevel = gpioSample[d].level & bits;
+   memset(twBits, 0, sizeof(twBits));
 
-                  if (newLevel != oldLevel)
-                  {
-                     gpioReport[emit].seqno = seqno;
-                     gpioReport[emit].flags = 0;
-                     gpioReport[emit].tick  = gpioSample[d].tick;
-                     gpioReport[emit].level = gpioSample[d].level;
+   memset(pwmOnCur,  0, sizeof(pwmOnCur));
+   memset(pwmOnNew,  0, sizeof(pwmOnNew));
+   memset(pwmOffCur, 0, sizeof(pwmOffCur));
+   memset(pwmOffNew, 0, sizeof(pwmOffNew));
+   memset(pwmDirty,  0, sizeof(pwmDirty));
 
-                     oldLevel = newLevel;
+   for (i=0; i<PI_GROUP_SLOTS; i++) groupInfo[i].state = PI_GROUP_CLOSED;
 
-                     emit++;
-                     seqno++;
-                  }
-               }
-            }
+   pwmStaging  = 0;
+   pwmOwner    = NULL;
+   pwmPeriod   = 1;
+   pwmStopBits = 0;
+   pwmHoldBits = 0;
 
-            /* check to see if any watchdogs are due for this
-               notification.
+   /* calculate the usable PWM frequencies */
 
-               bits        is the set of notification bits
-               timeoutBits is the set of timed out bits
-            */
+   for (i=0; i<PWM_FREQS; i++)
+   {
+      pwmFreq[i]=
+         (1000000.0/
+            ((float)PULSE_PER_CYCLE*gpioCfg.clockMicros*pwmCycles[i]))+0.5;
 
-            if (timeoutBits & bits)
-            {
-               /* at least one watchdog has fired for this
-                  notification.
-               */
+      DBG(DBG_STARTUP, "f%d is %d", i, pwmFreq[i]);
+   }
 
-               for (b=0; b<=PI_MAX_USER_GPIO; b++)
-               {
-                  if (timeoutBits & bits & (1<<b))
-                  {
-                     if (numSamples)
-                        newLevel = gpioSample[numSamples-1].level;
-                     else
-                        newLevel = reportedLevel;
+   inpFifo = NULL;
+   outFifo = NULL;
 
-                     gpioReport[emit].seqno = seqno;
-                     gpioReport[emit].flags = PI_NTFY_FLAGS_WDOG |
-                                              PI_NTFY_FLAGS_BIT(b);
-                     gpioReport[emit].tick  = tick;
-                     gpioReport[emit].level = newLevel;
+   fdLock  = -1;
+   fdMem   = -1;
+   fdSock  = -1;
+   fdEpoll = -1;
 
-                     emit++;
-                     seqno++;
-                  }
-               }
-            }
+   sockClients = 0;
+   sockBusy    = 0;
 
-            if (!emit)
-            {
-               if ((tick - gpioNotify[n].lastReportTick) > 60000000)
-               {
-                  if (numSamples)
-                     newLevel = gpioSample[numSamples-1].level;
-                  else
-                     newLevel = reportedLevel;
+   dmaMboxBlk = MAP_FAILED;
+   dmaPMapBlk = MAP_FAILED;
+   dmaVirt = MAP_FAILED;
+   dmaBus  = MAP_FAILED;
 
-                  gpioReport[emit].seqno = seqno;
-                  gpioReport[emit].flags = PI_NTFY_FLAGS_ALIVE;
-                  gpioReport[emit].tick  = tick;
-                  gpioReport[emit].level = newLevel;
+   auxReg  = MAP_FAILED;
+   clkReg  = MAP_FAILED;
+   dmaReg  = MAP_FAILED;
+   gpioReg = MAP_FAILED;
+   pcmReg  = MAP_FAILED;
+   pwmReg  = MAP_FAILED;
+   systReg = MAP_FAILED;
+   spiReg  = MAP_FAILED;
+}
 
-                  emit++;
-                  seqno++;
-               }
-            }
+/* ----------------------------------------------------------------------- */
 
-            if (emit)
-            {
-               gpioNotify[n].lastReportTick = tick;
-               max_emits = gpioNotify[n].max_emits;
+static void initReleaseResources(void)
+{
+   int i;
 
-               if (emit > gpioStats.maxEmit) gpioStats.maxEmit = emit;
+   DBG(DBG_STARTUP, "");
 
-               emitted = 0;
+   /* shut down running threads */
 
-               while (emit > 0)
-               {
-                  if (emit > max_emits)
-                  {
-                     gpioStats.emitFrags++;
+   twStop();
 
-                     err = write(gpioNotify[n].fd,
-                              gpioReport+emitted,
-                              max_emits*sizeof(gpioReport_t));
+   wsStop();
 
-                     if (err != (max_emits*sizeof(gpioReport_t)))
-                     {
-                        if (err < 0)
-                        {
-                           if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
-                           {
-                              /* serious error, no point continuing */
-
-                              DBG(DBG_ALWAYS, "fd=%d err=%d errno=%d",
-                                 gpioNotify[n].fd, err, errno);
-
-                              DBG(DBG_ALWAYS, "%s", strerror(errno));
-
-                              gpioNotify[n].bits  = 0;
-                              gpioNotify[n].state = PI_NOTIFY_CLOSING;
-                              intNotifyBits();
-                              break;
-                           }
-                           else gpioStats.wouldBlockPipeWrite++;
-                        }
-                        else
-                        {
-                           gpioCfg.internals |= PI_CFG_STATS;
-                           gpioStats.shortPipeWrite++;
-                           DBG(DBG_ALWAYS, "emitted %d, asked for %d",
-                              err/sizeof(gpioReport_t), max_emits);
-                        }
-                     }
-                     else gpioStats.goodPipeWrite++;
+   if (pthAlertRunning)
+   {
+      pthread_cancel(pthAlert);
+      pthread_join(pthAlert, NULL);
+      pthAlertRunning = 0;
+   }
 
-                     emitted += max_emits;
-                     emit    -= max_emits;
-                  }
-                  else
-                  {
-                     err = write(gpioNotify[n].fd,
-                              gpioReport+emitted,
-                              emit*sizeof(gpioReport_t));
+   capStop();
 
-                     if (err != (emit*sizeof(gpioReport_t)))
-                     {
-                        if (err < 0)
-                        {
-                           if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
-                           {
-                              DBG(DBG_ALWAYS, "fd=%d err=%d errno=%d",
-                                 gpioNotify[n].fd, err, errno);
-
-                              DBG(DBG_ALWAYS, "%s", strerror(errno));
-
-                              /* serious error, no point continuing */
-                              gpioNotify[n].bits  = 0;
-                              gpioNotify[n].state = PI_NOTIFY_CLOSING;
-                              intNotifyBits();
-                              break;
-                           }
-                           else gpioStats.wouldBlockPipeWrite++;
-                        }
-                        else
-                        {
-                           gpioCfg.internals |= PI_CFG_STATS;
-                           gpioStats.shortPipeWrite++;
-                           DBG(DBG_ALWAYS, "emitted %d, asked for %d",
-                              err/sizeof(gpioReport_t), emit);
-                        }
-                     }
-                     else gpioStats.goodPipeWrite++;
+   i2cQueueStop();
 
-                     emitted += emit;
-                     emit = 0;
-                  }
-               }
+   pollSPIStop();
 
-               gpioNotify[n].seqno = seqno;
-            }
-         }
-      }
+   memset(gpioPoll, 0, sizeof(gpioPoll));
 
-      if (changedBits & scriptBits)
+   for (i=0; i<PI_NOTIFY_SLOTS; i++)
+   {
+      if (gpioNotify[i].writer)
       {
-         for (n=0; n<PI_MAX_SCRIPTS; n++)
+         if (gpioNotify[i].state > PI_NOTIFY_CLOSING)
          {
-            if ((gpioScript[n].state     == PI_SCRIPT_IN_USE)  &&
-                (gpioScript[n].run_state == PI_SCRIPT_WAITING) &&
-                (gpioScript[n].waitBits & changedBits))
-            {
-               pthread_mutex_lock(&gpioScript[n].pthMutex);
+            gpioNotify[i].bits  = 0;
+            gpioNotify[i].state = PI_NOTIFY_CLOSING;
+         }
 
-               if (gpioScript[n].run_state == PI_SCRIPT_WAITING)
-               {
-                  gpioScript[n].changedBits =
-                     gpioScript[n].waitBits & changedBits;
-                  pthread_cond_signal(&gpioScript[n].pthCond);
-               }
+         pthread_mutex_lock(&notifyRing.mutex);
+         pthread_cond_broadcast(&notifyRing.cond);
+         pthread_mutex_unlock(&notifyRing.mutex);
 
-               pthread_mutex_unlock(&gpioScript[n].pthMutex);
-            }
-         }
+         notifyJoinWriter(i);
       }
+   }
 
-      /* once all outputs have been emitted set reported level */
+   if (pthFifoRunning)
+   {
+      pthread_cancel(pthFifo);
+      pthread_join(pthFifo, NULL);
+      pthFifoRunning = 0;
+   }
 
-      if (numSamples) reportedLevel = gpioSample[numSamples-1].level;
+   if (pthSocketRunning)
+   {
+      pthread_cancel(pthSocket);
+      pthread_join(pthSocket, NULL);
+      pthSocketRunning = 0;
+   }
 
-      if (numSamples > gpioStats.maxSamples)
-         gpioStats.maxSamples = numSamples;
+   /* no more workers once stopping */
 
-      gpioStats.numSamples += numSamples;
+   pthread_mutex_lock(&sockWorkerMutex);
+   sockStopping = 1;
+   pthread_mutex_unlock(&sockWorkerMutex);
 
-      /* Check that DMA is running okay */
+   for (i=0; i<sockWorkers; i++)
+   {
+      pthread_cancel(pthSocketWorkers[i]);
+      pthread_join(pthSocketWorkers[i], NULL);
+   }
 
-      if (dmaIn[DMA_CONBLK_AD])
-      {
-         if (stopped)
-         {
-            DBG(DBG_STARTUP, "****** GOING ******");
-            stopped = 0;
-         }
-      }
-      else
-      {
-         stopped = 1;
+   sockWorkers = 0;
 
-         myGpioDelay(5000);
+   isrStop();
 
-         if (runState == PI_RUNNING)
-         {
-            /* should never be executed, leave code just in case */
+   serStop();
 
-            gpioCfg.internals |= PI_CFG_STATS;
+   simStop();
 
-            dmaInitCbs();
-            flushMemory();
-            initDMAgo((uint32_t *)dmaIn, (uint32_t)dmaIBus[0]);
-            myGpioDelay(5000); /* let DMA run for a while */
-            oldSlot = dmaCurrentSlot(dmaNowAtICB());
-            gpioStats.DMARestarts++;
-         }
-      }
+   /* release mmap'd memory */
 
-      nowTick = systReg[SYST_CLO];
+   if (auxReg  != MAP_FAILED) munmap((void *)auxReg,  AUX_LEN);
+   if (clkReg  != MAP_FAILED) munmap((void *)clkReg,  CLK_LEN);
+   if (dmaReg  != MAP_FAILED) munmap((void *)dmaReg,  DMA_LEN);
+   if (gpioReg != MAP_FAILED) munmap((void *)gpioReg, GPIO_LEN);
+   if (pcmReg  != MAP_FAILED) munmap((void *)pcmReg,  PCM_LEN);
+   if (pwmReg  != MAP_FAILED) munmap((void *)pwmReg,  PWM_LEN);
+   if (systReg != MAP_FAILED) munmap((void *)systReg, SYST_LEN);
+   if (spiReg  != MAP_FAILED) munmap((void *)spiReg,  SPI_LEN);
 
-      if (moreToDo)
-      {
-         gpioStats.moreToDo++;
+   auxReg  = MAP_FAILED;
+   clkReg  = MAP_FAILED;
+   dmaReg  = MAP_FAILED;
+   gpioReg = MAP_FAILED;
+   pcmReg  = MAP_FAILED;
+   pwmReg  = MAP_FAILED;
+   systReg = MAP_FAILED;
+   spiReg  = MAP_FAILED;
 
-         /* rebase wake up time */
+   if (dmaBus != MAP_FAILED)
+   {
+      munmap(dmaBus,
+         PAGES_PER_BLOCK*DMA_BLOCKS*sizeof(dmaPage_t *));
+   }
 
-         nextWakeTick = nowTick +
-            alert_delays[(gpioCfg.internals>>PI_CFG_ALERT_FREQ)&15];
+   dmaBus = MAP_FAILED;
 
-         req.tv_nsec = 0;
-      }
-      else
+   if (dmaVirt != MAP_FAILED)
+   {
+      for (i=0; i<PAGES_PER_BLOCK*DMA_BLOCKS; i++)
       {
-         delayTicks = nextWakeTick - nowTick;
+         munmap(dmaVirt[i], PAGE_SIZE);
+      }
 
-         if (delayTicks < 0)
-         {
-            gpioStats.lateTicks++;
+      munmap(dmaVirt,
+         PAGES_PER_BLOCK*DMA_BLOCKS*sizeof(dmaPage_t *));
+   }
 
-            /* rebase wake up time */
+   dmaVirt = MAP_FAILED;
 
-            nextWakeTick = nowTick +
-               alert_delays[(gpioCfg.internals>>PI_CFG_ALERT_FREQ)&15];
+   if (dmaPMapBlk != MAP_FAILED)
+   {
+      for (i=0; i<DMA_BLOCKS; i++)
+      {
+         munmap(dmaPMapBlk[i], PAGES_PER_BLOCK*PAGE_SIZE);
+      }
 
-            req.tv_nsec = 0;
-         }
-         else
-         {
-            gpioStats.alertTicks++;
+      munmap(dmaPMapBlk, DMA_BLOCKS*sizeof(dmaPage_t *));
+   }
 
-            nextWakeTick +=
-               alert_delays[(gpioCfg.internals>>PI_CFG_ALERT_FREQ)&15];
+   dmaPMapBlk = MAP_FAILED;
 
-            req.tv_nsec = (delayTicks * 1000);
-         }
-      }
+   if (dmaMboxBlk != MAP_FAILED)
+   {
+      fdMbox = mbOpen();
 
-      if (req.tv_nsec)
+      for (i=0; i<DMA_BLOCKS; i++)
       {
-         req.tv_sec = 0;
-
-         while (nanosleep(&req, &rem))
-         {
-            req.tv_sec  = rem.tv_sec;
-            req.tv_nsec = rem.tv_nsec;
-         }
+         mbDMAFree(&dmaMboxBlk[DMA_BLOCKS-i-1]);
       }
 
-      nextWakeTick +=
-         alert_delays[(gpioCfg.internals>>PI_CFG_ALERT_FREQ)&15];
+      mbClose(fdMbox);
 
+      munmap(dmaMboxBlk, DMA_BLOCKS*sizeof(DMAMem_t));
    }
 
-   return 0;
-}
-
-/* ======================================================================= */
+   dmaMboxBlk = MAP_FAILED;
 
-static int scrPop(gpioScript_t *s, int *SP, int *S)
-{
-   if ((*SP) > 0)
+   if (inpFifo != NULL)
    {
-      return S[--(*SP)];
+      fclose(inpFifo);
+      unlink(PI_INPFIFO);
+      inpFifo = NULL;
    }
-   else
+
+   if (outFifo != NULL)
    {
-      s->run_state = PI_SCRIPT_FAILED;
-      DBG(DBG_ALWAYS, "script %d too many pops", s->id);
-      return 0;
+      fclose(outFifo);
+      unlink(PI_OUTFIFO);
+      outFifo = NULL;
    }
-}
-
-/* ----------------------------------------------------------------------- */
 
-static void scrPush(gpioScript_t *s, int *SP, int *S, int val)
-{
-   if ((*SP) < PI_SCRIPT_STACK_SIZE)
+   if (fdMem != -1)
    {
-      S[(*SP)++] = val;
+      close(fdMem);
+      fdMem = -1;
    }
-   else
+
+   if (fdLock != -1)
    {
-      s->run_state = PI_SCRIPT_FAILED;
-      DBG(DBG_ALWAYS, "script %d too many pushes", s->id);
+      close(fdLock);
+      unlink(PI_LOCKFILE);
+      fdLock = -1;
    }
-}
-
-/* ----------------------------------------------------------------------- */
-
-static void scrSwap(int *v1, int *v2)
-{
-   int t;
-
-   t=*v1; *v1=*v2; *v2= t;
-}
-
-/* ----------------------------------------------------------------------- */
 
-static int scrWait(gpioScript_t *s, uint32_t bits)
-{
-   pthread_mutex_lock(&s->pthMutex);
-
-   if (s->request == PI_SCRIPT_RUN)
+   if (fdSock != -1)
    {
-      s->run_state = PI_SCRIPT_WAITING;
-      s->waitBits = bits;
-      intScriptBits();
+      close(fdSock);
+      fdSock = -1;
+   }
 
-      pthread_cond_wait(&s->pthCond, &s->pthMutex);
+   if (fdEpoll != -1)
+   {
+      close(fdEpoll);
+      fdEpoll = -1;
+   }
 
-      s->waitBits = 0;
-      intScriptBits();
-      s->run_state = PI_SCRIPT_RUNNING;
+   if (fdPmap != -1)
+   {
+      close(fdPmap);
+      fdPmap = -1;
    }
 
-   pthread_mutex_unlock(&s->pthMutex);
+   if (fdMbox != -1)
+   {
+      close(fdMbox);
+      fdMbox = -1;
+   }
 
-   return s->changedBits;
+   gpioStats.DMARestarts = 0;
+   gpioStats.dmaInitCbsCount = 0;
 }
 
-/* ----------------------------------------------------------------------- */
-
-static int scrSys(char *cmd, uint32_t p1, uint32_t p2)
+int initInitialise(void)
 {
-   char buf[256];
-   char pars[40];
+   int rev, i;
+   struct sockaddr_in server;
+   char * portStr;
+   unsigned port;
+   struct sched_param param;
+   pthread_attr_t pthAttr;
 
-   sprintf(pars, " %u %u", p1, p2);
-   strcpy(buf, "/opt/pigpio/cgi/");
-   strncat(buf, cmd, 200);
-   strcat(buf, pars);
+   DBG(DBG_STARTUP, "");
 
-   DBG(DBG_USER, "sys %s", buf);
+   waveClockInited = 0;
 
-   return system(buf);
-}
+   clock_gettime(CLOCK_REALTIME, &libStarted);
 
-/* ----------------------------------------------------------------------- */
+   rev = gpioHardwareRevision();
 
-static void *pthScript(void *x)
-{
-   gpioScript_t *s;
-   cmdInstr_t instr;
-   int p1, p2, p1o, p2o, *t1, *t2;
-   int PC, A, F, SP;
-   int S[PI_SCRIPT_STACK_SIZE];
-   char buf[CMD_MAX_EXTENSION];
+   initClearGlobals();
 
+   if (!PI_SIM)
+   {
+      if (initCheckPermitted() < 0) return PI_INIT_FAILED;
 
-   S[0] = 0; /* to prevent compiler warning */
+      fdLock = initGrabLockFile();
 
-   s = x;
+      if (fdLock < 0)
+         SOFT_ERROR(PI_INIT_FAILED, "Can't lock %s", PI_LOCKFILE);
+   }
 
-   while ((volatile int)s->request != PI_SCRIPT_DELETE)
+   if (!gpioMaskSet)
    {
-      pthread_mutex_lock(&s->pthMutex);
-      s->run_state = PI_SCRIPT_HALTED;
-      pthread_cond_wait(&s->pthCond, &s->pthMutex);
-      pthread_mutex_unlock(&s->pthMutex);
+      if      (rev ==  0) gpioMask = PI_DEFAULT_UPDATE_MASK_R0;
+      else if (rev == 17) gpioMask = PI_DEFAULT_UPDATE_MASK_COMPUTE;
+      else if (rev <   4) gpioMask = PI_DEFAULT_UPDATE_MASK_R1;
+      else if (rev <  16) gpioMask = PI_DEFAULT_UPDATE_MASK_R2;
+      else                gpioMask = PI_DEFAULT_UPDATE_MASK_R3;
 
-      s->run_state = PI_SCRIPT_RUNNING;
+      gpioMaskSet = 1;
+   }
 
-      A  = 0;
-      F  = 0;
-      PC = 0;
-      SP = 0;
+#ifndef EMBEDDED_IN_VM
+   sigSetHandler();
+#endif
 
-      while (((volatile int)s->request   == PI_SCRIPT_RUN    ) &&
-                           (s->run_state == PI_SCRIPT_RUNNING))
-      {
-         instr = s->script.instr[PC];
+   if (initPeripherals() < 0) return PI_INIT_FAILED;
 
-         p1o = instr.p[1];
-         p2o = instr.p[2];
+   if (initAllocDMAMem() < 0) return PI_INIT_FAILED;
 
-         if      (instr.opt[1] == CMD_VAR) instr.p[1] = s->script.var[p1o];
-         else if (instr.opt[1] == CMD_PAR) instr.p[1] = s->script.par[p1o];
+   spiDmaInitCbs();
 
-         if      (instr.opt[2] == CMD_VAR) instr.p[2] = s->script.var[p2o];
-         else if (instr.opt[2] == CMD_PAR) instr.p[2] = s->script.par[p2o];
-/*
-         fprintf(stderr, "PC=%d cmd=%d p1o=%d p1=%d p2o=%d p2=%d\n",
-            PC, instr.p[0], p1o, instr.p[1], p2o, instr.p[2]);
-         fflush(stderr);
-*/
-         if (instr.p[0] < 100)
-         {
-            if (instr.p[3])
-            {
-               memcpy(buf, (char *)instr.p[4], instr.p[3]);
-            }
+   /* done with /dev/mem */
 
-            A = myDoCommand(instr.p, sizeof(buf)-1, buf);
+   if (fdMem != -1)
+   {
+      close(fdMem);
+      fdMem = -1;
+   }
 
-            F = A;
+   param.sched_priority = sched_get_priority_max(SCHED_FIFO);
 
-            PC++;
-         }
-         else
-         {
-            p1 = instr.p[1];
-            p2 = instr.p[2];
+   if (gpioCfg.internals & PI_CFG_RT_PRIORITY)
+      sched_setscheduler(0, SCHED_FIFO, &param);
 
-            switch (instr.p[0])
-            {
-               case PI_CMD_ADD:   A+=p1; F=A;                     PC++; break;
+   initClock(1); /* initialise main clock */
 
-               case PI_CMD_AND:   A&=p1; F=A;                     PC++; break;
+   atexit(gpioTerminate);
 
-               case PI_CMD_CALL:  scrPush(s, &SP, S, PC+1);    PC = p1; break;
+   if (pthread_attr_init(&pthAttr))
+      SOFT_ERROR(PI_INIT_FAILED, "pthread_attr_init failed (%m)");
 
-               case PI_CMD_CMP:   F=A-p1;                         PC++; break;
+   if (pthread_attr_setstacksize(&pthAttr, STACK_SIZE))
+      SOFT_ERROR(PI_INIT_FAILED, "pthread_attr_setstacksize failed (%m)");
 
-               case PI_CMD_DCR:
-                  if (instr.opt[1] == CMD_PAR)
-                     {--s->script.par[p1o]; F=s->script.par[p1o];}
-                  else
-                     {--s->script.var[p1o]; F=s->script.var[p1o];}
-                  PC++;
-                  break;
+   if (pthread_create(&pthAlert, &pthAttr, pthAlertThread, &i))
+      SOFT_ERROR(PI_INIT_FAILED, "pthread_create alert failed (%m)");
 
-               case PI_CMD_DCRA:  --A; F=A;                       PC++; break;
+   pthAlertRunning = 1;
 
-               case PI_CMD_DIV:   A/=p1; F=A;                     PC++; break;
+   if (!(gpioCfg.ifFlags & PI_DISABLE_FIFO_IF))
+   {
+      if (pthread_create(&pthFifo, &pthAttr, pthFifoThread, &i))
+         SOFT_ERROR(PI_INIT_FAILED, "pthread_create fifo failed (%m)");
 
-               case PI_CMD_HALT: s->run_state = PI_SCRIPT_HALTED;       break;
+      pthFifoRunning = 1;
+   }
 
-               case PI_CMD_INR:
-                  if (instr.opt[1] == CMD_PAR)
-                     {++s->script.par[p1o]; F=s->script.par[p1o];}
-                  else
-                     {++s->script.var[p1o]; F=s->script.var[p1o];}
-                  PC++;
-                  break;
+   if (!(gpioCfg.ifFlags & PI_DISABLE_SOCK_IF))
+   {
+      fdSock = socket(AF_INET , SOCK_STREAM , 0);
 
-               case PI_CMD_INRA:  ++A; F=A;                       PC++; break;
+      if (fdSock == -1)
+         SOFT_ERROR(PI_INIT_FAILED, "socket failed (%m)");
 
-               case PI_CMD_JM:    if (F<0)  PC=p1; else PC++;           break;
+      portStr = getenv(PI_ENVPORT);
 
-               case PI_CMD_JMP:   PC=p1;                                break;
+      if (portStr) port = atoi(portStr); else port = gpioCfg.socketPort;
 
-               case PI_CMD_JNZ:   if (F)    PC=p1; else PC++;           break;
+      server.sin_family = AF_INET;
+      server.sin_addr.s_addr = INADDR_ANY;
+      server.sin_port = htons(port);
 
-               case PI_CMD_JP:    if (F>=0) PC=p1; else PC++;           break;
+      if (bind(fdSock,(struct sockaddr *)&server , sizeof(server)) < 0)
+         SOFT_ERROR(PI_INIT_FAILED, "bind to port %d failed (%m)", port);
 
-               case PI_CMD_JZ:    if (!F)   PC=p1; else PC++;           break;
+      if (pthread_create(&pthSocket, &pthAttr, pthSocketThread, &i))
+         SOFT_ERROR(PI_INIT_FAILED, "pthread_create socket failed (%m)");
 
-               case PI_CMD_LD:
-                  if (instr.opt[1] == CMD_PAR) s->script.par[p1o]=p2;
-                  else                         s->script.var[p1o]=p2;
-                  PC++;
-                  break;
+      pthSocketRunning = 1;
+   }
 
-               case PI_CMD_LDA:   A=p1;                           PC++; break;
+   myGpioDelay(10000);
 
-               case PI_CMD_LDAB:
-                  if ((p1 >= 0) && (p1 < sizeof(buf))) A = buf[p1];
-                  PC++;
-                  break;
+   dmaInitCbs();
 
-               case PI_CMD_MLT:   A*=p1; F=A;                     PC++; break;
+   flushMemory();
 
-               case PI_CMD_MOD:   A%=p1; F=A;                     PC++; break;
+   initDMAgo((uint32_t *)dmaIn, (uint32_t)dmaIBus[0]);
 
-               case PI_CMD_OR:    A|=p1; F=A;                     PC++; break;
+   myGpioDelay(20000);
 
-               case PI_CMD_POP:
-                  if (instr.opt[1] == CMD_PAR)
-                     s->script.par[p1o]=scrPop(s, &SP, S);
-                  else
-                     s->script.var[p1o]=scrPop(s, &SP, S);
-                  PC++;
-                  break;
+   return PIGPIO_VERSION;
+}
 
-               case PI_CMD_POPA:  A=scrPop(s, &SP, S);            PC++; break;
 
-               case PI_CMD_PUSH:
-                  if (instr.opt[1] == CMD_PAR)
-                     scrPush(s, &SP, S, s->script.par[p1o]);
-                  else
-                     scrPush(s, &SP, S, s->script.var[p1o]);
-                  PC++;
-                  break;
+/* ======================================================================= */
 
-               case PI_CMD_PUSHA: scrPush(s, &SP, S, A);          PC++; break;
+int getBitInBytes(int bitPos, char *buf, int numBits)
+{
+   int bitp, bufp;
 
-               case PI_CMD_RET:   PC=scrPop(s, &SP, S);                 break;
+   if (bitPos < numBits)
+   {
+      bufp =      bitPos / 8;
+      bitp = 7 - (bitPos % 8);
+      if (buf[bufp] & (1<<bitp)) return 1;
+   }
 
-               case PI_CMD_RL:
-                  if (instr.opt[1] == CMD_PAR)
-                     {s->script.par[p1o]<<=p2; F=s->script.par[p1o];}
-                  else
-                     {s->script.var[p1o]<<=p2; F=s->script.var[p1o];}
-                  PC++;
-                  break;
+   return 0;
+}
 
-               case PI_CMD_RLA:   A<<=p1; F=A;                    PC++; break;
+/* ----------------------------------------------------------------------- */
 
-               case PI_CMD_RR:
-                  if (instr.opt[1] == CMD_PAR)
-                     {s->script.par[p1o]>>=p2; F=s->script.par[p1o];}
-                  else
-                     {s->script.var[p1o]>>=p2; F=s->script.var[p1o];}
-                  PC++;
-                  break;
+void putBitInBytes(int bitPos, char *buf, int bit)
+{
+   int bitp, bufp;
 
-               case PI_CMD_RRA:   A>>=p1; F=A;                    PC++; break;
+   bufp =      bitPos / 8;
+   bitp = 7 - (bitPos % 8);
 
-               case PI_CMD_STA:
-                  if (instr.opt[1] == CMD_PAR) s->script.par[p1o]=A;
-                  else                         s->script.var[p1o]=A;
-                  PC++;
-                  break;
+   if (bit) buf[bufp] |=   (1<<bitp);
+   else     buf[bufp] &= (~(1<<bitp));
+}
 
-               case PI_CMD_STAB:
-                  if ((p1 >= 0) && (p1 < sizeof(buf))) buf[p1] = A;
-                  PC++;
-                  break;
+/* ----------------------------------------------------------------------- */
 
-               case PI_CMD_SUB:   A-=p1; F=A;                     PC++; break;
+uint32_t rawWaveGetOut(int pos)
+{
+   int page, slot;
 
-               case PI_CMD_SYS:
-                  A=scrSys((char*)instr.p[4], A, *(gpioReg + GPLEV0));
-                  F=A;
-                  PC++;
-                  break;
+   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
+   {
+      waveOOLPageSlot(pos, &page, &slot);
+      return (dmaOVirt[page]->OOL[slot]);
+   }
 
-               case PI_CMD_WAIT:  A=scrWait(s, p1); F=A;          PC++; break;
+   return -1;
+}
 
-               case PI_CMD_X:
-                  if (instr.opt[1] == CMD_PAR) t1 = &s->script.par[p1o];
-                  else                         t1 = &s->script.var[p1o];
+/* ----------------------------------------------------------------------- */
 
-                  if (instr.opt[2] == CMD_PAR) t2 = &s->script.par[p2o];
-                  else                         t2 = &s->script.var[p2o];
+void rawWaveSetOut(int pos, uint32_t value)
+{
+   int page, slot;
 
-                  scrSwap(t1, t2);
-                  PC++;
-                  break;
+   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
+   {
+      waveOOLPageSlot(pos, &page, &slot);
+      dmaOVirt[page]->OOL[slot] = value;
+   }
+}
 
-               case PI_CMD_XA:
-                  if (instr.opt[1] == CMD_PAR)
-                     scrSwap(&s->script.par[p1o], &A);
-                  else
-                     scrSwap(&s->script.var[p1o], &A);
-                  PC++;
-                  break;
 
-               case PI_CMD_XOR:   A^=p1; F=A;                     PC++; break;
+/* ----------------------------------------------------------------------- */
 
-            }
-         }
+uint32_t rawWaveGetIn(int pos)
+{
+   int page, slot;
 
-         if (PC >= s->script.instrs) s->run_state = PI_SCRIPT_HALTED;
+   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
+   {
+      waveOOLPageSlot((NUM_WAVE_OOL-1)-pos, &page, &slot);
+      return (dmaOVirt[page]->OOL[slot]);
+   }
 
-      }
+   return -1;
+}
 
-      if ((volatile int)s->request == PI_SCRIPT_HALT)
-         s->run_state = PI_SCRIPT_HALTED;
+/* ----------------------------------------------------------------------- */
 
-   }
+void rawWaveSetIn(int pos, uint32_t value)
+{
+   int page, slot;
 
-   return 0;
+   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
+   {
+      waveOOLPageSlot((NUM_WAVE_OOL-1)-pos, &page, &slot);
+      dmaOVirt[page]->OOL[slot] = value;
+   }
 }
 
 /* ----------------------------------------------------------------------- */
 
-static void * pthTimerTick(void *x)
+rawWaveInfo_t rawWaveInfo(int wave_id)
 {
-   gpioTimer_t *     tp;
-   struct timespec   req, rem, period;
-   char              buf[256];
+   rawWaveInfo_t dummy = {-1, -1, -1, -1};
 
-   tp = x;
+   if ((wave_id >=0) && (wave_id < PI_MAX_WAVES)) return waveInfo[wave_id];
+   else                                           return dummy;
+}
 
-   clock_gettime(CLOCK_REALTIME, &tp->nextTick);
+/* ----------------------------------------------------------------------- */
 
-   while (1)
-   {
-      clock_gettime(CLOCK_REALTIME, &rem);
+double time_time(void)
+{
+   struct timeval tv;
+   double t;
 
-      period.tv_sec  = tp->millis / THOUSAND;
-      period.tv_nsec = (tp->millis % THOUSAND) * THOUSAND * THOUSAND;
+   gettimeofday(&tv, 0);
 
-      do
-      {
-         TIMER_ADD(&tp->nextTick, &period, &tp->nextTick);
+   t = (double)tv.tv_sec + ((double)tv.tv_usec / 1E6);
 
-         TIMER_SUB(&tp->nextTick, &rem, &req);
-      }
-      while (req.tv_sec < 0);
+   return t;
+}
 
-      while (nanosleep(&req, &rem))
-      {
-         req.tv_sec  = rem.tv_sec;
-         req.tv_nsec = rem.tv_nsec;
-      }
+/* ----------------------------------------------------------------------- */
+
+void time_sleep(double seconds)
+{
+   struct timespec ts, rem;
+
+   if (seconds > 0.0)
+   {
+      ts.tv_sec = seconds;
+      ts.tv_nsec = (seconds-(double)ts.tv_sec) * 1E9;
 
-      if (gpioCfg.dbgLevel >= DBG_SLOW_TICK)
+      while (clock_nanosleep(CLOCK_REALTIME, 0, &ts, &rem))
       {
-         if ((tp->millis > 50) || (gpioCfg.dbgLevel >= DBG_FAST_TICK))
-         {
-            sprintf(buf, "pigpio: TIMER=%d @ %u %u\n",
-               tp->id,
-              (unsigned)tp->nextTick.tv_sec,
-              (unsigned)tp->nextTick.tv_nsec);
-            fprintf(stderr, buf);
-         }
+         /* copy remaining time to ts */
+         ts.tv_sec  = rem.tv_sec;
+         ts.tv_nsec = rem.tv_nsec;
       }
-
-      if (tp->ex) (tp->func)(tp->userdata);
-      else        (tp->func)();
    }
-
-   return 0;
 }
 
 /* ----------------------------------------------------------------------- */
 
-
-static void * pthFifoThread(void *x)
+void rawDumpWave(void)
 {
-   char buf[CMD_MAX_EXTENSION];
-   int idx, flags, len, res, i;
-   uint32_t p[CMD_P_ARR];
-   cmdCtlParse_t ctl;
-   uint32_t *param;
-   char v[CMD_MAX_EXTENSION];
+   int i;
 
-   myCreatePipe(PI_INPFIFO, 0662);
+   unsigned numWaves, t;
 
-   if ((inpFifo = fopen(PI_INPFIFO, "r+")) == NULL)
-      SOFT_ERROR((void*)PI_INIT_FAILED, "fopen %s failed(%m)", PI_INPFIFO);
+   rawWave_t *waves;
 
-   myCreatePipe(PI_OUTFIFO, 0664);
+   numWaves = waveFlatten();
+   waves    = wf[0];
 
-   if ((outFifo = fopen(PI_OUTFIFO, "w+")) == NULL)
-      SOFT_ERROR((void*)PI_INIT_FAILED, "fopen %s failed (%m)", PI_OUTFIFO);
+   t = 0;
 
-   /* set outFifo non-blocking */
+   for (i=0; i<numWaves; i++)
+   {
+      fprintf(stderr, "%10u %08X %08X %08X %10u\n",
+         t, waves[i].gpioOn, waves[i].gpioOff,
+         waves[i].flags, waves[i].usDelay);
+      t += waves[i].usDelay;
+   }
+}
 
-   flags = fcntl(fileno(outFifo), F_GETFL, 0);
-   fcntl(fileno(outFifo), F_SETFL, flags | O_NONBLOCK);
+/* ----------------------------------------------------------------------- */
 
-   /* don't start until DMA started */
+void rawDumpScript(unsigned script_id)
+{
+   int i;
 
-   spinWhileStarting();
+   if (script_id >= PI_MAX_SCRIPTS) return;
 
-   while (1)
+   if (gpioScript[script_id].state == PI_SCRIPT_IN_USE)
    {
-      if (fgets(buf, sizeof(buf), inpFifo) == NULL)
-         SOFT_ERROR((void*)PI_INIT_FAILED, "fifo fgets failed (%m)");
-
-      len = strlen(buf);
 
-      if (len)
+      for (i=0; i<PI_MAX_SCRIPT_PARAMS; i++)
       {
-        --len;
-        buf[len] = 0; /* replace terminating */
+         fprintf(stderr, "p%d=%d ", i, gpioScript[script_id].script.par[i]);
       }
 
-      ctl.eaten = 0;
-      idx = 0;
+      fprintf(stderr, "\n");
 
-      while (((ctl.eaten)<len) && (idx >= 0))
+      for (i=0; i<PI_MAX_SCRIPT_VARS; i++)
       {
-         if ((idx=cmdParse(buf, p, CMD_MAX_EXTENSION, v, &ctl)) >= 0)
-         {
-            /* make sure extensions are null terminated */
-
-            v[p[3]] = 0;
-
-            res = myDoCommand(p, sizeof(v)-1, v);
+         fprintf(stderr, "v%d=%d ", i, gpioScript[script_id].script.var[i]);
+      }
 
-            switch (cmdInfo[idx].rv)
-            {
-               case 0:
-                  fprintf(outFifo, "%d\n", res);
-                  break;
+      fprintf(stderr, "\n");
 
-               case 1:
-                  fprintf(outFifo, "%d\n", res);
-                  break;
+      for (i=0; i<gpioScript[script_id].script.instrs; i++)
+      {
+         fprintf(stderr,
+            "c%d=[%d, %d(%d), %d(%d), %d, %d]\n",
+            i,
+            gpioScript[script_id].script.instr[i].p[0],
+            gpioScript[script_id].script.instr[i].p[1],
+            gpioScript[script_id].script.instr[i].opt[1],
+            gpioScript[script_id].script.instr[i].p[2],
+            gpioScript[script_id].script.instr[i].opt[2],
+            gpioScript[script_id].script.instr[i].p[3],
+            gpioScript[script_id].script.instr[i].p[4]);
+      }
+   }
+}
 
-               case 2:
-                  fprintf(outFifo, "%d\n", res);
-                  break;
+/* ======================================================================= */
 
-               case 3:
-                  fprintf(outFifo, "%08X\n", res);
-                  break;
+int gpioInitialise(void)
+{
+   int status;
 
-               case 4:
-                  fprintf(outFifo, "%u\n", res);
-                  break;
+   if (libInitialised) return PIGPIO_VERSION;
 
-               case 5:
-                  fprintf(outFifo, cmdUsage);
-                  break;
+   DBG(DBG_STARTUP, "not initialised, initialising");
 
-               case 6:
-                  fprintf(outFifo, "%d", res);
-                  if (res > 0)
-                  {
-                     for (i=0; i<res; i++)
-                     {
-                        fprintf(outFifo, " %d", v[i]);
-                     }
-                  }
-                  fprintf(outFifo, "\n");
-                  break;
+   runState = PI_STARTING;
 
-               case 7:
-                  if (res < 0) fprintf(outFifo, "%d\n", res);
-                  else
-                  {
-                     fprintf(outFifo, "%d", res);
-                     param = (uint32_t *)v;
-                     for (i=0; i<PI_MAX_SCRIPT_PARAMS; i++)
-                     {
-                        fprintf(outFifo, " %d", param[i]);
-                     }
-                     fprintf(outFifo, "\n");
-                  }
-                  break;
-            }
-         }
-         else fprintf(outFifo, "%d\n", PI_BAD_FIFO_COMMAND);
-      }
+   status = initInitialise();
 
-      fflush(outFifo);
+   if (status < 0)
+   {
+      runState = PI_ENDING;
+      initReleaseResources();
+   }
+   else
+   {
+      libInitialised = 1;
+      runState = PI_RUNNING;
    }
 
-   return 0;
+   return status;
 }
 
+
 /* ----------------------------------------------------------------------- */
 
-static void *pthSocketThreadHandler(void *fdC)
-{
-   int sock = *(int*)fdC;
-   uint32_t p[10];
-   int opt;
-   char buf[CMD_MAX_EXTENSION];
+void gpioTerminate(void)
+{
+   int i;
+
+   DBG(DBG_USER, "");
+
+   if (!libInitialised) return;
+
+   DBG(DBG_STARTUP, "initialised, terminating");
+
+   runState = PI_ENDING;
+
+   gpioMaskSet = 0;
+
+   /* reset DMA */
+
+   if (dmaReg != MAP_FAILED) dmaIn[DMA_CS] = DMA_CHANNEL_RESET;
+   if (dmaReg != MAP_FAILED) dmaOut[DMA_CS] = DMA_CHANNEL_RESET;
+
+#ifndef EMBEDDED_IN_VM
+   if (gpioCfg.internals & PI_CFG_STATS)
+   {
+      fprintf(stderr,
+         "\n#####################################################\n");
+      fprintf(stderr,
+         "If you didn't request stats please cut & paste the\n"
+         "following and e-mail to pigpio@abyz.co.uk\n");
+
+      fprintf(stderr, "pigpio version=%d internals=%X\n",
+         PIGPIO_VERSION, gpioCfg.internals);
+
+      fprintf(stderr,
+         "micros=%d allocMode=%d dmaInitCbs=%d DMARestarts=%d\n",
+         gpioCfg.clockMicros, gpioCfg.memAllocMode,
+         gpioStats.dmaInitCbsCount, gpioStats.DMARestarts);
+
+      fprintf(stderr,
+         "samples %u maxSamples %u maxEmit %u emitFrags %u\n",
+         gpioStats.numSamples, gpioStats.maxSamples,
+         gpioStats.maxEmit, gpioStats.emitFrags);
 
-   free(fdC);
+      fprintf(stderr, "cbTicks %d, cbCalls %u\n",
+         gpioStats.cbTicks, gpioStats.cbCalls);
 
-   /* Disable the Nagle algorithm. */
-   opt = 1;
-   setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char*)&opt, sizeof(int));
+      fprintf(stderr, "pipe: good %u, short %u, would block %u\n",
+         gpioStats.goodPipeWrite, gpioStats.shortPipeWrite,
+         gpioStats.wouldBlockPipeWrite);
 
-   while (1)
-   {
-      if (recv(sock, p, 16, MSG_WAITALL) != 16) break;
+      fprintf(stderr, "notify: gaps %u, lost %u\n",
+         gpioStats.notifyGaps, gpioStats.notifyLost);
 
-      if (p[3])
-      {
-         if (p[3] < sizeof(buf))
-         {
-            /* read extension into buf */
-            if (recv(sock, buf, p[3], MSG_WAITALL) != p[3])
-            {
-               /* Serious error.  No point continuing. */
-               DBG(DBG_ALWAYS, "recv failed for %d bytes", p[3]);
+      fprintf(stderr, "alertTicks %u, lateTicks %u, moreToDo %u\n",
+         gpioStats.alertTicks, gpioStats.lateTicks, gpioStats.moreToDo);
 
-               close(sock);
+      fprintf(stderr, "alert: samples %u, calls %u, wdog checks %u\n",
+         gpioStats.alertSamples, gpioStats.alertCalls,
+         gpioStats.wdogChecks);
 
-               return 0;
-            }
-         }
-         else
-         {
-            /* Serious error.  No point continuing. */
-            DBG(DBG_ALWAYS, "ext too large %d(%d)", p[3], sizeof(buf));
+      fprintf(stderr, "isr: wakeups %u, events %u, timeouts %u\n",
+         gpioStats.isrWakeups, gpioStats.isrEvents, gpioStats.isrTimeouts);
 
-            close(sock);
+      fprintf(stderr, "timer: wakeups %u, runs %u, overruns %u, late max %u\n",
+         gpioStats.timerWakeups, gpioStats.timerRuns,
+         gpioStats.timerOverruns, gpioStats.timerLateMax);
 
-            return 0;
-         }
-      }
+      for (i=0; i< TICKSLOTS; i++)
+         fprintf(stderr, "%9u ", gpioStats.diffTick[i]);
 
-      /* add null terminator in case it's a string */
+      fprintf(stderr,
+         "\n#####################################################\n\n\n");
+   }
+#endif
 
-      buf[p[3]] = 0;
+   initReleaseResources();
 
-      switch (p[0])
-      {
-         case PI_CMD_NOIB:
+   fflush(NULL);
 
-            p[3] = gpioNotifyOpenInBand(sock);
+   libInitialised = 0;
+}
 
-           /* Enable the Nagle algorithm. */
-            opt = 0;
-            setsockopt(
-               sock, IPPROTO_TCP, TCP_NODELAY, (char*)&opt, sizeof(int));
+static void switchFunctionOff(unsigned gpio)
+{
+   switch (gpioInfo[gpio].is)
+   {
+      case GPIO_SERVO:
+         /* switch servo off */
+         myGpioSetServo(gpio, gpioInfo[gpio].width, 0);
+         gpioInfo[gpio].width = 0;
+         break;
 
-            break;
+      case GPIO_PWM:
+         /* switch pwm off */
+         myGpioSetPwm(gpio, gpioInfo[gpio].width, 0);
+         gpioInfo[gpio].width = 0;
+         break;
 
-         case PI_CMD_PROCP:
-            p[3] = myDoCommand(p, sizeof(buf)-1, buf+sizeof(int));
-            if (((int)p[3]) >= 0)
-            {
-               memcpy(buf, &p[3], 4);
-               p[3] = 4 + (4*PI_MAX_SCRIPT_PARAMS);
-            }
-            break;
+      case GPIO_HW_CLK:
+         /* No longer disable clock hardware, doing that was a bug. */
+         gpioInfo[gpio].width = 0;
+         break;
 
-         default:
-            p[3] = myDoCommand(p, sizeof(buf)-1, buf);
-      }
+      case GPIO_HW_PWM:
+         /* No longer disable PWM hardware, doing that was a bug. */
+         gpioInfo[gpio].width = 0;
+         break;
+   }
+}
 
-      write(sock, p, 16);
+static void stopHardwarePWM(void)
+{
+   unsigned i, pwm;
 
-      switch (p[0])
+   for (i=0; i<= PI_MAX_GPIO; i++)
+   {
+      if (gpioInfo[i].is == GPIO_HW_PWM)
       {
-         /* extensions */
-
-         case PI_CMD_BI2CZ:
-         case PI_CMD_CF2:
-         case PI_CMD_I2CPK:
-         case PI_CMD_I2CRD:
-         case PI_CMD_I2CRI:
-         case PI_CMD_I2CRK:
-         case PI_CMD_I2CZ:
-         case PI_CMD_PROCP:
-         case PI_CMD_SERR:
-         case PI_CMD_SLR:
-         case PI_CMD_SPIX:
-         case PI_CMD_SPIR:
+         pwm = (PWMDef[i] >> 4) & 3;
 
-            if (((int)p[3]) > 0)
-            {
-               write(sock, buf, p[3]);
-            }
-            break;
+         if (pwm == 0) pwmReg[PWM_CTL] &= (~PWM_CTL_PWEN1);
+         else          pwmReg[PWM_CTL] &= (~PWM_CTL_PWEN2);
 
-         default:
-           break;
+         gpioInfo[i].width = 0;
+         gpioInfo[i].is = GPIO_UNDEFINED;
       }
    }
-
-   close(sock);
-
-   return 0;
 }
 
 /* ----------------------------------------------------------------------- */
 
-static void * pthSocketThread(void *x)
+int gpioSetMode(unsigned gpio, unsigned mode)
 {
-   int fdC, c, *sock;
-   struct sockaddr_in client;
-   pthread_attr_t attr;
-
-   if (pthread_attr_init(&attr))
-      SOFT_ERROR((void*)PI_INIT_FAILED,
-         "pthread_attr_init failed (%m)");
-
-   if (pthread_attr_setstacksize(&attr, STACK_SIZE))
-      SOFT_ERROR((void*)PI_INIT_FAILED,
-         "pthread_attr_setstacksize failed (%m)");
+   int reg, shift, old_mode;
 
-   if (pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED))
-      SOFT_ERROR((void*)PI_INIT_FAILED,
-         "pthread_attr_setdetachstate failed (%m)");
+   DBG(DBG_USER, "gpio=%d mode=%d", gpio, mode);
 
-   /* fdSock opened in gpioInitialise so that we can treat
-      failure to bind as fatal. */
+   CHECK_INITED;
 
-   listen(fdSock, 100);
+   if (gpio > PI_MAX_GPIO)
+      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
 
-   c = sizeof(struct sockaddr_in);
+   if (mode > PI_ALT3)
+      SOFT_ERROR(PI_BAD_MODE, "gpio %d, bad mode (%d)", gpio, mode);
 
-   /* don't start until DMA started */
+   reg   =  gpio/10;
+   shift = (gpio%10) * 3;
 
-   spinWhileStarting();
+   old_mode = (gpioReg[reg] >> shift) & 7;
 
-   while ((fdC =
-      accept(fdSock, (struct sockaddr *)&client, (socklen_t*)&c)))
+   if (mode != old_mode)
    {
-      pthread_t thr;
-
-      sock = malloc(sizeof(int));
+      switchFunctionOff(gpio);
 
-      *sock = fdC;
+      gpioInfo[gpio].is = GPIO_UNDEFINED;
 
-      if (pthread_create
-         (&thr, &attr, pthSocketThreadHandler, (void*) sock) < 0)
-         SOFT_ERROR((void*)PI_INIT_FAILED,
-            "socket pthread_create failed (%m)");
+      gpioReg[reg] = (gpioReg[reg] & ~(7<<shift)) | (mode<<shift);
    }
 
-   if (fdC < 0)
-      SOFT_ERROR((void*)PI_INIT_FAILED, "accept failed (%m)");
-
    return 0;
 }
 
-/* ======================================================================= */
 
-static void initCheckLockFile(void)
-{
-   int fd;
-   int count;
-   int pid;
-   int err;
-   int delete;
-   char str[20];
+/* ----------------------------------------------------------------------- */
 
-   fd = open(PI_LOCKFILE, O_RDONLY);
+int gpioGetMode(unsigned gpio)
+{
+   int reg, shift;
 
-   if (fd != -1)
-   {
-      DBG(DBG_STARTUP, "lock file exists");
-      delete = 1;
+   DBG(DBG_USER, "gpio=%d", gpio);
 
-      count = read(fd, str, sizeof(str)-1);
+   CHECK_INITED;
 
-      if (count)
-      {
-         pid = atoi(str);
-         err = kill(pid, 0);
-         if (!err) delete = 0; /* process still exists */
-         DBG(DBG_STARTUP, "lock file pid=%d err=%d", pid, err);
-      }
+   if (gpio > PI_MAX_GPIO)
+      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
 
-      close(fd);
-      DBG(DBG_STARTUP, "lock file delete=%d", delete);
+   reg   =  gpio/10;
+   shift = (gpio%10) * 3;
 
-      if (delete) unlink(PI_LOCKFILE);
-   }
+   return (gpioReg[reg] >> shift) & 7;
 }
 
-static int initGrabLockFile(void)
+
+/* ----------------------------------------------------------------------- */
+
+int gpioSetPullUpDown(unsigned gpio, unsigned pud)
 {
-   int fd;
-   int lockResult;
-   char pidStr[20];
+   DBG(DBG_USER, "gpio=%d pud=%d", gpio, pud);
 
-   initCheckLockFile();
+   CHECK_INITED;
 
-   /* try to grab the lock file */
+   if (gpio > PI_MAX_GPIO)
+      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
 
-   fd = open(PI_LOCKFILE, O_WRONLY|O_CREAT|O_EXCL|O_TRUNC, 0644);
+   if (pud > PI_PUD_UP)
+      SOFT_ERROR(PI_BAD_PUD, "gpio %d, bad pud (%d)", gpio, pud);
 
-   if (fd != -1)
-   {
-      lockResult = flock(fd, LOCK_EX|LOCK_NB);
+   *(gpioReg + GPPUD) = pud;
 
-      if(lockResult == 0)
-      {
-         sprintf(pidStr, "%d\n", (int)getpid());
+   myGpioDelay(20);
 
-         write(fd, pidStr, strlen(pidStr));
-      }
-      else
-      {
-         close(fd);
-         return -1;
-      }
-   }
+   *(gpioReg + GPPUDCLK0 + BANK) = BIT;
 
-   return fd;
-}
+   myGpioDelay(20);
 
-/* ----------------------------------------------------------------------- */
+   *(gpioReg + GPPUD) = 0;
 
-static uint32_t * initMapMem(int fd, uint32_t addr, uint32_t len)
-{
-    return (uint32_t *) mmap(0, len,
-       PROT_READ|PROT_WRITE|PROT_EXEC,
-       MAP_SHARED|MAP_LOCKED,
-       fd, addr);
+   *(gpioReg + GPPUDCLK0 + BANK) = 0;
+
+   return 0;
 }
 
+
 /* ----------------------------------------------------------------------- */
 
-static int initCheckPermitted(void)
+int gpioRead(unsigned gpio)
 {
-   DBG(DBG_STARTUP, "");
+   DBG(DBG_USER, "gpio=%d", gpio);
 
-   if ((fdMem = open("/dev/mem", O_RDWR | O_SYNC) ) < 0)
-   {
-      DBG(DBG_ALWAYS,
-         "\n" \
-         "+---------------------------------------------------------+\n" \
-         "|Sorry, you don't have permission to run this program.    |\n" \
-         "|Try running as root, e.g. precede the command with sudo. |\n" \
-         "+---------------------------------------------------------+\n\n");
-      return -1;
-   }
-   return 0;
+   CHECK_INITED;
+
+   if (gpio > PI_MAX_GPIO)
+      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
+
+   if ((*(gpioReg + GPLEV0 + BANK) & BIT) != 0) return PI_ON;
+   else                                         return PI_OFF;
 }
 
+
 /* ----------------------------------------------------------------------- */
 
-static int initPeripherals(void)
+int gpioWrite(unsigned gpio, unsigned level)
 {
-   uint32_t dmaBase;
-
-   DBG(DBG_STARTUP, "");
+   DBG(DBG_USER, "gpio=%d level=%d", gpio, level);
 
-   gpioReg = initMapMem(fdMem, GPIO_BASE, GPIO_LEN);
+   CHECK_INITED;
 
-   if (gpioReg == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap gpio failed (%m)");
+   if (gpio > PI_MAX_GPIO)
+      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
 
-   /* dma channels 0-14 share one page, 15 has another */
+   if (level > PI_ON)
+      SOFT_ERROR(PI_BAD_LEVEL, "gpio %d, bad level (%d)", gpio, level);
 
-   if (gpioCfg.DMAprimaryChannel < 15)
-   {
-      dmaBase = DMA_BASE;
-   }
-   else dmaBase = DMA15_BASE;
+   if (gpio <= PI_MAX_GPIO)
+   {
+      if (gpioInfo[gpio].is != GPIO_WRITE)
+      {
+         /* stop a glitch between setting mode then level */
+         if (level == PI_OFF) GPIO_CLR(BANK, BIT);
+         else                 GPIO_SET(BANK, BIT);
 
-   dmaReg = initMapMem(fdMem, dmaBase,  DMA_LEN);
+         switchFunctionOff(gpio);
 
-   if (dmaReg == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap dma failed (%m)");
+         gpioSetMode(gpio, PI_OUTPUT);
 
-   if (gpioCfg.DMAprimaryChannel < 15)
-   {
-      dmaIn =  dmaReg + (gpioCfg.DMAprimaryChannel   * 0x40);
-      dmaOut = dmaReg + (gpioCfg.DMAsecondaryChannel * 0x40);
+         gpioInfo[gpio].is = GPIO_WRITE;
+      }
    }
 
-   DBG(DBG_STARTUP, "DMA #%d @ %08X @ %08X",
-      gpioCfg.DMAprimaryChannel, dmaBase, (uint32_t)dmaIn);
-
-   DBG(DBG_STARTUP, "debug reg is %08X", dmaIn[DMA_DEBUG]);
+   if (level == PI_OFF) GPIO_CLR(BANK, BIT);
+   else                 GPIO_SET(BANK, BIT);
 
-   clkReg  = initMapMem(fdMem, CLK_BASE,  CLK_LEN);
+   return 0;
+}
 
-   if (clkReg == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap clk failed (%m)");
 
-   systReg  = initMapMem(fdMem, SYST_BASE,  SYST_LEN);
+/* ----------------------------------------------------------------------- */
 
-   if (systReg == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap syst failed (%m)");
+int gpioPWM(unsigned gpio, unsigned val)
+{
+   DBG(DBG_USER, "gpio=%d dutycycle=%d", gpio, val);
 
-   spiReg  = initMapMem(fdMem, SPI_BASE,  SPI_LEN);
+   CHECK_INITED;
 
-   if (spiReg == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap spi failed (%m)");
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-   pwmReg  = initMapMem(fdMem, PWM_BASE,  PWM_LEN);
+   if (val > gpioInfo[gpio].range)
+      SOFT_ERROR(PI_BAD_DUTYCYCLE, "gpio %d, bad dutycycle (%d)", gpio, val);
 
-   if (pwmReg == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap pwm failed (%m)");
+   if (gpioInfo[gpio].is != GPIO_PWM)
+   {
+      switchFunctionOff(gpio);
 
-   pcmReg  = initMapMem(fdMem, PCM_BASE,  PCM_LEN);
+      gpioSetMode(gpio, PI_OUTPUT);
 
-   if (pcmReg == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap pcm failed (%m)");
+      gpioInfo[gpio].is = GPIO_PWM;
+   }
 
-   auxReg  = initMapMem(fdMem, AUX_BASE,  AUX_LEN);
+   myGpioSetPwm(gpio, gpioInfo[gpio].width, val);
 
-   if (auxReg == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap aux failed (%m)");
+   gpioInfo[gpio].width=val;
 
    return 0;
 }
 
 /* ----------------------------------------------------------------------- */
 
-static int initZaps
-   (int  pmapFd, void *virtualBase, int  basePage, int  pages)
+static int pwmBegin(void *owner)
 {
-   int n;
-   long index;
-   off_t offset;
-   ssize_t t;
-   uint32_t physical;
-   int status;
-   uint32_t pageAdr;
-   unsigned long long pa;
-
-   DBG(DBG_STARTUP, "");
+   /* the owner is the socket client which began, NULL for any other */
 
-   status = 0;
+   pthread_mutex_lock(&pwmMutex);
+   pwmStaging = 1;
+   pwmOwner   = owner;
+   pthread_mutex_unlock(&pwmMutex);
 
-   pageAdr = (uint32_t) dmaVirt[basePage];
+   return 0;
+}
 
-   index  = ((uint32_t)virtualBase / PAGE_SIZE) * 8;
+/* ----------------------------------------------------------------------- */
 
-   offset = lseek(pmapFd, index, SEEK_SET);
+static void pwmRelease(void *owner)
+{
+   /* a client gone without committing, apply what it held */
 
-   if (offset != index)
-      SOFT_ERROR(PI_INIT_FAILED, "lseek pagemap failed (%m)");
+   pthread_mutex_lock(&pwmMutex);
 
-   for (n=0; n<pages; n++)
+   if (pwmStaging && (pwmOwner == owner))
    {
-      t = read(pmapFd, &pa, sizeof(pa));
+      DBG(DBG_USER, "committing held PWM of closed client");
 
-      if (t != sizeof(pa))
-         SOFT_ERROR(PI_INIT_FAILED, "read pagemap failed (%m)");
+      pwmFlush(pwmStaging);
 
-      DBG(DBG_STARTUP, "pf%d=%016llX", n, pa);
+      pwmStaging = 0;
+      pwmOwner   = NULL;
+   }
 
-      physical = 0x3FFFFFFF & (PAGE_SIZE * (pa & 0xFFFFFFFF));
+   pthread_mutex_unlock(&pwmMutex);
+}
 
-      if (physical)
-      {
-         dmaBus[basePage+n] = (dmaPage_t *) (physical | pi_dram_bus);
+/* ----------------------------------------------------------------------- */
 
-         dmaVirt[basePage+n] = mmap
-         (
-            (void *)pageAdr,
-            PAGE_SIZE,
-            PROT_READ|PROT_WRITE,
-            MAP_SHARED|MAP_FIXED|MAP_LOCKED|MAP_NORESERVE,
-            fdMem,
-            physical
-         );
-      }
-      else status = 1;
+int gpioPWMBegin(void)
+{
+   DBG(DBG_USER, "");
 
-      pageAdr += PAGE_SIZE;
-   }
+   CHECK_INITED;
 
-   return status;
+   return pwmBegin(NULL);
 }
 
 /* ----------------------------------------------------------------------- */
 
-static int initPagemapBlock(int block)
+int gpioPWMCommit(void)
 {
-   int trys, ok;
-   unsigned pageNum;
+   int writes;
 
-   DBG(DBG_STARTUP, "block=%d", block);
+   DBG(DBG_USER, "");
 
-   dmaPMapBlk[block] = mmap(
-       0, (PAGES_PER_BLOCK*PAGE_SIZE),
-       PROT_READ|PROT_WRITE,
-       MAP_SHARED|MAP_ANONYMOUS|MAP_NORESERVE|MAP_LOCKED,
-       -1, 0);
+   CHECK_INITED;
 
-   if (dmaPMapBlk[block] == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap dma block %d failed (%m)", block);
+   pthread_mutex_lock(&pwmMutex);
 
-   /* force allocation of physical memory */
+   writes = pwmFlush(pwmStaging);
 
-   memset((void *)dmaPMapBlk[block], 0xAA, (PAGES_PER_BLOCK*PAGE_SIZE));
+   pwmStaging = 0;
+   pwmOwner   = NULL;
 
-   memset((void *)dmaPMapBlk[block], 0xFF, (PAGES_PER_BLOCK*PAGE_SIZE));
+   pthread_mutex_unlock(&pwmMutex);
 
-   memset((void *)dmaPMapBlk[block], 0, (PAGES_PER_BLOCK*PAGE_SIZE));
+   return writes;
+}
 
-   pageNum = block * PAGES_PER_BLOCK;
+/* ----------------------------------------------------------------------- */
 
-   dmaVirt[pageNum] = mmap(
-       0, (PAGES_PER_BLOCK*PAGE_SIZE),
-       PROT_READ|PROT_WRITE,
-       MAP_SHARED|MAP_ANONYMOUS|MAP_NORESERVE|MAP_LOCKED,
-       -1, 0);
+int gpioGetPWMdutycycle(unsigned gpio)
+{
+   unsigned pwm;
 
-   if (dmaVirt[pageNum] == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap dma block %d failed (%m)", block);
+   DBG(DBG_USER, "gpio=%d", gpio);
 
-   munmap(dmaVirt[pageNum], PAGES_PER_BLOCK*PAGE_SIZE);
+   CHECK_INITED;
 
-   trys = 0;
-   ok = 0;
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-   while ((trys < 10) && !ok)
+   switch (gpioInfo[gpio].is)
    {
-      if (initZaps(fdPmap,
-                    dmaPMapBlk[block],
-                    pageNum,
-                    PAGES_PER_BLOCK) == 0) ok = 1;
-      else myGpioDelay(50000);
+      case GPIO_PWM:
+         return gpioInfo[gpio].width;
 
-      ++trys;
-   }
+      case GPIO_HW_PWM:
+         pwm = (PWMDef[gpio] >> 4) & 3;
+         return hw_pwm_duty[pwm];
 
-   if (!ok) SOFT_ERROR(PI_INIT_FAILED, "initZaps failed");
+      case GPIO_HW_CLK:
+         return PI_HW_PWM_RANGE/2;
 
-   return 0;
+      default:
+         SOFT_ERROR(PI_NOT_PWM_GPIO, "not a PWM gpio (%d)", gpio);
+   }
 }
 
-static int initMboxBlock(int block)
-{
-   int n, ok;
-   unsigned page;
-   uintptr_t virtualAdr;
-   uintptr_t busAdr;
-
-   DBG(DBG_STARTUP, "block=%d", block);
 
-   ok = mbDMAAlloc
-      (&dmaMboxBlk[block], PAGES_PER_BLOCK * PAGE_SIZE, pi_mem_flag);
+/* ----------------------------------------------------------------------- */
 
-   if (!ok) SOFT_ERROR(PI_INIT_FAILED, "init mbox zaps failed");
+int gpioSetPWMrange(unsigned gpio, unsigned range)
+{
+   int oldWidth, newWidth;
 
-   page = block * PAGES_PER_BLOCK;
+   DBG(DBG_USER, "gpio=%d range=%d", gpio, range);
 
-   virtualAdr = (uintptr_t) dmaMboxBlk[block].virtual_addr;
-   busAdr = dmaMboxBlk[block].bus_addr;
+   CHECK_INITED;
 
-   for (n=0; n<PAGES_PER_BLOCK; n++)
-   {
-      dmaVirt[page+n] = (dmaPage_t *) virtualAdr;
-      dmaBus[page+n] = (dmaPage_t *) busAdr;
-      virtualAdr += PAGE_SIZE;
-      busAdr += PAGE_SIZE;
-   }
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-   return 0;
-}
+   if ((range < PI_MIN_DUTYCYCLE_RANGE)  || (range > PI_MAX_DUTYCYCLE_RANGE))
+      SOFT_ERROR(PI_BAD_DUTYRANGE, "gpio %d, bad range (%d)", gpio, range);
 
-/* ----------------------------------------------------------------------- */
+   oldWidth = gpioInfo[gpio].width;
 
-static int initAllocDMAMem(void)
-{
-   int i, servoCycles, superCycles;
-   int status;
+   if (oldWidth)
+   {
+      if (gpioInfo[gpio].is == GPIO_PWM)
+      {
+         newWidth = (range * oldWidth) / gpioInfo[gpio].range;
 
-   DBG(DBG_STARTUP, "");
+         myGpioSetPwm(gpio, oldWidth, 0);
+         gpioInfo[gpio].range = range;
+         gpioInfo[gpio].width = newWidth;
+         myGpioSetPwm(gpio, 0, newWidth);
+      }
+   }
 
-   /* Calculate the number of blocks needed for buffers.  The number
-      of blocks must be a multiple of the 20ms servo cycle.
-   */
+   gpioInfo[gpio].range = range;
 
-   servoCycles = gpioCfg.bufferMilliseconds / 20;
-   if           (gpioCfg.bufferMilliseconds % 20) servoCycles++;
+   /* return the actual range for the current gpio frequency */
 
-   bufferCycles = (SUPERCYCLE * servoCycles) / gpioCfg.clockMicros;
+   return pwmRealRange[gpioInfo[gpio].freqIdx];
+}
 
-   superCycles = bufferCycles / SUPERCYCLE;
-   if           (bufferCycles % SUPERCYCLE) superCycles++;
 
-   bufferCycles = SUPERCYCLE * superCycles;
+/* ----------------------------------------------------------------------- */
 
-   bufferBlocks = bufferCycles / CYCLES_PER_BLOCK;
+int gpioGetPWMrange(unsigned gpio)
+{
+   DBG(DBG_USER, "gpio=%d", gpio);
 
-   DBG(DBG_STARTUP, "bmillis=%d mics=%d bblk=%d bcyc=%d",
-      gpioCfg.bufferMilliseconds, gpioCfg.clockMicros,
-      bufferBlocks, bufferCycles);
+   CHECK_INITED;
 
-   /* allocate memory for pointers to virtual and bus memory pages */
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-   dmaVirt = mmap(
-       0, PAGES_PER_BLOCK*(bufferBlocks+PI_WAVE_BLOCKS)*sizeof(dmaPage_t *),
-       PROT_READ|PROT_WRITE,
-       MAP_PRIVATE|MAP_ANONYMOUS|MAP_LOCKED,
-       -1, 0);
+   switch (gpioInfo[gpio].is)
+   {
+      case GPIO_HW_PWM:
+      case GPIO_HW_CLK:
+         return PI_HW_PWM_RANGE;
 
-   if (dmaVirt == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap dma virtual failed (%m)");
+      default:
+         return gpioInfo[gpio].range;
+   }
+}
 
-   dmaBus = mmap(
-       0, PAGES_PER_BLOCK*(bufferBlocks+PI_WAVE_BLOCKS)*sizeof(dmaPage_t *),
-       PROT_READ|PROT_WRITE,
-       MAP_PRIVATE|MAP_ANONYMOUS|MAP_LOCKED,
-       -1, 0);
 
-   if (dmaBus == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap dma bus failed (%m)");
+/* ----------------------------------------------------------------------- */
 
-   dmaIVirt = (dmaIPage_t **) dmaVirt;
-   dmaIBus  = (dmaIPage_t **) dmaBus;
+int gpioGetPWMrealRange(unsigned gpio)
+{
+   unsigned pwm;
 
-   dmaOVirt = (dmaOPage_t **)(dmaVirt + (PAGES_PER_BLOCK*bufferBlocks));
-   dmaOBus  = (dmaOPage_t **)(dmaBus  + (PAGES_PER_BLOCK*bufferBlocks));
+   DBG(DBG_USER, "gpio=%d", gpio);
 
-   if ((gpioCfg.memAllocMode == PI_MEM_ALLOC_PAGEMAP) ||
-       ((gpioCfg.memAllocMode == PI_MEM_ALLOC_AUTO) &&
-        (gpioCfg.bufferMilliseconds > PI_DEFAULT_BUFFER_MILLIS)))
-   {
-      /* pagemap allocation of DMA memory */
+   CHECK_INITED;
 
-      dmaPMapBlk = mmap(
-          0, (bufferBlocks+PI_WAVE_BLOCKS)*sizeof(dmaPage_t *),
-          PROT_READ|PROT_WRITE,
-          MAP_PRIVATE|MAP_ANONYMOUS|MAP_LOCKED,
-          -1, 0);
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-      if (dmaPMapBlk == MAP_FAILED)
-         SOFT_ERROR(PI_INIT_FAILED, "pagemap mmap block failed (%m)");
+   switch (gpioInfo[gpio].is)
+   {
+      case GPIO_HW_PWM:
+         pwm = (PWMDef[gpio] >> 4) & 3;
+         return hw_pwm_real_range[pwm];
 
-      fdPmap = open("/proc/self/pagemap", O_RDONLY);
+      case GPIO_HW_CLK:
+         return PI_HW_PWM_RANGE;
 
-      if (fdPmap < 0)
-         SOFT_ERROR(PI_INIT_FAILED, "pagemap open failed(%m)");
+      default:
+         return pwmRealRange[gpioInfo[gpio].freqIdx];
+   }
+}
 
-      for (i=0; i<(bufferBlocks+PI_WAVE_BLOCKS); i++)
-      {
-         status = initPagemapBlock(i);
-         if (status < 0)
-         {
-            close(fdPmap);
-            return status;
-         }
-      }
 
-      close(fdPmap);
+/* ----------------------------------------------------------------------- */
 
-      DBG(DBG_STARTUP, "dmaPMapBlk=%08X dmaIn=%08X",
-         (uint32_t)dmaPMapBlk, (uint32_t)dmaIn);
-   }
-   else
-   {
-      /* mailbox allocation of DMA memory */
+int gpioSetPWMfrequency(unsigned gpio, unsigned frequency)
+{
+   int i, width;
+   unsigned diff, best, idx;
 
-      dmaMboxBlk = mmap(
-          0, (bufferBlocks+PI_WAVE_BLOCKS)*sizeof(DMAMem_t),
-          PROT_READ|PROT_WRITE,
-          MAP_PRIVATE|MAP_ANONYMOUS|MAP_LOCKED,
-          -1, 0);
+   DBG(DBG_USER, "gpio=%d frequency=%d", gpio, frequency);
 
-      if (dmaMboxBlk == MAP_FAILED)
-         SOFT_ERROR(PI_INIT_FAILED, "mmap mbox block failed (%m)");
+   CHECK_INITED;
 
-      fdMbox = mbOpen();
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-      if (fdMbox < 0)
-         SOFT_ERROR(PI_INIT_FAILED, "mbox open failed(%m)");
+   if      (frequency > pwmFreq[0])           idx = 0;
+   else if (frequency < pwmFreq[PWM_FREQS-1]) idx = PWM_FREQS-1;
+   else
+   {
+      best = 100000; /* impossibly high frequency difference */
+      idx = 0;
 
-      for (i=0; i<(bufferBlocks+PI_WAVE_BLOCKS); i++)
+      for (i=0; i<PWM_FREQS; i++)
       {
-         status = initMboxBlock(i);
-         if (status < 0)
+         if (frequency > pwmFreq[i]) diff = frequency - pwmFreq[i];
+         else                        diff = pwmFreq[i] - frequency;
+
+         if (diff < best)
          {
-            mbClose(fdMbox);
-            return status;
+            best = diff;
+            idx = i;
          }
       }
-
-      mbClose(fdMbox);
-
-      DBG(DBG_STARTUP, "dmaMboxBlk=%08X dmaIn=%08X",
-         (uint32_t)dmaMboxBlk, (uint32_t)dmaIn);
    }
 
-   DBG(DBG_STARTUP,
-      "gpioReg=%08X pwmReg=%08X pcmReg=%08X clkReg=%08X auxReg=%08X",
-      (uint32_t)gpioReg, (uint32_t)pwmReg,
-      (uint32_t)pcmReg,  (uint32_t)clkReg, (uint32_t)auxReg);
-
-   for (i=0; i<DMAI_PAGES; i++)
-      DBG(DBG_STARTUP, "dmaIBus[%d]=%08X", i, (uint32_t)dmaIBus[i]);
+   width = gpioInfo[gpio].width;
 
-   if (gpioCfg.dbgLevel >= DBG_DMACBS)
+   if (width)
    {
-      fprintf(stderr, "*** INPUT DMA CONTROL BLOCKS ***\n");
-      for (i=0; i<NUM_CBS; i++) dmaCbPrint(i);
+      if (gpioInfo[gpio].is == GPIO_PWM)
+      {
+         myGpioSetPwm(gpio, width, 0);
+         gpioInfo[gpio].freqIdx = idx;
+         myGpioSetPwm(gpio, 0, width);
+      }
    }
 
-   return 0;
+   gpioInfo[gpio].freqIdx = idx;
+
+   return pwmFreq[idx];
 }
 
+
 /* ----------------------------------------------------------------------- */
 
-static void initPWM(unsigned bits)
+int gpioGetPWMfrequency(unsigned gpio)
 {
-   DBG(DBG_STARTUP, "bits=%d", bits);
+   unsigned pwm, clock;
 
-   /* reset PWM */
+   DBG(DBG_USER, "gpio=%d", gpio);
 
-   pwmReg[PWM_CTL] = 0;
+   CHECK_INITED;
 
-   myGpioDelay(10);
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-   pwmReg[PWM_STA] = -1;
+   switch (gpioInfo[gpio].is)
+   {
+      case GPIO_HW_PWM:
+         pwm = (PWMDef[gpio] >> 4) & 3;
+         return hw_pwm_freq[pwm];
 
-   myGpioDelay(10);
+      case GPIO_HW_CLK:
+         clock = (clkDef[gpio] >> 4) & 3;
+         return hw_clk_freq[clock];
 
-   /* set number of bits to transmit */
+      default:
+         return pwmFreq[gpioInfo[gpio].freqIdx];
+   }
+}
 
-   pwmReg[PWM_RNG1] = bits;
 
-   myGpioDelay(10);
+/* ----------------------------------------------------------------------- */
 
-   dmaIVirt[0]->periphData = 1;
+int gpioServo(unsigned gpio, unsigned val)
+{
+   DBG(DBG_USER, "gpio=%d pulsewidth=%d", gpio, val);
 
-   /* enable PWM DMA, raise panic and dreq thresholds to 15 */
+   CHECK_INITED;
 
-   pwmReg[PWM_DMAC] = PWM_DMAC_ENAB      |
-                      PWM_DMAC_PANIC(15) |
-                      PWM_DMAC_DREQ(15);
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-   myGpioDelay(10);
+   if ((val!=PI_SERVO_OFF) && (val<PI_MIN_SERVO_PULSEWIDTH))
+      SOFT_ERROR(PI_BAD_PULSEWIDTH,
+         "gpio %d, bad pulsewidth (%d)", gpio, val);
 
-   /* clear PWM fifo */
+   if (val>PI_MAX_SERVO_PULSEWIDTH)
+      SOFT_ERROR(PI_BAD_PULSEWIDTH,
+         "gpio %d, bad pulsewidth (%d)", gpio, val);
 
-   pwmReg[PWM_CTL] = PWM_CTL_CLRF1;
+   if (gpioInfo[gpio].is != GPIO_SERVO)
+   {
+      switchFunctionOff(gpio);
 
-   myGpioDelay(10);
+      gpioSetMode(gpio, PI_OUTPUT);
 
-   /* enable PWM channel 1 and use fifo */
+      gpioInfo[gpio].is = GPIO_SERVO;
+   }
 
-   pwmReg[PWM_CTL] = PWM_CTL_USEF1 | PWM_CTL_MODE1 | PWM_CTL_PWEN1;
-}
+   myGpioSetServo(gpio, gpioInfo[gpio].width, val);
 
-/* ----------------------------------------------------------------------- */
+   gpioInfo[gpio].width=val;
 
-static void initPCM(unsigned bits)
-{
-   DBG(DBG_STARTUP, "bits=%d", bits);
+   return 0;
+}
 
-   /* disable PCM so we can modify the regs */
 
-   pcmReg[PCM_CS] = 0;
+/* ----------------------------------------------------------------------- */
 
-   myGpioDelay(1000);
+int gpioGetServoPulsewidth(unsigned gpio)
+{
+   DBG(DBG_USER, "gpio=%d", gpio);
 
-   pcmReg[PCM_FIFO]   = 0;
-   pcmReg[PCM_MODE]   = 0;
-   pcmReg[PCM_RXC]    = 0;
-   pcmReg[PCM_TXC]    = 0;
-   pcmReg[PCM_DREQ]   = 0;
-   pcmReg[PCM_INTEN]  = 0;
-   pcmReg[PCM_INTSTC] = 0;
-   pcmReg[PCM_GRAY]   = 0;
+   CHECK_INITED;
 
-   myGpioDelay(1000);
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-   pcmReg[PCM_MODE] = PCM_MODE_FLEN(bits-1); /* # bits in frame */
+   if (gpioInfo[gpio].is != GPIO_SERVO)
+      SOFT_ERROR(PI_NOT_SERVO_GPIO, "not a servo gpio (%d)", gpio);
 
-   /* enable channel 1 with # bits width */
+   return gpioInfo[gpio].width;
+}
 
-   pcmReg[PCM_TXC] = PCM_TXC_CH1EN | PCM_TXC_CH1WID(bits-8);
 
-   pcmReg[PCM_CS] |= PCM_CS_STBY; /* clear standby */
+/* ----------------------------------------------------------------------- */
 
-   myGpioDelay(1000);
+int gpioWaveClear(void)
+{
+   int i;
 
-   pcmReg[PCM_CS] |= PCM_CS_TXCLR; /* clear TX FIFO */
+   DBG(DBG_USER, "");
 
-   pcmReg[PCM_CS] |= PCM_CS_DMAEN; /* enable DREQ */
+   CHECK_INITED;
 
-   pcmReg[PCM_DREQ] = PCM_DREQ_TX_PANIC(16) | PCM_DREQ_TX_REQ_L(30);
+   wsStop();
 
-   pcmReg[PCM_INTSTC] = 0b1111; /* clear status bits */
+   waveReset();
 
-   /* enable PCM */
+   for (i=0; i<PI_MAX_WAVES; i++) waveKeep(i, 0);
 
-   pcmReg[PCM_CS] |= PCM_CS_EN;
+   wfStats.micros = 0;
+   wfStats.pulses = 0;
+   wfStats.cbs    = 0;
 
-   /* enable tx */
+   waveOutBotCB  = PI_WAVE_COUNT_PAGES*CBS_PER_OPAGE;
+   waveOutBotOOL = PI_WAVE_COUNT_PAGES*OOL_PER_OPAGE;
+   waveOutTopOOL = NUM_WAVE_OOL;
 
-   pcmReg[PCM_CS] |= PCM_CS_TXON;
+   waveOutCount = 0;
 
-   dmaIVirt[0]->periphData = 0x0F;
+   return 0;
 }
 
 /* ----------------------------------------------------------------------- */
 
-static void initHWClk
-   (int clkCtl, int clkDiv, int clkSrc, int divI, int divF, int MASH)
-{
-   DBG(DBG_INTERNAL, "ctl=%d div=%d src=%d /I=%d /f=%d M=%d",
-      clkCtl, clkDiv, clkSrc, divI, divF, MASH);
-
-   /* kill the clock if busy, anything else isn't reliable */
-
-   if (clkReg[clkCtl] & CLK_CTL_BUSY)
-   {
-      do
-      {
-         clkReg[clkCtl] = CLK_PASSWD | CLK_CTL_KILL;
-      }
-      while (clkReg[clkCtl] & CLK_CTL_BUSY);
-   }
-
-   clkReg[clkDiv] = (CLK_PASSWD | CLK_DIV_DIVI(divI) | CLK_DIV_DIVF(divF));
+int gpioWaveAddNew(void)
+{
+   DBG(DBG_USER, "");
 
-   usleep(10);
+   CHECK_INITED;
 
-   clkReg[clkCtl] = (CLK_PASSWD | CLK_CTL_MASH(MASH) | CLK_CTL_SRC(clkSrc));
+   waveReset();
 
-   usleep(10);
+   wfStats.micros = 0;
+   wfStats.pulses = 0;
+   wfStats.cbs    = 0;
 
-   clkReg[clkCtl] |= (CLK_PASSWD | CLK_CTL_ENAB);
+   return 0;
 }
 
-static void initClock(int mainClock)
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveAddGeneric(unsigned numPulses, gpioPulse_t *pulses)
 {
-   const unsigned BITS=10;
-   int clockPWM;
-   unsigned clkCtl, clkDiv, clkSrc, clkDivI, clkDivF, clkMash, clkBits;
-   char *per;
-   unsigned micros;
+   int p;
 
-   DBG(DBG_STARTUP, "mainClock=%d", mainClock);
+   DBG(DBG_USER, "numPulses=%u pulses=%08X", numPulses, (uint32_t)pulses);
 
-   if (mainClock) micros = gpioCfg.clockMicros;
-   else           micros = PI_WF_MICROS;
+   CHECK_INITED;
 
-   clockPWM = mainClock ^ (gpioCfg.clockPeriph == PI_CLOCK_PCM);
+   if (numPulses > PI_WAVE_MAX_PULSES)
+      SOFT_ERROR(PI_TOO_MANY_PULSES, "bad number of pulses (%d)", numPulses);
 
-   if (clockPWM)
-   {
-      clkCtl = CLK_PWMCTL;
-      clkDiv = CLK_PWMDIV;
-      per = "PWM";
-   }
-   else
+   if (!pulses) SOFT_ERROR(PI_BAD_POINTER, "bad (NULL) pulses pointer");
+
+   for (p=0; p<numPulses; p++)
    {
-      clkCtl = CLK_PCMCTL;
-      clkDiv = CLK_PCMDIV;
-      per = "PCM";
+      wf[1][p].gpioOff = pulses[p].gpioOff;
+      wf[1][p].gpioOn  = pulses[p].gpioOn;
+      wf[1][p].usDelay = pulses[p].usDelay;
+      wf[1][p].flags   = 0;
    }
 
-   clkSrc  = CLK_CTL_SRC_PLLD;
-   clkDivI = 50 * micros; /* 10      MHz - 1      MHz */
-   clkBits = BITS;        /* 10/BITS MHz - 1/BITS MHz */
-   clkDivF = 0;
-   clkMash = 0;
-
-   DBG(DBG_STARTUP, "%s PLLD divi=%d divf=%d mash=%d bits=%d",
-      per, clkDivI, clkDivF, clkMash, clkBits);
-
-   initHWClk(clkCtl, clkDiv, clkSrc, clkDivI, clkDivF, clkMash);
-
-   if (clockPWM) initPWM(BITS);
-   else          initPCM(BITS);
-
-   myGpioDelay(2000);
+   return rawWaveAddGeneric(numPulses, wf[1]);
 }
 
 /* ----------------------------------------------------------------------- */
 
-static void initDMAgo(volatile uint32_t  *dmaAddr, uint32_t cbAddr)
+int gpioWaveAddSerial
+   (unsigned gpio,
+    unsigned baud,
+    unsigned data_bits,
+    unsigned stop_bits,
+    unsigned offset,
+    unsigned numBytes,
+    char     *bstr)
 {
-   DBG(DBG_STARTUP, "");
-
-   dmaAddr[DMA_CS] = DMA_CHANNEL_RESET;
+   int i, b, p, lev, c, v;
 
-   dmaAddr[DMA_CS] = DMA_INTERRUPT_STATUS | DMA_END_FLAG;
+   uint16_t *wstr = (uint16_t *)bstr;
+   uint32_t *lstr = (uint32_t *)bstr;
 
-   dmaAddr[DMA_CONBLK_AD] = cbAddr;
+   unsigned bitDelay[32];
 
-   /* clear READ/FIFO/READ_LAST_NOT_SET error bits */
+   DBG(DBG_USER,
+      "gpio=%d baud=%d bits=%d stops=%d offset=%d numBytes=%d str=[%s]",
+      gpio, baud, data_bits, stop_bits, offset,
+      numBytes, myBuf2Str(numBytes, (char *)bstr));
 
-   dmaAddr[DMA_DEBUG] = DMA_DEBUG_READ_ERR            |
-                        DMA_DEBUG_FIFO_ERR            |
-                        DMA_DEBUG_RD_LST_NOT_SET_ERR;
+   CHECK_INITED;
 
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-   dmaAddr[DMA_CS] = DMA_WAIT_ON_WRITES    |
-                     DMA_PANIC_PRIORITY(8) |
-                     DMA_PRIORITY(8)       |
-                     DMA_ACTIVATE;
-}
+   if ((baud < PI_WAVE_MIN_BAUD) || (baud > PI_WAVE_MAX_BAUD))
+      SOFT_ERROR(PI_BAD_WAVE_BAUD, "bad baud rate (%d)", baud);
 
-/* ----------------------------------------------------------------------- */
+   if ((data_bits < PI_MIN_WAVE_DATABITS) ||
+       (data_bits > PI_MAX_WAVE_DATABITS))
+      SOFT_ERROR(PI_BAD_DATABITS, "bad number of databits (%d)", data_bits);
 
-static void initClearGlobals(void)
-{
-   int i;
+   if ((stop_bits < PI_MIN_WAVE_HALFSTOPBITS) ||
+       (stop_bits > PI_MAX_WAVE_HALFSTOPBITS))
+      SOFT_ERROR(PI_BAD_STOPBITS,
+         "bad number of (half) stop bits (%d)", stop_bits);
 
-   DBG(DBG_STARTUP, "");
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-   alertBits   = 0;
-   monitorBits = 0;
-   notifyBits  = 0;
-   scriptBits  = 0;
+   if (numBytes > PI_WAVE_MAX_CHARS)
+      SOFT_ERROR(PI_TOO_MANY_CHARS, "too many chars (%d)", numBytes);
 
-   pthAlertRunning  = 0;
-   pthFifoRunning   = 0;
-   pthSocketRunning = 0;
+   if (offset > PI_WAVE_MAX_MICROS)
+      SOFT_ERROR(PI_BAD_SER_OFFSET, "offset too large (%d)", offset);
 
-   wfc[0] = 0;
-   wfc[1] = 0;
-   wfc[2] = 0;
+   if (data_bits > 8) numBytes /= 2;
+   if (data_bits > 16) numBytes /= 2;
 
-   wfcur=0;
+   if (!numBytes) return 0;
 
-   wfStats.micros     = 0;
-   wfStats.highMicros = 0;
-   wfStats.maxMicros  = PI_WAVE_MAX_MICROS;
+   waveBitDelay(baud, data_bits, stop_bits, bitDelay);
 
-   wfStats.pulses     = 0;
-   wfStats.highPulses = 0;
-   wfStats.maxPulses  = PI_WAVE_MAX_PULSES;
+   p = 0;
 
-   wfStats.cbs        = 0;
-   wfStats.highCbs    = 0;
-   wfStats.maxCbs     = (PI_WAVE_BLOCKS * PAGES_PER_BLOCK * CBS_PER_OPAGE);
+   wf[1][p].gpioOn  = (1<<gpio);
+   wf[1][p].gpioOff = 0;
+   wf[1][p].flags   = 0;
 
-   gpioGetSamples.func     = NULL;
-   gpioGetSamples.ex       = 0;
-   gpioGetSamples.userdata = NULL;
-   gpioGetSamples.bits     = 0;
+   if (offset > bitDelay[0]) wf[1][p].usDelay = offset;
+   else                      wf[1][p].usDelay = bitDelay[0];
 
-   for (i=0; i<=PI_MAX_USER_GPIO; i++)
+   for (i=0; i<numBytes; i++)
    {
-      wfRx[i].mode         = PI_WFRX_NONE;
+      p++;
 
-      gpioAlert[i].func    = NULL;
-   }
+      /* start bit */
 
-   for (i=0; i<=PI_MAX_GPIO; i++)
-   {
-      gpioInfo [i].is      = GPIO_UNDEFINED;
-      gpioInfo [i].width   = 0;
-      gpioInfo [i].range   = PI_DEFAULT_DUTYCYCLE_RANGE;
-      gpioInfo [i].freqIdx = DEFAULT_PWM_IDX;
-   }
+      wf[1][p].gpioOn = 0;
+      wf[1][p].gpioOff = (1<<gpio);
+      wf[1][p].usDelay = bitDelay[0];
+      wf[1][p].flags   = 0;
 
-   for (i=0; i<PI_NOTIFY_SLOTS; i++)
-   {
-      gpioNotify[i].seqno = 0;
-      gpioNotify[i].state = PI_NOTIFY_CLOSED;
-   }
+      lev = 0;
 
-   for (i=0; i<=PI_MAX_SIGNUM; i++)
-   {
-      gpioSignal[i].func     = NULL;
-      gpioSignal[i].ex       = 0;
-      gpioSignal[i].userdata = NULL;
-   }
+      if      (data_bits <  9) c = bstr[i];
+      else if (data_bits < 17) c = wstr[i];
+      else                  c = lstr[i];
 
-   for (i=0; i<=PI_MAX_TIMER; i++)
-   {
-      gpioTimer[i].running = 0;
-      gpioTimer[i].func    = NULL;
-   }
+      for (b=0; b<data_bits; b++)
+      {
+         if (c & (1<<b)) v=1; else v=0;
 
-   /* calculate the usable PWM frequencies */
+         if (v == lev) wf[1][p].usDelay += bitDelay[b+1];
+         else
+         {
+            p++;
 
-   for (i=0; i<PWM_FREQS; i++)
-   {
-      pwmFreq[i]=
-         (1000000.0/
-            ((float)PULSE_PER_CYCLE*gpioCfg.clockMicros*pwmCycles[i]))+0.5;
+            lev = v;
 
-      DBG(DBG_STARTUP, "f%d is %d", i, pwmFreq[i]);
-   }
+            if (lev)
+            {
+               wf[1][p].gpioOn  = (1<<gpio);
+               wf[1][p].gpioOff = 0;
+               wf[1][p].flags   = 0;
+            }
+            else
+            {
+               wf[1][p].gpioOn  = 0;
+               wf[1][p].gpioOff = (1<<gpio);
+               wf[1][p].flags   = 0;
+            }
 
-   inpFifo = NULL;
-   outFifo = NULL;
+            wf[1][p].usDelay = bitDelay[b+1];
+         }
+      }
 
-   fdLock = -1;
-   fdMem  = -1;
-   fdSock = -1;
+      /* stop bit */
 
-   dmaMboxBlk = MAP_FAILED;
-   dmaPMapBlk = MAP_FAILED;
-   dmaVirt = MAP_FAILED;
-   dmaBus  = MAP_FAILED;
+      if (lev) wf[1][p].usDelay += bitDelay[data_bits+1];
+      else
+      {
+         p++;
 
-   auxReg  = MAP_FAILED;
-   clkReg  = MAP_FAILED;
-   dmaReg  = MAP_FAILED;
-   gpioReg = MAP_FAILED;
-   pcmReg  = MAP_FAILED;
-   pwmReg  = MAP_FAILED;
-   systReg = MAP_FAILED;
-   spiReg  = MAP_FAILED;
+         wf[1][p].gpioOn  = (1<<gpio);
+         wf[1][p].gpioOff = 0;
+         wf[1][p].usDelay = bitDelay[data_bits+1];
+         wf[1][p].flags   = 0;
+      }
+   }
+
+   p++;
+
+   wf[1][p].gpioOn  = (1<<gpio);
+   wf[1][p].gpioOff = 0;
+   wf[1][p].usDelay = bitDelay[0];
+   wf[1][p].flags   = 0;
+
+   return rawWaveAddGeneric(p, wf[1]);
 }
 
 /* ----------------------------------------------------------------------- */
 
-static void initReleaseResources(void)
+int rawWaveAddSPI(
+   rawSPI_t *spi,
+   unsigned offset,
+   unsigned spiSS,
+   char *buf,
+   unsigned spiTxBits,
+   unsigned spiBitFirst,
+   unsigned spiBitLast,
+   unsigned spiBits)
 {
-   int i;
+   int p, dbv, bit, halfbit;
+   int rising_edge[2], read_cycle[2];
+   uint32_t on_bits, off_bits;
+   int tx_bit_pos;
 
-   DBG(DBG_STARTUP, "");
+   DBG(DBG_USER,
+      "spi=%08X off=%d spiSS=%d tx=%08X, num=%d fb=%d lb=%d spiBits=%d",
+      (uint32_t)spi, offset, spiSS, (uint32_t)buf, spiTxBits,
+      spiBitFirst, spiBitLast, spiBits);
 
-   /* shut down running threads */
+   CHECK_INITED;
 
-   for (i=0; i<=PI_MAX_TIMER; i++)
-   {
-      if (gpioTimer[i].running)
-      {
-         /* destroy thread */
+   if (spiSS > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", spiSS);
 
-         pthread_cancel(gpioTimer[i].pthId);
-         pthread_join(gpioTimer[i].pthId, NULL);
-         gpioTimer[i].running = 0;
-      }
-   }
+   /*
+   CPOL CPHA
+    0    0   read rising/write falling
+    0    1   read falling/write rising
+    1    0   read falling/write rising
+    1    1   read rising/write falling
+   */
 
-   if (pthAlertRunning)
-   {
-      pthread_cancel(pthAlert);
-      pthread_join(pthAlert, NULL);
-      pthAlertRunning = 0;
-   }
+   if (spi->clk_pol) {rising_edge[0] = 0; rising_edge[1] = 1;}
+   else              {rising_edge[0] = 1; rising_edge[1] = 0;}
 
-   if (pthFifoRunning)
-   {
-      pthread_cancel(pthFifo);
-      pthread_join(pthFifo, NULL);
-      pthFifoRunning = 0;
-   }
+   if (spi->clk_pha) {read_cycle[0] = 0; read_cycle[1] = 1;}
+   else              {read_cycle[0] = 1; read_cycle[1] = 0;}
 
-   if (pthSocketRunning)
+   p = 0;
+
+   if (offset)
    {
-      pthread_cancel(pthSocket);
-      pthread_join(pthSocket, NULL);
-      pthSocketRunning = 0;
+      wf[1][p].gpioOn  = 0;
+      wf[1][p].gpioOff = 0;
+      wf[1][p].flags   = 0;
+      wf[1][p].usDelay = offset;
+      p++;
    }
 
-   /* release mmap'd memory */
+   /* preset initial mosi bit in case it's read at leading clock bit */
 
-   if (auxReg  != MAP_FAILED) munmap((void *)auxReg,  AUX_LEN);
-   if (clkReg  != MAP_FAILED) munmap((void *)clkReg,  CLK_LEN);
-   if (dmaReg  != MAP_FAILED) munmap((void *)dmaReg,  DMA_LEN);
-   if (gpioReg != MAP_FAILED) munmap((void *)gpioReg, GPIO_LEN);
-   if (pcmReg  != MAP_FAILED) munmap((void *)pcmReg,  PCM_LEN);
-   if (pwmReg  != MAP_FAILED) munmap((void *)pwmReg,  PWM_LEN);
-   if (systReg != MAP_FAILED) munmap((void *)systReg, SYST_LEN);
-   if (spiReg  != MAP_FAILED) munmap((void *)spiReg,  SPI_LEN);
+   on_bits = 0;
+   off_bits = 0;
 
-   auxReg  = MAP_FAILED;
-   clkReg  = MAP_FAILED;
-   dmaReg  = MAP_FAILED;
-   gpioReg = MAP_FAILED;
-   pcmReg  = MAP_FAILED;
-   pwmReg  = MAP_FAILED;
-   systReg = MAP_FAILED;
-   spiReg  = MAP_FAILED;
+   tx_bit_pos = 0;
 
-   if (dmaBus != MAP_FAILED)
+   if (getBitInBytes(tx_bit_pos, buf, spiTxBits))
    {
-      munmap(dmaBus,
-         PAGES_PER_BLOCK*(bufferBlocks+PI_WAVE_BLOCKS)*sizeof(dmaPage_t *));
+      dbv = 1;
+      on_bits  |= (1<<(spi->mosi));
    }
-
-   dmaBus = MAP_FAILED;
-
-   if (dmaVirt != MAP_FAILED)
+   else
    {
-      for (i=0; i<PAGES_PER_BLOCK*(bufferBlocks+PI_WAVE_BLOCKS); i++)
-      {
-         munmap(dmaVirt[i], PAGE_SIZE);
-      }
-
-      munmap(dmaVirt,
-         PAGES_PER_BLOCK*(bufferBlocks+PI_WAVE_BLOCKS)*sizeof(dmaPage_t *));
+      dbv = 0;
+      off_bits  |= (1<<(spi->mosi));
    }
 
-   dmaVirt = MAP_FAILED;
+   if (spi->ss_pol) off_bits |= (1<<spiSS);
+   else             on_bits  |= (1<<spiSS);
 
-   if (dmaPMapBlk != MAP_FAILED)
-   {
-      for (i=0; i<(bufferBlocks+PI_WAVE_BLOCKS); i++)
-      {
-         munmap(dmaPMapBlk[i], PAGES_PER_BLOCK*PAGE_SIZE);
-      }
+   wf[1][p].gpioOn  = on_bits;
+   wf[1][p].gpioOff = off_bits;
+   wf[1][p].flags   = 0;
 
-      munmap(dmaPMapBlk, (bufferBlocks+PI_WAVE_BLOCKS)*sizeof(dmaPage_t *));
-   }
+   if (spi->clk_us > spi->ss_us) wf[1][p].usDelay = spi->clk_us;
+   else                          wf[1][p].usDelay = spi->ss_us;
 
-   dmaPMapBlk = MAP_FAILED;
+   p++;
 
-   if (dmaMboxBlk != MAP_FAILED)
+   for (bit=1; bit<=spiBits; bit++)
    {
-      fdMbox = mbOpen();
-
-      for (i=0; i<(bufferBlocks+PI_WAVE_BLOCKS); i++)
+      for (halfbit=0; halfbit<2; halfbit++)
       {
-         mbDMAFree(&dmaMboxBlk[bufferBlocks+PI_WAVE_BLOCKS-i-1]);
-      }
+         wf[1][p].usDelay = spi->clk_us;
+         wf[1][p].flags = 0;
 
-      mbClose(fdMbox);
+         on_bits = 0;
+         off_bits = 0;
 
-      munmap(dmaMboxBlk, (bufferBlocks+PI_WAVE_BLOCKS)*sizeof(DMAMem_t));
-   }
+         if (read_cycle[halfbit])
+         {
+            if ((bit>=spiBitFirst) && (bit<=spiBitLast))
+               wf[1][p].flags = WAVE_FLAG_READ;
+         }
+         else
+         {
+            if (getBitInBytes(tx_bit_pos, buf, spiTxBits))
+            {
+               if (!dbv) on_bits |= (1<<(spi->mosi));
+               dbv = 1;
+            }
+            else
+            {
+               if (dbv) off_bits |= (1<<(spi->mosi));
+               dbv = 0;
+            }
 
-   dmaMboxBlk = MAP_FAILED;
+            ++tx_bit_pos;
+         }
 
-   if (inpFifo != NULL)
-   {
-      fclose(inpFifo);
-      unlink(PI_INPFIFO);
-      inpFifo = NULL;
-   }
+         if (rising_edge[halfbit]) on_bits  |= (1<<(spi->clk));
+         else                      off_bits |= (1<<(spi->clk));
 
-   if (outFifo != NULL)
-   {
-      fclose(outFifo);
-      unlink(PI_OUTFIFO);
-      outFifo = NULL;
-   }
+         wf[1][p].gpioOn = on_bits;
+         wf[1][p].gpioOff = off_bits;
 
-   if (fdMem != -1)
-   {
-      close(fdMem);
-      fdMem = -1;
+         p++;
+      }
    }
 
-   if (fdLock != -1)
-   {
-      close(fdLock);
-      unlink(PI_LOCKFILE);
-      fdLock = -1;
-   }
+   on_bits = 0;
+   off_bits = 0;
 
-   if (fdSock != -1)
-   {
-      close(fdSock);
-      fdSock = -1;
-   }
+   if (spi->ss_pol) on_bits  |= (1<<spiSS);
+   else             off_bits |= (1<<spiSS);
 
-   if (fdPmap != -1)
-   {
-      close(fdPmap);
-      fdPmap = -1;
-   }
+   wf[1][p].gpioOn  = on_bits;
+   wf[1][p].gpioOff = off_bits;
+   wf[1][p].flags   = 0;
+   wf[1][p].usDelay = 0;
 
-   if (fdMbox != -1)
-   {
-      close(fdMbox);
-      fdMbox = -1;
-   }
+   p++;
 
-   gpioStats.DMARestarts = 0;
-   gpioStats.dmaInitCbsCount = 0;
+   return rawWaveAddGeneric(p, wf[1]);
 }
 
-int initInitialise(void)
-{
-   int rev, i;
-   struct sockaddr_in server;
-   char * portStr;
-   unsigned port;
-   struct sched_param param;
-   pthread_attr_t pthAttr;
-
-   DBG(DBG_STARTUP, "");
+/* ----------------------------------------------------------------------- */
 
-   waveClockInited = 0;
+int gpioWaveCreate(void)
+{
+   int i, wid;
+   int numCB, numBOOL, numTOOL;
+   int CB, BOOL, TOOL;
 
-   clock_gettime(CLOCK_REALTIME, &libStarted);
+   DBG(DBG_USER, "");
 
-   rev = gpioHardwareRevision();
+   CHECK_INITED;
 
-   initClearGlobals();
+   if (wfPulses == 0) return PI_EMPTY_WAVEFORM;
 
-   if (initCheckPermitted() < 0) return PI_INIT_FAILED;
+   /* What resources are needed? */
 
-   fdLock = initGrabLockFile();
+   waveCBsOOLs(&numCB, &numBOOL, &numTOOL);
 
-   if (fdLock < 0)
-      SOFT_ERROR(PI_INIT_FAILED, "Can't lock %s", PI_LOCKFILE);
+   /* Is the same wave already created (or deleted but not reused)? */
 
-   if (!gpioMaskSet)
+   for (i=0; i<waveOutCount; i++)
    {
-      if      (rev ==  0) gpioMask = PI_DEFAULT_UPDATE_MASK_R0;
-      else if (rev == 17) gpioMask = PI_DEFAULT_UPDATE_MASK_COMPUTE;
-      else if (rev <   4) gpioMask = PI_DEFAULT_UPDATE_MASK_R1;
-      else if (rev <  16) gpioMask = PI_DEFAULT_UPDATE_MASK_R2;
-      else                gpioMask = PI_DEFAULT_UPDATE_MASK_R3;
+      if ((i != wsWid)                     &&
+          (waveHash[i]        == wfHash)  &&
+          (waveInfo[i].numCB   == numCB)   &&
+          (waveInfo[i].numBOOL == numBOOL) &&
+          (waveInfo[i].numTOOL == numTOOL) &&
+          waveSame(i))
+      {
+         if (waveInfo[i].deleted)
+         {
+            waveInfo[i].deleted = 0;
+            waveRefs[i] = 0;
+         }
 
-      gpioMaskSet = 1;
-   }
+         waveRefs[i]++;
 
-#ifndef EMBEDDED_IN_VM
-   sigSetHandler();
-#endif
+         waveReset();
 
-   if (initPeripherals() < 0) return PI_INIT_FAILED;
+         return i;
+      }
+   }
 
-   if (initAllocDMAMem() < 0) return PI_INIT_FAILED;
+   wid = -1;
 
-   /* done with /dev/mem */
+   /* Is there an exact fit with a deleted wave. */
 
-   if (fdMem != -1)
+   for (i=0; i<waveOutCount; i++)
    {
-      close(fdMem);
-      fdMem = -1;
+      if (waveInfo[i].deleted             &&
+         (waveInfo[i].numCB   == numCB)   &&
+         (waveInfo[i].numBOOL == numBOOL) &&
+         (waveInfo[i].numTOOL == numTOOL))
+      {
+         /* Reuse the deleted waves resources. */
+         wid = i;
+         break;
+      }
    }
 
-   param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+   if (wid == -1)
+   {
+      /* Are there enough spare resources? */
 
-   if (gpioCfg.internals & PI_CFG_RT_PRIORITY)
-      sched_setscheduler(0, SCHED_FIFO, &param);
+      if ((numCB+waveOutBotCB) >= NUM_WAVE_CBS)
+         return PI_TOO_MANY_CBS;
 
-   initClock(1); /* initialise main clock */
+      if ((numBOOL+waveOutBotOOL) >= (waveOutTopOOL-numTOOL))
+         return PI_TOO_MANY_OOL;
 
-   atexit(gpioTerminate);
+      if (wid >= PI_MAX_WAVES)
+         return PI_NO_WAVEFORM_ID;
 
-   if (pthread_attr_init(&pthAttr))
-      SOFT_ERROR(PI_INIT_FAILED, "pthread_attr_init failed (%m)");
+      wid = waveOutCount++;
 
-   if (pthread_attr_setstacksize(&pthAttr, STACK_SIZE))
-      SOFT_ERROR(PI_INIT_FAILED, "pthread_attr_setstacksize failed (%m)");
+      waveInfo[wid].botCB  = waveOutBotCB;
+      waveInfo[wid].topCB  = waveOutBotCB + numCB -1;
+      waveInfo[wid].botOOL = waveOutBotOOL;
+      waveInfo[wid].topOOL = waveOutTopOOL;
+      waveInfo[wid].numCB = numCB;
+      waveInfo[wid].numBOOL = numBOOL;
+      waveInfo[wid].numTOOL = numTOOL;
 
-   if (pthread_create(&pthAlert, &pthAttr, pthAlertThread, &i))
-      SOFT_ERROR(PI_INIT_FAILED, "pthread_create alert failed (%m)");
+      waveOutBotCB += numCB;
+      waveOutBotOOL += numBOOL;
+      waveOutTopOOL -= numTOOL;
+   }
 
-   pthAlertRunning = 1;
+   /* Must be room if got this far. */
 
-   if (!(gpioCfg.ifFlags & PI_DISABLE_FIFO_IF))
-   {
-      if (pthread_create(&pthFifo, &pthAttr, pthFifoThread, &i))
-         SOFT_ERROR(PI_INIT_FAILED, "pthread_create fifo failed (%m)");
+   CB   = waveInfo[wid].botCB;
+   BOOL = waveInfo[wid].botOOL;
+   TOOL = waveInfo[wid].topOOL;
 
-      pthFifoRunning = 1;
-   }
+   wave2Cbs(PI_WAVE_MODE_ONE_SHOT, &CB, &BOOL, &TOOL);
 
-   if (!(gpioCfg.ifFlags & PI_DISABLE_SOCK_IF))
+   /* Sanity check. */
+
+   if ( (numCB   != (CB-waveInfo[wid].botCB))    ||
+        (numBOOL != (BOOL-waveInfo[wid].botOOL)) ||
+        (numTOOL != (waveInfo[wid].topOOL-TOOL)) )
    {
-      fdSock = socket(AF_INET , SOCK_STREAM , 0);
+      DBG(0, "ERROR wid=%d CBs %d=%d BOOL %d=%d TOOL %d=%d", wid,
+         numCB,   CB-waveInfo[wid].botCB,
+         numBOOL, BOOL-waveInfo[wid].botOOL,
+         numTOOL, waveInfo[wid].topOOL-TOOL);
+   }
 
-      if (fdSock == -1)
-         SOFT_ERROR(PI_INIT_FAILED, "socket failed (%m)");
+   waveInfo[wid].deleted = 0;
 
-      portStr = getenv(PI_ENVPORT);
+   waveHash[wid] = wfHash;
+   waveRefs[wid] = 1;
 
-      if (portStr) port = atoi(portStr); else port = gpioCfg.socketPort;
+   waveKeep(wid, 1);
 
-      server.sin_family = AF_INET;
-      server.sin_addr.s_addr = INADDR_ANY;
-      server.sin_port = htons(port);
+   /* Consume waves. */
 
-      if (bind(fdSock,(struct sockaddr *)&server , sizeof(server)) < 0)
-         SOFT_ERROR(PI_INIT_FAILED, "bind to port %d failed (%m)", port);
+   waveReset();
 
-      if (pthread_create(&pthSocket, &pthAttr, pthSocketThread, &i))
-         SOFT_ERROR(PI_INIT_FAILED, "pthread_create socket failed (%m)");
+   return wid;
+}
 
-      pthSocketRunning = 1;
-   }
+/* ----------------------------------------------------------------------- */
 
-   myGpioDelay(10000);
+int gpioWaveDelete(unsigned wave_id)
+{
+   DBG(DBG_USER, "wave id=%d", wave_id);
 
-   dmaInitCbs();
+   CHECK_INITED;
 
-   flushMemory();
+   if ((wave_id >= waveOutCount) || waveInfo[wave_id].deleted ||
+       (wave_id == wsWid))
+      SOFT_ERROR(PI_BAD_WAVE_ID, "bad wave id (%d)", wave_id);
 
-   initDMAgo((uint32_t *)dmaIn, (uint32_t)dmaIBus[0]);
+   /* a wave created more than once is kept until deleted as often */
 
-   myGpioDelay(20000);
+   if (--waveRefs[wave_id] > 0) return 0;
 
-   return PIGPIO_VERSION;
-}
+   waveInfo[wave_id].deleted = 1;
 
+   if (wave_id == (waveOutCount-1))
+   {
+      /* top wave deleted, garbage collect any other deleted waves */
 
-/* ======================================================================= */
+      while ((wave_id > 0) && (waveInfo[wave_id-1].deleted)) --wave_id;
 
-int getBitInBytes(int bitPos, char *buf, int numBits)
-{
-   int bitp, bufp;
+      waveOutBotCB  = waveInfo[wave_id].botCB;
+      waveOutBotOOL = waveInfo[wave_id].botOOL;
+      waveOutTopOOL = waveInfo[wave_id].topOOL;
 
-   if (bitPos < numBits)
-   {
-      bufp =      bitPos / 8;
-      bitp = 7 - (bitPos % 8);
-      if (buf[bufp] & (1<<bitp)) return 1;
+      waveOutCount = wave_id;
    }
 
    return 0;
@@ -7231,2346 +13633,2504 @@ int getBitInBytes(int bitPos, char *buf, int numBits)
 
 /* ----------------------------------------------------------------------- */
 
-void putBitInBytes(int bitPos, char *buf, int bit)
+int gpioWaveTxStart(unsigned wave_mode)
 {
-   int bitp, bufp;
+   /* This function is deprecated and has been removed. */
 
-   bufp =      bitPos / 8;
-   bitp = 7 - (bitPos % 8);
+   CHECK_INITED;
 
-   if (bit) buf[bufp] |=   (1<<bitp);
-   else     buf[bufp] &= (~(1<<bitp));
+   SOFT_ERROR(PI_DEPRECATED, "deprected function removed");
 }
 
 /* ----------------------------------------------------------------------- */
 
-uint32_t rawWaveGetOut(int pos)
+int gpioWaveTxSend(unsigned wave_id, unsigned wave_mode)
 {
-   int page, slot;
+   rawCbs_t *p=NULL;
 
-   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
-   {
-      waveOOLPageSlot(pos, &page, &slot);
-      return (dmaOVirt[page]->OOL[slot]);
-   }
+   DBG(DBG_USER, "wave_id=%d wave_mode=%d", wave_id, wave_mode);
 
-   return -1;
-}
+   CHECK_INITED;
 
-/* ----------------------------------------------------------------------- */
+   if ((wave_id >= waveOutCount) || waveInfo[wave_id].deleted)
+      SOFT_ERROR(PI_BAD_WAVE_ID, "bad wave id (%d)", wave_id);
 
-void rawWaveSetOut(int pos, uint32_t value)
-{
-   int page, slot;
+   if (wave_mode > PI_WAVE_MODE_REPEAT)
+      SOFT_ERROR(PI_BAD_WAVE_MODE, "bad wave mode (%d)", wave_mode);
 
-   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
+   if (wsWid >= 0)
+      SOFT_ERROR(PI_WAVE_STREAMING, "wave stream open");
+
+   if (!waveClockInited)
    {
-      waveOOLPageSlot(pos, &page, &slot);
-      dmaOVirt[page]->OOL[slot] = value;
+      stopHardwarePWM();
+      initClock(0); /* initialise secondary clock */
+      waveClockInited = 1;
    }
+
+   pthread_mutex_lock(&spiDmaMutex); /* wait for any SPI DMA transfer */
+
+   dmaOut[DMA_CS] = DMA_CHANNEL_RESET;
+
+   dmaOut[DMA_CONBLK_AD] = 0;
+
+   p = rawWaveCBAdr(waveInfo[wave_id].topCB);
+
+   if (wave_mode == PI_WAVE_MODE_ONE_SHOT) p->next = 0;
+   else p->next = waveCbPOadr(waveInfo[wave_id].botCB+1);
+
+   initDMAgo((uint32_t *)dmaOut, waveCbPOadr(waveInfo[wave_id].botCB));
+
+   pthread_mutex_unlock(&spiDmaMutex);
+
+   /* for compatability with the deprecated gpioWaveTxStart return the
+      number of cbs
+   */
+   return (waveInfo[wave_id].topCB - waveInfo[wave_id].botCB) + 1;
 }
 
 
 /* ----------------------------------------------------------------------- */
 
-uint32_t rawWaveGetIn(int pos)
+static int chainGetCB(int n)
 {
-   int page, slot;
+   int block, index;
 
-   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
+   if (n < (WCB_CHAIN_CBS * PI_WAVE_COUNT_PAGES))
    {
-      waveOOLPageSlot((NUM_WAVE_OOL-1)-pos, &page, &slot);
-      return (dmaOVirt[page]->OOL[slot]);
+      block = n / WCB_CHAIN_CBS;
+      index = n % WCB_CHAIN_CBS;
+      return (block*CBS_PER_OPAGE) + WCB_COUNTER_CBS + index;
    }
-
    return -1;
 }
 
-/* ----------------------------------------------------------------------- */
+static void chainSetVal(int n, uint32_t val)
+{
+   int block, index;
+   uint32_t *p;
 
-void rawWaveSetIn(int pos, uint32_t value)
+   if (n < (WCB_CHAIN_OOL * PI_WAVE_COUNT_PAGES))
+   {
+      block = n / WCB_CHAIN_OOL;
+      index = n % WCB_CHAIN_OOL;
+      p = (uint32_t *) dmaOVirt[block] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
+      p[index] = val;
+   }
+}
+
+static uint32_t chainGetValPadr(int n)
 {
-   int page, slot;
+   int block, index;
+   uint32_t *p;
 
-   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
+   if (n < (WCB_CHAIN_OOL * PI_WAVE_COUNT_PAGES))
    {
-      waveOOLPageSlot((NUM_WAVE_OOL-1)-pos, &page, &slot);
-      dmaOVirt[page]->OOL[slot] = value;
+      block = n / WCB_CHAIN_OOL;
+      index = n % WCB_CHAIN_OOL;
+      p = (uint32_t *) dmaOBus[block] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
+      return (uint32_t) (p + index);
    }
+   return 0;
 }
 
-/* ----------------------------------------------------------------------- */
+static uint32_t chainGetCntVal(int counter, int slot)
+{
+   uint32_t *p;
+   int page, offset;
+   page = counter / 2;
+   offset = (counter % 2 ? WCB_COUNTER_OOL : 0);
+   p = (uint32_t *) dmaOVirt[page] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
+   return p[WCB_CHAIN_OOL+ offset + slot];
+}
 
-rawWaveInfo_t rawWaveInfo(int wave_id)
+static void chainSetCntVal(int counter, int slot, uint32_t value)
 {
-   rawWaveInfo_t dummy = {-1, -1, -1, -1};
+   uint32_t *p;
+   int page, offset;
+   page = counter / 2;
+   offset = (counter % 2 ? WCB_COUNTER_OOL : 0);
+   p = (uint32_t *) dmaOVirt[page] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
+   p[WCB_CHAIN_OOL + offset + slot] = value;
+}
 
-   if ((wave_id >=0) && (wave_id < PI_MAX_WAVES)) return waveInfo[wave_id];
-   else                                           return dummy;
+static uint32_t chainGetCntValPadr(int counter, int slot)
+{
+   uint32_t *p;
+   int page, offset;
+   page = counter / 2;
+   offset = (counter % 2 ? WCB_COUNTER_OOL : 0);
+   p = (uint32_t *) dmaOBus[page] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
+   return (uint32_t)(p + WCB_CHAIN_OOL + offset + slot);
 }
 
-/* ----------------------------------------------------------------------- */
+static int chainGetCntCB(int counter)
+{
+   int page, offset;
+   page = counter / 2;
+   offset = (counter % 2 ? WCB_CNT_CBS : 0);
+   return ((page * CBS_PER_OPAGE) + offset);
+}
 
-double time_time(void)
+static void chainMakeCounter(
+   unsigned counter,
+   unsigned blklen,
+   unsigned blocks,
+   unsigned count,
+   uint32_t repeat,
+   uint32_t next)
 {
-   struct timeval tv;
-   double t;
+   rawCbs_t *p=NULL;
 
-   gettimeofday(&tv, 0);
+   int b, baseCB, dig;
+   uint32_t nxt;
 
-   t = (double)tv.tv_sec + ((double)tv.tv_usec / 1E6);
+   int botCB;
 
-   return t;
-}
+   botCB  = chainGetCntCB(counter);
 
-/* ----------------------------------------------------------------------- */
+   baseCB = botCB;
 
-void time_sleep(double seconds)
-{
-   struct timespec ts, rem;
+   /* set up all the OOLs */
+   for (b=0; b < (blocks*(blklen+1)); b++) chainSetCntVal(counter, b, repeat);
 
-   if (seconds > 0.0)
+   for (b=0; b<blocks; b++)
+      chainSetCntVal(counter,
+         ((b*(blklen+1))+blklen),
+         waveCbPOadr(baseCB+((b*3)+3)));
+
+   for (b=0; b<blocks; b++)
    {
-      ts.tv_sec = seconds;
-      ts.tv_nsec = (seconds-(double)ts.tv_sec) * 1E9;
+      /* copy BOTTOM to NEXT */
 
-      while (clock_nanosleep(CLOCK_REALTIME, 0, &ts, &rem))
-      {
-         /* copy remaining time to ts */
-         ts.tv_sec  = rem.tv_sec;
-         ts.tv_nsec = rem.tv_nsec;
-      }
-   }
-}
+      p = rawWaveCBAdr(botCB++);
 
-/* ----------------------------------------------------------------------- */
+      p->info = NORMAL_DMA;
 
-void rawDumpWave(void)
-{
-   int i;
+      p->src = chainGetCntValPadr(counter, b*(blklen+1));
+      p->dst = (waveCbPOadr(botCB+1) + 20);
 
-   unsigned numWaves, t;
+      p->length = 4;
+      p->next   = waveCbPOadr(botCB);
 
-   rawWave_t *waves;
+      /* copy BOTTOM to TOP */
+
+      p = rawWaveCBAdr(botCB++);
+
+      p->info   = NORMAL_DMA;
+
+      p->src = chainGetCntValPadr(counter, b*(blklen+1));
+      p->dst = chainGetCntValPadr(counter, (b*(blklen+1))+blklen);
+
+      p->length = 4;
+      p->next   = waveCbPOadr(botCB);
+
+      /* shift all down one */
+
+      p = rawWaveCBAdr(botCB++);
 
-   numWaves = wfc[wfcur];
-   waves    = wf [wfcur];
+      p->info   = NORMAL_DMA|DMA_SRC_INC|DMA_DEST_INC;
 
-   t = 0;
+      p->src = chainGetCntValPadr(counter, ((b*(blklen+1))+1));
+      p->dst = chainGetCntValPadr(counter, ((b*(blklen+1))+0));
 
-   for (i=0; i<numWaves; i++)
-   {
-      fprintf(stderr, "%10u %08X %08X %08X %10u\n",
-         t, waves[i].gpioOn, waves[i].gpioOff,
-         waves[i].flags, waves[i].usDelay);
-      t += waves[i].usDelay;
+      p->length = blklen*4;
+      p->next   = repeat;
    }
-}
 
-/* ----------------------------------------------------------------------- */
+   /* reset the counter */
 
-void rawDumpScript(unsigned script_id)
-{
-   int i;
+   p = rawWaveCBAdr(botCB);
 
-   if (script_id >= PI_MAX_SCRIPTS) return;
+   p->info = NORMAL_DMA|DMA_SRC_INC|DMA_DEST_INC;
 
-   if (gpioScript[script_id].state == PI_SCRIPT_IN_USE)
-   {
+   p->src = chainGetCntValPadr(counter, blocks*(blklen+1));
+   p->dst = chainGetCntValPadr(counter, 0);
 
-      for (i=0; i<PI_MAX_SCRIPT_PARAMS; i++)
-      {
-         fprintf(stderr, "p%d=%d ", i, gpioScript[script_id].script.par[i]);
-      }
+   p->length = blocks*(blklen+1)*4;
+   p->next   = next;
 
-      fprintf(stderr, "\n");
+   b = 0;
 
-      for (i=0; i<PI_MAX_SCRIPT_VARS; i++)
-      {
-         fprintf(stderr, "v%d=%d ", i, gpioScript[script_id].script.var[i]);
-      }
+   while (count && (b<blocks))
+   {
+      dig = count % blklen;
+      count /= blklen;
 
-      fprintf(stderr, "\n");
+      if (count) nxt = chainGetCntVal(counter, (b*(blklen+1))+blklen);
+      else       nxt = waveCbPOadr(botCB);
 
-      for (i=0; i<gpioScript[script_id].script.instrs; i++)
-      {
-         fprintf(stderr,
-            "c%d=[%d, %d(%d), %d(%d), %d, %d]\n",
-            i,
-            gpioScript[script_id].script.instr[i].p[0],
-            gpioScript[script_id].script.instr[i].p[1],
-            gpioScript[script_id].script.instr[i].opt[1],
-            gpioScript[script_id].script.instr[i].p[2],
-            gpioScript[script_id].script.instr[i].opt[2],
-            gpioScript[script_id].script.instr[i].p[3],
-            gpioScript[script_id].script.instr[i].p[4]);
-      }
+      chainSetCntVal(counter, b*(blklen+1)+dig, nxt);
+
+      b++;
    }
+
+   /* copy all the OOLs */
+   for (b=0; b < (blocks*(blklen+1)); b++)
+      chainSetCntVal(
+         counter, b+(blocks*(blklen+1)), chainGetCntVal(counter, b));
 }
 
-/* ======================================================================= */
 
-int gpioInitialise(void)
+int gpioWaveChain(char *buf, unsigned bufSize)
 {
-   int status;
+   unsigned blklen=16, blocks=4;
+   int cb, chaincb;
+   rawCbs_t *p;
+   int i, wid, cmd, loop, counters;
+   unsigned cycles;
+   uint32_t repeat, next;
+   int stk_pos[10], stk_lev=0;
 
-   if (libInitialised) return PIGPIO_VERSION;
+   cb = 0;
+   loop = -1;
 
-   DBG(DBG_STARTUP, "not initialised, initialising");
+   DBG(DBG_USER, "bufSize=%d [%s]", bufSize, myBuf2Str(bufSize, buf));
 
-   runState = PI_STARTING;
+   CHECK_INITED;
 
-   status = initInitialise();
+   if (wsWid >= 0)
+      SOFT_ERROR(PI_WAVE_STREAMING, "wave stream open");
 
-   if (status < 0)
-   {
-      runState = PI_ENDING;
-      initReleaseResources();
-   }
-   else
+   if (!waveClockInited)
    {
-      libInitialised = 1;
-      runState = PI_RUNNING;
+      stopHardwarePWM();
+      initClock(0); /* initialise secondary clock */
+      waveClockInited = 1;
    }
 
-   return status;
-}
+   pthread_mutex_lock(&spiDmaMutex);
 
+   dmaOut[DMA_CS] = DMA_CHANNEL_RESET;
 
-/* ----------------------------------------------------------------------- */
+   dmaOut[DMA_CONBLK_AD] = 0;
 
-void gpioTerminate(void)
-{
-   int i;
+   pthread_mutex_unlock(&spiDmaMutex);
 
-   DBG(DBG_USER, "");
+   /* add delay cb at start of DMA */
 
-   if (!libInitialised) return;
+   p = rawWaveCBAdr(chainGetCB(cb++));
 
-   DBG(DBG_STARTUP, "initialised, terminating");
+   /* use the secondary clock */
 
-   runState = PI_ENDING;
+   if (gpioCfg.clockPeriph != PI_CLOCK_PCM)
+   {
+      p->info = NORMAL_DMA | TIMED_DMA(2);
+      p->dst  = PCM_TIMER;
+   }
+   else
+   {
+      p->info = NORMAL_DMA | TIMED_DMA(5);
+      p->dst  = PWM_TIMER;
+   }
 
-   gpioMaskSet = 0;
+   p->src    = (uint32_t) (&dmaOBus[0]->periphData);
+   p->length = 4 * 20 / PI_WF_MICROS; /* 20 micros delay */
+   p->next   = waveCbPOadr(chainGetCB(cb));
 
-   /* reset DMA */
+   counters = 0;
+   wid = -1;
 
-   if (dmaReg != MAP_FAILED) dmaIn[DMA_CS] = DMA_CHANNEL_RESET;
-   if (dmaReg != MAP_FAILED) dmaOut[DMA_CS] = DMA_CHANNEL_RESET;
+   i = 0;
 
-#ifndef EMBEDDED_IN_VM
-   if (gpioCfg.internals & PI_CFG_STATS)
+   while (i<bufSize)
    {
-      fprintf(stderr,
-         "\n#####################################################\n");
-      fprintf(stderr,
-         "If you didn't request stats please cut & paste the\n"
-         "following and e-mail to pigpio@abyz.co.uk\n");
+      wid = (unsigned)buf[i];
 
-      fprintf(stderr, "pigpio version=%d internals=%X\n",
-         PIGPIO_VERSION, gpioCfg.internals);
+      if (wid == 255) /* wave command */
+      {
+         if ((i+2) > bufSize)
+            SOFT_ERROR(PI_BAD_CHAIN_CMD,
+               "incomplete chain command (at %d)", i);
 
-      fprintf(stderr,
-         "micros=%d allocMode=%d dmaInitCbs=%d DMARestarts=%d\n",
-         gpioCfg.clockMicros, gpioCfg.memAllocMode,
-         gpioStats.dmaInitCbsCount, gpioStats.DMARestarts);
+         cmd = buf[i+1];
 
-      fprintf(stderr,
-         "samples %u maxSamples %u maxEmit %u emitFrags %u\n",
-         gpioStats.numSamples, gpioStats.maxSamples,
-         gpioStats.maxEmit, gpioStats.emitFrags);
+         if (cmd == 0) /* loop begin */
+         {
+            if (stk_lev >= (sizeof(stk_pos)/sizeof(int)))
+               SOFT_ERROR(PI_CHAIN_NESTING,
+                  "chain counters nested too deep (at %d)", i);
 
-      fprintf(stderr, "cbTicks %d, cbCalls %u\n",
-         gpioStats.cbTicks, gpioStats.cbCalls);
+            stk_pos[stk_lev++] = cb;
 
-      fprintf(stderr, "pipe: good %u, short %u, would block %u\n",
-         gpioStats.goodPipeWrite, gpioStats.shortPipeWrite,
-         gpioStats.wouldBlockPipeWrite);
+            i += 2;
+         }
+         else if (cmd == 1) /* loop end */
+         {
+            if (counters >= WCB_COUNTERS)
+               SOFT_ERROR(PI_CHAIN_COUNTER,
+                  "too many chain counters (at %d)", i);
 
-      fprintf(stderr, "alertTicks %u, lateTicks %u, moreToDo %u\n",
-         gpioStats.alertTicks, gpioStats.lateTicks, gpioStats.moreToDo);
+            if ((i+4) > bufSize)
+               SOFT_ERROR(PI_BAD_CHAIN_CMD,
+                  "incomplete chain command (at %d)", i);
 
-      for (i=0; i< TICKSLOTS; i++)
-         fprintf(stderr, "%9u ", gpioStats.diffTick[i]);
+            loop = 0;
+            if (--stk_lev >= 0) loop = stk_pos[stk_lev];
 
-      fprintf(stderr,
-         "\n#####################################################\n\n\n");
-   }
-#endif
+            if ((loop < 1) || (loop == cb))
+               SOFT_ERROR(PI_BAD_CHAIN_LOOP,
+                  "empty chain loop (at %d)", i);
 
-   initReleaseResources();
+            cycles = ((unsigned)buf[i+3] <<  8) + (unsigned)buf[i+2];
 
-   fflush(NULL);
+            i += 4;
 
-   libInitialised = 0;
-}
+            if (cycles > PI_MAX_WAVE_CYCLES)
+               SOFT_ERROR(PI_CHAIN_LOOP_CNT,
+                  "bad chain loop count (%d)", cycles);
 
-static void switchFunctionOff(unsigned gpio)
-{
-   switch (gpioInfo[gpio].is)
-   {
-      case GPIO_SERVO:
-         /* switch servo off */
-         myGpioSetServo(gpio, gpioInfo[gpio].width, 0);
-         gpioInfo[gpio].width = 0;
-         break;
+            if (cycles == 0)
+            {
+               /* Skip the complete loop block.  Change
+                  the next pointing to the start of the
+                  loop block to the current cb.
+               */
+               p = rawWaveCBAdr(chainGetCB(loop));
+               p->next = waveCbPOadr(chainGetCB(cb));
+            }
+            else if (cycles == 1)
+            {
+               /* Nothing to do, no need for a counter. */
+            }
+            else
+            {
+               chaincb = chainGetCB(cb++);
+               if (chaincb < 0)
+                  SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
 
-      case GPIO_PWM:
-         /* switch pwm off */
-         myGpioSetPwm(gpio, gpioInfo[gpio].width, 0);
-         gpioInfo[gpio].width = 0;
-         break;
+               p = rawWaveCBAdr(chaincb);
 
-      case GPIO_HW_CLK:
-         /* No longer disable clock hardware, doing that was a bug. */
-         gpioInfo[gpio].width = 0;
-         break;
+               repeat = waveCbPOadr(chainGetCB(loop));
 
-      case GPIO_HW_PWM:
-         /* No longer disable PWM hardware, doing that was a bug. */
-         gpioInfo[gpio].width = 0;
-         break;
-   }
-}
+                /* Need to check next cb as well. */
 
-static void stopHardwarePWM(void)
-{
-   unsigned i, pwm;
+               chaincb = chainGetCB(cb);
 
-   for (i=0; i<= PI_MAX_GPIO; i++)
-   {
-      if (gpioInfo[i].is == GPIO_HW_PWM)
-      {
-         pwm = (PWMDef[i] >> 4) & 3;
+               if (chaincb < 0)
+                  SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
 
-         if (pwm == 0) pwmReg[PWM_CTL] &= (~PWM_CTL_PWEN1);
-         else          pwmReg[PWM_CTL] &= (~PWM_CTL_PWEN2);
+               next = waveCbPOadr(chainGetCB(cb));
 
-         gpioInfo[i].width = 0;
-         gpioInfo[i].is = GPIO_UNDEFINED;
-      }
-   }
-}
+               /* dummy src and dest */
+               p->info = NORMAL_DMA;
+               p->src = (uint32_t) (&dmaOBus[0]->periphData);
+               p->dst = (uint32_t) (&dmaOBus[0]->periphData);
+               p->length = 4;
+               p->next = waveCbPOadr(chainGetCntCB(counters));
 
-/* ----------------------------------------------------------------------- */
+               chainMakeCounter(counters, blklen, blocks,
+                            cycles-1, repeat, next);
 
-int gpioSetMode(unsigned gpio, unsigned mode)
-{
-   int reg, shift, old_mode;
+               counters++;
+            }
+         }
+         else if (cmd == 2) /* delay us */
+         {
+            if ((i+4) > bufSize)
+               SOFT_ERROR(PI_BAD_CHAIN_CMD,
+                  "incomplete chain command (at %d)", i);
 
-   DBG(DBG_USER, "gpio=%d mode=%d", gpio, mode);
+            cycles = ((unsigned)buf[i+3] <<  8) + (unsigned)buf[i+2];
 
-   CHECK_INITED;
+            i += 4;
 
-   if (gpio > PI_MAX_GPIO)
-      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
+            if (cycles > PI_MAX_WAVE_DELAY)
+               SOFT_ERROR(PI_BAD_CHAIN_DELAY,
+                  "bad chain delay micros (%d)", cycles);
 
-   if (mode > PI_ALT3)
-      SOFT_ERROR(PI_BAD_MODE, "gpio %d, bad mode (%d)", gpio, mode);
+            if (cycles)
+            {
+               chaincb = chainGetCB(cb++);
 
-   reg   =  gpio/10;
-   shift = (gpio%10) * 3;
+               if (chaincb < 0)
+                  SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
 
-   old_mode = (gpioReg[reg] >> shift) & 7;
+               p = rawWaveCBAdr(chaincb);
 
-   if (mode != old_mode)
-   {
-      switchFunctionOff(gpio);
+               /* use the secondary clock */
 
-      gpioInfo[gpio].is = GPIO_UNDEFINED;
+               if (gpioCfg.clockPeriph != PI_CLOCK_PCM)
+               {
+                  p->info = NORMAL_DMA | TIMED_DMA(2);
+                  p->dst  = PCM_TIMER;
+               }
+               else
+               {
+                  p->info = NORMAL_DMA | TIMED_DMA(5);
+                  p->dst  = PWM_TIMER;
+               }
 
-      gpioReg[reg] = (gpioReg[reg] & ~(7<<shift)) | (mode<<shift);
-   }
+               p->src    = (uint32_t) (&dmaOBus[0]->periphData);
+               p->length = 4 * cycles / PI_WF_MICROS;
+               p->next   = waveCbPOadr(chainGetCB(cb));
+            }
+         }
+         else if (cmd == 3) /* repeat loop forever */
+         {
+            i += 2;
 
-   return 0;
-}
+            loop = 0;
+            if (--stk_lev >= 0) loop = stk_pos[stk_lev];
 
+            if ((loop < 1) || (loop == cb))
+               SOFT_ERROR(PI_BAD_CHAIN_LOOP,
+                  "empty chain loop (at %d)", i);
 
-/* ----------------------------------------------------------------------- */
+            chaincb = chainGetCB(cb++);
+            if (chaincb < 0)
+               SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
 
-int gpioGetMode(unsigned gpio)
-{
-   int reg, shift;
+            if (i < bufSize)
+               SOFT_ERROR(PI_BAD_FOREVER,
+                  "loop forever must be last command");
 
-   DBG(DBG_USER, "gpio=%d", gpio);
+            p = rawWaveCBAdr(chaincb);
 
-   CHECK_INITED;
+            /* dummy src and dest */
+            p->info = NORMAL_DMA;
+            p->src = (uint32_t) (&dmaOBus[0]->periphData);
+            p->dst = (uint32_t) (&dmaOBus[0]->periphData);
+            p->length = 4;
+            p->next = waveCbPOadr(chainGetCB(loop));
+         }
+         else
+            SOFT_ERROR(PI_BAD_CHAIN_CMD,
+               "unknown chain command (255 %d)", cmd);
+      }
+      else if ((wid >= waveOutCount) || waveInfo[wid].deleted)
+         SOFT_ERROR(PI_BAD_WAVE_ID, "undefined wave (%d)", wid);
+      else
+      {
+         chaincb = chainGetCB(cb++);
 
-   if (gpio > PI_MAX_GPIO)
-      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
+         if (chaincb < 0)
+            SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
 
-   reg   =  gpio/10;
-   shift = (gpio%10) * 3;
+         p = rawWaveCBAdr(chaincb);
 
-   return (gpioReg[reg] >> shift) & 7;
-}
+         chaincb = chainGetCB(cb);
 
+         if (chaincb < 0)
+            SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
 
-/* ----------------------------------------------------------------------- */
+         chainSetVal(cb-1, waveCbPOadr(chaincb));
 
-int gpioSetPullUpDown(unsigned gpio, unsigned pud)
-{
-   DBG(DBG_USER, "gpio=%d pud=%d", gpio, pud);
+         /* patch next of wid topCB to next cb */
 
-   CHECK_INITED;
+         p->info   = NORMAL_DMA;
+         p->src    = chainGetValPadr(cb-1); /* this next */
+         p->dst    = waveCbPOadr(waveInfo[wid].topCB) + 20; /* wid next */
+         p->length = 4;
+         p->next   = waveCbPOadr(waveInfo[wid].botCB+1);
 
-   if (gpio > PI_MAX_GPIO)
-      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
+         i += 1;
+      }
+   }
 
-   if (pud > PI_PUD_UP)
-      SOFT_ERROR(PI_BAD_PUD, "gpio %d, bad pud (%d)", gpio, pud);
+   chaincb = chainGetCB(cb++);
 
-   *(gpioReg + GPPUD) = pud;
+   if (chaincb < 0)
+      SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
 
-   myGpioDelay(20);
+   p = rawWaveCBAdr(chaincb);
 
-   *(gpioReg + GPPUDCLK0 + BANK) = BIT;
+   p->info   = NORMAL_DMA;
+   p->src    = (uint32_t) (&dmaOBus[0]->periphData);
+   p->dst    = (uint32_t) (&dmaOBus[0]->periphData);
+   p->length = 4;
+   p->next = 0;
 
-   myGpioDelay(20);
+   pthread_mutex_lock(&spiDmaMutex);
 
-   *(gpioReg + GPPUD) = 0;
+   initDMAgo((uint32_t *)dmaOut, waveCbPOadr(chainGetCB(0)));
 
-   *(gpioReg + GPPUDCLK0 + BANK) = 0;
+   pthread_mutex_unlock(&spiDmaMutex);
 
    return 0;
 }
 
+/*-------------------------------------------------------------------------*/
 
-/* ----------------------------------------------------------------------- */
-
-int gpioRead(unsigned gpio)
+int gpioWaveTxBusy(void)
 {
-   DBG(DBG_USER, "gpio=%d", gpio);
+   DBG(DBG_USER, "");
 
    CHECK_INITED;
 
-   if (gpio > PI_MAX_GPIO)
-      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
-
-   if ((*(gpioReg + GPLEV0 + BANK) & BIT) != 0) return PI_ON;
-   else                                         return PI_OFF;
+   if (dmaOut[DMA_CONBLK_AD])
+      return 1;
+   else
+      return 0;
 }
 
-
 /* ----------------------------------------------------------------------- */
 
-int gpioWrite(unsigned gpio, unsigned level)
+int gpioWaveTxStop(void)
 {
-   DBG(DBG_USER, "gpio=%d level=%d", gpio, level);
+   DBG(DBG_USER, "");
 
    CHECK_INITED;
 
-   if (gpio > PI_MAX_GPIO)
-      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
-
-   if (level > PI_ON)
-      SOFT_ERROR(PI_BAD_LEVEL, "gpio %d, bad level (%d)", gpio, level);
-
-   if (gpio <= PI_MAX_GPIO)
-   {
-      if (gpioInfo[gpio].is != GPIO_WRITE)
-      {
-         /* stop a glitch between setting mode then level */
-         if (level == PI_OFF) *(gpioReg + GPCLR0 + BANK) = BIT;
-         else                 *(gpioReg + GPSET0 + BANK) = BIT;
+   wsStop();
 
-         switchFunctionOff(gpio);
+   pthread_mutex_lock(&spiDmaMutex);
 
-         gpioSetMode(gpio, PI_OUTPUT);
+   dmaOut[DMA_CS] = DMA_CHANNEL_RESET;
 
-         gpioInfo[gpio].is = GPIO_WRITE;
-      }
-   }
+   dmaOut[DMA_CONBLK_AD] = 0;
 
-   if (level == PI_OFF) *(gpioReg + GPCLR0 + BANK) = BIT;
-   else                 *(gpioReg + GPSET0 + BANK) = BIT;
+   pthread_mutex_unlock(&spiDmaMutex);
 
    return 0;
 }
 
-
 /* ----------------------------------------------------------------------- */
 
-int gpioPWM(unsigned gpio, unsigned val)
+static void wsDelayCb(rawCbs_t *p, uint32_t micros)
 {
-   DBG(DBG_USER, "gpio=%d dutycycle=%d", gpio, val);
-
-   CHECK_INITED;
-
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
-
-   if (val > gpioInfo[gpio].range)
-      SOFT_ERROR(PI_BAD_DUTYCYCLE, "gpio %d, bad dutycycle (%d)", gpio, val);
+   /* use the secondary clock */
 
-   if (gpioInfo[gpio].is != GPIO_PWM)
+   if (gpioCfg.clockPeriph != PI_CLOCK_PCM)
    {
-      switchFunctionOff(gpio);
-
-      gpioSetMode(gpio, PI_OUTPUT);
-
-      gpioInfo[gpio].is = GPIO_PWM;
+      p->info = NORMAL_DMA | TIMED_DMA(2);
+      p->dst  = PCM_TIMER;
+   }
+   else
+   {
+      p->info = NORMAL_DMA | TIMED_DMA(5);
+      p->dst  = PWM_TIMER;
    }
 
-   myGpioSetPwm(gpio, gpioInfo[gpio].width, val);
-
-   gpioInfo[gpio].width=val;
-
-   return 0;
+   p->src    = (uint32_t) (&dmaOBus[0]->periphData);
+   p->length = 4 * ((micros + (PI_WF_MICROS/2)) / PI_WF_MICROS);
 }
 
 /* ----------------------------------------------------------------------- */
 
-int gpioGetPWMdutycycle(unsigned gpio)
+static void wsCopyCb(rawCbs_t *p, uint32_t src, uint32_t dst, uint32_t next)
 {
-   unsigned pwm;
-
-   DBG(DBG_USER, "gpio=%d", gpio);
-
-   CHECK_INITED;
-
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
-
-   switch (gpioInfo[gpio].is)
-   {
-      case GPIO_PWM:
-         return gpioInfo[gpio].width;
-
-      case GPIO_HW_PWM:
-         pwm = (PWMDef[gpio] >> 4) & 3;
-         return hw_pwm_duty[pwm];
-
-      case GPIO_HW_CLK:
-         return PI_HW_PWM_RANGE/2;
-
-      default:
-         SOFT_ERROR(PI_NOT_PWM_GPIO, "not a PWM gpio (%d)", gpio);
-   }
+   p->info   = NORMAL_DMA;
+   p->src    = src;
+   p->dst    = dst;
+   p->length = 4;
+   p->next   = next;
 }
 
-
 /* ----------------------------------------------------------------------- */
 
-int gpioSetPWMrange(unsigned gpio, unsigned range)
+static void wsInitCbs(void)
 {
-   int oldWidth, newWidth;
+   int botCB, botOOL, cb, ool, s, i;
+   uint32_t dispatch, one, zero, flag;
+   rawCbs_t *p;
 
-   DBG(DBG_USER, "gpio=%d range=%d", gpio, range);
+   botCB  = waveInfo[wsWid].botCB;
+   botOOL = waveInfo[wsWid].botOOL;
 
-   CHECK_INITED;
+   dispatch = waveCbPOadr(botCB + WS_CB_DISPATCH);
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   one  = waveOOLPOadr(botOOL + WS_OOL_ONE);
+   zero = waveOOLPOadr(botOOL + WS_OOL_ZERO);
+   flag = waveOOLPOadr(botOOL + WS_OOL_FLAG);
 
-   if ((range < PI_MIN_DUTYCYCLE_RANGE)  || (range > PI_MAX_DUTYCYCLE_RANGE))
-      SOFT_ERROR(PI_BAD_DUTYRANGE, "gpio %d, bad range (%d)", gpio, range);
+   waveSetOOL(botOOL + WS_OOL_ONE,  1);
+   waveSetOOL(botOOL + WS_OOL_ZERO, 0);
+   waveSetOOL(botOOL + WS_OOL_IDLE, waveCbPOadr(botCB + WS_CB_IDLE));
+   waveSetOOL(botOOL + WS_OOL_FLAG, 0);
 
-   oldWidth = gpioInfo[gpio].width;
+   p = rawWaveCBAdr(botCB + WS_CB_START);
+   wsDelayCb(p, 20);
+   p->next = waveCbPOadr(botCB + WS_CB_IDLE);
 
-   if (oldWidth)
-   {
-      if (gpioInfo[gpio].is == GPIO_PWM)
-      {
-         newWidth = (range * oldWidth) / gpioInfo[gpio].range;
+   wsCopyCb(rawWaveCBAdr(botCB + WS_CB_IDLE),
+      one, flag, waveCbPOadr(botCB + WS_CB_IDLE + 1));
 
-         myGpioSetPwm(gpio, oldWidth, 0);
-         gpioInfo[gpio].range = range;
-         gpioInfo[gpio].width = newWidth;
-         myGpioSetPwm(gpio, 0, newWidth);
-      }
-   }
+   p = rawWaveCBAdr(botCB + WS_CB_IDLE + 1);
+   wsDelayCb(p, WS_IDLE_MICROS);
+   p->next = dispatch;
 
-   gpioInfo[gpio].range = range;
+   wsCopyCb(rawWaveCBAdr(botCB + WS_CB_DISPATCH),
+      one, waveOOLPOadr(botOOL + WS_OOL_DUMMY),
+      waveCbPOadr(botCB + WS_CB_IDLE));
 
-   /* return the actual range for the current gpio frequency */
+   for (s=0; s<WS_SEGS; s++)
+   {
+      cb  = botCB  + WS_CB_SEG  + (s * WS_SEG_CBS);
+      ool = botOOL + WS_OOL_SEG + (s * 2 * WS_SEG_PULSES);
 
-   return pwmRealRange[gpioInfo[gpio].freqIdx];
-}
+      /* FLAG is cleared first so it is current once DISPATCH is reset */
 
+      wsCopyCb(rawWaveCBAdr(cb), zero, flag, waveCbPOadr(cb+1));
 
-/* ----------------------------------------------------------------------- */
+      wsCopyCb(rawWaveCBAdr(cb+1), waveOOLPOadr(botOOL + WS_OOL_IDLE),
+         dispatch + 20, waveCbPOadr(cb+2));
 
-int gpioGetPWMrange(unsigned gpio)
-{
-   DBG(DBG_USER, "gpio=%d", gpio);
+      cb += 2;
 
-   CHECK_INITED;
+      for (i=0; i<WS_SEG_PULSES; i++)
+      {
+         wsCopyCb(rawWaveCBAdr(cb), waveOOLPOadr(ool),
+            ((GPIO_BASE + (GPSET0*4)) & 0x00ffffff) | PI_PERI_BUS,
+            waveCbPOadr(cb+1));
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+         wsCopyCb(rawWaveCBAdr(cb+1), waveOOLPOadr(ool+1),
+            ((GPIO_BASE + (GPCLR0*4)) & 0x00ffffff) | PI_PERI_BUS,
+            waveCbPOadr(cb+2));
 
-   switch (gpioInfo[gpio].is)
-   {
-      case GPIO_HW_PWM:
-      case GPIO_HW_CLK:
-         return PI_HW_PWM_RANGE;
+         wsDelayCb(rawWaveCBAdr(cb+2), 0);
 
-      default:
-         return gpioInfo[gpio].range;
+         cb  += 3;
+         ool += 2;
+      }
    }
 }
 
-
 /* ----------------------------------------------------------------------- */
 
-int gpioGetPWMrealRange(unsigned gpio)
+static void wsFill(int seg, int count)
 {
-   unsigned pwm;
+   int cb, ool, i;
+   uint32_t micros, next, dispatch;
+   gpioPulse_t *pulse;
+   rawCbs_t *p;
 
-   DBG(DBG_USER, "gpio=%d", gpio);
+   cb  = waveInfo[wsWid].botCB  + WS_CB_SEG  + (seg * WS_SEG_CBS) + 2;
+   ool = waveInfo[wsWid].botOOL + WS_OOL_SEG + (seg * 2 * WS_SEG_PULSES);
 
-   CHECK_INITED;
+   dispatch = waveCbPOadr(waveInfo[wsWid].botCB + WS_CB_DISPATCH);
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   micros = 0;
 
-   switch (gpioInfo[gpio].is)
+   for (i=0; i<count; i++)
    {
-      case GPIO_HW_PWM:
-         pwm = (PWMDef[gpio] >> 4) & 3;
-         return hw_pwm_real_range[pwm];
+      pulse = &wsFifo[wsFifoPos];
 
-      case GPIO_HW_CLK:
-         return PI_HW_PWM_RANGE;
+      wsFifoPos = (wsFifoPos + 1) % PI_WAVE_STREAM_PULSES;
 
-      default:
-         return pwmRealRange[gpioInfo[gpio].freqIdx];
+      waveSetOOL(ool,   pulse->gpioOn);
+      waveSetOOL(ool+1, pulse->gpioOff);
+
+      if (i < (count-1)) next = waveCbPOadr(cb+3);
+      else               next = dispatch;
+
+      p = rawWaveCBAdr(cb+2);
+
+      wsDelayCb(p, pulse->usDelay);
+
+      p->next = next;
+
+      /* skip a delay too short to time */
+
+      if (p->length) next = waveCbPOadr(cb+2);
+
+      rawWaveCBAdr(cb+1)->next = next;
+
+      micros += pulse->usDelay;
+
+      cb  += 3;
+      ool += 2;
    }
-}
 
+   wsFifoCount -= count;
+
+   wsSegLen[seg]    = count;
+   wsSegMicros[seg] = micros;
+}
 
 /* ----------------------------------------------------------------------- */
 
-int gpioSetPWMfrequency(unsigned gpio, unsigned frequency)
+static void *pthWaveStreamThread(void *x)
 {
-   int i, width;
-   unsigned diff, best, idx;
+   volatile rawCbs_t *dispatch;
+   uint32_t idle, next, wait;
+   int botCB, botOOL, seg, count, freeSegs;
+   struct timespec ts;
 
-   DBG(DBG_USER, "gpio=%d frequency=%d", gpio, frequency);
+   botCB  = waveInfo[wsWid].botCB;
+   botOOL = waveInfo[wsWid].botOOL;
 
-   CHECK_INITED;
+   dispatch = rawWaveCBAdr(botCB + WS_CB_DISPATCH);
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   idle = waveCbPOadr(botCB + WS_CB_IDLE);
 
-   if      (frequency > pwmFreq[0])           idx = 0;
-   else if (frequency < pwmFreq[PWM_FREQS-1]) idx = PWM_FREQS-1;
-   else
+   pthread_mutex_lock(&wsMutex);
+
+   while (wsRun)
    {
-      best = 100000; /* impossibly high frequency difference */
-      idx = 0;
+      next = dispatch->next;
 
-      for (i=0; i<PWM_FREQS; i++)
+      __sync_synchronize();
+
+      if (next == idle)
       {
-         if (frequency > pwmFreq[i]) diff = frequency - pwmFreq[i];
-         else                        diff = pwmFreq[i] - frequency;
+         if (wsLinked >= 0)
+         {
+            /* the linked segment has started, the one before has ended */
 
-         if (diff < best)
+            wsPlaying = wsLinked;
+            wsLinked  = -1;
+         }
+         else if ((wsPlaying >= 0) && waveGetOOL(botOOL + WS_OOL_FLAG))
          {
-            best = diff;
-            idx = i;
+            /* nothing linked in time, the DMA engine is idling */
+
+            wsPlaying = -1;
+            wsStarved = 1;
          }
       }
-   }
 
-   width = gpioInfo[gpio].width;
+      freeSegs = WS_SEGS - wsFilled - (wsLinked >= 0) - (wsPlaying >= 0);
 
-   if (width)
-   {
-      if (gpioInfo[gpio].is == GPIO_PWM)
+      /* fill whole segments, or whatever there is if about to run out */
+
+      while (freeSegs && wsFifoCount &&
+             ((wsFifoCount >= WS_SEG_PULSES) || (!wsFilled && (wsLinked < 0))))
       {
-         myGpioSetPwm(gpio, width, 0);
-         gpioInfo[gpio].freqIdx = idx;
-         myGpioSetPwm(gpio, 0, width);
+         count = wsFifoCount;
+
+         if (count > WS_SEG_PULSES) count = WS_SEG_PULSES;
+
+         wsFill(wsFillSeg, count);
+
+         wsFillSeg = (wsFillSeg + 1) % WS_SEGS;
+
+         wsFilled++;
+         freeSegs--;
       }
-   }
 
-   gpioInfo[gpio].freqIdx = idx;
+      if ((next == idle) && (wsLinked < 0) && wsFilled)
+      {
+         seg = (wsFillSeg + WS_SEGS - wsFilled) % WS_SEGS;
 
-   return pwmFreq[idx];
-}
+         __sync_synchronize();
 
+         dispatch->next = waveCbPOadr(botCB + WS_CB_SEG + (seg * WS_SEG_CBS));
 
-/* ----------------------------------------------------------------------- */
+         wsLinked = seg;
+         wsFilled--;
 
-int gpioGetPWMfrequency(unsigned gpio)
-{
-   unsigned pwm, clock;
+         if (wsStarved)
+         {
+            wsUnderruns++;
+            wsStarved = 0;
+         }
+      }
 
-   DBG(DBG_USER, "gpio=%d", gpio);
+      /* look again in time to link a segment before the last one ends */
 
-   CHECK_INITED;
+      wait = WS_MAX_WAIT;
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+      if ((wsPlaying >= 0) && ((wsSegMicros[wsPlaying] / 2) < wait))
+         wait = wsSegMicros[wsPlaying] / 2;
 
-   switch (gpioInfo[gpio].is)
-   {
-      case GPIO_HW_PWM:
-         pwm = (PWMDef[gpio] >> 4) & 3;
-         return hw_pwm_freq[pwm];
+      if ((wsLinked >= 0) && ((wsSegMicros[wsLinked] / 2) < wait))
+         wait = wsSegMicros[wsLinked] / 2;
 
-      case GPIO_HW_CLK:
-         clock = (clkDef[gpio] >> 4) & 3;
-         return hw_clk_freq[clock];
+      if (wait < WS_MIN_WAIT) wait = WS_MIN_WAIT;
 
-      default:
-         return pwmFreq[gpioInfo[gpio].freqIdx];
+      clock_gettime(CLOCK_REALTIME, &ts);
+
+      ts.tv_nsec += (wait * 1000);
+
+      if (ts.tv_nsec >= BILLION)
+      {
+         ts.tv_sec++;
+         ts.tv_nsec -= BILLION;
+      }
+
+      pthread_cond_timedwait(&wsCond, &wsMutex, &ts);
    }
-}
 
+   pthread_mutex_unlock(&wsMutex);
+
+   return NULL;
+}
 
 /* ----------------------------------------------------------------------- */
 
-int gpioServo(unsigned gpio, unsigned val)
+static void wsStop(void)
 {
-   DBG(DBG_USER, "gpio=%d pulsewidth=%d", gpio, val);
+   int wid;
 
-   CHECK_INITED;
+   if (wsWid < 0) return;
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   pthread_mutex_lock(&wsMutex);
 
-   if ((val!=PI_SERVO_OFF) && (val<PI_MIN_SERVO_PULSEWIDTH))
-      SOFT_ERROR(PI_BAD_PULSEWIDTH,
-         "gpio %d, bad pulsewidth (%d)", gpio, val);
+   wsRun = 0;
 
-   if (val>PI_MAX_SERVO_PULSEWIDTH)
-      SOFT_ERROR(PI_BAD_PULSEWIDTH,
-         "gpio %d, bad pulsewidth (%d)", gpio, val);
+   pthread_cond_signal(&wsCond);
 
-   if (gpioInfo[gpio].is != GPIO_SERVO)
-   {
-      switchFunctionOff(gpio);
+   pthread_mutex_unlock(&wsMutex);
 
-      gpioSetMode(gpio, PI_OUTPUT);
+   pthread_join(pthWaveStream, NULL);
 
-      gpioInfo[gpio].is = GPIO_SERVO;
-   }
+   dmaOut[DMA_CS] = DMA_CHANNEL_RESET;
 
-   myGpioSetServo(gpio, gpioInfo[gpio].width, val);
+   dmaOut[DMA_CONBLK_AD] = 0;
 
-   gpioInfo[gpio].width=val;
+   /* release the resources as for a deleted wave */
 
-   return 0;
-}
+   wid = wsWid;
+
+   wsWid = -1;
 
+   waveRefs[wid] = 1;
+
+   gpioWaveDelete(wid);
+}
 
 /* ----------------------------------------------------------------------- */
 
-int gpioGetServoPulsewidth(unsigned gpio)
+int gpioWaveStreamOpen(void)
 {
-   DBG(DBG_USER, "gpio=%d", gpio);
+   int wid;
+   pthread_attr_t pthAttr;
+
+   DBG(DBG_USER, "");
 
    CHECK_INITED;
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   if (wsWid >= 0)
+      SOFT_ERROR(PI_WAVE_STREAMING, "wave stream already open");
 
-   if (gpioInfo[gpio].is != GPIO_SERVO)
-      SOFT_ERROR(PI_NOT_SERVO_GPIO, "not a servo gpio (%d)", gpio);
+   /* Are there enough spare resources? */
 
-   return gpioInfo[gpio].width;
-}
+   if ((WS_CBS+waveOutBotCB) >= NUM_WAVE_CBS)
+      return PI_TOO_MANY_CBS;
 
+   if ((WS_OOLS+waveOutBotOOL) >= waveOutTopOOL)
+      return PI_TOO_MANY_OOL;
 
-/* ----------------------------------------------------------------------- */
+   if (waveOutCount >= PI_MAX_WAVES)
+      return PI_NO_WAVEFORM_ID;
 
-int gpioWaveClear(void)
-{
-   DBG(DBG_USER, "");
+   wid = waveOutCount++;
 
-   CHECK_INITED;
+   waveInfo[wid].botCB   = waveOutBotCB;
+   waveInfo[wid].topCB   = waveOutBotCB + WS_CBS - 1;
+   waveInfo[wid].botOOL  = waveOutBotOOL;
+   waveInfo[wid].topOOL  = waveOutTopOOL;
+   waveInfo[wid].numCB   = WS_CBS;
+   waveInfo[wid].numBOOL = WS_OOLS;
+   waveInfo[wid].numTOOL = 0;
+   waveInfo[wid].deleted = 0;
 
-   wfc[0] = 0;
-   wfc[1] = 0;
-   wfc[2] = 0;
+   waveHash[wid] = 0;
+   waveRefs[wid] = 1;
 
-   wfcur = 0;
+   waveKeep(wid, 0);
 
-   wfStats.micros = 0;
-   wfStats.pulses = 0;
-   wfStats.cbs    = 0;
+   waveOutBotCB  += WS_CBS;
+   waveOutBotOOL += WS_OOLS;
 
-   waveOutBotCB  = PI_WAVE_COUNT_PAGES*CBS_PER_OPAGE;
-   waveOutBotOOL = PI_WAVE_COUNT_PAGES*OOL_PER_OPAGE;
-   waveOutTopOOL = NUM_WAVE_OOL;
+   wsWid = wid;
 
-   waveOutCount = 0;
+   wsFifoPos   = 0;
+   wsFifoCount = 0;
+   wsFillSeg   = 0;
+   wsFilled    = 0;
+   wsLinked    = -1;
+   wsPlaying   = -1;
+   wsStarved   = 0;
+   wsUnderruns = 0;
 
-   return 0;
-}
+   wsInitCbs();
 
-/* ----------------------------------------------------------------------- */
+   if (!waveClockInited)
+   {
+      stopHardwarePWM();
+      initClock(0); /* initialise secondary clock */
+      waveClockInited = 1;
+   }
 
-int gpioWaveAddNew(void)
-{
-   DBG(DBG_USER, "");
+   pthread_mutex_lock(&spiDmaMutex);
 
-   CHECK_INITED;
+   dmaOut[DMA_CS] = DMA_CHANNEL_RESET;
 
-   wfc[0] = 0;
-   wfc[1] = 0;
-   wfc[2] = 0;
+   dmaOut[DMA_CONBLK_AD] = 0;
 
-   wfcur = 0;
+   initDMAgo((uint32_t *)dmaOut, waveCbPOadr(waveInfo[wid].botCB));
 
-   wfStats.micros = 0;
-   wfStats.pulses = 0;
-   wfStats.cbs    = 0;
+   pthread_mutex_unlock(&spiDmaMutex);
+
+   wsRun = 1;
+
+   if (pthread_attr_init(&pthAttr) ||
+       pthread_attr_setstacksize(&pthAttr, STACK_SIZE) ||
+       pthread_create(&pthWaveStream, &pthAttr, pthWaveStreamThread, NULL))
+   {
+      wsRun = 0;
+
+      dmaOut[DMA_CS] = DMA_CHANNEL_RESET;
+
+      dmaOut[DMA_CONBLK_AD] = 0;
+
+      wsWid = -1;
+
+      gpioWaveDelete(wid);
+
+      SOFT_ERROR(PI_INIT_FAILED, "wave stream thread failed (%m)");
+   }
 
    return 0;
 }
 
 /* ----------------------------------------------------------------------- */
 
-int gpioWaveAddGeneric(unsigned numPulses, gpioPulse_t *pulses)
+int gpioWaveStreamWrite(unsigned numPulses, gpioPulse_t *pulses)
 {
-   int p;
+   unsigned i, pos;
 
    DBG(DBG_USER, "numPulses=%u pulses=%08X", numPulses, (uint32_t)pulses);
 
    CHECK_INITED;
 
-   if (numPulses > PI_WAVE_MAX_PULSES)
-      SOFT_ERROR(PI_TOO_MANY_PULSES, "bad number of pulses (%d)", numPulses);
+   if (wsWid < 0)
+      SOFT_ERROR(PI_WAVE_STREAMING, "wave stream not open");
 
-   if (!pulses) SOFT_ERROR(PI_BAD_POINTER, "bad (NULL) pulses pointer");
+   if (numPulses && !pulses)
+      SOFT_ERROR(PI_BAD_POINTER, "bad (NULL) pulses pointer");
 
-   for (p=0; p<numPulses; p++)
+   pthread_mutex_lock(&wsMutex);
+
+   if (numPulses > (PI_WAVE_STREAM_PULSES - wsFifoCount))
+      numPulses = PI_WAVE_STREAM_PULSES - wsFifoCount;
+
+   pos = (wsFifoPos + wsFifoCount) % PI_WAVE_STREAM_PULSES;
+
+   for (i=0; i<numPulses; i++)
    {
-      wf[2][p].gpioOff = pulses[p].gpioOff;
-      wf[2][p].gpioOn  = pulses[p].gpioOn;
-      wf[2][p].usDelay = pulses[p].usDelay;
-      wf[2][p].flags   = 0;
+      wsFifo[pos] = pulses[i];
+
+      pos = (pos + 1) % PI_WAVE_STREAM_PULSES;
    }
 
-   return rawWaveAddGeneric(numPulses, wf[2]);
+   wsFifoCount += numPulses;
+
+   if (numPulses) pthread_cond_signal(&wsCond);
+
+   pthread_mutex_unlock(&wsMutex);
+
+   return numPulses;
 }
 
 /* ----------------------------------------------------------------------- */
 
-int gpioWaveAddSerial
-   (unsigned gpio,
-    unsigned baud,
-    unsigned data_bits,
-    unsigned stop_bits,
-    unsigned offset,
-    unsigned numBytes,
-    char     *bstr)
+int gpioWaveStreamStatus(uint32_t *underruns)
 {
-   int i, b, p, lev, c, v;
+   int queued, s, seg;
 
-   uint16_t *wstr = (uint16_t *)bstr;
-   uint32_t *lstr = (uint32_t *)bstr;
+   DBG(DBG_USER, "underruns=%08X", (uint32_t)underruns);
 
-   unsigned bitDelay[32];
+   CHECK_INITED;
 
-   DBG(DBG_USER,
-      "gpio=%d baud=%d bits=%d stops=%d offset=%d numBytes=%d str=[%s]",
-      gpio, baud, data_bits, stop_bits, offset,
-      numBytes, myBuf2Str(numBytes, (char *)bstr));
+   if (wsWid < 0)
+      SOFT_ERROR(PI_WAVE_STREAMING, "wave stream not open");
+
+   pthread_mutex_lock(&wsMutex);
+
+   queued = wsFifoCount;
+
+   for (s=1; s<=wsFilled; s++)
+   {
+      seg = (wsFillSeg + WS_SEGS - s) % WS_SEGS;
+      queued += wsSegLen[seg];
+   }
 
-   CHECK_INITED;
+   if (wsLinked  >= 0) queued += wsSegLen[wsLinked];
+   if (wsPlaying >= 0) queued += wsSegLen[wsPlaying];
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   if (underruns) *underruns = wsUnderruns;
 
-   if ((baud < PI_WAVE_MIN_BAUD) || (baud > PI_WAVE_MAX_BAUD))
-      SOFT_ERROR(PI_BAD_WAVE_BAUD, "bad baud rate (%d)", baud);
+   pthread_mutex_unlock(&wsMutex);
 
-   if ((data_bits < PI_MIN_WAVE_DATABITS) ||
-       (data_bits > PI_MAX_WAVE_DATABITS))
-      SOFT_ERROR(PI_BAD_DATABITS, "bad number of databits (%d)", data_bits);
+   return queued;
+}
 
-   if ((stop_bits < PI_MIN_WAVE_HALFSTOPBITS) ||
-       (stop_bits > PI_MAX_WAVE_HALFSTOPBITS))
-      SOFT_ERROR(PI_BAD_STOPBITS,
-         "bad number of (half) stop bits (%d)", stop_bits);
+/* ----------------------------------------------------------------------- */
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+int gpioWaveStreamClose(void)
+{
+   DBG(DBG_USER, "");
 
-   if (numBytes > PI_WAVE_MAX_CHARS)
-      SOFT_ERROR(PI_TOO_MANY_CHARS, "too many chars (%d)", numBytes);
+   CHECK_INITED;
 
-   if (offset > PI_WAVE_MAX_MICROS)
-      SOFT_ERROR(PI_BAD_SER_OFFSET, "offset too large (%d)", offset);
+   if (wsWid < 0)
+      SOFT_ERROR(PI_WAVE_STREAMING, "wave stream not open");
 
-   if (data_bits > 8) numBytes /= 2;
-   if (data_bits > 16) numBytes /= 2;
+   wsStop();
 
-   if (!numBytes) return 0;
+   return 0;
+}
 
-   waveBitDelay(baud, data_bits, stop_bits, bitDelay);
+/* ----------------------------------------------------------------------- */
 
-   p = 0;
+int gpioWaveGetMicros(void)
+{
+   DBG(DBG_USER, "");
 
-   wf[2][p].gpioOn  = (1<<gpio);
-   wf[2][p].gpioOff = 0;
-   wf[2][p].flags   = 0;
+   CHECK_INITED;
 
-   if (offset > bitDelay[0]) wf[2][p].usDelay = offset;
-   else                      wf[2][p].usDelay = bitDelay[0];
+   return wfStats.micros;
+}
 
-   for (i=0; i<numBytes; i++)
-   {
-      p++;
+/* ----------------------------------------------------------------------- */
 
-      /* start bit */
+int gpioWaveGetHighMicros(void)
+{
+   DBG(DBG_USER, "");
 
-      wf[2][p].gpioOn = 0;
-      wf[2][p].gpioOff = (1<<gpio);
-      wf[2][p].usDelay = bitDelay[0];
-      wf[2][p].flags   = 0;
+   CHECK_INITED;
 
-      lev = 0;
+   return wfStats.highMicros;
+}
 
-      if      (data_bits <  9) c = bstr[i];
-      else if (data_bits < 17) c = wstr[i];
-      else                  c = lstr[i];
+/* ----------------------------------------------------------------------- */
 
-      for (b=0; b<data_bits; b++)
-      {
-         if (c & (1<<b)) v=1; else v=0;
+int gpioWaveGetMaxMicros(void)
+{
+   DBG(DBG_USER, "");
 
-         if (v == lev) wf[2][p].usDelay += bitDelay[b+1];
-         else
-         {
-            p++;
+   CHECK_INITED;
 
-            lev = v;
+   return wfStats.maxMicros;
+}
 
-            if (lev)
-            {
-               wf[2][p].gpioOn  = (1<<gpio);
-               wf[2][p].gpioOff = 0;
-               wf[2][p].flags   = 0;
-            }
-            else
-            {
-               wf[2][p].gpioOn  = 0;
-               wf[2][p].gpioOff = (1<<gpio);
-               wf[2][p].flags   = 0;
-            }
+/* ----------------------------------------------------------------------- */
 
-            wf[2][p].usDelay = bitDelay[b+1];
-         }
-      }
+int gpioWaveGetPulses(void)
+{
+   DBG(DBG_USER, "");
 
-      /* stop bit */
+   CHECK_INITED;
 
-      if (lev) wf[2][p].usDelay += bitDelay[data_bits+1];
-      else
-      {
-         p++;
+   return wfStats.pulses;
+}
 
-         wf[2][p].gpioOn  = (1<<gpio);
-         wf[2][p].gpioOff = 0;
-         wf[2][p].usDelay = bitDelay[data_bits+1];
-         wf[2][p].flags   = 0;
-      }
-   }
+/* ----------------------------------------------------------------------- */
 
-   p++;
+int gpioWaveGetHighPulses(void)
+{
+   DBG(DBG_USER, "");
 
-   wf[2][p].gpioOn  = (1<<gpio);
-   wf[2][p].gpioOff = 0;
-   wf[2][p].usDelay = bitDelay[0];
-   wf[2][p].flags   = 0;
+   CHECK_INITED;
 
-   return rawWaveAddGeneric(p, wf[2]);
+   return wfStats.highPulses;
 }
 
 /* ----------------------------------------------------------------------- */
 
-int rawWaveAddSPI(
-   rawSPI_t *spi,
-   unsigned offset,
-   unsigned spiSS,
-   char *buf,
-   unsigned spiTxBits,
-   unsigned spiBitFirst,
-   unsigned spiBitLast,
-   unsigned spiBits)
+int gpioWaveGetMaxPulses(void)
 {
-   int p, dbv, bit, halfbit;
-   int rising_edge[2], read_cycle[2];
-   uint32_t on_bits, off_bits;
-   int tx_bit_pos;
-
-   DBG(DBG_USER,
-      "spi=%08X off=%d spiSS=%d tx=%08X, num=%d fb=%d lb=%d spiBits=%d",
-      (uint32_t)spi, offset, spiSS, (uint32_t)buf, spiTxBits,
-      spiBitFirst, spiBitLast, spiBits);
+   DBG(DBG_USER, "");
 
    CHECK_INITED;
 
-   if (spiSS > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", spiSS);
+   return wfStats.maxPulses;
+}
 
-   /*
-   CPOL CPHA
-    0    0   read rising/write falling
-    0    1   read falling/write rising
-    1    0   read falling/write rising
-    1    1   read rising/write falling
-   */
+/* ----------------------------------------------------------------------- */
 
-   if (spi->clk_pol) {rising_edge[0] = 0; rising_edge[1] = 1;}
-   else              {rising_edge[0] = 1; rising_edge[1] = 0;}
+int gpioWaveGetCbs(void)
+{
+   DBG(DBG_USER, "");
 
-   if (spi->clk_pha) {read_cycle[0] = 0; read_cycle[1] = 1;}
-   else              {read_cycle[0] = 1; read_cycle[1] = 0;}
+   CHECK_INITED;
 
-   p = 0;
+   return wfStats.cbs;
+}
 
-   if (offset)
-   {
-      wf[2][p].gpioOn  = 0;
-      wf[2][p].gpioOff = 0;
-      wf[2][p].flags   = 0;
-      wf[2][p].usDelay = offset;
-      p++;
-   }
+/* ----------------------------------------------------------------------- */
 
-   /* preset initial mosi bit in case it's read at leading clock bit */
+int gpioWaveGetHighCbs(void)
+{
+   DBG(DBG_USER, "");
 
-   on_bits = 0;
-   off_bits = 0;
+   CHECK_INITED;
 
-   tx_bit_pos = 0;
+   return wfStats.highCbs;
+}
 
-   if (getBitInBytes(tx_bit_pos, buf, spiTxBits))
-   {
-      dbv = 1;
-      on_bits  |= (1<<(spi->mosi));
-   }
-   else
-   {
-      dbv = 0;
-      off_bits  |= (1<<(spi->mosi));
-   }
+/* ----------------------------------------------------------------------- */
 
-   if (spi->ss_pol) off_bits |= (1<<spiSS);
-   else             on_bits  |= (1<<spiSS);
+int gpioWaveGetMaxCbs(void)
+{
+   DBG(DBG_USER, "");
 
-   wf[2][p].gpioOn  = on_bits;
-   wf[2][p].gpioOff = off_bits;
-   wf[2][p].flags   = 0;
+   CHECK_INITED;
 
-   if (spi->clk_us > spi->ss_us) wf[2][p].usDelay = spi->clk_us;
-   else                          wf[2][p].usDelay = spi->ss_us;
+   return wfStats.maxCbs;
+}
 
-   p++;
+static int read_SDA(wfRx_t *w)
+{
+   myGpioSetMode(w->I.SDA, PI_INPUT);
+   return gpioRead(w->I.SDA);
+}
 
-   for (bit=1; bit<=spiBits; bit++)
-   {
-      for (halfbit=0; halfbit<2; halfbit++)
-      {
-         wf[2][p].usDelay = spi->clk_us;
-         wf[2][p].flags = 0;
+static void set_SDA(wfRx_t *w)
+{
+   myGpioSetMode(w->I.SDA, PI_INPUT);
+}
 
-         on_bits = 0;
-         off_bits = 0;
+static void clear_SDA(wfRx_t *w)
+{
+   myGpioSetMode(w->I.SDA, PI_OUTPUT);
+   myGpioWrite(w->I.SDA, 0);
+}
 
-         if (read_cycle[halfbit])
-         {
-            if ((bit>=spiBitFirst) && (bit<=spiBitLast))
-               wf[2][p].flags = WAVE_FLAG_READ;
-         }
-         else
-         {
-            if (getBitInBytes(tx_bit_pos, buf, spiTxBits))
-            {
-               if (!dbv) on_bits |= (1<<(spi->mosi));
-               dbv = 1;
-            }
-            else
-            {
-               if (dbv) off_bits |= (1<<(spi->mosi));
-               dbv = 0;
-            }
+static void clear_SCL(wfRx_t *w)
+{
+   myGpioSetMode(w->I.SCL, PI_OUTPUT);
+   myGpioWrite(w->I.SCL, 0);
+}
 
-            ++tx_bit_pos;
-         }
+static void I2C_delay(wfRx_t *w)
+{
+   myGpioDelay(w->I.delay);
+}
 
-         if (rising_edge[halfbit]) on_bits  |= (1<<(spi->clk));
-         else                      off_bits |= (1<<(spi->clk));
+static void I2C_clock_stretch(wfRx_t *w)
+{
+   uint32_t now, max_stretch=10000;
 
-         wf[2][p].gpioOn = on_bits;
-         wf[2][p].gpioOff = off_bits;
+   myGpioSetMode(w->I.SCL, PI_INPUT);
+   now = gpioTick();
+   while ((gpioRead(w->I.SCL) == 0) && ((gpioTick()-now) < max_stretch));
+}
 
-         p++;
-      }
+static void I2CStart(wfRx_t *w)
+{
+   if (w->I.started)
+   {
+      set_SDA(w);
+      I2C_delay(w);
+      I2C_clock_stretch(w);
+      I2C_delay(w);
    }
 
-   on_bits = 0;
-   off_bits = 0;
+   clear_SDA(w);
+   I2C_delay(w);
+   clear_SCL(w);
+   I2C_delay(w);
 
-   if (spi->ss_pol) on_bits  |= (1<<spiSS);
-   else             off_bits |= (1<<spiSS);
+   w->I.started = 1;
+}
+
+static void I2CStop(wfRx_t *w)
+{
+   clear_SDA(w);
+   I2C_delay(w);
+   I2C_clock_stretch(w);
+   I2C_delay(w);
+   set_SDA(w);
+   I2C_delay(w);
 
-   wf[2][p].gpioOn  = on_bits;
-   wf[2][p].gpioOff = off_bits;
-   wf[2][p].flags   = 0;
-   wf[2][p].usDelay = 0;
+   w->I.started = 0;
+}
 
-   p++;
+static void I2CPutBit(wfRx_t *w, int bit)
+{
+   if (bit) set_SDA(w);
+   else     clear_SDA(w);
 
-   return rawWaveAddGeneric(p, wf[2]);
+   I2C_delay(w);
+   I2C_clock_stretch(w);
+   I2C_delay(w);
+   clear_SCL(w);
 }
 
-/* ----------------------------------------------------------------------- */
-
-int gpioWaveCreate(void)
+static int I2CGetBit(wfRx_t *w)
 {
-   int i, wid;
-   int numCB, numBOOL, numTOOL;
-   int CB, BOOL, TOOL;
+   int bit;
 
-   DBG(DBG_USER, "");
+   set_SDA(w); /* let SDA float */
+   I2C_delay(w);
+   I2C_clock_stretch(w);
+   bit = read_SDA(w);
+   I2C_delay(w);
+   clear_SCL(w);
 
-   CHECK_INITED;
+   return bit;
+}
 
-   if (wfc[wfcur] == 0) return PI_EMPTY_WAVEFORM;
+static int I2CPutByte(wfRx_t *w, int byte)
+{
+   int bit, nack;
 
-   /* What resources are needed? */
+   for(bit=0; bit<8; bit++)
+   {
+      I2CPutBit(w, byte & 0x80);
+      byte <<= 1;
+   }
 
-   waveCBsOOLs(&numCB, &numBOOL, &numTOOL);
+   nack = I2CGetBit(w);
 
-   wid = -1;
+   return nack;
+}
 
-   /* Is there an exact fit with a deleted wave. */
+static uint8_t I2CGetByte(wfRx_t *w, int nack)
+{
+   int bit, byte=0;
 
-   for (i=0; i<waveOutCount; i++)
+   for (bit=0; bit<8; bit++)
    {
-      if (waveInfo[i].deleted             &&
-         (waveInfo[i].numCB   == numCB)   &&
-         (waveInfo[i].numBOOL == numBOOL) &&
-         (waveInfo[i].numTOOL == numTOOL))
-      {
-         /* Reuse the deleted waves resources. */
-         wid = i;
-         break;
-      }
+      byte = (byte << 1) | I2CGetBit(w);
    }
 
-   if (wid == -1)
-   {
-      /* Are there enough spare resources? */
-
-      if ((numCB+waveOutBotCB) >= NUM_WAVE_CBS)
-         return PI_TOO_MANY_CBS;
-
-      if ((numBOOL+waveOutBotOOL) >= (waveOutTopOOL-numTOOL))
-         return PI_TOO_MANY_OOL;
-
-      if (wid >= PI_MAX_WAVES)
-         return PI_NO_WAVEFORM_ID;
+   I2CPutBit(w, nack);
 
-      wid = waveOutCount++;
+   return byte;
+}
 
-      waveInfo[wid].botCB  = waveOutBotCB;
-      waveInfo[wid].topCB  = waveOutBotCB + numCB -1;
-      waveInfo[wid].botOOL = waveOutBotOOL;
-      waveInfo[wid].topOOL = waveOutTopOOL;
-      waveInfo[wid].numCB = numCB;
-      waveInfo[wid].numBOOL = numBOOL;
-      waveInfo[wid].numTOOL = numTOOL;
+int bbI2COpen(unsigned SDA, unsigned SCL, unsigned baud)
+{
+   DBG(DBG_USER, "SDA=%d SCL=%d baud=%d", SDA, SCL, baud);
 
-      waveOutBotCB += numCB;
-      waveOutBotOOL += numBOOL;
-      waveOutTopOOL -= numTOOL;
-   }
+   CHECK_INITED;
 
-   /* Must be room if got this far. */
+   if (SDA > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad SDA (%d)", SDA);
 
-   CB   = waveInfo[wid].botCB;
-   BOOL = waveInfo[wid].botOOL;
-   TOOL = waveInfo[wid].topOOL;
+   if (SCL > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad SCL (%d)", SCL);
 
-   wave2Cbs(PI_WAVE_MODE_ONE_SHOT, &CB, &BOOL, &TOOL);
+   if ((baud < PI_BB_I2C_MIN_BAUD) || (baud > PI_BB_I2C_MAX_BAUD))
+      SOFT_ERROR(PI_BAD_I2C_BAUD,
+         "SDA %d, bad baud rate (%d)", SDA, baud);
 
-   /* Sanity check. */
+   if (wfRx[SDA].mode != PI_WFRX_NONE)
+      SOFT_ERROR(PI_GPIO_IN_USE, "gpio %d is already being used", SDA);
 
-   if ( (numCB   != (CB-waveInfo[wid].botCB))    ||
-        (numBOOL != (BOOL-waveInfo[wid].botOOL)) ||
-        (numTOOL != (waveInfo[wid].topOOL-TOOL)) )
-   {
-      DBG(0, "ERROR wid=%d CBs %d=%d BOOL %d=%d TOOL %d=%d", wid,
-         numCB,   CB-waveInfo[wid].botCB,
-         numBOOL, BOOL-waveInfo[wid].botOOL,
-         numTOOL, waveInfo[wid].topOOL-TOOL);
-   }
+   if ((wfRx[SCL].mode != PI_WFRX_NONE)  || (SCL == SDA))
+      SOFT_ERROR(PI_GPIO_IN_USE, "gpio %d is already being used", SCL);
 
-   waveInfo[wid].deleted = 0;
+   wfRx[SDA].gpio = SDA;
+   wfRx[SDA].mode = PI_WFRX_I2C;
+   wfRx[SDA].baud = baud;
 
-   /* Consume waves. */
+   wfRx[SDA].I.started = 0;
+   wfRx[SDA].I.SDA = SDA;
+   wfRx[SDA].I.SCL = SCL;
+   wfRx[SDA].I.delay = 500000 / baud;
+   wfRx[SDA].I.SDAMode = gpioGetMode(SDA);
+   wfRx[SDA].I.SCLMode = gpioGetMode(SCL);
 
-   wfc[0] = 0;
-   wfc[1] = 0;
-   wfc[2] = 0;
+   wfRx[SCL].gpio = SCL;
+   wfRx[SCL].mode = PI_WFRX_I2C_CLK;
 
-   wfcur = 0;
+   myGpioSetMode(SDA, PI_INPUT);
+   myGpioSetMode(SCL, PI_INPUT);
 
-   return wid;
+   return 0;
 }
 
+
 /* ----------------------------------------------------------------------- */
 
-int gpioWaveDelete(unsigned wave_id)
+
+int bbI2CClose(unsigned SDA)
 {
-   DBG(DBG_USER, "wave id=%d", wave_id);
+   DBG(DBG_USER, "SDA=%d", SDA);
 
    CHECK_INITED;
 
-   if ((wave_id >= waveOutCount) || waveInfo[wave_id].deleted)
-      SOFT_ERROR(PI_BAD_WAVE_ID, "bad wave id (%d)", wave_id);
-
-   waveInfo[wave_id].deleted = 1;
+   if (SDA > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", SDA);
 
-   if (wave_id == (waveOutCount-1))
+   switch(wfRx[SDA].mode)
    {
-      /* top wave deleted, garbage collect any other deleted waves */
+      case PI_WFRX_I2C:
 
-      while ((wave_id > 0) && (waveInfo[wave_id-1].deleted)) --wave_id;
+         gpioSetMode(wfRx[SDA].I.SDA, wfRx[SDA].I.SDAMode);
+         gpioSetMode(wfRx[SDA].I.SCL, wfRx[SDA].I.SCLMode);
 
-      waveOutBotCB  = waveInfo[wave_id].botCB;
-      waveOutBotOOL = waveInfo[wave_id].botOOL;
-      waveOutTopOOL = waveInfo[wave_id].topOOL;
+         wfRx[wfRx[SDA].I.SDA].mode = PI_WFRX_NONE;
+         wfRx[wfRx[SDA].I.SCL].mode = PI_WFRX_NONE;
+
+         break;
+
+      default:
+
+         SOFT_ERROR(PI_NOT_I2C_GPIO, "no I2C on gpio (%d)", SDA);
+
+         break;
 
-      waveOutCount = wave_id;
    }
 
    return 0;
 }
 
-/* ----------------------------------------------------------------------- */
+/*-------------------------------------------------------------------------*/
 
-int gpioWaveTxStart(unsigned wave_mode)
+int bbI2CZip(
+   unsigned SDA,
+   char *inBuf,
+   unsigned inLen,
+   char *outBuf,
+   unsigned outLen)
 {
-   /* This function is deprecated and has been removed. */
+   int i, ack, inPos, outPos, status, bytes;
+   int addr, flags, esc, setesc;
+   wfRx_t *w;
+
+   DBG(DBG_USER, "gpio=%d inBuf=%s outBuf=%08X len=%d",
+      SDA, myBuf2Str(inLen, (char *)inBuf), (int)outBuf, outLen);
 
    CHECK_INITED;
 
-   SOFT_ERROR(PI_DEPRECATED, "deprected function removed");
-}
+   if (SDA > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", SDA);
 
-/* ----------------------------------------------------------------------- */
+   if (wfRx[SDA].mode != PI_WFRX_I2C)
+      SOFT_ERROR(PI_NOT_I2C_GPIO, "no I2C on gpio (%d)", SDA);
 
-int gpioWaveTxSend(unsigned wave_id, unsigned wave_mode)
-{
-   rawCbs_t *p=NULL;
+   if (!inBuf || !inLen)
+      SOFT_ERROR(PI_BAD_POINTER, "input buffer can't be NULL");
 
-   DBG(DBG_USER, "wave_id=%d wave_mode=%d", wave_id, wave_mode);
+   if (!outBuf && outLen)
+      SOFT_ERROR(PI_BAD_POINTER, "output buffer can't be NULL");
 
-   CHECK_INITED;
+   w = &wfRx[SDA];
 
-   if ((wave_id >= waveOutCount) || waveInfo[wave_id].deleted)
-      SOFT_ERROR(PI_BAD_WAVE_ID, "bad wave id (%d)", wave_id);
+   inPos = 0;
+   outPos = 0;
+   status = 0;
 
-   if (wave_mode > PI_WAVE_MODE_REPEAT)
-      SOFT_ERROR(PI_BAD_WAVE_MODE, "bad wave mode (%d)", wave_mode);
+   addr = 0;
+   flags = 0;
+   esc = 0;
+   setesc = 0;
 
-   if (!waveClockInited)
+   while (!status && (inPos < inLen))
    {
-      stopHardwarePWM();
-      initClock(0); /* initialise secondary clock */
-      waveClockInited = 1;
-   }
+      DBG(DBG_INTERNAL, "status=%d inpos=%d inlen=%d cmd=%d addr=%d flags=%x",
+         status, inPos, inLen, inBuf[inPos], addr, flags);
 
-   dmaOut[DMA_CS] = DMA_CHANNEL_RESET;
+      switch (inBuf[inPos++])
+      {
+         case PI_I2C_END:
+            status = 1;
+            break;
 
-   dmaOut[DMA_CONBLK_AD] = 0;
+         case PI_I2C_START:
+            I2CStart(w);
+            break;
 
-   p = rawWaveCBAdr(waveInfo[wave_id].topCB);
+         case PI_I2C_STOP:
+            I2CStop(w);
+            break;
 
-   if (wave_mode == PI_WAVE_MODE_ONE_SHOT) p->next = 0;
-   else p->next = waveCbPOadr(waveInfo[wave_id].botCB+1);
+         case PI_I2C_ADDR:
+            addr = myI2CGetPar(inBuf, &inPos, inLen, &esc);
+            if (addr < 0) status = PI_BAD_I2C_CMD;
+            break;
+
+         case PI_I2C_FLAGS:
+            /* cheat to force two byte flags */
+            esc = 1;
+            flags = myI2CGetPar(inBuf, &inPos, inLen, &esc);
+            if (flags < 0) status = PI_BAD_I2C_CMD;
+            break;
+
+         case PI_I2C_ESC:
+            setesc = 1;
+            break;
+
+         case PI_I2C_READ:
+
+            bytes = myI2CGetPar(inBuf, &inPos, inLen, &esc);
+
+            if (bytes >= 0) ack = I2CPutByte(w, (addr<<1)|1);
 
-   initDMAgo((uint32_t *)dmaOut, waveCbPOadr(waveInfo[wave_id].botCB));
+            if (bytes > 0)
+            {
+               if (!ack)
+               {
+                  if ((bytes + outPos) < outLen)
+                  {
+                     for (i=0; i<(bytes-1); i++)
+                     {
+                        outBuf[outPos++] = I2CGetByte(w, 0);
+                     }
+                     outBuf[outPos++] = I2CGetByte(w, 1);
+                  }
+                  else status = PI_BAD_I2C_RLEN;
+               }
+               else status = PI_I2C_READ_FAILED;
+            }
+            else status = PI_BAD_I2C_CMD;
+            break;
 
-   /* for compatability with the deprecated gpioWaveTxStart return the
-      number of cbs
-   */
-   return (waveInfo[wave_id].topCB - waveInfo[wave_id].botCB) + 1;
-}
+         case PI_I2C_WRITE:
 
+            bytes = myI2CGetPar(inBuf, &inPos, inLen, &esc);
 
-/* ----------------------------------------------------------------------- */
+            if (bytes >= 0) ack = I2CPutByte(w, addr<<1);
 
-static int chainGetCB(int n)
-{
-   int block, index;
+            if (bytes > 0)
+            {
+               if (!ack)
+               {
+                  if ((bytes + inPos) < inLen)
+                  {
+                     for (i=0; i<(bytes-1); i++)
+                     {
+                        ack = I2CPutByte(w, inBuf[inPos++]);
+                        if (ack) status = PI_I2C_WRITE_FAILED;
+                     }
+                     ack = I2CPutByte(w, inBuf[inPos++]);
+                  }
+                  else status = PI_BAD_I2C_RLEN;
+               } else status = PI_I2C_WRITE_FAILED;
+            }
+            else status = PI_BAD_I2C_CMD;
+            break;
 
-   if (n < (WCB_CHAIN_CBS * PI_WAVE_COUNT_PAGES))
-   {
-      block = n / WCB_CHAIN_CBS;
-      index = n % WCB_CHAIN_CBS;
-      return (block*CBS_PER_OPAGE) + WCB_COUNTER_CBS + index;
-   }
-   return -1;
-}
+         default:
+            status = PI_BAD_I2C_CMD;
+      }
 
-static void chainSetVal(int n, uint32_t val)
-{
-   int block, index;
-   uint32_t *p;
+      if (setesc) esc = 1; else esc = 0;
 
-   if (n < (WCB_CHAIN_OOL * PI_WAVE_COUNT_PAGES))
-   {
-      block = n / WCB_CHAIN_OOL;
-      index = n % WCB_CHAIN_OOL;
-      p = (uint32_t *) dmaOVirt[block] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
-      p[index] = val;
+      setesc = 0;
    }
-}
 
-static uint32_t chainGetValPadr(int n)
-{
-   int block, index;
-   uint32_t *p;
+   if (status >= 0) status = outPos;
 
-   if (n < (WCB_CHAIN_OOL * PI_WAVE_COUNT_PAGES))
-   {
-      block = n / WCB_CHAIN_OOL;
-      index = n % WCB_CHAIN_OOL;
-      p = (uint32_t *) dmaOBus[block] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
-      return (uint32_t) (p + index);
-   }
-   return 0;
+   return status;
 }
 
-static uint32_t chainGetCntVal(int counter, int slot)
-{
-   uint32_t *p;
-   int page, offset;
-   page = counter / 2;
-   offset = (counter % 2 ? WCB_COUNTER_OOL : 0);
-   p = (uint32_t *) dmaOVirt[page] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
-   return p[WCB_CHAIN_OOL+ offset + slot];
-}
 
-static void chainSetCntVal(int counter, int slot, uint32_t value)
-{
-   uint32_t *p;
-   int page, offset;
-   page = counter / 2;
-   offset = (counter % 2 ? WCB_COUNTER_OOL : 0);
-   p = (uint32_t *) dmaOVirt[page] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
-   p[WCB_CHAIN_OOL + offset + slot] = value;
-}
+/*-------------------------------------------------------------------------*/
 
-static uint32_t chainGetCntValPadr(int counter, int slot)
+int gpioSerialReadOpen(unsigned gpio, unsigned baud, unsigned data_bits)
 {
-   uint32_t *p;
-   int page, offset;
-   page = counter / 2;
-   offset = (counter % 2 ? WCB_COUNTER_OOL : 0);
-   p = (uint32_t *) dmaOBus[page] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
-   return (uint32_t)(p + WCB_CHAIN_OOL + offset + slot);
-}
+   int bitTime, halfBit;
+   char *buf;
 
-static int chainGetCntCB(int counter)
-{
-   int page, offset;
-   page = counter / 2;
-   offset = (counter % 2 ? WCB_CNT_CBS : 0);
-   return ((page * CBS_PER_OPAGE) + offset);
-}
+   DBG(DBG_USER, "gpio=%d baud=%d data_bits=%d", gpio, baud, data_bits);
 
-static void chainMakeCounter(
-   unsigned counter,
-   unsigned blklen,
-   unsigned blocks,
-   unsigned count,
-   uint32_t repeat,
-   uint32_t next)
-{
-   rawCbs_t *p=NULL;
+   CHECK_INITED;
 
-   int b, baseCB, dig;
-   uint32_t nxt;
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-   int botCB;
+   if ((baud < PI_BB_SER_MIN_BAUD) || (baud > PI_BB_SER_MAX_BAUD))
+      SOFT_ERROR(PI_BAD_WAVE_BAUD,
+         "gpio %d, bad baud rate (%d)", gpio, baud);
 
-   botCB  = chainGetCntCB(counter);
+   if ((data_bits < PI_MIN_WAVE_DATABITS) ||
+       (data_bits > PI_MAX_WAVE_DATABITS))
+      SOFT_ERROR(PI_BAD_DATABITS,
+         "gpio %d, bad data bits (%d)", gpio, data_bits);
 
-   baseCB = botCB;
+   if (wfRx[gpio].mode != PI_WFRX_NONE)
+      SOFT_ERROR(PI_GPIO_IN_USE, "gpio %d is already being used", gpio);
 
-   /* set up all the OOLs */
-   for (b=0; b < (blocks*(blklen+1)); b++) chainSetCntVal(counter, b, repeat);
+   bitTime = (1000 * MILLION) / baud; /* nanos */
 
-   for (b=0; b<blocks; b++)
-      chainSetCntVal(counter,
-         ((b*(blklen+1))+blklen),
-         waveCbPOadr(baseCB+((b*3)+3)));
+   /* bit centres round to the nearest microsecond */
 
-   for (b=0; b<blocks; b++)
-   {
-      /* copy BOTTOM to NEXT */
+   halfBit = (bitTime / 2) + 500;
 
-      p = rawWaveCBAdr(botCB++);
+   /* in samples, with SRX_FRAC fraction bits */
 
-      p->info = NORMAL_DMA;
+   bitTime = ((uint64_t)bitTime << SRX_FRAC) / (gpioCfg.clockMicros * 1000);
+   halfBit = ((uint64_t)halfBit << SRX_FRAC) / (gpioCfg.clockMicros * 1000);
 
-      p->src = chainGetCntValPadr(counter, b*(blklen+1));
-      p->dst = (waveCbPOadr(botCB+1) + 20);
+   buf = malloc(SRX_BUF_SIZE);
 
-      p->length = 4;
-      p->next   = waveCbPOadr(botCB);
+   if (buf == NULL)
+      SOFT_ERROR(PI_NO_MEMORY, "gpio %d, can't allocate buffer", gpio);
 
-      /* copy BOTTOM to TOP */
+   pthread_mutex_lock(&srxReadMutex);
+   pthread_mutex_lock(&srxMutex);
 
-      p = rawWaveCBAdr(botCB++);
+   wfRx[gpio].gpio = gpio;
+   wfRx[gpio].mode = PI_WFRX_SERIAL;
+   wfRx[gpio].baud = baud;
 
-      p->info   = NORMAL_DMA;
+   wfRx[gpio].s.buf      = buf;
+   wfRx[gpio].s.bufSize  = SRX_BUF_SIZE;
+   wfRx[gpio].s.fullBit  = bitTime;
+   wfRx[gpio].s.halfBit  = halfBit;
+   wfRx[gpio].s.readPos  = 0;
+   wfRx[gpio].s.writePos = 0;
+   wfRx[gpio].s.bit      = -1;
+   wfRx[gpio].s.dataBits = data_bits;
+   wfRx[gpio].s.invert   = PI_BB_SER_NORMAL;
 
-      p->src = chainGetCntValPadr(counter, b*(blklen+1));
-      p->dst = chainGetCntValPadr(counter, (b*(blklen+1))+blklen);
+   if      (data_bits <  9) wfRx[gpio].s.bytes = 1;
+   else if (data_bits < 17) wfRx[gpio].s.bytes = 2;
+   else                  wfRx[gpio].s.bytes = 4;
 
-      p->length = 4;
-      p->next   = waveCbPOadr(botCB);
+   /* a frame starts on the first high to low after now */
 
-      /* shift all down one */
+   srxInvert &= ~BIT;
 
-      p = rawWaveCBAdr(botCB++);
+   if (gpioReg[GPLEV0] & BIT) srxPrev |= BIT; else srxPrev &= ~BIT;
 
-      p->info   = NORMAL_DMA|DMA_SRC_INC|DMA_DEST_INC;
+   srxActive &= ~BIT;
+   srxBits   |= BIT;
 
-      p->src = chainGetCntValPadr(counter, ((b*(blklen+1))+1));
-      p->dst = chainGetCntValPadr(counter, ((b*(blklen+1))+0));
+   pthread_mutex_unlock(&srxMutex);
+   pthread_mutex_unlock(&srxReadMutex);
 
-      p->length = blklen*4;
-      p->next   = repeat;
-   }
+   return 0;
+}
 
-   /* reset the counter */
+/*-------------------------------------------------------------------------*/
 
-   p = rawWaveCBAdr(botCB);
+int gpioSerialReadInvert(unsigned gpio, unsigned invert)
+{
+   DBG(DBG_USER, "gpio=%d invert=%d", gpio, invert);
 
-   p->info = NORMAL_DMA|DMA_SRC_INC|DMA_DEST_INC;
+   CHECK_INITED;
 
-   p->src = chainGetCntValPadr(counter, blocks*(blklen+1));
-   p->dst = chainGetCntValPadr(counter, 0);
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-   p->length = blocks*(blklen+1)*4;
-   p->next   = next;
+   if (wfRx[gpio].mode != PI_WFRX_SERIAL)
+      SOFT_ERROR(PI_NOT_SERIAL_GPIO, "no serial read on gpio (%d)", gpio);
 
-   b = 0;
+   if ((invert < PI_BB_SER_NORMAL) ||
+       (invert > PI_BB_SER_INVERT))
+      SOFT_ERROR(PI_BAD_SER_INVERT,
+         "bad invert level for gpio %d (%d)", gpio, invert);
 
-   while (count && (b<blocks))
-   {
-      dig = count % blklen;
-      count /= blklen;
+   pthread_mutex_lock(&srxMutex);
 
-      if (count) nxt = chainGetCntVal(counter, (b*(blklen+1))+blklen);
-      else       nxt = waveCbPOadr(botCB);
+   if (invert != wfRx[gpio].s.invert)
+   {
+      wfRx[gpio].s.invert = invert;
 
-      chainSetCntVal(counter, b*(blklen+1)+dig, nxt);
+      /* keep the last level in the new sense so no start bit is seen */
 
-      b++;
+      srxInvert ^= BIT;
+      srxPrev   ^= BIT;
    }
 
-   /* copy all the OOLs */
-   for (b=0; b < (blocks*(blklen+1)); b++)
-      chainSetCntVal(
-         counter, b+(blocks*(blklen+1)), chainGetCntVal(counter, b));
+   pthread_mutex_unlock(&srxMutex);
+
+   return 0;
 }
 
+/*-------------------------------------------------------------------------*/
 
-int gpioWaveChain(char *buf, unsigned bufSize)
+int gpioSerialRead(unsigned gpio, void *buf, size_t bufSize)
 {
-   unsigned blklen=16, blocks=4;
-   int cb, chaincb;
-   rawCbs_t *p;
-   int i, wid, cmd, loop, counters;
-   unsigned cycles;
-   uint32_t repeat, next;
-   int stk_pos[10], stk_lev=0;
-
-   cb = 0;
-   loop = -1;
-
-   DBG(DBG_USER, "bufSize=%d [%s]", bufSize, myBuf2Str(bufSize, buf));
-
-   CHECK_INITED;
+   unsigned bytes, rpos, wpos, pos, part;
+   wfRx_t *w;
 
-   if (!waveClockInited)
-   {
-      stopHardwarePWM();
-      initClock(0); /* initialise secondary clock */
-      waveClockInited = 1;
-   }
+   DBG(DBG_USER, "gpio=%d buf=%08X bufSize=%d", gpio, (int)buf, bufSize);
 
-   dmaOut[DMA_CS] = DMA_CHANNEL_RESET;
+   CHECK_INITED;
 
-   dmaOut[DMA_CONBLK_AD] = 0;
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-   /* add delay cb at start of DMA */
+   if (bufSize == 0)
+      SOFT_ERROR(PI_BAD_SERIAL_COUNT, "buffer size can't be zero");
 
-   p = rawWaveCBAdr(chainGetCB(cb++));
+   /* gpioSerialReadClose can't free the buffer while it is read */
 
-   /* use the secondary clock */
+   pthread_mutex_lock(&srxReadMutex);
 
-   if (gpioCfg.clockPeriph != PI_CLOCK_PCM)
-   {
-      p->info = NORMAL_DMA | TIMED_DMA(2);
-      p->dst  = PCM_TIMER;
-   }
-   else
+   if (wfRx[gpio].mode != PI_WFRX_SERIAL)
    {
-      p->info = NORMAL_DMA | TIMED_DMA(5);
-      p->dst  = PWM_TIMER;
+      pthread_mutex_unlock(&srxReadMutex);
+      SOFT_ERROR(PI_NOT_SERIAL_GPIO, "no serial read on gpio (%d)", gpio);
    }
 
-   p->src    = (uint32_t) (&dmaOBus[0]->periphData);
-   p->length = 4 * 20 / PI_WF_MICROS; /* 20 micros delay */
-   p->next   = waveCbPOadr(chainGetCB(cb));
+   w = &wfRx[gpio];
 
-   counters = 0;
-   wid = -1;
+   /* consumer side of the ring filled by the alert thread */
 
-   i = 0;
+   rpos = w->s.readPos;
+   wpos = __atomic_load_n(&w->s.writePos, __ATOMIC_ACQUIRE);
 
-   while (i<bufSize)
-   {
-      wid = (unsigned)buf[i];
+   bytes = wpos - rpos;
 
-      if (wid == 255) /* wave command */
-      {
-         if ((i+2) > bufSize)
-            SOFT_ERROR(PI_BAD_CHAIN_CMD,
-               "incomplete chain command (at %d)", i);
+   if (bytes > bufSize) bytes = bufSize;
 
-         cmd = buf[i+1];
+   /* copy in multiples of the data size in bytes */
 
-         if (cmd == 0) /* loop begin */
-         {
-            if (stk_lev >= (sizeof(stk_pos)/sizeof(int)))
-               SOFT_ERROR(PI_CHAIN_NESTING,
-                  "chain counters nested too deep (at %d)", i);
+   bytes = (bytes / w->s.bytes) * w->s.bytes;
 
-            stk_pos[stk_lev++] = cb;
+   if (buf && bytes)
+   {
+      pos  = rpos & (w->s.bufSize-1);
+      part = w->s.bufSize - pos;
 
-            i += 2;
-         }
-         else if (cmd == 1) /* loop end */
-         {
-            if (counters >= WCB_COUNTERS)
-               SOFT_ERROR(PI_CHAIN_COUNTER,
-                  "too many chain counters (at %d)", i);
+      if (part > bytes) part = bytes;
 
-            if ((i+4) > bufSize)
-               SOFT_ERROR(PI_BAD_CHAIN_CMD,
-                  "incomplete chain command (at %d)", i);
+      memcpy(buf, w->s.buf+pos, part);
+      memcpy((char *)buf+part, w->s.buf, bytes-part);
+   }
 
-            loop = 0;
-            if (--stk_lev >= 0) loop = stk_pos[stk_lev];
+   __atomic_store_n(&w->s.readPos, rpos + bytes, __ATOMIC_RELEASE);
 
-            if ((loop < 1) || (loop == cb))
-               SOFT_ERROR(PI_BAD_CHAIN_LOOP,
-                  "empty chain loop (at %d)", i);
+   pthread_mutex_unlock(&srxReadMutex);
 
-            cycles = ((unsigned)buf[i+3] <<  8) + (unsigned)buf[i+2];
+   return bytes;
+}
 
-            i += 4;
 
-            if (cycles > PI_MAX_WAVE_CYCLES)
-               SOFT_ERROR(PI_CHAIN_LOOP_CNT,
-                  "bad chain loop count (%d)", cycles);
+/*-------------------------------------------------------------------------*/
 
-            if (cycles == 0)
-            {
-               /* Skip the complete loop block.  Change
-                  the next pointing to the start of the
-                  loop block to the current cb.
-               */
-               p = rawWaveCBAdr(chainGetCB(loop));
-               p->next = waveCbPOadr(chainGetCB(cb));
-            }
-            else if (cycles == 1)
-            {
-               /* Nothing to do, no need for a counter. */
-            }
-            else
-            {
-               chaincb = chainGetCB(cb++);
-               if (chaincb < 0)
-                  SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+int gpioSerialReadClose(unsigned gpio)
+{
+   DBG(DBG_USER, "gpio=%d", gpio);
 
-               p = rawWaveCBAdr(chaincb);
+   CHECK_INITED;
 
-               repeat = waveCbPOadr(chainGetCB(loop));
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-                /* Need to check next cb as well. */
+   switch(wfRx[gpio].mode)
+   {
+      case PI_WFRX_NONE:
 
-               chaincb = chainGetCB(cb);
+         SOFT_ERROR(PI_NOT_SERIAL_GPIO, "no serial read on gpio (%d)", gpio);
 
-               if (chaincb < 0)
-                  SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+         break;
 
-               next = waveCbPOadr(chainGetCB(cb));
+      case PI_WFRX_SERIAL:
 
-               /* dummy src and dest */
-               p->info = NORMAL_DMA;
-               p->src = (uint32_t) (&dmaOBus[0]->periphData);
-               p->dst = (uint32_t) (&dmaOBus[0]->periphData);
-               p->length = 4;
-               p->next = waveCbPOadr(chainGetCntCB(counters));
+         /* waits for a gpioSerialRead in progress */
 
-               chainMakeCounter(counters, blklen, blocks,
-                            cycles-1, repeat, next);
+         pthread_mutex_lock(&srxReadMutex);
 
-               counters++;
-            }
-         }
-         else if (cmd == 2) /* delay us */
+         if (wfRx[gpio].mode == PI_WFRX_SERIAL)
          {
-            if ((i+4) > bufSize)
-               SOFT_ERROR(PI_BAD_CHAIN_CMD,
-                  "incomplete chain command (at %d)", i);
+            pthread_mutex_lock(&srxMutex);
 
-            cycles = ((unsigned)buf[i+3] <<  8) + (unsigned)buf[i+2];
+            srxBits   &= ~(1<<gpio);
+            srxActive &= ~(1<<gpio);
 
-            i += 4;
+            wfRx[gpio].mode = PI_WFRX_NONE;
 
-            if (cycles > PI_MAX_WAVE_DELAY)
-               SOFT_ERROR(PI_BAD_CHAIN_DELAY,
-                  "bad chain delay micros (%d)", cycles);
+            pthread_mutex_unlock(&srxMutex);
 
-            if (cycles)
-            {
-               chaincb = chainGetCB(cb++);
+            free(wfRx[gpio].s.buf);
+         }
 
-               if (chaincb < 0)
-                  SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+         pthread_mutex_unlock(&srxReadMutex);
 
-               p = rawWaveCBAdr(chaincb);
+         break;
+   }
 
-               /* use the secondary clock */
+   return 0;
+}
 
-               if (gpioCfg.clockPeriph != PI_CLOCK_PCM)
-               {
-                  p->info = NORMAL_DMA | TIMED_DMA(2);
-                  p->dst  = PCM_TIMER;
-               }
-               else
-               {
-                  p->info = NORMAL_DMA | TIMED_DMA(5);
-                  p->dst  = PWM_TIMER;
-               }
 
-               p->src    = (uint32_t) (&dmaOBus[0]->periphData);
-               p->length = 4 * cycles / PI_WF_MICROS;
-               p->next   = waveCbPOadr(chainGetCB(cb));
-            }
-         }
-         else if (cmd == 3) /* repeat loop forever */
-         {
-            i += 2;
+/* ----------------------------------------------------------------------- */
 
-            loop = 0;
-            if (--stk_lev >= 0) loop = stk_pos[stk_lev];
+static int intGpioSetAlertFunc(
+   unsigned gpio,
+   void *   f,
+   int      user,
+   void *   userdata)
+{
+   DBG(DBG_INTERNAL, "gpio=%d function=%08X, user=%d, userdata=%08X",
+      gpio, (uint32_t)f, user, (uint32_t)userdata);
 
-            if ((loop < 1) || (loop == cb))
-               SOFT_ERROR(PI_BAD_CHAIN_LOOP,
-                  "empty chain loop (at %d)", i);
+   gpioAlert[gpio].ex = user;
+   gpioAlert[gpio].userdata = userdata;
 
-            chaincb = chainGetCB(cb++);
-            if (chaincb < 0)
-               SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+   gpioAlert[gpio].func = f;
 
-            if (i < bufSize)
-               SOFT_ERROR(PI_BAD_FOREVER,
-                  "loop forever must be last command");
+   if (f)
+   {
+      alertBits |= BIT;
+   }
+   else
+   {
+      alertBits &= ~BIT;
+   }
 
-            p = rawWaveCBAdr(chaincb);
+   monitorBits = alertBits | notifyBits | scriptBits | gpioGetSamples.bits |
+      capMonitorBits;
 
-            /* dummy src and dest */
-            p->info = NORMAL_DMA;
-            p->src = (uint32_t) (&dmaOBus[0]->periphData);
-            p->dst = (uint32_t) (&dmaOBus[0]->periphData);
-            p->length = 4;
-            p->next = waveCbPOadr(chainGetCB(loop));
-         }
-         else
-            SOFT_ERROR(PI_BAD_CHAIN_CMD,
-               "unknown chain command (255 %d)", cmd);
-      }
-      else if ((wid >= waveOutCount) || waveInfo[wid].deleted)
-         SOFT_ERROR(PI_BAD_WAVE_ID, "undefined wave (%d)", wid);
-      else
-      {
-         chaincb = chainGetCB(cb++);
+   return 0;
+}
 
-         if (chaincb < 0)
-            SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+/* ----------------------------------------------------------------------- */
 
-         p = rawWaveCBAdr(chaincb);
+int gpioSetAlertFunc(unsigned gpio, gpioAlertFunc_t f)
+{
+   DBG(DBG_USER, "gpio=%d function=%08X", gpio, (uint32_t)f);
 
-         chaincb = chainGetCB(cb);
+   CHECK_INITED;
 
-         if (chaincb < 0)
-            SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-         chainSetVal(cb-1, waveCbPOadr(chaincb));
+   intGpioSetAlertFunc(gpio, f, 0, NULL);
 
-         /* patch next of wid topCB to next cb */
+   return 0;
+}
 
-         p->info   = NORMAL_DMA;
-         p->src    = chainGetValPadr(cb-1); /* this next */
-         p->dst    = waveCbPOadr(waveInfo[wid].topCB) + 20; /* wid next */
-         p->length = 4;
-         p->next   = waveCbPOadr(waveInfo[wid].botCB+1);
 
-         i += 1;
-      }
-   }
+/* ----------------------------------------------------------------------- */
 
-   chaincb = chainGetCB(cb++);
+int gpioSetAlertFuncEx(unsigned gpio, gpioAlertFuncEx_t f, void *userdata)
+{
+   DBG(DBG_USER, "gpio=%d function=%08X userdata=%08X",
+      gpio, (uint32_t)f, (uint32_t)userdata);
 
-   if (chaincb < 0)
-      SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+   CHECK_INITED;
 
-   p = rawWaveCBAdr(chaincb);
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-   p->info   = NORMAL_DMA;
-   p->src    = (uint32_t) (&dmaOBus[0]->periphData);
-   p->dst    = (uint32_t) (&dmaOBus[0]->periphData);
-   p->length = 4;
-   p->next = 0;
+   intGpioSetAlertFunc(gpio, f, 1, userdata);
+
+   return 0;
+}
+
+/*
+All ISR gpios are serviced by one thread.  It epolls the sysfs value
+files of every ISR gpio together with an eventfd which is written
+whenever the ISR configuration changes.  Pending timeouts are kept in
+a min heap of deadlines so the thread only waits for the earliest.
+*/
+
+static uint64_t isrMillis(void)
+{
+   struct timespec ts;
 
-   initDMAgo((uint32_t *)dmaOut, waveCbPOadr(chainGetCB(0)));
+   clock_gettime(CLOCK_MONOTONIC, &ts);
 
-   return 0;
+   return ((uint64_t)ts.tv_sec * THOUSAND) + (ts.tv_nsec / MILLION);
 }
 
-/*-------------------------------------------------------------------------*/
+/* ----------------------------------------------------------------------- */
 
-int gpioWaveTxBusy(void)
+static void isrHeapSwap(int a, int b)
 {
-   DBG(DBG_USER, "");
+   int t;
 
-   CHECK_INITED;
+   t = isrHeap[a];
+   isrHeap[a] = isrHeap[b];
+   isrHeap[b] = t;
 
-   if (dmaOut[DMA_CONBLK_AD])
-      return 1;
-   else
-      return 0;
+   gpioISR[isrHeap[a]].heapPos = a;
+   gpioISR[isrHeap[b]].heapPos = b;
 }
 
 /* ----------------------------------------------------------------------- */
 
-int gpioWaveTxStop(void)
+static void isrHeapFix(int pos)
 {
-   DBG(DBG_USER, "");
+   int parent, child;
 
-   CHECK_INITED;
+   while (pos > 0)
+   {
+      parent = (pos - 1) / 2;
 
-   dmaOut[DMA_CS] = DMA_CHANNEL_RESET;
+      if (gpioISR[isrHeap[pos]].deadline >= gpioISR[isrHeap[parent]].deadline)
+         break;
 
-   dmaOut[DMA_CONBLK_AD] = 0;
+      isrHeapSwap(pos, parent);
 
-   return 0;
-}
+      pos = parent;
+   }
 
-/* ----------------------------------------------------------------------- */
+   while ((child = (2 * pos) + 1) < isrHeapSize)
+   {
+      if (((child + 1) < isrHeapSize) &&
+          (gpioISR[isrHeap[child+1]].deadline <
+           gpioISR[isrHeap[child]].deadline)) child++;
 
-int gpioWaveGetMicros(void)
-{
-   DBG(DBG_USER, "");
+      if (gpioISR[isrHeap[pos]].deadline <= gpioISR[isrHeap[child]].deadline)
+         break;
 
-   CHECK_INITED;
+      isrHeapSwap(pos, child);
 
-   return wfStats.micros;
+      pos = child;
+   }
 }
 
 /* ----------------------------------------------------------------------- */
 
-int gpioWaveGetHighMicros(void)
+static void isrHeapRemove(unsigned gpio)
 {
-   DBG(DBG_USER, "");
+   int pos;
 
-   CHECK_INITED;
+   pos = gpioISR[gpio].heapPos;
 
-   return wfStats.highMicros;
+   if (pos < 0) return;
+
+   gpioISR[gpio].heapPos = -1;
+
+   if (--isrHeapSize != pos)
+   {
+      isrHeap[pos] = isrHeap[isrHeapSize];
+      gpioISR[isrHeap[pos]].heapPos = pos;
+      isrHeapFix(pos);
+   }
 }
 
 /* ----------------------------------------------------------------------- */
 
-int gpioWaveGetMaxMicros(void)
+/* call with isrMutex held */
+
+static void isrRestartTimeout(unsigned gpio, uint64_t now)
 {
-   DBG(DBG_USER, "");
+   gpioISR_t *isr = &gpioISR[gpio];
 
-   CHECK_INITED;
+   if (isr->timeout > 0)
+   {
+      isr->deadline = now + isr->timeout;
 
-   return wfStats.maxMicros;
+      if (isr->heapPos < 0)
+      {
+         isr->heapPos = isrHeapSize;
+         isrHeap[isrHeapSize++] = gpio;
+      }
+
+      isrHeapFix(isr->heapPos);
+   }
+   else isrHeapRemove(gpio);
 }
 
 /* ----------------------------------------------------------------------- */
 
-int gpioWaveGetPulses(void)
+static void isrQueue(isrCall_t *call, gpioISR_t *isr, int level)
 {
-   DBG(DBG_USER, "");
-
-   CHECK_INITED;
-
-   return wfStats.pulses;
+   call->func     = isr->func;
+   call->gpio     = isr->gpio;
+   call->level    = level;
+   call->ex       = isr->ex;
+   call->userdata = isr->userdata;
 }
 
 /* ----------------------------------------------------------------------- */
 
-int gpioWaveGetHighPulses(void)
+static void *pthISRThread(void *x)
 {
-   DBG(DBG_USER, "");
+   struct epoll_event ev[PI_MAX_USER_GPIO+2];
+   isrCall_t call[2*(PI_MAX_USER_GPIO+1)];
+   gpioISR_t *isr;
+   uint64_t now, count;
+   uint32_t tick, levels;
+   int i, n, calls, timeout, level, state;
+   char buf[64];
 
-   CHECK_INITED;
+   while (1)
+   {
+      pthread_mutex_lock(&isrMutex);
 
-   return wfStats.highPulses;
-}
+      timeout = -1;
 
-/* ----------------------------------------------------------------------- */
+      if (isrHeapSize)
+      {
+         now = isrMillis();
 
-int gpioWaveGetMaxPulses(void)
-{
-   DBG(DBG_USER, "");
+         if (gpioISR[isrHeap[0]].deadline > now)
+            timeout = gpioISR[isrHeap[0]].deadline - now;
+         else
+            timeout = 0;
+      }
 
-   CHECK_INITED;
+      pthread_mutex_unlock(&isrMutex);
 
-   return wfStats.maxPulses;
-}
+      n = epoll_wait(isrEpfd, ev, PI_MAX_USER_GPIO+2, timeout);
 
-/* ----------------------------------------------------------------------- */
+      if (n < 0) n = 0; /* interrupted, just check the timeouts */
 
-int gpioWaveGetCbs(void)
-{
-   DBG(DBG_USER, "");
+      /* one tick and one level read serve every interrupt in the batch */
 
-   CHECK_INITED;
+      tick = systReg[SYST_CLO];
 
-   return wfStats.cbs;
-}
+      levels = *(gpioReg + GPLEV0);
 
-/* ----------------------------------------------------------------------- */
+      /* don't allow cancellation while holding the mutex */
 
-int gpioWaveGetHighCbs(void)
-{
-   DBG(DBG_USER, "");
+      pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
 
-   CHECK_INITED;
+      pthread_mutex_lock(&isrMutex);
 
-   return wfStats.highCbs;
-}
+      gpioStats.isrWakeups++;
 
-/* ----------------------------------------------------------------------- */
+      now = isrMillis();
 
-int gpioWaveGetMaxCbs(void)
-{
-   DBG(DBG_USER, "");
+      calls = 0;
 
-   CHECK_INITED;
+      for (i=0; i<n; i++)
+      {
+         if (ev[i].data.u32 > PI_MAX_USER_GPIO)
+         {
+            /* configuration changed, the wait will be recalculated */
 
-   return wfStats.maxCbs;
-}
+            read(isrWakeFd, &count, sizeof(count));
+            continue;
+         }
 
-static int read_SDA(wfRx_t *w)
-{
-   myGpioSetMode(w->I.SDA, PI_INPUT);
-   return gpioRead(w->I.SDA);
-}
+         isr = &gpioISR[ev[i].data.u32];
 
-static void set_SDA(wfRx_t *w)
-{
-   myGpioSetMode(w->I.SDA, PI_INPUT);
-}
+         if (isr->func == NULL) continue; /* deleted during the wait */
 
-static void clear_SDA(wfRx_t *w)
-{
-   myGpioSetMode(w->I.SDA, PI_OUTPUT);
-   myGpioWrite(w->I.SDA, 0);
-}
+         lseek(isr->fd, 0, SEEK_SET);    /* consume interrupt */
+         read(isr->fd, buf, sizeof buf);
 
-static void clear_SCL(wfRx_t *w)
-{
-   myGpioSetMode(w->I.SCL, PI_OUTPUT);
-   myGpioWrite(w->I.SCL, 0);
-}
+         if (levels & (1<<isr->gpio)) level = PI_ON; else level = PI_OFF;
 
-static void I2C_delay(wfRx_t *w)
-{
-   myGpioDelay(w->I.delay);
-}
+         isrQueue(&call[calls++], isr, level);
 
-static void I2C_clock_stretch(wfRx_t *w)
-{
-   uint32_t now, max_stretch=10000;
+         isrRestartTimeout(isr->gpio, now);
 
-   myGpioSetMode(w->I.SCL, PI_INPUT);
-   now = gpioTick();
-   while ((gpioRead(w->I.SCL) == 0) && ((gpioTick()-now) < max_stretch));
-}
+         gpioStats.isrEvents++;
+      }
 
-static void I2CStart(wfRx_t *w)
-{
-   if (w->I.started)
-   {
-      set_SDA(w);
-      I2C_delay(w);
-      I2C_clock_stretch(w);
-      I2C_delay(w);
-   }
+      while (isrHeapSize && (gpioISR[isrHeap[0]].deadline <= now))
+      {
+         isr = &gpioISR[isrHeap[0]];
 
-   clear_SDA(w);
-   I2C_delay(w);
-   clear_SCL(w);
-   I2C_delay(w);
+         isrQueue(&call[calls++], isr, PI_TIMEOUT);
 
-   w->I.started = 1;
-}
+         isrRestartTimeout(isr->gpio, now);
 
-static void I2CStop(wfRx_t *w)
-{
-   clear_SDA(w);
-   I2C_delay(w);
-   I2C_clock_stretch(w);
-   I2C_delay(w);
-   set_SDA(w);
-   I2C_delay(w);
+         gpioStats.isrTimeouts++;
+      }
 
-   w->I.started = 0;
-}
+      pthread_mutex_unlock(&isrMutex);
 
-static void I2CPutBit(wfRx_t *w, int bit)
-{
-   if (bit) set_SDA(w);
-   else     clear_SDA(w);
+      pthread_setcancelstate(state, NULL);
 
-   I2C_delay(w);
-   I2C_clock_stretch(w);
-   I2C_delay(w);
-   clear_SCL(w);
+      /* called unlocked so that a callback may change the ISRs */
+
+      for (i=0; i<calls; i++)
+      {
+         if (call[i].ex)
+            (call[i].func)
+               (call[i].gpio, call[i].level, tick, call[i].userdata);
+         else
+            (call[i].func)(call[i].gpio, call[i].level, tick);
+      }
+   }
+
+   return NULL;
 }
 
-static int I2CGetBit(wfRx_t *w)
-{
-   int bit;
 
-   set_SDA(w); /* let SDA float */
-   I2C_delay(w);
-   I2C_clock_stretch(w);
-   bit = read_SDA(w);
-   I2C_delay(w);
-   clear_SCL(w);
+/* ----------------------------------------------------------------------- */
 
-   return bit;
-}
+/* call with isrMutex held */
 
-static int I2CPutByte(wfRx_t *w, int byte)
+static int isrStart(void)
 {
-   int bit, nack;
+   struct epoll_event ev;
+   pthread_attr_t pthAttr;
 
-   for(bit=0; bit<8; bit++)
+   isrEpfd = epoll_create(PI_MAX_USER_GPIO+2);
+
+   if (isrEpfd < 0)
+      SOFT_ERROR(PI_BAD_ISR_INIT, "epoll_create failed (%m)");
+
+   isrWakeFd = eventfd(0, EFD_NONBLOCK);
+
+   ev.events   = EPOLLIN;
+   ev.data.u32 = PI_MAX_USER_GPIO+1;
+
+   if ((isrWakeFd < 0) ||
+       (epoll_ctl(isrEpfd, EPOLL_CTL_ADD, isrWakeFd, &ev) < 0) ||
+       pthread_attr_init(&pthAttr) ||
+       pthread_attr_setstacksize(&pthAttr, STACK_SIZE) ||
+       pthread_create(&pthISR, &pthAttr, pthISRThread, NULL))
    {
-      I2CPutBit(w, byte & 0x80);
-      byte <<= 1;
+      if (isrWakeFd >= 0) close(isrWakeFd);
+      close(isrEpfd);
+
+      isrWakeFd = -1;
+      isrEpfd   = -1;
+
+      SOFT_ERROR(PI_BAD_ISR_INIT, "ISR thread failed (%m)");
    }
 
-   nack = I2CGetBit(w);
+   pthISRRunning = 1;
 
-   return nack;
+   return 0;
 }
 
-static uint8_t I2CGetByte(wfRx_t *w, int nack)
+/* ----------------------------------------------------------------------- */
+
+static void isrWake(void)
 {
-   int bit, byte=0;
+   uint64_t one = 1;
 
-   for (bit=0; bit<8; bit++)
+   if (write(isrWakeFd, &one, sizeof(one)) != sizeof(one))
+      DBG(DBG_INTERNAL, "ISR wake failed (%m)");
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void isrStop(void)
+{
+   int i;
+
+   if (pthISRRunning)
    {
-      byte = (byte << 1) | I2CGetBit(w);
+      pthread_cancel(pthISR);
+      pthread_join(pthISR, NULL);
+      pthISRRunning = 0;
+
+      close(isrWakeFd);
+      close(isrEpfd);
+
+      isrWakeFd = -1;
+      isrEpfd   = -1;
    }
 
-   I2CPutBit(w, nack);
+   for (i=0; i<=PI_MAX_USER_GPIO; i++)
+   {
+      if (gpioISR[i].func)
+      {
+         close(gpioISR[i].fd);
+         gpioISR[i].func = NULL;
+      }
 
-   return byte;
+      gpioISR[i].heapPos = -1;
+   }
+
+   isrHeapSize = 0;
 }
 
-int bbI2COpen(unsigned SDA, unsigned SCL, unsigned baud)
+/* ----------------------------------------------------------------------- */
+
+static int intGpioSetISRFunc(
+   unsigned gpio,
+   unsigned edge,
+   int timeout,
+   void *f,
+   int user,
+   void *userdata)
 {
-   DBG(DBG_USER, "SDA=%d SCL=%d baud=%d", SDA, SCL, baud);
+   char buf[64];
 
-   CHECK_INITED;
+   char *edge_str[]={"rising\n", "falling\n", "both\n"};
+   int fd;
+   int err;
+   struct epoll_event ev;
+
+   DBG(DBG_INTERNAL,
+      "gpio=%d edge=%d timeout=%d function=%08X user=%d userdata=%08X",
+      gpio, edge, timeout, (uint32_t)f, user, (uint32_t)userdata);
+
+   if (f)
+   {
+      if (!gpioISR[gpio].inited) /* export gpio if unexported */
+      {
+         fd = open("/sys/class/gpio/export", O_WRONLY);
+         if (fd < 0) return PI_BAD_ISR_INIT;
+
+         /* ignore write fail if already exported */
+         sprintf(buf, "%d\n", gpio);
+         err = write(fd, buf, strlen(buf));
+         close(fd);
+
+         sprintf(buf, "/sys/class/gpio/gpio%d/direction", gpio);
+         fd = open(buf, O_WRONLY);
+         if (fd < 0) return PI_BAD_ISR_INIT;
 
-   if (SDA > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad SDA (%d)", SDA);
+         err = write(fd, "in\n", 3);
+         close(fd);
+         if (err != 3) return PI_BAD_ISR_INIT;
 
-   if (SCL > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad SCL (%d)", SCL);
+         gpioISR[gpio].gpio = gpio;
+         gpioISR[gpio].edge = -1;
+         gpioISR[gpio].timeout = -1;
+         gpioISR[gpio].heapPos = -1;
 
-   if ((baud < PI_BB_I2C_MIN_BAUD) || (baud > PI_BB_I2C_MAX_BAUD))
-      SOFT_ERROR(PI_BAD_I2C_BAUD,
-         "SDA %d, bad baud rate (%d)", SDA, baud);
+         gpioISR[gpio].inited = 1;
+      }
 
-   if (wfRx[SDA].mode != PI_WFRX_NONE)
-      SOFT_ERROR(PI_GPIO_IN_USE, "gpio %d is already being used", SDA);
+      if (gpioISR[gpio].edge != edge)
+      {
+         sprintf(buf, "/sys/class/gpio/gpio%d/edge", gpio);
+         fd = open(buf, O_WRONLY);
+         if (fd < 0) return PI_BAD_ISR_INIT;
 
-   if ((wfRx[SCL].mode != PI_WFRX_NONE)  || (SCL == SDA))
-      SOFT_ERROR(PI_GPIO_IN_USE, "gpio %d is already being used", SCL);
+         err = write(fd, edge_str[edge], strlen(edge_str[edge]));
+         close(fd);
+         if (err != strlen(edge_str[edge])) return PI_BAD_ISR_INIT;
 
-   wfRx[SDA].gpio = SDA;
-   wfRx[SDA].mode = PI_WFRX_I2C;
-   wfRx[SDA].baud = baud;
+         gpioISR[gpio].edge = edge;
+      }
 
-   wfRx[SDA].I.started = 0;
-   wfRx[SDA].I.SDA = SDA;
-   wfRx[SDA].I.SCL = SCL;
-   wfRx[SDA].I.delay = 500000 / baud;
-   wfRx[SDA].I.SDAMode = gpioGetMode(SDA);
-   wfRx[SDA].I.SCLMode = gpioGetMode(SCL);
+      if (timeout <= 0) timeout = -1;
 
-   wfRx[SCL].gpio = SCL;
-   wfRx[SCL].mode = PI_WFRX_I2C_CLK;
+      pthread_mutex_lock(&isrMutex);
 
-   myGpioSetMode(SDA, PI_INPUT);
-   myGpioSetMode(SCL, PI_INPUT);
+      if (!pthISRRunning && isrStart())
+      {
+         pthread_mutex_unlock(&isrMutex);
+         return PI_BAD_ISR_INIT;
+      }
 
-   return 0;
-}
+      if (gpioISR[gpio].func == NULL)
+      {
+         sprintf(buf, "/sys/class/gpio/gpio%d/value", gpio);
 
+         fd = open(buf, O_RDONLY);
 
-/* ----------------------------------------------------------------------- */
+         if (fd < 0)
+         {
+            pthread_mutex_unlock(&isrMutex);
+            SOFT_ERROR(PI_BAD_ISR_INIT, "gpio %d not exported", gpio);
+         }
 
+         lseek(fd, 0, SEEK_SET);    /* consume any prior interrupt */
+         read(fd, buf, sizeof buf);
 
-int bbI2CClose(unsigned SDA)
-{
-   DBG(DBG_USER, "SDA=%d", SDA);
+         ev.events   = EPOLLPRI | EPOLLERR;
+         ev.data.u32 = gpio;
 
-   CHECK_INITED;
+         if (epoll_ctl(isrEpfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+         {
+            close(fd);
+            pthread_mutex_unlock(&isrMutex);
+            SOFT_ERROR(PI_BAD_ISR_INIT, "epoll_ctl failed (%m)");
+         }
 
-   if (SDA > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", SDA);
+         gpioISR[gpio].fd = fd;
+      }
 
-   switch(wfRx[SDA].mode)
-   {
-      case PI_WFRX_I2C:
+      gpioISR[gpio].func = f;
+      gpioISR[gpio].ex = user;
+      gpioISR[gpio].userdata = userdata;
+      gpioISR[gpio].timeout = timeout;
 
-         gpioSetMode(wfRx[SDA].I.SDA, wfRx[SDA].I.SDAMode);
-         gpioSetMode(wfRx[SDA].I.SCL, wfRx[SDA].I.SCLMode);
+      /* any change restarts the timeout */
 
-         wfRx[wfRx[SDA].I.SDA].mode = PI_WFRX_NONE;
-         wfRx[wfRx[SDA].I.SCL].mode = PI_WFRX_NONE;
+      isrRestartTimeout(gpio, isrMillis());
 
-         break;
+      pthread_mutex_unlock(&isrMutex);
 
-      default:
+      isrWake();
+   }
+   else /* null function, delete ISR, unexport gpio */
+   {
+      pthread_mutex_lock(&isrMutex);
 
-         SOFT_ERROR(PI_NOT_I2C_GPIO, "no I2C on gpio (%d)", SDA);
+      if (gpioISR[gpio].func) /* delete any existing ISR */
+      {
+         epoll_ctl(isrEpfd, EPOLL_CTL_DEL, gpioISR[gpio].fd, NULL);
+         close(gpioISR[gpio].fd);
+         isrHeapRemove(gpio);
+         gpioISR[gpio].func = NULL;
+      }
 
-         break;
+      pthread_mutex_unlock(&isrMutex);
 
+      if (gpioISR[gpio].inited) /* unexport any gpio */
+      {
+         fd = open("/sys/class/gpio/unexport", O_WRONLY);
+         if (fd < 0) return PI_BAD_ISR_INIT;
+         sprintf(buf, "%d\n", gpio);
+         err = write(fd, buf, strlen(buf));
+         close(fd);
+         if (err != strlen(buf)) return PI_BAD_ISR_INIT;
+         gpioISR[gpio].inited = 0;
+      }
    }
 
    return 0;
 }
 
-/*-------------------------------------------------------------------------*/
+/* ----------------------------------------------------------------------- */
 
-int bbI2CZip(
-   unsigned SDA,
-   char *inBuf,
-   unsigned inLen,
-   char *outBuf,
-   unsigned outLen)
+int gpioSetISRFunc(
+   unsigned gpio,
+   unsigned edge,
+   int timeout,
+   gpioISRFunc_t f)
 {
-   int i, ack, inPos, outPos, status, bytes;
-   int addr, flags, esc, setesc;
-   wfRx_t *w;
-
-   DBG(DBG_USER, "gpio=%d inBuf=%s outBuf=%08X len=%d",
-      SDA, myBuf2Str(inLen, (char *)inBuf), (int)outBuf, outLen);
+   DBG(DBG_USER, "gpio=%d edge=%d timeout=%d function=%08X",
+      gpio, edge, timeout, (uint32_t)f);
 
    CHECK_INITED;
 
-   if (SDA > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", SDA);
-
-   if (wfRx[SDA].mode != PI_WFRX_I2C)
-      SOFT_ERROR(PI_NOT_I2C_GPIO, "no I2C on gpio (%d)", SDA);
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-   if (!inBuf || !inLen)
-      SOFT_ERROR(PI_BAD_POINTER, "input buffer can't be NULL");
+   if (edge > EITHER_EDGE)
+      SOFT_ERROR(PI_BAD_EDGE, "bad ISR edge (%d)", edge);
 
-   if (!outBuf && outLen)
-      SOFT_ERROR(PI_BAD_POINTER, "output buffer can't be NULL");
+   return intGpioSetISRFunc(gpio, edge, timeout, f, 0, NULL);
+}
 
-   w = &wfRx[SDA];
 
-   inPos = 0;
-   outPos = 0;
-   status = 0;
+/* ----------------------------------------------------------------------- */
 
-   addr = 0;
-   flags = 0;
-   esc = 0;
-   setesc = 0;
+int gpioSetISRFuncEx(
+   unsigned gpio,
+   unsigned edge,
+   int timeout,
+   gpioAlertFuncEx_t f,
+   void *userdata)
+{
+   DBG(DBG_USER, "gpio=%d edge=%d timeout=%d function=%08X userdata=%08X",
+      gpio, edge, timeout, (uint32_t)f, (uint32_t)userdata);
 
-   while (!status && (inPos < inLen))
-   {
-      DBG(DBG_INTERNAL, "status=%d inpos=%d inlen=%d cmd=%d addr=%d flags=%x",
-         status, inPos, inLen, inBuf[inPos], addr, flags);
+   CHECK_INITED;
 
-      switch (inBuf[inPos++])
-      {
-         case PI_I2C_END:
-            status = 1;
-            break;
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-         case PI_I2C_START:
-            I2CStart(w);
-            break;
+   if (edge > EITHER_EDGE)
+      SOFT_ERROR(PI_BAD_EDGE, "bad ISR edge (%d)", edge);
 
-         case PI_I2C_STOP:
-            I2CStop(w);
-            break;
+   return intGpioSetISRFunc(gpio, edge, timeout, f, 1, userdata);
+}
 
-         case PI_I2C_ADDR:
-            addr = myI2CGetPar(inBuf, &inPos, inLen, &esc);
-            if (addr < 0) status = PI_BAD_I2C_CMD;
-            break;
 
-         case PI_I2C_FLAGS:
-            /* cheat to force two byte flags */
-            esc = 1;
-            flags = myI2CGetPar(inBuf, &inPos, inLen, &esc);
-            if (flags < 0) status = PI_BAD_I2C_CMD;
-            break;
+/* ----------------------------------------------------------------------- */
 
-         case PI_I2C_ESC:
-            setesc = 1;
-            break;
+int gpioNotifyOpen(void)
+{
+   int i, slot, fd;
+   char name[32];
 
-         case PI_I2C_READ:
+   DBG(DBG_USER, "");
 
-            bytes = myI2CGetPar(inBuf, &inPos, inLen, &esc);
+   CHECK_INITED;
 
-            if (bytes >= 0) ack = I2CPutByte(w, (addr<<1)|1);
+   slot = -1;
 
-            if (bytes > 0)
-            {
-               if (!ack)
-               {
-                  if ((bytes + outPos) < outLen)
-                  {
-                     for (i=0; i<(bytes-1); i++)
-                     {
-                        outBuf[outPos++] = I2CGetByte(w, 0);
-                     }
-                     outBuf[outPos++] = I2CGetByte(w, 1);
-                  }
-                  else status = PI_BAD_I2C_RLEN;
-               }
-               else status = PI_I2C_READ_FAILED;
-            }
-            else status = PI_BAD_I2C_CMD;
-            break;
+   for (i=0; i<PI_NOTIFY_SLOTS; i++)
+   {
+      if (gpioNotify[i].state == PI_NOTIFY_CLOSED)
+      {
+         notifyJoinWriter(i);
+         gpioNotify[i].state = PI_NOTIFY_OPENED;
+         slot = i;
+         break;
+      }
+   }
 
-         case PI_I2C_WRITE:
+   if (slot < 0)
+      SOFT_ERROR(PI_NO_HANDLE, "no handle");
 
-            bytes = myI2CGetPar(inBuf, &inPos, inLen, &esc);
+   sprintf(name, "/dev/pigpio%d", slot);
 
-            if (bytes >= 0) ack = I2CPutByte(w, addr<<1);
+   myCreatePipe(name, 0664);
 
-            if (bytes > 0)
-            {
-               if (!ack)
-               {
-                  if ((bytes + inPos) < inLen)
-                  {
-                     for (i=0; i<(bytes-1); i++)
-                     {
-                        ack = I2CPutByte(w, inBuf[inPos++]);
-                        if (ack) status = PI_I2C_WRITE_FAILED;
-                     }
-                     ack = I2CPutByte(w, inBuf[inPos++]);
-                  }
-                  else status = PI_BAD_I2C_RLEN;
-               } else status = PI_I2C_WRITE_FAILED;
-            }
-            else status = PI_BAD_I2C_CMD;
-            break;
+   fd = open(name, O_RDWR|O_NONBLOCK);
 
-         default:
-            status = PI_BAD_I2C_CMD;
-      }
+   if (fd < 0)
+   {
+      gpioNotify[slot].state = PI_NOTIFY_CLOSED;
+      SOFT_ERROR(PI_BAD_PATHNAME, "open %s failed (%m)", name);
+   }
 
-      if (setesc) esc = 1; else esc = 0;
+   gpioNotify[slot].seqno = 0;
+   gpioNotify[slot].bits  = 0;
+   gpioNotify[slot].fd    = fd;
+   gpioNotify[slot].pipe  = 1;
+   gpioNotify[slot].max_emits  = MAX_EMITS;
+   gpioNotify[slot].tick64 = 0;
+   gpioNotify[slot].compact = 0;
+   gpioNotify[slot].encLevel = 0;
+   gpioNotify[slot].pollTail = gpioNotify[slot].pollHead;
+   gpioNotify[slot].lastReportTick = gpioTick();
 
-      setesc = 0;
+   if (notifyStartWriter(slot))
+   {
+      close(fd);
+      unlink(name);
+      gpioNotify[slot].state = PI_NOTIFY_CLOSED;
+      SOFT_ERROR(PI_NO_HANDLE, "writer thread failed (%m)");
    }
 
-   if (status >= 0) status = outPos;
-
-   return status;
+   return slot;
 }
 
 
-/*-------------------------------------------------------------------------*/
+/* ----------------------------------------------------------------------- */
 
-int gpioSerialReadOpen(unsigned gpio, unsigned baud, unsigned data_bits)
+static int gpioNotifyOpenInBand(int fd)
 {
-   int bitTime, timeout;
+   int i, slot;
 
-   DBG(DBG_USER, "gpio=%d baud=%d data_bits=%d", gpio, baud, data_bits);
+   DBG(DBG_USER, "");
 
    CHECK_INITED;
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   slot = -1;
 
-   if ((baud < PI_BB_SER_MIN_BAUD) || (baud > PI_BB_SER_MAX_BAUD))
-      SOFT_ERROR(PI_BAD_WAVE_BAUD,
-         "gpio %d, bad baud rate (%d)", gpio, baud);
+   for (i=0; i<PI_NOTIFY_SLOTS; i++)
+   {
+      if (gpioNotify[i].state == PI_NOTIFY_CLOSED)
+      {
+         slot = i;
+         break;
+      }
+   }
 
-   if ((data_bits < PI_MIN_WAVE_DATABITS) ||
-       (data_bits > PI_MAX_WAVE_DATABITS))
-      SOFT_ERROR(PI_BAD_DATABITS,
-         "gpio %d, bad data bits (%d)", gpio, data_bits);
+   if (slot < 0) SOFT_ERROR(PI_NO_HANDLE, "no handle");
 
-   if (wfRx[gpio].mode != PI_WFRX_NONE)
-      SOFT_ERROR(PI_GPIO_IN_USE, "gpio %d is already being used", gpio);
+   notifyJoinWriter(slot);
 
-   bitTime = (1000 * MILLION) / baud; /* nanos */
+   gpioNotify[slot].state = PI_NOTIFY_OPENED;
+   gpioNotify[slot].seqno = 0;
+   gpioNotify[slot].bits  = 0;
+   gpioNotify[slot].fd    = fd;
+   gpioNotify[slot].pipe  = 0;
+   gpioNotify[slot].max_emits  = MAX_EMITS;
+   gpioNotify[slot].tick64 = 0;
+   gpioNotify[slot].compact = 0;
+   gpioNotify[slot].encLevel = 0;
+   gpioNotify[slot].pollTail = gpioNotify[slot].pollHead;
+   gpioNotify[slot].lastReportTick = gpioTick();
 
-   timeout  = ((data_bits+2) * bitTime)/MILLION; /* millis */
+   if (notifyStartWriter(slot))
+   {
+      gpioNotify[slot].state = PI_NOTIFY_CLOSED;
+      SOFT_ERROR(PI_NO_HANDLE, "writer thread failed (%m)");
+   }
 
-   if (timeout < 1) timeout = 1;
+   return slot;
+}
 
-   wfRx[gpio].gpio = gpio;
-   wfRx[gpio].mode = PI_WFRX_SERIAL;
-   wfRx[gpio].baud = baud;
 
-   wfRx[gpio].s.buf      = malloc(SRX_BUF_SIZE);
-   wfRx[gpio].s.bufSize  = SRX_BUF_SIZE;
-   wfRx[gpio].s.timeout  = timeout;
-   wfRx[gpio].s.fullBit  = bitTime;         /* nanos */
-   wfRx[gpio].s.halfBit  = (bitTime/2)+500; /* nanos (500 for rounding) */
-   wfRx[gpio].s.readPos  = 0;
-   wfRx[gpio].s.writePos = 0;
-   wfRx[gpio].s.bit      = -1;
-   wfRx[gpio].s.dataBits = data_bits;
-   wfRx[gpio].s.invert   = PI_BB_SER_NORMAL;
+/* ----------------------------------------------------------------------- */
 
-   if      (data_bits <  9) wfRx[gpio].s.bytes = 1;
-   else if (data_bits < 17) wfRx[gpio].s.bytes = 2;
-   else                  wfRx[gpio].s.bytes = 4;
+static void intScriptBits(void)
+{
+   int i;
+   uint32_t bits;
 
-   gpioSetAlertFunc(gpio, waveRxBit);
+   bits = 0;
 
-   return 0;
-}
+   for (i=0; i<PI_MAX_SCRIPTS; i++)
+   {
+      if (gpioScript[i].state == PI_SCRIPT_IN_USE)
+      {
+         bits |= gpioScript[i].waitBits;
+      }
+   }
 
-/*-------------------------------------------------------------------------*/
+   scriptBits = bits;
 
-int gpioSerialReadInvert(unsigned gpio, unsigned invert)
-{
-   DBG(DBG_USER, "gpio=%d invert=%d", gpio, invert);
+   monitorBits = alertBits | notifyBits | scriptBits | gpioGetSamples.bits |
+      capMonitorBits;
+}
 
-   CHECK_INITED;
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+static void intNotifyBits(void)
+{
+   int i;
+   uint32_t bits;
 
-   if (wfRx[gpio].mode != PI_WFRX_SERIAL)
-      SOFT_ERROR(PI_NOT_SERIAL_GPIO, "no serial read on gpio (%d)", gpio);
+   bits = 0;
 
-   if ((invert < PI_BB_SER_NORMAL) ||
-       (invert > PI_BB_SER_INVERT))
-      SOFT_ERROR(PI_BAD_SER_INVERT,
-         "bad invert level for gpio %d (%d)", gpio, invert);
+   for (i=0; i<PI_NOTIFY_SLOTS; i++)
+   {
+      if (gpioNotify[i].state == PI_NOTIFY_RUNNING)
+      {
+         bits |= gpioNotify[i].bits;
+      }
+   }
 
-   wfRx[gpio].s.invert = invert;
+   notifyBits = bits;
 
-   return 0;
+   monitorBits = alertBits | notifyBits | scriptBits | gpioGetSamples.bits |
+      capMonitorBits;
 }
 
-/*-------------------------------------------------------------------------*/
 
-int gpioSerialRead(unsigned gpio, void *buf, size_t bufSize)
-{
-   unsigned bytes=0, wpos;
-   volatile wfRx_t *w;
+/* ----------------------------------------------------------------------- */
 
-   DBG(DBG_USER, "gpio=%d buf=%08X bufSize=%d", gpio, (int)buf, bufSize);
+int gpioNotifyFormat(unsigned handle, unsigned format)
+{
+   DBG(DBG_USER, "handle=%d format=%d", handle, format);
 
    CHECK_INITED;
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   if (handle >= PI_NOTIFY_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   if (bufSize == 0)
-      SOFT_ERROR(PI_BAD_SERIAL_COUNT, "buffer size can't be zero");
+   if (gpioNotify[handle].state <= PI_NOTIFY_CLOSING)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   if (wfRx[gpio].mode != PI_WFRX_SERIAL)
-      SOFT_ERROR(PI_NOT_SERIAL_GPIO, "no serial read on gpio (%d)", gpio);
+   if (format & ~PI_NOTIFY_FORMATS)
+      SOFT_ERROR(PI_BAD_NOTIFY_FMT, "bad format (%d)", format);
 
-   w = &wfRx[gpio];
+   /* the writer only looks at the format while running */
 
-   if (w->s.readPos != w->s.writePos)
-   {
-      wpos = w->s.writePos;
+   if (gpioNotify[handle].state == PI_NOTIFY_RUNNING)
+      SOFT_ERROR(PI_BAD_NOTIFY_FMT, "handle %d running", handle);
 
-      if (wpos > w->s.readPos) bytes = wpos - w->s.readPos;
-      else                     bytes = w->s.bufSize - w->s.readPos;
+   if (format & PI_NOTIFY_COMPACT)
+   {
+      gpioNotify[handle].compact = 1;
+      gpioNotify[handle].tick64 = 0;
+      gpioNotify[handle].max_emits = PIPE_BUF;
+   }
+   else if (format & PI_NOTIFY_TICK64)
+   {
+      gpioNotify[handle].compact = 0;
+      gpioNotify[handle].tick64 = 1;
+      gpioNotify[handle].max_emits = PIPE_BUF / sizeof(gpioReport64_t);
+   }
+   else
+   {
+      gpioNotify[handle].compact = 0;
+      gpioNotify[handle].tick64 = 0;
+      gpioNotify[handle].max_emits = MAX_EMITS;
+   }
 
-      if (bytes > bufSize) bytes = bufSize;
+   return 0;
+}
 
-      /* copy in multiples of the data size in bytes */
 
-      bytes = (bytes / w->s.bytes) * w->s.bytes;
+/* ----------------------------------------------------------------------- */
 
-      if (buf) memcpy(buf, w->s.buf+w->s.readPos, bytes);
+int gpioNotifyBegin(unsigned handle, uint32_t bits)
+{
+   DBG(DBG_USER, "handle=%d bits=%08X", handle, bits);
 
-      w->s.readPos += bytes;
+   CHECK_INITED;
 
-      if (w->s.readPos >= w->s.bufSize) w->s.readPos = 0;
-   }
-   return bytes;
-}
+   if (handle >= PI_NOTIFY_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
+   if (gpioNotify[handle].state <= PI_NOTIFY_CLOSING)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-/*-------------------------------------------------------------------------*/
+   gpioNotify[handle].bits  = bits;
 
-int gpioSerialReadClose(unsigned gpio)
-{
-   DBG(DBG_USER, "gpio=%d", gpio);
+   gpioNotify[handle].state = PI_NOTIFY_RUNNING;
 
-   CHECK_INITED;
+   intNotifyBits();
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   return 0;
+}
 
-   switch(wfRx[gpio].mode)
-   {
-      case PI_WFRX_NONE:
 
-         SOFT_ERROR(PI_NOT_SERIAL_GPIO, "no serial read on gpio (%d)", gpio);
+/* ----------------------------------------------------------------------- */
 
-         break;
+int gpioNotifyPause (unsigned handle)
+{
+   DBG(DBG_USER, "handle=%d", handle);
 
-      case PI_WFRX_SERIAL:
+   CHECK_INITED;
 
-         free(wfRx[gpio].s.buf);
+   if (handle >= PI_NOTIFY_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-         gpioSetWatchdog(gpio, 0); /* switch off timeouts */
+   if (gpioNotify[handle].state <= PI_NOTIFY_CLOSING)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-         gpioSetAlertFunc(gpio, NULL); /* cancel alert */
+   gpioNotify[handle].bits  = 0;
 
-         wfRx[gpio].mode = PI_WFRX_NONE;
+   gpioNotify[handle].state = PI_NOTIFY_PAUSED;
 
-         break;
-   }
+   intNotifyBits();
 
    return 0;
 }
@@ -9578,422 +16138,607 @@ int gpioSerialReadClose(unsigned gpio)
 
 /* ----------------------------------------------------------------------- */
 
-static int intGpioSetAlertFunc(
-   unsigned gpio,
-   void *   f,
-   int      user,
-   void *   userdata)
+int gpioNotifyClose(unsigned handle)
 {
-   DBG(DBG_INTERNAL, "gpio=%d function=%08X, user=%d, userdata=%08X",
-      gpio, (uint32_t)f, user, (uint32_t)userdata);
+   DBG(DBG_USER, "handle=%d", handle);
 
-   gpioAlert[gpio].ex = user;
-   gpioAlert[gpio].userdata = userdata;
+   CHECK_INITED;
 
-   gpioAlert[gpio].func = f;
+   if (handle >= PI_NOTIFY_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   if (f)
-   {
-      alertBits |= BIT;
-   }
-   else
-   {
-      alertBits &= ~BIT;
-   }
+   if (gpioNotify[handle].state <= PI_NOTIFY_CLOSING)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   gpioNotify[handle].bits  = 0;
 
-   monitorBits = alertBits | notifyBits | scriptBits | gpioGetSamples.bits;
+   gpioNotify[handle].state = PI_NOTIFY_CLOSING;
+
+   intNotifyBits();
+
+   /* actual close done in the handle's writer thread */
 
    return 0;
 }
 
 /* ----------------------------------------------------------------------- */
 
-int gpioSetAlertFunc(unsigned gpio, gpioAlertFunc_t f)
+/*
+Adds the reports of a poll job reading to its notification handle,
+called with pollMutex held.  A reading is added whole or not at all.
+*/
+
+static void pollPut(gpioPoll_t *j, int status, char *data)
 {
-   DBG(DBG_USER, "gpio=%d function=%08X", gpio, (uint32_t)f);
+   gpioNotify_t *h = &gpioNotify[j->handle];
+   gpioReport64_t *r;
+   unsigned i, k, n, pos, flags;
+   uint32_t level;
 
-   CHECK_INITED;
+   if (h->state != PI_NOTIFY_RUNNING) return;
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   if ((status < 0) || (j->rxLen == 0)) n = 1;
+   else                                 n = (j->rxLen + 3) / 4;
 
-   intGpioSetAlertFunc(gpio, f, 0, NULL);
+   if ((h->pollHead - h->pollTail + n) > NOTIFY_POLL_SIZE) return;
 
-   return 0;
-}
+   for (i=0; i<n; i++)
+   {
+      flags = PI_NTFY_FLAGS_POLL | PI_NTFY_FLAGS_BIT(j - gpioPoll);
+
+      level = 0;
+
+      if (status < 0)
+      {
+         flags |= PI_NTFY_FLAGS_FAIL;
+         level = status;
+      }
+      else
+      {
+         flags |= PI_NTFY_FLAGS_PART(i);
+
+         /* up to four bytes, first in the least significant */
+
+         for (k=0; k<4; k++)
+         {
+            pos = (i * 4) + k;
+
+            if (pos < j->rxLen) level |= (uint8_t)data[pos] << (k * 8);
+         }
+      }
+
+      r = &h->pollRep[(h->pollHead + i) & NOTIFY_POLL_MASK];
+
+      r->seqno = 0;
+      r->flags = flags;
+      r->tick  = j->tick;
+      r->level = level;
+   }
 
+   /* reports must be visible before the new head */
+
+   __sync_synchronize();
+
+   h->pollHead += n;
+
+   pthread_mutex_lock(&notifyRing.mutex);
+   pthread_cond_broadcast(&notifyRing.cond);
+   pthread_mutex_unlock(&notifyRing.mutex);
+}
 
 /* ----------------------------------------------------------------------- */
 
-int gpioSetAlertFuncEx(unsigned gpio, gpioAlertFuncEx_t f, void *userdata)
+static void pollI2CDone(int id, int status, void *userdata)
 {
-   DBG(DBG_USER, "gpio=%d function=%08X userdata=%08X",
-      gpio, (uint32_t)f, (uint32_t)userdata);
+   gpioPoll_t *j = userdata;
 
-   CHECK_INITED;
+   pthread_mutex_lock(&pollMutex);
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   j->busy = 0;
 
-   intGpioSetAlertFunc(gpio, f, 1, userdata);
+   if (j->state == PI_POLL_RUNNING)
+      pollPut(j, status, j->buf + j->txLen);
 
-   return 0;
+   else if (j->state == PI_POLL_STOPPING)
+      j->state = PI_POLL_FREE;
+
+   pthread_mutex_unlock(&pollMutex);
 }
 
-static void *pthISRThread(void *x)
+/* ----------------------------------------------------------------------- */
+
+static void pollTimer(void *userdata)
 {
-   gpioISR_t *isr = x;
-   int fd;
-   int retval;
-   uint32_t tick;
-   int level;
-   uint32_t levels;
-   struct pollfd pfd;
-   char buf[64];
+   gpioPoll_t *j = userdata;
+   int n, status;
 
-   DBG(DBG_USER, "gpio=%d edge=%d timeout=%d f=%x u=%d data=%x",
-      isr->gpio, isr->edge, isr->timeout, (uint32_t)isr->func,
-      isr->ex, (uint32_t)isr->userdata);
+   pthread_mutex_lock(&pollMutex);
 
-   sprintf(buf, "/sys/class/gpio/gpio%d/value", isr->gpio);
+   /* skip a period rather than queue behind a slow transfer */
 
-   if ((fd = open(buf, O_RDONLY)) < 0)
+   if ((j->state != PI_POLL_RUNNING) || j->busy)
    {
-      DBG(DBG_ALWAYS, "gpio %d not exported", isr->gpio);
-      return NULL;
+      pthread_mutex_unlock(&pollMutex);
+      return;
    }
 
-   pfd.fd = fd;
-
-   pfd.events = POLLPRI;
+   j->tick = systTick64();
 
-   lseek(fd, 0, SEEK_SET);    /* consume any prior interrupt */
-   read(fd, buf, sizeof buf);
-
-   while (1)
+   if (j->pollFlags == PI_POLL_I2C)
    {
-      retval = poll(&pfd, 1, isr->timeout); /* wait for interrupt */
+      /* the I2C queue worker completes the reading */
 
-      tick = systReg[SYST_CLO];
+      j->busy = 1;
 
-      levels = *(gpioReg + GPLEV0);
+      n = 0;
 
-      if (retval >= 0)
+      if (j->txLen) j->segs[n++].len = j->txLen;
+
+      if (j->rxLen)
       {
-         lseek(fd, 0, SEEK_SET);    /* consume interrupt */
-         read(fd, buf, sizeof buf);
-         if (retval)
-         {
-            if (levels & (1<<isr->gpio)) level = PI_ON; else level = PI_OFF;
-         }
-         else level = PI_TIMEOUT;
+         j->segs[n].addr  = i2cInfo[j->dev].addr;
+         j->segs[n].flags = PI_I2C_M_RD;
+         j->segs[n].len   = j->rxLen;
+         j->segs[n].buf   = (uint8_t *)j->buf + j->txLen;
+         n++;
+      }
+
+      j->segs[0].addr = i2cInfo[j->dev].addr;
+
+      pthread_mutex_unlock(&pollMutex);
+
+      status = i2cQueue(j->dev, j->segs, n, pollI2CDone, j);
 
-         if (isr->ex) (isr->func)(isr->gpio, level, tick, isr->userdata);
-         else         (isr->func)(isr->gpio, level, tick);
+      if (status < 0)
+      {
+         pthread_mutex_lock(&pollMutex);
+         j->busy = 0;
+         if (j->state == PI_POLL_RUNNING) pollPut(j, status, NULL);
+         else j->state = PI_POLL_FREE;
+         pthread_mutex_unlock(&pollMutex);
       }
    }
+   else
+   {
+      /* the SPI worker completes the reading */
 
-   return NULL;
-}
+      j->busy = 1;
+      j->due  = 1;
+
+      pthread_cond_signal(&pollWork);
 
+      pthread_mutex_unlock(&pollMutex);
+   }
+}
 
 /* ----------------------------------------------------------------------- */
 
-static int intGpioSetISRFunc(
-   unsigned gpio,
-   unsigned edge,
-   int timeout,
-   void *f,
-   int user,
-   void *userdata)
+static void *pthPollSPIThread(void *x)
 {
-   char buf[64];
+   gpioPoll_t *j;
+   char rxBuf[2 * PI_POLL_MAX_BYTES];
+   int i, next, status;
 
-   char *edge_str[]={"rising\n", "falling\n", "both\n"};
-   int fd;
-   int err;
+   next = 0;
 
-   DBG(DBG_INTERNAL,
-      "gpio=%d edge=%d timeout=%d function=%08X user=%d userdata=%08X",
-      gpio, edge, timeout, (uint32_t)f, user, (uint32_t)userdata);
+   pthread_mutex_lock(&pollMutex);
 
-   if (f)
+   while (!pollSPIStopping)
    {
-      if (!gpioISR[gpio].inited) /* export gpio if unexported */
-      {
-         fd = open("/sys/class/gpio/export", O_WRONLY);
-         if (fd < 0) return PI_BAD_ISR_INIT;
+      /* the due jobs in turn, so a slow device can't starve the rest */
 
-         /* ignore write fail if already exported */
-         sprintf(buf, "%d\n", gpio);
-         err = write(fd, buf, strlen(buf));
-         close(fd);
+      for (i=0; i<PI_POLL_SLOTS; i++)
+      {
+         if (gpioPoll[(next + i) % PI_POLL_SLOTS].due) break;
+      }
 
-         sprintf(buf, "/sys/class/gpio/gpio%d/direction", gpio);
-         fd = open(buf, O_WRONLY);
-         if (fd < 0) return PI_BAD_ISR_INIT;
+      if (i >= PI_POLL_SLOTS)
+      {
+         pthread_cond_wait(&pollWork, &pollMutex);
+         continue;
+      }
 
-         err = write(fd, "in\n", 3);
-         close(fd);
-         if (err != 3) return PI_BAD_ISR_INIT;
+      j = &gpioPoll[(next + i) % PI_POLL_SLOTS];
 
-         gpioISR[gpio].gpio = gpio;
-         gpioISR[gpio].edge = -1;
-         gpioISR[gpio].timeout = -1;
+      next = (next + i + 1) % PI_POLL_SLOTS;
 
-         gpioISR[gpio].inited = 1;
-      }
+      j->due = 0;
 
-      if (gpioISR[gpio].edge != edge)
+      if (j->state == PI_POLL_RUNNING)
       {
-         sprintf(buf, "/sys/class/gpio/gpio%d/edge", gpio);
-         fd = open(buf, O_WRONLY);
-         if (fd < 0) return PI_BAD_ISR_INIT;
-
-         err = write(fd, edge_str[edge], strlen(edge_str[edge]));
-         close(fd);
-         if (err != strlen(edge_str[edge])) return PI_BAD_ISR_INIT;
+         pthread_mutex_unlock(&pollMutex);
 
-         gpioISR[gpio].edge = edge;
+         /* SPI writes txLen bytes then zeros while reading rxLen */
 
-         if (gpioISR[gpio].pth != NULL)
-            pthread_kill(*gpioISR[gpio].pth, SIGCHLD);
-      }
+         status = spiXfer(j->dev, j->buf, rxBuf, j->txLen + j->rxLen);
 
-      if (timeout <= 0) timeout = -1;
-      if (gpioISR[gpio].timeout != timeout)
-      {
-         gpioISR[gpio].timeout = timeout;
+         pthread_mutex_lock(&pollMutex);
 
-         if (gpioISR[gpio].pth != NULL)
-            pthread_kill(*gpioISR[gpio].pth, SIGCHLD);
+         if (j->state == PI_POLL_RUNNING)
+            pollPut(j, (status < 0) ? status : 0, rxBuf + j->txLen);
       }
 
-      gpioISR[gpio].func = f;
-      gpioISR[gpio].ex = user;
-      gpioISR[gpio].userdata = userdata;
+      j->busy = 0;
 
-      if (gpioISR[gpio].pth == NULL)
-         gpioISR[gpio].pth = gpioStartThread(pthISRThread, &gpioISR[gpio]);
+      if (j->state == PI_POLL_STOPPING) j->state = PI_POLL_FREE;
    }
-   else /* null function, delete ISR, unexport gpio */
-   {
-      if (gpioISR[gpio].pth) /* delete any existing ISR */
-      {
-         gpioStopThread(gpioISR[gpio].pth);
-         gpioISR[gpio].func = NULL;
-         gpioISR[gpio].pth = NULL;
-      }
 
-      if (gpioISR[gpio].inited) /* unexport any gpio */
-      {
-         fd = open("/sys/class/gpio/unexport", O_WRONLY);
-         if (fd < 0) return PI_BAD_ISR_INIT;
-         sprintf(buf, "%d\n", gpio);
-         err = write(fd, buf, strlen(buf));
-         close(fd);
-         if (err != sizeof(buf)) return PI_BAD_ISR_INIT;
-         gpioISR[gpio].inited = 0;
-      }
-   }
+   pthread_mutex_unlock(&pollMutex);
 
-   return 0;
+   return NULL;
 }
 
 /* ----------------------------------------------------------------------- */
 
-int gpioSetISRFunc(
-   unsigned gpio,
-   unsigned edge,
-   int timeout,
-   gpioISRFunc_t f)
+static int pollSPIStart(void)
 {
-   DBG(DBG_USER, "gpio=%d edge=%d timeout=%d function=%08X",
-      gpio, edge, timeout, (uint32_t)f);
+   /* called with pollMutex held */
 
-   CHECK_INITED;
+   pthread_attr_t pthAttr;
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   if (pollSPIRunning) return 0;
 
-   if (edge > EITHER_EDGE)
-      SOFT_ERROR(PI_BAD_EDGE, "bad ISR edge (%d)", edge);
+   pollSPIStopping = 0;
 
-   return intGpioSetISRFunc(gpio, edge, timeout, f, 0, NULL);
+   if (pthread_attr_init(&pthAttr) ||
+       pthread_attr_setstacksize(&pthAttr, STACK_SIZE) ||
+       pthread_create(&pthPollSPI, &pthAttr, pthPollSPIThread, NULL))
+      return PI_INIT_FAILED;
+
+   pollSPIRunning = 1;
+
+   return 0;
 }
 
+/* ----------------------------------------------------------------------- */
+
+static void pollSPIStop(void)
+{
+   if (pollSPIRunning)
+   {
+      pthread_mutex_lock(&pollMutex);
+      pollSPIStopping = 1;
+      pthread_cond_broadcast(&pollWork);
+      pthread_mutex_unlock(&pollMutex);
+
+      pthread_join(pthPollSPI, NULL);
+
+      pollSPIRunning = 0;
+   }
+}
 
 /* ----------------------------------------------------------------------- */
 
-int gpioSetISRFuncEx(
-   unsigned gpio,
-   unsigned edge,
-   int timeout,
-   gpioAlertFuncEx_t f,
-   void *userdata)
+static void pollStop(gpioPoll_t *j)
 {
-   DBG(DBG_USER, "gpio=%d edge=%d timeout=%d function=%08X userdata=%08X",
-      gpio, edge, timeout, (uint32_t)f, (uint32_t)userdata);
+   pthread_mutex_lock(&pollMutex);
+   j->state = PI_POLL_STOPPING;
+   pthread_mutex_unlock(&pollMutex);
 
-   CHECK_INITED;
+   /* waits for a running callback */
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   pthread_mutex_lock(&twMutex);
+   twCancel(j->timer);
+   pthread_mutex_unlock(&twMutex);
 
-   if (edge > EITHER_EDGE)
-      SOFT_ERROR(PI_BAD_EDGE, "bad ISR edge (%d)", edge);
+   /* else freed when the queued transfer completes */
 
-   return intGpioSetISRFunc(gpio, edge, timeout, f, 1, userdata);
+   pthread_mutex_lock(&pollMutex);
+   if (!j->busy) j->state = PI_POLL_FREE;
+   pthread_mutex_unlock(&pollMutex);
 }
 
+/* ----------------------------------------------------------------------- */
+
+static void pollStopAll(int handle)
+{
+   int i;
+
+   for (i=0; i<PI_POLL_SLOTS; i++)
+   {
+      if ((gpioPoll[i].state == PI_POLL_RUNNING) &&
+          (gpioPoll[i].handle == handle))
+      {
+         pollStop(&gpioPoll[i]);
+      }
+   }
+}
 
 /* ----------------------------------------------------------------------- */
 
-int gpioNotifyOpen(void)
+int gpioPollStart(
+   unsigned handle, unsigned pollFlags, unsigned devHandle,
+   unsigned micros, char *txBuf, unsigned txLen, unsigned rxLen)
 {
-   int i, slot, fd;
-   char name[32];
+   int i, slot, timer;
+   gpioPoll_t *j;
 
-   DBG(DBG_USER, "");
+   DBG(DBG_USER, "handle=%d flags=%d dev=%d micros=%d tx=%s rxLen=%d",
+      handle, pollFlags, devHandle, micros,
+      myBuf2Str(txLen, txBuf), rxLen);
 
    CHECK_INITED;
 
+   if (handle >= PI_NOTIFY_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (gpioNotify[handle].state <= PI_NOTIFY_CLOSING)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (pollFlags == PI_POLL_I2C)
+   {
+      if ((devHandle >= PI_I2C_SLOTS) ||
+          (i2cInfo[devHandle].state != PI_I2C_OPENED))
+         SOFT_ERROR(PI_BAD_HANDLE, "bad I2C handle (%d)", devHandle);
+   }
+   else if (pollFlags == PI_POLL_SPI)
+   {
+      if ((devHandle >= PI_SPI_SLOTS) ||
+          (spiInfo[devHandle].state != PI_SPI_OPENED))
+         SOFT_ERROR(PI_BAD_HANDLE, "bad SPI handle (%d)", devHandle);
+   }
+   else SOFT_ERROR(PI_BAD_POLL, "bad flags (%d)", pollFlags);
+
+   if ((txLen > PI_POLL_MAX_BYTES) || (rxLen > PI_POLL_MAX_BYTES) ||
+       ((txLen + rxLen) == 0))
+      SOFT_ERROR(PI_BAD_POLL, "bad lengths (%d, %d)", txLen, rxLen);
+
+   if (txLen && (txBuf == NULL))
+      SOFT_ERROR(PI_BAD_POINTER, "null tx buffer");
+
+   if ((micros < PI_MIN_TIMER_MICROS) || (micros > PI_MAX_TIMER_MICROS))
+      SOFT_ERROR(PI_BAD_TIMER_MICS, "bad micros (%u)", micros);
+
+   pthread_mutex_lock(&pollMutex);
+
+   if ((pollFlags == PI_POLL_SPI) && pollSPIStart())
+   {
+      pthread_mutex_unlock(&pollMutex);
+      SOFT_ERROR(PI_INIT_FAILED, "SPI poll worker failed (%m)");
+   }
+
    slot = -1;
 
-   for (i=0; i<PI_NOTIFY_SLOTS; i++)
+   for (i=0; i<PI_POLL_SLOTS; i++)
    {
-      if (gpioNotify[i].state == PI_NOTIFY_CLOSED)
+      if (gpioPoll[i].state == PI_POLL_FREE)
       {
-         gpioNotify[i].state = PI_NOTIFY_OPENED;
          slot = i;
          break;
       }
    }
 
    if (slot < 0)
-      SOFT_ERROR(PI_NO_HANDLE, "no handle");
+   {
+      pthread_mutex_unlock(&pollMutex);
+      SOFT_ERROR(PI_NO_HANDLE, "no poll job slots");
+   }
 
-   sprintf(name, "/dev/pigpio%d", slot);
+   j = &gpioPoll[slot];
 
-   myCreatePipe(name, 0664);
+   j->handle    = handle;
+   j->pollFlags = pollFlags;
+   j->dev       = devHandle;
+   j->busy      = 0;
+   j->due       = 0;
+   j->txLen     = txLen;
+   j->rxLen     = rxLen;
 
-   fd = open(name, O_RDWR|O_NONBLOCK);
+   memset(j->buf, 0, sizeof(j->buf));
+   if (txLen) memcpy(j->buf, txBuf, txLen);
 
-   if (fd < 0)
+   j->segs[0].flags = 0;
+   j->segs[0].buf   = (uint8_t *)j->buf;
+
+   /* held until the timer is known */
+
+   j->state = PI_POLL_STOPPING;
+
+   pthread_mutex_unlock(&pollMutex);
+
+   timer = gpioTimerStart(micros, 0, pollTimer, j);
+
+   pthread_mutex_lock(&pollMutex);
+
+   if (timer >= 0)
    {
-      gpioNotify[slot].state = PI_NOTIFY_CLOSED;
-      SOFT_ERROR(PI_BAD_PATHNAME, "open %s failed (%m)", name);
+      j->timer = timer;
+      j->state = PI_POLL_RUNNING;
    }
+   else j->state = PI_POLL_FREE;
 
-   gpioNotify[slot].seqno = 0;
-   gpioNotify[slot].bits  = 0;
-   gpioNotify[slot].fd    = fd;
-   gpioNotify[slot].pipe  = 1;
-   gpioNotify[slot].max_emits  = MAX_EMITS;
-   gpioNotify[slot].lastReportTick = gpioTick();
+   pthread_mutex_unlock(&pollMutex);
+
+   if (timer < 0) return timer;
 
    return slot;
 }
 
-
 /* ----------------------------------------------------------------------- */
 
-static int gpioNotifyOpenInBand(int fd)
+int gpioPollStop(unsigned job)
 {
-   int i, slot;
-
-   DBG(DBG_USER, "");
+   DBG(DBG_USER, "job=%d", job);
 
    CHECK_INITED;
 
-   slot = -1;
+   if ((job >= PI_POLL_SLOTS) || (gpioPoll[job].state != PI_POLL_RUNNING))
+      SOFT_ERROR(PI_BAD_HANDLE, "bad poll job (%d)", job);
 
-   for (i=0; i<PI_NOTIFY_SLOTS; i++)
-   {
-      if (gpioNotify[i].state == PI_NOTIFY_CLOSED)
-      {
-         slot = i;
-         break;
-      }
-   }
+   pollStop(&gpioPoll[job]);
 
-   if (slot < 0) SOFT_ERROR(PI_NO_HANDLE, "no handle");
+   return 0;
+}
 
-   gpioNotify[slot].state = PI_NOTIFY_OPENED;
-   gpioNotify[slot].seqno = 0;
-   gpioNotify[slot].bits  = 0;
-   gpioNotify[slot].fd    = fd;
-   gpioNotify[slot].pipe  = 0;
-   gpioNotify[slot].max_emits  = MAX_EMITS;
-   gpioNotify[slot].lastReportTick = gpioTick();
+/* ----------------------------------------------------------------------- */
 
-   return slot;
-}
+static int capCommandFile(char *name, char *path, unsigned size)
+{
+   /*
+   A command may only create a file in PI_CAPTURE_DIR, a plain name
+   without a directory and not starting with a dot.
+   */
 
+   if ((name[0] == 0) || (name[0] == '.') || strchr(name, '/'))
+      SOFT_ERROR(PI_BAD_CAPTURE, "bad capture file name (%s)", name);
+
+   if ((strlen(PI_CAPTURE_DIR) + strlen(name)) >= size)
+      SOFT_ERROR(PI_BAD_CAPTURE, "capture file name too long");
+
+   strcpy(path, PI_CAPTURE_DIR);
+   strcat(path, name);
+
+   return 0;
+}
 
 /* ----------------------------------------------------------------------- */
 
-static void intScriptBits(void)
+int gpioCaptureStart(
+   char *file, uint32_t bits, unsigned kbytes,
+   uint32_t trigBits, uint32_t trigLevels, unsigned preMicros)
 {
-   int i;
-   uint32_t bits;
+   gpioCaptureHeader_t *hdr;
+   uint64_t dataSize;
+   uint32_t indexSize;
+   size_t mapSize, dataOffset;
+   void *map;
+   int fd, err;
 
-   bits = 0;
+   DBG(DBG_USER,
+      "file=%s bits=%08X kbytes=%d trigBits=%08X trigLevels=%08X preMicros=%d",
+      file, bits, kbytes, trigBits, trigLevels, preMicros);
 
-   for (i=0; i<PI_MAX_SCRIPTS; i++)
+   CHECK_INITED;
+
+   if ((file == NULL) || (file[0] == 0))
+      SOFT_ERROR(PI_BAD_CAPTURE, "no file name");
+
+   if (!bits)
+      SOFT_ERROR(PI_BAD_CAPTURE, "no gpios");
+
+   if ((kbytes < PI_MIN_CAPTURE_KB) || (kbytes > PI_MAX_CAPTURE_KB))
+      SOFT_ERROR(PI_BAD_CAPTURE, "bad kbytes (%d)", kbytes);
+
+   if (trigLevels & ~trigBits)
+      SOFT_ERROR(PI_BAD_CAPTURE, "bad trigLevels (%08X)", trigLevels);
+
+   if (preMicros > PI_MAX_CAPTURE_PRE)
+      SOFT_ERROR(PI_BAD_CAPTURE, "bad preMicros (%d)", preMicros);
+
+   if (capState != PI_CAPTURE_IDLE)
+      SOFT_ERROR(PI_CAPTURE_BUSY, "capture already started");
+
+   dataSize  = (uint64_t)kbytes * 1024;
+   indexSize = (dataSize / CAP_INDEX_INTERVAL) + 1;
+
+   dataOffset = sizeof(gpioCaptureHeader_t) +
+      (indexSize * sizeof(gpioCaptureIndex_t));
+
+   dataOffset = (dataOffset + 4095) & ~4095;
+
+   mapSize = dataOffset + dataSize;
+
+   fd = open(file, O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC, 0644);
+
+   if (fd < 0)
+      SOFT_ERROR(PI_BAD_CAPTURE, "can't create %s (%m)", file);
+
+   /* allocate it all now so the writes never fault on a full disk */
+
+   err = posix_fallocate(fd, 0, mapSize);
+
+   if (err)
    {
-      if (gpioScript[i].state == PI_SCRIPT_IN_USE)
-      {
-         bits |= gpioScript[i].waitBits;
-      }
+      close(fd);
+      unlink(file);
+      SOFT_ERROR(PI_BAD_CAPTURE, "can't allocate %s (%s)",
+         file, strerror(err));
    }
 
-   scriptBits = bits;
+   map = mmap(NULL, mapSize, PROT_READ|PROT_WRITE,
+      MAP_SHARED|MAP_POPULATE, fd, 0);
 
-   monitorBits = alertBits | notifyBits | scriptBits | gpioGetSamples.bits;
-}
+   if (map == MAP_FAILED)
+   {
+      close(fd);
+      unlink(file);
+      SOFT_ERROR(PI_BAD_CAPTURE, "can't map %s (%m)", file);
+   }
 
+   hdr = map;
 
-static void intNotifyBits(void)
-{
-   int i;
-   uint32_t bits;
+   hdr->magic         = PI_CAPTURE_MAGIC;
+   hdr->version       = PI_CAPTURE_VERSION;
+   hdr->headerSize    = sizeof(gpioCaptureHeader_t);
+   hdr->bits          = bits;
+   hdr->indexInterval = CAP_INDEX_INTERVAL;
+   hdr->indexSize     = indexSize;
+   hdr->dataOffset    = dataOffset;
+   hdr->dataSize      = dataSize;
 
-   bits = 0;
+   pthread_mutex_lock(&capMutex);
 
-   for (i=0; i<PI_NOTIFY_SLOTS; i++)
+   if (trigBits)
    {
-      if (gpioNotify[i].state == PI_NOTIFY_RUNNING)
+      capPre = malloc(CAP_PRE_SAMPLES * sizeof(capSample_t));
+
+      if (capPre == NULL)
       {
-         bits |= gpioNotify[i].bits;
+         pthread_mutex_unlock(&capMutex);
+         munmap(map, mapSize);
+         close(fd);
+         unlink(file);
+         SOFT_ERROR(PI_BAD_CAPTURE, "can't allocate pre-trigger buffer");
       }
    }
 
-   notifyBits = bits;
+   capFd      = fd;
+   capMap     = map;
+   capMapSize = mapSize;
+   capHdr     = hdr;
+   capIndex   = (gpioCaptureIndex_t *)((char *)map + hdr->headerSize);
+   capData    = (uint8_t *)map + dataOffset;
 
-   monitorBits = alertBits | notifyBits | scriptBits | gpioGetSamples.bits;
-}
+   capBits       = bits;
+   capTrigBits   = trigBits;
+   capTrigLevels = trigLevels;
+   capPreMicros  = preMicros;
 
+   capUsed      = 0;
+   capCount     = 0;
+   capNextIndex = 0;
 
-/* ----------------------------------------------------------------------- */
+   capTick  = systTick64();
+   capLevel = gpioRead_Bits_0_31();
 
-int gpioNotifyBegin(unsigned handle, uint32_t bits)
-{
-   DBG(DBG_USER, "handle=%d bits=%08X", handle, bits);
+   if (trigBits)
+   {
+      capPreTail   = 0;
+      capPreCount  = 0;
+      capBaseTick  = capTick;
+      capBaseLevel = capLevel;
+      capTrigLast  = ((capLevel & trigBits) == trigLevels);
 
-   CHECK_INITED;
+      capState = PI_CAPTURE_ARMED;
+   }
+   else
+   {
+      capLevel &= bits;
 
-   if (handle >= PI_NOTIFY_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+      hdr->startTick  = capTick;
+      hdr->startLevel = capLevel;
 
-   if (gpioNotify[handle].state <= PI_NOTIFY_CLOSING)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+      capState = PI_CAPTURE_RUNNING;
+   }
 
-   gpioNotify[handle].bits  = bits;
+   capSync();
 
-   gpioNotify[handle].state = PI_NOTIFY_RUNNING;
+   capMonitorBits = bits | trigBits;
 
-   intNotifyBits();
+   pthread_mutex_unlock(&capMutex);
+
+   monitorBits = alertBits | notifyBits | scriptBits | gpioGetSamples.bits |
+      capMonitorBits;
 
    return 0;
 }
@@ -10001,23 +16746,19 @@ int gpioNotifyBegin(unsigned handle, uint32_t bits)
 
 /* ----------------------------------------------------------------------- */
 
-int gpioNotifyPause (unsigned handle)
+int gpioCaptureStop(void)
 {
-   DBG(DBG_USER, "handle=%d", handle);
+   DBG(DBG_USER, "");
 
    CHECK_INITED;
 
-   if (handle >= PI_NOTIFY_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
-
-   if (gpioNotify[handle].state <= PI_NOTIFY_CLOSING)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
-
-   gpioNotify[handle].bits  = 0;
+   if (capState == PI_CAPTURE_IDLE)
+      SOFT_ERROR(PI_NOT_CAPTURING, "no capture started");
 
-   gpioNotify[handle].state = PI_NOTIFY_PAUSED;
+   capStop();
 
-   intNotifyBits();
+   monitorBits = alertBits | notifyBits | scriptBits | gpioGetSamples.bits |
+      capMonitorBits;
 
    return 0;
 }
@@ -10025,27 +16766,24 @@ int gpioNotifyPause (unsigned handle)
 
 /* ----------------------------------------------------------------------- */
 
-int gpioNotifyClose(unsigned handle)
+int gpioCaptureStatus(uint32_t *samples, uint32_t *bytes)
 {
-   DBG(DBG_USER, "handle=%d", handle);
-
-   CHECK_INITED;
+   int state;
 
-   if (handle >= PI_NOTIFY_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   DBG(DBG_USER, "samples=%08X bytes=%08X", (uint32_t)samples, (uint32_t)bytes);
 
-   if (gpioNotify[handle].state <= PI_NOTIFY_CLOSING)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   CHECK_INITED;
 
-   gpioNotify[handle].bits  = 0;
+   pthread_mutex_lock(&capMutex);
 
-   gpioNotify[handle].state = PI_NOTIFY_CLOSING;
+   state = capState;
 
-   intNotifyBits();
+   if (samples) *samples = capCount;
+   if (bytes)   *bytes   = capUsed;
 
-   /* actual close done in alert thread */
+   pthread_mutex_unlock(&capMutex);
 
-   return 0;
+   return state;
 }
 
 /* ----------------------------------------------------------------------- */
@@ -10066,13 +16804,13 @@ int gpioTrigger(unsigned gpio, unsigned pulseLen, unsigned level)
       SOFT_ERROR(PI_BAD_PULSELEN,
          "gpio %d, bad pulseLen (%d)", gpio, pulseLen);
 
-   if (level == PI_OFF) *(gpioReg + GPCLR0 + BANK) = BIT;
-   else                 *(gpioReg + GPSET0 + BANK) = BIT;
+   if (level == PI_OFF) GPIO_CLR(BANK, BIT);
+   else                 GPIO_SET(BANK, BIT);
 
    myGpioDelay(pulseLen);
 
-   if (level != PI_OFF) *(gpioReg + GPCLR0 + BANK) = BIT;
-   else                 *(gpioReg + GPSET0 + BANK) = BIT;
+   if (level != PI_OFF) GPIO_CLR(BANK, BIT);
+   else                 GPIO_SET(BANK, BIT);
 
    return 0;
 }
@@ -10096,6 +16834,8 @@ int gpioSetWatchdog(unsigned gpio, unsigned timeout)
    gpioAlert[gpio].timeout = timeout;
    gpioAlert[gpio].tick    = systReg[SYST_CLO];
 
+   if (timeout) wdogBits |= (1<<gpio); else wdogBits &= ~(1<<gpio);
+
    return 0;
 }
 
@@ -10114,7 +16854,8 @@ int gpioSetGetSamplesFunc(gpioGetSamplesFunc_t f, uint32_t bits)
    if (f) gpioGetSamples.bits = bits;
    else   gpioGetSamples.bits = 0;
 
-   monitorBits = alertBits | notifyBits | scriptBits | gpioGetSamples.bits;
+   monitorBits = alertBits | notifyBits | scriptBits | gpioGetSamples.bits |
+      capMonitorBits;
 
    return 0;
 }
@@ -10137,7 +16878,8 @@ int gpioSetGetSamplesFuncEx(gpioGetSamplesFuncEx_t f,
    if (f) gpioGetSamples.bits = bits;
    else   gpioGetSamples.bits = 0;
 
-   monitorBits = alertBits | notifyBits | scriptBits | gpioGetSamples.bits;
+   monitorBits = alertBits | notifyBits | scriptBits | gpioGetSamples.bits |
+      capMonitorBits;
 
    return 0;
 }
@@ -10151,56 +16893,21 @@ static int intGpioSetTimerFunc(unsigned id,
                                int user,
                                void *userdata)
 {
-   pthread_attr_t pthAttr;
+   int err;
 
    DBG(DBG_INTERNAL, "id=%d millis=%d function=%08X user=%d userdata=%08X",
       id, millis, (uint32_t)f, user, (uint32_t)userdata);
 
-   gpioTimer[id].id   = id;
+   err = 0;
 
-   if (f)
-   {
-      gpioTimer[id].func     = f;
-      gpioTimer[id].ex       = user;
-      gpioTimer[id].userdata = userdata;
-      gpioTimer[id].millis   = millis;
-
-      if (!gpioTimer[id].running)
-      {
-         if (pthread_attr_init(&pthAttr))
-            SOFT_ERROR(PI_TIMER_FAILED,
-               "pthread_attr_init failed (%m)");
-
-         if (pthread_attr_setstacksize(&pthAttr, STACK_SIZE))
-            SOFT_ERROR(PI_TIMER_FAILED,
-               "pthread_attr_setstacksize failed (%m)");
-
-         if (pthread_create(
-            &gpioTimer[id].pthId, &pthAttr, pthTimerTick, &gpioTimer[id]))
-               SOFT_ERROR(PI_TIMER_FAILED,
-                  "timer %d, create failed (%m)", id);
-
-         gpioTimer[id].running = 1;
-      }
-   }
-   else
-   {
-      if (gpioTimer[id].running)
-      {
-         /* destroy thread */
+   pthread_mutex_lock(&twMutex);
 
-         if (pthread_cancel(gpioTimer[id].pthId))
-            SOFT_ERROR(PI_TIMER_FAILED, "timer %d, cancel failed (%m)", id);
+   if (f) err = twSet(id, millis * THOUSAND, 0, f, user, userdata);
+   else   twCancel(id);
 
-         if (pthread_join(gpioTimer[id].pthId, NULL))
-            SOFT_ERROR(PI_TIMER_FAILED, "timer %d, join failed (%m)", id);
+   pthread_mutex_unlock(&twMutex);
 
-         gpioTimer[id].running = 0;
-         gpioTimer[id].func    = f;
-      }
-   }
-
-   return 0;
+   return err;
 }
 
 
@@ -10218,9 +16925,7 @@ int gpioSetTimerFunc(unsigned id, unsigned millis, gpioTimerFunc_t f)
    if ((millis < PI_MIN_MS) || (millis > PI_MAX_MS))
       SOFT_ERROR(PI_BAD_MS, "timer %d, bad millis (%d)", id, millis);
 
-   intGpioSetTimerFunc(id, millis, f, 0, NULL);
-
-   return 0;
+   return intGpioSetTimerFunc(id, millis, f, 0, NULL);
 }
 
 
@@ -10240,7 +16945,105 @@ int gpioSetTimerFuncEx(unsigned id, unsigned millis, gpioTimerFuncEx_t f,
    if ((millis < PI_MIN_MS) || (millis > PI_MAX_MS))
       SOFT_ERROR(PI_BAD_MS, "timer %d, bad millis (%d)", id, millis);
 
-   intGpioSetTimerFunc(id, millis, f, 1, userdata);
+   return intGpioSetTimerFunc(id, millis, f, 1, userdata);
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioTimerStart(
+   unsigned micros, unsigned flags, gpioTimerFuncEx_t f, void *userdata)
+{
+   int i, err;
+
+   DBG(DBG_USER, "micros=%u flags=%X function=%08X, userdata=%08X",
+      micros, flags, (uint32_t)f, (uint32_t)userdata);
+
+   CHECK_INITED;
+
+   if ((micros < PI_MIN_TIMER_MICROS) || (micros > PI_MAX_TIMER_MICROS))
+      SOFT_ERROR(PI_BAD_TIMER_MICS, "bad micros (%u)", micros);
+
+   if (flags & ~PI_TIMER_ONESHOT)
+      SOFT_ERROR(PI_BAD_FLAGS, "bad flags (0x%X)", flags);
+
+   if (f == NULL)
+      SOFT_ERROR(PI_TIMER_FAILED, "no function");
+
+   pthread_mutex_lock(&twMutex);
+
+   /* ids up to PI_MAX_TIMER belong to gpioSetTimerFunc */
+
+   for (i=PI_MAX_TIMER+1; i<PI_TIMER_SLOTS; i++)
+   {
+      if (!gpioTimer[i].running && (twCalling != i)) break;
+   }
+
+   if (i < PI_TIMER_SLOTS)
+   {
+      err = twSet(i, micros, flags & PI_TIMER_ONESHOT, f, 1, userdata);
+
+      if (!err) err = i;
+   }
+   else err = PI_NO_HANDLE;
+
+   pthread_mutex_unlock(&twMutex);
+
+   if (err == PI_NO_HANDLE) SOFT_ERROR(PI_NO_HANDLE, "no timer handle");
+
+   return err;
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioTimerCancel(unsigned handle)
+{
+   DBG(DBG_USER, "handle=%d", handle);
+
+   CHECK_INITED;
+
+   if ((handle <= PI_MAX_TIMER) || (handle >= PI_TIMER_SLOTS))
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   pthread_mutex_lock(&twMutex);
+
+   twCancel(handle);
+
+   pthread_mutex_unlock(&twMutex);
+
+   return 0;
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioTimerGetStats(unsigned handle, gpioTimerStats_t *stats)
+{
+   gpioTimer_t *tp;
+
+   DBG(DBG_USER, "handle=%d stats=%08X", handle, (uint32_t)stats);
+
+   CHECK_INITED;
+
+   if (handle >= PI_TIMER_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (stats == NULL)
+      SOFT_ERROR(PI_BAD_POINTER, "null stats");
+
+   tp = &gpioTimer[handle];
+
+   pthread_mutex_lock(&twMutex);
+
+   stats->runs     = tp->runs;
+   stats->overruns = tp->overruns;
+   stats->lateMax  = tp->lateMax;
+
+   if (tp->runs) stats->lateAvg = tp->lateTotal / tp->runs;
+   else          stats->lateAvg = 0;
+
+   pthread_mutex_unlock(&twMutex);
 
    return 0;
 }
@@ -10327,6 +17130,15 @@ int gpioStoreScript(char *script)
 
    status = cmdParseScript(script, &s->script, 0);
 
+   s->code = NULL;
+
+   if ((status == 0) && (!(gpioCfg.internals & PI_CFG_NOSCRIPTCOMPILE)))
+   {
+      /* fall back to interpreting the script if it can't be compiled */
+
+      s->code = scrCompile(s);
+   }
+
    if (status == 0)
    {
       s->request   = PI_SCRIPT_HALT;
@@ -10496,6 +17308,10 @@ int gpioDeleteScript(unsigned script_id)
 
       gpioScript[script_id].script.par = NULL;
 
+      if (gpioScript[script_id].code) free(gpioScript[script_id].code);
+
+      gpioScript[script_id].code = NULL;
+
       gpioScript[script_id].state = PI_SCRIPT_FREE;
 
       return 0;
@@ -10579,7 +17395,7 @@ int gpioWrite_Bits_0_31_Clear(uint32_t bits)
 
    CHECK_INITED;
 
-   *(gpioReg + GPCLR0) = bits;
+   GPIO_CLR(0, bits);
 
    return 0;
 }
@@ -10593,7 +17409,7 @@ int gpioWrite_Bits_32_53_Clear(uint32_t bits)
 
    CHECK_INITED;
 
-   *(gpioReg + GPCLR1) = bits;
+   GPIO_CLR(1, bits);
 
    return 0;
 }
@@ -10607,7 +17423,7 @@ int gpioWrite_Bits_0_31_Set(uint32_t bits)
 
    CHECK_INITED;
 
-   *(gpioReg + GPSET0) = bits;
+   GPIO_SET(0, bits);
 
    return 0;
 }
@@ -10621,7 +17437,143 @@ int gpioWrite_Bits_32_53_Set(uint32_t bits)
 
    CHECK_INITED;
 
-   *(gpioReg + GPSET1) = bits;
+   GPIO_SET(1, bits);
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioGroupOpen(unsigned numGpios, unsigned *gpios)
+{
+   groupInfo_t *g;
+   uint32_t mask;
+   int i, b, v, slot;
+
+   DBG(DBG_USER, "numGpios=%d", numGpios);
+
+   CHECK_INITED;
+
+   if ((numGpios < 1) || (numGpios > PI_MAX_GROUP_GPIOS))
+      SOFT_ERROR(PI_BAD_GROUP, "bad numGpios (%d)", numGpios);
+
+   mask = 0;
+
+   for (i=0; i<numGpios; i++)
+   {
+      if ((gpios[i] > PI_MAX_USER_GPIO) || (mask & (1<<gpios[i])))
+         SOFT_ERROR(PI_BAD_GROUP, "bad or repeated gpio (%d)", gpios[i]);
+
+      mask |= (1<<gpios[i]);
+   }
+
+   /* the slot is reserved by holding groupMutex until it is opened */
+
+   pthread_mutex_lock(&groupMutex);
+
+   slot = -1;
+
+   for (i=0; i<PI_GROUP_SLOTS; i++)
+   {
+      if (groupInfo[i].state == PI_GROUP_CLOSED)
+      {
+         slot = i;
+         break;
+      }
+   }
+
+   if (slot < 0)
+   {
+      pthread_mutex_unlock(&groupMutex);
+      SOFT_ERROR(PI_NO_HANDLE, "no group handles");
+   }
+
+   g = &groupInfo[slot];
+
+   memset(g->scatter, 0, sizeof(g->scatter));
+
+   /* scatter[b][v] is the gpios set by byte b of the value being v */
+
+   for (i=0; i<numGpios; i++)
+   {
+      b = i / 8;
+
+      for (v=0; v<256; v++)
+      {
+         if (v & (1<<(i%8))) g->scatter[b][v] |= (1<<gpios[i]);
+      }
+   }
+
+   g->bytes = (numGpios + 7) / 8;
+   g->mask  = mask;
+
+   g->state = PI_GROUP_OPENED;
+
+   pthread_mutex_unlock(&groupMutex);
+
+   return slot;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioGroupWrite(unsigned handle, uint32_t value)
+{
+   groupInfo_t *g;
+   uint32_t bits;
+
+   DBG(DBG_USER, "handle=%d value=%08X", handle, value);
+
+   CHECK_INITED;
+
+   if (handle >= PI_GROUP_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   g = &groupInfo[handle];
+
+   if (g->state != PI_GROUP_OPENED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   bits = g->scatter[0][value & 0xFF];
+
+   if (g->bytes > 1)
+   {
+      bits |= g->scatter[1][(value >>  8) & 0xFF];
+
+      if (g->bytes > 2)
+      {
+         bits |= g->scatter[2][(value >> 16) & 0xFF];
+         bits |= g->scatter[3][(value >> 24)       ];
+      }
+   }
+
+   GPIO_SET(0, bits);
+   GPIO_CLR(0, g->mask & ~bits);
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioGroupClose(unsigned handle)
+{
+   DBG(DBG_USER, "handle=%d", handle);
+
+   CHECK_INITED;
+
+   if (handle >= PI_GROUP_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   pthread_mutex_lock(&groupMutex);
+
+   if (groupInfo[handle].state != PI_GROUP_OPENED)
+   {
+      pthread_mutex_unlock(&groupMutex);
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   }
+
+   groupInfo[handle].state = PI_GROUP_CLOSED;
+
+   pthread_mutex_unlock(&groupMutex);
 
    return 0;
 }
@@ -10924,6 +17876,16 @@ uint32_t gpioTick(void)
 }
 
 
+/* ----------------------------------------------------------------------- */
+
+uint64_t gpioTick64(void)
+{
+   CHECK_INITED;
+
+   return systTick64();
+}
+
+
 /* ----------------------------------------------------------------------- */
 
 unsigned gpioVersion(void)
@@ -11127,6 +18089,24 @@ int gpioCfgSocketPort(unsigned port)
 }
 
 
+/* ----------------------------------------------------------------------- */
+
+int gpioCfgSocketClients(unsigned maxClients)
+{
+   DBG(DBG_USER, "maxClients=%d", maxClients);
+
+   CHECK_NOT_INITED;
+
+   if ((maxClients < PI_MIN_SOCKET_CLIENTS) ||
+       (maxClients > PI_MAX_SOCKET_CLIENTS))
+      SOFT_ERROR(PI_BAD_SOCK_CLIENTS, "bad maxClients (%d)", maxClients);
+
+   gpioCfg.socketClients = maxClients;
+
+   return 0;
+}
+
+
 /* ----------------------------------------------------------------------- */
 
 int gpioCfgMemAlloc(unsigned memAllocMode)
@@ -124,6 +124,9 @@ gpioGetPWMdutycycle        Get dutycycle setting on a gpio
 gpioServo                  Start/stop servo pulses on a gpio
 gpioGetServoPulsewidth     Get pulsewidth setting on a gpio
 
+gpioPWMBegin               Hold PWM and servo changes
+gpioPWMCommit              Apply held PWM and servo changes together
+
 gpioDelay                  Delay for a number of microseconds
 
 gpioSetAlertFunc           Request a gpio level change callback
@@ -151,6 +154,10 @@ gpioWrite_Bits_32_53_Clear Clear selected gpios in bank 2
 gpioWrite_Bits_0_31_Set    Set selected gpios in bank 1
 gpioWrite_Bits_32_53_Set   Set selected gpios in bank 2
 
+gpioGroupOpen              Open a group of gpios written as one value
+gpioGroupWrite             Write a value to a gpio group
+gpioGroupClose             Close a gpio group
+
 gpioStartThread            Start a new thread
 gpioStopThread             Stop a previously started thread
 
@@ -171,11 +178,23 @@ gpioSetGetSamplesFuncEx    Requests a gpio samples callback, extended
 
 gpioSetTimerFuncEx         Request a regular timed callback, extended
 
+gpioTimerStart             Start a periodic or one-shot microsecond timer
+gpioTimerCancel            Cancel a timer
+gpioTimerGetStats          Get a timer's lateness and overrun counts
+
 gpioNotifyOpen             Request a notification handle
+gpioNotifyFormat           Select the notification report format
 gpioNotifyBegin            Start notifications for selected gpios
 gpioNotifyPause            Pause notifications
 gpioNotifyClose            Close a notification
 
+gpioPollStart              Start reading a device onto a notification
+gpioPollStop               Stop a poll job
+
+gpioCaptureStart           Start capturing gpio changes to a file
+gpioCaptureStop            Stop capturing gpio changes
+gpioCaptureStatus          Get the capture state and size
+
 gpioSerialReadOpen         Opens a gpio for bit bang serial reads
 gpioSerialReadInvert       Configures normal/inverted for serial reads
 gpioSerialRead             Reads bit bang serial data from a gpio
@@ -210,6 +229,11 @@ gpioWaveChain              Transmits a chain of waveforms
 gpioWaveTxBusy             Checks to see if the waveform has ended
 gpioWaveTxStop             Aborts the current waveform
 
+gpioWaveStreamOpen         Starts an unbounded streamed waveform
+gpioWaveStreamWrite        Queues pulses on the streamed waveform
+gpioWaveStreamStatus       Gets queued pulses and underruns
+gpioWaveStreamClose        Ends the streamed waveform
+
 gpioWaveGetMicros          Length in microseconds of the current waveform
 gpioWaveGetHighMicros      Length of longest waveform so far
 gpioWaveGetMaxMicros       Absolute maximum allowed micros
@@ -251,6 +275,10 @@ i2cSegments                Performs multiple I2C transactions
 
 i2cZip                     Performs multiple I2C transactions
 
+i2cQueue                   Queues an I2C transaction
+i2cQueueWait               Waits for a queued I2C transaction
+i2cQueueStats              Gets an I2C bus queue's statistics
+
 bbI2COpen                  Opens gpios for bit banging I2C
 bbI2CClose                 Closes gpios for bit banging I2C
 bbI2CZip                   Performs multiple bit banged I2C transactions
@@ -263,6 +291,7 @@ spiClose                   Closes a SPI device
 spiRead                    Reads bytes from a SPI device
 spiWrite                   Writes bytes to a SPI device
 spiXfer                    Transfers bytes with a SPI device
+spiSegments                Transfers a sequence of SPI segments
 
 SERIAL
 
@@ -276,6 +305,9 @@ serRead                    Reads bytes from a serial device
 
 serDataAvailable           Returns number of bytes ready to be read
 
+serNotifyStart             Start sending received bytes to a notification
+serNotifyStop              Stop sending received bytes
+
 CONFIGURATION
 
 gpioCfgBufferSize          Configure the gpio sample buffer size
@@ -285,6 +317,7 @@ gpioCfgDMAchannels         Configure the DMA channels
 gpioCfgPermissions         Configure the gpio access permissions
 gpioCfgInterfaces          Configure user interfaces
 gpioCfgSocketPort          Configure socket port
+gpioCfgSocketClients       Configure maximum socket clients
 gpioCfgMemAlloc            Configure DMA memory allocation mode
 
 gpioCfgInternals           Configure miscellaneous internals (DEPRECATED)
@@ -300,6 +333,7 @@ gpioCustom2                User custom function 2
 UTILITIES
 
 gpioTick                   Get current tick (microseconds)
+gpioTick64                 Get current 64 bit tick (microseconds)
 
 gpioHardwareRevision       Get hardware revision
 gpioVersion                Get the pigpio version
@@ -335,6 +369,7 @@ OVERVIEW*/
 
 #define PI_ENVPORT "PIGPIO_PORT"
 #define PI_ENVADDR "PIGPIO_ADDR"
+#define PI_ENVCOMPACT "PIGPIO_COMPACT"
 
 #define PI_LOCKFILE "/var/run/pigpio.pid"
 
@@ -371,6 +406,62 @@ typedef struct
    uint32_t level;
 } gpioReport_t;
 
+typedef struct
+{
+   uint16_t seqno;
+   uint16_t flags;
+   uint32_t level;
+   uint64_t tick;
+} gpioReport64_t;
+
+typedef struct
+{
+   uint32_t magic;
+   uint32_t version;
+   uint32_t headerSize;
+   uint32_t state;
+   uint32_t bits;
+   uint32_t startLevel;
+   uint64_t startTick;
+   uint64_t trigTick;
+   uint64_t samples;
+   uint32_t indexInterval;
+   uint32_t indexUsed;
+   uint32_t indexSize;
+   uint32_t pad;
+   uint64_t dataOffset;
+   uint64_t dataSize;
+   uint64_t dataUsed;
+} gpioCaptureHeader_t;
+
+typedef struct
+{
+   uint64_t tick;
+   uint64_t offset;
+   uint32_t level;
+   uint32_t pad;
+} gpioCaptureIndex_t;
+
+typedef struct
+{
+   uint32_t runs;
+   uint32_t overruns;
+   uint32_t lateMax;
+   uint32_t lateAvg;
+} gpioTimerStats_t;
+
+typedef struct
+{
+   uint32_t transactions;
+   uint32_t failed;
+   uint32_t ioctls;
+   uint32_t queued;
+   uint32_t latencyMax;
+   uint32_t latencyAvg;
+   uint32_t bytes;
+   uint32_t bytesPerSec;
+} i2cQueueStats_t;
+
 typedef struct
 {
    uint32_t gpioOn;
@@ -446,6 +537,16 @@ typedef struct
    uint8_t  *buf;  /* pointer to msg data */
 } pi_i2c_msg_t;
 
+typedef struct
+{
+   char     *txBuf; /* NULL sends zeros       */
+   char     *rxBuf; /* NULL discards the data */
+   unsigned len;    /* bytes to transfer      */
+   unsigned baud;   /* 0 for the handle baud  */
+   unsigned delay;  /* micros after segment   */
+   unsigned flags;  /* PI_SPI_SEG_CS_HOLD     */
+} pi_spi_seg_t;
+
 typedef void (*gpioAlertFunc_t)    (int      gpio,
                                     int      level,
                                     uint32_t tick);
@@ -480,6 +581,10 @@ typedef void (*gpioGetSamplesFuncEx_t) (const gpioSample_t *samples,
                                         int                 numSamples,
                                         void               *userdata);
 
+typedef void (*i2cQueueFunc_t)         (int   id,
+                                        int   status,
+                                        void *userdata);
+
 typedef void *(gpioThreadFunc_t) (void *);
 
 
@@ -552,14 +657,68 @@ typedef void *(gpioThreadFunc_t) (void *);
 
 #define PI_NOTIFY_SLOTS  32
 
+#define PI_NTFY_FLAGS_GAP      (1 <<7)
 #define PI_NTFY_FLAGS_ALIVE    (1 <<6)
 #define PI_NTFY_FLAGS_WDOG     (1 <<5)
 #define PI_NTFY_FLAGS_BIT(x) (((x)<<0)&31)
 
+#define PI_NTFY_FLAGS_POLL     (1 <<8)
+#define PI_NTFY_FLAGS_FAIL     (1 <<9)
+#define PI_NTFY_FLAGS_PART(x) (((x)<<10)&0x1C00)
+#define PI_NTFY_FLAGS_SER      (1 <<13)
+
+/* gpioPollStart */
+
+#define PI_POLL_SLOTS 32
+
+#define PI_POLL_MAX_BYTES 32
+
+#define PI_POLL_I2C 0
+#define PI_POLL_SPI 1
+
+/* notification formats */
+
+#define PI_NOTIFY_TICK64  1
+#define PI_NOTIFY_COMPACT 2
+
+#define PI_NOTIFY_FORMATS (PI_NOTIFY_TICK64 | PI_NOTIFY_COMPACT)
+
+/* PI_NOTIFY_COMPACT record codes */
+
+#define PI_NOTIFY_CODE_BITS  6
+#define PI_NOTIFY_CODE_MULTI 32
+#define PI_NOTIFY_CODE_KEY   33
+#define PI_NOTIFY_CODE_FLAGS 34
+
+/* capture files */
+
+#define PI_CAPTURE_MAGIC   0x43474950 /* "PIGC" */
+#define PI_CAPTURE_VERSION 1
+
+#define PI_CAPTURE_IDLE    0
+#define PI_CAPTURE_ARMED   1
+#define PI_CAPTURE_RUNNING 2
+#define PI_CAPTURE_FULL    3
+#define PI_CAPTURE_STOPPED 4
+
+#define PI_CAPTURE_CODE_BITS 6
+#define PI_CAPTURE_MULTI     32
+
+#define PI_MIN_CAPTURE_KB 16
+#define PI_MAX_CAPTURE_KB 1048576
+
+#define PI_MAX_CAPTURE_PRE 60000000
+
+/* where the CAPON command creates its files */
+
+#define PI_CAPTURE_DIR "/opt/pigpio/capture/"
+
 #define PI_WAVE_BLOCKS     4
 #define PI_WAVE_MAX_PULSES (PI_WAVE_BLOCKS * 3000)
 #define PI_WAVE_MAX_CHARS  (PI_WAVE_BLOCKS *  300)
 
+#define PI_WAVE_STREAM_PULSES 4096
+
 #define PI_BB_I2C_MIN_BAUD     50
 #define PI_BB_I2C_MAX_BAUD 500000
 
@@ -604,6 +763,16 @@ typedef void *(gpioThreadFunc_t) (void *);
 #define PI_SPI_SLOTS 16
 #define PI_SER_SLOTS 8
 
+/* serNotifyStart */
+
+#define PI_SER_NO_DELIM 256
+#define PI_SER_MAX_COUNT 1024
+
+/* gpioGroupOpen */
+
+#define PI_GROUP_SLOTS     16
+#define PI_MAX_GROUP_GPIOS 32
+
 #define PI_NUM_I2C_BUS 2
 #define PI_MAX_I2C_ADDR 0x7F
 
@@ -617,6 +786,10 @@ typedef void *(gpioThreadFunc_t) (void *);
 
 #define  PI_I2C_RDRW_IOCTL_MAX_MSGS 42
 
+/* i2cQueue transactions in flight */
+
+#define PI_I2C_QUEUE_SLOTS 256
+
 /* flags for i2cTransaction, pi_i2c_msg_t */
 
 #define PI_I2C_M_WR           0x0000 /* write data */
@@ -643,6 +816,7 @@ typedef void *(gpioThreadFunc_t) (void *);
 
 /* SPI */
 
+#define PI_SPI_FLAGS_NO_DMA(x)  ((x&1)<<22)
 #define PI_SPI_FLAGS_BITLEN(x) ((x&63)<<16)
 #define PI_SPI_FLAGS_RX_LSB(x)  ((x&1)<<15)
 #define PI_SPI_FLAGS_TX_LSB(x)  ((x&1)<<14)
@@ -653,6 +827,12 @@ typedef void *(gpioThreadFunc_t) (void *);
 #define PI_SPI_FLAGS_CSPOLS(x)  ((x&7)<<2)
 #define PI_SPI_FLAGS_MODE(x)    ((x&3))
 
+/* spiSegments */
+
+#define PI_SPI_SEG_CS_HOLD 1
+
+#define PI_SPI_MAX_SEGS 256
+
 /* Longest busy delay */
 
 #define PI_MAX_BUSY_DELAY 100
@@ -672,6 +852,15 @@ typedef void *(gpioThreadFunc_t) (void *);
 #define PI_MIN_MS 10
 #define PI_MAX_MS 60000
 
+/* gpioTimerStart handles, 0-9 are the gpioSetTimerFunc timers */
+
+#define PI_TIMER_SLOTS 4096
+
+#define PI_MIN_TIMER_MICROS 100
+#define PI_MAX_TIMER_MICROS 3600000000U
+
+#define PI_TIMER_ONESHOT 1
+
 #define PI_MAX_SCRIPTS       32
 
 #define PI_MAX_SCRIPT_TAGS   50
@@ -724,6 +913,11 @@ typedef void *(gpioThreadFunc_t) (void *);
 #define PI_MIN_SOCKET_PORT 1024
 #define PI_MAX_SOCKET_PORT 32000
 
+/* socket clients */
+
+#define PI_MIN_SOCKET_CLIENTS 1
+#define PI_MAX_SOCKET_CLIENTS 1024
+
 
 /* ifFlags: */
 
@@ -742,8 +936,9 @@ typedef void *(gpioThreadFunc_t) (void *);
 #define PI_CFG_ALERT_FREQ        4 /* bits 4-7 */
 #define PI_CFG_RT_PRIORITY       (1<<8)
 #define PI_CFG_STATS             (1<<9)
+#define PI_CFG_NOSCRIPTCOMPILE   (1<<10)
 
-#define PI_CFG_ILLEGAL_VAL       (1<<10)
+#define PI_CFG_ILLEGAL_VAL       (1<<11)
 
 /* gpioISR */
 
@@ -932,6 +1127,54 @@ gpioPWM(23, 0);   // Sets gpio23 full off.
 D*/
 
 
+/*F*/
+int gpioPWMBegin(void);
+/*D
+This function holds the PWM and servo changes which follow until
+[*gpioPWMCommit*] is called.
+
+Returns 0 if OK.
+
+Changes made by [*gpioPWM*], [*gpioServo*], [*gpioSetPWMrange*],
+[*gpioSetPWMfrequency*], and by switching a PWM or servo gpio to
+another use are held, whoever makes them.  The settings reported
+by the get functions change at once.
+
+The changes are held until [*gpioPWMCommit*] is called, by anyone.
+If the socket client which sent PWMB disconnects first, its held
+changes are applied when its connection closes, so a client which
+dies part way through cannot hold up PWM for everyone.
+pigs makes a connection per invocation, so give PWMB, the changes,
+and PWMC on one command line (pigs pwmb p 4 64 p 5 192 pwmc).
+
+...
+gpioPWMBegin();
+
+for (i=0; i<16; i++) gpioPWM(led[i], level[i]);
+
+gpioPWMCommit(); // all 16 change at the same PWM cycle
+...
+D*/
+
+
+/*F*/
+int gpioPWMCommit(void);
+/*D
+This function applies the PWM and servo changes held since
+[*gpioPWMBegin*].
+
+Returns the number of DMA table words written (>=0).
+
+The changes take effect together at the start of a PWM cycle of
+every gpio changed, so no cycle mixes old and new settings.  The
+call waits for that cycle, at most one PWM period (for gpios with
+different frequencies the least common multiple of the periods).
+
+Only the DMA table words which change are written, each once.
+Without [*gpioPWMBegin*] each change is applied as it is made.
+D*/
+
+
 /*F*/
 int gpioGetPWMdutycycle(unsigned user_gpio);
 /*D
@@ -1404,6 +1647,84 @@ else
 D*/
 
 
+/*F*/
+int gpioNotifyFormat(unsigned handle, unsigned format);
+/*D
+This function selects the format of the reports sent on a previously
+opened handle.
+
+. .
+handle: >=0, as returned by [*gpioNotifyOpen*]
+format: 0, PI_NOTIFY_TICK64, or PI_NOTIFY_COMPACT
+. .
+
+Returns 0 if OK, otherwise PI_BAD_HANDLE or PI_BAD_NOTIFY_FMT.
+
+The format may only be changed while notifications are not running,
+i.e. before [*gpioNotifyBegin*] or after [*gpioNotifyPause*].
+Reports already queued keep the format they were sent with.
+
+A format of 0 selects the 12 byte gpioReport_t, as described for
+[*gpioNotifyOpen*].  This is the default for every new handle.
+
+PI_NOTIFY_TICK64 selects a 16 byte report with a 64 bit tick.
+
+. .
+typedef struct
+{
+   uint16_t seqno;
+   uint16_t flags;
+   uint32_t level;
+   uint64_t tick;
+} gpioReport64_t;
+. .
+
+seqno, flags, and level are as for gpioReport_t.  tick is the
+number of microseconds since system boot as returned by
+[*gpioTick64*].  It does not wrap.
+
+PI_NOTIFY_COMPACT selects a stream of variable length records, for
+slow links.  A report of one gpio changing a few milliseconds after
+the last takes 2 or 3 bytes rather than 12.  It takes precedence over
+PI_NOTIFY_TICK64.
+
+Each record starts with a value v held 7 bits per byte, least
+significant first, with the top bit of each byte set if another
+follows.  Further values in the record are held the same way.
+
+v >> PI_NOTIFY_CODE_BITS is the microseconds since the previous
+record.  The low PI_NOTIFY_CODE_BITS of v are a code.
+
+. .
+0-31                  the report of a change of that one gpio
+PI_NOTIFY_CODE_MULTI  a report, followed by the xor of the old and
+                      new levels
+PI_NOTIFY_CODE_FLAGS  a report with flags, followed by the flags then
+                      the xor of the old and new levels, or for a
+                      PI_NTFY_FLAGS_POLL or PI_NTFY_FLAGS_SER report
+                      its level, which leaves the levels unchanged
+PI_NOTIFY_CODE_KEY    not a report, followed by the 64 bit tick and
+                      the level (v >> PI_NOTIFY_CODE_BITS is 0)
+. .
+
+A key comes first and then at least every 256 records, and with a gap
+report.  Ticks and levels are relative to the previous record, so
+decoding starts at the first key.  seqno is not sent, it counts the
+reports.
+
+...
+h = gpioNotifyOpen();
+
+if (h >= 0)
+{
+   gpioNotifyFormat(h, PI_NOTIFY_TICK64);
+
+   gpioNotifyBegin(h, 1234);
+}
+...
+D*/
+
+
 /*F*/
 int gpioNotifyBegin(unsigned handle, uint32_t bits);
 /*D
@@ -1435,15 +1756,23 @@ typedef struct
 seqno: starts at 0 each time the handle is opened and then increments
 by one for each report.
 
-flags: two flags are defined, PI_NTFY_FLAGS_WDOG and PI_NTFY_FLAGS_ALIVE.
+flags: three flags are defined, PI_NTFY_FLAGS_WDOG, PI_NTFY_FLAGS_ALIVE,
+and PI_NTFY_FLAGS_GAP.
 If bit 5 is set (PI_NTFY_FLAGS_WDOG) then bits 0-4 of the flags
 indicate a gpio which has had a watchdog timeout; if bit 6 is set
 (PI_NTFY_FLAGS_ALIVE) this indicates a keep alive signal on the
 pipe/socket and is sent once a minute in the absence of other
-notification activity.
+notification activity; if bit 7 is set (PI_NTFY_FLAGS_GAP) the
+reader fell too far behind and reports have been lost.  The level
+of a gap report is the level of the gpios at its tick, and the
+reports which follow it carry on from that tick.  Reports with
+bit 8 set (PI_NTFY_FLAGS_POLL) carry a [*gpioPollStart*] reading
+and reports with bit 13 set (PI_NTFY_FLAGS_SER) carry serial bytes
+sent by [*serNotifyStart*].
 
 tick: the number of microseconds since system boot.  It wraps around
-after 1h12m.
+after 1h12m.  [*gpioNotifyFormat*] selects reports with a 64 bit
+tick which does not wrap.
 
 level: indicates the level of each gpio.  If bit 1<<x is set then
 gpio x is high.
@@ -1498,6 +1827,195 @@ gpioNotifyClose(h);
 D*/
 
 
+/*F*/
+int gpioPollStart(
+   unsigned handle,
+   unsigned pollFlags,
+   unsigned devHandle,
+   unsigned micros,
+   char    *txBuf,
+   unsigned txLen,
+   unsigned rxLen);
+/*D
+This function starts a poll job which reads an I2C or SPI device
+every micros microseconds and sends each reading as reports on a
+notification handle.
+
+. .
+   handle: >=0, as returned by [*gpioNotifyOpen*]
+pollFlags: PI_POLL_I2C or PI_POLL_SPI
+devHandle: >=0, as returned by [*i2cOpen*] or [*spiOpen*]
+   micros: 100-3600000000, the poll period
+    txBuf: the bytes to write first, e.g. a register number
+    txLen: 0-32, the number of bytes to write
+    rxLen: 0-32, the number of bytes to read
+. .
+
+Returns a job id (0-31) if OK, otherwise PI_BAD_HANDLE, PI_BAD_POLL,
+PI_BAD_POINTER, PI_BAD_TIMER_MICS, PI_NO_HANDLE, or PI_INIT_FAILED.
+
+An I2C job writes txLen bytes then reads rxLen bytes from the
+handle's address as one combined transaction on the bus's
+[*i2cQueue*].  An SPI job transfers txLen + rxLen bytes, sending
+txBuf then zeros, and keeps the last rxLen bytes received.  The SPI
+transfers of all jobs are made in turn by one worker thread, so
+neither kind holds up the library's timers.
+
+A reading is sent as (rxLen+3)/4 reports, at least one, while
+notifications are running on the handle.  Each has the
+PI_NTFY_FLAGS_POLL flag with the job id in bits 0-4, the part
+number (0-7) in bits 10-12, the tick when the transfer started and
+up to four reading bytes in level, the first byte in the least
+significant.  A failed transfer is sent as one report with the
+PI_NTFY_FLAGS_FAIL flag and the error code in level.
+
+A period is skipped if the job's previous transfer is still queued.
+The job stops when the notification handle is closed.
+
+...
+char reg = 0x32;
+
+h = gpioNotifyOpen();
+gpioNotifyBegin(h, 0);
+
+i2c = i2cOpen(1, 0x53, 0);
+
+// read 6 bytes from register 0x32 every 10 milliseconds
+
+job = gpioPollStart(h, PI_POLL_I2C, i2c, 10000, &reg, 1, 6);
+...
+D*/
+
+/*F*/
+int gpioPollStop(unsigned job);
+/*D
+This function stops a poll job.
+
+. .
+job: 0-31, as returned by [*gpioPollStart*]
+. .
+
+Returns 0 if OK, otherwise PI_BAD_HANDLE.
+D*/
+
+/*F*/
+int gpioCaptureStart(
+   char *file, uint32_t bits, unsigned kbytes,
+   uint32_t trigBits, uint32_t trigLevels, unsigned preMicros);
+/*D
+This function starts capturing the changes of the selected gpios to
+a new file.  The changes are written by the library as they are
+sampled, no notification pipe or reading process is involved.
+
+. .
+      file: the name of the file to create, it must not exist
+      bits: a bit mask of the gpios (0-31) to capture
+    kbytes: PI_MIN_CAPTURE_KB-PI_MAX_CAPTURE_KB, the data size
+  trigBits: a bit mask of the gpios (0-31) to trigger on, 0 for none
+trigLevels: the trigger levels of the trigBits gpios
+ preMicros: 0-PI_MAX_CAPTURE_PRE, microseconds kept before the trigger
+. .
+
+The file is allocated in full and memory mapped when the capture
+starts.
+
+If trigBits is 0 capture starts at once.  Otherwise the capture is
+armed and starts when the levels of the trigBits gpios become equal
+to trigLevels.  The changes in the preMicros before the trigger are
+kept in memory while armed (at most 65536 of them) and are written
+first.
+
+Capture stops when the file is full, or when [*gpioCaptureStop*] is
+called.
+
+A capture started by the CAPON socket or pipe command (pigs CAPON)
+names a file in PI_CAPTURE_DIR (/opt/pigpio/capture/), which must
+exist.  The name may not contain a / or start with a dot.
+
+Returns 0 if OK, otherwise PI_CAPTURE_BUSY or PI_BAD_CAPTURE.
+
+The file starts with a [*gpioCaptureHeader_t*], all values little
+endian.
+
+. .
+typedef struct
+{
+   uint32_t magic;         // PI_CAPTURE_MAGIC
+   uint32_t version;       // PI_CAPTURE_VERSION
+   uint32_t headerSize;    // bytes, the index follows
+   uint32_t state;         // PI_CAPTURE_ARMED-PI_CAPTURE_STOPPED
+   uint32_t bits;          // gpios captured
+   uint32_t startLevel;    // levels at startTick
+   uint64_t startTick;     // 64 bit tick of startLevel
+   uint64_t trigTick;      // 64 bit tick of the trigger, 0 if none
+   uint64_t samples;       // records written
+   uint32_t indexInterval; // data bytes between index entries
+   uint32_t indexUsed;     // index entries written
+   uint32_t indexSize;     // index entries available
+   uint32_t pad;
+   uint64_t dataOffset;    // file offset of the data
+   uint64_t dataSize;      // data bytes available
+   uint64_t dataUsed;      // data bytes written
+} gpioCaptureHeader_t;
+. .
+
+The header is brought up to date after each batch of samples, so a
+file may be read while being written.  A state of
+PI_CAPTURE_ARMED or PI_CAPTURE_RUNNING in a closed file means the
+capture was not stopped, the data up to dataUsed is still good.
+
+The data is a sequence of records, one for each change.  A record
+starts with a value v held 7 bits per byte, least significant first,
+with the top bit of each byte set if another follows.
+
+v >> PI_CAPTURE_CODE_BITS is the microseconds since the previous
+record (or startTick).  The low PI_CAPTURE_CODE_BITS of v are the
+number of the one gpio which changed, or PI_CAPTURE_MULTI if another
+value follows holding the bit mask of the gpios which changed.
+
+Most records are 1 to 3 bytes.
+
+The index, indexSize [*gpioCaptureIndex_t*] entries, follows the
+header.  An entry is added at the first record at or after every
+indexInterval data bytes, so that reading can start part way through.
+
+. .
+typedef struct
+{
+   uint64_t tick;   // 64 bit tick before the record
+   uint64_t offset; // offset of the record in the data
+   uint32_t level;  // levels before the record
+   uint32_t pad;
+} gpioCaptureIndex_t;
+. .
+D*/
+
+
+/*F*/
+int gpioCaptureStop(void);
+/*D
+This function stops the capture, brings the file header up to date
+and closes the file.
+
+Returns 0 if OK, otherwise PI_NOT_CAPTURING if no capture was started.
+D*/
+
+
+/*F*/
+int gpioCaptureStatus(uint32_t *samples, uint32_t *bytes);
+/*D
+This function returns the state of the capture.
+
+. .
+samples: if not NULL set to the number of changes written
+  bytes: if not NULL set to the number of data bytes written
+. .
+
+Returns PI_CAPTURE_IDLE if no capture was started, otherwise
+PI_CAPTURE_ARMED, PI_CAPTURE_RUNNING, or PI_CAPTURE_FULL.
+D*/
+
+
 /*F*/
 int gpioWaveClear(void);
 /*D
@@ -1665,13 +2183,18 @@ function.
 As many waveforms may be created as there is space available.  The
 wave id is passed to [*gpioWaveTxSend*] to specify the waveform to transmit.
 
+If the same waveform has already been created, and its space has
+not since been reused, its wave id is returned and no more space
+is used.  The wave is then only deleted when [*gpioWaveDelete*] has been
+called once for each time it was created.
+
 Normal usage would be
 
 Step 1. [*gpioWaveClear*] to clear all waveforms and added data.
 
 Step 2. [*gpioWaveAdd**] calls to supply the waveform data.
 
-Step 3. [*gpioWaveCreate*] to create the waveform and get a unique id
+Step 3. [*gpioWaveCreate*] to create the waveform and get its id
 
 Repeat steps 2 and 3 as needed.
 
@@ -1717,6 +2240,9 @@ wave_id: >=0, as returned by [*gpioWaveCreate*]
 
 Wave ids are allocated in order, 0, 1, 2, etc.
 
+A wave id returned more than once by [*gpioWaveCreate*] is only
+deleted by the last of the matching deletes.
+
 Returns 0 if OK, otherwise PI_BAD_WAVE_ID.
 D*/
 
@@ -1735,7 +2261,7 @@ wave_mode: 0 (PI_WAVE_MODE_ONE_SHOT), 1 (PI_WAVE_MODE_REPEAT)
 . .
 
 Returns the number of DMA control blocks in the waveform if OK,
-otherwise PI_BAD_WAVE_ID, or PI_BAD_WAVE_MODE.
+otherwise PI_BAD_WAVE_ID, PI_BAD_WAVE_MODE, or PI_WAVE_STREAMING.
 D*/
 
 
@@ -1756,7 +2282,8 @@ bufSize: the number of bytes in buf
 . .
 
 Returns 0 if OK, otherwise PI_CHAIN_NESTING, PI_CHAIN_LOOP_CNT, PI_BAD_CHAIN_LOOP, PI_BAD_CHAIN_CMD, PI_CHAIN_COUNTER,
-PI_BAD_CHAIN_DELAY, PI_CHAIN_TOO_BIG, or PI_BAD_WAVE_ID.
+PI_BAD_CHAIN_DELAY, PI_CHAIN_TOO_BIG, PI_BAD_WAVE_ID, or
+PI_WAVE_STREAMING.
 
 Each wave is transmitted in the order specified.  A wave may
 occur multiple times per chain.
@@ -1855,6 +2382,115 @@ This function aborts the transmission of the current waveform.
 Returns 0 if OK.
 
 This function is intended to stop a waveform started in repeat mode.
+
+A streamed waveform is closed as if by [*gpioWaveStreamClose*].
+D*/
+
+
+/*F*/
+int gpioWaveStreamOpen(void);
+/*D
+This function starts a streamed waveform.  Any waveform being
+transmitted is stopped.
+
+A streamed waveform has no length limit.  Pulses queued by
+[*gpioWaveStreamWrite*] are copied by a refill thread into a ring of
+DMA control blocks ahead of the DMA engine, which transmits them as
+one continuous waveform.  The stream uses a fixed amount of the wave
+resources however long it runs.
+
+If the queue runs dry the gpios hold their levels until more pulses
+are written (an underrun, see [*gpioWaveStreamStatus*]).
+
+Only one waveform may be streamed at a time.  While it is open
+[*gpioWaveTxSend*] and [*gpioWaveChain*] return PI_WAVE_STREAMING.
+
+Returns 0 if OK, otherwise PI_WAVE_STREAMING, PI_TOO_MANY_CBS,
+PI_TOO_MANY_OOL, PI_NO_WAVEFORM_ID, or PI_INIT_FAILED.
+
+. .
+gpioPulse_t pulse[2];
+
+gpioSetMode(4, PI_OUTPUT);
+
+pulse[0].gpioOn = (1<<4); pulse[0].gpioOff = 0; pulse[0].usDelay = 10;
+pulse[1].gpioOn = 0; pulse[1].gpioOff = (1<<4); pulse[1].usDelay = 90;
+
+gpioWaveStreamOpen();
+
+while (running)
+{
+   // 10 kHz, 10% duty, until stopped
+
+   if (gpioWaveStreamWrite(2, pulse) != 2) time_sleep(0.01);
+}
+
+gpioWaveStreamClose();
+. .
+D*/
+
+
+/*F*/
+int gpioWaveStreamWrite(unsigned numPulses, gpioPulse_t *pulses);
+/*D
+This function queues pulses on the streamed waveform.  It does not
+block.
+
+. .
+numPulses: the number of pulses
+   pulses: an array of pulses
+. .
+
+At most PI_WAVE_STREAM_PULSES pulses are queued.  Pulses are
+transmitted in the order written, each pulse following the previous
+as if they had been added to one waveform by [*gpioWaveAddGeneric*].
+
+Returns the number of pulses queued (which may be less than numPulses
+if the queue is nearly full) if OK, otherwise PI_WAVE_STREAMING if no
+stream is open.
+D*/
+
+
+/*F*/
+int gpioWaveStreamStatus(uint32_t *underruns);
+/*D
+This function returns the number of pulses written to the streamed
+waveform which have not yet finished transmission.
+
+. .
+underruns: if not NULL set to the number of underruns
+. .
+
+An underrun is counted each time transmission resumes after the DMA
+engine ran out of pulses, i.e. each unintended gap in the waveform.
+
+The count includes the whole control block segment being
+transmitted, and the one linked to follow it, until the DMA engine has
+moved past them.  A count of 0 means every pulse written has been
+transmitted and the gpios are holding their final levels.
+
+Returns the queued pulse count if OK, otherwise PI_WAVE_STREAMING if
+no stream is open.
+D*/
+
+
+/*F*/
+int gpioWaveStreamClose(void);
+/*D
+This function stops the streamed waveform immediately and releases
+its resources.  Queued pulses, including those being transmitted,
+are discarded.
+
+To let the written pulses finish first, stop writing and wait for
+[*gpioWaveStreamStatus*] to return 0 before closing.
+
+Returns 0 if OK, otherwise PI_WAVE_STREAMING if no stream is open.
+
+. .
+while (gpioWaveStreamStatus(NULL) > 0) time_sleep(0.001);
+
+gpioWaveStreamClose();
+. .
 D*/
 
 
@@ -1947,6 +2583,12 @@ The serial data is returned in a cyclic buffer and is read using
 
 It is the caller's responsibility to read data from the cyclic buffer
 in a timely fashion.
+
+All the gpios opened for serial reads are decoded together from the
+sampled levels, looking only at the samples where one of them
+changes level.  The gpio's alert function and watchdog are not used
+and each word is available once the sampled levels which include its
+last data bit have been decoded.
 D*/
 
 /*F*/
@@ -2469,23 +3111,134 @@ End
 D*/
 
 /*F*/
-int bbI2COpen(unsigned SDA, unsigned SCL, unsigned baud);
+int i2cQueue(
+   unsigned        handle,
+   pi_i2c_msg_t   *segs,
+   unsigned        numSegs,
+   i2cQueueFunc_t  f,
+   void           *userdata);
 /*D
-This function selects a pair of gpios for bit banging I2C at a
-specified baud rate.
-
-Bit banging I2C allows for certain operations which are not possible
-with the standard I2C driver.
-
-o baud rates as low as 50 
-o repeated starts 
-o clock stretching 
-o I2C on any pair of spare gpios
+This function queues an I2C transaction for the bus of handle and
+returns without waiting for it.
 
 . .
- SDA: 0-31
- SCL: 0-31
-baud: 50-500000
+  handle: >=0, as returned by a call to [*i2cOpen*]
+    segs: an array of I2C segments
+ numSegs: 1-42, the number of I2C segments
+       f: the function to call on completion, or NULL
+userdata: pointer to arbitrary user data
+. .
+
+Returns a transaction id (>=0) if OK, otherwise PI_BAD_HANDLE,
+PI_BAD_POINTER, PI_TOO_MANY_SEGS, or PI_NO_HANDLE (queue full).
+
+The segments are copied but their data buffers must remain valid
+until the transaction completes.
+
+Each bus has a worker thread which joins the transactions queued
+for one handle while it was busy into one I2C_RDWR ioctl of up to 42
+segments, as [*i2cSegments*] does for a single caller.  Joined
+transactions are separated by repeated starts rather than stops.
+Transactions for different handles are never joined, so a device
+which is absent or fails does not fail the transactions of others.
+
+A transaction is never repeated.  The ioctl does not say which
+segment failed, so if a joined ioctl fails every transaction in it
+reports PI_BAD_I2C_SEG.  The handle's transactions are then sent one
+per ioctl until one succeeds, so while a device keeps failing each
+error belongs to the transaction which reports it.  Of a failed
+joined ioctl, the transactions before the failure have taken place
+and those after it have not; queue one again only if it is safe to
+repeat.
+
+On completion f is called from the worker thread with the id, the
+status (the number of segments if OK, otherwise PI_BAD_I2C_SEG) and
+userdata.  The callback should return quickly as the bus waits for
+it.
+
+If f is NULL the transaction keeps its id until its status is
+collected with [*i2cQueueWait*].
+
+...
+pi_i2c_msg_t segs[2];
+char reg=0x32, data[6];
+
+segs[0].addr = 0x53; segs[0].flags = 0; segs[0].len = 1;
+segs[0].buf = &reg;
+segs[1].addr = 0x53; segs[1].flags = PI_I2C_M_RD; segs[1].len = 6;
+segs[1].buf = data;
+
+id = i2cQueue(h, segs, 2, NULL, NULL);
+
+// do something else
+
+if (i2cQueueWait(id, 100) == 2) printf("read %d %d", data[0], data[1]);
+...
+D*/
+
+/*F*/
+int i2cQueueWait(unsigned id, unsigned millis);
+/*D
+This function waits for a transaction queued by [*i2cQueue*]
+without a callback function.
+
+. .
+    id: a transaction id returned by [*i2cQueue*]
+millis: the most milliseconds to wait, 0 to just check
+. .
+
+Returns the transaction status (the number of segments if OK,
+otherwise PI_BAD_I2C_SEG), or PI_I2C_PENDING if it has not completed,
+or PI_BAD_HANDLE.
+
+Once the status has been returned the id is released.
+D*/
+
+/*F*/
+int i2cQueueStats(unsigned i2cBus, i2cQueueStats_t *stats);
+/*D
+This function returns the statistics of an I2C bus queue.
+
+. .
+i2cBus: 0-1
+ stats: where to store the statistics
+. .
+
+Returns 0 if OK, otherwise PI_BAD_I2C_BUS or PI_BAD_POINTER.
+
+. .
+typedef struct
+{
+   uint32_t transactions; // completed transactions
+   uint32_t failed;       // of which failed
+   uint32_t ioctls;       // I2C_RDWR calls made
+   uint32_t queued;       // transactions waiting now
+   uint32_t latencyMax;   // micros from queueing to completion
+   uint32_t latencyAvg;
+   uint32_t bytes;        // data bytes transferred
+   uint32_t bytesPerSec;  // while the bus was busy
+} i2cQueueStats_t;
+. .
+D*/
+
+/*F*/
+int bbI2COpen(unsigned SDA, unsigned SCL, unsigned baud);
+/*D
+This function selects a pair of gpios for bit banging I2C at a
+specified baud rate.
+
+Bit banging I2C allows for certain operations which are not possible
+with the standard I2C driver.
+
+o baud rates as low as 50 
+o repeated starts 
+o clock stretching 
+o I2C on any pair of spare gpios
+
+. .
+ SDA: 0-31
+ SCL: 0-31
+baud: 50-500000
 . .
 
 Returns 0 if OK, otherwise PI_BAD_USER_GPIO, PI_BAD_I2C_BAUD, or
@@ -2602,11 +3355,11 @@ spiFlags: see below
 Returns a handle (>=0) if OK, otherwise PI_BAD_SPI_CHANNEL,
 PI_BAD_SPI_SPEED, PI_BAD_FLAGS, PI_NO_AUX_SPI, or PI_SPI_OPEN_FAILED.
 
-spiFlags consists of the least significant 22 bits.
+spiFlags consists of the least significant 23 bits.
 
 . .
-21 20 19 18 17 16 15 14 13 12 11 10  9  8  7  6  5  4  3  2  1  0
- b  b  b  b  b  b  R  T  n  n  n  n  W  A u2 u1 u0 p2 p1 p0  m  m
+22 21 20 19 18 17 16 15 14 13 12 11 10  9  8  7  6  5  4  3  2  1  0
+ D  b  b  b  b  b  b  R  T  n  n  n  n  W  A u2 u1 u0 p2 p1 p0  m  m
 . .
 
 mm defines the SPI mode.
@@ -2646,6 +3399,12 @@ device only.
 bbbbbb defines the word size in bits (0-32).  The default (0)
 sets 8 bits per word.  Auxiliary SPI device only.
 
+D is 1 to always poll the SPI FIFO.  By default (0) transfers of 64
+or more bytes are made by DMA on the secondary DMA channel (see
+[*gpioCfgDMAchannels*]) and the caller sleeps until they complete.
+Transfers are polled if a wave is using the secondary channel.
+Standard SPI device, 4-wire only.
+
 The other bits in flags should be set to zero.
 D*/
 
@@ -2713,6 +3472,54 @@ Returns the number of bytes transferred if OK, otherwise
 PI_BAD_HANDLE, PI_BAD_SPI_COUNT, or PI_SPI_XFER_FAILED.
 D*/
 
+/*F*/
+int spiSegments(unsigned handle, pi_spi_seg_t *segs, unsigned numSegs);
+/*D
+This function transfers a sequence of segments with the SPI device
+associated with the handle, back to back.
+
+. .
+ handle: >=0, as returned by a call to [*spiOpen*]
+   segs: an array of SPI segments
+numSegs: 1-256, the number of SPI segments
+. .
+
+Returns the total number of bytes transferred if OK, otherwise
+PI_BAD_HANDLE, PI_BAD_SPI_SEG, PI_BAD_SPI_COUNT, PI_BAD_SPI_SPEED,
+or PI_SPI_XFER_FAILED.
+
+Each segment transfers len bytes from txBuf (zeros if NULL) and
+places the bytes read in rxBuf (discarded if NULL).  A non-zero baud
+overrides the handle's baud for the segment.  The segment is
+followed by a delay of 0-1000000 microseconds.
+
+The chip select is released after each segment unless the segment
+sets PI_SPI_SEG_CS_HOLD in flags, in which case the next segment
+continues with it asserted (the delay is taken with it asserted).
+The chip select is always released after the last segment.
+
+On the socket interface the sequence is one command, collapsing one
+round trip per transfer into one per sequence.
+
+...
+// MCP3008, read channels 0 and 1 as 3 byte transfers
+
+char tx[2][3] = {{1, 0x80, 0}, {1, 0x90, 0}}, rx[2][3];
+pi_spi_seg_t segs[2];
+
+memset(segs, 0, sizeof(segs));
+
+segs[0].txBuf = tx[0]; segs[0].rxBuf = rx[0]; segs[0].len = 3;
+segs[1].txBuf = tx[1]; segs[1].rxBuf = rx[1]; segs[1].len = 3;
+
+if (spiSegments(h, segs, 2) == 6)
+{
+   ch0 = ((rx[0][1]&3)<<8) | rx[0][2];
+   ch1 = ((rx[1][1]&3)<<8) | rx[1][2];
+}
+...
+D*/
+
 
 /*F*/
 int serOpen(char *sertty, unsigned baud, unsigned serFlags);
@@ -2806,6 +3613,10 @@ handle: >=0, as returned by a call to serial_open
 
 Returns the number of bytes read (>0) if OK, otherwise PI_BAD_HANDLE,
 PI_BAD_PARAM, PI_SER_READ_NO_DATA, or PI_SER_WRITE_FAILED.
+
+The bytes come from the buffer the library fills as data arrives.
+PI_SER_READ_FAILED is returned once the buffer is empty after the
+device failed, e.g. a USB adapter was unplugged.
 D*/
 
 
@@ -2823,6 +3634,65 @@ Returns the number of bytes of data available (>=0) if OK,
 otherwise PI_BAD_HANDLE.
 D*/
 
+/*F*/
+int serNotifyStart(
+   unsigned handle, unsigned serHandle, unsigned delim, unsigned count);
+/*D
+This function sends the bytes received on a serial device as reports
+on a notification handle, so they need not be polled for.
+
+. .
+   handle: >=0, as returned by [*gpioNotifyOpen*]
+serHandle: >=0, as returned by [*serOpen*]
+    delim: 0-255, the byte which ends a message, or PI_SER_NO_DELIM
+    count: 0-1024, the number of bytes which is always sent
+. .
+
+Returns 0 if OK, otherwise PI_BAD_HANDLE or PI_BAD_PARAM.
+
+The library reads every open serial device as data arrives and keeps
+up to 4096 bytes per device until they are read by [*serRead*] or
+sent.  Bytes are sent once a delim byte is received, up to and
+including the last delim, or once count bytes are waiting.  With
+no delim and a count of 0 bytes are sent as they arrive.  Bytes
+which have been sent are no longer returned by [*serRead*].
+
+The bytes are sent as reports with the PI_NTFY_FLAGS_SER flag, the
+serial handle in bits 0-4, the number of bytes (1-4) in bits 10-12,
+the tick when they were sent and the bytes in level, the first byte
+in the least significant.  Bytes wait while notifications on the
+handle are paused.
+
+A serial device has one notification handle at a time, a new call
+replaces the previous one.  Sending stops when either handle is
+closed.
+
+...
+h = gpioNotifyOpen();
+gpioNotifyBegin(h, 0);
+
+gps = serOpen("/dev/ttyAMA0", 9600, 0);
+
+// send each NMEA sentence as it is completed
+
+serNotifyStart(h, gps, '\n', 0);
+...
+D*/
+
+
+/*F*/
+int serNotifyStop(unsigned serHandle);
+/*D
+This function stops sending the bytes received on a serial device to
+a notification handle.
+
+. .
+serHandle: >=0, as returned by [*serOpen*]
+. .
+
+Returns 0 if OK, otherwise PI_BAD_HANDLE.
+D*/
+
 
 /*F*/
 int gpioTrigger(unsigned user_gpio, unsigned pulseLen, unsigned level);
@@ -2949,12 +3819,16 @@ millis: 10-60000
 
 Returns 0 if OK, otherwise PI_BAD_TIMER, PI_BAD_MS, or PI_TIMER_FAILED.
 
-10 timers are supported numbered 0 to 9.
+10 timers are supported numbered 0 to 9.  Use [*gpioTimerStart*]
+for more timers or for microsecond periods.
 
 One function may be registered per timer.
 
 The timer may be cancelled by passing NULL as the function.
 
+The first call is made millis milliseconds after registration.
+Registering again restarts the timer.
+
 ...
 void bFunction(void)
 {
@@ -2991,6 +3865,103 @@ See [*gpioSetTimerFunc*] for further details.
 D*/
 
 
+/*F*/
+int gpioTimerStart(
+   unsigned micros, unsigned flags, gpioTimerFuncEx_t f, void *userdata);
+/*D
+Starts a timer which calls f every micros microseconds, or once
+after micros microseconds.
+
+. .
+  micros: 100-3600000000
+   flags: 0 or PI_TIMER_ONESHOT
+       f: the function to call
+userdata: a pointer to arbitrary user data
+. .
+
+Returns a handle (>=10) if OK, otherwise PI_BAD_TIMER_MICS,
+PI_BAD_FLAGS, PI_NO_HANDLE, or PI_TIMER_FAILED.
+
+The function is passed the userdata pointer.
+
+Up to PI_TIMER_SLOTS-10 timers may be running.  All timers, including
+those of [*gpioSetTimerFunc*], are driven by one thread from the
+monotonic clock in steps of 100 microseconds, so they are unaffected
+by changes to the system time.
+
+A periodic timer keeps to its original schedule.  If a call is so late
+that whole periods have passed those calls are skipped and counted as
+overruns (see [*gpioTimerGetStats*]).
+
+A one-shot timer's handle is released once its function returns.
+
+The functions are called one at a time, a function which takes a
+long time delays the others.
+
+...
+void aFunction(void *userdata)
+{
+   // called every 2.5 ms
+}
+
+h = gpioTimerStart(2500, 0, aFunction, NULL);
+...
+D*/
+
+
+/*F*/
+int gpioTimerCancel(unsigned handle);
+/*D
+Cancels a timer started by [*gpioTimerStart*].
+
+. .
+handle: >=10, as returned by [*gpioTimerStart*]
+. .
+
+Returns 0 if OK, otherwise PI_BAD_HANDLE.
+
+If the timer's function is running in another thread this function
+waits for it to return.  It may also be called from the timer's
+own function.
+D*/
+
+
+/*F*/
+int gpioTimerGetStats(unsigned handle, gpioTimerStats_t *stats);
+/*D
+Gets the statistics of a timer.
+
+. .
+handle: 0-9 for a [*gpioSetTimerFunc*] timer, otherwise as returned
+        by [*gpioTimerStart*]
+ stats: where to store the statistics
+. .
+
+Returns 0 if OK, otherwise PI_BAD_HANDLE or PI_BAD_POINTER.
+
+. .
+typedef struct
+{
+   uint32_t runs;
+   uint32_t overruns;
+   uint32_t lateMax;
+   uint32_t lateAvg;
+} gpioTimerStats_t;
+. .
+
+runs: the number of times the function has been called.
+
+overruns: the number of periodic calls skipped because the timer
+was more than a whole period late.
+
+lateMax, lateAvg: the largest and average number of microseconds
+between when a call was due and when it was made.
+
+The statistics are reset when a timer is started, and remain
+readable after it is cancelled until its handle is reused.
+D*/
+
+
 /*F*/
 pthread_t *gpioStartThread(gpioThreadFunc_t f, void *arg);
 /*D
@@ -3268,6 +4239,71 @@ gpioWrite_Bits_32_53_Set((1<<(32-32)) | (1<<(40-32)) | (1<<(53-32)));
 ...
 D*/
 
+/*F*/
+int gpioGroupOpen(unsigned numGpios, unsigned *gpios);
+/*D
+This function opens a group of gpios which may then be written
+together as one value with [*gpioGroupWrite*].
+
+. .
+numGpios: 1-32, the number of gpios in the group
+   gpios: an array of distinct gpios 0-31, the first is value bit 0
+. .
+
+Returns a handle (>=0) if OK, otherwise PI_BAD_GROUP or
+PI_NO_HANDLE.
+
+The gpios may be in any order, so a bus whose lines are scattered
+over the header may be written as if they were adjacent.  The
+gpios are not set as outputs, use [*gpioSetMode*] first.
+
+...
+unsigned bus[8]={7, 8, 25, 24, 23, 18, 15, 14}; // D0-D7
+
+h = gpioGroupOpen(8, bus);
+
+if (h >= 0)
+{
+   gpioGroupWrite(h, 0xA5);
+}
+...
+D*/
+
+/*F*/
+int gpioGroupWrite(unsigned handle, uint32_t value);
+/*D
+This function writes a value to a gpio group.
+
+. .
+handle: >=0, as returned by a call to [*gpioGroupOpen*]
+ value: bit n is written to the group's gpio n
+. .
+
+Returns 0 if OK, otherwise PI_BAD_HANDLE.
+
+Value bits beyond the size of the group are ignored.
+
+The gpios to set and to clear are looked up a byte of value at a
+time in tables built by [*gpioGroupOpen*], then written with one
+store to the set register followed by one store to the clear
+register, so the gpios being set change just before those being
+cleared.
+D*/
+
+/*F*/
+int gpioGroupClose(unsigned handle);
+/*D
+This function closes a gpio group.
+
+. .
+handle: >=0, as returned by a call to [*gpioGroupOpen*]
+. .
+
+Returns 0 if OK, otherwise PI_BAD_HANDLE.
+
+The gpios are left at their last levels.
+D*/
+
 /*F*/
 int gpioHardwareClock(unsigned gpio, unsigned clkfreq);
 /*D
@@ -3458,6 +4494,31 @@ printf("some processing took %d microseconds\n", diffTick);
 D*/
 
 
+/*F*/
+uint64_t gpioTick64(void);
+/*D
+Returns the current system tick as a 64 bit quantity.
+
+Tick is the number of microseconds since system boot.  The low 32
+bits are the same as those returned by [*gpioTick*].
+
+Both halves of the system timer are read so that the result is
+consistent even if the low half wraps during the call.
+
+...
+uint64_t startTick, endTick;
+
+startTick = gpioTick64();
+
+// do some long running processing
+
+endTick = gpioTick64();
+
+printf("processing took %llu microseconds\n", endTick - startTick);
+...
+D*/
+
+
 /*F*/
 unsigned gpioHardwareRevision(void);
 /*D
@@ -3624,6 +4685,26 @@ The default setting is to use port 8888.
 D*/
 
 
+/*F*/
+int gpioCfgSocketClients(unsigned maxClients);
+/*D
+Configures the maximum number of simultaneous socket clients.
+
+. .
+maxClients: 1-1024
+. .
+
+Socket commands are served by a pool of threads which starts small
+and grows while all its threads are busy, up to one per client, so a
+client waiting in a slow command does not hold up the others.
+Connections beyond maxClients are closed as soon as they are
+accepted.  Each notification socket (see
+[*gpioNotifyOpen*]) counts as a client.
+
+The default setting is 64 clients.
+D*/
+
+
 /*F*/
 int gpioCfgInterfaces(unsigned ifFlags);
 /*D
@@ -3989,6 +5070,10 @@ e.g. to select bits 5, 9, 23 you could use (1<<5) | (1<<9) | (1<<23).
 
 A buffer to hold data being sent or being received.
 
+*bytes::
+
+A pointer to a uint32_t to store a count of bytes.
+
 bufSize::
 
 The size in bytes of a buffer.
@@ -4050,6 +5135,13 @@ count::
 The number of bytes to be transferred in an I2C, SPI, or Serial
 command.
 
+For [*serNotifyStart*] the number of waiting bytes which are sent
+without a delimiter, 0-1024.
+
+. .
+PI_SER_MAX_COUNT 1024
+. .
+
 data_bits::1-32
 
 The number of data bits to be used when adding serial data to a
@@ -4066,6 +5158,17 @@ PI_MIN_DMA_CHANNEL 0
 PI_MAX_DMA_CHANNEL 14
 . .
 
+delim::0-256
+
+A byte which ends a serial message, or PI_SER_NO_DELIM for none.
+
+. .
+PI_SER_NO_DELIM 256
+. .
+
+devHandle::
+A handle returned by [*i2cOpen*] or [*spiOpen*].
+
 double::
 
 A floating point number.
@@ -4091,6 +5194,10 @@ f::
 
 A function.
 
+*file::
+
+A pointer to the name of a file.
+
 frequency::0-
 
 The number of times a gpio is swiched on and off per second.  This
@@ -4151,6 +5258,7 @@ One of
 [*gpioCfgInterfaces*] 
 [*gpioCfgInternals*] 
 [*gpioCfgSocketPort*] 
+[*gpioCfgSocketClients*] 
 [*gpioCfgMemAlloc*]
 
 gpioGetSamplesFunc_t::
@@ -4177,6 +5285,14 @@ typedef void (*gpioISRFuncEx_t)
    (int gpio, int level, uint32_t tick, void *userdata);
 . .
 
+gpioCaptureHeader_t::
+
+The header at the start of a capture file, see [*gpioCaptureStart*].
+
+gpioCaptureIndex_t::
+
+An index entry in a capture file, see [*gpioCaptureStart*].
+
 gpioPulse_t::
 . .
 typedef struct
@@ -4221,6 +5337,9 @@ gpioTimerFuncEx_t::
 typedef void (*gpioTimerFuncEx_t) (void *userdata);
 . .
 
+*gpios::
+An array of gpios.
+
 gpioWaveAdd*::
 
 One of
@@ -4234,6 +5353,7 @@ handle::0-
 A number referencing an object opened by one of
 
 [*i2cOpen*] 
+[*gpioGroupOpen*] 
 [*gpioNotifyOpen*] 
 [*serOpen*] 
 [*spiOpen*]
@@ -4249,10 +5369,18 @@ i2cFlags::0
 
 Flags which modify an I2C open command.  None are currently defined.
 
+i2cQueueFunc_t::
+. .
+typedef void (*i2cQueueFunc_t) (int id, int status, void *userdata);
+. .
+
 i2cReg:: 0-255
 
 A register of an I2C device.
 
+id::
+A transaction id returned by [*i2cQueue*].
+
 ifFlags::0-3
 . .
 PI_DISABLE_FIFO_IF 1
@@ -4271,6 +5399,13 @@ A whole number, negative or positive.
 invert::
 A flag used to set normal or inverted bit bang serial data level logic.
 
+job::0-31
+A poll job id returned by [*gpioPollStart*].
+
+kbytes::
+
+A size in units of 1024 bytes.
+
 level::
 The level of a gpio.  Low or High.
 
@@ -4297,6 +5432,9 @@ lVal::0-4294967295 (Hex 0x0-0xFFFFFFFF, Octal 0-37777777777)
 
 A 32-bit word value.
 
+maxClients:: 1-1024
+The maximum number of simultaneous socket clients.  Defaults to 64.
+
 memAllocMode:: 0-2
 
 The DMA memory allocation mode.
@@ -4343,6 +5481,9 @@ The number of bytes used to store characters in a string.  Depending
 on the number of bits per character there may be 1, 2, or 4 bytes
 per character.
 
+numGpios::
+The number of gpios in a group.
+
 numPar:: 0-10
 The number of parameters passed to a script.
 
@@ -4350,7 +5491,8 @@ numPulses::
 The number of pulses to be added to a waveform.
 
 numSegs::
-The number of segments in a combined I2C transaction.
+The number of segments in a combined I2C transaction or a
+sequence of SPI transfers.
 
 offset::
 The associated data starts this number of microseconds from the start of
@@ -4376,12 +5518,36 @@ typedef struct
 } pi_i2c_msg_t;
 . .
 
+pi_spi_seg_t::
+. .
+typedef struct
+{
+   char     *txBuf; // NULL sends zeros
+   char     *rxBuf; // NULL discards the data
+   unsigned len;    // bytes to transfer
+   unsigned baud;   // 0 for the handle baud
+   unsigned delay;  // micros after segment
+   unsigned flags;  // PI_SPI_SEG_CS_HOLD
+} pi_spi_seg_t;
+. .
+
+pollFlags::
+. .
+PI_POLL_I2C 0
+PI_POLL_SPI 1
+. .
+
 port:: 1024-32000
 The port used to bind to the pigpio socket.  Defaults to 8888.
 
 pos::
 The position of an item.
 
+preMicros::0-60000000
+
+The microseconds of gpio changes before a capture trigger which are
+kept.
+
 primaryChannel:: 0-14
 The DMA channel used to time the sampling of gpios and to time servo and
 PWM pulses.
@@ -4503,10 +5669,17 @@ The maximum number of bytes a user customised function should return.
 
 A pointer to a buffer to receive data.
 
+rxLen::0-32
+The number of bytes to read.
+
 SCL::
 
 The user gpio to use for the clock when bit banging I2C.
 
+*samples::
+
+A pointer to a uint32_t to store a count of samples.
+
 *script::
 
 A pointer to the text of a script.
@@ -4534,11 +5707,15 @@ The number of seconds.
 
 *segs::
 
-An array of segments which make up a combined I2C transaction.
+An array of segments which make up a combined I2C transaction
+or a sequence of SPI transfers.
 
 serFlags::
 Flags which modify a serial open command.  None are currently defined.
 
+serHandle::
+A handle returned by [*serOpen*].
+
 *sertty::
 The name of a serial tty device, e.g. /dev/ttyAMA0, /dev/ttyUSB0, /dev/tty1.
 
@@ -4619,10 +5796,21 @@ PI_TIME_RELATIVE 0
 PI_TIME_ABSOLUTE 1
 . .
 
+trigBits::
+
+A mask of the gpios whose levels trigger a capture.
+
+trigLevels::
+
+The levels of the trigBits gpios which trigger a capture.
+
 *txBuf::
 
 An array of bytes to transmit.
 
+txLen::0-32
+The number of bytes to write.
+
 uint32_t::0-0-4,294,967,295 (Hex 0x0-0xFFFFFFFF)
 
 A 32-bit unsigned value.
@@ -4651,6 +5839,10 @@ See [*gpio*].
 
 A pointer to arbitrary user data.  This may be used to identify the instance.
 
+value::
+A value written to a gpio group.  Bit n is written to gpio n of the
+group.
+
 void::
 
 Denoting no parameter is required
@@ -4786,8 +5978,31 @@ PARAMS*/
 #define PI_CMD_CGI   95
 #define PI_CMD_CSI   96
 
+#define PI_CMD_BATCH 97
+
 #define PI_CMD_NOIB  99
 
+#define PI_CMD_NF    100
+#define PI_CMD_T64   101
+#define PI_CMD_CAPON 102
+#define PI_CMD_CAPOFF 103
+#define PI_CMD_CAPST 104
+
+#define PI_CMD_POLLON  105
+#define PI_CMD_POLLOFF 106
+
+#define PI_CMD_SPISG   107
+
+#define PI_CMD_SERNON  108
+#define PI_CMD_SERNOFF 109
+
+#define PI_CMD_PWMB    110
+#define PI_CMD_PWMC    111
+
+#define PI_CMD_GRPO    112
+#define PI_CMD_GRPW    113
+#define PI_CMD_GRPC    114
+
 /*DEF_E*/
 
 /*
@@ -4800,6 +6015,34 @@ The socket should be dedicated to receiving notifications
 after this command is issued.
 */
 
+/*
+PI_CMD_SPISG p1 is the handle and p3 the length of the extension.  The
+extension holds each segment as a 12 byte header followed by len
+bytes of data to send.  The header is len (uint16), flags (uint16),
+baud (uint32), and delay (uint32), little endian.  The response
+extension holds the bytes read by all segments, concatenated.
+*/
+
+/*
+PI_CMD_SERNON p1 is the notification handle, p2 the serial handle,
+and the 8 byte extension holds delim (uint32) and count (uint32).
+*/
+
+/*
+PI_CMD_BATCH only works on the socket interface.
+p1 is the number of commands in the batch and p2 a sequence number
+which is echoed in the response.  The extension holds each command
+as a 16 byte request followed by its own extension.
+
+The commands are executed in order.  The response p1 holds the number
+of commands executed and p3 the length of the response extension (or
+an error).  The response extension holds a 16 byte response for each
+command executed followed by any extension it returned.
+
+Requests may be pipelined, responses on a socket are always returned
+in request order.
+*/
+
 /* pseudo commands */
 
 #define PI_CMD_SCRIPT 800
@@ -4975,6 +6218,18 @@ after this command is issued.
 #define PI_BAD_EDGE        -122 // bad ISR edge value, not 0-2
 #define PI_BAD_ISR_INIT    -123 // bad ISR initialisation
 #define PI_BAD_FOREVER     -124 // loop forever must be last chain command
+#define PI_BAD_SOCK_CLIENTS -125 // socket clients not 1-1024
+#define PI_BAD_BATCH       -126 // bad batch command
+#define PI_BAD_NOTIFY_FMT  -127 // bad notify format or notify running
+#define PI_BAD_TIMER_MICS  -128 // timer micros not 100-3600000000
+#define PI_WAVE_STREAMING  -129 // wave stream open, or not open
+#define PI_BAD_CAPTURE     -130 // bad capture parameter or file
+#define PI_CAPTURE_BUSY    -131 // capture already started
+#define PI_I2C_PENDING     -132 // queued I2C transaction not complete
+#define PI_BAD_POLL        -133 // bad poll job flags or lengths
+#define PI_BAD_SPI_SEG     -134 // bad SPI segment count, delay, or flags
+#define PI_BAD_GROUP       -135 // bad group gpio count, or bad or repeated gpio
+#define PI_NOT_CAPTURING   -136 // no capture started
 
 #define PI_PIGIF_ERR_0    -2000
 #define PI_PIGIF_ERR_99   -2099
@@ -4995,6 +6250,7 @@ after this command is issued.
 #define PI_DEFAULT_DMA_SECONDARY_CHANNEL 5
 #define PI_DEFAULT_SOCKET_PORT           8888
 #define PI_DEFAULT_SOCKET_PORT_STR       "8888"
+#define PI_DEFAULT_SOCKET_CLIENTS        64
 #define PI_DEFAULT_SOCKET_ADDR_STR       "127.0.0.1"
 #define PI_DEFAULT_UPDATE_MASK_R0        0xFFFFFFFF
 #define PI_DEFAULT_UPDATE_MASK_R1        0x03E7CF93
@@ -112,6 +112,9 @@ write                     Write a gpio
 set_PWM_dutycycle         Start/stop PWM pulses on a gpio
 get_PWM_dutycycle         Get PWM dutycycle set on a gpio
 
+PWM_begin                 Hold PWM and servo changes
+PWM_commit                Apply held PWM and servo changes together
+
 set_servo_pulsewidth      Start/Stop servo pulses on a gpio
 get_servo_pulsewidth      Get servo pulsewidth set on a gpio
 
@@ -139,6 +142,10 @@ clear_bank_2              Clear selected gpios in bank 2
 set_bank_1                Set selected gpios in bank 1
 set_bank_2                Set selected gpios in bank 2
 
+group_open                Open a group of gpios written as one value
+group_write               Write a value to a gpio group
+group_close               Close a gpio group
+
 Advanced
 
 get_PWM_real_range        Get underlying PWM range for a gpio
@@ -148,6 +155,10 @@ notify_begin              Start notifications for selected gpios
 notify_pause              Pause notifications
 notify_close              Close a notification
 
+poll_start                Start reading a device onto a notification
+poll_stop                 Stop a poll job
+poll_callback             Call a function with each reading of a device
+
 bb_serial_read_open       Open a gpio for bit bang serial reads
 bb_serial_read            Read bit bang serial data from  a gpio
 bb_serial_read_close      Close a gpio for bit bang serial reads
@@ -227,6 +238,7 @@ spi_close                 Closes a SPI device
 spi_read                  Reads bytes from a SPI device
 spi_write                 Writes bytes to a SPI device
 spi_xfer                  Transfers bytes with a SPI device
+spi_segments              Transfers a sequence of SPI segments
 
 Serial
 
@@ -241,6 +253,10 @@ serial_write_byte         Writes a byte to a serial device
 
 serial_data_available     Returns number of bytes ready to be read
 
+serial_notify_start       Start sending received bytes to a notification
+serial_notify_stop        Stop sending received bytes
+serial_callback           Call a function with received bytes
+
 CUSTOM
 
 custom_1                  User custom function 1
@@ -313,9 +329,38 @@ PI_SCRIPT_FAILED =4
 
 # notification flags
 
+NTFY_FLAGS_GAP   = (1 << 7)
 NTFY_FLAGS_ALIVE = (1 << 6)
 NTFY_FLAGS_WDOG  = (1 << 5)
 NTFY_FLAGS_GPIO  = 31
+NTFY_FLAGS_POLL  = (1 << 8)
+NTFY_FLAGS_FAIL  = (1 << 9)
+NTFY_FLAGS_SER   = (1 << 13)
+
+# serial_notify_start
+
+SER_NO_DELIM = 256
+
+# poll_start
+
+POLL_I2C = 0
+POLL_SPI = 1
+
+# spi_segments flags
+
+SPI_SEG_CS_HOLD = 1
+
+# notification formats
+
+NOTIFY_TICK64  = 1
+NOTIFY_COMPACT = 2
+
+# NOTIFY_COMPACT record codes
+
+_NOTIFY_CODE_BITS  = 6
+_NOTIFY_CODE_MULTI = 32
+_NOTIFY_CODE_KEY   = 33
+_NOTIFY_CODE_FLAGS = 34
 
 # pigpio command numbers
 
@@ -425,6 +470,12 @@ _PI_CMD_CF2  =88
 
 _PI_CMD_NOIB =99
 
+_PI_CMD_NF   =100
+_PI_CMD_T64  =101
+
+_PI_CMD_POLLON =105
+_PI_CMD_POLLOFF=106
+
 _PI_CMD_BI2CC=89
 _PI_CMD_BI2CO=90
 _PI_CMD_BI2CZ=91
@@ -435,6 +486,18 @@ _PI_CMD_WVCHA=93
 
 _PI_CMD_SLRI =94
 
+_PI_CMD_SPISG=107
+
+_PI_CMD_SERNON =108
+_PI_CMD_SERNOFF=109
+
+_PI_CMD_PWMB=110
+_PI_CMD_PWMC=111
+
+_PI_CMD_GRPO=112
+_PI_CMD_GRPW=113
+_PI_CMD_GRPC=114
+
 # pigpio error numbers
 
 _PI_INIT_FAILED     =-1
@@ -559,6 +622,18 @@ PI_CHAIN_NESTING    =-118
 PI_CHAIN_TOO_BIG    =-119
 PI_DEPRECATED       =-120
 PI_BAD_SER_INVERT   =-121
+PI_BAD_SOCK_CLIENTS =-125
+PI_BAD_BATCH        =-126
+PI_BAD_NOTIFY_FMT   =-127
+PI_BAD_TIMER_MICS   =-128
+PI_WAVE_STREAMING   =-129
+PI_BAD_CAPTURE      =-130
+PI_CAPTURE_BUSY     =-131
+PI_I2C_PENDING      =-132
+PI_BAD_POLL         =-133
+PI_BAD_SPI_SEG      =-134
+PI_BAD_GROUP        =-135
+PI_NOT_CAPTURING    =-136
 
 # pigpio error text
 
@@ -682,6 +757,18 @@ _errors=[
    [PI_CHAIN_TOO_BIG     , "chain is too long"],
    [PI_DEPRECATED        , "deprecated function removed"],
    [PI_BAD_SER_INVERT    , "bit bang serial invert not 0 or 1"],
+   [PI_BAD_SOCK_CLIENTS  , "socket clients not 1-1024"],
+   [PI_BAD_BATCH         , "bad batch command"],
+   [PI_BAD_NOTIFY_FMT    , "bad notify format or notify running"],
+   [PI_BAD_TIMER_MICS    , "timer micros not 100-3600000000"],
+   [PI_WAVE_STREAMING    , "wave stream open, or not open"],
+   [PI_BAD_CAPTURE       , "bad capture parameter or file"],
+   [PI_CAPTURE_BUSY      , "capture already started"],
+   [PI_I2C_PENDING       , "queued I2C transaction not complete"],
+   [PI_BAD_POLL          , "bad poll job flags or lengths"],
+   [PI_BAD_SPI_SEG       , "bad SPI segment count, delay, or flags"],
+   [PI_BAD_GROUP         , "bad group gpio count, or bad or repeated gpio"],
+   [PI_NOT_CAPTURING     , "no capture started"],
 
 ]
 
@@ -855,9 +942,25 @@ class _callback_ADT:
       self.func = func
       self.bit = 1<<gpio
 
+def _varint(buf, pos):
+   """
+   Returns the value held 7 bits per byte at buf[pos] and the
+   position after it, or None if buf ends first.
+   """
+   v = 0
+   shift = 0
+   while pos < len(buf):
+      b = buf[pos]
+      pos += 1
+      v |= (b & 0x7F) << shift
+      if not b & 0x80:
+         return v, pos
+      shift += 7
+   return None
+
 class _callback_thread(threading.Thread):
    """A class to encapsulate pigpio notification callbacks."""
-   def __init__(self, control, host, port):
+   def __init__(self, control, host, port, compact=False):
       """Initialises notifications."""
       threading.Thread.__init__(self)
       self.control = control
@@ -866,9 +969,23 @@ class _callback_thread(threading.Thread):
       self.daemon = True
       self.monitor = 0
       self.callbacks = []
+      self.serial = {}
+      self.polls = {}
+      self.poll_lock = threading.Lock()
       self.sl.s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
       self.sl.s.connect((host, port))
-      self.handle = _pigpio_command(self.sl, _PI_CMD_NOIB, 0, 0)
+      # p1 asks for a format, p2 of the reply is the format given
+      # (an earlier daemon echoes the 0 sent)
+      if compact:
+         fmt = NOTIFY_COMPACT
+      else:
+         fmt = 0
+      self.sl.s.send(struct.pack('IIII', _PI_CMD_NOIB, fmt, 0, 0))
+      buf = bytearray()
+      while len(buf) < 16:
+         buf += self.sl.s.recv(16-len(buf))
+      dummy, dummy, given, self.handle = struct.unpack('IIII', buf)
+      self.compact = (given & NOTIFY_COMPACT) != 0
       self.go = True
       self.start()
 
@@ -896,39 +1013,185 @@ class _callback_thread(threading.Thread):
             _pigpio_command(
                self.control, _PI_CMD_NB, self.handle, self.monitor)
 
+   def append_serial(self, callb, delim, count):
+      """Adds a serial callback to the notification thread."""
+      self.serial[callb.ser_handle] = callb
+      # reports only flow once the handle has been started
+      _pigpio_command(self.control, _PI_CMD_NB, self.handle, self.monitor)
+      extents = [struct.pack("II", delim, count)]
+      status = _pigpio_command_ext(
+         self.control, _PI_CMD_SERNON, self.handle, callb.ser_handle, 8,
+         extents)
+      if u2i(status) < 0:
+         del self.serial[callb.ser_handle]
+      return status
+
+   def remove_serial(self, callb):
+      """Removes a serial callback from the notification thread."""
+      if self.serial.get(callb.ser_handle) is callb:
+         del self.serial[callb.ser_handle]
+         _pigpio_command(self.control, _PI_CMD_SERNOFF, callb.ser_handle, 0)
+
+   def append_poll(self, callb, poll_flags, dev_handle, micros, tx_data,
+      rx_count):
+      """Starts a poll job for a poll callback."""
+      # reports only flow once the handle has been started
+      _pigpio_command(self.control, _PI_CMD_NB, self.handle, self.monitor)
+      extents = [struct.pack("III", poll_flags, micros, rx_count), tx_data]
+      # the job is not known until started, the lock holds its reports
+      with self.poll_lock:
+         status = _pigpio_command_ext(
+            self.control, _PI_CMD_POLLON, self.handle, dev_handle,
+            len(tx_data)+12, extents)
+         if u2i(status) >= 0:
+            callb.job = u2i(status)
+            self.polls[callb.job] = callb
+      return status
+
+   def remove_poll(self, callb):
+      """Stops the poll job of a poll callback."""
+      with self.poll_lock:
+         if self.polls.get(callb.job) is callb:
+            del self.polls[callb.job]
+            _pigpio_command(self.control, _PI_CMD_POLLOFF, callb.job, 0)
+
+   def _flush(self):
+      """Passes on the serial bytes of a read."""
+      for cb in list(self.serial.values()):
+         cb._flush()
+
+   def _dispatch(self, flags, tick, level):
+      """Calls the callbacks for one report."""
+      # a gap report carries the level at its tick, treat as a change
+      if flags == 0 or flags & NTFY_FLAGS_GAP:
+         changed = level ^ self.lastLevel
+         self.lastLevel = level
+         for cb in self.callbacks:
+            if cb.bit & changed:
+               newLevel = 0
+               if cb.bit & level:
+                  newLevel = 1
+               if (cb.edge ^ newLevel):
+                   cb.func(cb.gpio, newLevel, tick)
+      elif flags & NTFY_FLAGS_WDOG:
+         gpio = flags & NTFY_FLAGS_GPIO
+         for cb in self.callbacks:
+            if cb.gpio == gpio:
+               cb.func(cb.gpio, TIMEOUT, tick)
+      elif flags & NTFY_FLAGS_SER:
+         cb = self.serial.get(flags & NTFY_FLAGS_GPIO)
+         if cb is not None:
+            # bytes sent together share a tick
+            if cb.tick != tick:
+               cb._flush()
+            cb.data += struct.pack('I', level)[:(flags >> 10) & 7]
+            cb.tick = tick
+      elif flags & NTFY_FLAGS_POLL:
+         with self.poll_lock:
+            cb = self.polls.get(flags & NTFY_FLAGS_GPIO)
+         if cb is not None:
+            if flags & NTFY_FLAGS_FAIL:
+               cb.data = bytearray()
+               cb.func(cb.job, u2i(level), bytearray(), tick)
+            else:
+               part = (flags >> 10) & 7
+               # a part following a lost part is ignored
+               if part == 0:
+                  cb.data = bytearray()
+               if len(cb.data) == (part * 4):
+                  cb.data += struct.pack('I', level)[:cb.rx_count-(part*4)]
+                  if len(cb.data) >= cb.rx_count:
+                     data = cb.data
+                     cb.data = bytearray()
+                     cb.func(cb.job, len(data), data, tick)
+
+   def _run_compact(self):
+      """Decodes NOTIFY_COMPACT records."""
+      buf = bytearray()
+      tick = 0
+      level = 0
+      while self.go:
+         data = self.sl.s.recv(4096)
+         if not data:
+            break
+         buf += data
+         pos = 0
+         while True:
+            r = _varint(buf, pos)
+            if r is None:
+               break
+            v, p = r
+            code = v & ((1 << _NOTIFY_CODE_BITS) - 1)
+            a = b = 0
+            if code >= _NOTIFY_CODE_MULTI:
+               r = _varint(buf, p)
+               if r is None:
+                  break
+               a, p = r
+            if code >= _NOTIFY_CODE_KEY:
+               r = _varint(buf, p)
+               if r is None:
+                  break
+               b, p = r
+            pos = p
+            tick += v >> _NOTIFY_CODE_BITS
+            if code < _NOTIFY_CODE_MULTI:
+               level ^= 1 << code
+               flags = 0
+            elif code == _NOTIFY_CODE_MULTI:
+               level ^= a
+               flags = 0
+            elif code == _NOTIFY_CODE_FLAGS:
+               flags = a
+               # poll and serial reports carry data, not levels
+               if flags & (NTFY_FLAGS_POLL | NTFY_FLAGS_SER):
+                  if self.go:
+                     self._dispatch(flags, tick & 0xFFFFFFFF, b)
+                  continue
+               level ^= b
+            else:
+               if code == _NOTIFY_CODE_KEY:
+                  tick = a
+                  level = b
+               continue
+            if self.go:
+               self._dispatch(flags, tick & 0xFFFFFFFF, level)
+         del buf[:pos]
+         self._flush()
+
    def run(self):
       """Runs the notification thread."""
 
-      lastLevel = _pigpio_command(self.control,  _PI_CMD_BR1, 0, 0)
+      self.lastLevel = _pigpio_command(self.control,  _PI_CMD_BR1, 0, 0)
+
+      if self.compact:
+         self._run_compact()
+         self.sl.s.close()
+         return
 
       MSG_SIZ = 12
 
+      buf = bytearray()
+
       while self.go:
 
-         buf = self.sl.s.recv(MSG_SIZ)
+         data = self.sl.s.recv(4096)
+         if not data:
+            break
+         buf += data
 
-         while self.go and len(buf) < MSG_SIZ:
-            buf += self.sl.s.recv(MSG_SIZ-len(buf))
+         pos = 0
 
-         if self.go:
-            seq, flags, tick, level = (struct.unpack('HHII', buf))
+         while self.go and (len(buf) - pos) >= MSG_SIZ:
+            seq, flags, tick, level = (
+               struct.unpack('HHII', buf[pos:pos+MSG_SIZ]))
 
-            if flags == 0:
-               changed = level ^ lastLevel
-               lastLevel = level
-               for cb in self.callbacks:
-                  if cb.bit & changed:
-                     newLevel = 0
-                     if cb.bit & level:
-                        newLevel = 1
-                     if (cb.edge ^ newLevel):
-                         cb.func(cb.gpio, newLevel, tick)
-            else:
-               if flags & NTFY_FLAGS_WDOG:
-                  gpio = flags & NTFY_FLAGS_GPIO
-                  for cb in self.callbacks:
-                     if cb.gpio == gpio:
-                        cb.func(cb.gpio, TIMEOUT, tick)
+            self._dispatch(flags, tick, level)
+
+            pos += MSG_SIZ
+
+         del buf[:pos]
+         self._flush()
 
       self.sl.s.close()
 
@@ -964,6 +1227,90 @@ class _callback:
       """
       return self.count
 
+class _serial_callback:
+   """A class to provide serial byte callbacks."""
+
+   def __init__(self, notify, ser_handle, delim, count, func=None):
+      """
+      Initialise a serial callback and adds it to the notification thread.
+      """
+      self._notify = notify
+      self.ser_handle = ser_handle
+      self.data = bytearray()
+      self.tick = 0
+      self.lock = threading.Lock()
+      self.stored = bytearray()
+      if func is None:
+         func=self._store
+      self.func = func
+      _u2i(self._notify.append_serial(self, delim, count))
+
+   def cancel(self):
+      """Cancels a serial callback and stops the bytes being sent."""
+      self._notify.remove_serial(self)
+
+   def _flush(self):
+      """Calls the callback with the bytes gathered."""
+      if len(self.data):
+         data = bytes(self.data)
+         self.data = bytearray()
+         self.func(self.ser_handle, data, self.tick)
+
+   def _store(self, ser_handle, data, tick):
+      """Keeps the bytes for read."""
+      with self.lock:
+         self.stored += data
+
+   def read(self):
+      """
+      Returns the bytes kept by the default callback since the
+      last read.
+
+      No bytes are kept if the user has supplied their own
+      callback function.
+      """
+      with self.lock:
+         data = self.stored
+         self.stored = bytearray()
+      return data
+
+class _poll_callback:
+   """A class to provide device reading callbacks."""
+
+   def __init__(self, notify, poll_flags, dev_handle, micros, tx_data,
+      rx_count, func=None):
+      """
+      Initialise a poll callback and starts its job.
+      """
+      self._notify = notify
+      self.job = -1
+      self.rx_count = rx_count
+      self.data = bytearray()
+      self.reading = (0, bytearray())
+      if func is None:
+         func=self._keep
+      self.func = func
+      _u2i(self._notify.append_poll(
+         self, poll_flags, dev_handle, micros, tx_data, rx_count))
+
+   def cancel(self):
+      """Cancels a poll callback and stops its job."""
+      self._notify.remove_poll(self)
+
+   def _keep(self, job, status, data, tick):
+      """Keeps the latest reading."""
+      self.reading = (status, data)
+
+   def read(self):
+      """
+      Returns the latest reading kept by the default callback as
+      a status and bytearray.
+
+      The status is 0 if the user has supplied their own callback
+      function.
+      """
+      return self.reading
+
 class _wait_for_edge:
    """Encapsulates waiting for gpio edges."""
 
@@ -1111,6 +1458,33 @@ class pi():
       return _u2i(_pigpio_command(
          self.sl, _PI_CMD_PWM, user_gpio, int(dutycycle)))
 
+   def PWM_begin(self):
+      """
+      Holds the PWM and servo changes which follow until
+      [*PWM_commit*] is called.  Changes made by any script or
+      client are held.
+
+      ...
+      pi.PWM_begin()
+      for g in leds:
+         pi.set_PWM_dutycycle(g, 128)
+      pi.PWM_commit() # all change at the same PWM cycle
+      ...
+      """
+      return _u2i(_pigpio_command(self.sl, _PI_CMD_PWMB, 0, 0))
+
+   def PWM_commit(self):
+      """
+      Applies the PWM and servo changes held since [*PWM_begin*].
+
+      Returns the number of DMA table words written.
+
+      The changes take effect together at the start of a PWM cycle
+      of every gpio changed.  The call waits for that cycle, at most
+      one PWM period.
+      """
+      return _u2i(_pigpio_command(self.sl, _PI_CMD_PWMC, 0, 0))
+
    def get_PWM_dutycycle(self, user_gpio):
       """
       Returns the PWM dutycycle being used on the gpio.
@@ -1323,12 +1697,15 @@ class pi():
       seqno: starts at 0 each time the handle is opened and then
       increments by one for each report.
 
-      flags: two flags are defined, PI_NTFY_FLAGS_WDOG and
-      PI_NTFY_FLAGS_ALIVE.  If bit 5 is set (PI_NTFY_FLAGS_WDOG)
-      then bits 0-4 of the flags indicate a gpio which has had a
-      watchdog timeout; if bit 6 is set (PI_NTFY_FLAGS_ALIVE) this
-      indicates a keep alive signal on the pipe/socket and is sent
-      once a minute in the absence of other notification activity.
+      flags: three flags are defined, PI_NTFY_FLAGS_WDOG,
+      PI_NTFY_FLAGS_ALIVE, and PI_NTFY_FLAGS_GAP.  If bit 5 is set
+      (PI_NTFY_FLAGS_WDOG) then bits 0-4 of the flags indicate a
+      gpio which has had a watchdog timeout; if bit 6 is set
+      (PI_NTFY_FLAGS_ALIVE) this indicates a keep alive signal on
+      the pipe/socket and is sent once a minute in the absence of
+      other notification activity; if bit 7 is set (PI_NTFY_FLAGS_GAP)
+      the reader fell behind and reports were lost, the level is
+      the level of the gpios at its tick.
 
       tick: the number of microseconds since system boot.  It wraps
       around after 1h12m.
@@ -1365,6 +1742,28 @@ class pi():
       """
       return _u2i(_pigpio_command(self.sl, _PI_CMD_NB, handle, bits))
 
+   def notify_format(self, handle, format):
+      """
+      Selects the format of the reports sent on a handle.
+
+      handle:= >=0 (as returned by a prior call to [*notify_open*])
+      format:= 0, NOTIFY_TICK64, or NOTIFY_COMPACT.
+
+      The format may only be changed while notifications are not
+      running.  With NOTIFY_TICK64 each report is 16 bytes, seqno,
+      flags, level, and a 64 bit tick which does not wrap
+      (struct format "HHIQ").  NOTIFY_COMPACT selects variable
+      length records, see gpioNotifyFormat in pigpio.h.
+
+      ...
+      h = pi.notify_open()
+      if h >= 0:
+         pi.notify_format(h, pigpio.NOTIFY_TICK64)
+         pi.notify_begin(h, 1234)
+      ...
+      """
+      return _u2i(_pigpio_command(self.sl, _PI_CMD_NF, handle, format))
+
    def notify_pause(self, handle):
       """
       Pauses notifications on a handle.
@@ -1404,6 +1803,113 @@ class pi():
       """
       return _u2i(_pigpio_command(self.sl, _PI_CMD_NC, handle, 0))
 
+   def poll_start(self, handle, poll_flags, dev_handle, micros, tx_data,
+      rx_count):
+      """
+      Starts a poll job which reads an I2C or SPI device every
+      micros microseconds and sends each reading as reports on a
+      notification handle.
+
+          handle:= >=0 (as returned by a prior call to [*notify_open*])
+      poll_flags:= POLL_I2C or POLL_SPI.
+      dev_handle:= >=0 (as returned by a prior call to [*i2c_open*]
+                   or [*spi_open*]).
+          micros:= 100-3600000000, the poll period.
+         tx_data:= the bytes to write first, e.g. a register number.
+        rx_count:= 0-32, the number of bytes to read.
+
+      Returns a job id (0-31).
+
+      A reading is sent as (rx_count+3)/4 reports, at least one.
+      Each has the NTFY_FLAGS_POLL flag with the job id in bits
+      0-4, the part number (0-7) in bits 10-12, and up to four
+      reading bytes in level, the first byte in the least
+      significant.  A failed transfer is sent as one report with
+      the NTFY_FLAGS_FAIL flag and the error code in level.  The
+      job stops when the notification handle is closed.
+
+      ...
+      h = pi.notify_open()
+      pi.notify_begin(h, 0)
+
+      acc = pi.i2c_open(1, 0x53)
+
+      # read 6 bytes from register 0x32 every 10 milliseconds
+
+      job = pi.poll_start(h, pigpio.POLL_I2C, acc, 10000, [0x32], 6)
+      ...
+      """
+      # pigpio message format
+
+      # I p1 handle
+      # I p2 dev_handle
+      # I p3 len+12
+      ## extension ##
+      # I poll_flags
+      # I micros
+      # I rx_count
+      # s len tx_data bytes
+      extents = [struct.pack("III", poll_flags, micros, rx_count), tx_data]
+      return _u2i(_pigpio_command_ext(
+         self.sl, _PI_CMD_POLLON, handle, dev_handle, len(tx_data)+12,
+         extents))
+
+   def poll_stop(self, job):
+      """
+      Stops a poll job.
+
+      job:= 0-31 (as returned by a prior call to [*poll_start*]).
+
+      ...
+      pi.poll_stop(job)
+      ...
+      """
+      return _u2i(_pigpio_command(self.sl, _PI_CMD_POLLOFF, job, 0))
+
+   def poll_callback(self, poll_flags, dev_handle, micros, tx_data,
+      rx_count, func=None):
+      """
+      Calls a user supplied function (a callback) with each reading
+      of an I2C or SPI device.
+
+      poll_flags:= POLL_I2C or POLL_SPI.
+      dev_handle:= >=0 (as returned by a prior call to [*i2c_open*]
+                   or [*spi_open*]).
+          micros:= 100-3600000000, the poll period.
+         tx_data:= the bytes to write first, e.g. a register number.
+        rx_count:= 0-32, the number of bytes to read.
+            func:= user supplied callback function.
+
+      The job is started on the callback notification handle by
+      [*poll_start*].
+
+      The user supplied callback receives four parameters, the job
+      id, the status, the reading, and the tick.  The status is the
+      number of bytes read, or the error code if the transfer
+      failed.
+
+      If a user callback is not specified a default callback is
+      provided which keeps the latest reading.  It may be retrieved
+      by calling the read function.
+
+      The callback may be cancelled by calling the cancel function,
+      which also stops the job.
+
+      ...
+      def cbf(job, status, data, tick):
+         print(job, status, data, tick)
+
+      acc = pi.i2c_open(1, 0x53)
+
+      cb1 = pi.poll_callback(pigpio.POLL_I2C, acc, 10000, [0x32], 6, cbf)
+
+      cb1.cancel() # To cancel callback cb1.
+      ...
+      """
+      return _poll_callback(
+         self._notify, poll_flags, dev_handle, micros, tx_data, rx_count,
+         func)
+
    def set_watchdog(self, user_gpio, wdog_timeout):
       """
       Sets a watchdog timeout for a gpio.
@@ -1524,6 +2030,59 @@ class pi():
       """
       return _u2i(_pigpio_command(self.sl, _PI_CMD_BS2, bits, 0))
 
+   def group_open(self, gpios):
+      """
+      Opens a group of gpios which may then be written together as
+      one value with [*group_write*].  Returns a handle (>=0).
+
+      gpios:= a list of 1-32 distinct gpios 0-31, the first is
+              value bit 0.
+
+      The gpios are not set as outputs, use [*set_mode*] first.
+
+      ...
+      h = pi.group_open([7, 8, 25, 24, 23, 18, 15, 14]) # D0-D7
+      ...
+      """
+      # I p1 0
+      # I p2 0
+      # I p3 len
+      ## extension ##
+      # s len gpio bytes
+
+      if len(gpios) < 1 or len(gpios) > 32 or max(gpios) > 31:
+         return _u2i(PI_BAD_GROUP)
+
+      return _u2i(_pigpio_command_ext(
+         self.sl, _PI_CMD_GRPO, 0, 0, len(gpios), [bytearray(gpios)]))
+
+   def group_write(self, handle, value):
+      """
+      Writes a value to a gpio group.
+
+      handle:= >=0 (as returned by a prior call to [*group_open*]).
+       value:= bit n is written to the group's gpio n.
+
+      The group's gpios are set and cleared by one command.
+
+      ...
+      pi.group_write(h, 0xA5)
+      ...
+      """
+      return _u2i(_pigpio_command(self.sl, _PI_CMD_GRPW, handle, value))
+
+   def group_close(self, handle):
+      """
+      Closes a gpio group.
+
+      handle:= >=0 (as returned by a prior call to [*group_open*]).
+
+      ...
+      pi.group_close(h)
+      ...
+      """
+      return _u2i(_pigpio_command(self.sl, _PI_CMD_GRPC, handle, 0))
+
    def hardware_clock(self, gpio, clkfreq):
       """
       Starts a hardware clock on a gpio at the specified frequency.
@@ -1640,6 +2199,29 @@ class pi():
       """
       return _pigpio_command(self.sl, _PI_CMD_TICK, 0, 0)
 
+   def get_current_tick64(self):
+      """
+      Returns the current system tick as a 64 bit quantity.
+
+      Tick is the number of microseconds since system boot.  It
+      does not wrap.
+
+      ...
+      t1 = pi.get_current_tick64()
+      time.sleep(1)
+      t2 = pi.get_current_tick64()
+      ...
+      """
+      # Don't raise exception.  Must release lock.
+      bytes = u2i(_pigpio_command(self.sl, _PI_CMD_T64, 0, 0, False))
+      tick = 0
+      if bytes > 0:
+         data = self._rxbuf(bytes)
+         if bytes == 8:
+            tick = struct.unpack('Q', data)[0]
+      self.sl.l.release()
+      return tick
+
    def get_hardware_revision(self):
       """
       Returns the Pi's hardware revision number.
@@ -2880,11 +3462,11 @@ class pi():
       you will always run on the local Pi use the standard SPI
       module instead.
 
-      spi_flags consists of the least significant 22 bits.
+      spi_flags consists of the least significant 23 bits.
 
       . .
-      21 20 19 18 17 16 15 14 13 12 11 10  9  8  7  6  5  4  3  2  1  0
-       b  b  b  b  b  b  R  T  n  n  n  n  W  A u2 u1 u0 p2 p1 p0  m  m
+      22 21 20 19 18 17 16 15 14 13 12 11 10  9  8  7  6  5  4  3  2  1  0
+       D  b  b  b  b  b  b  R  T  n  n  n  n  W  A u2 u1 u0 p2 p1 p0  m  m
       . .
 
       mm defines the SPI mode.
@@ -2926,6 +3508,11 @@ class pi():
       bbbbbb defines the word size in bits (0-32).  The default (0)
       sets 8 bits per word.  Auxiliary SPI device only.
 
+      D is 1 to always poll the SPI FIFO.  By default (0) transfers of 64
+      or more bytes are made by DMA on the secondary DMA channel (pigpiod
+      -e option) unless a wave is using it.  Standard SPI device, 4-wire
+      only.
+
       The other bits in flags should be set to zero.
 
       ...
@@ -3049,6 +3636,72 @@ class pi():
       self.sl.l.release()
       return bytes, data
 
+   def spi_segments(self, handle, segments):
+      """
+      Transfers a sequence of segments with the SPI device associated
+      with handle, back to back, in one command.
+
+        handle:= >=0 (as returned by a prior call to [*spi_open*]).
+      segments:= a list of 1-256 segments.
+
+      Each segment is a tuple (data, baud, delay, flags) where only
+      data, the bytes to write, is required.  A non-zero baud
+      overrides the handle's baud for the segment.  The segment is
+      followed by a delay of 0-1000000 microseconds.  The chip select
+      is released after each segment unless flags has SPI_SEG_CS_HOLD
+      set.  It is always released after the last segment.
+
+      The returned value is a tuple of the total number of bytes
+      transferred and a list of bytearrays, the bytes read by each
+      segment.  If there was an error the number of bytes will be
+      less than zero (and will contain the error code).
+
+      ...
+      # MCP3008, read channels 0 and 1
+
+      (count, rx) = pi.spi_segments(h, [[1, 0x80, 0], [1, 0x90, 0]])
+
+      # write a register address and hold CS then read 16 bytes at 1 MHz
+
+      (count, rx) = pi.spi_segments(h,
+         [([0x00], 0, 0, pigpio.SPI_SEG_CS_HOLD), (bytes(16), 1000000)])
+      ...
+      """
+      # I p1 handle
+      # I p2 0
+      # I p3 len
+      ## extension ##
+      # for each segment
+      #    H len, H flags, I baud, I delay
+      #    s len data bytes
+
+      ext = bytearray()
+      lens = []
+      for seg in segments:
+         if type(seg) != type(()):
+            seg = (seg,)
+         data = seg[0]
+         if type(data) == type(""):
+            data = _b(data)
+         data = bytearray(data)
+         baud, delay, flags = (tuple(seg[1:]) + (0, 0, 0))[:3]
+         ext.extend(struct.pack('HHII', len(data), flags, baud, delay))
+         ext.extend(data)
+         lens.append(len(data))
+
+      # Don't raise exception.  Must release lock.
+      bytes = u2i(_pigpio_command_ext(
+         self.sl, _PI_CMD_SPISG, handle, 0, len(ext), [ext], False))
+      rx = []
+      if bytes > 0:
+         data = self._rxbuf(bytes)
+         pos = 0
+         for l in lens:
+            rx.append(data[pos:pos+l])
+            pos += l
+      self.sl.l.release()
+      return bytes, rx
+
    def serial_open(self, tty, baud, ser_flags=0):
       """
       Returns a handle for the serial tty device opened
@@ -3191,6 +3844,103 @@ class pi():
       """
       return _u2i(_pigpio_command(self.sl, _PI_CMD_SERDA, handle, 0))
 
+   def serial_notify_start(self, handle, ser_handle, delim=SER_NO_DELIM,
+      count=0):
+      """
+      Sends the bytes received on a serial device as reports on a
+      notification handle, so they need not be polled for.
+
+          handle:= >=0 (as returned by a prior call to [*notify_open*])
+      ser_handle:= >=0 (as returned by a prior call to [*serial_open*]).
+           delim:= 0-255, the byte which ends a message, or
+                   SER_NO_DELIM.
+           count:= 0-1024, the number of bytes which is always sent.
+
+      Bytes are sent once a delim byte is received, up to and
+      including the last delim, or once count bytes are waiting.
+      With no delim and a count of 0 bytes are sent as they arrive.
+      Bytes which have been sent are no longer returned by
+      [*serial_read*].
+
+      The bytes are sent as reports with the NTFY_FLAGS_SER flag,
+      the serial handle in bits 0-4, the number of bytes (1-4) in
+      bits 10-12 and the bytes in level, the first byte in the
+      least significant.  Sending stops when either handle is
+      closed.
+
+      ...
+      h = pi.notify_open()
+      pi.notify_begin(h, 0)
+
+      gps = pi.serial_open("/dev/ttyAMA0", 9600)
+
+      pi.serial_notify_start(h, gps, ord('\\n'))
+      ...
+      """
+      # pigpio message format
+
+      # I p1 handle
+      # I p2 ser_handle
+      # I p3 8
+      ## extension ##
+      # I delim
+      # I count
+      extents = [struct.pack("II", delim, count)]
+      return _u2i(_pigpio_command_ext(
+         self.sl, _PI_CMD_SERNON, handle, ser_handle, 8, extents))
+
+   def serial_notify_stop(self, ser_handle):
+      """
+      Stops sending the bytes received on a serial device to a
+      notification handle.
+
+      ser_handle:= >=0 (as returned by a prior call to [*serial_open*]).
+
+      ...
+      pi.serial_notify_stop(gps)
+      ...
+      """
+      return _u2i(_pigpio_command(self.sl, _PI_CMD_SERNOFF, ser_handle, 0))
+
+   def serial_callback(self, ser_handle, delim=SER_NO_DELIM, count=0,
+      func=None):
+      """
+      Calls a user supplied function (a callback) with the bytes
+      received on a serial device.
+
+      ser_handle:= >=0 (as returned by a prior call to [*serial_open*]).
+           delim:= 0-255, the byte which ends a message, or
+                   SER_NO_DELIM.
+           count:= 0-1024, the number of bytes which is always sent.
+            func:= user supplied callback function.
+
+      The bytes are sent on the callback notification handle by
+      [*serial_notify_start*] with the given delim and count.
+
+      The user supplied callback receives three parameters, the
+      serial handle, the bytes, and the tick.  The bytes sent
+      together are passed in one call.
+
+      If a user callback is not specified a default callback is
+      provided which keeps the bytes.  They may be retrieved by
+      calling the read function.
+
+      The callback may be cancelled by calling the cancel function,
+      which also stops the bytes being sent.
+
+      ...
+      def cbf(ser_handle, data, tick):
+         print(ser_handle, data, tick)
+
+      gps = pi.serial_open("/dev/ttyAMA0", 9600)
+
+      cb1 = pi.serial_callback(gps, ord('\\n'), func=cbf)
+
+      cb1.cancel() # To cancel callback cb1.
+      ...
+      """
+      return _serial_callback(self._notify, ser_handle, delim, count, func)
+
    def gpio_trigger(self, user_gpio, pulse_len=10, level=1):
       """
       Send a trigger pulse to a gpio.  The gpio is set to
@@ -3569,7 +4319,8 @@ class pi():
 
    def __init__(self,
                 host = os.getenv("PIGPIO_ADDR", ''),
-                port = os.getenv("PIGPIO_PORT", 8888)):
+                port = os.getenv("PIGPIO_PORT", 8888),
+                compact = os.getenv("PIGPIO_COMPACT", "0") == "1"):
       """
       Grants access to a Pi's gpios.
 
@@ -3582,6 +4333,12 @@ class pi():
              environment variable.  The pigpio daemon must have been
              started with the same port number.
 
+      compact:= True to feed callbacks from NOTIFY_COMPACT reports,
+                which take a quarter of the bandwidth or less.  The
+                default is False unless the PIGPIO_COMPACT environment
+                variable is 1.  A daemon which does not support them
+                sends the usual reports.
+
       This connects to the pigpio daemon and reserves resources
       to be used for sending commands and receiving notifications.
 
@@ -3606,7 +4363,8 @@ class pi():
 
       try:
          self.sl.s.connect((self._host, self._port))
-         self._notify = _callback_thread(self.sl, self._host, self._port)
+         self._notify = _callback_thread(
+            self.sl, self._host, self._port, compact)
 
       except socket.error:
          self.connected = False
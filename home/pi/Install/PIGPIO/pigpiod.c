@@ -56,6 +56,7 @@ static unsigned ifFlags                = PI_DEFAULT_IF_FLAGS;
 static unsigned DMAprimaryChannel      = PI_DEFAULT_DMA_PRIMARY_CHANNEL;
 static unsigned DMAsecondaryChannel    = PI_DEFAULT_DMA_SECONDARY_CHANNEL;
 static unsigned socketPort             = PI_DEFAULT_SOCKET_PORT;
+static unsigned socketClients          = PI_DEFAULT_SOCKET_CLIENTS;
 static unsigned memAllocMode           = PI_DEFAULT_MEM_ALLOC_MODE;
 static uint64_t updateMask             = -1;
 
@@ -92,6 +93,7 @@ void usage()
       "   -e value, secondary DMA channel, 0-6,         default 5\n" \
       "   -f,       disable fifo interface,             default enabled\n" \
       "   -k,       disable socket interface,           default enabled\n" \
+      "   -n value, maximum socket clients, 1-1024,     default 64\n" \
       "   -p value, socket port, 1024-32000,            default 8888\n" \
       "   -s value, sample rate, 1, 2, 4, 5, 8, or 10,  default 5\n" \
       "   -t value, clock peripheral, 0=PWM 1=PCM,      default PCM\n" \
@@ -119,7 +121,7 @@ static void initOpts(int argc, char *argv[])
    int opt, err, i;
    int64_t mask;
 
-   while ((opt = getopt(argc, argv, "a:b:c:d:e:fkp:s:t:x:")) != -1)
+   while ((opt = getopt(argc, argv, "a:b:c:d:e:fkn:p:s:t:x:")) != -1)
    {
       switch (opt)
       {
@@ -166,6 +168,13 @@ static void initOpts(int argc, char *argv[])
             ifFlags |= PI_DISABLE_SOCK_IF;
             break; 
 
+         case 'n':
+            i = getNum(optarg, &err);
+            if ((i >= PI_MIN_SOCKET_CLIENTS) && (i <= PI_MAX_SOCKET_CLIENTS))
+               socketClients = i;
+            else fatal("invalid -n option (%d)", i);
+            break;
+
          case 'p':
             i = getNum(optarg, &err);
             if ((i >= PI_MIN_SOCKET_PORT) && (i <= PI_MAX_SOCKET_PORT))
@@ -287,6 +296,8 @@ int main(int argc, char **argv)
 
    gpioCfgSocketPort(socketPort);
 
+   gpioCfgSocketClients(socketClients);
+
    gpioCfgMemAlloc(memAllocMode);
 
    if (updateMaskSet) gpioCfgPermissions(updateMask);
@@ -71,6 +71,22 @@ struct callback_s
    callback_t *next;
 };
 
+typedef struct
+{
+   char *buf;   /* queued requests, CMD_MAX_EXTENSION bytes */
+   unsigned len;
+   int count;
+} batch_t;
+
+typedef struct batchReply_s
+{
+   uint32_t seq;
+   int count;
+   int status;
+   int *results;
+   struct batchReply_s *next;
+} batchReply_t;
+
 /* GLOBALS ---------------------------------------------------------------- */
 
 static gpioReport_t gReport[PISCOPE_MAX_REPORTS_PER_READ];
@@ -82,6 +98,8 @@ static int gPigNotify = -1;
 static uint32_t gNotifyBits;
 static uint32_t gLastLevel;
 
+static int gCompact; /* notifications are PI_NOTIFY_COMPACT records */
+
 callback_t *gCallBackFirst = 0;
 callback_t *gCallBackLast = 0;
 
@@ -91,12 +109,132 @@ static pthread_t *pthNotify;
 
 static pthread_mutex_t command_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+static __thread batch_t *tBatch = NULL; /* batch being queued by thread */
+
+static batchReply_t *gBatchReplies = NULL;
+static uint32_t gBatchSeq = 0;
+static int gBatchPending = 0;
+
 /* PRIVATE ---------------------------------------------------------------- */
 
+static int batch_queue
+   (int command, int p1, int p2, int p3,
+    int extents, gpioExtent_t *ext, int rl)
+{
+   cmdCmd_t cmd;
+   unsigned need;
+   int i;
+
+   if (!rl)
+   {
+      /* caller expects to receive data and then unlock */
+      pthread_mutex_lock(&command_mutex);
+      return pigif_batch_unsupported;
+   }
+
+   need = sizeof(cmd);
+
+   for (i=0; i<extents; i++) need += ext[i].size;
+
+   if ((tBatch->len + need) >= CMD_MAX_EXTENSION) return pigif_batch_full;
+
+   cmd.cmd = command;
+   cmd.p1  = p1;
+   cmd.p2  = p2;
+   cmd.p3  = p3;
+
+   memcpy(tBatch->buf + tBatch->len, &cmd, sizeof(cmd));
+   tBatch->len += sizeof(cmd);
+
+   for (i=0; i<extents; i++)
+   {
+      memcpy(tBatch->buf + tBatch->len, ext[i].ptr, ext[i].size);
+      tBatch->len += ext[i].size;
+   }
+
+   return tBatch->count++;
+}
+
+static int batch_stash(int fd, cmdCmd_t *cmd)
+{
+   /* store the reply to a pipelined batch, command_mutex held */
+
+   batchReply_t *r;
+   cmdCmd_t *sub;
+   char *ext = NULL;
+   int i, len, pos;
+
+   gBatchPending--;
+
+   r = malloc(sizeof(batchReply_t));
+
+   if (r == NULL) return pigif_bad_malloc;
+
+   r->seq     = cmd->p2;
+   r->count   = cmd->p1;
+   r->status  = cmd->res;
+   r->results = NULL;
+
+   if (r->status > 0)
+   {
+      len = r->status;
+
+      ext = malloc(len);
+      r->results = malloc(r->count * sizeof(int));
+
+      if ((ext == NULL) || (r->results == NULL) ||
+          (recv(fd, ext, len, MSG_WAITALL) != len))
+      {
+         free(ext);
+         free(r->results);
+         free(r);
+         return pigif_bad_recv;
+      }
+
+      pos = 0;
+
+      for (i=0; (i<r->count) && ((pos + sizeof(cmdCmd_t)) <= len); i++)
+      {
+         sub = (cmdCmd_t *)(ext + pos);
+
+         r->results[i] = sub->res;
+
+         pos += sizeof(cmdCmd_t);
+
+         if (cmdReplyExt(sub->cmd) && (((int)sub->res) > 0)) pos += sub->res;
+      }
+
+      free(ext);
+   }
+
+   r->next = gBatchReplies;
+   gBatchReplies = r;
+
+   return 0;
+}
+
+static int recv_reply(int fd, int command, cmdCmd_t *cmd)
+{
+   while (1)
+   {
+      if (recv(fd, cmd, sizeof(cmdCmd_t), MSG_WAITALL) != sizeof(cmdCmd_t))
+         return pigif_bad_recv;
+
+      /* replies to pipelined batches may arrive first */
+
+      if ((cmd->cmd != PI_CMD_BATCH) || (command == PI_CMD_BATCH)) return 0;
+
+      if (batch_stash(fd, cmd)) return pigif_bad_recv;
+   }
+}
+
 static int pigpio_command(int fd, int command, int p1, int p2, int rl)
 {
    cmdCmd_t cmd;
 
+   if (tBatch && (fd == gPigCommand))
+      return batch_queue(command, p1, p2, 0, 0, NULL, rl);
+
    cmd.cmd = command;
    cmd.p1  = p1;
    cmd.p2  = p2;
@@ -110,7 +248,7 @@ static int pigpio_command(int fd, int command, int p1, int p2, int rl)
       return pigif_bad_send;
    }
 
-   if (recv(fd, &cmd, sizeof(cmd), MSG_WAITALL) != sizeof(cmd))
+   if (recv_reply(fd, command, &cmd))
    {
       pthread_mutex_unlock(&command_mutex);
       return pigif_bad_recv;
@@ -128,6 +266,9 @@ static int pigpio_command_ext
    int i;
    cmdCmd_t cmd;
 
+   if (tBatch && (fd == gPigCommand))
+      return batch_queue(command, p1, p2, p3, extents, ext, rl);
+
    cmd.cmd = command;
    cmd.p1  = p1;
    cmd.p2  = p2;
@@ -150,7 +291,7 @@ static int pigpio_command_ext
       }
    }
 
-   if (recv(fd, &cmd, sizeof(cmd), MSG_WAITALL) != sizeof(cmd))
+   if (recv_reply(fd, command, &cmd))
    {
       pthread_mutex_unlock(&command_mutex);
       return pigif_bad_recv;
@@ -230,7 +371,9 @@ static void dispatch_notification(gpioReport_t *r)
       r->seqno, r->flags, r->level, r->tick);
    */
 
-   if (r->flags == 0)
+   /* a gap report carries the level at its tick, treat as a change */
+
+   if ((r->flags == 0) || (r->flags & PI_NTFY_FLAGS_GAP))
    {
       changed = (r->level ^ gLastLevel) & gNotifyBits;
 
@@ -252,7 +395,7 @@ static void dispatch_notification(gpioReport_t *r)
          p = p->next;
       }
    }
-   else
+   else if (r->flags & PI_NTFY_FLAGS_WDOG)
    {
       g = (r->flags) & 31;
 
@@ -270,12 +413,132 @@ static void dispatch_notification(gpioReport_t *r)
    }
 }
 
+static int get_varint(uint8_t *buf, int len, uint64_t *v)
+{
+   int n, shift;
+
+   *v = 0;
+
+   for (n=0, shift=0; n<len; n++, shift+=7)
+   {
+      *v |= (uint64_t)(buf[n] & 0x7F) << shift;
+
+      if (!(buf[n] & 0x80)) return n + 1;
+   }
+
+   return 0; /* incomplete */
+}
+
+/*
+Decodes the PI_NOTIFY_COMPACT record at buf.  Returns the bytes used,
+0 if the record is incomplete, and sets r if the record is a report.
+*/
+
+static int decode_compact(
+   uint8_t *buf, int len, gpioReport64_t *state, gpioReport_t *r, int *isRep)
+{
+   uint64_t v, a, b;
+   int n, m, code, data;
+
+   a = 0;
+   b = 0;
+   data = 0;
+
+   if (!(n = get_varint(buf, len, &v))) return 0;
+
+   code = v & ((1<<PI_NOTIFY_CODE_BITS) - 1);
+
+   if (code >= PI_NOTIFY_CODE_MULTI)
+   {
+      if (!(m = get_varint(buf+n, len-n, &a))) return 0;
+      n += m;
+   }
+
+   if (code >= PI_NOTIFY_CODE_KEY)
+   {
+      if (!(m = get_varint(buf+n, len-n, &b))) return 0;
+      n += m;
+   }
+
+   *isRep = 1;
+
+   r->flags = 0;
+
+   state->tick += (v >> PI_NOTIFY_CODE_BITS);
+
+   if      (code <  PI_NOTIFY_CODE_MULTI) state->level ^= (1<<code);
+   else if (code == PI_NOTIFY_CODE_MULTI) state->level ^= a;
+   else if (code == PI_NOTIFY_CODE_KEY)
+   {
+      state->tick  = a;
+      state->level = b;
+      *isRep = 0;
+   }
+   else if (code == PI_NOTIFY_CODE_FLAGS)
+   {
+      r->flags = a;
+
+      /* poll and serial reports carry data, not levels */
+
+      if (a & (PI_NTFY_FLAGS_POLL | PI_NTFY_FLAGS_SER)) data = 1;
+      else state->level ^= b;
+   }
+   else *isRep = 0;
+
+   if (*isRep)
+   {
+      r->seqno = state->seqno++;
+      r->tick  = state->tick;
+      r->level = data ? b : state->level;
+   }
+
+   return n;
+}
+
+static void *pthNotifyCompact(void)
+{
+   uint8_t *buf = (uint8_t *)gReport;
+   gpioReport64_t state;
+   gpioReport_t r;
+   int got, bytes, pos, n, isRep;
+
+   memset(&state, 0, sizeof(state));
+
+   got = 0;
+
+   while (1)
+   {
+      bytes = read(gPigNotify, buf+got, sizeof(gReport)-got);
+
+      if (bytes > 0) got += bytes;
+      else break;
+
+      pos = 0;
+
+      while ((n = decode_compact(buf+pos, got-pos, &state, &r, &isRep)))
+      {
+         if (isRep) dispatch_notification(&r);
+
+         pos += n;
+      }
+
+      /* copy any partial record to start of buffer */
+
+      got -= pos;
+
+      if (got && pos) memmove(buf, buf+pos, got);
+   }
+   return 0;
+}
+
 static void *pthNotifyThread(void *x)
 {
    static int got = 0;
 
    int bytes, r;
 
+   if (gCompact) return pthNotifyCompact();
+
    while (1)
    {
       bytes = read(gPigNotify, (char*)&gReport+got, sizeof(gReport)-got);
@@ -436,6 +699,12 @@ char *pigpio_error(int errnum)
             return "failed to create notification thread";
          case pigif_callback_not_found:
             return "callback not found";
+         case pigif_bad_batch:
+            return "no batch open or batch already open";
+         case pigif_batch_full:
+            return "batch is full";
+         case pigif_batch_unsupported:
+            return "command can not be batched";
          default:
             return "unknown error";
       }
@@ -490,6 +759,34 @@ void stop_thread(pthread_t *pth)
    }
 }
 
+static int pigpio_notify(int fd)
+{
+   cmdCmd_t cmd;
+   char *compactStr;
+   unsigned format;
+
+   /* ask for compact reports if wanted, an earlier daemon ignores it */
+
+   compactStr = getenv(PI_ENVCOMPACT);
+
+   if (compactStr && (atoi(compactStr) > 0)) format = PI_NOTIFY_COMPACT;
+   else                                      format = 0;
+
+   cmd.cmd = PI_CMD_NOIB;
+   cmd.p1  = format;
+   cmd.p2  = 0;
+   cmd.res = 0;
+
+   if (send(fd, &cmd, sizeof(cmd), 0) != sizeof(cmd)) return pigif_bad_send;
+
+   if (recv(fd, &cmd, sizeof(cmd), MSG_WAITALL) != sizeof(cmd))
+      return pigif_bad_recv;
+
+   gCompact = (cmd.p2 & PI_NOTIFY_COMPACT) ? 1 : 0;
+
+   return cmd.res;
+}
+
 int pigpio_start(char *addrStr, char *portStr)
 {
    if (!gPigStarted)
@@ -502,7 +799,7 @@ int pigpio_start(char *addrStr, char *portStr)
 
          if (gPigNotify >= 0)
          {
-            gPigHandle = pigpio_command(gPigNotify, PI_CMD_NOIB, 0, 0, 1);
+            gPigHandle = pigpio_notify(gPigNotify);
 
             if (gPigHandle < 0) return pigif_bad_noib;
             else
@@ -614,6 +911,45 @@ int notify_pause(unsigned handle)
 int notify_close(unsigned handle)
    {return pigpio_command(gPigCommand, PI_CMD_NC, handle, 0, 1);}
 
+int notify_format(unsigned handle, unsigned format)
+   {return pigpio_command(gPigCommand, PI_CMD_NF, handle, format, 1);}
+
+int poll_start(
+   unsigned handle, unsigned pollFlags, unsigned devHandle,
+   unsigned micros, char *txBuf, unsigned txLen, unsigned rxLen)
+{
+   gpioExtent_t ext[4];
+
+   /*
+   p1=handle
+   p2=devHandle
+   p3=txLen+12
+   ## extension ##
+   uint32_t pollFlags
+   uint32_t micros
+   uint32_t rxLen
+   char txBuf[txLen]
+   */
+
+   ext[0].size = 4;
+   ext[0].ptr = &pollFlags;
+
+   ext[1].size = 4;
+   ext[1].ptr = &micros;
+
+   ext[2].size = 4;
+   ext[2].ptr = &rxLen;
+
+   ext[3].size = txLen;
+   ext[3].ptr = txBuf;
+
+   return pigpio_command_ext
+      (gPigCommand, PI_CMD_POLLON, handle, devHandle, txLen+12, 4, ext, 1);
+}
+
+int poll_stop(unsigned job)
+   {return pigpio_command(gPigCommand, PI_CMD_POLLOFF, job, 0, 1);}
+
 int set_watchdog(unsigned user_gpio, unsigned timeout)
    {return pigpio_command(gPigCommand, PI_CMD_WDOG, user_gpio, timeout, 1);}
 
@@ -635,6 +971,43 @@ int set_bank_1(uint32_t levels)
 int set_bank_2(uint32_t levels)
    {return pigpio_command(gPigCommand, PI_CMD_BS2, levels, 0, 1);}
 
+int group_open(unsigned numGpios, unsigned *gpios)
+{
+   gpioExtent_t ext[1];
+   char buf[PI_MAX_GROUP_GPIOS];
+   int i;
+
+   /*
+   p1=0
+   p2=0
+   p3=numGpios
+   ## extension ##
+   char gpios[numGpios]
+   */
+
+   if ((numGpios < 1) || (numGpios > PI_MAX_GROUP_GPIOS))
+      return PI_BAD_GROUP;
+
+   for (i=0; i<numGpios; i++)
+   {
+      if (gpios[i] > PI_MAX_USER_GPIO) return PI_BAD_GROUP;
+
+      buf[i] = gpios[i];
+   }
+
+   ext[0].size = numGpios;
+   ext[0].ptr = buf;
+
+   return pigpio_command_ext
+      (gPigCommand, PI_CMD_GRPO, 0, 0, numGpios, 1, ext, 1);
+}
+
+int group_write(unsigned handle, uint32_t value)
+   {return pigpio_command(gPigCommand, PI_CMD_GRPW, handle, value, 1);}
+
+int group_close(unsigned handle)
+   {return pigpio_command(gPigCommand, PI_CMD_GRPC, handle, 0, 1);}
+
 int hardware_clock(unsigned gpio, unsigned frequency)
    {return pigpio_command(gPigCommand, PI_CMD_HC, gpio, frequency, 1);}
 
@@ -880,6 +1253,25 @@ int recvMax(void *buf, int bufsize, int sent)
    return count;
 }
 
+uint64_t get_current_tick64(void)
+{
+   uint64_t tick;
+   int bytes;
+
+   tick = 0;
+
+   bytes = pigpio_command(gPigCommand, PI_CMD_T64, 0, 0, 0);
+
+   if (bytes > 0)
+   {
+      if (recvMax(&tick, sizeof(tick), bytes) != sizeof(tick)) tick = 0;
+   }
+
+   pthread_mutex_unlock(&command_mutex);
+
+   return tick;
+}
+
 int script_status(unsigned script_id, uint32_t *param)
 {
    int status;
@@ -1489,6 +1881,140 @@ int custom_2(unsigned arg1, char *argx, unsigned count,
    return bytes;
 }
 
+int batch_begin(void)
+{
+   if (tBatch) return pigif_bad_batch;
+
+   tBatch = malloc(sizeof(batch_t));
+
+   if (tBatch == NULL) return pigif_bad_malloc;
+
+   tBatch->buf = malloc(CMD_MAX_EXTENSION);
+
+   if (tBatch->buf == NULL)
+   {
+      free(tBatch);
+      tBatch = NULL;
+      return pigif_bad_malloc;
+   }
+
+   tBatch->len   = 0;
+   tBatch->count = 0;
+
+   return 0;
+}
+
+int batch_cancel(void)
+{
+   if (!tBatch) return pigif_bad_batch;
+
+   free(tBatch->buf);
+   free(tBatch);
+   tBatch = NULL;
+
+   return 0;
+}
+
+int batch_send(void)
+{
+   cmdCmd_t cmd;
+   batch_t *b;
+   int seq;
+
+   if (!tBatch) return pigif_bad_batch;
+
+   b = tBatch;
+   tBatch = NULL;
+
+   pthread_mutex_lock(&command_mutex);
+
+   seq = (gBatchSeq++) & 0x7FFFFFFF;
+
+   cmd.cmd = PI_CMD_BATCH;
+   cmd.p1  = b->count;
+   cmd.p2  = seq;
+   cmd.p3  = b->len;
+
+   if ((send(gPigCommand, &cmd, sizeof(cmd), 0) != sizeof(cmd)) ||
+       (send(gPigCommand, b->buf, b->len, 0) != b->len))
+   {
+      seq = pigif_bad_send;
+   }
+   else gBatchPending++;
+
+   pthread_mutex_unlock(&command_mutex);
+
+   free(b->buf);
+   free(b);
+
+   return seq;
+}
+
+int batch_collect(unsigned seq, int *results, unsigned maxResults)
+{
+   batchReply_t *r, **prev;
+   cmdCmd_t cmd;
+   int i, status;
+
+   pthread_mutex_lock(&command_mutex);
+
+   while (1)
+   {
+      for (prev=&gBatchReplies; *prev; prev=&((*prev)->next))
+      {
+         if ((*prev)->seq == seq) break;
+      }
+
+      if (*prev) break;
+
+      if (!gBatchPending)
+      {
+         pthread_mutex_unlock(&command_mutex);
+         return pigif_bad_batch;
+      }
+
+      /* only batch replies can be outstanding */
+
+      if ((recv_reply(gPigCommand, PI_CMD_BATCH, &cmd)) ||
+          (cmd.cmd != PI_CMD_BATCH) ||
+          (batch_stash(gPigCommand, &cmd)))
+      {
+         pthread_mutex_unlock(&command_mutex);
+         return pigif_bad_recv;
+      }
+   }
+
+   r = *prev;
+   *prev = r->next;
+
+   pthread_mutex_unlock(&command_mutex);
+
+   if (r->status < 0) status = r->status;
+   else
+   {
+      status = r->count;
+
+      for (i=0; (i<r->count) && (i<maxResults); i++)
+         results[i] = r->results[i];
+   }
+
+   free(r->results);
+   free(r);
+
+   return status;
+}
+
+int batch_commit(int *results, unsigned maxResults)
+{
+   int seq;
+
+   seq = batch_send();
+
+   if (seq < 0) return seq;
+
+   return batch_collect(seq, results, maxResults);
+}
+
 
 int callback(unsigned user_gpio, unsigned edge, CBFunc_t f)
    {return intCallback(user_gpio, edge, f, 0, 0);}
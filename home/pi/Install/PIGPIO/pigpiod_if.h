@@ -30,7 +30,7 @@ For more information, please refer to <http://unlicense.org/>
 
 #include "pigpio.h"
 
-#define PIGPIOD_IF_VERSION 20
+#define PIGPIOD_IF_VERSION 21
 
 /*TEXT
 
@@ -146,6 +146,10 @@ clear_bank_2               Clear selected gpios in bank 2
 set_bank_1                 Set selected gpios in bank 1
 set_bank_2                 Set selected gpios in bank 2
 
+group_open                 Open a group of gpios written as one value
+group_write                Write a value to a gpio group
+group_close                Close a gpio group
+
 start_thread               Start a new thread
 stop_thread                Stop a previously started thread
 
@@ -154,10 +158,14 @@ ADVANCED
 get_PWM_real_range         Get underlying PWM range for a gpio
 
 notify_open                Request a notification handle
+notify_format              Select the notification report format
 notify_begin               Start notifications for selected gpios
 notify_pause               Pause notifications
 notify_close               Close a notification
 
+poll_start                 Start reading a device onto a notification
+poll_stop                  Stop a poll job
+
 bb_serial_read_open        Opens a gpio for bit bang serial reads
 bb_serial_read             Reads bit bang serial data from a gpio
 bb_serial_read_close       Closes a gpio for bit bang serial reads
@@ -255,6 +263,14 @@ serial_read                Reads bytes from a serial device
 
 serial_data_available      Returns number of bytes ready to be read
 
+BATCHES
+
+batch_begin                Start queuing commands
+batch_commit               Send queued commands and wait for the results
+batch_send                 Send queued commands without waiting
+batch_collect              Wait for the results of a sent batch
+batch_cancel               Discard queued commands
+
 CUSTOM
 
 custom_1                   User custom function 1
@@ -263,6 +279,7 @@ custom_2                   User custom function 2
 UTILITIES
 
 get_current_tick           Get current tick (microseconds)
+get_current_tick64         Get current 64 bit tick (microseconds)
 
 get_hardware_revision      Get hardware revision
 get_pigpio_version         Get the pigpio version
@@ -364,6 +381,11 @@ portStr: specifies the port address used by the Pi running the
          is used unless overridden by the PIGPIO_PORT environment
          variable.
 . .
+
+If the PIGPIO_COMPACT environment variable is 1 callbacks are fed
+from PI_NOTIFY_COMPACT reports (see gpioNotifyFormat), which take a
+quarter of the network bandwidth or less.  A daemon which does not
+support them sends the usual reports.
 D*/
 
 /*F*/
@@ -698,6 +720,31 @@ E.g. if the function returns 15 then the notifications must be
 read from /dev/pigpio15.
 D*/
 
+/*F*/
+int notify_format(unsigned handle, unsigned format);
+/*D
+Select the format of the reports sent on a previously opened handle.
+
+. .
+handle: 0-31 (as returned by [*notify_open*])
+format: 0 or PI_NOTIFY_TICK64
+. .
+
+Returns 0 if OK, otherwise PI_BAD_HANDLE or PI_BAD_NOTIFY_FMT.
+
+The format may only be changed while notifications are not running.
+
+With PI_NOTIFY_TICK64 each notification occupies 16 bytes in the
+fifo as follows:
+
+. .
+H (16 bit) seqno
+H (16 bit) flags
+I (32 bit) level
+Q (64 bit) tick
+. .
+D*/
+
 /*F*/
 int notify_begin(unsigned handle, uint32_t bits);
 /*D
@@ -753,6 +800,48 @@ handle: 0-31 (as returned by [*notify_open*])
 Returns 0 if OK, otherwise PI_BAD_HANDLE.
 D*/
 
+/*F*/
+int poll_start(
+   unsigned handle, unsigned pollFlags, unsigned devHandle,
+   unsigned micros, char *txBuf, unsigned txLen, unsigned rxLen);
+/*D
+This function starts a poll job which reads an I2C or SPI device
+every micros microseconds and sends each reading as reports on a
+notification handle.
+
+. .
+   handle: 0-31 (as returned by [*notify_open*])
+pollFlags: PI_POLL_I2C or PI_POLL_SPI
+devHandle: >=0, as returned by [*i2c_open*] or [*spi_open*]
+   micros: 100-3600000000, the poll period
+    txBuf: the bytes to write first, e.g. a register number
+    txLen: 0-32, the number of bytes to write
+    rxLen: 0-32, the number of bytes to read
+. .
+
+Returns a job id (0-31) if OK, otherwise PI_BAD_HANDLE, PI_BAD_POLL,
+PI_BAD_TIMER_MICS, or PI_NO_HANDLE.
+
+A reading is sent as (rxLen+3)/4 reports, at least one.  Each has
+the PI_NTFY_FLAGS_POLL flag with the job id in bits 0-4, the part
+number (0-7) in bits 10-12, and up to four reading bytes in level,
+the first byte in the least significant.  A failed transfer is sent
+as one report with the PI_NTFY_FLAGS_FAIL flag and the error code
+in level.  The job stops when the notification handle is closed.
+D*/
+
+/*F*/
+int poll_stop(unsigned job);
+/*D
+This function stops a poll job.
+
+. .
+job: 0-31, as returned by [*poll_start*]
+. .
+
+Returns 0 if OK, otherwise PI_BAD_HANDLE.
+D*/
+
 /*F*/
 int set_watchdog(unsigned user_gpio, unsigned timeout);
 /*D
@@ -862,6 +951,52 @@ A status of PI_SOME_PERMITTED indicates that the user is not
 allowed to write to one or more of the gpios.
 D*/
 
+/*F*/
+int group_open(unsigned numGpios, unsigned *gpios);
+/*D
+This function opens a group of gpios which may then be written
+together as one value with [*group_write*].
+
+. .
+numGpios: 1-32, the number of gpios in the group
+   gpios: an array of distinct gpios 0-31, the first is value bit 0
+. .
+
+Returns a handle (>=0) if OK, otherwise PI_BAD_GROUP, PI_NO_HANDLE,
+or PI_NOT_PERMITTED.
+
+The gpios are not set as outputs, use [*set_mode*] first.
+D*/
+
+/*F*/
+int group_write(unsigned handle, uint32_t value);
+/*D
+This function writes a value to a gpio group.
+
+. .
+handle: >=0, as returned by a call to [*group_open*]
+ value: bit n is written to the group's gpio n
+. .
+
+Returns 0 if OK, otherwise PI_BAD_HANDLE.
+
+The group's gpios are set and cleared by one command, the daemon
+writing the set register then the clear register.  Value bits
+beyond the size of the group are ignored.
+D*/
+
+/*F*/
+int group_close(unsigned handle);
+/*D
+This function closes a gpio group.
+
+. .
+handle: >=0, as returned by a call to [*group_open*]
+. .
+
+Returns 0 if OK, otherwise PI_BAD_HANDLE.
+D*/
+
 
 /*F*/
 int hardware_clock(unsigned gpio, unsigned clkfreq);
@@ -958,6 +1093,17 @@ As tick is an unsigned 32 bit quantity it wraps around after
 
 D*/
 
+/*F*/
+uint64_t get_current_tick64(void);
+/*D
+Gets the current system tick as a 64 bit quantity.
+
+Tick is the number of microseconds since system boot.  It does
+not wrap.
+
+Returns 0 if the tick could not be read.
+D*/
+
 /*F*/
 uint32_t get_hardware_revision(void);
 /*D
@@ -2068,11 +2214,11 @@ spi_channel: 0-1 (0-2 for A+/B+/Pi2 auxiliary device).
 Returns a handle (>=0) if OK, otherwise PI_BAD_SPI_CHANNEL,
 PI_BAD_SPI_SPEED, PI_BAD_FLAGS, PI_NO_AUX_SPI, or PI_SPI_OPEN_FAILED.
 
-spi_flags consists of the least significant 22 bits.
+spi_flags consists of the least significant 23 bits.
 
 . .
-21 20 19 18 17 16 15 14 13 12 11 10  9  8  7  6  5  4  3  2  1  0
- b  b  b  b  b  b  R  T  n  n  n  n  W  A u2 u1 u0 p2 p1 p0  m  m
+22 21 20 19 18 17 16 15 14 13 12 11 10  9  8  7  6  5  4  3  2  1  0
+ D  b  b  b  b  b  b  R  T  n  n  n  n  W  A u2 u1 u0 p2 p1 p0  m  m
 . .
 
 mm defines the SPI mode.
@@ -2112,6 +2258,11 @@ device only.
 bbbbbb defines the word size in bits (0-32).  The default (0)
 sets 8 bits per word.  Auxiliary SPI device only.
 
+D is 1 to always poll the SPI FIFO.  By default (0) transfers of 64
+or more bytes are made by DMA on the secondary DMA channel (pigpiod
+-e option) unless a wave is using it.  Standard SPI device, 4-wire
+only.
+
 The other bits in flags should be set to zero.
 D*/
 
@@ -2325,6 +2476,96 @@ Note, the number of returned bytes will be retMax or less.
 D*/
 
 
+/*F*/
+int batch_begin(void);
+/*D
+This function starts a batch for the calling thread.
+
+Until [*batch_commit*], [*batch_send*], or [*batch_cancel*] is called
+commands issued by the thread are queued rather than sent.  Each
+queued command returns its position in the batch (0 for the first)
+rather than its result.
+
+Commands which return data in a buffer (e.g. [*i2c_read_device*],
+[*spi_xfer*], [*serial_read*]) can not be queued and return
+pigif_batch_unsupported.
+
+Returns 0 if OK, otherwise pigif_bad_batch (a batch is already
+open) or pigif_bad_malloc.
+
+...
+int r[3];
+
+batch_begin();
+
+gpio_write(4, 1);
+gpio_write(17, 0);
+gpio_read(22);
+
+if (batch_commit(r, 3) == 3) printf("gpio 22 is %d\n", r[2]);
+...
+D*/
+
+/*F*/
+int batch_commit(int *results, unsigned maxResults);
+/*D
+This function sends the commands queued since [*batch_begin*] to
+the daemon as one request and waits for their results.
+
+. .
+   results: an array to receive the result of each command
+maxResults: the number of entries in results
+. .
+
+Returns the number of commands executed if OK, otherwise
+pigif_bad_batch, pigif_bad_send, pigif_bad_recv, or PI_BAD_BATCH.
+
+The commands are executed in order.  If a command in the batch is
+malformed it and any following commands are not executed.
+D*/
+
+/*F*/
+int batch_send(void);
+/*D
+This function sends the commands queued since [*batch_begin*] to
+the daemon as one request without waiting for the results.
+
+Returns a batch sequence number (>= 0) if OK, otherwise
+pigif_bad_batch or pigif_bad_send.
+
+Several batches may be in flight at once.  The results are
+retrieved by passing the sequence number to [*batch_collect*].
+
+Only batches are pipelined.  A command sent outside a batch waits for
+its own result, so to pipeline single commands send each as a batch.
+D*/
+
+/*F*/
+int batch_collect(unsigned seq, int *results, unsigned maxResults);
+/*D
+This function waits for the results of a batch sent by [*batch_send*].
+
+. .
+       seq: the batch sequence number returned by [*batch_send*]
+   results: an array to receive the result of each command
+maxResults: the number of entries in results
+. .
+
+Returns the number of commands executed if OK, otherwise
+pigif_bad_batch, pigif_bad_recv, or PI_BAD_BATCH.
+
+Replies are matched to batches by sequence number so batches may be
+collected in any order.
+D*/
+
+/*F*/
+int batch_cancel(void);
+/*D
+This function discards the commands queued since [*batch_begin*].
+
+Returns 0 if OK, otherwise pigif_bad_batch.
+D*/
+
 /*F*/
 int callback(unsigned user_gpio, unsigned edge, CBFunc_t f);
 /*D
@@ -2553,9 +2794,12 @@ gpioThreadFunc_t::
 typedef void *(gpioThreadFunc_t) (void *);
 . .
 
+*gpios::
+An array of gpios.
+
 handle::0-
-A number referencing an object opened by one of [*i2c_open*], [*notify_open*],
-[*serial_open*], and [*spi_open*].
+A number referencing an object opened by one of [*group_open*],
+[*i2c_open*], [*notify_open*], [*serial_open*], and [*spi_open*].
 
 i2c_addr::
 The address of a device on the I2C bus.
@@ -2602,6 +2846,9 @@ reported as PI_TIMEOUT.  See [*set_watchdog*].
 PI_TIMEOUT 2
 . .
 
+maxResults::
+The number of entries in a batch results array.
+
 mode::0-7
 The operational mode of a gpio, normally INPUT or OUTPUT.
 
@@ -2621,6 +2868,9 @@ The number of bytes used to store characters in a string.  Depending
 on the number of bits per character there may be 1, 2, or 4 bytes
 per character.
 
+numGpios::
+The number of gpios in a group.
+
 numPar:: 0-10
 The number of parameters passed to a script.
 
@@ -2697,6 +2947,9 @@ PI_MIN_DUTYCYCLE_RANGE 25
 PI_MAX_DUTYCYCLE_RANGE 40000
 . .
 
+*results::
+An array to receive the result of each command in a batch.
+
 *retBuf::
 A buffer to hold a number of bytes returned to a used customised function,
 
@@ -2722,6 +2975,9 @@ The user gpio to use for data when bit banging I2C.
 seconds::
 The number of seconds.
 
+seq::
+A batch sequence number as returned by [*batch_send*].
+
 ser_flags::
 Flags which modify a serial open command.  None are currently defined.
 
@@ -2777,6 +3033,10 @@ See [*gpio*].
 *userdata::
 A pointer to arbitrary user data.  This may be used to identify the instance.
 
+value::
+A value written to a gpio group.  Bit n is written to gpio n of the
+group.
+
 void::
 Denoting no parameter is required
 
@@ -2809,6 +3069,9 @@ typedef enum
    pigif_bad_callback       = -2008,
    pigif_notify_failed      = -2009,
    pigif_callback_not_found = -2010,
+   pigif_bad_batch          = -2011,
+   pigif_batch_full         = -2012,
+   pigif_batch_unsupported  = -2013,
 } pigifError_t;
 
 /*DEF_E*/
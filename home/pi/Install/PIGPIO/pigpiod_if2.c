@@ -0,0 +1,2698 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+/* PIGPIOD_IF2_VERSION 1 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <netdb.h>
+#include <pthread.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+
+#include <arpa/inet.h>
+
+#include "pigpio.h"
+#include "command.h"
+
+#include "pigpiod_if2.h"
+
+#define PISCOPE_MAX_REPORTS_PER_READ 4096
+
+#define STACK_SIZE (256*1024)
+
+#define CB_GPIO   0
+#define CB_SERIAL 1
+#define CB_POLL   2
+
+#define CB_DATA_BYTES 256 /* serial bytes gathered for one call */
+
+typedef void (*CBF_t) ();
+
+struct callback_s
+{
+
+   int id;
+   int pi;
+   int gpio; /* or serial handle or poll job */
+   int edge;
+   int kind; /* CB_GPIO, CB_SERIAL, or CB_POLL */
+   CBF_t f;
+   void * user;
+   int ex;
+   unsigned got;  /* data bytes gathered */
+   unsigned rxLen; /* poll reading bytes */
+   uint32_t tick; /* of the data */
+   char data[CB_DATA_BYTES];
+   callback_t *prev;
+   callback_t *next;
+};
+
+typedef struct
+{
+   int fd;
+   pthread_mutex_t mutex;
+} cmdSocket_t;
+
+typedef struct
+{
+   int pi;
+   char *buf;   /* queued requests, CMD_MAX_EXTENSION bytes */
+   unsigned len;
+   int count;
+} batch_t;
+
+typedef struct batchReply_s
+{
+   uint32_t seq;
+   int count;
+   int status;
+   int *results;
+   struct batchReply_s *next;
+} batchReply_t;
+
+/* GLOBALS ---------------------------------------------------------------- */
+
+static int          gPiInUse     [MAX_PI];
+
+static cmdSocket_t  gPigCommand  [MAX_PI][MAX_COMMAND_SOCKETS];
+static int          gPigSockets  [MAX_PI];
+static unsigned     gPigNextSock [MAX_PI];
+
+static int          gPigHandle   [MAX_PI];
+static int          gPigNotify   [MAX_PI];
+
+static uint32_t     gNotifyBits  [MAX_PI];
+static uint32_t     gLastLevel   [MAX_PI];
+static int          gCompact     [MAX_PI]; /* PI_NOTIFY_COMPACT records */
+
+static pthread_t   *gPthNotify   [MAX_PI];
+
+/* the batch state of a Pi is protected by its first command socket */
+
+static batchReply_t *gBatchReplies[MAX_PI];
+static uint32_t     gBatchSeq    [MAX_PI];
+static int          gBatchPending[MAX_PI];
+
+static callback_t  *gCallBackFirst = 0;
+static callback_t  *gCallBackLast  = 0;
+
+static pthread_mutex_t gPiMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* recursive as callbacks may be added or cancelled from a callback */
+
+static pthread_mutex_t gCallBackMutex;
+static int gCallBackId = 0;
+static pthread_once_t  gCallBackOnce = PTHREAD_ONCE_INIT;
+
+static __thread batch_t *tBatch = NULL; /* batch being queued by thread */
+static __thread int      tSocket = -1;  /* command socket held by thread */
+
+/* PRIVATE ---------------------------------------------------------------- */
+
+static void initCallBackMutex(void)
+{
+   pthread_mutexattr_t attr;
+
+   pthread_mutexattr_init(&attr);
+   pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+   pthread_mutex_init(&gCallBackMutex, &attr);
+   pthread_mutexattr_destroy(&attr);
+}
+
+static int _pml(int pi)
+{
+   int i, s, n;
+
+   /* take an idle command socket, otherwise queue on the next in turn */
+
+   n = gPigSockets[pi];
+
+   s = __sync_fetch_and_add(&gPigNextSock[pi], 1) % n;
+
+   for (i=0; i<n; i++)
+   {
+      if (!pthread_mutex_trylock(&gPigCommand[pi][(s+i)%n].mutex))
+      {
+         tSocket = (s+i) % n;
+         return gPigCommand[pi][tSocket].fd;
+      }
+   }
+
+   pthread_mutex_lock(&gPigCommand[pi][s].mutex);
+
+   tSocket = s;
+
+   return gPigCommand[pi][s].fd;
+}
+
+static void _pmu(int pi)
+{
+   if (tSocket >= 0)
+   {
+      pthread_mutex_unlock(&gPigCommand[pi][tSocket].mutex);
+      tSocket = -1;
+   }
+}
+
+static int badPi(int pi)
+{
+   return ((pi < 0) || (pi >= MAX_PI) || (!gPiInUse[pi]));
+}
+
+static int batch_queue
+   (int command, int p1, int p2, int p3,
+    int extents, gpioExtent_t *ext, int rl)
+{
+   cmdCmd_t cmd;
+   unsigned need;
+   int i;
+
+   /* the caller unlocks with _pmu, a no-op as no socket is held */
+
+   if (!rl) return pigif_batch_unsupported;
+
+   need = sizeof(cmd);
+
+   for (i=0; i<extents; i++) need += ext[i].size;
+
+   if ((tBatch->len + need) >= CMD_MAX_EXTENSION) return pigif_batch_full;
+
+   cmd.cmd = command;
+   cmd.p1  = p1;
+   cmd.p2  = p2;
+   cmd.p3  = p3;
+
+   memcpy(tBatch->buf + tBatch->len, &cmd, sizeof(cmd));
+   tBatch->len += sizeof(cmd);
+
+   for (i=0; i<extents; i++)
+   {
+      memcpy(tBatch->buf + tBatch->len, ext[i].ptr, ext[i].size);
+      tBatch->len += ext[i].size;
+   }
+
+   return tBatch->count++;
+}
+
+static int batch_stash(int pi, int fd, cmdCmd_t *cmd)
+{
+   /* store the reply to a pipelined batch, first socket held */
+
+   batchReply_t *r;
+   cmdCmd_t *sub;
+   char *ext = NULL;
+   int i, len, pos;
+
+   gBatchPending[pi]--;
+
+   r = malloc(sizeof(batchReply_t));
+
+   if (r == NULL) return pigif_bad_malloc;
+
+   r->seq     = cmd->p2;
+   r->count   = cmd->p1;
+   r->status  = cmd->res;
+   r->results = NULL;
+
+   if (r->status > 0)
+   {
+      len = r->status;
+
+      ext = malloc(len);
+      r->results = malloc(r->count * sizeof(int));
+
+      if ((ext == NULL) || (r->results == NULL) ||
+          (recv(fd, ext, len, MSG_WAITALL) != len))
+      {
+         free(ext);
+         free(r->results);
+         free(r);
+         return pigif_bad_recv;
+      }
+
+      pos = 0;
+
+      for (i=0; (i<r->count) && ((pos + sizeof(cmdCmd_t)) <= len); i++)
+      {
+         sub = (cmdCmd_t *)(ext + pos);
+
+         r->results[i] = sub->res;
+
+         pos += sizeof(cmdCmd_t);
+
+         if (cmdReplyExt(sub->cmd) && (((int)sub->res) > 0)) pos += sub->res;
+      }
+
+      free(ext);
+   }
+
+   r->next = gBatchReplies[pi];
+   gBatchReplies[pi] = r;
+
+   return 0;
+}
+
+static int recv_reply(int pi, int fd, int command, cmdCmd_t *cmd)
+{
+   while (1)
+   {
+      if (recv(fd, cmd, sizeof(cmdCmd_t), MSG_WAITALL) != sizeof(cmdCmd_t))
+         return pigif_bad_recv;
+
+      /* replies to pipelined batches may arrive first */
+
+      if ((cmd->cmd != PI_CMD_BATCH) || (command == PI_CMD_BATCH)) return 0;
+
+      if (batch_stash(pi, fd, cmd)) return pigif_bad_recv;
+   }
+}
+
+static int send_command(int pi, int command, int p1, int p2, int rl)
+{
+   cmdCmd_t cmd;
+   int fd;
+
+   cmd.cmd = command;
+   cmd.p1  = p1;
+   cmd.p2  = p2;
+   cmd.res = 0;
+
+   fd = _pml(pi);
+
+   if (send(fd, &cmd, sizeof(cmd), 0) != sizeof(cmd))
+   {
+      _pmu(pi);
+      return pigif_bad_send;
+   }
+
+   if (recv_reply(pi, fd, command, &cmd))
+   {
+      _pmu(pi);
+      return pigif_bad_recv;
+   }
+
+   if (rl) _pmu(pi);
+
+   return cmd.res;
+}
+
+static int pigpio_command(int pi, int command, int p1, int p2, int rl)
+{
+   if (badPi(pi)) return pigif_unconnected_pi;
+
+   if (tBatch && (tBatch->pi == pi))
+      return batch_queue(command, p1, p2, 0, 0, NULL, rl);
+
+   return send_command(pi, command, p1, p2, rl);
+}
+
+static int pigpio_command_ext
+   (int pi, int command, int p1, int p2, int p3,
+    int extents, gpioExtent_t *ext, int rl)
+{
+   int i, fd;
+   cmdCmd_t cmd;
+
+   if (badPi(pi)) return pigif_unconnected_pi;
+
+   if (tBatch && (tBatch->pi == pi))
+      return batch_queue(command, p1, p2, p3, extents, ext, rl);
+
+   cmd.cmd = command;
+   cmd.p1  = p1;
+   cmd.p2  = p2;
+   cmd.p3  = p3;
+
+   fd = _pml(pi);
+
+   if (send(fd, &cmd, sizeof(cmd), 0) != sizeof(cmd))
+   {
+      _pmu(pi);
+      return pigif_bad_send;
+   }
+
+   for (i=0; i<extents; i++)
+   {
+      if (send(fd, ext[i].ptr, ext[i].size, 0) != ext[i].size)
+      {
+         _pmu(pi);
+         return pigif_bad_send;
+      }
+   }
+
+   if (recv_reply(pi, fd, command, &cmd))
+   {
+      _pmu(pi);
+      return pigif_bad_recv;
+   }
+
+   if (rl) _pmu(pi);
+
+   return cmd.res;
+}
+
+static int pigpio_notify(int pi, int fd)
+{
+   cmdCmd_t cmd;
+   char *compactStr;
+   unsigned format;
+
+   /* ask the daemon to send notifications down this socket, as
+      compact reports if wanted, an earlier daemon ignores that */
+
+   compactStr = getenv(PI_ENVCOMPACT);
+
+   if (compactStr && (atoi(compactStr) > 0)) format = PI_NOTIFY_COMPACT;
+   else                                      format = 0;
+
+   cmd.cmd = PI_CMD_NOIB;
+   cmd.p1  = format;
+   cmd.p2  = 0;
+   cmd.res = 0;
+
+   if (send(fd, &cmd, sizeof(cmd), 0) != sizeof(cmd)) return pigif_bad_send;
+
+   if (recv(fd, &cmd, sizeof(cmd), MSG_WAITALL) != sizeof(cmd))
+      return pigif_bad_recv;
+
+   gCompact[pi] = (cmd.p2 & PI_NOTIFY_COMPACT) ? 1 : 0;
+
+   return cmd.res;
+}
+
+static int recvMax(int pi, void *buf, int bufsize, int sent)
+{
+   uint8_t scratch[4096];
+   int remaining, fetch, count, fd;
+
+   /* the socket the reply is arriving on is held by this thread */
+
+   fd = gPigCommand[pi][tSocket].fd;
+
+   if (sent < bufsize) count = sent; else count = bufsize;
+
+   if (count) recv(fd, buf, count, MSG_WAITALL);
+
+   remaining = sent - count;
+
+   while (remaining)
+   {
+      fetch = remaining;
+      if (fetch > sizeof(scratch)) fetch = sizeof(scratch);
+      recv(fd, scratch, fetch, MSG_WAITALL);
+      remaining -= fetch;
+   }
+
+   return count;
+}
+
+static int pigpioOpenSocket(char *addr, char *port)
+{
+   int sock, err, opt;
+   struct addrinfo hints, *res, *rp;
+   const char *addrStr, *portStr;
+
+   if (!addr)
+   {
+      addrStr = getenv(PI_ENVADDR);
+
+      if ((!addrStr) || (!strlen(addrStr)))
+      {
+         addrStr = PI_DEFAULT_SOCKET_ADDR_STR;
+      }
+   }
+   else addrStr = addr;
+
+   if (!port)
+   {
+      portStr = getenv(PI_ENVPORT);
+
+      if ((!portStr) || (!strlen(portStr)))
+      {
+         portStr = PI_DEFAULT_SOCKET_PORT_STR;
+      }
+   }
+   else portStr = port;
+
+   memset (&hints, 0, sizeof (hints));
+
+   hints.ai_family   = PF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+   hints.ai_flags   |= AI_CANONNAME;
+
+   err = getaddrinfo (addrStr, portStr, &hints, &res);
+
+   if (err) return pigif_bad_getaddrinfo;
+
+   for (rp=res; rp!=NULL; rp=rp->ai_next)
+   {
+      sock = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+
+      if (sock == -1) continue;
+
+      /* Disable the Nagle algorithm. */
+      opt = 1;
+      setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char*)&opt, sizeof(int));
+
+      if (connect(sock, rp->ai_addr, rp->ai_addrlen) != -1) break;
+   }
+
+   freeaddrinfo(res);
+
+   if (rp == NULL) return pigif_bad_connect;
+
+   return sock;
+}
+
+static void dispatch_serial(int pi, callback_t *p)
+{
+   /* callback mutex held */
+
+   if (p->got)
+   {
+      (p->f)(pi, p->gpio, p->data, p->got, p->tick, p->user);
+
+      p->got = 0;
+   }
+}
+
+static void dispatch_done(int pi)
+{
+   callback_t *p;
+
+   /* the serial bytes of a read are passed on together */
+
+   pthread_mutex_lock(&gCallBackMutex);
+
+   p = gCallBackFirst;
+
+   while (p)
+   {
+      if ((p->pi == pi) && (p->kind == CB_SERIAL)) dispatch_serial(pi, p);
+      p = p->next;
+   }
+
+   pthread_mutex_unlock(&gCallBackMutex);
+}
+
+static void dispatch_notification(int pi, gpioReport_t *r)
+{
+   callback_t *p;
+   uint32_t changed;
+   int l, g, n, i;
+
+   /*
+   printf("pi=%d s=%d f=%d l=%8X, t=%10u\n",
+      pi, r->seqno, r->flags, r->level, r->tick);
+   */
+
+   pthread_mutex_lock(&gCallBackMutex);
+
+   /* a gap report carries the level at its tick, treat as a change */
+
+   if ((r->flags == 0) || (r->flags & PI_NTFY_FLAGS_GAP))
+   {
+      changed = (r->level ^ gLastLevel[pi]) & gNotifyBits[pi];
+
+      gLastLevel[pi] = r->level;
+
+      p = gCallBackFirst;
+
+      while (p)
+      {
+         if ((p->pi == pi) && (p->kind == CB_GPIO) &&
+             (changed & (1<<(p->gpio))))
+         {
+            if ((r->level) & (1<<(p->gpio))) l = 1; else l = 0;
+            if ((p->edge) ^ l)
+            {
+               if (p->ex) (p->f)(pi, p->gpio, l, r->tick, p->user);
+               else       (p->f)(pi, p->gpio, l, r->tick);
+            }
+         }
+         p = p->next;
+      }
+   }
+   else if (r->flags & PI_NTFY_FLAGS_WDOG)
+   {
+      g = (r->flags) & 31;
+
+      p = gCallBackFirst;
+
+      while (p)
+      {
+         if ((p->pi == pi) && (p->kind == CB_GPIO) && ((p->gpio) == g))
+         {
+            if (p->ex) (p->f)(pi, g, PI_TIMEOUT, r->tick, p->user);
+            else       (p->f)(pi, g, PI_TIMEOUT, r->tick);
+         }
+         p = p->next;
+      }
+   }
+   else if (r->flags & PI_NTFY_FLAGS_SER)
+   {
+      g = (r->flags) & 31;
+      n = ((r->flags) >> 10) & 7;
+
+      p = gCallBackFirst;
+
+      while (p)
+      {
+         if ((p->pi == pi) && (p->kind == CB_SERIAL) && ((p->gpio) == g))
+         {
+            /* bytes sent together share a tick */
+
+            if ((p->tick != r->tick) || ((p->got + n) > CB_DATA_BYTES))
+               dispatch_serial(pi, p);
+
+            for (i=0; i<n; i++) p->data[p->got++] = (r->level) >> (i * 8);
+
+            p->tick = r->tick;
+         }
+         p = p->next;
+      }
+   }
+   else if (r->flags & PI_NTFY_FLAGS_POLL)
+   {
+      g = (r->flags) & 31;
+      n = ((r->flags) >> 10) & 7; /* part of the reading */
+
+      p = gCallBackFirst;
+
+      while (p)
+      {
+         if ((p->pi == pi) && (p->kind == CB_POLL) && ((p->gpio) == g))
+         {
+            if (r->flags & PI_NTFY_FLAGS_FAIL)
+            {
+               (p->f)(pi, g, (int)r->level, p->data, r->tick, p->user);
+               p->got = 0;
+            }
+            else
+            {
+               /* a part following a lost part is ignored */
+
+               if (n == 0) p->got = 0;
+
+               if (p->got == (n * 4))
+               {
+                  for (i=0; (i<4) && (p->got < p->rxLen); i++)
+                     p->data[p->got++] = (r->level) >> (i * 8);
+
+                  if (p->got >= p->rxLen)
+                  {
+                     (p->f)(pi, g, p->got, p->data, r->tick, p->user);
+                     p->got = 0;
+                  }
+               }
+            }
+         }
+         p = p->next;
+      }
+   }
+
+   pthread_mutex_unlock(&gCallBackMutex);
+}
+
+static int get_varint(uint8_t *buf, int len, uint64_t *v)
+{
+   int n, shift;
+
+   *v = 0;
+
+   for (n=0, shift=0; n<len; n++, shift+=7)
+   {
+      *v |= (uint64_t)(buf[n] & 0x7F) << shift;
+
+      if (!(buf[n] & 0x80)) return n + 1;
+   }
+
+   return 0; /* incomplete */
+}
+
+/*
+Decodes the PI_NOTIFY_COMPACT record at buf.  Returns the bytes used,
+0 if the record is incomplete, and sets r if the record is a report.
+*/
+
+static int decode_compact(
+   uint8_t *buf, int len, gpioReport64_t *state, gpioReport_t *r, int *isRep)
+{
+   uint64_t v, a, b;
+   int n, m, code, data;
+
+   a = 0;
+   b = 0;
+   data = 0;
+
+   if (!(n = get_varint(buf, len, &v))) return 0;
+
+   code = v & ((1<<PI_NOTIFY_CODE_BITS) - 1);
+
+   if (code >= PI_NOTIFY_CODE_MULTI)
+   {
+      if (!(m = get_varint(buf+n, len-n, &a))) return 0;
+      n += m;
+   }
+
+   if (code >= PI_NOTIFY_CODE_KEY)
+   {
+      if (!(m = get_varint(buf+n, len-n, &b))) return 0;
+      n += m;
+   }
+
+   *isRep = 1;
+
+   r->flags = 0;
+
+   state->tick += (v >> PI_NOTIFY_CODE_BITS);
+
+   if      (code <  PI_NOTIFY_CODE_MULTI) state->level ^= (1<<code);
+   else if (code == PI_NOTIFY_CODE_MULTI) state->level ^= a;
+   else if (code == PI_NOTIFY_CODE_KEY)
+   {
+      state->tick  = a;
+      state->level = b;
+      *isRep = 0;
+   }
+   else if (code == PI_NOTIFY_CODE_FLAGS)
+   {
+      r->flags = a;
+
+      /* poll and serial reports carry data, not levels */
+
+      if (a & (PI_NTFY_FLAGS_POLL | PI_NTFY_FLAGS_SER)) data = 1;
+      else state->level ^= b;
+   }
+   else *isRep = 0;
+
+   if (*isRep)
+   {
+      r->seqno = state->seqno++;
+      r->tick  = state->tick;
+      r->level = data ? b : state->level;
+   }
+
+   return n;
+}
+
+static void *pthNotifyCompact(int pi)
+{
+   gpioReport64_t state;
+   gpioReport_t r;
+   uint8_t *buf;
+   int got, bytes, pos, n, isRep, size;
+
+   size = PISCOPE_MAX_REPORTS_PER_READ * sizeof(gpioReport_t);
+
+   buf = malloc(size);
+
+   if (buf == NULL) return 0;
+
+   memset(&state, 0, sizeof(state));
+
+   got = 0;
+
+   while (1)
+   {
+      bytes = read(gPigNotify[pi], buf+got, size-got);
+
+      if (bytes > 0) got += bytes;
+      else break;
+
+      pos = 0;
+
+      while ((n = decode_compact(buf+pos, got-pos, &state, &r, &isRep)))
+      {
+         if (isRep) dispatch_notification(pi, &r);
+
+         pos += n;
+      }
+
+      dispatch_done(pi);
+
+      /* copy any partial record to start of buffer */
+
+      got -= pos;
+
+      if (got && pos) memmove(buf, buf+pos, got);
+   }
+
+   free(buf);
+
+   return 0;
+}
+
+static void *pthNotifyThread(void *x)
+{
+   gpioReport_t *report;
+   int pi, got, bytes, r;
+
+   pi = (intptr_t)x;
+
+   if (gCompact[pi]) return pthNotifyCompact(pi);
+
+   report = malloc(PISCOPE_MAX_REPORTS_PER_READ * sizeof(gpioReport_t));
+
+   if (report == NULL) return 0;
+
+   got = 0;
+
+   while (1)
+   {
+      bytes = read(gPigNotify[pi], (char*)report+got,
+         (PISCOPE_MAX_REPORTS_PER_READ * sizeof(gpioReport_t)) - got);
+
+      if (bytes > 0) got += bytes;
+      else break;
+
+      r = 0;
+
+      while (got >= sizeof(gpioReport_t))
+      {
+         dispatch_notification(pi, &report[r]);
+
+         r++;
+
+         got -= sizeof(gpioReport_t);
+      }
+
+      dispatch_done(pi);
+
+      /* copy any partial report to start of array */
+      
+      if (got && r) memmove(report, &report[r], got);
+   }
+
+   free(report);
+
+   return 0;
+}
+
+static void findNotifyBits(int pi)
+{
+   callback_t *p;
+   uint32_t bits = 0;
+
+   /* callback mutex held */
+
+   p = gCallBackFirst;
+
+   while (p)
+   {
+      if ((p->pi == pi) && (p->kind == CB_GPIO)) bits |= (1<<(p->gpio));
+      p = p->next;
+   }
+
+   if (bits != gNotifyBits[pi])
+   {
+      gNotifyBits[pi] = bits;
+
+      /* never queued in a batch */
+
+      send_command(pi, PI_CMD_NB, gPigHandle[pi], gNotifyBits[pi], 1);
+   }
+}
+
+static void _wfe(
+   int pi, unsigned user_gpio, unsigned level, uint32_t tick, void *user)
+{
+   *(int *)user = 1;
+}
+
+static int intCallback(
+   int pi, unsigned user_gpio, unsigned edge, void *f, void *user, int ex)
+{
+   callback_t *p;
+
+   if (badPi(pi)) return pigif_unconnected_pi;
+
+   if ((user_gpio >=0) && (user_gpio < 32) && (edge >=0) && (edge <= 2) && f)
+   {
+      pthread_mutex_lock(&gCallBackMutex);
+
+      /* prevent duplicates */
+
+      p = gCallBackFirst;
+
+      while (p)
+      {
+         if ((p->pi == pi) && (p->kind == CB_GPIO) &&
+             (p->gpio == user_gpio) && (p->edge == edge) && (p->f == f))
+         {
+            pthread_mutex_unlock(&gCallBackMutex);
+            return pigif_duplicate_callback;
+         }
+         p = p->next;
+      }
+
+      p = malloc(sizeof(callback_t));
+
+      if (p)
+      {
+         if (!gCallBackFirst) gCallBackFirst = p;
+
+         p->id = gCallBackId++;
+         p->pi = pi;
+         p->gpio = user_gpio;
+         p->edge = edge;
+         p->kind = CB_GPIO;
+         p->f = f;
+         p->user = user;
+         p->ex = ex;
+         p->next = 0;
+         p->prev = gCallBackLast;
+
+         if (p->prev) (p->prev)->next = p;
+         gCallBackLast = p;
+
+         findNotifyBits(pi);
+
+         pthread_mutex_unlock(&gCallBackMutex);
+
+         return p->id;
+      }
+
+      pthread_mutex_unlock(&gCallBackMutex);
+
+      return pigif_bad_malloc;
+   }
+
+   return pigif_bad_callback;
+}
+
+static void unlinkCallback(callback_t *p)
+{
+   /* callback mutex held */
+
+   if (p->prev) p->prev->next = p->next;
+   else gCallBackFirst = p->next;
+
+   if (p->next) p->next->prev = p->prev;
+   else gCallBackLast = p->prev;
+
+   free(p);
+}
+
+static void releasePi(int pi)
+{
+   batchReply_t *r;
+   callback_t *p, *n;
+   int i;
+
+   /* gPiMutex held, undoes a full or partial pigpio_start */
+
+   if (gPthNotify[pi])
+   {
+      /* a closed socket ends the notify thread */
+
+      shutdown(gPigNotify[pi], SHUT_RDWR);
+      pthread_join(*gPthNotify[pi], NULL);
+      free(gPthNotify[pi]);
+      gPthNotify[pi] = NULL;
+   }
+
+   if (gPigNotify[pi] >= 0)
+   {
+      close(gPigNotify[pi]);
+      gPigNotify[pi] = -1;
+   }
+
+   gPigHandle[pi] = -1;
+
+   pthread_mutex_lock(&gCallBackMutex);
+
+   p = gCallBackFirst;
+
+   while (p)
+   {
+      n = p->next;
+      if (p->pi == pi) unlinkCallback(p);
+      p = n;
+   }
+
+   gNotifyBits[pi] = 0;
+
+   pthread_mutex_unlock(&gCallBackMutex);
+
+   gPiInUse[pi] = 0;
+
+   for (i=0; i<gPigSockets[pi]; i++)
+   {
+      close(gPigCommand[pi][i].fd);
+      pthread_mutex_destroy(&gPigCommand[pi][i].mutex);
+   }
+
+   gPigSockets[pi] = 0;
+
+   while (gBatchReplies[pi])
+   {
+      r = gBatchReplies[pi];
+      gBatchReplies[pi] = r->next;
+      free(r->results);
+      free(r);
+   }
+
+   gBatchPending[pi] = 0;
+}
+
+/* PUBLIC ----------------------------------------------------------------- */
+
+double time_time(void)
+{
+   struct timeval tv;
+   double t;
+
+   gettimeofday(&tv, 0);
+
+   t = (double)tv.tv_sec + ((double)tv.tv_usec / 1E6);
+
+   return t;
+}
+
+void time_sleep(double seconds)
+{
+   struct timespec ts, rem;
+
+   if (seconds > 0.0)
+   {
+      ts.tv_sec = seconds;
+      ts.tv_nsec = (seconds-(double)ts.tv_sec) * 1E9;
+
+      while (clock_nanosleep(CLOCK_REALTIME, 0, &ts, &rem))
+      {
+         /* copy remaining time to ts */
+         ts.tv_sec  = rem.tv_sec;
+         ts.tv_nsec = rem.tv_nsec;
+      }
+   }
+}
+
+char *pigpio_error(int errnum)
+{
+   if (errnum > -1000) return cmdErrStr(errnum);
+   else
+   {
+      switch(errnum)
+      {
+         case pigif_bad_send:
+            return "failed to send to pigpiod";
+         case pigif_bad_recv:
+            return "failed to receive from pigpiod";
+         case pigif_bad_getaddrinfo:
+            return "failed to find address of pigpiod";
+         case pigif_bad_connect:
+            return "failed to connect to pigpiod";
+         case pigif_bad_socket:
+            return "failed to create socket";
+         case pigif_bad_noib:
+            return "failed to open noib";
+         case pigif_duplicate_callback:
+            return "identical callback exists";
+         case pigif_bad_malloc:
+            return "failed to malloc";
+         case pigif_bad_callback:
+            return "bad callback parameter";
+         case pigif_notify_failed:
+            return "failed to create notification thread";
+         case pigif_callback_not_found:
+            return "callback not found";
+         case pigif_bad_batch:
+            return "no batch open or batch already open";
+         case pigif_batch_full:
+            return "batch is full";
+         case pigif_batch_unsupported:
+            return "command can not be batched";
+         case pigif_unconnected_pi:
+            return "no connection to Pi";
+         case pigif_too_many_pis:
+            return "too many connected Pis";
+         case pigif_bad_pool:
+            return "bad number of command sockets";
+         default:
+            return "unknown error";
+      }
+   }
+}
+
+unsigned pigpiod_if_version(void)
+{
+   return PIGPIOD_IF2_VERSION;
+}
+
+pthread_t *start_thread(gpioThreadFunc_t thread_func, void *arg)
+{
+   pthread_t *pth;
+   pthread_attr_t pthAttr;
+
+   pth = malloc(sizeof(pthread_t));
+
+   if (pth)
+   {
+      if (pthread_attr_init(&pthAttr))
+      {
+         perror("pthread_attr_init failed");
+         free(pth);
+         return NULL;
+      }
+
+      if (pthread_attr_setstacksize(&pthAttr, STACK_SIZE))
+      {
+         perror("pthread_attr_setstacksize failed");
+         free(pth);
+         return NULL;
+      }
+
+      if (pthread_create(pth, &pthAttr, thread_func, arg))
+      {
+         perror("pthread_create socket failed");
+         free(pth);
+         return NULL;
+      }
+   }
+   return pth;
+}
+
+void stop_thread(pthread_t *pth)
+{
+   if (pth)
+   {
+      pthread_cancel(*pth);
+      pthread_join(*pth, NULL);
+      free(pth);
+   }
+}
+
+int pigpio_start_pool(char *addrStr, char *portStr, unsigned sockets)
+{
+   int pi, fd, handle;
+
+   if ((sockets < 1) || (sockets > MAX_COMMAND_SOCKETS)) return pigif_bad_pool;
+
+   pthread_once(&gCallBackOnce, initCallBackMutex);
+
+   pthread_mutex_lock(&gPiMutex);
+
+   for (pi=0; pi<MAX_PI; pi++) if (!gPiInUse[pi]) break;
+
+   if (pi >= MAX_PI)
+   {
+      pthread_mutex_unlock(&gPiMutex);
+      return pigif_too_many_pis;
+   }
+
+   gPigSockets[pi] = 0;
+   gPigNotify[pi] = -1;
+   gPigHandle[pi] = -1;
+   gPthNotify[pi] = NULL;
+
+   while (gPigSockets[pi] < sockets)
+   {
+      fd = pigpioOpenSocket(addrStr, portStr);
+
+      if (fd < 0)
+      {
+         releasePi(pi);
+         pthread_mutex_unlock(&gPiMutex);
+         return fd;
+      }
+
+      gPigCommand[pi][gPigSockets[pi]].fd = fd;
+      pthread_mutex_init(&gPigCommand[pi][gPigSockets[pi]].mutex, NULL);
+
+      gPigSockets[pi]++;
+   }
+
+   gPiInUse[pi] = 1;
+
+   fd = pigpioOpenSocket(addrStr, portStr);
+
+   if (fd < 0)
+   {
+      releasePi(pi);
+      pthread_mutex_unlock(&gPiMutex);
+      return fd;
+   }
+
+   gPigNotify[pi] = fd;
+
+   handle = pigpio_notify(pi, fd);
+
+   if (handle < 0)
+   {
+      releasePi(pi);
+      pthread_mutex_unlock(&gPiMutex);
+      return pigif_bad_noib;
+   }
+
+   gPigHandle[pi] = handle;
+
+   gLastLevel[pi] = read_bank_1(pi);
+
+   gPthNotify[pi] = start_thread(pthNotifyThread, (void *)(intptr_t)pi);
+
+   if (!gPthNotify[pi])
+   {
+      releasePi(pi);
+      pthread_mutex_unlock(&gPiMutex);
+      return pigif_notify_failed;
+   }
+
+   pthread_mutex_unlock(&gPiMutex);
+
+   return pi;
+}
+
+int pigpio_start(char *addrStr, char *portStr)
+   {return pigpio_start_pool(addrStr, portStr, 1);}
+
+void pigpio_stop(int pi)
+{
+   pthread_mutex_lock(&gPiMutex);
+
+   if (!badPi(pi))
+   {
+      send_command(pi, PI_CMD_NC, gPigHandle[pi], 0, 1);
+
+      releasePi(pi);
+   }
+
+   pthread_mutex_unlock(&gPiMutex);
+}
+
+int set_mode(int pi, unsigned gpio, unsigned mode)
+   {return pigpio_command(pi, PI_CMD_MODES, gpio, mode, 1);}
+
+int get_mode(int pi, unsigned gpio)
+   {return pigpio_command(pi, PI_CMD_MODEG, gpio, 0, 1);}
+
+int set_pull_up_down(int pi, unsigned gpio, unsigned pud)
+   {return pigpio_command(pi, PI_CMD_PUD, gpio, pud, 1);}
+
+int gpio_read(int pi, unsigned gpio)
+   {return pigpio_command(pi, PI_CMD_READ, gpio, 0, 1);}
+
+int gpio_write(int pi, unsigned gpio, unsigned level)
+   {return pigpio_command(pi, PI_CMD_WRITE, gpio, level, 1);}
+
+int set_PWM_dutycycle(int pi, unsigned user_gpio, unsigned dutycycle)
+   {return pigpio_command(pi, PI_CMD_PWM, user_gpio, dutycycle, 1);}
+
+int PWM_begin(int pi)
+   {return pigpio_command(pi, PI_CMD_PWMB, 0, 0, 1);}
+
+int PWM_commit(int pi)
+   {return pigpio_command(pi, PI_CMD_PWMC, 0, 0, 1);}
+
+int get_PWM_dutycycle(int pi, unsigned user_gpio)
+   {return pigpio_command(pi, PI_CMD_GDC, user_gpio, 0, 1);}
+
+int set_PWM_range(int pi, unsigned user_gpio, unsigned range)
+   {return pigpio_command(pi, PI_CMD_PRS, user_gpio, range, 1);}
+
+int get_PWM_range(int pi, unsigned user_gpio)
+   {return pigpio_command(pi, PI_CMD_PRG, user_gpio, 0, 1);}
+
+int get_PWM_real_range(int pi, unsigned user_gpio)
+   {return pigpio_command(pi, PI_CMD_PRRG, user_gpio, 0, 1);}
+
+int set_PWM_frequency(int pi, unsigned user_gpio, unsigned frequency)
+   {return pigpio_command(pi, PI_CMD_PFS, user_gpio, frequency, 1);}
+
+int get_PWM_frequency(int pi, unsigned user_gpio)
+   {return pigpio_command(pi, PI_CMD_PFG, user_gpio, 0, 1);}
+
+int set_servo_pulsewidth(int pi, unsigned user_gpio, unsigned pulsewidth)
+   {return pigpio_command(pi, PI_CMD_SERVO, user_gpio, pulsewidth, 1);}
+
+int get_servo_pulsewidth(int pi, unsigned user_gpio)
+   {return pigpio_command(pi, PI_CMD_GPW, user_gpio, 0, 1);}
+
+int notify_open(int pi)
+   {return pigpio_command(pi, PI_CMD_NO, 0, 0, 1);}
+
+int notify_begin(int pi, unsigned handle, uint32_t bits)
+   {return pigpio_command(pi, PI_CMD_NB, handle, bits, 1);}
+
+int notify_pause(int pi, unsigned handle)
+   {return pigpio_command(pi, PI_CMD_NB, handle, 0, 1);}
+
+int notify_close(int pi, unsigned handle)
+   {return pigpio_command(pi, PI_CMD_NC, handle, 0, 1);}
+
+int notify_format(int pi, unsigned handle, unsigned format)
+   {return pigpio_command(pi, PI_CMD_NF, handle, format, 1);}
+
+int poll_start(
+   int pi, unsigned handle, unsigned pollFlags, unsigned devHandle,
+   unsigned micros, char *txBuf, unsigned txLen, unsigned rxLen)
+{
+   gpioExtent_t ext[4];
+
+   /*
+   p1=handle
+   p2=devHandle
+   p3=txLen+12
+   ## extension ##
+   uint32_t pollFlags
+   uint32_t micros
+   uint32_t rxLen
+   char txBuf[txLen]
+   */
+
+   ext[0].size = 4;
+   ext[0].ptr = &pollFlags;
+
+   ext[1].size = 4;
+   ext[1].ptr = &micros;
+
+   ext[2].size = 4;
+   ext[2].ptr = &rxLen;
+
+   ext[3].size = txLen;
+   ext[3].ptr = txBuf;
+
+   return pigpio_command_ext
+      (pi, PI_CMD_POLLON, handle, devHandle, txLen+12, 4, ext, 1);
+}
+
+int poll_stop(int pi, unsigned job)
+   {return pigpio_command(pi, PI_CMD_POLLOFF, job, 0, 1);}
+
+int poll_callback(
+   int pi, unsigned pollFlags, unsigned devHandle, unsigned micros,
+   char *txBuf, unsigned txLen, unsigned rxLen,
+   pollCBFunc_t f, void *userdata)
+{
+   callback_t *p;
+   batch_t *batch;
+   int status;
+
+   if (badPi(pi)) return pigif_unconnected_pi;
+
+   if ((rxLen > CB_DATA_BYTES) || (f == NULL)) return pigif_bad_callback;
+
+   pthread_mutex_lock(&gCallBackMutex);
+
+   p = malloc(sizeof(callback_t));
+
+   if (p == NULL)
+   {
+      pthread_mutex_unlock(&gCallBackMutex);
+      return pigif_bad_malloc;
+   }
+
+   /* the job is not known until started, the mutex holds its reports */
+
+   p->id = gCallBackId++;
+   p->pi = pi;
+   p->gpio = -1;
+   p->edge = 0;
+   p->kind = CB_POLL;
+   p->f = f;
+   p->user = userdata;
+   p->ex = 1;
+   p->got = 0;
+   p->rxLen = rxLen;
+   p->tick = 0;
+   p->next = 0;
+   p->prev = gCallBackLast;
+
+   if (p->prev) (p->prev)->next = p; else gCallBackFirst = p;
+   gCallBackLast = p;
+
+   /* never queued in a batch, reports only flow once NB has been sent */
+
+   batch = tBatch;
+   tBatch = NULL;
+
+   send_command(pi, PI_CMD_NB, gPigHandle[pi], gNotifyBits[pi], 1);
+
+   status = poll_start(
+      pi, gPigHandle[pi], pollFlags, devHandle, micros, txBuf, txLen, rxLen);
+
+   tBatch = batch;
+
+   if (status < 0)
+   {
+      unlinkCallback(p);
+      pthread_mutex_unlock(&gCallBackMutex);
+      return status;
+   }
+
+   p->gpio = status;
+
+   status = p->id;
+
+   pthread_mutex_unlock(&gCallBackMutex);
+
+   return status;
+}
+
+int set_watchdog(int pi, unsigned user_gpio, unsigned timeout)
+   {return pigpio_command(pi, PI_CMD_WDOG, user_gpio, timeout, 1);}
+
+uint32_t read_bank_1(int pi)
+   {return pigpio_command(pi, PI_CMD_BR1, 0, 0, 1);}
+
+uint32_t read_bank_2(int pi)
+   {return pigpio_command(pi, PI_CMD_BR2, 0, 0, 1);}
+
+int clear_bank_1(int pi, uint32_t levels)
+   {return pigpio_command(pi, PI_CMD_BC1, levels, 0, 1);}
+
+int clear_bank_2(int pi, uint32_t levels)
+   {return pigpio_command(pi, PI_CMD_BC2, levels, 0, 1);}
+
+int set_bank_1(int pi, uint32_t levels)
+   {return pigpio_command(pi, PI_CMD_BS1, levels, 0, 1);}
+
+int set_bank_2(int pi, uint32_t levels)
+   {return pigpio_command(pi, PI_CMD_BS2, levels, 0, 1);}
+
+int group_open(int pi, unsigned numGpios, unsigned *gpios)
+{
+   gpioExtent_t ext[1];
+   char buf[PI_MAX_GROUP_GPIOS];
+   int i;
+
+   /*
+   p1=0
+   p2=0
+   p3=numGpios
+   ## extension ##
+   char gpios[numGpios]
+   */
+
+   if ((numGpios < 1) || (numGpios > PI_MAX_GROUP_GPIOS))
+      return PI_BAD_GROUP;
+
+   for (i=0; i<numGpios; i++)
+   {
+      if (gpios[i] > PI_MAX_USER_GPIO) return PI_BAD_GROUP;
+
+      buf[i] = gpios[i];
+   }
+
+   ext[0].size = numGpios;
+   ext[0].ptr = buf;
+
+   return pigpio_command_ext
+      (pi, PI_CMD_GRPO, 0, 0, numGpios, 1, ext, 1);
+}
+
+int group_write(int pi, unsigned handle, uint32_t value)
+   {return pigpio_command(pi, PI_CMD_GRPW, handle, value, 1);}
+
+int group_close(int pi, unsigned handle)
+   {return pigpio_command(pi, PI_CMD_GRPC, handle, 0, 1);}
+
+int hardware_clock(int pi, unsigned gpio, unsigned frequency)
+   {return pigpio_command(pi, PI_CMD_HC, gpio, frequency, 1);}
+
+int hardware_PWM(int pi, unsigned gpio, unsigned frequency, uint32_t dutycycle)
+{
+   gpioExtent_t ext[1];
+   
+   /*
+   p1=gpio
+   p2=frequency
+   p3=4
+   ## extension ##
+   uint32_t dutycycle
+   */
+
+   ext[0].size = sizeof(dutycycle);
+   ext[0].ptr = &dutycycle;
+
+   return pigpio_command_ext(
+      pi, PI_CMD_HP, gpio, frequency, sizeof(dutycycle), 1, ext, 1);
+}
+
+uint32_t get_current_tick(int pi)
+   {return pigpio_command(pi, PI_CMD_TICK, 0, 0, 1);}
+
+uint64_t get_current_tick64(int pi)
+{
+   uint64_t tick;
+   int bytes;
+
+   tick = 0;
+
+   bytes = pigpio_command(pi, PI_CMD_T64, 0, 0, 0);
+
+   if (bytes > 0)
+   {
+      if (recvMax(pi, &tick, sizeof(tick), bytes) != sizeof(tick)) tick = 0;
+   }
+
+   _pmu(pi);
+
+   return tick;
+}
+
+uint32_t get_hardware_revision(int pi)
+   {return pigpio_command(pi, PI_CMD_HWVER, 0, 0, 1);}
+
+uint32_t get_pigpio_version(int pi)
+   {return pigpio_command(pi, PI_CMD_PIGPV, 0, 0, 1);}
+
+int wave_clear(int pi)
+   {return pigpio_command(pi, PI_CMD_WVCLR, 0, 0, 1);}
+
+int wave_add_new(int pi)
+   {return pigpio_command(pi, PI_CMD_WVNEW, 0, 0, 1);}
+
+int wave_add_generic(int pi, unsigned numPulses, gpioPulse_t *pulses)
+{
+   gpioExtent_t ext[1];
+   
+   /*
+   p1=0
+   p2=0
+   p3=pulses*sizeof(gpioPulse_t)
+   ## extension ##
+   gpioPulse_t[] pulses
+   */
+
+   if (!numPulses) return 0;
+
+   ext[0].size = numPulses * sizeof(gpioPulse_t);
+   ext[0].ptr = pulses;
+
+   return pigpio_command_ext(
+      pi, PI_CMD_WVAG, 0, 0, ext[0].size, 1, ext, 1);
+}
+
+int wave_add_serial(
+   int pi, unsigned user_gpio, unsigned baud, uint32_t databits,
+   uint32_t stophalfbits, uint32_t offset,  unsigned numChar, char *str)
+{
+   uint8_t buf[12];
+   gpioExtent_t ext[2];
+
+   /*
+   p1=user_gpio
+   p2=baud
+   p3=len+12
+   ## extension ##
+   uint32_t databits
+   uint32_t stophalfbits
+   uint32_t offset
+   char[len] str
+   */
+
+   if (!numChar) return 0;
+
+   memcpy(buf, &databits, 4);
+   memcpy(buf+4, &stophalfbits, 4);
+   memcpy(buf+8, &offset, 4);
+
+   ext[0].size = sizeof(buf);
+   ext[0].ptr = buf;
+
+   ext[1].size = numChar;
+   ext[1].ptr = str;
+
+   return pigpio_command_ext(pi, PI_CMD_WVAS,
+      user_gpio, baud, numChar+sizeof(buf), 2, ext, 1);
+}
+
+int wave_create(int pi)
+   {return pigpio_command(pi, PI_CMD_WVCRE, 0, 0, 1);}
+
+int wave_delete(int pi, unsigned wave_id)
+   {return pigpio_command(pi, PI_CMD_WVDEL, wave_id, 0, 1);}
+
+int wave_send_once(int pi, unsigned wave_id)
+   {return pigpio_command(pi, PI_CMD_WVTX, wave_id, 0, 1);}
+
+int wave_send_repeat(int pi, unsigned wave_id)
+   {return pigpio_command(pi, PI_CMD_WVTXR, wave_id, 0, 1);}
+
+int wave_chain(int pi, char *buf, unsigned bufSize)
+{
+   gpioExtent_t ext[1];
+
+   /*
+   p1=0
+   p2=0
+   p3=bufSize
+   ## extension ##
+   char buf[bufSize]
+   */
+
+   ext[0].size = bufSize;
+   ext[0].ptr = buf;
+
+   return pigpio_command_ext
+      (pi, PI_CMD_WVCHA, 0, 0, bufSize, 1, ext, 1);
+}
+
+int wave_tx_busy(int pi)
+   {return pigpio_command(pi, PI_CMD_WVBSY, 0, 0, 1);}
+
+int wave_tx_stop(int pi)
+   {return pigpio_command(pi, PI_CMD_WVHLT, 0, 0, 1);}
+
+int wave_get_micros(int pi)
+   {return pigpio_command(pi, PI_CMD_WVSM, 0, 0, 1);}
+
+int wave_get_high_micros(int pi)
+   {return pigpio_command(pi, PI_CMD_WVSM, 1, 0, 1);}
+
+int wave_get_max_micros(int pi)
+   {return pigpio_command(pi, PI_CMD_WVSM, 2, 0, 1);}
+
+int wave_get_pulses(int pi)
+   {return pigpio_command(pi, PI_CMD_WVSP, 0, 0, 1);}
+
+int wave_get_high_pulses(int pi)
+   {return pigpio_command(pi, PI_CMD_WVSP, 1, 0, 1);}
+
+int wave_get_max_pulses(int pi)
+   {return pigpio_command(pi, PI_CMD_WVSP, 2, 0, 1);}
+
+int wave_get_cbs(int pi)
+   {return pigpio_command(pi, PI_CMD_WVSC, 0, 0, 1);}
+
+int wave_get_high_cbs(int pi)
+   {return pigpio_command(pi, PI_CMD_WVSC, 1, 0, 1);}
+
+int wave_get_max_cbs(int pi)
+   {return pigpio_command(pi, PI_CMD_WVSC, 2, 0, 1);}
+
+int gpio_trigger(int pi, unsigned user_gpio, unsigned pulseLen, uint32_t level)
+{
+   gpioExtent_t ext[1];
+   
+   /*
+   p1=user_gpio
+   p2=pulseLen
+   p3=4
+   ## extension ##
+   unsigned level
+   */
+
+   ext[0].size = sizeof(uint32_t);
+   ext[0].ptr = &level;
+
+   return pigpio_command_ext(
+      pi, PI_CMD_TRIG, user_gpio, pulseLen, 4, 1, ext, 1);
+}
+
+int store_script(int pi, char *script)
+{
+   unsigned len;
+   gpioExtent_t ext[1];
+
+   /*
+   p1=0
+   p2=0
+   p3=len
+   ## extension ##
+   char[len] script
+   */
+
+   len = strlen(script);
+
+   if (!len) return 0;
+
+   ext[0].size = len;
+   ext[0].ptr = script;
+
+   return pigpio_command_ext(pi, PI_CMD_PROC, 0, 0, len, 1, ext, 1);
+}
+
+int run_script(int pi, unsigned script_id, unsigned numPar, uint32_t *param)
+{
+   gpioExtent_t ext[1];
+
+   /*
+   p1=script id
+   p2=0
+   p3=numPar * 4
+   ## extension ##
+   uint32_t[numPar] pars
+   */
+
+   ext[0].size = 4 * numPar;
+   ext[0].ptr = param;
+
+   return pigpio_command_ext
+      (pi, PI_CMD_PROCR, script_id, 0, numPar*4, 1, ext, 1);
+}
+
+int script_status(int pi, unsigned script_id, uint32_t *param)
+{
+   int status;
+   uint32_t p[PI_MAX_SCRIPT_PARAMS+1]; /* space for script status */
+
+   status = pigpio_command(pi, PI_CMD_PROCP, script_id, 0, 0);
+
+   if (status > 0)
+   {
+      recvMax(pi, p, sizeof(p), status);
+      status = p[0];
+      if (param) memcpy(param, p+1, sizeof(p)-4);
+   }
+
+   _pmu(pi);
+
+   return status;
+}
+
+int stop_script(int pi, unsigned script_id)
+   {return pigpio_command(pi, PI_CMD_PROCS, script_id, 0, 1);}
+
+int delete_script(int pi, unsigned script_id)
+   {return pigpio_command(pi, PI_CMD_PROCD, script_id, 0, 1);}
+
+int bb_serial_read_open(
+   int pi, unsigned user_gpio, unsigned baud, uint32_t bbBits)
+{
+   gpioExtent_t ext[1];
+   
+   /*
+   p1=user_gpio
+   p2=baud
+   p3=4
+   ## extension ##
+   unsigned bbBits
+   */
+
+   ext[0].size = sizeof(uint32_t);
+   ext[0].ptr = &bbBits;
+
+   return pigpio_command_ext(
+      pi, PI_CMD_SLRO, user_gpio, baud, 4, 1, ext, 1);
+}
+
+int bb_serial_read(int pi, unsigned user_gpio, void *buf, size_t bufSize)
+{
+   int bytes;
+
+   bytes = pigpio_command(pi, PI_CMD_SLR, user_gpio, bufSize, 0);
+
+   if (bytes > 0)
+   {
+      bytes = recvMax(pi, buf, bufSize, bytes);
+   }
+
+   _pmu(pi);
+
+   return bytes;
+}
+
+int bb_serial_read_close(int pi, unsigned user_gpio)
+   {return pigpio_command(pi, PI_CMD_SLRC, user_gpio, 0, 1);}
+
+int bb_serial_invert(int pi, unsigned user_gpio, unsigned invert)
+   {return pigpio_command(pi, PI_CMD_SLRI, user_gpio, invert, 1);}
+
+int i2c_open(int pi, unsigned i2c_bus, unsigned i2c_addr, uint32_t i2c_flags)
+{
+   gpioExtent_t ext[1];
+
+   /*
+   p1=i2c_bus
+   p2=i2c_addr
+   p3=4
+   ## extension ##
+   uint32_t i2c_flags
+   */
+
+   ext[0].size = sizeof(uint32_t);
+   ext[0].ptr = &i2c_flags;
+
+   return pigpio_command_ext
+      (pi, PI_CMD_I2CO, i2c_bus, i2c_addr, 4, 1, ext, 1);
+}
+
+int i2c_close(int pi, unsigned handle)
+   {return pigpio_command(pi, PI_CMD_I2CC, handle, 0, 1);}
+
+int i2c_write_quick(int pi, unsigned handle, unsigned bit)
+   {return pigpio_command(pi, PI_CMD_I2CWQ, handle, bit, 1);}
+
+int i2c_write_byte(int pi, unsigned handle, unsigned val)
+   {return pigpio_command(pi, PI_CMD_I2CWS, handle, val, 1);}
+
+int i2c_read_byte(int pi, unsigned handle)
+   {return pigpio_command(pi, PI_CMD_I2CRS, handle, 0, 1);}
+
+int i2c_write_byte_data(int pi, unsigned handle, unsigned reg, uint32_t val)
+{
+   gpioExtent_t ext[1];
+
+   /*
+   p1=handle
+   p2=reg
+   p3=4
+   ## extension ##
+   uint32_t val
+   */
+
+   ext[0].size = sizeof(uint32_t);
+   ext[0].ptr = &val;
+
+   return pigpio_command_ext
+      (pi, PI_CMD_I2CWB, handle, reg, 4, 1, ext, 1);
+}
+
+int i2c_write_word_data(int pi, unsigned handle, unsigned reg, uint32_t val)
+{
+   gpioExtent_t ext[1];
+
+   /*
+   p1=handle
+   p2=reg
+   p3=4
+   ## extension ##
+   uint32_t val
+   */
+
+   ext[0].size = sizeof(uint32_t);
+   ext[0].ptr = &val;
+
+   return pigpio_command_ext
+      (pi, PI_CMD_I2CWW, handle, reg, 4, 1, ext, 1);
+}
+
+int i2c_read_byte_data(int pi, unsigned handle, unsigned reg)
+   {return pigpio_command(pi, PI_CMD_I2CRB, handle, reg, 1);}
+
+int i2c_read_word_data(int pi, unsigned handle, unsigned reg)
+   {return pigpio_command(pi, PI_CMD_I2CRW, handle, reg, 1);}
+
+int i2c_process_call(int pi, unsigned handle, unsigned reg, uint32_t val)
+{
+   gpioExtent_t ext[1];
+
+   /*
+   p1=handle
+   p2=reg
+   p3=4
+   ## extension ##
+   uint32_t val
+   */
+
+   ext[0].size = sizeof(uint32_t);
+   ext[0].ptr = &val;
+
+   return pigpio_command_ext
+      (pi, PI_CMD_I2CPK, handle, reg, 4, 1, ext, 1);
+}
+
+int i2c_write_block_data(
+   int pi, unsigned handle, unsigned reg, char *buf, unsigned count)
+{
+   gpioExtent_t ext[1];
+
+   /*
+   p1=handle
+   p2=reg
+   p3=count
+   ## extension ##
+   char buf[count]
+   */
+
+   ext[0].size = count;
+   ext[0].ptr = buf;
+
+   return pigpio_command_ext
+      (pi, PI_CMD_I2CWK, handle, reg, count, 1, ext, 1);
+}
+
+int i2c_read_block_data(int pi, unsigned handle, unsigned reg, char *buf)
+{
+   int bytes;
+
+   bytes = pigpio_command(pi, PI_CMD_I2CRK, handle, reg, 0);
+
+   if (bytes > 0)
+   {
+      bytes = recvMax(pi, buf, 32, bytes);
+   }
+
+   _pmu(pi);
+
+   return bytes;
+}
+
+int i2c_block_process_call(
+   int pi, unsigned handle, unsigned reg, char *buf, unsigned count)
+{
+   int bytes;
+   gpioExtent_t ext[1];
+
+   /*
+   p1=handle
+   p2=reg
+   p3=count
+   ## extension ##
+   char buf[count]
+   */
+
+   ext[0].size = count;
+   ext[0].ptr = buf;
+
+   bytes = pigpio_command_ext
+      (pi, PI_CMD_I2CPK, handle, reg, count, 1, ext, 0);
+
+   if (bytes > 0)
+   {
+      bytes = recvMax(pi, buf, 32, bytes);
+   }
+
+   _pmu(pi);
+
+   return bytes;
+}
+
+int i2c_read_i2c_block_data(
+   int pi, unsigned handle, unsigned reg, char *buf, uint32_t count)
+{
+   int bytes;
+   gpioExtent_t ext[1];
+
+   /*
+   p1=handle
+   p2=reg
+   p3=4
+   ## extension ##
+   uint32_t count
+   */
+
+   ext[0].size = sizeof(uint32_t);
+   ext[0].ptr = &count;
+
+   bytes = pigpio_command_ext
+      (pi, PI_CMD_I2CRI, handle, reg, 4, 1, ext, 0);
+
+   if (bytes > 0)
+   {
+      bytes = recvMax(pi, buf, count, bytes);
+   }
+
+   _pmu(pi);
+
+   return bytes;
+}
+
+
+int i2c_write_i2c_block_data(
+   int pi, unsigned handle, unsigned reg, char *buf, unsigned count)
+{
+   gpioExtent_t ext[1];
+
+   /*
+   p1=handle
+   p2=reg
+   p3=count
+   ## extension ##
+   char buf[count]
+   */
+
+   ext[0].size = count;
+   ext[0].ptr = buf;
+
+   return pigpio_command_ext
+      (pi, PI_CMD_I2CWI, handle, reg, count, 1, ext, 1);
+}
+
+int i2c_read_device(int pi, unsigned handle, char *buf, unsigned count)
+{
+   int bytes;
+
+   bytes = pigpio_command(pi, PI_CMD_I2CRD, handle, count, 0);
+
+   if (bytes > 0)
+   {
+      bytes = recvMax(pi, buf, count, bytes);
+   }
+
+   _pmu(pi);
+
+   return bytes;
+}
+
+int i2c_write_device(int pi, unsigned handle, char *buf, unsigned count)
+{
+   gpioExtent_t ext[1];
+
+   /*
+   p1=handle
+   p2=0
+   p3=count
+   ## extension ##
+   char buf[count]
+   */
+
+   ext[0].size = count;
+   ext[0].ptr = buf;
+
+   return pigpio_command_ext
+      (pi, PI_CMD_I2CWD, handle, 0, count, 1, ext, 1);
+}
+
+int i2c_zip(
+   int      pi,
+   unsigned handle,
+   char    *inBuf,
+   unsigned inLen,
+   char    *outBuf,
+   unsigned outLen)
+{
+   int bytes;
+   gpioExtent_t ext[1];
+
+   /*
+   p1=handle
+   p2=0
+   p3=inLen
+   ## extension ##
+   char inBuf[inLen]
+   */
+
+   ext[0].size = inLen;
+   ext[0].ptr = inBuf;
+
+   bytes = pigpio_command_ext
+      (pi, PI_CMD_I2CZ, handle, 0, inLen, 1, ext, 0);
+
+   if (bytes > 0)
+   {
+      bytes = recvMax(pi, outBuf, outLen, bytes);
+   }
+
+   _pmu(pi);
+
+   return bytes;
+}
+
+int bb_i2c_open(int pi, unsigned SDA, unsigned SCL, unsigned baud)
+{
+   gpioExtent_t ext[1];
+
+   /*
+   p1=SDA
+   p2=SCL
+   p3=4
+   ## extension ##
+   uint32_t baud
+   */
+
+   ext[0].size = sizeof(uint32_t);
+   ext[0].ptr = &baud;
+
+   return pigpio_command_ext
+      (pi, PI_CMD_BI2CO, SDA, SCL, 4, 1, ext, 1);
+}
+
+int bb_i2c_close(int pi, unsigned SDA)
+   {return pigpio_command(pi, PI_CMD_BI2CC, SDA, 0, 1);}
+
+int bb_i2c_zip(
+   int      pi,
+   unsigned SDA,
+   char    *inBuf,
+   unsigned inLen,
+   char    *outBuf,
+   unsigned outLen)
+{
+   int bytes;
+   gpioExtent_t ext[1];
+
+   /*
+   p1=SDA
+   p2=0
+   p3=inLen
+   ## extension ##
+   char inBuf[inLen]
+   */
+
+   ext[0].size = inLen;
+   ext[0].ptr = inBuf;
+
+   bytes = pigpio_command_ext
+      (pi, PI_CMD_BI2CZ, SDA, 0, inLen, 1, ext, 0);
+
+   if (bytes > 0)
+   {
+      bytes = recvMax(pi, outBuf, outLen, bytes);
+   }
+
+   _pmu(pi);
+
+   return bytes;
+}
+
+int spi_open(int pi, unsigned channel, unsigned speed, uint32_t flags)
+{
+   gpioExtent_t ext[1];
+
+   /*
+   p1=channel
+   p2=speed
+   p3=4
+   ## extension ##
+   uint32_t flags
+   */
+
+   ext[0].size = sizeof(uint32_t);
+   ext[0].ptr = &flags;
+
+   return pigpio_command_ext
+      (pi, PI_CMD_SPIO, channel, speed, 4, 1, ext, 1);
+}
+
+int spi_close(int pi, unsigned handle)
+   {return pigpio_command(pi, PI_CMD_SPIC, handle, 0, 1);}
+
+int spi_read(int pi, unsigned handle, char *buf, unsigned count)
+{
+   int bytes;
+
+   bytes = pigpio_command
+      (pi, PI_CMD_SPIR, handle, count, 0);
+
+   if (bytes > 0)
+   {
+      bytes = recvMax(pi, buf, count, bytes);
+   }
+
+   _pmu(pi);
+
+   return bytes;
+}
+
+int spi_write(int pi, unsigned handle, char *buf, unsigned count)
+{
+   gpioExtent_t ext[1];
+
+   /*
+   p1=handle
+   p2=0
+   p3=count
+   ## extension ##
+   char buf[count]
+   */
+
+   ext[0].size = count;
+   ext[0].ptr = buf;
+
+   return pigpio_command_ext
+      (pi, PI_CMD_SPIW, handle, 0, count, 1, ext, 1);
+}
+
+int spi_xfer(int pi, unsigned handle, char *txBuf, char *rxBuf, unsigned count)
+{
+   int bytes;
+   gpioExtent_t ext[1];
+
+   /*
+   p1=handle
+   p2=0
+   p3=count
+   ## extension ##
+   char buf[count]
+   */
+
+   ext[0].size = count;
+   ext[0].ptr = txBuf;
+
+   bytes = pigpio_command_ext
+      (pi, PI_CMD_SPIX, handle, 0, count, 1, ext, 0);
+
+   if (bytes > 0)
+   {
+      bytes = recvMax(pi, rxBuf, count, bytes);
+   }
+
+   _pmu(pi);
+
+   return bytes;
+}
+
+int spi_segments(int pi, unsigned handle, pi_spi_seg_t *segs, unsigned numSegs)
+{
+   int i, bytes, size, pos;
+   uint16_t len, flags;
+   char *buf;
+   gpioExtent_t ext[1];
+
+   /*
+   p1=handle
+   p2=0
+   p3=size
+   ## extension ##
+   for each segment
+      uint16_t len, uint16_t flags, uint32_t baud, uint32_t delay
+      char tx[len]
+   */
+
+   if (!segs || !numSegs || (numSegs > PI_SPI_MAX_SEGS))
+      return PI_BAD_SPI_SEG;
+
+   size = 0;
+
+   for (i=0; i<numSegs; i++) size += 12 + segs[i].len;
+
+   if (size >= CMD_MAX_EXTENSION) return PI_BAD_SPI_COUNT;
+
+   buf = malloc(size);
+
+   if (buf == NULL) return pigif_bad_malloc;
+
+   pos = 0;
+
+   for (i=0; i<numSegs; i++)
+   {
+      len   = segs[i].len;
+      flags = segs[i].flags;
+
+      memcpy(buf+pos,   &len,            2);
+      memcpy(buf+pos+2, &flags,          2);
+      memcpy(buf+pos+4, &segs[i].baud,   4);
+      memcpy(buf+pos+8, &segs[i].delay,  4);
+
+      pos += 12;
+
+      if (segs[i].txBuf) memcpy(buf+pos, segs[i].txBuf, len);
+      else               memset(buf+pos, 0, len);
+
+      pos += len;
+   }
+
+   ext[0].size = size;
+   ext[0].ptr = buf;
+
+   bytes = pigpio_command_ext
+      (pi, PI_CMD_SPISG, handle, 0, size, 1, ext, 0);
+
+   if (bytes > 0)
+   {
+      bytes = recvMax(pi, buf, size, bytes);
+
+      /* the reply is each segment's read data, concatenated */
+
+      pos = 0;
+
+      for (i=0; (i<numSegs) && (pos<bytes); i++)
+      {
+         len = segs[i].len;
+
+         if (len > (bytes - pos)) len = bytes - pos;
+
+         if (segs[i].rxBuf) memcpy(segs[i].rxBuf, buf+pos, len);
+
+         pos += len;
+      }
+   }
+
+   _pmu(pi);
+
+   free(buf);
+
+   return bytes;
+}
+
+int serial_open(int pi, char *dev, unsigned baud, unsigned flags)
+{
+   int len;
+   gpioExtent_t ext[1];
+
+   len = strlen(dev);
+
+   /*
+   p1=baud
+   p2=flags
+   p3=len
+   ## extension ##
+   char dev[len]
+   */
+
+   ext[0].size = len;
+   ext[0].ptr = dev;
+
+   return pigpio_command_ext
+      (pi, PI_CMD_SERO, baud, flags, len, 1, ext, 1);
+}
+
+int serial_close(int pi, unsigned handle)
+   {return pigpio_command(pi, PI_CMD_SERC, handle, 0, 1);}
+
+int serial_write_byte(int pi, unsigned handle, unsigned val)
+   {return pigpio_command(pi, PI_CMD_SERWB, handle, val, 1);}
+
+int serial_read_byte(int pi, unsigned handle)
+   {return pigpio_command(pi, PI_CMD_SERRB, handle, 0, 1);}
+
+int serial_write(int pi, unsigned handle, char *buf, unsigned count)
+{
+   gpioExtent_t ext[1];
+
+   /*
+   p1=handle
+   p2=0
+   p3=count
+   ## extension ##
+   char buf[count]
+   */
+
+   ext[0].size = count;
+   ext[0].ptr = buf;
+
+   return pigpio_command_ext
+      (pi, PI_CMD_SERW, handle, 0, count, 1, ext, 1);
+}
+
+int serial_read(int pi, unsigned handle, char *buf, unsigned count)
+{
+   int bytes;
+
+   bytes = pigpio_command
+      (pi, PI_CMD_SERR, handle, count, 0);
+
+   if (bytes > 0)
+   {
+      bytes = recvMax(pi, buf, count, bytes);
+   }
+
+   _pmu(pi);
+
+   return bytes;
+}
+
+int serial_data_available(int pi, unsigned handle)
+   {return pigpio_command(pi, PI_CMD_SERDA, handle, 0, 1);}
+
+int serial_notify_start(
+   int pi, unsigned handle, unsigned ser_handle,
+   unsigned delim, unsigned count)
+{
+   gpioExtent_t ext[2];
+
+   /*
+   p1=handle
+   p2=ser_handle
+   p3=8
+   ## extension ##
+   uint32_t delim
+   uint32_t count
+   */
+
+   ext[0].size = 4;
+   ext[0].ptr = &delim;
+
+   ext[1].size = 4;
+   ext[1].ptr = &count;
+
+   return pigpio_command_ext
+      (pi, PI_CMD_SERNON, handle, ser_handle, 8, 2, ext, 1);
+}
+
+int serial_notify_stop(int pi, unsigned ser_handle)
+   {return pigpio_command(pi, PI_CMD_SERNOFF, ser_handle, 0, 1);}
+
+int serial_callback(
+   int pi, unsigned ser_handle, unsigned delim, unsigned count,
+   serCBFunc_t f, void *userdata)
+{
+   callback_t *p;
+   batch_t *batch;
+   int status;
+
+   if (badPi(pi)) return pigif_unconnected_pi;
+
+   if ((ser_handle >= 32) || (f == NULL)) return pigif_bad_callback;
+
+   pthread_mutex_lock(&gCallBackMutex);
+
+   p = gCallBackFirst;
+
+   while (p)
+   {
+      if ((p->pi == pi) && (p->kind == CB_SERIAL) && (p->gpio == ser_handle))
+      {
+         pthread_mutex_unlock(&gCallBackMutex);
+         return pigif_duplicate_callback;
+      }
+      p = p->next;
+   }
+
+   p = malloc(sizeof(callback_t));
+
+   if (p == NULL)
+   {
+      pthread_mutex_unlock(&gCallBackMutex);
+      return pigif_bad_malloc;
+   }
+
+   p->id = gCallBackId++;
+   p->pi = pi;
+   p->gpio = ser_handle;
+   p->edge = 0;
+   p->kind = CB_SERIAL;
+   p->f = f;
+   p->user = userdata;
+   p->ex = 1;
+   p->got = 0;
+   p->tick = 0;
+   p->next = 0;
+   p->prev = gCallBackLast;
+
+   if (p->prev) (p->prev)->next = p; else gCallBackFirst = p;
+   gCallBackLast = p;
+
+   /* never queued in a batch, reports only flow once NB has been sent */
+
+   batch = tBatch;
+   tBatch = NULL;
+
+   send_command(pi, PI_CMD_NB, gPigHandle[pi], gNotifyBits[pi], 1);
+
+   status = serial_notify_start(pi, gPigHandle[pi], ser_handle, delim, count);
+
+   tBatch = batch;
+
+   if (status < 0)
+   {
+      unlinkCallback(p);
+      pthread_mutex_unlock(&gCallBackMutex);
+      return status;
+   }
+
+   status = p->id;
+
+   pthread_mutex_unlock(&gCallBackMutex);
+
+   return status;
+}
+
+int custom_1(int pi, unsigned arg1, unsigned arg2, char *argx, unsigned count)
+{
+   gpioExtent_t ext[1];
+
+   /*
+   p1=arg1
+   p2=arg2
+   p3=count
+   ## extension ##
+   char argx[count]
+   */
+
+   ext[0].size = count;
+   ext[0].ptr = argx;
+
+   return pigpio_command_ext(
+      pi, PI_CMD_CF1, arg1, arg2, count, 1, ext, 1);
+}
+
+
+int custom_2(int pi, unsigned arg1, char *argx, unsigned count,
+             char *retBuf, uint32_t retMax)
+{
+   int bytes;
+   gpioExtent_t ext[1];
+
+   /*
+   p1=arg1
+   p2=retMax
+   p3=count
+   ## extension ##
+   char argx[count]
+   */
+
+   ext[0].size = count;
+   ext[0].ptr = argx;
+
+   bytes = pigpio_command_ext
+      (pi, PI_CMD_CF2, arg1, retMax, count, 1, ext, 0);
+
+   if (bytes > 0)
+   {
+      bytes = recvMax(pi, retBuf, retMax, bytes);
+   }
+
+   _pmu(pi);
+
+   return bytes;
+}
+
+int batch_begin(int pi)
+{
+   if (badPi(pi)) return pigif_unconnected_pi;
+
+   if (tBatch) return pigif_bad_batch;
+
+   tBatch = malloc(sizeof(batch_t));
+
+   if (tBatch == NULL) return pigif_bad_malloc;
+
+   tBatch->buf = malloc(CMD_MAX_EXTENSION);
+
+   if (tBatch->buf == NULL)
+   {
+      free(tBatch);
+      tBatch = NULL;
+      return pigif_bad_malloc;
+   }
+
+   tBatch->pi    = pi;
+   tBatch->len   = 0;
+   tBatch->count = 0;
+
+   return 0;
+}
+
+int batch_cancel(int pi)
+{
+   if ((!tBatch) || (tBatch->pi != pi)) return pigif_bad_batch;
+
+   free(tBatch->buf);
+   free(tBatch);
+
+   tBatch = NULL;
+
+   return 0;
+}
+
+int batch_send(int pi)
+{
+   cmdCmd_t cmd;
+   batch_t *b;
+   int seq, fd;
+
+   if ((!tBatch) || (tBatch->pi != pi)) return pigif_bad_batch;
+
+   b = tBatch;
+   tBatch = NULL;
+
+   if (badPi(pi))
+   {
+      free(b->buf);
+      free(b);
+      return pigif_unconnected_pi;
+   }
+
+   /* batches always use the first socket so their replies are found */
+
+   pthread_mutex_lock(&gPigCommand[pi][0].mutex);
+
+   fd = gPigCommand[pi][0].fd;
+
+   seq = (gBatchSeq[pi]++) & 0x7FFFFFFF;
+
+   cmd.cmd = PI_CMD_BATCH;
+   cmd.p1  = b->count;
+   cmd.p2  = seq;
+   cmd.p3  = b->len;
+
+   if ((send(fd, &cmd, sizeof(cmd), 0) != sizeof(cmd)) ||
+       (send(fd, b->buf, b->len, 0) != b->len))
+   {
+      seq = pigif_bad_send;
+   }
+   else gBatchPending[pi]++;
+
+   pthread_mutex_unlock(&gPigCommand[pi][0].mutex);
+
+   free(b->buf);
+   free(b);
+
+   return seq;
+}
+
+int batch_collect(int pi, unsigned seq, int *results, unsigned maxResults)
+{
+   batchReply_t *r, **prev;
+   cmdCmd_t cmd;
+   int i, status, fd;
+
+   if (badPi(pi)) return pigif_unconnected_pi;
+
+   pthread_mutex_lock(&gPigCommand[pi][0].mutex);
+
+   fd = gPigCommand[pi][0].fd;
+
+   while (1)
+   {
+      for (prev=&gBatchReplies[pi]; *prev; prev=&((*prev)->next))
+      {
+         if ((*prev)->seq == seq) break;
+      }
+
+      if (*prev) break;
+
+      if (!gBatchPending[pi])
+      {
+         pthread_mutex_unlock(&gPigCommand[pi][0].mutex);
+         return pigif_bad_batch;
+      }
+
+      /* only batch replies can be outstanding */
+
+      if ((recv_reply(pi, fd, PI_CMD_BATCH, &cmd)) ||
+          (cmd.cmd != PI_CMD_BATCH) ||
+          (batch_stash(pi, fd, &cmd)))
+      {
+         pthread_mutex_unlock(&gPigCommand[pi][0].mutex);
+         return pigif_bad_recv;
+      }
+   }
+
+   r = *prev;
+   *prev = r->next;
+
+   pthread_mutex_unlock(&gPigCommand[pi][0].mutex);
+
+   if (r->status < 0) status = r->status;
+   else
+   {
+      status = r->count;
+
+      for (i=0; (i<r->count) && (i<maxResults); i++)
+         results[i] = r->results[i];
+   }
+
+   free(r->results);
+   free(r);
+
+   return status;
+}
+
+int batch_commit(int pi, int *results, unsigned maxResults)
+{
+   int seq;
+
+   seq = batch_send(pi);
+
+   if (seq < 0) return seq;
+
+   return batch_collect(pi, seq, results, maxResults);
+}
+
+int callback(int pi, unsigned user_gpio, unsigned edge, CBFunc_t f)
+   {return intCallback(pi, user_gpio, edge, f, 0, 0);}
+
+int callback_ex(
+   int pi, unsigned user_gpio, unsigned edge, CBFuncEx_t f, void *user)
+   {return intCallback(pi, user_gpio, edge, f, user, 1);}
+
+int callback_cancel(unsigned id)
+{
+   callback_t *p;
+   int pi;
+
+   pthread_once(&gCallBackOnce, initCallBackMutex);
+
+   pthread_mutex_lock(&gCallBackMutex);
+
+   p = gCallBackFirst;
+
+   while (p)
+   {
+      if (p->id == id)
+      {
+         pi = p->pi;
+
+         if (p->kind == CB_SERIAL)
+            send_command(pi, PI_CMD_SERNOFF, p->gpio, 0, 1);
+         else if (p->kind == CB_POLL)
+            send_command(pi, PI_CMD_POLLOFF, p->gpio, 0, 1);
+
+         unlinkCallback(p);
+
+         findNotifyBits(pi);
+
+         pthread_mutex_unlock(&gCallBackMutex);
+
+         return 0;
+      }
+      p = p->next;
+   }
+
+   pthread_mutex_unlock(&gCallBackMutex);
+
+   return pigif_callback_not_found;
+}
+
+int wait_for_edge(int pi, unsigned user_gpio, unsigned edge, double timeout)
+{
+   int triggered = 0;
+   int id;
+   double due;
+
+   if (timeout <= 0.0) return 0;
+
+   due = time_time() + timeout;
+
+   id = callback_ex(pi, user_gpio, edge, _wfe, &triggered);
+
+   if (id < 0) return id;
+
+   while (!triggered && (time_time() < due)) time_sleep(0.1);
+
+   callback_cancel(id);
+
+   return triggered;
+}
+
@@ -140,6 +140,7 @@ void print_result(int sock, int rv, cmdCmd_t cmd)
 {
    int i, r, ch;
    uint32_t *p;
+   uint64_t tick;
 
    r = cmd.res;
 
@@ -171,7 +172,7 @@ void print_result(int sock, int rv, cmdCmd_t cmd)
          printf(cmdUsage);
          break;
 
-      case 6: /* BI2CZ CF2 I2CPK I2CRD I2CRI I2CRK I2CZ SERR SLR SPIX SPIR */
+      case 6: /* BI2CZ CF2 I2CPK I2CRD I2CRI I2CRK I2CZ SERR SLR SPISG SPIX SPIR */
          printf("%d", r);
          if (r < 0) fatal("ERROR: %s", cmdErrStr(r));
          if (r > 0)
@@ -212,32 +213,43 @@ void print_result(int sock, int rv, cmdCmd_t cmd)
          }
          printf("\n");
          break;
+
+      case 8: /* T64 */
+         if (r != 8)
+         {
+            printf("%d\n", r);
+            fatal("ERROR: %s", cmdErrStr(r));
+         }
+         else
+         {
+            memcpy(&tick, response_buf, 8);
+            printf("%llu\n", (unsigned long long)tick);
+         }
+         break;
+
+      case 9: /* CAPST */
+         if (r != 12)
+         {
+            printf("%d\n", r);
+            fatal("ERROR: %s", cmdErrStr(r));
+         }
+         else
+         {
+            p = (uint32_t *)response_buf;
+            printf("%d %u %u\n", p[0], p[1], p[2]);
+         }
+         break;
    }
 }
 
 void get_extensions(int sock, int command, int res)
 {
-   switch (command)
+   /* the daemon and clients share the list of extended replies */
+
+   if (cmdReplyExt(command) && (res > 0))
    {
-      case PI_CMD_BI2CZ:
-      case PI_CMD_CF2:
-      case PI_CMD_I2CPK:
-      case PI_CMD_I2CRD:
-      case PI_CMD_I2CRI:
-      case PI_CMD_I2CRK:
-      case PI_CMD_I2CZ:
-      case PI_CMD_PROCP:
-      case PI_CMD_SERR:
-      case PI_CMD_SLR:
-      case PI_CMD_SPIX:
-      case PI_CMD_SPIR:
-
-         if (res > 0)
-         {
-            recv(sock, response_buf, res, MSG_WAITALL);
-            response_buf[res] = 0;
-         }
-         break;
+      recv(sock, response_buf, res, MSG_WAITALL);
+      response_buf[res] = 0;
    }
 }
 
@@ -2,6 +2,11 @@
 gcc -o x_pigpio x_pigpio.c -lpigpio -lrt -lpthread
 sudo ./x_pigpio
 
+sudo ./x_pigpio d # script benchmark, interpreted against compiled
+sudo ./x_pigpio e # SPI poll job, no SPI device need be connected
+sudo ./x_pigpio f # serial notify, on a pseudo terminal
+sudo ./x_pigpio g # gpio group, drives gpios 4 17 18 22 23 24 25 27
+
 *** WARNING ************************************************
 *                                                          *
 * All the tests make extensive use of gpio 4 (pin P1-7).   *
@@ -19,6 +24,7 @@ sudo ./x_pigpio
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/ioctl.h>
 #include <unistd.h>
 #include <string.h>
 #include <ctype.h>
@@ -833,6 +839,319 @@ void tc()
    CHECK(12, 99, e, 0, 0, "spiClose");
 }
 
+int td_run(char *script, int loops, uint32_t *result)
+{
+   int s, e;
+   uint32_t p[10];
+   double t0, t1;
+
+   s = gpioStoreScript(script);
+
+   if (s < 0) return s;
+
+   while (1)
+   {
+      /* loop until script initialised */
+      time_sleep(0.01);
+      e = gpioScriptStatus(s, p);
+      if (e != PI_SCRIPT_INITING) break;
+   }
+
+   p[0] = loops;
+   p[1] = GPIO;
+
+   t0 = time_time();
+
+   gpioRunScript(s, 2, p);
+
+   while (1)
+   {
+      time_sleep(0.001);
+      e = gpioScriptStatus(s, p);
+      if (e != PI_SCRIPT_RUNNING) break;
+   }
+
+   t1 = time_time();
+
+   *result = p[9];
+
+   gpioDeleteScript(s);
+
+   return (t1 - t0) * 1000000.0;
+}
+
+void td()
+{
+   /* instructions per loop and script, loop count in p0, gpio in p1 */
+
+   static struct {int per_loop; char *name; char *script;} bench[]=
+   {
+      {6, "arithmetic",
+       "tag 1 add 1 xor 5 and 255 or 3 dcr p0 jnz 1 sta p9"},
+
+      {4, "bit bang write",
+       "tag 1 w p1 1 w p1 0 dcr p0 jnz 1 ld p9 0"},
+
+      {5, "read",
+       "ld v0 0 tag 1 r p1 or v0 sta v0 dcr p0 jnz 1 sta p9"},
+
+      {5, "call/return",
+       "ld v1 0 tag 1 call 2 dcr p0 jnz 1 ld p9 v1 halt tag 2 inr v1 ret"},
+   };
+
+   int b, loops, us[2];
+   uint32_t cfg, res[2];
+   double ips[2];
+
+   printf("Script benchmark tests.\n");
+
+   gpioSetMode(GPIO, PI_OUTPUT);
+
+   cfg = gpioCfgGetInternals();
+
+   loops = 200000;
+
+   for (b=0; b<(sizeof(bench)/sizeof(bench[0])); b++)
+   {
+      /* before, interpreted */
+
+      gpioCfgSetInternals(cfg | PI_CFG_NOSCRIPTCOMPILE);
+      us[0] = td_run(bench[b].script, loops, &res[0]);
+
+      /* after, compiled */
+
+      gpioCfgSetInternals(cfg & (~PI_CFG_NOSCRIPTCOMPILE));
+      us[1] = td_run(bench[b].script, loops, &res[1]);
+
+      ips[0] = (us[0] > 0) ? (1E6 * loops * bench[b].per_loop) / us[0] : 0;
+      ips[1] = (us[1] > 0) ? (1E6 * loops * bench[b].per_loop) / us[1] : 0;
+
+      printf("%-15s interpreted %10.0f instr/s, compiled %10.0f instr/s",
+         bench[b].name, ips[0], ips[1]);
+
+      if (ips[0] > 0) printf(" (x%.1f)\n", ips[1] / ips[0]);
+      else            printf("\n");
+
+      CHECK(13, b+1, res[1], res[0], 0, "compiled result");
+   }
+
+   gpioCfgSetInternals(cfg);
+
+   gpioWrite(GPIO, 0);
+}
+
+void te()
+{
+   int h, e, f, b, n, job, spi, fails, other;
+   gpioReport_t r;
+   char p[32], reg;
+
+   printf("Poll job tests.\n");
+
+   h = gpioNotifyOpen();
+   e = gpioNotifyBegin(h, 0);
+   CHECK(14, 1, e, 0, 0, "notify open/begin");
+
+   sprintf(p, "/dev/pigpio%d", h);
+
+   f = open(p, O_RDONLY);
+
+   spi = spiOpen(0, 500000, 0);
+   CHECK(14, 2, spi, 0, 0, "spiOpen");
+
+   /* read 2 bytes after sending a register number every 10 ms */
+
+   reg = 0x80;
+
+   job = gpioPollStart(h, PI_POLL_SPI, spi, 10000, &reg, 1, 2);
+   CHECK(14, 3, job, 0, 0, "gpioPollStart");
+
+   time_sleep(1);
+
+   e = gpioPollStop(job);
+   CHECK(14, 4, e, 0, 0, "gpioPollStop");
+
+   e = gpioPollStop(job);
+   CHECK(14, 5, e, PI_BAD_HANDLE, 0, "gpioPollStop again");
+
+   e = gpioNotifyClose(h);
+   CHECK(14, 6, e, 0, 0, "notify close");
+
+   n = 0;
+   fails = 0;
+   other = 0;
+
+   while (1)
+   {
+      b = read(f, &r, 12);
+      if (b == 12)
+      {
+         if ((r.flags & PI_NTFY_FLAGS_POLL) && ((r.flags & 31) == job))
+         {
+            if (r.flags & PI_NTFY_FLAGS_FAIL) fails++;
+            else if ((r.flags >> 10) & 7) other++; /* one part per reading */
+            else n++;
+         }
+         else other++;
+      }
+      else break;
+   }
+
+   close(f);
+
+   CHECK(14, 7, n, 100, 10, "number of readings");
+
+   CHECK(14, 8, fails, 0, 0, "failed transfers");
+
+   CHECK(14, 9, other, 0, 0, "other reports");
+
+   e = spiClose(spi);
+   CHECK(14, 10, e, 0, 0, "spiClose");
+}
+
+void tf()
+{
+   int h, e, f, b, n, m, i, ser, other, pts, unlock;
+   gpioReport_t r;
+   char p[32], got[64], *tty;
+
+   printf("Serial notify tests.\n");
+
+   /* a pseudo terminal stands in for a serial device */
+
+   tty = "/dev/ttyx_pigpio";
+
+   unlock = 0;
+
+   m = open("/dev/ptmx", O_RDWR | O_NOCTTY);
+   ioctl(m, TIOCSPTLCK, &unlock);
+   ioctl(m, TIOCGPTN, &pts);
+
+   sprintf(p, "/dev/pts/%d", pts);
+
+   unlink(tty);
+   e = symlink(p, tty);
+   CHECK(15, 1, e, 0, 0, "pseudo terminal");
+
+   h = gpioNotifyOpen();
+   e = gpioNotifyBegin(h, 0);
+   CHECK(15, 2, e, 0, 0, "notify open/begin");
+
+   sprintf(p, "/dev/pigpio%d", h);
+
+   f = open(p, O_RDONLY);
+
+   ser = serOpen(tty, 9600, 0);
+   CHECK(15, 3, ser, 0, 0, "serOpen");
+
+   e = serNotifyStart(h, ser, '\n', 0);
+   CHECK(15, 4, e, 0, 0, "serNotifyStart");
+
+   /* only the bytes up to the last newline are sent */
+
+   write(m, "hello\nworld", 11);
+
+   time_sleep(0.5);
+
+   e = serDataAvailable(ser);
+   CHECK(15, 5, e, 5, 0, "serDataAvailable");
+
+   e = serNotifyStop(ser);
+   CHECK(15, 6, e, 0, 0, "serNotifyStop");
+
+   e = gpioNotifyClose(h);
+   CHECK(15, 7, e, 0, 0, "notify close");
+
+   n = 0;
+   other = 0;
+
+   while (1)
+   {
+      b = read(f, &r, 12);
+      if (b == 12)
+      {
+         if ((r.flags & PI_NTFY_FLAGS_SER) && ((r.flags & 31) == ser))
+         {
+            for (i=0; i<((r.flags >> 10) & 7); i++)
+            {
+               if (n < sizeof(got)) got[n++] = r.level >> (i * 8);
+            }
+         }
+         else other++;
+      }
+      else break;
+   }
+
+   close(f);
+
+   CHECK(15, 8, n, 6, 0, "bytes sent");
+
+   CHECK(15, 9, strncmp(got, "hello\n", 6), 0, 0, "bytes sent");
+
+   CHECK(15, 10, other, 0, 0, "other reports");
+
+   e = serRead(ser, got, sizeof(got));
+   CHECK(15, 11, e, 5, 0, "serRead");
+
+   CHECK(15, 12, strncmp(got, "world", 5), 0, 0, "serRead");
+
+   e = serClose(ser);
+   CHECK(15, 13, e, 0, 0, "serClose");
+
+   unlink(tty);
+   close(m);
+}
+
+void tg()
+{
+   static unsigned gpio[8]={27, 4, 22, 18, 25, 17, 24, 23};
+
+   int h, e, i, v, bad, mode[8];
+   uint32_t levels, expect, mask;
+
+   printf("Gpio group tests.\n");
+
+   /* nothing should be connected to the group gpios */
+
+   mask = 0;
+
+   for (i=0; i<8; i++)
+   {
+      mode[i] = gpioGetMode(gpio[i]);
+      gpioSetMode(gpio[i], PI_OUTPUT);
+      mask |= (1<<gpio[i]);
+   }
+
+   h = gpioGroupOpen(8, gpio);
+   CHECK(16, 1, h, 0, 0, "gpioGroupOpen");
+
+   bad = 0;
+
+   for (v=0; v<256; v++)
+   {
+      e = gpioGroupWrite(h, v);
+
+      expect = 0;
+
+      for (i=0; i<8; i++) if (v & (1<<i)) expect |= (1<<gpio[i]);
+
+      levels = gpioRead_Bits_0_31() & mask;
+
+      if (e || (levels != expect)) bad++;
+   }
+
+   CHECK(16, 2, bad, 0, 0, "group write readback");
+
+   e = gpioGroupClose(h);
+   CHECK(16, 3, e, 0, 0, "gpioGroupClose");
+
+   for (i=0; i<8; i++)
+   {
+      gpioWrite(gpio[i], 0);
+      gpioSetMode(gpio[i], mode[i]);
+   }
+}
+
 int main(int argc, char *argv[])
 {
    int i, t, c, status;
@@ -877,6 +1196,10 @@ int main(int argc, char *argv[])
    if (strchr(test, 'a')) ta();
    if (strchr(test, 'b')) tb();
    if (strchr(test, 'c')) tc();
+   if (strchr(test, 'd')) td();
+   if (strchr(test, 'e')) te();
+   if (strchr(test, 'f')) tf();
+   if (strchr(test, 'g')) tg();
 
    gpioTerminate();
 